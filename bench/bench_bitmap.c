@@ -0,0 +1,242 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Codec and GDI Microbenchmarks, Bitmap Decompression and Color Conversion
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/update.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/codec/color.h>
+#include <freerdp/codec/bitmap.h>
+
+#include "bench_freerdp.h"
+
+/* servers send bitmap updates as 64x64 tiles */
+#define BITMAP_TILE_SIZE	64
+
+/* compress every tile of the synthetic desktop the way a server would */
+static LIST* bench_bitmap_tiles_new(BENCH* bench, int bpp)
+{
+	int x, y, j;
+	int length;
+	uint8* tile;
+	uint8* buffer;
+	BENCH_BITMAP* bitmap;
+	LIST* tiles;
+	BENCH_INPUT* input = bench->input;
+
+	tiles = list_new();
+	tile = (uint8*) xmalloc(BITMAP_TILE_SIZE * BITMAP_TILE_SIZE * 4);
+	buffer = (uint8*) xmalloc(BITMAP_TILE_SIZE * BITMAP_TILE_SIZE * 4 + 64);
+
+	for (y = 0; y < input->height; y += BITMAP_TILE_SIZE)
+	{
+		for (x = 0; x < input->width; x += BITMAP_TILE_SIZE)
+		{
+			for (j = 0; j < BITMAP_TILE_SIZE; j++)
+			{
+				memcpy(&tile[j * BITMAP_TILE_SIZE * 4], &input->desktop[((y + j) * input->width + x) * 4],
+					BITMAP_TILE_SIZE * 4);
+			}
+
+			if (bpp == 32)
+				length = bench_encode_planar(buffer, tile, BITMAP_TILE_SIZE, BITMAP_TILE_SIZE);
+			else
+				length = bench_encode_interleaved(buffer, tile, BITMAP_TILE_SIZE, BITMAP_TILE_SIZE, bpp);
+
+			bitmap = xnew(BENCH_BITMAP);
+			bitmap->width = BITMAP_TILE_SIZE;
+			bitmap->height = BITMAP_TILE_SIZE;
+			bitmap->bpp = bpp;
+			bitmap->length = length;
+			bitmap->data = (uint8*) xmalloc(length);
+			memcpy(bitmap->data, buffer, length);
+
+			list_enqueue(tiles, bitmap);
+		}
+	}
+
+	xfree(tile);
+	xfree(buffer);
+
+	return tiles;
+}
+
+static void bench_bitmap_tiles_free(LIST* tiles)
+{
+	BENCH_BITMAP* bitmap;
+
+	while ((bitmap = (BENCH_BITMAP*) list_dequeue(tiles)) != NULL)
+	{
+		xfree(bitmap->data);
+		xfree(bitmap);
+	}
+
+	list_free(tiles);
+}
+
+static void bench_bitmap_decompress(BENCH* bench, LIST* bitmaps)
+{
+	int size;
+	uint64 bytes;
+	uint8* buffer;
+	LIST_ITEM* item;
+	BENCH_BITMAP* bitmap;
+
+	if (list_size(bitmaps) < 1)
+	{
+		bench_skip(bench);
+		return;
+	}
+
+	size = 0;
+	bytes = 0;
+
+	for (item = bitmaps->head; item; item = item->next)
+	{
+		bitmap = (BENCH_BITMAP*) item->data;
+		size = MAX(size, bitmap->width * bitmap->height * 4);
+		bytes += bitmap->width * bitmap->height * ((bitmap->bpp + 7) / 8);
+	}
+
+	buffer = (uint8*) xmalloc(size);
+	bench_set_bytes(bench, bytes);
+
+	while (bench_next(bench))
+	{
+		for (item = bitmaps->head; item; item = item->next)
+		{
+			bitmap = (BENCH_BITMAP*) item->data;
+			bitmap_decompress(bitmap->data, buffer, bitmap->width, bitmap->height,
+				bitmap->length, bitmap->bpp, bitmap->bpp);
+		}
+	}
+
+	xfree(buffer);
+}
+
+static void bench_interleaved_16bpp(BENCH* bench)
+{
+	LIST* tiles = bench_bitmap_tiles_new(bench, 16);
+	bench_bitmap_decompress(bench, tiles);
+	bench_bitmap_tiles_free(tiles);
+}
+
+static void bench_interleaved_24bpp(BENCH* bench)
+{
+	LIST* tiles = bench_bitmap_tiles_new(bench, 24);
+	bench_bitmap_decompress(bench, tiles);
+	bench_bitmap_tiles_free(tiles);
+}
+
+static void bench_planar_32bpp(BENCH* bench)
+{
+	LIST* tiles = bench_bitmap_tiles_new(bench, 32);
+	bench_bitmap_decompress(bench, tiles);
+	bench_bitmap_tiles_free(tiles);
+}
+
+static void bench_interleaved_recorded(BENCH* bench)
+{
+	bench_bitmap_decompress(bench, bench->input->interleaved);
+}
+
+static void bench_planar_recorded(BENCH* bench)
+{
+	bench_bitmap_decompress(bench, bench->input->planar);
+}
+
+static void bench_color_convert(BENCH* bench, int srcBpp, int dstBpp)
+{
+	int i;
+	uint8* src;
+	uint8* dst;
+	uint8* pixel;
+	HCLRCONV clrconv;
+	BENCH_INPUT* input = bench->input;
+	int count = input->width * input->height;
+
+	clrconv = freerdp_clrconv_new(CLRCONV_ALPHA);
+	clrconv->palette->count = 256;
+	clrconv->palette->entries = (PALETTE_ENTRY*) xmalloc(sizeof(PALETTE_ENTRY) * 256);
+
+	/* 3-3-2 palette, so that the 8bpp input is the desktop at reduced depth */
+	for (i = 0; i < 256; i++)
+	{
+		clrconv->palette->entries[i].red = (i & 0xE0);
+		clrconv->palette->entries[i].green = (i & 0x1C) << 3;
+		clrconv->palette->entries[i].blue = (i & 0x03) << 6;
+	}
+
+	if (srcBpp == 8)
+	{
+		src = (uint8*) xmalloc(count);
+
+		for (i = 0; i < count; i++)
+		{
+			pixel = &input->desktop[i * 4];
+			src[i] = (pixel[2] & 0xE0) | ((pixel[1] >> 3) & 0x1C) | (pixel[0] >> 6);
+		}
+	}
+	else
+	{
+		src = freerdp_image_convert(input->desktop, NULL, input->width, input->height, 32, srcBpp, clrconv);
+	}
+
+	dst = (uint8*) xmalloc(count * 4);
+	bench_set_bytes(bench, count * ((srcBpp + 7) / 8));
+
+	while (bench_next(bench))
+		freerdp_image_convert(src, dst, input->width, input->height, srcBpp, dstBpp, clrconv);
+
+	if (src != input->desktop)
+		xfree(src);
+
+	xfree(dst);
+	xfree(clrconv->palette->entries);
+	freerdp_clrconv_free(clrconv);
+}
+
+static void bench_color_8to32(BENCH* bench)
+{
+	bench_color_convert(bench, 8, 32);
+}
+
+static void bench_color_16to32(BENCH* bench)
+{
+	bench_color_convert(bench, 16, 32);
+}
+
+static void bench_color_24to32(BENCH* bench)
+{
+	bench_color_convert(bench, 24, 32);
+}
+
+static void bench_color_32to16(BENCH* bench)
+{
+	bench_color_convert(bench, 32, 16);
+}
+
+void add_bitmap_suite(void)
+{
+	add_bench_function("bitmap", interleaved_16bpp);
+	add_bench_function("bitmap", interleaved_24bpp);
+	add_bench_function("bitmap", interleaved_recorded);
+	add_bench_function("bitmap", planar_32bpp);
+	add_bench_function("bitmap", planar_recorded);
+	add_bench_function("bitmap", color_8to32);
+	add_bench_function("bitmap", color_16to32);
+	add_bench_function("bitmap", color_24to32);
+	add_bench_function("bitmap", color_32to16);
+}
@@ -0,0 +1,680 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Codec and GDI Microbenchmarks, RemoteFX, NSCodec and MPPC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/stream.h>
+#include <freerdp/codec/rfx.h>
+#include <freerdp/codec/nsc.h>
+#include <freerdp/codec/mppc_enc.h>
+#include <freerdp/codec/mppc_dec.h>
+
+#include "rfx_types.h"
+#include "rfx_rlgr.h"
+#include "rfx_differential.h"
+
+#include "bench_freerdp.h"
+
+#define MPPC_CHUNK_SIZE		16384
+
+/* LL3, LH3, HL3, HH3, LH2, HL2, HH2, LH1, HL1, HH1, as used by the encoder */
+static const uint32 bench_quantization_values[] =
+{
+	6, 6, 6, 6, 7, 7, 8, 8, 8, 9
+};
+
+/**
+ * Inputs of every RemoteFX stage for all tiles of the synthetic desktop, one
+ * 64x64 block of coefficients per component. Each stage benchmark copies the
+ * input of its stage to the work buffer with the timer paused, then runs the
+ * stage on every block.
+ */
+struct _RFX_STAGES
+{
+	RFX_CONTEXT* context;
+	int tiles;
+	int blocks;
+	size_t size;
+
+	sint16* rgb;
+	sint16* ycbcr;
+	sint16* dwt;
+	sint16* quantized;
+	sint16* differential;
+	sint16* dequantized;
+	sint16* idwt;
+	sint16* work;
+
+	sint16* rlgr;
+	int* rlgr_size;
+};
+typedef struct _RFX_STAGES RFX_STAGES;
+
+#define RFX_BLOCK(_buffer, _index)	(&(_buffer)[(_index) * 4096])
+
+static RFX_STAGES* rfx_stages_new(BENCH* bench)
+{
+	int i, x, y;
+	int tx, ty;
+	int tiles_x;
+	uint8* pixel;
+	RFX_STAGES* stages;
+	BENCH_INPUT* input = bench->input;
+
+	stages = xnew(RFX_STAGES);
+	stages->context = rfx_context_new();
+	rfx_context_set_cpu_opt(stages->context, bench->cpu_opt);
+
+	tiles_x = input->width / 64;
+	stages->tiles = tiles_x * (input->height / 64);
+	stages->blocks = stages->tiles * 3;
+	stages->size = stages->blocks * 4096 * sizeof(sint16);
+
+	stages->rgb = (sint16*) xmalloc(stages->size);
+	stages->ycbcr = (sint16*) xmalloc(stages->size);
+	stages->dwt = (sint16*) xmalloc(stages->size);
+	stages->quantized = (sint16*) xmalloc(stages->size);
+	stages->differential = (sint16*) xmalloc(stages->size);
+	stages->dequantized = (sint16*) xmalloc(stages->size);
+	stages->idwt = (sint16*) xmalloc(stages->size);
+	stages->work = (sint16*) xmalloc(stages->size);
+	stages->rlgr = (sint16*) xmalloc(stages->size);
+	stages->rlgr_size = (int*) xmalloc(stages->blocks * sizeof(int));
+
+	for (i = 0; i < stages->tiles; i++)
+	{
+		tx = (i % tiles_x) * 64;
+		ty = (i / tiles_x) * 64;
+
+		for (y = 0; y < 64; y++)
+		{
+			for (x = 0; x < 64; x++)
+			{
+				pixel = &input->desktop[((ty + y) * input->width + tx + x) * 4];
+				RFX_BLOCK(stages->rgb, i * 3)[y * 64 + x] = pixel[2];
+				RFX_BLOCK(stages->rgb, i * 3 + 1)[y * 64 + x] = pixel[1];
+				RFX_BLOCK(stages->rgb, i * 3 + 2)[y * 64 + x] = pixel[0];
+			}
+		}
+	}
+
+	/* run the encoder and the decoder once to collect the input of each stage */
+	memcpy(stages->ycbcr, stages->rgb, stages->size);
+
+	for (i = 0; i < stages->tiles; i++)
+	{
+		stages->context->encode_rgb_to_ycbcr(RFX_BLOCK(stages->ycbcr, i * 3),
+			RFX_BLOCK(stages->ycbcr, i * 3 + 1), RFX_BLOCK(stages->ycbcr, i * 3 + 2));
+	}
+
+	memcpy(stages->dwt, stages->ycbcr, stages->size);
+
+	for (i = 0; i < stages->blocks; i++)
+		stages->context->dwt_2d_encode(RFX_BLOCK(stages->dwt, i), stages->context->priv->dwt_buffer);
+
+	memcpy(stages->quantized, stages->dwt, stages->size);
+
+	for (i = 0; i < stages->blocks; i++)
+		stages->context->quantization_encode(RFX_BLOCK(stages->quantized, i), bench_quantization_values);
+
+	memcpy(stages->differential, stages->quantized, stages->size);
+
+	for (i = 0; i < stages->blocks; i++)
+		rfx_differential_encode(RFX_BLOCK(stages->differential, i) + 4032, 64);
+
+	for (i = 0; i < stages->blocks; i++)
+	{
+		stages->rlgr_size[i] = rfx_rlgr_encode(RLGR3, RFX_BLOCK(stages->differential, i), 4096,
+			(uint8*) RFX_BLOCK(stages->rlgr, i), 4096 * sizeof(sint16));
+	}
+
+	memcpy(stages->dequantized, stages->quantized, stages->size);
+
+	for (i = 0; i < stages->blocks; i++)
+		stages->context->quantization_decode(RFX_BLOCK(stages->dequantized, i), bench_quantization_values);
+
+	memcpy(stages->idwt, stages->dequantized, stages->size);
+
+	for (i = 0; i < stages->blocks; i++)
+		stages->context->dwt_2d_decode(RFX_BLOCK(stages->idwt, i), stages->context->priv->dwt_buffer);
+
+	bench_set_bytes(bench, stages->tiles * 4096 * 4);
+
+	return stages;
+}
+
+static void rfx_stages_free(RFX_STAGES* stages)
+{
+	rfx_context_free(stages->context);
+
+	xfree(stages->rgb);
+	xfree(stages->ycbcr);
+	xfree(stages->dwt);
+	xfree(stages->quantized);
+	xfree(stages->differential);
+	xfree(stages->dequantized);
+	xfree(stages->idwt);
+	xfree(stages->work);
+	xfree(stages->rlgr);
+	xfree(stages->rlgr_size);
+	xfree(stages);
+}
+
+static void rfx_stages_restore(BENCH* bench, RFX_STAGES* stages, sint16* input)
+{
+	bench_pause(bench);
+	memcpy(stages->work, input, stages->size);
+	bench_resume(bench);
+}
+
+static void bench_rfx_encode_ycbcr(BENCH* bench)
+{
+	int i;
+	RFX_STAGES* stages = rfx_stages_new(bench);
+
+	while (bench_next(bench))
+	{
+		rfx_stages_restore(bench, stages, stages->rgb);
+
+		for (i = 0; i < stages->tiles; i++)
+		{
+			stages->context->encode_rgb_to_ycbcr(RFX_BLOCK(stages->work, i * 3),
+				RFX_BLOCK(stages->work, i * 3 + 1), RFX_BLOCK(stages->work, i * 3 + 2));
+		}
+	}
+
+	rfx_stages_free(stages);
+}
+
+static void bench_rfx_encode_dwt(BENCH* bench)
+{
+	int i;
+	RFX_STAGES* stages = rfx_stages_new(bench);
+
+	while (bench_next(bench))
+	{
+		rfx_stages_restore(bench, stages, stages->ycbcr);
+
+		for (i = 0; i < stages->blocks; i++)
+			stages->context->dwt_2d_encode(RFX_BLOCK(stages->work, i), stages->context->priv->dwt_buffer);
+	}
+
+	rfx_stages_free(stages);
+}
+
+static void bench_rfx_encode_quantization(BENCH* bench)
+{
+	int i;
+	RFX_STAGES* stages = rfx_stages_new(bench);
+
+	while (bench_next(bench))
+	{
+		rfx_stages_restore(bench, stages, stages->dwt);
+
+		for (i = 0; i < stages->blocks; i++)
+			stages->context->quantization_encode(RFX_BLOCK(stages->work, i), bench_quantization_values);
+	}
+
+	rfx_stages_free(stages);
+}
+
+static void bench_rfx_encode_differential(BENCH* bench)
+{
+	int i;
+	RFX_STAGES* stages = rfx_stages_new(bench);
+
+	while (bench_next(bench))
+	{
+		rfx_stages_restore(bench, stages, stages->quantized);
+
+		for (i = 0; i < stages->blocks; i++)
+			rfx_differential_encode(RFX_BLOCK(stages->work, i) + 4032, 64);
+	}
+
+	rfx_stages_free(stages);
+}
+
+static void bench_rfx_encode_rlgr(BENCH* bench)
+{
+	int i;
+	RFX_STAGES* stages = rfx_stages_new(bench);
+
+	while (bench_next(bench))
+	{
+		for (i = 0; i < stages->blocks; i++)
+		{
+			rfx_rlgr_encode(RLGR3, RFX_BLOCK(stages->differential, i), 4096,
+				(uint8*) RFX_BLOCK(stages->work, i), 4096 * sizeof(sint16));
+		}
+	}
+
+	rfx_stages_free(stages);
+}
+
+static void bench_rfx_decode_rlgr(BENCH* bench)
+{
+	int i;
+	RFX_STAGES* stages = rfx_stages_new(bench);
+
+	while (bench_next(bench))
+	{
+		for (i = 0; i < stages->blocks; i++)
+		{
+			rfx_rlgr_decode(RLGR3, (uint8*) RFX_BLOCK(stages->rlgr, i), stages->rlgr_size[i],
+				RFX_BLOCK(stages->work, i), 4096);
+		}
+	}
+
+	rfx_stages_free(stages);
+}
+
+static void bench_rfx_decode_differential(BENCH* bench)
+{
+	int i;
+	RFX_STAGES* stages = rfx_stages_new(bench);
+
+	while (bench_next(bench))
+	{
+		rfx_stages_restore(bench, stages, stages->differential);
+
+		for (i = 0; i < stages->blocks; i++)
+			rfx_differential_decode(RFX_BLOCK(stages->work, i) + 4032, 64);
+	}
+
+	rfx_stages_free(stages);
+}
+
+static void bench_rfx_decode_quantization(BENCH* bench)
+{
+	int i;
+	RFX_STAGES* stages = rfx_stages_new(bench);
+
+	while (bench_next(bench))
+	{
+		rfx_stages_restore(bench, stages, stages->quantized);
+
+		for (i = 0; i < stages->blocks; i++)
+			stages->context->quantization_decode(RFX_BLOCK(stages->work, i), bench_quantization_values);
+	}
+
+	rfx_stages_free(stages);
+}
+
+static void bench_rfx_decode_dwt(BENCH* bench)
+{
+	int i;
+	RFX_STAGES* stages = rfx_stages_new(bench);
+
+	while (bench_next(bench))
+	{
+		rfx_stages_restore(bench, stages, stages->dequantized);
+
+		for (i = 0; i < stages->blocks; i++)
+			stages->context->dwt_2d_decode(RFX_BLOCK(stages->work, i), stages->context->priv->dwt_buffer);
+	}
+
+	rfx_stages_free(stages);
+}
+
+static void bench_rfx_decode_ycbcr(BENCH* bench)
+{
+	int i;
+	RFX_STAGES* stages = rfx_stages_new(bench);
+
+	while (bench_next(bench))
+	{
+		rfx_stages_restore(bench, stages, stages->idwt);
+
+		for (i = 0; i < stages->tiles; i++)
+		{
+			stages->context->decode_ycbcr_to_rgb(RFX_BLOCK(stages->work, i * 3),
+				RFX_BLOCK(stages->work, i * 3 + 1), RFX_BLOCK(stages->work, i * 3 + 2));
+		}
+	}
+
+	rfx_stages_free(stages);
+}
+
+static RFX_CONTEXT* bench_rfx_context_new(BENCH* bench)
+{
+	RFX_CONTEXT* context;
+
+	context = rfx_context_new();
+	context->mode = RLGR3;
+	context->width = bench->input->width;
+	context->height = bench->input->height;
+	rfx_context_set_cpu_opt(context, bench->cpu_opt);
+	rfx_context_set_pixel_format(context, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+	return context;
+}
+
+static void bench_rfx_encode(BENCH* bench)
+{
+	STREAM* s;
+	RFX_RECT rect;
+	RFX_CONTEXT* context;
+	BENCH_INPUT* input = bench->input;
+
+	context = bench_rfx_context_new(bench);
+	s = stream_new(input->width * input->height * 4);
+
+	rect.x = 0;
+	rect.y = 0;
+	rect.width = input->width;
+	rect.height = input->height;
+
+	bench_set_bytes(bench, input->width * input->height * 4);
+
+	while (bench_next(bench))
+	{
+		stream_set_pos(s, 0);
+		rfx_compose_message(context, s, &rect, 1, input->desktop, input->width, input->height, input->width * 4);
+	}
+
+	stream_free(s);
+	rfx_context_free(context);
+}
+
+static void bench_rfx_decode(BENCH* bench)
+{
+	STREAM* s;
+	RFX_RECT rect;
+	RFX_MESSAGE* message;
+	RFX_CONTEXT* encoder;
+	RFX_CONTEXT* decoder;
+	BENCH_INPUT* input = bench->input;
+
+	encoder = bench_rfx_context_new(bench);
+	decoder = bench_rfx_context_new(bench);
+	s = stream_new(input->width * input->height * 4);
+
+	rect.x = 0;
+	rect.y = 0;
+	rect.width = input->width;
+	rect.height = input->height;
+
+	/* the decoder only needs to see the header blocks once */
+	rfx_compose_message_header(encoder, s);
+	message = rfx_process_message(decoder, s->data, stream_get_length(s));
+	rfx_message_free(decoder, message);
+
+	stream_set_pos(s, 0);
+	rfx_compose_message(encoder, s, &rect, 1, input->desktop, input->width, input->height, input->width * 4);
+	stream_seal(s);
+
+	bench_set_bytes(bench, input->width * input->height * 4);
+
+	while (bench_next(bench))
+	{
+		message = rfx_process_message(decoder, s->data, s->size);
+		rfx_message_free(decoder, message);
+	}
+
+	stream_free(s);
+	rfx_context_free(encoder);
+	rfx_context_free(decoder);
+}
+
+static void bench_rfx_decode_recorded(BENCH* bench)
+{
+	uint64 bytes;
+	LIST_ITEM* item;
+	BENCH_BITMAP* bitmap;
+	RFX_MESSAGE* message;
+	RFX_CONTEXT* context;
+
+	if (list_size(bench->input->rfx) < 1)
+	{
+		bench_skip(bench);
+		return;
+	}
+
+	context = rfx_context_new();
+	rfx_context_set_cpu_opt(context, bench->cpu_opt);
+	rfx_context_set_pixel_format(context, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+	bytes = 0;
+
+	for (item = bench->input->rfx->head; item; item = item->next)
+	{
+		bitmap = (BENCH_BITMAP*) item->data;
+		bytes += bitmap->width * bitmap->height * 4;
+	}
+
+	bench_set_bytes(bench, bytes);
+
+	while (bench_next(bench))
+	{
+		for (item = bench->input->rfx->head; item; item = item->next)
+		{
+			bitmap = (BENCH_BITMAP*) item->data;
+			message = rfx_process_message(context, bitmap->data, bitmap->length);
+			rfx_message_free(context, message);
+		}
+	}
+
+	rfx_context_free(context);
+}
+
+static void bench_nsc_encode(BENCH* bench)
+{
+	STREAM* s;
+	NSC_CONTEXT* context;
+	BENCH_INPUT* input = bench->input;
+
+	context = nsc_context_new();
+	nsc_context_set_cpu_opt(context, bench->cpu_opt);
+	nsc_context_set_pixel_format(context, RDP_PIXEL_FORMAT_B8G8R8A8);
+	s = stream_new(input->width * input->height * 4);
+
+	bench_set_bytes(bench, input->width * input->height * 4);
+
+	while (bench_next(bench))
+	{
+		stream_set_pos(s, 0);
+		nsc_compose_message(context, s, input->desktop, input->width, input->height, input->width * 4);
+	}
+
+	stream_free(s);
+	nsc_context_free(context);
+}
+
+static void bench_nsc_decode(BENCH* bench)
+{
+	STREAM* s;
+	NSC_CONTEXT* encoder;
+	NSC_CONTEXT* decoder;
+	BENCH_INPUT* input = bench->input;
+
+	encoder = nsc_context_new();
+	nsc_context_set_cpu_opt(encoder, bench->cpu_opt);
+	nsc_context_set_pixel_format(encoder, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+	decoder = nsc_context_new();
+	nsc_context_set_cpu_opt(decoder, bench->cpu_opt);
+
+	s = stream_new(input->width * input->height * 4);
+	nsc_compose_message(encoder, s, input->desktop, input->width, input->height, input->width * 4);
+	stream_seal(s);
+
+	bench_set_bytes(bench, input->width * input->height * 4);
+
+	while (bench_next(bench))
+		nsc_process_message(decoder, 32, input->width, input->height, s->data, s->size);
+
+	stream_free(s);
+	nsc_context_free(encoder);
+	nsc_context_free(decoder);
+}
+
+static void bench_nsc_decode_recorded(BENCH* bench)
+{
+	uint64 bytes;
+	LIST_ITEM* item;
+	BENCH_BITMAP* bitmap;
+	NSC_CONTEXT* context;
+
+	if (list_size(bench->input->nsc) < 1)
+	{
+		bench_skip(bench);
+		return;
+	}
+
+	context = nsc_context_new();
+	nsc_context_set_cpu_opt(context, bench->cpu_opt);
+
+	bytes = 0;
+
+	for (item = bench->input->nsc->head; item; item = item->next)
+	{
+		bitmap = (BENCH_BITMAP*) item->data;
+		bytes += bitmap->width * bitmap->height * 4;
+	}
+
+	bench_set_bytes(bench, bytes);
+
+	while (bench_next(bench))
+	{
+		for (item = bench->input->nsc->head; item; item = item->next)
+		{
+			bitmap = (BENCH_BITMAP*) item->data;
+			nsc_process_message(context, bitmap->bpp, bitmap->width, bitmap->height, bitmap->data, bitmap->length);
+		}
+	}
+
+	nsc_context_free(context);
+}
+
+/* MPPC works on PDUs, feed it the interleaved RLE encoding of the desktop in PDU sized chunks */
+static uint8* bench_mppc_input(BENCH* bench, int* length)
+{
+	uint8* data;
+	BENCH_INPUT* input = bench->input;
+
+	data = (uint8*) xmalloc(input->width * input->height * 4);
+	*length = bench_encode_interleaved(data, input->desktop, input->width, input->height, 16);
+
+	bench_set_bytes(bench, *length);
+
+	return data;
+}
+
+static void bench_mppc_compress(BENCH* bench)
+{
+	int offset;
+	int length;
+	int chunk;
+	uint8* data;
+	struct rdp_mppc_enc* enc;
+
+	data = bench_mppc_input(bench, &length);
+	enc = mppc_enc_new(PROTO_RDP_50);
+
+	while (bench_next(bench))
+	{
+		for (offset = 0; offset < length; offset += chunk)
+		{
+			chunk = MIN(MPPC_CHUNK_SIZE, length - offset);
+			compress_rdp(enc, &data[offset], chunk);
+		}
+	}
+
+	mppc_enc_free(enc);
+	xfree(data);
+}
+
+struct _MPPC_PACKET
+{
+	int flags;
+	int length;
+	uint8* data;
+};
+typedef struct _MPPC_PACKET MPPC_PACKET;
+
+static void bench_mppc_decompress(BENCH* bench)
+{
+	int i;
+	int count;
+	int offset;
+	int length;
+	int chunk;
+	uint8* data;
+	uint32 roff;
+	uint32 rlen;
+	MPPC_PACKET* packets;
+	struct rdp_mppc_enc* enc;
+	struct rdp_mppc_dec* dec;
+
+	data = bench_mppc_input(bench, &length);
+	enc = mppc_enc_new(PROTO_RDP_50);
+	dec = mppc_dec_new();
+
+	count = (length + MPPC_CHUNK_SIZE - 1) / MPPC_CHUNK_SIZE;
+	packets = (MPPC_PACKET*) xzalloc(count * sizeof(MPPC_PACKET));
+
+	for (i = 0, offset = 0; i < count; i++, offset += chunk)
+	{
+		chunk = MIN(MPPC_CHUNK_SIZE, length - offset);
+		compress_rdp(enc, &data[offset], chunk);
+
+		packets[i].flags = enc->flags;
+		packets[i].length = (enc->flags & PACKET_COMPRESSED) ? enc->bytes_in_opb : chunk;
+		packets[i].data = (uint8*) xmalloc(packets[i].length);
+		memcpy(packets[i].data, (enc->flags & PACKET_COMPRESSED) ? (uint8*) enc->outputBuffer : &data[offset],
+			packets[i].length);
+	}
+
+	/* the first packet resets the history, so every pass decodes the same stream */
+	while (bench_next(bench))
+	{
+		for (i = 0; i < count; i++)
+		{
+			if (packets[i].flags & PACKET_COMPRESSED)
+				decompress_rdp(dec, packets[i].data, packets[i].length, packets[i].flags, &roff, &rlen);
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		xfree(packets[i].data);
+
+	xfree(packets);
+	mppc_dec_free(dec);
+	mppc_enc_free(enc);
+	xfree(data);
+}
+
+void add_codec_suite(void)
+{
+	add_bench_function("codec", rfx_encode);
+	add_bench_function("codec", rfx_encode_ycbcr);
+	add_bench_function("codec", rfx_encode_dwt);
+	add_bench_function("codec", rfx_encode_quantization);
+	add_bench_function("codec", rfx_encode_differential);
+	add_bench_function("codec", rfx_encode_rlgr);
+	add_bench_function("codec", rfx_decode);
+	add_bench_function("codec", rfx_decode_rlgr);
+	add_bench_function("codec", rfx_decode_differential);
+	add_bench_function("codec", rfx_decode_quantization);
+	add_bench_function("codec", rfx_decode_dwt);
+	add_bench_function("codec", rfx_decode_ycbcr);
+	add_bench_function("codec", rfx_decode_recorded);
+	add_bench_function("codec", nsc_encode);
+	add_bench_function("codec", nsc_decode);
+	add_bench_function("codec", nsc_decode_recorded);
+	add_bench_function("codec", mppc_compress);
+	add_bench_function("codec", mppc_decompress);
+}
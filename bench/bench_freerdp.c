@@ -0,0 +1,476 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Codec and GDI Microbenchmarks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+
+#ifdef _WIN32
+#include <winpr/windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <freerdp/constants.h>
+#include <freerdp/utils/memory.h>
+
+#include "bench_freerdp.h"
+
+struct _BENCH_CASE
+{
+	const char* suite;
+	const char* name;
+	pBenchFunction func;
+};
+typedef struct _BENCH_CASE BENCH_CASE;
+
+struct _BENCH_RESULT
+{
+	const char* suite;
+	const char* name;
+	int count;
+	uint64 bytes;
+	uint64 min;
+	uint64 median;
+	uint64 p90;
+	uint64 p99;
+	uint64 max;
+	uint64 mean;
+};
+typedef struct _BENCH_RESULT BENCH_RESULT;
+
+static LIST* bench_cases = NULL;
+
+static uint64 bench_get_time(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER count;
+	static LARGE_INTEGER frequency;
+
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+
+	QueryPerformanceCounter(&count);
+	return (uint64) ((double) count.QuadPart * 1000000000.0 / (double) frequency.QuadPart);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64) ts.tv_sec * 1000000000) + ts.tv_nsec;
+#endif
+}
+
+void bench_add(const char* suite, const char* name, pBenchFunction func)
+{
+	BENCH_CASE* bench_case;
+
+	bench_case = xnew(BENCH_CASE);
+	bench_case->suite = suite;
+	bench_case->name = name;
+	bench_case->func = func;
+
+	list_enqueue(bench_cases, bench_case);
+}
+
+/**
+ * Drives the timed loop of a benchmark: each call closes the sample started
+ * by the previous one and opens the next. Warmup iterations are run but not
+ * recorded. Work done outside of the loop is not timed.
+ */
+boolean bench_next(BENCH* bench)
+{
+	uint64 now;
+
+	now = bench_get_time();
+
+	if (bench->running)
+	{
+		if (!bench->paused)
+			bench->elapsed += now - bench->start;
+
+		if (bench->current >= bench->warmup)
+			bench->samples[bench->current - bench->warmup] = bench->elapsed;
+
+		bench->current++;
+	}
+
+	if (bench->skipped || bench->current >= bench->warmup + bench->iterations)
+	{
+		bench->running = false;
+		return false;
+	}
+
+	bench->running = true;
+	bench->paused = false;
+	bench->elapsed = 0;
+	bench->start = bench_get_time();
+
+	return true;
+}
+
+/* exclude per-iteration preparation, such as restoring an input that is modified in place */
+void bench_pause(BENCH* bench)
+{
+	if (!bench->paused)
+	{
+		bench->elapsed += bench_get_time() - bench->start;
+		bench->paused = true;
+	}
+}
+
+void bench_resume(BENCH* bench)
+{
+	if (bench->paused)
+	{
+		bench->paused = false;
+		bench->start = bench_get_time();
+	}
+}
+
+/* bytes processed by one iteration, used to report throughput */
+void bench_set_bytes(BENCH* bench, uint64 bytes)
+{
+	bench->bytes = bytes;
+}
+
+/* for benchmarks that have no input, e.g. recorded data when no recording was given */
+void bench_skip(BENCH* bench)
+{
+	bench->skipped = true;
+}
+
+/* fixed seed linear congruential generator, inputs must be identical across runs and platforms */
+uint32 bench_rand(uint32* seed)
+{
+	*seed = (*seed * 1103515245) + 12345;
+	return (*seed >> 16) & 0x7FFF;
+}
+
+static int bench_compare_samples(const void* a, const void* b)
+{
+	uint64 sa = *((uint64*) a);
+	uint64 sb = *((uint64*) b);
+
+	return (sa < sb) ? -1 : ((sa > sb) ? 1 : 0);
+}
+
+/* nearest-rank percentile of sorted samples */
+static uint64 bench_percentile(uint64* samples, int count, int percentile)
+{
+	int rank;
+
+	rank = (percentile * count + 99) / 100;
+
+	if (rank < 1)
+		rank = 1;
+
+	return samples[rank - 1];
+}
+
+static boolean bench_run(BENCH_CASE* bench_case, BENCH* bench, BENCH_RESULT* result)
+{
+	int i;
+	uint64 total;
+
+	bench->suite = bench_case->suite;
+	bench->name = bench_case->name;
+	bench->current = 0;
+	bench->running = false;
+	bench->skipped = false;
+	bench->bytes = 0;
+
+	bench_case->func(bench);
+
+	memset(result, 0, sizeof(BENCH_RESULT));
+	result->suite = bench->suite;
+	result->name = bench->name;
+	result->bytes = bench->bytes;
+	result->count = bench->current - bench->warmup;
+
+	if (bench->skipped || result->count <= 0)
+		return false;
+
+	qsort(bench->samples, result->count, sizeof(uint64), bench_compare_samples);
+
+	total = 0;
+
+	for (i = 0; i < result->count; i++)
+		total += bench->samples[i];
+
+	result->min = bench->samples[0];
+	result->max = bench->samples[result->count - 1];
+	result->median = bench_percentile(bench->samples, result->count, 50);
+	result->p90 = bench_percentile(bench->samples, result->count, 90);
+	result->p99 = bench_percentile(bench->samples, result->count, 99);
+	result->mean = total / result->count;
+
+	return true;
+}
+
+/* megabytes per second at the median */
+static double bench_throughput(BENCH_RESULT* result)
+{
+	if (result->bytes == 0 || result->median == 0)
+		return 0;
+
+	return ((double) result->bytes * 1000.0) / (double) result->median;
+}
+
+static void bench_print_header(FILE* fp, int format, BENCH* bench)
+{
+	switch (format)
+	{
+		case BENCH_FORMAT_CSV:
+			fprintf(fp, "suite,name,iterations,bytes,min_ns,median_ns,p90_ns,p99_ns,max_ns,mean_ns,mb_per_s\n");
+			break;
+
+		case BENCH_FORMAT_JSON:
+			fprintf(fp, "{\n");
+			fprintf(fp, "\t\"version\": \"%s\",\n", FREERDP_VERSION_FULL);
+			fprintf(fp, "\t\"timestamp\": %lu,\n", (unsigned long) time(NULL));
+			fprintf(fp, "\t\"iterations\": %d,\n", bench->iterations);
+			fprintf(fp, "\t\"sse2\": %s,\n", (bench->cpu_opt & CPU_SSE2) ? "true" : "false");
+			fprintf(fp, "\t\"results\": [");
+			break;
+
+		default:
+			fprintf(fp, "%-8s %-28s %6s %10s %10s %10s %10s %10s %10s\n", "suite", "name",
+				"iter", "min us", "median us", "p90 us", "p99 us", "mean us", "MB/s");
+			break;
+	}
+}
+
+static void bench_print_result(FILE* fp, int format, BENCH_RESULT* result, boolean first)
+{
+	switch (format)
+	{
+		case BENCH_FORMAT_CSV:
+			fprintf(fp, "%s,%s,%d,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.2f\n",
+				result->suite, result->name, result->count,
+				(unsigned long long) result->bytes,
+				(unsigned long long) result->min,
+				(unsigned long long) result->median,
+				(unsigned long long) result->p90,
+				(unsigned long long) result->p99,
+				(unsigned long long) result->max,
+				(unsigned long long) result->mean,
+				bench_throughput(result));
+			break;
+
+		case BENCH_FORMAT_JSON:
+			fprintf(fp, "%s\n\t\t{ \"suite\": \"%s\", \"name\": \"%s\", \"iterations\": %d, \"bytes\": %llu, "
+				"\"min_ns\": %llu, \"median_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, "
+				"\"max_ns\": %llu, \"mean_ns\": %llu, \"mb_per_s\": %.2f }",
+				first ? "" : ",",
+				result->suite, result->name, result->count,
+				(unsigned long long) result->bytes,
+				(unsigned long long) result->min,
+				(unsigned long long) result->median,
+				(unsigned long long) result->p90,
+				(unsigned long long) result->p99,
+				(unsigned long long) result->max,
+				(unsigned long long) result->mean,
+				bench_throughput(result));
+			break;
+
+		default:
+			fprintf(fp, "%-8s %-28s %6d %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+				result->suite, result->name, result->count,
+				result->min / 1000.0, result->median / 1000.0,
+				result->p90 / 1000.0, result->p99 / 1000.0,
+				result->mean / 1000.0, bench_throughput(result));
+			break;
+	}
+
+	fflush(fp);
+}
+
+static void bench_print_footer(FILE* fp, int format)
+{
+	if (format == BENCH_FORMAT_JSON)
+		fprintf(fp, "\n\t]\n}\n");
+}
+
+static boolean bench_match(BENCH_CASE* bench_case, int argc, char* argv[], int first)
+{
+	int i;
+
+	if (first >= argc)
+		return true;
+
+	for (i = first; i < argc; i++)
+	{
+		if (strcmp(argv[i], bench_case->suite) == 0 || strstr(bench_case->name, argv[i]) != NULL)
+			return true;
+	}
+
+	return false;
+}
+
+static void bench_usage(const char* name)
+{
+	printf("Usage: %s [options] [suite|name ...]\n\n", name);
+	printf("Options:\n");
+	printf("  -i <count>   timed iterations per benchmark (default %d)\n", BENCH_DEFAULT_ITERATIONS);
+	printf("  -w <count>   untimed warmup iterations (default %d)\n", BENCH_DEFAULT_WARMUP);
+	printf("  -f <format>  output format: text, csv or json (default text)\n");
+	printf("  -o <file>    write results to a file instead of stdout\n");
+	printf("  -r <file>    also benchmark bitmaps and surface bits from a session recording\n");
+	printf("  -s           enable SSE2 code paths\n");
+	printf("  -l           list benchmarks\n");
+	printf("\nSuites: codec, bitmap, gdi. Other arguments select benchmarks by name substring.\n");
+}
+
+int main(int argc, char* argv[])
+{
+	int index;
+	int format;
+	boolean list;
+	boolean first;
+	FILE* fp;
+	char* output;
+	char* recording;
+	BENCH bench;
+	BENCH_CASE* bench_case;
+	BENCH_RESULT result;
+
+	memset(&bench, 0, sizeof(BENCH));
+	bench.iterations = BENCH_DEFAULT_ITERATIONS;
+	bench.warmup = BENCH_DEFAULT_WARMUP;
+
+	format = BENCH_FORMAT_TEXT;
+	list = false;
+	output = NULL;
+	recording = NULL;
+
+	for (index = 1; index < argc && argv[index][0] == '-'; index++)
+	{
+		if (strcmp(argv[index], "-i") == 0 && index + 1 < argc)
+		{
+			bench.iterations = atoi(argv[++index]);
+		}
+		else if (strcmp(argv[index], "-w") == 0 && index + 1 < argc)
+		{
+			bench.warmup = atoi(argv[++index]);
+		}
+		else if (strcmp(argv[index], "-f") == 0 && index + 1 < argc)
+		{
+			index++;
+
+			if (strcmp(argv[index], "csv") == 0)
+				format = BENCH_FORMAT_CSV;
+			else if (strcmp(argv[index], "json") == 0)
+				format = BENCH_FORMAT_JSON;
+			else if (strcmp(argv[index], "text") == 0)
+				format = BENCH_FORMAT_TEXT;
+			else
+			{
+				bench_usage(argv[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[index], "-o") == 0 && index + 1 < argc)
+		{
+			output = argv[++index];
+		}
+		else if (strcmp(argv[index], "-r") == 0 && index + 1 < argc)
+		{
+			recording = argv[++index];
+		}
+		else if (strcmp(argv[index], "-s") == 0)
+		{
+			bench.cpu_opt |= CPU_SSE2;
+		}
+		else if (strcmp(argv[index], "-l") == 0)
+		{
+			list = true;
+		}
+		else
+		{
+			bench_usage(argv[0]);
+			return (strcmp(argv[index], "-h") == 0) ? 0 : 1;
+		}
+	}
+
+	if (bench.iterations < 1 || bench.warmup < 0)
+	{
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	bench_cases = list_new();
+
+	add_codec_suite();
+	add_bitmap_suite();
+	add_gdi_suite();
+	add_unicode_suite();
+
+	if (list)
+	{
+		while ((bench_case = (BENCH_CASE*) list_dequeue(bench_cases)) != NULL)
+		{
+			printf("%s %s\n", bench_case->suite, bench_case->name);
+			xfree(bench_case);
+		}
+
+		list_free(bench_cases);
+		return 0;
+	}
+
+	bench.input = bench_input_new();
+
+	if (recording != NULL && !bench_input_load(bench.input, recording))
+		return 1;
+
+	fp = stdout;
+
+	if (output != NULL)
+	{
+		fp = fopen(output, "w");
+
+		if (fp == NULL)
+		{
+			perror("opening output file failed");
+			return 1;
+		}
+	}
+
+	bench.samples = (uint64*) xmalloc(sizeof(uint64) * bench.iterations);
+
+	bench_print_header(fp, format, &bench);
+	first = true;
+
+	while ((bench_case = (BENCH_CASE*) list_dequeue(bench_cases)) != NULL)
+	{
+		if (bench_match(bench_case, argc, argv, index) && bench_run(bench_case, &bench, &result))
+		{
+			bench_print_result(fp, format, &result, first);
+			first = false;
+		}
+
+		xfree(bench_case);
+	}
+
+	bench_print_footer(fp, format);
+
+	if (fp != stdout)
+		fclose(fp);
+
+	xfree(bench.samples);
+	bench_input_free(bench.input);
+	list_free(bench_cases);
+
+	return 0;
+}
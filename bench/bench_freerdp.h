@@ -0,0 +1,115 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Codec and GDI Microbenchmarks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BENCH_FREERDP_H
+#define __BENCH_FREERDP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <freerdp/types.h>
+#include <freerdp/utils/list.h>
+
+#define BENCH_DEFAULT_ITERATIONS	200
+#define BENCH_DEFAULT_WARMUP		5
+
+/* synthetic desktop, large enough for a full RemoteFX frame */
+#define BENCH_DESKTOP_WIDTH		1024
+#define BENCH_DESKTOP_HEIGHT		768
+
+enum BENCH_FORMAT
+{
+	BENCH_FORMAT_TEXT,
+	BENCH_FORMAT_CSV,
+	BENCH_FORMAT_JSON
+};
+
+/* a compressed bitmap or surface bits payload taken from a session recording */
+struct _BENCH_BITMAP
+{
+	uint16 width;
+	uint16 height;
+	uint16 bpp;
+	uint32 length;
+	uint8* data;
+};
+typedef struct _BENCH_BITMAP BENCH_BITMAP;
+
+struct _BENCH_INPUT
+{
+	/* synthetic 32bpp XRGB desktop, filled from a fixed seed */
+	int width;
+	int height;
+	uint8* desktop;
+
+	/* recorded inputs, lists of BENCH_BITMAP */
+	LIST* interleaved;
+	LIST* planar;
+	LIST* rfx;
+	LIST* nsc;
+};
+typedef struct _BENCH_INPUT BENCH_INPUT;
+
+typedef struct _BENCH BENCH;
+typedef void (*pBenchFunction)(BENCH* bench);
+
+struct _BENCH
+{
+	const char* suite;
+	const char* name;
+	BENCH_INPUT* input;
+	uint32 cpu_opt;
+
+	int iterations;
+	int warmup;
+	int current;
+	boolean running;
+	boolean paused;
+	uint64 start;
+	uint64 elapsed;
+
+	uint64 bytes;
+	uint64* samples;
+	boolean skipped;
+};
+
+#define add_bench_function(_suite, _name) \
+	bench_add(_suite, #_name, bench_##_name)
+
+void bench_add(const char* suite, const char* name, pBenchFunction func);
+boolean bench_next(BENCH* bench);
+void bench_pause(BENCH* bench);
+void bench_resume(BENCH* bench);
+void bench_set_bytes(BENCH* bench, uint64 bytes);
+void bench_skip(BENCH* bench);
+
+uint32 bench_rand(uint32* seed);
+
+BENCH_INPUT* bench_input_new(void);
+boolean bench_input_load(BENCH_INPUT* input, const char* filename);
+void bench_input_free(BENCH_INPUT* input);
+
+int bench_encode_interleaved(uint8* dst, const uint8* src, int width, int height, int bpp);
+int bench_encode_planar(uint8* dst, const uint8* src, int width, int height);
+
+void add_codec_suite(void);
+void add_bitmap_suite(void);
+void add_gdi_suite(void);
+void add_unicode_suite(void);
+
+#endif /* __BENCH_FREERDP_H */
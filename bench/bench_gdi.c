@@ -0,0 +1,263 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Codec and GDI Microbenchmarks, GDI Raster Operations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/gdi/dc.h>
+#include <freerdp/gdi/pen.h>
+#include <freerdp/gdi/line.h>
+#include <freerdp/gdi/brush.h>
+#include <freerdp/gdi/bitmap.h>
+#include <freerdp/gdi/drawing.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/codec/color.h>
+
+#include "bench_freerdp.h"
+
+#define GDI_LINE_COUNT		1024
+
+struct _BENCH_GDI
+{
+	int width;
+	int height;
+	HGDI_DC hdcSrc;
+	HGDI_DC hdcDst;
+	HGDI_BITMAP hBmpSrc;
+	HGDI_BITMAP hBmpDst;
+	HGDI_BRUSH hBrush;
+};
+typedef struct _BENCH_GDI BENCH_GDI;
+
+static HGDI_DC bench_gdi_dc_new(int bpp)
+{
+	HGDI_DC hdc;
+
+	hdc = gdi_GetDC();
+	hdc->bitsPerPixel = bpp;
+	hdc->bytesPerPixel = (bpp + 7) / 8;
+	hdc->brush = NULL;
+	hdc->pen = NULL;
+	hdc->selectedObject = NULL;
+	gdi_SetBkColor(hdc, 0);
+	gdi_SetTextColor(hdc, 0xFFFFFF);
+	gdi_SetROP2(hdc, GDI_R2_COPYPEN);
+
+	return hdc;
+}
+
+/**
+ * Source and destination surfaces the size of the synthetic desktop, the
+ * source holding the desktop and the destination a copy shifted by half a
+ * screen, at the requested color depth. Pattern operations use an 8x8 brush.
+ */
+static BENCH_GDI* bench_gdi_new(BENCH* bench, int bpp, boolean pattern)
+{
+	int i;
+	uint8* data;
+	uint8* shifted;
+	BENCH_GDI* gdi;
+	HCLRCONV clrconv;
+	BENCH_INPUT* input = bench->input;
+
+	gdi = xnew(BENCH_GDI);
+	gdi->width = input->width;
+	gdi->height = input->height;
+
+	clrconv = freerdp_clrconv_new(CLRCONV_ALPHA);
+
+	gdi->hdcSrc = bench_gdi_dc_new(bpp);
+	gdi->hdcDst = bench_gdi_dc_new(bpp);
+
+	data = freerdp_image_convert(input->desktop, NULL, gdi->width, gdi->height, 32, bpp, clrconv);
+	gdi->hBmpSrc = gdi_CreateBitmap(gdi->width, gdi->height, bpp, data);
+	gdi_SelectObject(gdi->hdcSrc, (HGDIOBJECT) gdi->hBmpSrc);
+
+	shifted = (uint8*) xmalloc(gdi->width * gdi->height * 4);
+
+	for (i = 0; i < gdi->height; i++)
+	{
+		memcpy(&shifted[i * gdi->width * 4], &input->desktop[((i + gdi->height / 2) % gdi->height) * gdi->width * 4],
+			gdi->width * 4);
+	}
+
+	data = freerdp_image_convert(shifted, NULL, gdi->width, gdi->height, 32, bpp, clrconv);
+	gdi->hBmpDst = gdi_CreateBitmap(gdi->width, gdi->height, bpp, data);
+	gdi_SelectObject(gdi->hdcDst, (HGDIOBJECT) gdi->hBmpDst);
+	xfree(shifted);
+
+	if (pattern)
+	{
+		data = freerdp_image_convert(input->desktop, NULL, 8, 8, 32, bpp, clrconv);
+		gdi->hBrush = gdi_CreatePatternBrush(gdi_CreateBitmap(8, 8, bpp, data));
+	}
+	else
+	{
+		gdi->hBrush = gdi_CreateSolidBrush(0x2B5797);
+	}
+
+	gdi_SelectObject(gdi->hdcDst, (HGDIOBJECT) gdi->hBrush);
+
+	freerdp_clrconv_free(clrconv);
+
+	bench_set_bytes(bench, gdi->width * gdi->height * ((bpp + 7) / 8));
+
+	return gdi;
+}
+
+/* a pattern brush owns its bitmap */
+static void bench_gdi_free(BENCH_GDI* gdi)
+{
+	gdi_DeleteObject((HGDIOBJECT) gdi->hBrush);
+	gdi_DeleteObject((HGDIOBJECT) gdi->hBmpSrc);
+	gdi_DeleteObject((HGDIOBJECT) gdi->hBmpDst);
+
+	gdi_DeleteDC(gdi->hdcSrc);
+	gdi_DeleteDC(gdi->hdcDst);
+	xfree(gdi);
+}
+
+static void bench_gdi_bitblt(BENCH* bench, int bpp, int rop, boolean pattern)
+{
+	BENCH_GDI* gdi = bench_gdi_new(bench, bpp, pattern);
+
+	while (bench_next(bench))
+		gdi_BitBlt(gdi->hdcDst, 0, 0, gdi->width, gdi->height, gdi->hdcSrc, 0, 0, rop);
+
+	bench_gdi_free(gdi);
+}
+
+static void bench_gdi_patblt(BENCH* bench, int bpp, int rop, boolean pattern)
+{
+	BENCH_GDI* gdi = bench_gdi_new(bench, bpp, pattern);
+
+	while (bench_next(bench))
+		gdi_PatBlt(gdi->hdcDst, 0, 0, gdi->width, gdi->height, rop);
+
+	bench_gdi_free(gdi);
+}
+
+static void bench_gdi_srccopy_32bpp(BENCH* bench)
+{
+	bench_gdi_bitblt(bench, 32, GDI_SRCCOPY, false);
+}
+
+static void bench_gdi_srccopy_16bpp(BENCH* bench)
+{
+	bench_gdi_bitblt(bench, 16, GDI_SRCCOPY, false);
+}
+
+static void bench_gdi_srcinvert(BENCH* bench)
+{
+	bench_gdi_bitblt(bench, 32, GDI_SRCINVERT, false);
+}
+
+static void bench_gdi_srcand(BENCH* bench)
+{
+	bench_gdi_bitblt(bench, 32, GDI_SRCAND, false);
+}
+
+static void bench_gdi_srcpaint(BENCH* bench)
+{
+	bench_gdi_bitblt(bench, 32, GDI_SRCPAINT, false);
+}
+
+static void bench_gdi_dstinvert(BENCH* bench)
+{
+	bench_gdi_bitblt(bench, 32, GDI_DSTINVERT, false);
+}
+
+static void bench_gdi_mergecopy(BENCH* bench)
+{
+	bench_gdi_bitblt(bench, 32, GDI_MERGECOPY, true);
+}
+
+/* the raster operation used to draw glyphs */
+static void bench_gdi_dspdxax(BENCH* bench)
+{
+	bench_gdi_bitblt(bench, 32, GDI_DSPDxax, false);
+}
+
+static void bench_gdi_patcopy_solid(BENCH* bench)
+{
+	bench_gdi_patblt(bench, 32, GDI_PATCOPY, false);
+}
+
+static void bench_gdi_patcopy_pattern(BENCH* bench)
+{
+	bench_gdi_patblt(bench, 32, GDI_PATCOPY, true);
+}
+
+static void bench_gdi_patinvert(BENCH* bench)
+{
+	bench_gdi_patblt(bench, 32, GDI_PATINVERT, true);
+}
+
+static void bench_gdi_lineto(BENCH* bench)
+{
+	int i;
+	uint32 seed;
+	HGDI_PEN hPen;
+	BENCH_GDI* gdi;
+	GDI_POINT* points;
+
+	gdi = bench_gdi_new(bench, 32, false);
+	hPen = gdi_CreatePen(GDI_PS_SOLID, 1, 0xFFFFFF);
+	gdi_SelectObject(gdi->hdcDst, (HGDIOBJECT) hPen);
+
+	seed = 0x4C494E45;
+	points = (GDI_POINT*) xmalloc(sizeof(GDI_POINT) * (GDI_LINE_COUNT + 1));
+
+	for (i = 0; i <= GDI_LINE_COUNT; i++)
+	{
+		points[i].x = bench_rand(&seed) % gdi->width;
+		points[i].y = bench_rand(&seed) % gdi->height;
+	}
+
+	/* throughput of lines is not meaningful in bytes */
+	bench_set_bytes(bench, 0);
+
+	while (bench_next(bench))
+	{
+		gdi_MoveToEx(gdi->hdcDst, points[0].x, points[0].y, NULL);
+
+		for (i = 1; i <= GDI_LINE_COUNT; i++)
+		{
+			gdi_LineTo(gdi->hdcDst, points[i].x, points[i].y);
+			gdi_MoveToEx(gdi->hdcDst, points[i].x, points[i].y, NULL);
+		}
+	}
+
+	xfree(points);
+	gdi_DeleteObject((HGDIOBJECT) hPen);
+	bench_gdi_free(gdi);
+}
+
+void add_gdi_suite(void)
+{
+	add_bench_function("gdi", gdi_srccopy_32bpp);
+	add_bench_function("gdi", gdi_srccopy_16bpp);
+	add_bench_function("gdi", gdi_srcinvert);
+	add_bench_function("gdi", gdi_srcand);
+	add_bench_function("gdi", gdi_srcpaint);
+	add_bench_function("gdi", gdi_dstinvert);
+	add_bench_function("gdi", gdi_mergecopy);
+	add_bench_function("gdi", gdi_dspdxax);
+	add_bench_function("gdi", gdi_patcopy_solid);
+	add_bench_function("gdi", gdi_patcopy_pattern);
+	add_bench_function("gdi", gdi_patinvert);
+	add_bench_function("gdi", gdi_lineto);
+}
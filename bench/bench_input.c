@@ -0,0 +1,541 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Codec and GDI Microbenchmarks, Inputs
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/stream.h>
+#include <freerdp/utils/record.h>
+
+#include "rdp.h"
+#include "update.h"
+#include "surface.h"
+#include "fastpath.h"
+
+#include "bench_freerdp.h"
+
+#define BENCH_SEED	0x46524450
+
+#define RFX_SYNC_BLOCK	0xCCC0
+
+static void bench_fill_rect(uint8* data, int stride, int x, int y, int width, int height, uint32 color)
+{
+	int i, j;
+	uint32* p;
+
+	for (j = y; j < y + height; j++)
+	{
+		p = (uint32*) &data[j * stride + x * 4];
+
+		for (i = 0; i < width; i++)
+			*p++ = color;
+	}
+}
+
+/* rows of 6x9 glyph cells, with word gaps, on a flat background */
+static void bench_fill_text(uint8* data, int stride, int x, int y, int width, int height, uint32 color, uint32* seed)
+{
+	int i, j;
+	int cx, cy;
+	uint32 bits;
+
+	for (cy = y; cy + 9 <= y + height; cy += 14)
+	{
+		for (cx = x; cx + 6 <= x + width; cx += 7)
+		{
+			if (bench_rand(seed) % 7 == 0)
+				continue;
+
+			for (j = 0; j < 9; j++)
+			{
+				bits = bench_rand(seed);
+
+				for (i = 0; i < 6; i++)
+				{
+					if (bits & (1 << i))
+						*((uint32*) &data[(cy + j) * stride + (cx + i) * 4]) = color;
+				}
+			}
+		}
+	}
+}
+
+/* smooth noise, the kind of content wallpapers and photos produce */
+static void bench_fill_photo(uint8* data, int stride, int x, int y, int width, int height, uint32* seed)
+{
+	int i, j, c;
+	int value[3] = { 128, 128, 128 };
+	uint8* p;
+
+	for (j = y; j < y + height; j++)
+	{
+		p = &data[j * stride + x * 4];
+
+		for (i = 0; i < width; i++)
+		{
+			for (c = 0; c < 3; c++)
+			{
+				value[c] += (int) (bench_rand(seed) % 9) - 4;
+				value[c] = (value[c] < 0) ? 0 : ((value[c] > 255) ? 255 : value[c]);
+
+				if (j > y)
+					p[c] = (uint8) ((value[c] + p[c - stride]) / 2);
+				else
+					p[c] = (uint8) value[c];
+			}
+
+			p[3] = 0xFF;
+			p += 4;
+		}
+	}
+}
+
+/**
+ * The synthetic desktop: a gradient wallpaper with a photo, and two windows
+ * with a title bar and text. It covers flat areas, sharp edges and noise,
+ * so that run-length and transform codecs all get representative work.
+ */
+static void bench_fill_desktop(uint8* data, int width, int height)
+{
+	int x, y;
+	uint32 seed;
+	int stride = width * 4;
+
+	seed = BENCH_SEED;
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+		{
+			data[y * stride + x * 4 + 0] = (uint8) (96 + (y * 128) / height);
+			data[y * stride + x * 4 + 1] = (uint8) (48 + (x * 64) / width);
+			data[y * stride + x * 4 + 2] = 32;
+			data[y * stride + x * 4 + 3] = 0xFF;
+		}
+	}
+
+	bench_fill_photo(data, stride, width / 2, height / 8, width / 2 - 16, height / 2, &seed);
+
+	bench_fill_rect(data, stride, 32, 32, width / 2, height / 2, 0xFFFFFFFF);
+	bench_fill_rect(data, stride, 32, 32, width / 2, 22, 0xFF2B5797);
+	bench_fill_text(data, stride, 40, 60, width / 2 - 16, height / 2 - 36, 0xFF000000, &seed);
+
+	bench_fill_rect(data, stride, width / 4, height / 2, width / 2, height / 2 - 32, 0xFFECE9D8);
+	bench_fill_rect(data, stride, width / 4, height / 2, width / 2, 22, 0xFF0A246A);
+	bench_fill_text(data, stride, width / 4 + 8, height / 2 + 28, width / 2 - 16, height / 2 - 64, 0xFF202020, &seed);
+}
+
+static uint32 bench_read_pixel(const uint8* src, int bpp)
+{
+	uint32 b = src[0];
+	uint32 g = src[1];
+	uint32 r = src[2];
+
+	switch (bpp)
+	{
+		case 15:
+			return ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+
+		case 16:
+			return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+
+		default:
+			return (r << 16) | (g << 8) | b;
+	}
+}
+
+static uint8* bench_write_pixel(uint8* dst, uint32 pixel, int bpp)
+{
+	*dst++ = pixel & 0xFF;
+	*dst++ = (pixel >> 8) & 0xFF;
+
+	if (bpp > 16)
+		*dst++ = (pixel >> 16) & 0xFF;
+
+	return dst;
+}
+
+static uint8* bench_write_order(uint8* dst, uint8 regular, uint8 mega, int length)
+{
+	if (length < 32)
+	{
+		*dst++ = (regular << 5) | length;
+	}
+	else
+	{
+		*dst++ = mega;
+		*dst++ = length & 0xFF;
+		*dst++ = (length >> 8) & 0xFF;
+	}
+
+	return dst;
+}
+
+/**
+ * Interleaved RLE encoder (MS-RDPBCGR 2.2.9.1.1.3.1.2.4) producing color runs
+ * and color images only. Scanlines are stored bottom-up, as bitmap_decompress()
+ * expects. Returns the compressed size; dst must hold width * height * 4 bytes.
+ */
+int bench_encode_interleaved(uint8* dst, const uint8* src, int width, int height, int bpp)
+{
+	int i, x, y;
+	int count;
+	int run;
+	int image;
+	uint32* pixels;
+	uint8* start = dst;
+
+	count = width * height;
+	pixels = (uint32*) xmalloc(count * sizeof(uint32));
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+			pixels[y * width + x] = bench_read_pixel(&src[((height - y - 1) * width + x) * 4], bpp);
+	}
+
+	i = 0;
+	image = 0;
+
+	while (i < count)
+	{
+		run = 1;
+
+		while (i + run < count && run < 0xFFFF && pixels[i + run] == pixels[i])
+			run++;
+
+		if (run < 4 && image + run < 0xFFFF)
+		{
+			image += run;
+			i += run;
+			continue;
+		}
+
+		if (image > 0)
+		{
+			dst = bench_write_order(dst, 0x04, 0xF4, image);
+
+			for (x = i - image; x < i; x++)
+				dst = bench_write_pixel(dst, pixels[x], bpp);
+
+			image = 0;
+		}
+
+		if (run < 4)
+			continue;
+
+		dst = bench_write_order(dst, 0x03, 0xF3, run);
+		dst = bench_write_pixel(dst, pixels[i], bpp);
+		i += run;
+	}
+
+	if (image > 0)
+	{
+		dst = bench_write_order(dst, 0x04, 0xF4, image);
+
+		for (x = i - image; x < i; x++)
+			dst = bench_write_pixel(dst, pixels[x], bpp);
+	}
+
+	xfree(pixels);
+
+	return (int) (dst - start);
+}
+
+static uint8* bench_encode_planar_line(uint8* dst, const uint8* line, int width)
+{
+	int i;
+	int raw;
+	int run;
+
+	i = 0;
+
+	while (i < width)
+	{
+		raw = 0;
+		run = 0;
+
+		while (raw < 15 && i + raw < width)
+		{
+			raw++;
+			run = 0;
+
+			while (run < 15 && i + raw + run < width && line[i + raw + run] == line[i + raw - 1])
+				run++;
+
+			if (run >= 3)
+				break;
+		}
+
+		/* runs of one or two would be read as a control code for a longer run */
+		if (run < 3)
+			run = 0;
+
+		*dst++ = (raw << 4) | run;
+		memcpy(dst, &line[i], raw);
+		dst += raw;
+		i += raw + run;
+	}
+
+	return dst;
+}
+
+/**
+ * Planar encoder (MS-RDPEGDI 2.2.2.5.1) producing RLE planes without alpha.
+ * The first scanline is stored as values, the following ones as deltas to
+ * the scanline above. Returns the compressed size; dst must hold
+ * width * height * 4 bytes.
+ */
+int bench_encode_planar(uint8* dst, const uint8* src, int width, int height)
+{
+	int c, x, y;
+	int delta;
+	uint8* line;
+	const uint8* row;
+	const uint8* prev;
+	uint8* start = dst;
+
+	line = (uint8*) xmalloc(width);
+
+	*dst++ = 0x30; /* RLE, no alpha */
+
+	/* red, green and blue planes, scanlines from the bottom up */
+	for (c = 2; c >= 0; c--)
+	{
+		for (y = height - 1; y >= 0; y--)
+		{
+			row = &src[y * width * 4];
+			prev = &src[(y + 1) * width * 4];
+
+			for (x = 0; x < width; x++)
+			{
+				if (y == height - 1)
+				{
+					line[x] = row[x * 4 + c];
+					continue;
+				}
+
+				delta = (int) row[x * 4 + c] - (int) prev[x * 4 + c];
+				delta = (delta > 127) ? delta - 256 : ((delta < -128) ? delta + 256 : delta);
+				line[x] = (delta >= 0) ? (delta << 1) : (((-delta - 1) << 1) | 1);
+			}
+
+			dst = bench_encode_planar_line(dst, line, width);
+		}
+	}
+
+	xfree(line);
+
+	return (int) (dst - start);
+}
+
+static void bench_input_add(LIST* list, uint16 width, uint16 height, uint16 bpp, uint8* data, uint32 length)
+{
+	BENCH_BITMAP* bitmap;
+
+	bitmap = xnew(BENCH_BITMAP);
+	bitmap->width = width;
+	bitmap->height = height;
+	bitmap->bpp = bpp;
+	bitmap->length = length;
+	bitmap->data = (uint8*) xmalloc(length);
+	memcpy(bitmap->data, data, length);
+
+	list_enqueue(list, bitmap);
+}
+
+static void bench_input_read_bitmap_update(BENCH_INPUT* input, STREAM* s)
+{
+	int i;
+	uint8* data;
+	uint16 number;
+	uint16 updateType;
+	BITMAP_DATA bitmap;
+
+	if (stream_get_left(s) < 4)
+		return;
+
+	stream_read_uint16(s, updateType); /* updateType (2 bytes) */
+
+	if (updateType != UPDATE_TYPE_BITMAP)
+		return;
+
+	stream_read_uint16(s, number); /* numberRectangles (2 bytes) */
+
+	for (i = 0; i < number; i++)
+	{
+		if (stream_get_left(s) < 18)
+			return;
+
+		stream_seek(s, 8); /* destLeft, destTop, destRight, destBottom (8 bytes) */
+		stream_read_uint16(s, bitmap.width);
+		stream_read_uint16(s, bitmap.height);
+		stream_read_uint16(s, bitmap.bitsPerPixel);
+		stream_read_uint16(s, bitmap.flags);
+		stream_read_uint16(s, bitmap.bitmapLength);
+
+		if ((bitmap.flags & BITMAP_COMPRESSION) && !(bitmap.flags & NO_BITMAP_COMPRESSION_HDR))
+		{
+			if (stream_get_left(s) < 8)
+				return;
+
+			stream_seek(s, 2); /* cbCompFirstRowSize (2 bytes) */
+			stream_read_uint16(s, bitmap.bitmapLength); /* cbCompMainBodySize (2 bytes) */
+			stream_seek(s, 4); /* cbScanWidth, cbUncompressedSize (4 bytes) */
+		}
+
+		if (stream_get_left(s) < bitmap.bitmapLength)
+			return;
+
+		stream_get_mark(s, data);
+		stream_seek(s, bitmap.bitmapLength);
+
+		if (!(bitmap.flags & BITMAP_COMPRESSION) || bitmap.width == 0 || bitmap.height == 0)
+			continue;
+
+		if (bitmap.bitsPerPixel == 32)
+			bench_input_add(input->planar, bitmap.width, bitmap.height, 32, data, bitmap.bitmapLength);
+		else
+			bench_input_add(input->interleaved, bitmap.width, bitmap.height, bitmap.bitsPerPixel, data, bitmap.bitmapLength);
+	}
+}
+
+static void bench_input_read_surface_commands(BENCH_INPUT* input, STREAM* s)
+{
+	uint8* data;
+	uint8 bpp;
+	uint8 codecID;
+	uint16 cmdType;
+	uint16 width;
+	uint16 height;
+	uint16 blockType;
+	uint32 length;
+
+	while (stream_get_left(s) > 2)
+	{
+		stream_read_uint16(s, cmdType);
+
+		if (cmdType == CMDTYPE_FRAME_MARKER)
+		{
+			stream_seek(s, 6); /* frameAction (2 bytes), frameId (4 bytes) */
+			continue;
+		}
+
+		if ((cmdType != CMDTYPE_SET_SURFACE_BITS && cmdType != CMDTYPE_STREAM_SURFACE_BITS) ||
+			stream_get_left(s) < 20)
+			return;
+
+		stream_seek(s, 8); /* destLeft, destTop, destRight, destBottom (8 bytes) */
+		stream_read_uint8(s, bpp);
+		stream_seek(s, 2); /* reserved (2 bytes) */
+		stream_read_uint8(s, codecID);
+		stream_read_uint16(s, width);
+		stream_read_uint16(s, height);
+		stream_read_uint32(s, length);
+
+		if (stream_get_left(s) < length)
+			return;
+
+		stream_get_mark(s, data);
+		stream_seek(s, length);
+
+		/* codec ids are negotiated, tell RemoteFX from NSCodec by the leading sync block */
+		if (codecID == 0 || length < 6)
+			continue;
+
+		blockType = data[0] | (data[1] << 8);
+
+		if (blockType == RFX_SYNC_BLOCK)
+			bench_input_add(input->rfx, width, height, bpp, data, length);
+		else
+			bench_input_add(input->nsc, width, height, bpp, data, length);
+	}
+}
+
+/* collect the compressed bitmaps and surface bits of a recording made with --record */
+boolean bench_input_load(BENCH_INPUT* input, const char* filename)
+{
+	STREAM* s;
+	rdpRecord* record;
+	RECORD_ENTRY entry;
+
+	record = record_open(filename, false);
+
+	if (record == NULL)
+		return false;
+
+	s = stream_new(0);
+
+	while (record_read(record, &entry))
+	{
+		stream_attach(s, entry.data, entry.length);
+
+		if (entry.type == RECORD_TYPE_FASTPATH && entry.id == FASTPATH_UPDATETYPE_BITMAP)
+			bench_input_read_bitmap_update(input, s);
+		else if (entry.type == RECORD_TYPE_DATA_PDU && entry.id == DATA_PDU_TYPE_UPDATE)
+			bench_input_read_bitmap_update(input, s);
+		else if (entry.type == RECORD_TYPE_FASTPATH && entry.id == FASTPATH_UPDATETYPE_SURFCMDS)
+			bench_input_read_surface_commands(input, s);
+	}
+
+	stream_detach(s);
+	stream_free(s);
+	record_close(record);
+
+	return true;
+}
+
+BENCH_INPUT* bench_input_new(void)
+{
+	BENCH_INPUT* input;
+
+	input = xnew(BENCH_INPUT);
+	input->width = BENCH_DESKTOP_WIDTH;
+	input->height = BENCH_DESKTOP_HEIGHT;
+	input->desktop = (uint8*) xmalloc(input->width * input->height * 4);
+
+	bench_fill_desktop(input->desktop, input->width, input->height);
+
+	input->interleaved = list_new();
+	input->planar = list_new();
+	input->rfx = list_new();
+	input->nsc = list_new();
+
+	return input;
+}
+
+static void bench_input_free_list(LIST* list)
+{
+	BENCH_BITMAP* bitmap;
+
+	while ((bitmap = (BENCH_BITMAP*) list_dequeue(list)) != NULL)
+	{
+		xfree(bitmap->data);
+		xfree(bitmap);
+	}
+
+	list_free(list);
+}
+
+void bench_input_free(BENCH_INPUT* input)
+{
+	bench_input_free_list(input->interleaved);
+	bench_input_free_list(input->planar);
+	bench_input_free_list(input->rfx);
+	bench_input_free_list(input->nsc);
+
+	xfree(input->desktop);
+	xfree(input);
+}
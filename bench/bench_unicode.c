@@ -0,0 +1,243 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Codec and GDI Microbenchmarks, Unicode Conversion
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_ICONV_H
+#include <iconv.h>
+#endif
+
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/unicode.h>
+
+#include "bench_freerdp.h"
+
+/* about the size of a large clipboard text */
+#define UNICODE_TEXT_LENGTH	65536
+
+struct _BENCH_TEXT
+{
+	char* utf8;
+	int utf8_length;
+	uint8* utf16;
+	int utf16_length;
+	char* output;
+};
+typedef struct _BENCH_TEXT BENCH_TEXT;
+
+/**
+ * Words separated by spaces and line breaks. Mixed text has an accented
+ * letter, a CJK character or an emoji in about one word out of four,
+ * ASCII text has none.
+ */
+static BENCH_TEXT* bench_text_new(boolean mixed)
+{
+	int i;
+	int length;
+	uint32 seed;
+	BENCH_TEXT* text;
+	static const char* const symbols[] =
+	{
+		"\xC3\xA9", "\xC3\xBC", "\xE2\x82\xAC", "\xE4\xB8\xAD", "\xE6\x96\x87", "\xF0\x9F\x98\x80"
+	};
+
+	seed = 0x55544638;
+	text = xnew(BENCH_TEXT);
+	text->utf8 = (char*) xmalloc(UNICODE_TEXT_LENGTH + 8);
+
+	for (length = 0; length < UNICODE_TEXT_LENGTH; )
+	{
+		for (i = bench_rand(&seed) % 8 + 1; i > 0; i--)
+			text->utf8[length++] = 'a' + bench_rand(&seed) % 26;
+
+		if (mixed && bench_rand(&seed) % 4 == 0)
+		{
+			strcpy(&text->utf8[length], symbols[bench_rand(&seed) % ARRAY_SIZE(symbols)]);
+			length += strlen(&text->utf8[length]);
+		}
+
+		text->utf8[length++] = (bench_rand(&seed) % 12 == 0) ? '\n' : ' ';
+	}
+
+	text->utf8_length = length;
+	text->utf16_length = freerdp_utf8_to_utf16(text->utf8, length, NULL, 0);
+	text->utf16 = (uint8*) xmalloc(text->utf16_length);
+	freerdp_utf8_to_utf16(text->utf8, length, text->utf16, text->utf16_length);
+
+	/* large enough for either direction */
+	text->output = (char*) xmalloc(length * 2);
+
+	return text;
+}
+
+static void bench_text_free(BENCH_TEXT* text)
+{
+	xfree(text->utf8);
+	xfree(text->utf16);
+	xfree(text->output);
+	xfree(text);
+}
+
+static void bench_utf16_to_utf8(BENCH* bench, boolean mixed)
+{
+	BENCH_TEXT* text;
+
+	text = bench_text_new(mixed);
+	bench_set_bytes(bench, text->utf16_length);
+
+	while (bench_next(bench))
+		freerdp_utf16_to_utf8(text->utf16, text->utf16_length, text->output, text->utf8_length);
+
+	bench_text_free(text);
+}
+
+static void bench_utf8_to_utf16(BENCH* bench, boolean mixed)
+{
+	BENCH_TEXT* text;
+
+	text = bench_text_new(mixed);
+	bench_set_bytes(bench, text->utf8_length);
+
+	while (bench_next(bench))
+		freerdp_utf8_to_utf16(text->utf8, text->utf8_length, (uint8*) text->output, text->utf16_length);
+
+	bench_text_free(text);
+}
+
+/* conversion into an exactly sized allocation, as freerdp_uniconv_in() does */
+static void bench_utf16_to_utf8_alloc(BENCH* bench, boolean mixed)
+{
+	int length;
+	char* output;
+	BENCH_TEXT* text;
+
+	text = bench_text_new(mixed);
+	bench_set_bytes(bench, text->utf16_length);
+
+	while (bench_next(bench))
+	{
+		length = freerdp_utf16_to_utf8(text->utf16, text->utf16_length, NULL, 0);
+		output = (char*) xmalloc(length);
+		freerdp_utf16_to_utf8(text->utf16, text->utf16_length, output, length);
+		xfree(output);
+	}
+
+	bench_text_free(text);
+}
+
+static void bench_unicode_to_utf8_ascii(BENCH* bench)
+{
+	bench_utf16_to_utf8(bench, false);
+}
+
+static void bench_unicode_to_utf8_mixed(BENCH* bench)
+{
+	bench_utf16_to_utf8(bench, true);
+}
+
+static void bench_unicode_to_utf16_ascii(BENCH* bench)
+{
+	bench_utf8_to_utf16(bench, false);
+}
+
+static void bench_unicode_to_utf16_mixed(BENCH* bench)
+{
+	bench_utf8_to_utf16(bench, true);
+}
+
+static void bench_unicode_to_utf8_alloc(BENCH* bench)
+{
+	bench_utf16_to_utf8_alloc(bench, true);
+}
+
+/* the same conversions through iconv, for comparison */
+
+static void bench_iconv(BENCH* bench, boolean to_utf8, boolean mixed)
+{
+#ifdef HAVE_ICONV_H
+	char* in;
+	char* out;
+	size_t in_left;
+	size_t out_left;
+	iconv_t cd;
+	BENCH_TEXT* text;
+
+	text = bench_text_new(mixed);
+
+	if (to_utf8)
+		cd = iconv_open("UTF-8", "UTF-16LE");
+	else
+		cd = iconv_open("UTF-16LE", "UTF-8");
+
+	if (cd == (iconv_t) -1)
+	{
+		bench_text_free(text);
+		bench_skip(bench);
+		return;
+	}
+
+	bench_set_bytes(bench, to_utf8 ? text->utf16_length : text->utf8_length);
+
+	while (bench_next(bench))
+	{
+		in = to_utf8 ? (char*) text->utf16 : text->utf8;
+		in_left = to_utf8 ? text->utf16_length : text->utf8_length;
+		out = text->output;
+		out_left = text->utf8_length * 2;
+
+		iconv(cd, &in, &in_left, &out, &out_left);
+	}
+
+	iconv_close(cd);
+	bench_text_free(text);
+#else
+	bench_skip(bench);
+#endif
+}
+
+static void bench_unicode_iconv_to_utf8_ascii(BENCH* bench)
+{
+	bench_iconv(bench, true, false);
+}
+
+static void bench_unicode_iconv_to_utf8_mixed(BENCH* bench)
+{
+	bench_iconv(bench, true, true);
+}
+
+static void bench_unicode_iconv_to_utf16_ascii(BENCH* bench)
+{
+	bench_iconv(bench, false, false);
+}
+
+static void bench_unicode_iconv_to_utf16_mixed(BENCH* bench)
+{
+	bench_iconv(bench, false, true);
+}
+
+void add_unicode_suite(void)
+{
+	add_bench_function("unicode", unicode_to_utf8_ascii);
+	add_bench_function("unicode", unicode_to_utf8_mixed);
+	add_bench_function("unicode", unicode_to_utf16_ascii);
+	add_bench_function("unicode", unicode_to_utf16_mixed);
+	add_bench_function("unicode", unicode_to_utf8_alloc);
+	add_bench_function("unicode", unicode_iconv_to_utf8_ascii);
+	add_bench_function("unicode", unicode_iconv_to_utf8_mixed);
+	add_bench_function("unicode", unicode_iconv_to_utf16_ascii);
+	add_bench_function("unicode", unicode_iconv_to_utf16_mixed);
+}
@@ -0,0 +1,132 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol client.
+ * Clipboard Virtual Channel
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freerdp/types.h>
+#include <freerdp/constants.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/svc_plugin.h>
+#include <freerdp/plugins/cliprdr.h>
+
+#include "cliprdr_constants.h"
+#include "cliprdr_main.h"
+#include "cliprdr_file.h"
+
+/**
+ * File contents are pulled one range at a time by whoever pastes, so that
+ * neither side ever holds more of a file than the ranges in flight.
+ */
+
+void cliprdr_process_filecontents_request(cliprdrPlugin* cliprdr, STREAM* s, uint32 dataLen, uint16 msgFlags)
+{
+	uint32 positionLow;
+	uint32 positionHigh;
+	RDP_CB_FILECONTENTS_REQUEST_EVENT* cb_event;
+
+	if (dataLen < 24)
+	{
+		DEBUG_WARN("file contents request too short: %d", dataLen);
+		return;
+	}
+
+	cb_event = (RDP_CB_FILECONTENTS_REQUEST_EVENT*) freerdp_event_new(RDP_EVENT_CLASS_CLIPRDR,
+		RDP_EVENT_TYPE_CB_FILECONTENTS_REQUEST, NULL, NULL);
+
+	stream_read_uint32(s, cb_event->stream_id); /* streamId (4 bytes) */
+	stream_read_uint32(s, cb_event->lindex); /* lindex (4 bytes) */
+	stream_read_uint32(s, cb_event->flags); /* dwFlags (4 bytes) */
+	stream_read_uint32(s, positionLow); /* nPositionLow (4 bytes) */
+	stream_read_uint32(s, positionHigh); /* nPositionHigh (4 bytes) */
+	stream_read_uint32(s, cb_event->requested); /* cbRequested (4 bytes) */
+	/* clipDataId (4 bytes, optional), clipboard data is never locked */
+
+	cb_event->position = ((uint64) positionHigh << 32) | positionLow;
+
+	DEBUG_CLIPRDR("streamId %d lindex %d flags 0x%X position %llu requested %d",
+		cb_event->stream_id, cb_event->lindex, cb_event->flags,
+		(unsigned long long) cb_event->position, cb_event->requested);
+
+	svc_plugin_send_event((rdpSvcPlugin*) cliprdr, (RDP_EVENT*) cb_event);
+}
+
+void cliprdr_process_filecontents_response_event(cliprdrPlugin* cliprdr, RDP_CB_FILECONTENTS_RESPONSE_EVENT* cb_event)
+{
+	STREAM* s;
+
+	DEBUG_CLIPRDR("Sending File Contents Response");
+
+	if (cb_event->failed)
+	{
+		s = cliprdr_packet_new(CB_FILECONTENTS_RESPONSE, CB_RESPONSE_FAIL, 4);
+		stream_write_uint32(s, cb_event->stream_id); /* streamId (4 bytes) */
+	}
+	else
+	{
+		s = cliprdr_packet_new(CB_FILECONTENTS_RESPONSE, CB_RESPONSE_OK, 4 + cb_event->size);
+		stream_write_uint32(s, cb_event->stream_id); /* streamId (4 bytes) */
+		stream_write(s, cb_event->data, cb_event->size); /* requestedFileContentsData */
+	}
+
+	cliprdr_packet_send(cliprdr, s);
+}
+
+void cliprdr_process_filecontents_request_event(cliprdrPlugin* cliprdr, RDP_CB_FILECONTENTS_REQUEST_EVENT* cb_event)
+{
+	STREAM* s;
+
+	DEBUG_CLIPRDR("Sending File Contents Request");
+
+	s = cliprdr_packet_new(CB_FILECONTENTS_REQUEST, 0, 24);
+	stream_write_uint32(s, cb_event->stream_id); /* streamId (4 bytes) */
+	stream_write_uint32(s, cb_event->lindex); /* lindex (4 bytes) */
+	stream_write_uint32(s, cb_event->flags); /* dwFlags (4 bytes) */
+	stream_write_uint32(s, (uint32) (cb_event->position & 0xFFFFFFFF)); /* nPositionLow (4 bytes) */
+	stream_write_uint32(s, (uint32) (cb_event->position >> 32)); /* nPositionHigh (4 bytes) */
+	stream_write_uint32(s, cb_event->requested); /* cbRequested (4 bytes) */
+
+	cliprdr_packet_send(cliprdr, s);
+}
+
+void cliprdr_process_filecontents_response(cliprdrPlugin* cliprdr, STREAM* s, uint32 dataLen, uint16 msgFlags)
+{
+	RDP_CB_FILECONTENTS_RESPONSE_EVENT* cb_event;
+
+	if (dataLen < 4)
+	{
+		DEBUG_WARN("file contents response too short: %d", dataLen);
+		return;
+	}
+
+	cb_event = (RDP_CB_FILECONTENTS_RESPONSE_EVENT*) freerdp_event_new(RDP_EVENT_CLASS_CLIPRDR,
+		RDP_EVENT_TYPE_CB_FILECONTENTS_RESPONSE, NULL, NULL);
+
+	stream_read_uint32(s, cb_event->stream_id); /* streamId (4 bytes) */
+
+	if (msgFlags & CB_RESPONSE_FAIL)
+	{
+		cb_event->failed = true;
+	}
+	else if (dataLen > 4)
+	{
+		cb_event->size = dataLen - 4;
+		cb_event->data = cliprdr_packet_take_data(s, &cb_event->size);
+	}
+
+	svc_plugin_send_event((rdpSvcPlugin*) cliprdr, (RDP_EVENT*) cb_event);
+}
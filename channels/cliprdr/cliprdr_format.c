@@ -37,6 +37,7 @@
 #define CFSTR_PNG       "P\0N\0G\0\0"
 #define CFSTR_JPEG      "J\0F\0I\0F\0\0"
 #define CFSTR_GIF       "G\0I\0F\0\0"
+#define CFSTR_FILEGROUPDESCRIPTORW "F\0i\0l\0e\0G\0r\0o\0u\0p\0D\0e\0s\0c\0r\0i\0p\0t\0o\0r\0W\0\0"
 
 void cliprdr_process_format_list_event(cliprdrPlugin* cliprdr, RDP_CB_FORMAT_LIST_EVENT* cb_event)
 {
@@ -73,6 +74,9 @@ void cliprdr_process_format_list_event(cliprdrPlugin* cliprdr, RDP_CB_FORMAT_LIS
 				case CB_FORMAT_GIF:
 					name = CFSTR_GIF; name_length = sizeof(CFSTR_GIF);
 					break;
+				case CB_FORMAT_FILEGROUPDESCRIPTORW:
+					name = CFSTR_FILEGROUPDESCRIPTORW; name_length = sizeof(CFSTR_FILEGROUPDESCRIPTORW);
+					break;
 				default:
 					name = "\0\0"; name_length = 2;
 			}
@@ -256,6 +260,11 @@ void cliprdr_process_format_list(cliprdrPlugin* cliprdr, STREAM* s, uint32 dataL
 						format = CB_FORMAT_GIF;
 						break;
 					}
+					if (strcmp(format_name->name, "FileGroupDescriptorW") == 0)
+					{
+						format = CB_FORMAT_FILEGROUPDESCRIPTORW;
+						break;
+					}
 				}
 				else
 				{
@@ -346,8 +355,7 @@ void cliprdr_process_format_data_response(cliprdrPlugin* cliprdr, STREAM* s, uin
 	if (dataLen > 0)
 	{
 		cb_event->size = dataLen;
-		cb_event->data = (uint8*) xmalloc(dataLen);
-		memcpy(cb_event->data, stream_get_tail(s), dataLen);
+		cb_event->data = cliprdr_packet_take_data(s, &cb_event->size);
 	}
 
 	svc_plugin_send_event((rdpSvcPlugin*) cliprdr, (RDP_EVENT*) cb_event);
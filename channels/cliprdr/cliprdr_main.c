@@ -32,6 +32,7 @@
 #include "cliprdr_constants.h"
 #include "cliprdr_main.h"
 #include "cliprdr_format.h"
+#include "cliprdr_file.h"
 
 static const char* const CB_MSG_TYPE_STRINGS[] =
 {
@@ -45,7 +46,7 @@ static const char* const CB_MSG_TYPE_STRINGS[] =
 	"CB_CLIP_CAPS",
 	"CB_FILECONTENTS_REQUEST",
 	"CB_FILECONTENTS_RESPONSE",
-	"CB_LOCK_CLIPDATA"
+	"CB_LOCK_CLIPDATA",
 	"CB_UNLOCK_CLIPDATA"
 };
 
@@ -76,6 +77,26 @@ void cliprdr_packet_send(cliprdrPlugin* cliprdr, STREAM* s)
 	svc_plugin_send((rdpSvcPlugin*) cliprdr, s);
 }
 
+/**
+ * Hands the rest of a received packet over to an event without copying it:
+ * the data is moved to the start of the buffer, which the stream gives up.
+ * The length is reduced to what the packet actually holds.
+ */
+
+uint8* cliprdr_packet_take_data(STREAM* s, uint32* length)
+{
+	uint8* data;
+
+	if (*length > stream_get_left(s))
+		*length = stream_get_left(s);
+
+	data = stream_get_head(s);
+	memmove(data, stream_get_tail(s), *length);
+	stream_detach(s);
+
+	return data;
+}
+
 static void cliprdr_process_connect(rdpSvcPlugin* plugin)
 {
 	DEBUG_CLIPRDR("connecting");
@@ -167,7 +188,7 @@ static void cliprdr_send_clip_caps(cliprdrPlugin* cliprdr)
 
 	DEBUG_CLIPRDR("Sending Capabilities");
 
-	flags = CB_USE_LONG_FORMAT_NAMES;
+	flags = CB_USE_LONG_FORMAT_NAMES | CB_STREAM_FILECLIP_ENABLED | CB_FILECLIP_NO_FILE_PATHS;
 
 	stream_write_uint16(s, 1); /* cCapabilitiesSets */
 	stream_write_uint16(s, 0); /* pad1 */
@@ -230,6 +251,14 @@ static void cliprdr_process_receive(rdpSvcPlugin* plugin, STREAM* s)
 			cliprdr_process_format_data_response(cliprdr, s, dataLen, msgFlags);
 			break;
 
+		case CB_FILECONTENTS_REQUEST:
+			cliprdr_process_filecontents_request(cliprdr, s, dataLen, msgFlags);
+			break;
+
+		case CB_FILECONTENTS_RESPONSE:
+			cliprdr_process_filecontents_response(cliprdr, s, dataLen, msgFlags);
+			break;
+
 		default:
 			DEBUG_WARN("unknown msgType %d", msgType);
 			break;
@@ -254,6 +283,14 @@ static void cliprdr_process_event(rdpSvcPlugin* plugin, RDP_EVENT* event)
 			cliprdr_process_format_data_response_event((cliprdrPlugin*) plugin, (RDP_CB_DATA_RESPONSE_EVENT*) event);
 			break;
 
+		case RDP_EVENT_TYPE_CB_FILECONTENTS_REQUEST:
+			cliprdr_process_filecontents_request_event((cliprdrPlugin*) plugin, (RDP_CB_FILECONTENTS_REQUEST_EVENT*) event);
+			break;
+
+		case RDP_EVENT_TYPE_CB_FILECONTENTS_RESPONSE:
+			cliprdr_process_filecontents_response_event((cliprdrPlugin*) plugin, (RDP_CB_FILECONTENTS_RESPONSE_EVENT*) event);
+			break;
+
 		default:
 			DEBUG_WARN("unknown event type %d", event->event_type);
 			break;
@@ -48,6 +48,7 @@ typedef struct cliprdr_plugin cliprdrPlugin;
 
 STREAM* cliprdr_packet_new(uint16 msgType, uint16 msgFlags, uint32 dataLen);
 void cliprdr_packet_send(cliprdrPlugin* cliprdr, STREAM* data_out);
+uint8* cliprdr_packet_take_data(STREAM* s, uint32* length);
 
 #ifdef WITH_DEBUG_CLIPRDR
 #define DEBUG_CLIPRDR(fmt, ...) DEBUG_CLASS(CLIPRDR, fmt, ## __VA_ARGS__)
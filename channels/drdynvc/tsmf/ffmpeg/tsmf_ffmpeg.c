@@ -20,8 +20,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <freerdp/utils/memory.h>
 #include <freerdp/utils/event.h>
+#include <freerdp/utils/buffer_pool.h>
 #include <freerdp/plugins/tsmf.h>
 #include <libavcodec/avcodec.h>
 
@@ -48,8 +50,35 @@ typedef struct _TSMFFFmpegDecoder
 	uint8* decoded_data;
 	uint32 decoded_size;
 	uint32 decoded_size_max;
+
+	/* video frames are taken from the pool when the caller provides one */
+	BUFFER_POOL* pool;
+
+	/* from the plugin options, threads 0 means one per CPU */
+	int threads;
+	boolean frame_threads;
+
+	/* layout of decoded_data when the decoder rendered into it directly */
+	boolean direct;
+	uint32 offsets[3];
+	uint32 steps[3];
+
+	uint64 decoded_time;
 } TSMFFFmpegDecoder;
 
+/* extra bytes after the planes, some decoders read a little past the end of a row */
+#define TSMF_FFMPEG_BUFFER_PADDING	64
+
+static void tsmf_ffmpeg_free_decoded_data(TSMFFFmpegDecoder* mdecoder)
+{
+	if (mdecoder->pool && mdecoder->media_type == AVMEDIA_TYPE_VIDEO)
+		buffer_pool_put(mdecoder->decoded_data);
+	else
+		xfree(mdecoder->decoded_data);
+
+	mdecoder->decoded_data = NULL;
+}
+
 static boolean tsmf_ffmpeg_init_context(ITSMFDecoder* decoder)
 {
 	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
@@ -64,8 +93,87 @@ static boolean tsmf_ffmpeg_init_context(ITSMFDecoder* decoder)
 	return true;
 }
 
+/**
+ * Direct rendering: the decoder writes YUV420P pictures straight into pool
+ * buffers, with its own row alignment, so they can be handed out without a
+ * copy. Pictures it keeps as references hold a buffer_pool_ref() of their
+ * own. Buffers are released on any thread when frame threads are used.
+ */
+static int tsmf_ffmpeg_get_buffer(AVCodecContext* context, AVFrame* frame)
+{
+	int width;
+	int height;
+	uint32 size;
+	uint32 luma_step;
+	uint32 chroma_step;
+	uint8* buffer;
+	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) context->opaque;
+
+	if (mdecoder->pool == NULL || context->pix_fmt != PIX_FMT_YUV420P)
+		return avcodec_default_get_buffer(context, frame);
+
+	width = context->width;
+	height = context->height;
+	avcodec_align_dimensions(context, &width, &height);
+
+	luma_step = (width + 31) & ~31;
+	chroma_step = ((width + 1) / 2 + 31) & ~31;
+	size = luma_step * height + chroma_step * ((height + 1) / 2) * 2 + TSMF_FFMPEG_BUFFER_PADDING;
+
+	buffer = buffer_pool_get(mdecoder->pool, size);
+
+	if (buffer == NULL)
+		return -1;
+
+	frame->data[0] = buffer;
+	frame->data[1] = frame->data[0] + luma_step * height;
+	frame->data[2] = frame->data[1] + chroma_step * ((height + 1) / 2);
+	frame->data[3] = NULL;
+	frame->linesize[0] = luma_step;
+	frame->linesize[1] = chroma_step;
+	frame->linesize[2] = chroma_step;
+	frame->linesize[3] = 0;
+
+	frame->opaque = buffer;
+	frame->type = FF_BUFFER_TYPE_USER;
+	frame->reordered_opaque = context->reordered_opaque;
+#if LIBAVCODEC_VERSION_MAJOR < 54
+	frame->age = 256 * 256 * 256 * 64;
+#endif
+
+	return 0;
+}
+
+static void tsmf_ffmpeg_release_buffer(AVCodecContext* context, AVFrame* frame)
+{
+	int i;
+
+	if (frame->type != FF_BUFFER_TYPE_USER)
+	{
+		avcodec_default_release_buffer(context, frame);
+		return;
+	}
+
+	buffer_pool_put((uint8*) frame->opaque);
+
+	for (i = 0; i < 4; i++)
+		frame->data[i] = NULL;
+}
+
+static int tsmf_ffmpeg_cpu_count(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (count > 0)
+		return (int) count;
+#endif
+	return 1;
+}
+
 static boolean tsmf_ffmpeg_init_video_stream(ITSMFDecoder* decoder, const TS_AM_MEDIA_TYPE* media_type)
 {
+	int threads;
 	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
 
 	mdecoder->codec_context->width = media_type->Width;
@@ -74,6 +182,31 @@ static boolean tsmf_ffmpeg_init_video_stream(ITSMFDecoder* decoder, const TS_AM_
 	mdecoder->codec_context->time_base.den = media_type->SamplesPerSecond.Numerator;
 	mdecoder->codec_context->time_base.num = media_type->SamplesPerSecond.Denominator;
 
+	threads = (mdecoder->threads == 0) ? tsmf_ffmpeg_cpu_count() : mdecoder->threads;
+
+	if (threads > 1)
+	{
+		DEBUG_DVC("decoding with %d %s threads", threads, mdecoder->frame_threads ? "frame" : "slice");
+#ifdef FF_THREAD_FRAME
+		mdecoder->codec_context->thread_count = threads;
+		mdecoder->codec_context->thread_type = mdecoder->frame_threads ? FF_THREAD_FRAME : FF_THREAD_SLICE;
+#else
+		avcodec_thread_init(mdecoder->codec_context, threads);
+#endif
+	}
+
+	/* the pool is only set after the codec is opened, get_buffer falls back until then */
+	if (mdecoder->codec->capabilities & CODEC_CAP_DR1)
+	{
+		mdecoder->codec_context->opaque = mdecoder;
+		mdecoder->codec_context->get_buffer = tsmf_ffmpeg_get_buffer;
+		mdecoder->codec_context->release_buffer = tsmf_ffmpeg_release_buffer;
+		mdecoder->codec_context->flags |= CODEC_FLAG_EMU_EDGE;
+#ifdef FF_THREAD_FRAME
+		mdecoder->codec_context->thread_safe_callbacks = 1;
+#endif
+	}
+
 	mdecoder->frame = avcodec_alloc_frame();
 
 	return true;
@@ -258,6 +391,7 @@ static boolean tsmf_ffmpeg_set_format(ITSMFDecoder* decoder, TS_AM_MEDIA_TYPE* m
 static boolean tsmf_ffmpeg_decode_video(ITSMFDecoder* decoder, const uint8* data, uint32 data_size, uint32 extensions)
 {
 	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
+	int i;
 	int decoded;
 	int len;
 	AVFrame* frame;
@@ -284,8 +418,8 @@ static boolean tsmf_ffmpeg_decode_video(ITSMFDecoder* decoder, const uint8* data
 	}
 	else if (!decoded)
 	{
-		DEBUG_WARN("data_size %d, no frame is decoded.", data_size);
-		ret = false;
+		/* the decoder is still filling its reorder or thread queue, the frame comes later */
+		DEBUG_DVC("data_size %d, no frame is decoded yet.", data_size);
 	}
 	else
 	{
@@ -296,9 +430,33 @@ static boolean tsmf_ffmpeg_decode_video(ITSMFDecoder* decoder, const uint8* data
 			mdecoder->codec_context->pix_fmt,
 			mdecoder->codec_context->width, mdecoder->codec_context->height);
 
+		mdecoder->decoded_time = (uint64) mdecoder->frame->reordered_opaque;
+
+		if (mdecoder->frame->type == FF_BUFFER_TYPE_USER)
+		{
+			/* rendered into a pool buffer, share it with the decoder instead of copying */
+			mdecoder->decoded_data = (uint8*) mdecoder->frame->opaque;
+			mdecoder->decoded_size = buffer_pool_get_size(mdecoder->decoded_data);
+			buffer_pool_ref(mdecoder->decoded_data);
+
+			for (i = 0; i < 3; i++)
+			{
+				mdecoder->offsets[i] = mdecoder->frame->data[i] - mdecoder->decoded_data;
+				mdecoder->steps[i] = mdecoder->frame->linesize[i];
+			}
+
+			mdecoder->direct = true;
+
+			return true;
+		}
+
+		mdecoder->direct = false;
 		mdecoder->decoded_size = avpicture_get_size(mdecoder->codec_context->pix_fmt,
 			mdecoder->codec_context->width, mdecoder->codec_context->height);
-		mdecoder->decoded_data = xzalloc(mdecoder->decoded_size);
+		if (mdecoder->pool)
+			mdecoder->decoded_data = buffer_pool_get(mdecoder->pool, mdecoder->decoded_size);
+		else
+			mdecoder->decoded_data = xzalloc(mdecoder->decoded_size);
 		frame = avcodec_alloc_frame();
 		avpicture_fill((AVPicture *) frame, mdecoder->decoded_data,
 			mdecoder->codec_context->pix_fmt,
@@ -409,10 +567,7 @@ static boolean tsmf_ffmpeg_decode(ITSMFDecoder* decoder, const uint8* data, uint
 	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
 
 	if (mdecoder->decoded_data)
-	{
-		xfree(mdecoder->decoded_data);
-		mdecoder->decoded_data = NULL;
-	}
+		tsmf_ffmpeg_free_decoded_data(mdecoder);
 	mdecoder->decoded_size = 0;
 
 	switch (mdecoder->media_type)
@@ -427,6 +582,37 @@ static boolean tsmf_ffmpeg_decode(ITSMFDecoder* decoder, const uint8* data, uint
 	}
 }
 
+/* the presentation time travels with the packet through reordering and frame threads */
+static int tsmf_ffmpeg_decode_ex(ITSMFDecoder* decoder, const uint8* data, uint32 data_size, uint32 extensions,
+	uint64 start_time, uint64 end_time, uint64 duration)
+{
+	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
+
+	mdecoder->codec_context->reordered_opaque = (int64_t) start_time;
+
+	return tsmf_ffmpeg_decode(decoder, data, data_size, extensions);
+}
+
+static void tsmf_ffmpeg_control(ITSMFDecoder* decoder, ITSMFControlMsg control_msg, uint32* arg)
+{
+	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
+
+	switch (control_msg)
+	{
+		case Control_Flush:
+			/* frames still held by the decoder belong to the old position */
+			if (mdecoder->decoded_data)
+				tsmf_ffmpeg_free_decoded_data(mdecoder);
+			mdecoder->decoded_size = 0;
+			if (mdecoder->prepared)
+				avcodec_flush_buffers(mdecoder->codec_context);
+			break;
+
+		default:
+			break;
+	}
+}
+
 static uint8* tsmf_ffmpeg_get_decoded_data(ITSMFDecoder* decoder, uint32* size)
 {
 	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
@@ -471,6 +657,72 @@ static boolean tsmf_ffmpeg_get_decoded_dimension(ITSMFDecoder* decoder, uint32*
 	}
 }
 
+static boolean tsmf_ffmpeg_get_decoded_layout(ITSMFDecoder* decoder, uint32* offsets, uint32* steps)
+{
+	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
+
+	if (!mdecoder->direct)
+		return false;
+
+	memcpy(offsets, mdecoder->offsets, sizeof(mdecoder->offsets));
+	memcpy(steps, mdecoder->steps, sizeof(mdecoder->steps));
+
+	return true;
+}
+
+static boolean tsmf_ffmpeg_get_decoded_time(ITSMFDecoder* decoder, uint64* start_time)
+{
+	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
+
+	if (mdecoder->media_type != AVMEDIA_TYPE_VIDEO || (int64_t) mdecoder->decoded_time == AV_NOPTS_VALUE)
+		return false;
+
+	*start_time = mdecoder->decoded_time;
+
+	return true;
+}
+
+static void tsmf_ffmpeg_set_buffer_pool(ITSMFDecoder* decoder, BUFFER_POOL* pool)
+{
+	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
+
+	mdecoder->pool = pool;
+}
+
+/**
+ * Options are comma separated, such as "threads=4,thread_type=frame".
+ * threads=0 uses one thread per CPU. Slice threads add no latency, frame
+ * threads scale better but hold back as many frames as there are threads.
+ */
+static void tsmf_ffmpeg_set_options(ITSMFDecoder* decoder, const char* options)
+{
+	char* str;
+	char* option;
+	char* value;
+	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
+
+	str = xstrdup(options);
+
+	for (option = strtok(str, ","); option != NULL; option = strtok(NULL, ","))
+	{
+		value = strchr(option, '=');
+
+		if (value == NULL)
+			continue;
+
+		*value++ = '\0';
+
+		if (strcmp(option, "threads") == 0)
+			mdecoder->threads = atoi(value);
+		else if (strcmp(option, "thread_type") == 0)
+			mdecoder->frame_threads = (strcmp(value, "frame") == 0);
+		else
+			DEBUG_WARN("unknown option %s", option);
+	}
+
+	xfree(str);
+}
+
 static void tsmf_ffmpeg_free(ITSMFDecoder* decoder)
 {
 	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
@@ -478,7 +730,7 @@ static void tsmf_ffmpeg_free(ITSMFDecoder* decoder)
 	if (mdecoder->frame)
 		av_free(mdecoder->frame);
 	if (mdecoder->decoded_data)
-		xfree(mdecoder->decoded_data);
+		tsmf_ffmpeg_free_decoded_data(mdecoder);
 	if (mdecoder->codec_context)
 	{
 		if (mdecoder->prepared)
@@ -511,6 +763,15 @@ TSMFDecoderEntry(void)
 	decoder->iface.GetDecodedFormat = tsmf_ffmpeg_get_decoded_format;
 	decoder->iface.GetDecodedDimension = tsmf_ffmpeg_get_decoded_dimension;
 	decoder->iface.Free = tsmf_ffmpeg_free;
+	decoder->iface.Control = tsmf_ffmpeg_control;
+	decoder->iface.SetBufferPool = tsmf_ffmpeg_set_buffer_pool;
+	decoder->iface.SetOptions = tsmf_ffmpeg_set_options;
+	decoder->iface.DecodeEx = tsmf_ffmpeg_decode_ex;
+	decoder->iface.GetDecodedLayout = tsmf_ffmpeg_get_decoded_layout;
+	decoder->iface.GetDecodedTime = tsmf_ffmpeg_get_decoded_time;
+
+	/* decode on the stream thread unless the options ask for more */
+	decoder->threads = 1;
 
 	return (ITSMFDecoder*) decoder;
 }
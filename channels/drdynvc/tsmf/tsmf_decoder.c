@@ -28,7 +28,7 @@
 #include "tsmf_constants.h"
 #include "tsmf_decoder.h"
 
-static ITSMFDecoder* tsmf_load_decoder_by_name(const char* name, TS_AM_MEDIA_TYPE* media_type)
+static ITSMFDecoder* tsmf_load_decoder_by_name(const char* name, const char* options, TS_AM_MEDIA_TYPE* media_type)
 {
 	ITSMFDecoder* decoder;
 	TSMF_DECODER_ENTRY entry;
@@ -55,6 +55,8 @@ static ITSMFDecoder* tsmf_load_decoder_by_name(const char* name, TS_AM_MEDIA_TYP
 		DEBUG_WARN("failed to call export function in %s", name);
 		return NULL;
 	}
+	if (options && decoder->SetOptions)
+		decoder->SetOptions(decoder, options);
 	if (!decoder->SetFormat(decoder, media_type))
 	{
 		decoder->Free(decoder);
@@ -63,17 +65,17 @@ static ITSMFDecoder* tsmf_load_decoder_by_name(const char* name, TS_AM_MEDIA_TYP
 	return decoder;
 }
 
-ITSMFDecoder* tsmf_load_decoder(const char* name, TS_AM_MEDIA_TYPE* media_type)
+ITSMFDecoder* tsmf_load_decoder(const char* name, const char* options, TS_AM_MEDIA_TYPE* media_type)
 {
 	ITSMFDecoder* decoder;
 
 	if (name)
 	{
-		decoder = tsmf_load_decoder_by_name(name, media_type);
+		decoder = tsmf_load_decoder_by_name(name, options, media_type);
 	}
 	else
 	{
-		decoder = tsmf_load_decoder_by_name("ffmpeg", media_type);
+		decoder = tsmf_load_decoder_by_name("ffmpeg", options, media_type);
 	}
 
 	return decoder;
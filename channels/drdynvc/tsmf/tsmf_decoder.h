@@ -21,6 +21,8 @@
 #ifndef __TSMF_DECODER_H
 #define __TSMF_DECODER_H
 
+#include <freerdp/utils/buffer_pool.h>
+
 #include "drdynvc_types.h"
 #include "tsmf_types.h"
 
@@ -61,12 +63,20 @@ struct _ITSMFDecoder
 	void (*ChangeVolume) (ITSMFDecoder * decoder, uint32 newVolume, uint32 muted);
 	/* Check buffer level */
 	uint32 (*BufferLevel) (ITSMFDecoder * decoder);
+	/* Optional: return decoded video frames in buffers from the pool */
+	void (*SetBufferPool) (ITSMFDecoder * decoder, BUFFER_POOL* pool);
+	/* Optional: decoder options from the plugin arguments, called before SetFormat */
+	void (*SetOptions) (ITSMFDecoder * decoder, const char* options);
+	/* Optional: plane offsets and row steps of the decoded video frame. Return false if packed. */
+	boolean (*GetDecodedLayout) (ITSMFDecoder * decoder, uint32* offsets, uint32* steps);
+	/* Optional: start time of the sample the decoded frame came from, it may be an earlier one */
+	boolean (*GetDecodedTime) (ITSMFDecoder * decoder, uint64* start_time);
 };
 
 #define TSMF_DECODER_EXPORT_FUNC_NAME "TSMFDecoderEntry"
 typedef ITSMFDecoder* (*TSMF_DECODER_ENTRY) (void);
 
-ITSMFDecoder* tsmf_load_decoder(const char* name, TS_AM_MEDIA_TYPE* media_type);
+ITSMFDecoder* tsmf_load_decoder(const char* name, const char* options, TS_AM_MEDIA_TYPE* media_type);
 
 #endif
 
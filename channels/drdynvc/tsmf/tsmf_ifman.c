@@ -164,7 +164,7 @@ int tsmf_ifman_add_stream(TSMF_IFMAN* ifman)
 		stream_seek_uint32(ifman->input); /* numMediaType */
 		stream = tsmf_stream_new(presentation, StreamId);
 		if (stream)
-			tsmf_stream_set_format(stream, ifman->decoder_name, ifman->input);
+			tsmf_stream_set_format(stream, ifman->decoder_name, ifman->decoder_options, ifman->input);
 	}
 	ifman->output_pending = true;
 	return error;
@@ -25,6 +25,7 @@ struct _TSMF_IFMAN
 {
 	IWTSVirtualChannelCallback* channel_callback;
 	const char* decoder_name;
+	const char* decoder_options;
 	const char* audio_name;
 	const char* audio_device;
 	uint8 presentation_id[16];
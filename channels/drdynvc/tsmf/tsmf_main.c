@@ -63,6 +63,7 @@ struct _TSMF_PLUGIN
 	TSMF_LISTENER_CALLBACK* listener_callback;
 
 	const char* decoder_name;
+	const char* decoder_options;
 	const char* audio_name;
 	const char* audio_device;
 };
@@ -140,6 +141,7 @@ static int tsmf_on_data_received(IWTSVirtualChannelCallback* pChannelCallback,
 	memset(&ifman, 0, sizeof(TSMF_IFMAN));
 	ifman.channel_callback = pChannelCallback;
 	ifman.decoder_name = ((TSMF_PLUGIN*) callback->plugin)->decoder_name;
+	ifman.decoder_options = ((TSMF_PLUGIN*) callback->plugin)->decoder_options;
 	ifman.audio_name = ((TSMF_PLUGIN*) callback->plugin)->audio_name;
 	ifman.audio_device = ((TSMF_PLUGIN*) callback->plugin)->audio_device;
 	memcpy(ifman.presentation_id, callback->presentation_id, 16);
@@ -408,6 +410,7 @@ static void tsmf_process_plugin_data(IWTSPlugin* pPlugin, RDP_PLUGIN_DATA* data)
 			if (data->data[1] && strcmp((char*)data->data[1], "decoder") == 0)
 			{
 				tsmf->decoder_name = data->data[2];
+				tsmf->decoder_options = data->data[3];
 			}
 			else if (data->data[1] && strcmp((char*)data->data[1], "audio") == 0)
 			{
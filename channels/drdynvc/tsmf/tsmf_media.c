@@ -38,6 +38,7 @@
 #include <freerdp/utils/mutex.h>
 #include <freerdp/utils/event.h>
 #include <freerdp/utils/sleep.h>
+#include <freerdp/utils/buffer_pool.h>
 #include <freerdp/plugins/tsmf.h>
 
 #include "drdynvc_types.h"
@@ -51,6 +52,31 @@
 
 #define AUDIO_TOLERANCE 10000000LL
 
+/**
+ * Idle decoded frames kept for reuse, enough to cover the client's event queue
+ * and the reference frames a decoder rendering directly into pooled buffers holds.
+ */
+#define TSMF_FRAME_POOL_SIZE 16
+
+/**
+ * Video scheduling, times in 100ns units unless noted otherwise.
+ * Frames are decoded up to TSMF_DECODE_AHEAD samples before they are due.
+ * A frame still undecoded more than TSMF_SKIP_THRESHOLD behind the clock is
+ * dropped without decoding when a later key frame is already queued, and a
+ * decoded frame is dropped once its display slot has passed.
+ */
+#define TSMF_DECODE_AHEAD 3
+#define TSMF_SKIP_THRESHOLD 2000000LL
+#define TSMF_EARLY_TOLERANCE 20000LL
+#define TSMF_MIN_FRAME_DURATION 200000LL
+
+/* upper bound on the frames pulled out of a decoder at end of stream */
+#define TSMF_DRAIN_MAX 64
+
+/* thread waits in milliseconds: nothing to do, and audio waiting for another stream */
+#define TSMF_IDLE_WAIT 100
+#define TSMF_SYNC_WAIT 5
+
 struct _TSMF_PRESENTATION
 {
 	uint8 presentation_id[GUID_SIZE];
@@ -78,6 +104,16 @@ struct _TSMF_PRESENTATION
 	uint64 audio_start_time;
 	uint64 audio_end_time;
 
+	/**
+	 * The A/V clock maps media time to system time: clock_media is due at
+	 * clock_system. Audio playback moves it, video only starts it when
+	 * there is no audio.
+	 */
+	boolean clock_valid;
+	boolean clock_audio;
+	uint64 clock_media;
+	uint64 clock_system;
+
 	/* The stream list could be accessed by differnt threads and need to be protected. */
 	freerdp_mutex mutex;
 
@@ -92,6 +128,9 @@ struct _TSMF_STREAM
 
 	ITSMFDecoder* decoder;
 
+	/* decoded frames travel to the client in these and come back when the event is freed */
+	BUFFER_POOL* frame_pool;
+
 	int major_type;
 	int eos;
 	uint32 width;
@@ -104,13 +143,23 @@ struct _TSMF_STREAM
 
 	/* The end_time of last played sample */
 	uint64 last_end_time;
-	/* Next sample should not start before this system time. */
-	uint64 next_start_time;
 
 	freerdp_thread* thread;
 
 	LIST* sample_list;
 
+	/* decoded video samples waiting for their time, accessed only by the stream thread */
+	LIST* ready_list;
+	boolean starved;
+	boolean drained;
+	boolean flush_decoder;
+	uint32 frames_played;
+	uint32 frames_dropped;
+	uint32 frames_skipped;
+	uint32 frames_decoded;
+	uint64 decode_time; /* 100ns units */
+	uint64 decode_time_max;
+
 	/* The sample ack response queue will be accessed only by the stream thread. */
 	LIST* sample_ack_list;
 };
@@ -126,6 +175,9 @@ struct _TSMF_SAMPLE
 	uint8* data;
 	uint32 decoded_size;
 	uint32 pixfmt;
+	uint32 offsets[3];
+	uint32 steps[3];
+	boolean pooled;
 
 	TSMF_STREAM* stream;
 	IWTSVirtualChannelCallback* channel_callback;
@@ -162,6 +214,7 @@ static TSMF_SAMPLE* tsmf_stream_pop_sample(TSMF_STREAM* stream, int sync)
 		{
 			if (stream->decoder->GetDecodedData)
 			{
+				/* video follows the presentation clock instead, see tsmf_stream_process_video() */
 				if (stream->major_type == TSMF_MAJOR_TYPE_AUDIO)
 				{
 					/* Check if some other stream has earlier sample that needs to be played first */
@@ -181,14 +234,6 @@ static TSMF_SAMPLE* tsmf_stream_pop_sample(TSMF_STREAM* stream, int sync)
 						freerdp_mutex_unlock(presentation->mutex);
 					}
 				}
-				else
-				{
-					if (stream->last_end_time > presentation->audio_end_time)
-					{
-						pending = true;
-					}
-				}
-
 			}
 		}
 	}
@@ -208,13 +253,19 @@ static TSMF_SAMPLE* tsmf_stream_pop_sample(TSMF_STREAM* stream, int sync)
 
 static void tsmf_sample_free(TSMF_SAMPLE* sample)
 {
-	if (sample->data)
+	if (sample->pooled)
+		buffer_pool_put(sample->data);
+	else if (sample->data)
 		xfree(sample->data);
 	xfree(sample);
 }
 
 static void tsmf_sample_ack(TSMF_SAMPLE* sample)
 {
+	/* frames drained from the decoder at end of stream have no server sample */
+	if (sample->channel_callback == NULL)
+		return;
+
 	tsmf_playback_ack(sample->channel_callback, sample->sample_id, sample->duration, sample->data_size);
 }
 
@@ -225,7 +276,8 @@ static void tsmf_sample_queue_ack(TSMF_SAMPLE* sample)
 	list_enqueue(stream->sample_ack_list, sample);
 }
 
-static void tsmf_stream_process_ack(TSMF_STREAM* stream)
+/* returns the milliseconds until the next queued ack is due, or -1 */
+static int tsmf_stream_process_ack(TSMF_STREAM* stream)
 {
 	TSMF_SAMPLE* sample;
 	uint64 ack_time;
@@ -234,13 +286,63 @@ static void tsmf_stream_process_ack(TSMF_STREAM* stream)
 	while (list_size(stream->sample_ack_list) > 0 && !freerdp_thread_is_stopped(stream->thread))
 	{
 		sample = (TSMF_SAMPLE*) list_peek(stream->sample_ack_list);
-		if (!sample || sample->ack_time > ack_time)
+		if (!sample)
 			break;
 
+		if (sample->ack_time > ack_time)
+			return (int) ((sample->ack_time - ack_time) / 10000) + 1;
+
 		sample = list_dequeue(stream->sample_ack_list);
 		tsmf_sample_ack(sample);
 		tsmf_sample_free(sample);
 	}
+
+	return -1;
+}
+
+/**
+ * System time at which a sample is due. Without audio the clock starts
+ * with the first video sample, and restarts when a stream that ran dry
+ * gets a sample that is already late, so network stalls do not drop frames.
+ */
+static uint64 tsmf_presentation_due_time(TSMF_PRESENTATION* presentation, TSMF_STREAM* stream,
+	TSMF_SAMPLE* sample, uint64 now)
+{
+	uint64 due;
+
+	freerdp_mutex_lock(presentation->mutex);
+
+	if (!presentation->clock_valid)
+	{
+		presentation->clock_media = sample->start_time;
+		presentation->clock_system = now;
+		presentation->clock_valid = true;
+	}
+
+	due = presentation->clock_system + (sint64) (sample->start_time - presentation->clock_media);
+
+	if (stream->starved && !presentation->clock_audio && due < now)
+	{
+		presentation->clock_media = sample->start_time;
+		presentation->clock_system = now;
+		due = now;
+	}
+
+	freerdp_mutex_unlock(presentation->mutex);
+
+	stream->starved = false;
+
+	return due;
+}
+
+static void tsmf_presentation_set_clock(TSMF_PRESENTATION* presentation, uint64 media_time, uint64 system_time)
+{
+	freerdp_mutex_lock(presentation->mutex);
+	presentation->clock_media = media_time;
+	presentation->clock_system = system_time;
+	presentation->clock_valid = true;
+	presentation->clock_audio = true;
+	freerdp_mutex_unlock(presentation->mutex);
 }
 
 TSMF_PRESENTATION* tsmf_presentation_new(const uint8* guid, IWTSVirtualChannelCallback* pChannelCallback)
@@ -314,9 +416,20 @@ static void tsmf_presentation_restore_last_video_frame(TSMF_PRESENTATION* presen
 	}
 }
 
+static void tsmf_video_frame_free(RDP_EVENT* event)
+{
+	RDP_VIDEO_FRAME_EVENT* vevent = (RDP_VIDEO_FRAME_EVENT*) event;
+
+	/* user_data marks a pooled frame */
+	if (event->user_data)
+	{
+		buffer_pool_put(vevent->frame_data);
+		vevent->frame_data = NULL;
+	}
+}
+
 static void tsmf_sample_playback_video(TSMF_SAMPLE* sample)
 {
-	uint64 t;
 	RDP_VIDEO_FRAME_EVENT* vevent;
 	TSMF_STREAM* stream = sample->stream;
 	TSMF_PRESENTATION* presentation = stream->presentation;
@@ -326,16 +439,6 @@ static void tsmf_sample_playback_video(TSMF_SAMPLE* sample)
 
 	if (sample->data)
 	{
-		t = get_current_time();
-
-		if (stream->next_start_time > t &&
-			(sample->end_time >= presentation->audio_start_time ||
-			sample->end_time < stream->last_end_time))
-		{
-			freerdp_usleep((stream->next_start_time - t) / 10);
-		}
-		stream->next_start_time = t + sample->duration - 50000;
-
 		if (presentation->last_x != presentation->output_x ||
 			presentation->last_y != presentation->output_y ||
 			presentation->last_width != presentation->output_width ||
@@ -367,12 +470,14 @@ static void tsmf_sample_playback_video(TSMF_SAMPLE* sample)
 		}
 
 		vevent = (RDP_VIDEO_FRAME_EVENT*) freerdp_event_new(RDP_EVENT_CLASS_TSMF, RDP_EVENT_TYPE_TSMF_VIDEO_FRAME,
-			NULL, NULL);
+			tsmf_video_frame_free, sample->pooled ? stream->frame_pool : NULL);
 		vevent->frame_data = sample->data;
 		vevent->frame_size = sample->decoded_size;
 		vevent->frame_pixfmt = sample->pixfmt;
 		vevent->frame_width = sample->stream->width;
 		vevent->frame_height = sample->stream->height;
+		memcpy(vevent->frame_offsets, sample->offsets, sizeof(sample->offsets));
+		memcpy(vevent->frame_steps, sample->steps, sizeof(sample->steps));
 		vevent->x = presentation->output_x;
 		vevent->y = presentation->output_y;
 		vevent->width = presentation->output_width;
@@ -388,6 +493,7 @@ static void tsmf_sample_playback_video(TSMF_SAMPLE* sample)
 		/* The frame data ownership is passed to the event object, and is freed after the event is processed. */
 		sample->data = NULL;
 		sample->decoded_size = 0;
+		sample->pooled = false;
 
 		if (!tsmf_push_event(sample->channel_callback, (RDP_EVENT*) vevent))
 		{
@@ -444,10 +550,18 @@ static void tsmf_sample_playback_audio(TSMF_SAMPLE* sample)
 	stream->last_end_time = sample->end_time + latency;
 	stream->presentation->audio_start_time = sample->start_time + latency;
 	stream->presentation->audio_end_time = sample->end_time + latency;
+
+	/* the sample starts being heard once the device latency has passed */
+	tsmf_presentation_set_clock(stream->presentation, sample->start_time, sample->ack_time);
 }
 
-static void tsmf_sample_playback(TSMF_SAMPLE* sample)
+/**
+ * Decode a sample. With decoders that hand the decoded data back, the
+ * sample holds the decoded data afterwards.
+ */
+static boolean tsmf_sample_decode(TSMF_SAMPLE* sample)
 {
+	uint64 t;
 	boolean ret = false;
 	uint32 width;
 	uint32 height;
@@ -456,19 +570,25 @@ static void tsmf_sample_playback(TSMF_SAMPLE* sample)
 
 	if (stream->decoder)
 	{
+		t = get_current_time();
+
 		if (stream->decoder->DecodeEx)
 			ret = stream->decoder->DecodeEx(stream->decoder, sample->data, sample->data_size, sample->extensions,
         			sample->start_time, sample->end_time, sample->duration);
 		else
 			ret = stream->decoder->Decode(stream->decoder, sample->data, sample->data_size, sample->extensions);
+
+		t = get_current_time() - t;
+		stream->frames_decoded++;
+		stream->decode_time += t;
+		if (t > stream->decode_time_max)
+			stream->decode_time_max = t;
+
+		DEBUG_DVC("MessageId %d decoded in %d us", sample->sample_id, (int) (t / 10));
 	}
 
 	if (!ret)
-	{
-		tsmf_sample_ack(sample);
-		tsmf_sample_free(sample);
-		return;
-	}
+		return false;
 
 	xfree(sample->data);
 	sample->data = NULL;
@@ -479,11 +599,7 @@ static void tsmf_sample_playback(TSMF_SAMPLE* sample)
 		{
 			pixfmt = stream->decoder->GetDecodedFormat(stream->decoder);
 			if (pixfmt == ((uint32) -1))
-			{
-				tsmf_sample_ack(sample);
-				tsmf_sample_free(sample);
-				return;
-			}
+				return false;
 			sample->pixfmt = pixfmt;
 		}
 
@@ -503,6 +619,38 @@ static void tsmf_sample_playback(TSMF_SAMPLE* sample)
 	if (stream->decoder->GetDecodedData)
 	{
 		sample->data = stream->decoder->GetDecodedData(stream->decoder, &sample->decoded_size);
+		sample->pooled = (stream->frame_pool != NULL && sample->data != NULL);
+
+		if (sample->data && stream->decoder->GetDecodedLayout)
+		{
+			if (!stream->decoder->GetDecodedLayout(stream->decoder, sample->offsets, sample->steps))
+			{
+				memset(sample->offsets, 0, sizeof(sample->offsets));
+				memset(sample->steps, 0, sizeof(sample->steps));
+			}
+		}
+
+		/* decoders with reordering or frame threads return frames of earlier samples */
+		if (sample->data && stream->decoder->GetDecodedTime)
+			stream->decoder->GetDecodedTime(stream->decoder, &sample->start_time);
+	}
+
+	return true;
+}
+
+static void tsmf_sample_playback(TSMF_SAMPLE* sample)
+{
+	TSMF_STREAM* stream = sample->stream;
+
+	if (!tsmf_sample_decode(sample))
+	{
+		tsmf_sample_ack(sample);
+		tsmf_sample_free(sample);
+		return;
+	}
+
+	if (stream->decoder->GetDecodedData)
+	{
 		switch (sample->stream->major_type)
 		{
 			case TSMF_MAJOR_TYPE_VIDEO:
@@ -624,8 +772,159 @@ static void tsmf_sample_playback(TSMF_SAMPLE* sample)
         }
 }
 
+/* true if a key frame is queued, decoding can restart from there */
+static boolean tsmf_stream_has_cleanpoint(TSMF_STREAM* stream)
+{
+	LIST_ITEM* item;
+	boolean found = false;
+
+	freerdp_thread_lock(stream->thread);
+
+	for (item = stream->sample_list->head; item; item = item->next)
+	{
+		if (((TSMF_SAMPLE*) item->data)->extensions & TSMM_SAMPLE_EXT_CLEANPOINT)
+		{
+			found = true;
+			break;
+		}
+	}
+
+	freerdp_thread_unlock(stream->thread);
+
+	return found;
+}
+
+/**
+ * At end of stream, pull the frames a reordering or frame threaded decoder
+ * still holds by decoding empty packets, and queue them for playback.
+ */
+static void tsmf_stream_drain_video(TSMF_STREAM* stream)
+{
+	int i;
+	TSMF_SAMPLE* sample;
+
+	stream->drained = true;
+
+	for (i = 0; i < TSMF_DRAIN_MAX; i++)
+	{
+		sample = xnew(TSMF_SAMPLE);
+		sample->stream = stream;
+
+		if (!tsmf_sample_decode(sample) || sample->data == NULL)
+		{
+			tsmf_sample_free(sample);
+			break;
+		}
+
+		list_enqueue(stream->ready_list, sample);
+	}
+}
+
+/**
+ * Decode ahead and present the video frames that are due, dropping the
+ * ones that are late. Returns the milliseconds until the next frame is due.
+ */
+static int tsmf_stream_process_video(TSMF_STREAM* stream)
+{
+	uint64 now;
+	uint64 due;
+	uint64 duration;
+	TSMF_SAMPLE* sample;
+	TSMF_PRESENTATION* presentation = stream->presentation;
+
+	while (!freerdp_thread_is_stopped(stream->thread))
+	{
+		while (list_size(stream->ready_list) < TSMF_DECODE_AHEAD)
+		{
+			sample = tsmf_stream_pop_sample(stream, 0);
+
+			if (sample == NULL)
+			{
+				if (stream->eos && !stream->drained)
+					tsmf_stream_drain_video(stream);
+				if (list_size(stream->ready_list) == 0)
+					stream->starved = true;
+				break;
+			}
+
+			now = get_current_time();
+			due = tsmf_presentation_due_time(presentation, stream, sample, now);
+
+			/* far behind: skip decoding up to the next key frame */
+			if (now > due + TSMF_SKIP_THRESHOLD && !(sample->extensions & TSMM_SAMPLE_EXT_CLEANPOINT) &&
+				tsmf_stream_has_cleanpoint(stream))
+			{
+				stream->frames_skipped++;
+				tsmf_sample_ack(sample);
+				tsmf_sample_free(sample);
+				continue;
+			}
+
+			if (!tsmf_sample_decode(sample))
+			{
+				tsmf_sample_ack(sample);
+				tsmf_sample_free(sample);
+				continue;
+			}
+
+			list_enqueue(stream->ready_list, sample);
+		}
+
+		sample = (TSMF_SAMPLE*) list_peek(stream->ready_list);
+
+		if (sample == NULL)
+			return TSMF_IDLE_WAIT;
+
+		now = get_current_time();
+		due = tsmf_presentation_due_time(presentation, stream, sample, now);
+
+		if (due > now + TSMF_EARLY_TOLERANCE)
+		{
+			if (due - now > TSMF_IDLE_WAIT * 10000LL)
+				return TSMF_IDLE_WAIT;
+
+			return (int) ((due - now) / 10000) + 1;
+		}
+
+		list_dequeue(stream->ready_list);
+
+		duration = (sample->duration > TSMF_MIN_FRAME_DURATION) ? sample->duration : TSMF_MIN_FRAME_DURATION;
+
+		if (now > due + duration)
+		{
+			stream->frames_dropped++;
+		}
+		else
+		{
+			tsmf_sample_playback_video(sample);
+			stream->frames_played++;
+		}
+
+		tsmf_sample_ack(sample);
+		tsmf_sample_free(sample);
+	}
+
+	return 0;
+}
+
+/* at end of stream the decoded frames left are shown without waiting */
+static void tsmf_stream_play_ready(TSMF_STREAM* stream)
+{
+	TSMF_SAMPLE* sample;
+
+	while ((sample = (TSMF_SAMPLE*) list_dequeue(stream->ready_list)) != NULL)
+	{
+		tsmf_sample_playback_video(sample);
+		tsmf_sample_ack(sample);
+		tsmf_sample_free(sample);
+	}
+}
+
 static void* tsmf_stream_playback_func(void* arg)
 {
+	int timeout;
+	int ack_timeout;
+	boolean scheduled;
 	TSMF_SAMPLE* sample;
 	TSMF_STREAM* stream = (TSMF_STREAM*) arg;
 	TSMF_PRESENTATION* presentation = stream->presentation;
@@ -650,20 +949,66 @@ static void* tsmf_stream_playback_func(void* arg)
 			}
 		}
 	}
+
+	/* decoders handing video frames back are scheduled here, others render themselves */
+	scheduled = (stream->major_type == TSMF_MAJOR_TYPE_VIDEO &&
+		stream->decoder && stream->decoder->GetDecodedData);
+
 	while (!freerdp_thread_is_stopped(stream->thread))
 	{
-		tsmf_stream_process_ack(stream);
-		sample = tsmf_stream_pop_sample(stream, 1);
-		if (sample)
-			tsmf_sample_playback(sample);
+		/* new samples signal the thread, a signal while busy makes the wait return at once */
+		freerdp_thread_reset(stream->thread);
+
+		if (stream->flush_decoder)
+		{
+			stream->flush_decoder = false;
+			if (stream->decoder && stream->decoder->Control)
+				stream->decoder->Control(stream->decoder, Control_Flush, NULL);
+		}
+
+		ack_timeout = tsmf_stream_process_ack(stream);
+
+		if (scheduled)
+		{
+			timeout = tsmf_stream_process_video(stream);
+		}
 		else
-			freerdp_usleep(5000);
+		{
+			sample = tsmf_stream_pop_sample(stream, 1);
+
+			if (sample)
+			{
+				tsmf_sample_playback(sample);
+				continue;
+			}
+
+			timeout = (list_size(stream->sample_list) > 0) ? TSMF_SYNC_WAIT : TSMF_IDLE_WAIT;
+		}
+
+		if (ack_timeout >= 0 && ack_timeout < timeout)
+			timeout = ack_timeout;
+
+		freerdp_thread_wait_timeout(stream->thread, timeout);
 	}
 	if (stream->eos || presentation->eos)
 	{
+		tsmf_stream_play_ready(stream);
 		while ((sample = tsmf_stream_pop_sample(stream, 1)) != NULL)
 			tsmf_sample_playback(sample);
+
+		if (scheduled && !stream->drained)
+		{
+			tsmf_stream_drain_video(stream);
+			tsmf_stream_play_ready(stream);
+		}
 	}
+
+	DEBUG_DVC("stream %d: %d frames played, %d dropped late, %d skipped before decoding", stream->stream_id,
+		stream->frames_played, stream->frames_dropped, stream->frames_skipped);
+	DEBUG_DVC("stream %d: %d samples decoded in %d us on average, %d us at most", stream->stream_id,
+		stream->frames_decoded, stream->frames_decoded ? (int) (stream->decode_time / stream->frames_decoded / 10) : 0,
+		(int) (stream->decode_time_max / 10));
+
 	if (stream->audio)
 	{
 		stream->audio->Free(stream->audio);
@@ -853,12 +1198,18 @@ static void tsmf_stream_flush(TSMF_STREAM* stream)
 	while ((sample = list_dequeue(stream->sample_ack_list)) != NULL)
 		tsmf_sample_free(sample);
 
+	while ((sample = list_dequeue(stream->ready_list)) != NULL)
+		tsmf_sample_free(sample);
+
 	if (stream->audio)
 		stream->audio->Flush(stream->audio);
 
 	stream->eos = 0;
 	stream->last_end_time = 0;
-	stream->next_start_time = 0;
+	stream->starved = false;
+	stream->drained = false;
+	/* the decoder belongs to the stream thread, it drops its held frames there */
+	stream->flush_decoder = true;
 	if (stream->major_type == TSMF_MAJOR_TYPE_AUDIO)
 	{
 		stream->presentation->audio_start_time = 0;
@@ -880,6 +1231,11 @@ void tsmf_presentation_flush(TSMF_PRESENTATION* presentation)
 	presentation->eos = 0;
 	presentation->audio_start_time = 0;
 	presentation->audio_end_time = 0;
+
+	freerdp_mutex_lock(presentation->mutex);
+	presentation->clock_valid = false;
+	presentation->clock_audio = false;
+	freerdp_mutex_unlock(presentation->mutex);
 }
 
 void tsmf_presentation_free(TSMF_PRESENTATION* presentation)
@@ -921,6 +1277,7 @@ TSMF_STREAM* tsmf_stream_new(TSMF_PRESENTATION* presentation, uint32 stream_id)
 	stream->thread = freerdp_thread_new();
 	stream->sample_list = list_new();
 	stream->sample_ack_list = list_new();
+	stream->ready_list = list_new();
 
 	freerdp_mutex_lock(presentation->mutex);
 	list_enqueue(presentation->stream_list, stream);
@@ -943,7 +1300,7 @@ TSMF_STREAM* tsmf_stream_find_by_id(TSMF_PRESENTATION* presentation, uint32 stre
 	return NULL;
 }
 
-void tsmf_stream_set_format(TSMF_STREAM* stream, const char* name, STREAM* s)
+void tsmf_stream_set_format(TSMF_STREAM* stream, const char* name, const char* options, STREAM* s)
 {
 	TS_AM_MEDIA_TYPE mediatype;
 
@@ -977,7 +1334,13 @@ void tsmf_stream_set_format(TSMF_STREAM* stream, const char* name, STREAM* s)
 	stream->major_type = mediatype.MajorType;
 	stream->width = mediatype.Width;
 	stream->height = mediatype.Height;
-	stream->decoder = tsmf_load_decoder(name, &mediatype);
+	stream->decoder = tsmf_load_decoder(name, options, &mediatype);
+
+	if (stream->decoder && stream->decoder->SetBufferPool && mediatype.MajorType == TSMF_MAJOR_TYPE_VIDEO)
+	{
+		stream->frame_pool = buffer_pool_new(TSMF_FRAME_POOL_SIZE);
+		stream->decoder->SetBufferPool(stream->decoder, stream->frame_pool);
+	}
 }
 
 void tsmf_stream_end(TSMF_STREAM* stream)
@@ -999,6 +1362,7 @@ void tsmf_stream_free(TSMF_STREAM* stream)
 
 	list_free(stream->sample_list);
 	list_free(stream->sample_ack_list);
+	list_free(stream->ready_list);
 
 	if (stream->decoder)
 	{
@@ -1006,6 +1370,9 @@ void tsmf_stream_free(TSMF_STREAM* stream)
 		stream->decoder = 0;
 	}
 
+	/* frames still queued for the client keep the pool alive */
+	buffer_pool_free(stream->frame_pool);
+
 	freerdp_thread_free(stream->thread);
 
 	xfree(stream);
@@ -1044,6 +1411,8 @@ void tsmf_stream_push_sample(TSMF_STREAM* stream, IWTSVirtualChannelCallback* pC
 	freerdp_thread_lock(stream->thread);
 	list_enqueue(stream->sample_list, sample);
 	freerdp_thread_unlock(stream->thread);
+
+	freerdp_thread_signal(stream->thread);
 }
 
 #ifndef _WIN32
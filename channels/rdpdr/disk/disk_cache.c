@@ -0,0 +1,431 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol client.
+ * File System Virtual Channel - Metadata Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _WIN32
+#define __USE_LARGEFILE64
+#define _LARGEFILE_SOURCE
+#define _LARGEFILE64_SOURCE
+#endif
+
+#include "freerdp_config.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/unicode.h>
+#include <freerdp/utils/svc_plugin.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#define DISK_CACHE_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+	IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
+#include "disk_cache.h"
+
+static uint32 disk_cache_hash(const char* path, int length)
+{
+	int i;
+	uint32 hash = 5381;
+
+	for (i = 0; i < length; i++)
+		hash = ((hash << 5) + hash) + (uint8) path[i];
+
+	return hash;
+}
+
+static int disk_cache_entry_compare(const void* a, const void* b)
+{
+	return strcmp(((DISK_DIR_ENTRY*) a)->name, ((DISK_DIR_ENTRY*) b)->name);
+}
+
+static void disk_cache_unref(DISK_DIR_LISTING* listing)
+{
+	int i;
+
+	if (--listing->refcount > 0)
+		return;
+
+	for (i = 0; i < listing->count; i++)
+	{
+		xfree(listing->entries[i].name);
+		xfree(listing->entries[i].uname);
+	}
+
+	xfree(listing->entries);
+	xfree(listing->path);
+	xfree(listing);
+}
+
+static DISK_DIR_LISTING* disk_cache_find(DISK_CACHE* cache, const char* path, int length)
+{
+	uint32 hash;
+	DISK_DIR_LISTING* listing;
+
+	hash = disk_cache_hash(path, length);
+
+	for (listing = cache->buckets[hash % DISK_CACHE_BUCKETS]; listing; listing = listing->next)
+	{
+		if (listing->hash == hash && strncmp(listing->path, path, length) == 0 &&
+				listing->path[length] == '\0')
+			return listing;
+	}
+
+	return NULL;
+}
+
+/* drop a listing from the table, open directory handles may still hold it */
+static void disk_cache_remove(DISK_CACHE* cache, DISK_DIR_LISTING* listing)
+{
+	DISK_DIR_LISTING** link;
+
+	for (link = &cache->buckets[listing->hash % DISK_CACHE_BUCKETS]; *link; link = &(*link)->next)
+	{
+		if (*link == listing)
+		{
+			*link = listing->next;
+			break;
+		}
+	}
+
+#ifdef __linux__
+	if (listing->wd >= 0)
+		inotify_rm_watch(cache->inotify_fd, listing->wd);
+#endif
+
+	listing->next = NULL;
+	cache->count--;
+
+	DEBUG_SVC("dropped %s", listing->path);
+	disk_cache_unref(listing);
+}
+
+static void disk_cache_flush(DISK_CACHE* cache)
+{
+	int i;
+
+	for (i = 0; i < DISK_CACHE_BUCKETS; i++)
+	{
+		while (cache->buckets[i])
+			disk_cache_remove(cache, cache->buckets[i]);
+	}
+}
+
+static void disk_cache_evict(DISK_CACHE* cache)
+{
+	int i;
+	DISK_DIR_LISTING* listing;
+	DISK_DIR_LISTING* oldest = NULL;
+
+	for (i = 0; i < DISK_CACHE_BUCKETS; i++)
+	{
+		for (listing = cache->buckets[i]; listing; listing = listing->next)
+		{
+			if (!oldest || (sint32) (listing->last_used - oldest->last_used) < 0)
+				oldest = listing;
+		}
+	}
+
+	if (oldest)
+		disk_cache_remove(cache, oldest);
+}
+
+/* apply pending change notifications, never blocks */
+static void disk_cache_poll(DISK_CACHE* cache)
+{
+#ifdef __linux__
+	int i;
+	ssize_t length;
+	ssize_t offset;
+	struct inotify_event* event;
+	DISK_DIR_LISTING* listing;
+	char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	if (cache->inotify_fd < 0)
+		return;
+
+	while ((length = read(cache->inotify_fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (offset = 0; offset < length; offset += sizeof(struct inotify_event) + event->len)
+		{
+			event = (struct inotify_event*) &buffer[offset];
+
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				disk_cache_flush(cache);
+				continue;
+			}
+
+			for (i = 0; i < DISK_CACHE_BUCKETS; i++)
+			{
+				for (listing = cache->buckets[i]; listing; listing = listing->next)
+				{
+					if (listing->wd == event->wd)
+						break;
+				}
+
+				if (listing)
+				{
+					/* the kernel drops the watch by itself on IN_IGNORED */
+					if (event->mask & IN_IGNORED)
+						listing->wd = -1;
+
+					disk_cache_remove(cache, listing);
+					break;
+				}
+			}
+		}
+	}
+#endif
+}
+
+static boolean disk_cache_is_stale(DISK_CACHE* cache, DISK_DIR_LISTING* listing)
+{
+	if (listing->wd >= 0)
+		return false;
+
+	return (time(NULL) - listing->timestamp > DISK_CACHE_TTL) ? true : false;
+}
+
+static DISK_DIR_LISTING* disk_cache_load(DISK_CACHE* cache, const char* path)
+{
+	DIR* dir;
+	int size;
+	char* ent_path;
+	UNICONV* uniconv;
+	struct dirent* ent;
+	DISK_DIR_ENTRY* entry;
+	DISK_DIR_LISTING* listing;
+
+	listing = xnew(DISK_DIR_LISTING);
+	listing->path = xstrdup(path);
+	listing->hash = disk_cache_hash(path, strlen(path));
+	listing->wd = -1;
+	listing->timestamp = time(NULL);
+
+	/* watch before reading, so that no change can slip in between */
+#ifdef __linux__
+	if (cache->inotify_fd >= 0)
+		listing->wd = inotify_add_watch(cache->inotify_fd, path, DISK_CACHE_WATCH_MASK);
+#endif
+
+	dir = opendir(path);
+
+	if (dir == NULL)
+	{
+#ifdef __linux__
+		if (listing->wd >= 0)
+			inotify_rm_watch(cache->inotify_fd, listing->wd);
+#endif
+		xfree(listing->path);
+		xfree(listing);
+		return NULL;
+	}
+
+	size = 64;
+	listing->entries = (DISK_DIR_ENTRY*) xmalloc(sizeof(DISK_DIR_ENTRY) * size);
+	ent_path = (char*) xmalloc(strlen(path) + 256 + 2);
+	uniconv = freerdp_uniconv_new();
+
+	while ((ent = readdir(dir)) != NULL)
+	{
+		if (listing->count == size)
+		{
+			size *= 2;
+			listing->entries = (DISK_DIR_ENTRY*) xrealloc(listing->entries, sizeof(DISK_DIR_ENTRY) * size);
+		}
+
+		entry = &listing->entries[listing->count++];
+		entry->name = xstrdup(ent->d_name);
+		entry->uname = freerdp_uniconv_out(uniconv, ent->d_name, &entry->ulen);
+
+		memset(&entry->st, 0, sizeof(struct STAT));
+		sprintf(ent_path, "%s/%s", path, ent->d_name);
+
+		if (STAT(ent_path, &entry->st) != 0)
+			DEBUG_WARN("stat %s failed. errno = %d", ent_path, errno);
+	}
+
+	freerdp_uniconv_free(uniconv);
+	xfree(ent_path);
+	closedir(dir);
+
+	qsort(listing->entries, listing->count, sizeof(DISK_DIR_ENTRY), disk_cache_entry_compare);
+
+	DEBUG_SVC("loaded %s (%d entries)", path, listing->count);
+
+	return listing;
+}
+
+DISK_DIR_LISTING* disk_cache_get_listing(DISK_CACHE* cache, const char* path)
+{
+	DISK_DIR_LISTING* listing;
+	DISK_DIR_LISTING** bucket;
+
+	freerdp_mutex_lock(cache->mutex);
+
+	disk_cache_poll(cache);
+
+	listing = disk_cache_find(cache, path, strlen(path));
+
+	if (listing && disk_cache_is_stale(cache, listing))
+	{
+		disk_cache_remove(cache, listing);
+		listing = NULL;
+	}
+
+	if (listing == NULL)
+	{
+		if (cache->count >= DISK_CACHE_MAX_DIRS)
+			disk_cache_evict(cache);
+
+		listing = disk_cache_load(cache, path);
+
+		if (listing)
+		{
+			listing->refcount = 1; /* held by the table */
+			bucket = &cache->buckets[listing->hash % DISK_CACHE_BUCKETS];
+			listing->next = *bucket;
+			*bucket = listing;
+			cache->count++;
+		}
+	}
+
+	if (listing)
+	{
+		listing->refcount++;
+		listing->last_used = ++cache->use_counter;
+	}
+
+	freerdp_mutex_unlock(cache->mutex);
+
+	return listing;
+}
+
+void disk_cache_release_listing(DISK_CACHE* cache, DISK_DIR_LISTING* listing)
+{
+	if (listing == NULL)
+		return;
+
+	freerdp_mutex_lock(cache->mutex);
+	disk_cache_unref(listing);
+	freerdp_mutex_unlock(cache->mutex);
+}
+
+boolean disk_cache_stat(DISK_CACHE* cache, const char* path, struct STAT* st)
+{
+	char* name;
+	boolean found = false;
+	DISK_DIR_ENTRY key;
+	DISK_DIR_ENTRY* entry;
+	DISK_DIR_LISTING* listing;
+
+	name = strrchr(path, '/');
+
+	if (name && name != path)
+	{
+		freerdp_mutex_lock(cache->mutex);
+
+		disk_cache_poll(cache);
+
+		/* only served from an already loaded parent, a stat alone never loads a directory */
+		listing = disk_cache_find(cache, path, name - path);
+
+		if (listing && !disk_cache_is_stale(cache, listing))
+		{
+			key.name = name + 1;
+			entry = (DISK_DIR_ENTRY*) bsearch(&key, listing->entries, listing->count,
+				sizeof(DISK_DIR_ENTRY), disk_cache_entry_compare);
+
+			if (entry)
+			{
+				memcpy(st, &entry->st, sizeof(struct STAT));
+				found = true;
+			}
+		}
+
+		freerdp_mutex_unlock(cache->mutex);
+	}
+
+	if (found)
+		return true;
+
+	return (STAT(path, st) == 0) ? true : false;
+}
+
+void disk_cache_invalidate(DISK_CACHE* cache, const char* path)
+{
+	char* name;
+	DISK_DIR_LISTING* listing;
+
+	freerdp_mutex_lock(cache->mutex);
+
+	listing = disk_cache_find(cache, path, strlen(path));
+
+	if (listing)
+		disk_cache_remove(cache, listing);
+
+	name = strrchr(path, '/');
+
+	if (name && name != path)
+	{
+		listing = disk_cache_find(cache, path, name - path);
+
+		if (listing)
+			disk_cache_remove(cache, listing);
+	}
+
+	freerdp_mutex_unlock(cache->mutex);
+}
+
+DISK_CACHE* disk_cache_new(void)
+{
+	DISK_CACHE* cache;
+
+	cache = xnew(DISK_CACHE);
+	cache->mutex = freerdp_mutex_new();
+	cache->inotify_fd = -1;
+
+#ifdef __linux__
+	cache->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (cache->inotify_fd < 0)
+		DEBUG_WARN("inotify_init1 failed, errno = %d. falling back to a %d second TTL.", errno, DISK_CACHE_TTL);
+#endif
+
+	return cache;
+}
+
+void disk_cache_free(DISK_CACHE* cache)
+{
+	if (cache == NULL)
+		return;
+
+	disk_cache_flush(cache);
+
+	if (cache->inotify_fd >= 0)
+		close(cache->inotify_fd);
+
+	freerdp_mutex_free(cache->mutex);
+	xfree(cache);
+}
@@ -0,0 +1,83 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol client.
+ * File System Virtual Channel - Metadata Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DISK_CACHE_H
+#define __DISK_CACHE_H
+
+#include <time.h>
+#include <freerdp/types.h>
+#include <freerdp/utils/mutex.h>
+
+#include "disk_file.h"
+
+#define DISK_CACHE_BUCKETS	64
+#define DISK_CACHE_MAX_DIRS	128
+#define DISK_CACHE_TTL		2 /* seconds, only used without inotify */
+
+typedef struct _DISK_CACHE DISK_CACHE;
+typedef struct _DISK_DIR_LISTING DISK_DIR_LISTING;
+typedef struct _DISK_DIR_ENTRY DISK_DIR_ENTRY;
+
+struct _DISK_DIR_ENTRY
+{
+	char* name;
+	char* uname; /* name in UTF-16LE */
+	size_t ulen;
+	struct STAT st;
+};
+
+/**
+ * A snapshot of one directory. Snapshots are reference counted: an open
+ * directory handle keeps enumerating the snapshot it started with even
+ * if the cache drops it in the meantime.
+ */
+struct _DISK_DIR_LISTING
+{
+	char* path;
+	uint32 hash;
+	int refcount;
+	int wd;
+	time_t timestamp;
+	uint32 last_used;
+
+	int count;
+	DISK_DIR_ENTRY* entries; /* sorted by name */
+
+	DISK_DIR_LISTING* next;
+};
+
+struct _DISK_CACHE
+{
+	freerdp_mutex mutex;
+
+	int count;
+	uint32 use_counter;
+	DISK_DIR_LISTING* buckets[DISK_CACHE_BUCKETS];
+
+	int inotify_fd;
+};
+
+DISK_CACHE* disk_cache_new(void);
+void disk_cache_free(DISK_CACHE* cache);
+
+DISK_DIR_LISTING* disk_cache_get_listing(DISK_CACHE* cache, const char* path);
+void disk_cache_release_listing(DISK_CACHE* cache, DISK_DIR_LISTING* listing);
+
+boolean disk_cache_stat(DISK_CACHE* cache, const char* path, struct STAT* st);
+void disk_cache_invalidate(DISK_CACHE* cache, const char* path);
+
+#endif /* __DISK_CACHE_H */
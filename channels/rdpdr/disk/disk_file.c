@@ -47,6 +47,7 @@
 #include "rdpdr_constants.h"
 #include "rdpdr_types.h"
 #include "disk_file.h"
+#include "disk_cache.h"
 
 static boolean disk_file_wildcard_match(const char* pattern, const char* filename)
 {
@@ -208,20 +209,17 @@ static boolean disk_file_init(DISK_FILE* file, uint32 DesiredAccess, uint32 Crea
 				return true;
 			  }
 			}
+			else
+			{
+				file->err = ENOENT;
+				return true;
+			}
 		}
 		exists = false;
 	}
 
-	if (file->is_dir)
-	{
-		file->dir = opendir(file->fullpath);
-		if (file->dir == NULL)
-		{
-			file->err = errno;
-			return true;
-		}
-	}
-	else
+	/* directory listings come from the cache, nothing to open here */
+	if (!file->is_dir)
 	{
 		switch (CreateDisposition)
 		{
@@ -276,16 +274,20 @@ static boolean disk_file_init(DISK_FILE* file, uint32 DesiredAccess, uint32 Crea
 		}
 	}
 
+	if (!exists || (oflag & O_TRUNC))
+		disk_cache_invalidate(file->cache, file->fullpath);
+
 	return true;
 }
 
-DISK_FILE* disk_file_new(const char* base_path, const char* path, uint32 id,
+DISK_FILE* disk_file_new(DISK_CACHE* cache, const char* base_path, const char* path, uint32 id,
 	uint32 DesiredAccess, uint32 CreateDisposition, uint32 CreateOptions)
 {
 	DISK_FILE* file;
 
 	file = xnew(DISK_FILE);
 	file->id = id;
+	file->cache = cache;
 	file->basepath = (char*) base_path;
 	disk_file_set_fullpath(file, disk_file_combine_fullpath(base_path, path));
 	file->fd = -1;
@@ -303,8 +305,6 @@ void disk_file_free(DISK_FILE* file)
 {
 	if (file->fd != -1)
 		close(file->fd);
-	if (file->dir != NULL)
-		closedir(file->dir);
 
 	if (file->delete_pending)
 	{
@@ -312,8 +312,12 @@ void disk_file_free(DISK_FILE* file)
 			disk_file_remove_dir(file->fullpath);
 		else
 			unlink(file->fullpath);
+
+		disk_cache_invalidate(file->cache, file->fullpath);
 	}
 
+	disk_cache_release_listing(file->cache, file->listing);
+
 	xfree(file->pattern);
 	xfree(file->fullpath);
 	xfree(file);
@@ -345,6 +349,33 @@ boolean disk_file_read(DISK_FILE* file, uint8* buffer, uint32* Length)
 	return true;
 }
 
+void disk_file_readahead(DISK_FILE* file, uint64 Offset, uint32 Length)
+{
+	if (file->is_dir || file->fd == -1)
+		return;
+
+	/* prefetch a few requests worth of data, bounded; Length comes off the wire */
+	if (Length > DISK_READAHEAD_MAX / 4)
+		Length = DISK_READAHEAD_MAX;
+	else
+		Length *= 4;
+
+	if (Length < DISK_READAHEAD_MIN)
+		Length = DISK_READAHEAD_MIN;
+
+#if defined(POSIX_FADV_WILLNEED)
+	posix_fadvise(file->fd, (off_t) Offset, (off_t) Length, POSIX_FADV_WILLNEED);
+#elif defined(F_RDADVISE)
+	{
+		struct radvisory ra;
+
+		ra.ra_offset = (off_t) Offset;
+		ra.ra_count = (int) Length;
+		fcntl(file->fd, F_RDADVISE, &ra);
+	}
+#endif
+}
+
 boolean disk_file_write(DISK_FILE* file, uint8* buffer, uint32 Length)
 {
 	ssize_t r;
@@ -361,6 +392,8 @@ boolean disk_file_write(DISK_FILE* file, uint8* buffer, uint32 Length)
 		buffer += r;
 	}
 
+	disk_cache_invalidate(file->cache, file->fullpath);
+
 	return true;
 }
 
@@ -368,7 +401,7 @@ boolean disk_file_query_information(DISK_FILE* file, uint32 FsInformationClass,
 {
 	struct STAT st;
 
-	if (STAT(file->fullpath, &st) != 0)
+	if (!disk_cache_stat(file->cache, file->fullpath, &st))
 	{
 		stream_write_uint32(output, 0); /* Length */
 		return false;
@@ -457,6 +490,8 @@ boolean disk_file_set_information(DISK_FILE* file, uint32 FsInformationClass, ui
 				if (m != st.st_mode)
 					fchmod(file->fd, st.st_mode);
 			}
+
+			disk_cache_invalidate(file->cache, file->fullpath);
 			break;
 
 		case FileEndOfFileInformation:
@@ -466,6 +501,8 @@ boolean disk_file_set_information(DISK_FILE* file, uint32 FsInformationClass, ui
 			stream_read_uint64(input, size);
 			if (ftruncate(file->fd, size) != 0)
 				return false;
+
+			disk_cache_invalidate(file->cache, file->fullpath);
 			break;
 
 		case FileDispositionInformation:
@@ -492,6 +529,8 @@ boolean disk_file_set_information(DISK_FILE* file, uint32 FsInformationClass, ui
 			if (rename(file->fullpath, fullpath) == 0)
 			{
 				DEBUG_SVC("renamed %s to %s", file->fullpath, fullpath);
+				disk_cache_invalidate(file->cache, file->fullpath);
+				disk_cache_invalidate(file->cache, fullpath);
 				disk_file_set_fullpath(file, fullpath);
 			}
 			else
@@ -514,16 +553,15 @@ boolean disk_file_set_information(DISK_FILE* file, uint32 FsInformationClass, ui
 boolean disk_file_query_directory(DISK_FILE* file, uint32 FsInformationClass, uint8 InitialQuery,
 	const char* path, STREAM* output)
 {
-	struct dirent* ent;
-	char* ent_path;
+	DISK_DIR_ENTRY* entry;
 	struct STAT st;
-	UNICONV* uniconv;
+	char* ent_path;
 	size_t len;
 	boolean ret;
 
 	DEBUG_SVC("path %s FsInformationClass %d InitialQuery %d", path, FsInformationClass, InitialQuery);
 
-	if (!file->dir)
+	if (!file->is_dir)
 	{
 		stream_write_uint32(output, 0); /* Length */
 		stream_write_uint8(output, 0); /* Padding */
@@ -532,7 +570,10 @@ boolean disk_file_query_directory(DISK_FILE* file, uint32 FsInformationClass, ui
 
 	if (InitialQuery != 0)
 	{
-		rewinddir(file->dir);
+		/* enumeration runs on a cached snapshot of the directory */
+		disk_cache_release_listing(file->cache, file->listing);
+		file->listing = disk_cache_get_listing(file->cache, file->fullpath);
+		file->listing_index = 0;
 		xfree(file->pattern);
 
 		if (path[0])
@@ -541,24 +582,19 @@ boolean disk_file_query_directory(DISK_FILE* file, uint32 FsInformationClass, ui
 			file->pattern = NULL;
 	}
 
-	if (file->pattern)
-	{
-		do
-		{
-			ent = readdir(file->dir);
-			if (ent == NULL)
-				continue;
+	entry = NULL;
 
-			if (disk_file_wildcard_match(file->pattern, ent->d_name))
-				break;
-		} while (ent);
-	}
-	else
+	while (file->listing && file->listing_index < file->listing->count)
 	{
-		ent = readdir(file->dir);
+		entry = &file->listing->entries[file->listing_index++];
+
+		if (!file->pattern || disk_file_wildcard_match(file->pattern, entry->name))
+			break;
+
+		entry = NULL;
 	}
 
-	if (ent == NULL)
+	if (entry == NULL)
 	{
 		DEBUG_SVC("  pattern %s not found.", file->pattern);
 		stream_write_uint32(output, 0); /* Length */
@@ -566,20 +602,11 @@ boolean disk_file_query_directory(DISK_FILE* file, uint32 FsInformationClass, ui
 		return false;
 	}
 
-	memset(&st, 0, sizeof(struct STAT));
-	ent_path = xmalloc(strlen(file->fullpath) + strlen(ent->d_name) + 2);
-	sprintf(ent_path, "%s/%s", file->fullpath, ent->d_name);
-	if (STAT(ent_path, &st) != 0)
-	{
-		DEBUG_WARN("stat %s failed. errno = %d", ent_path, errno);
-	}
+	DEBUG_SVC("  pattern %s matched %s/%s", file->pattern, file->fullpath, entry->name);
 
-	DEBUG_SVC("  pattern %s matched %s", file->pattern, ent_path);
-	xfree(ent_path);
-
-	uniconv = freerdp_uniconv_new();
-	ent_path = freerdp_uniconv_out(uniconv, ent->d_name, &len);
-	freerdp_uniconv_free(uniconv);
+	st = entry->st;
+	ent_path = entry->uname;
+	len = entry->ulen;
 
 	ret = true;
 	switch (FsInformationClass)
@@ -658,7 +685,5 @@ boolean disk_file_query_directory(DISK_FILE* file, uint32 FsInformationClass, ui
 			break;
 	}
 
-	xfree(ent_path);
-
 	return ret;
 }
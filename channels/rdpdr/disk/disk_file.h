@@ -52,6 +52,9 @@
 
 #define EPOCH_DIFF 11644473600LL
 
+#define DISK_READAHEAD_MIN	(64 * 1024)
+#define DISK_READAHEAD_MAX	(4 * 1024 * 1024)
+
 #define FILE_TIME_SYSTEM_TO_RDP(_t) \
 	(((uint64)(_t) + EPOCH_DIFF) * 10000000LL)
 #define FILE_TIME_RDP_TO_SYSTEM(_t) \
@@ -70,20 +73,25 @@ struct _DISK_FILE
 	boolean is_dir;
 	int fd;
 	int err;
-	DIR* dir;
 	char* basepath;
 	char* fullpath;
 	char* filename;
 	char* pattern;
 	boolean delete_pending;
+	uint64 next_offset;
+
+	struct _DISK_CACHE* cache;
+	struct _DISK_DIR_LISTING* listing;
+	int listing_index;
 };
 
-DISK_FILE* disk_file_new(const char* base_path, const char* path, uint32 id,
+DISK_FILE* disk_file_new(struct _DISK_CACHE* cache, const char* base_path, const char* path, uint32 id,
 	uint32 DesiredAccess, uint32 CreateDisposition, uint32 CreateOptions);
 void disk_file_free(DISK_FILE* file);
 
 boolean disk_file_seek(DISK_FILE* file, uint64 Offset);
 boolean disk_file_read(DISK_FILE* file, uint8* buffer, uint32* Length);
+void disk_file_readahead(DISK_FILE* file, uint64 Offset, uint32 Length);
 boolean disk_file_write(DISK_FILE* file, uint8* buffer, uint32 Length);
 boolean disk_file_query_information(DISK_FILE* file, uint32 FsInformationClass, STREAM* output);
 boolean disk_file_set_information(DISK_FILE* file, uint32 FsInformationClass, uint32 Length, STREAM* input);
@@ -36,23 +36,46 @@
 #include <freerdp/utils/stream.h>
 #include <freerdp/utils/unicode.h>
 #include <freerdp/utils/list.h>
+#include <freerdp/utils/mutex.h>
 #include <freerdp/utils/thread.h>
 #include <freerdp/utils/svc_plugin.h>
 
 #include "rdpdr_constants.h"
 #include "rdpdr_types.h"
 #include "disk_file.h"
+#include "disk_cache.h"
+
+#define DISK_DEFAULT_WORKERS	4
+#define DISK_MAX_WORKERS	16
 
 typedef struct _DISK_DEVICE DISK_DEVICE;
+typedef struct _DISK_WORKER DISK_WORKER;
+
+/**
+ * IRPs are spread over a small pool of I/O workers. Every request for
+ * a given FileId is always queued on the same worker, so operations on
+ * one file are executed in order while different files proceed in parallel.
+ */
+struct _DISK_WORKER
+{
+	DISK_DEVICE* disk;
+
+	LIST* irp_list;
+	freerdp_thread* thread;
+};
+
 struct _DISK_DEVICE
 {
 	DEVICE device;
 
 	char* path;
 	LIST* files;
+	freerdp_mutex files_mutex;
+	DISK_CACHE* cache;
 
-	LIST* irp_list;
-	freerdp_thread* thread;
+	int num_workers;
+	DISK_WORKER* workers;
+	uint32 create_sequence;
 
 	DEVMAN* devman;
 	pcRegisterDevice UnregisterDevice;
@@ -94,15 +117,22 @@ disk_map_posix_err(int fs_errno)
 static DISK_FILE* disk_get_file_by_id(DISK_DEVICE* disk, uint32 id)
 {
 	LIST_ITEM* item;
-	DISK_FILE* file;
+	DISK_FILE* file = NULL;
+
+	freerdp_mutex_lock(disk->files_mutex);
 
 	for (item = disk->files->head; item; item = item->next)
 	{
-		file = (DISK_FILE*)item->data;
-		if (file->id == id)
-			return file;
+		if (((DISK_FILE*)item->data)->id == id)
+		{
+			file = (DISK_FILE*)item->data;
+			break;
+		}
 	}
-	return NULL;
+
+	freerdp_mutex_unlock(disk->files_mutex);
+
+	return file;
 }
 
 static void disk_process_irp_create(DISK_DEVICE* disk, IRP* irp)
@@ -127,9 +157,11 @@ static void disk_process_irp_create(DISK_DEVICE* disk, IRP* irp)
 	path = freerdp_uniconv_in(uniconv, stream_get_tail(irp->input), PathLength);
 	freerdp_uniconv_free(uniconv);
 
+	freerdp_mutex_lock(disk->files_mutex);
 	FileId = irp->devman->id_sequence++;
+	freerdp_mutex_unlock(disk->files_mutex);
 
-	file = disk_file_new(disk->path, path, FileId,
+	file = disk_file_new(disk->cache, disk->path, path, FileId,
 		DesiredAccess, CreateDisposition, CreateOptions);
 
 	if (file == NULL)
@@ -151,7 +183,9 @@ static void disk_process_irp_create(DISK_DEVICE* disk, IRP* irp)
 	}
 	else
 	{
+		freerdp_mutex_lock(disk->files_mutex);
 		list_enqueue(disk->files, file);
+		freerdp_mutex_unlock(disk->files_mutex);
 
 		switch (CreateDisposition)
 		{
@@ -198,7 +232,10 @@ static void disk_process_irp_close(DISK_DEVICE* disk, IRP* irp)
 	{
 		DEBUG_SVC("%s(%d) closed.", file->fullpath, file->id);
 
+		freerdp_mutex_lock(disk->files_mutex);
 		list_remove(disk->files, file);
+		freerdp_mutex_unlock(disk->files_mutex);
+
 		disk_file_free(file);
 	}
 
@@ -212,11 +249,15 @@ static void disk_process_irp_read(DISK_DEVICE* disk, IRP* irp)
 	DISK_FILE* file;
 	uint32 Length;
 	uint64 Offset;
-	uint8* buffer = NULL;
+	int pos;
 
 	stream_read_uint32(irp->input, Length);
 	stream_read_uint64(irp->input, Offset);
 
+	/* the data is read straight into the output stream, right after the Length field */
+	pos = stream_get_pos(irp->output);
+	stream_seek_uint32(irp->output);
+
 	file = disk_get_file_by_id(disk, irp->FileId);
 
 	if (file == NULL)
@@ -235,12 +276,11 @@ static void disk_process_irp_read(DISK_DEVICE* disk, IRP* irp)
 	}
 	else
 	{
-		buffer = (uint8*)xmalloc(Length);
-		if (!disk_file_read(file, buffer, &Length))
+		stream_check_size(irp->output, Length);
+
+		if (!disk_file_read(file, stream_get_tail(irp->output), &Length))
 		{
 			irp->IoStatus = STATUS_UNSUCCESSFUL;
-			xfree(buffer);
-			buffer = NULL;
 			Length = 0;
 
 			DEBUG_WARN("read %s(%d) failed.", file->fullpath, file->id);
@@ -248,16 +288,18 @@ static void disk_process_irp_read(DISK_DEVICE* disk, IRP* irp)
 		else
 		{
 			DEBUG_SVC("read %llu-%llu from %s(%d).", Offset, Offset + Length, file->fullpath, file->id);
+
+			/* sequential access: hint the kernel to prefetch what comes next */
+			if (Length > 0 && Offset == file->next_offset)
+				disk_file_readahead(file, Offset + Length, Length);
+
+			file->next_offset = Offset + Length;
 		}
 	}
 
+	stream_set_pos(irp->output, pos);
 	stream_write_uint32(irp->output, Length);
-	if (Length > 0)
-	{
-		stream_check_size(irp->output, Length);
-		stream_write(irp->output, buffer, Length);
-	}
-	xfree(buffer);
+	stream_seek(irp->output, Length);
 
 	irp->Complete(irp);
 }
@@ -572,73 +614,100 @@ static void disk_process_irp(DISK_DEVICE* disk, IRP* irp)
 	}
 }
 
-static void disk_process_irp_list(DISK_DEVICE* disk)
+static void disk_process_irp_list(DISK_WORKER* worker)
 {
 	IRP* irp;
 
 	while (1)
 	{
-		if (freerdp_thread_is_stopped(disk->thread))
+		if (freerdp_thread_is_stopped(worker->thread))
 			break;
 
-		freerdp_thread_lock(disk->thread);
-		irp = (IRP*)list_dequeue(disk->irp_list);
-		freerdp_thread_unlock(disk->thread);
+		freerdp_thread_lock(worker->thread);
+		irp = (IRP*)list_dequeue(worker->irp_list);
+		freerdp_thread_unlock(worker->thread);
 
 		if (irp == NULL)
 			break;
 
-		disk_process_irp(disk, irp);
+		disk_process_irp(worker->disk, irp);
 	}
 }
 
 static void* disk_thread_func(void* arg)
 {
-	DISK_DEVICE* disk = (DISK_DEVICE*)arg;
+	DISK_WORKER* worker = (DISK_WORKER*)arg;
 
 	while (1)
 	{
-		freerdp_thread_wait(disk->thread);
+		freerdp_thread_wait(worker->thread);
 
-		if (freerdp_thread_is_stopped(disk->thread))
+		if (freerdp_thread_is_stopped(worker->thread))
 			break;
 
-		freerdp_thread_reset(disk->thread);
-		disk_process_irp_list(disk);
+		freerdp_thread_reset(worker->thread);
+		disk_process_irp_list(worker);
 	}
 
-	freerdp_thread_quit(disk->thread);
+	freerdp_thread_quit(worker->thread);
 
 	return NULL;
 }
 
+static DISK_WORKER* disk_get_worker(DISK_DEVICE* disk, IRP* irp)
+{
+	uint32 key;
+
+	/* no FileId exists yet for a create, so spread those round-robin */
+	if (irp->MajorFunction == IRP_MJ_CREATE)
+		key = disk->create_sequence++;
+	else
+		key = irp->FileId;
+
+	return &disk->workers[key % disk->num_workers];
+}
+
 static void disk_irp_request(DEVICE* device, IRP* irp)
 {
 	DISK_DEVICE* disk = (DISK_DEVICE*)device;
+	DISK_WORKER* worker;
 
-	freerdp_thread_lock(disk->thread);
-	list_enqueue(disk->irp_list, irp);
-	freerdp_thread_unlock(disk->thread);
+	worker = disk_get_worker(disk, irp);
 
-	freerdp_thread_signal(disk->thread);
+	freerdp_thread_lock(worker->thread);
+	list_enqueue(worker->irp_list, irp);
+	freerdp_thread_unlock(worker->thread);
+
+	freerdp_thread_signal(worker->thread);
 }
 
 static void disk_free(DEVICE* device)
 {
 	DISK_DEVICE* disk = (DISK_DEVICE*)device;
+	DISK_WORKER* worker;
 	IRP* irp;
 	DISK_FILE* file;
+	int i;
 
-	freerdp_thread_stop(disk->thread);
-	freerdp_thread_free(disk->thread);
+	for (i = 0; i < disk->num_workers; i++)
+		freerdp_thread_stop(disk->workers[i].thread);
 
-	while ((irp = (IRP*)list_dequeue(disk->irp_list)) != NULL)
-		irp->Discard(irp);
-	list_free(disk->irp_list);
+	for (i = 0; i < disk->num_workers; i++)
+	{
+		worker = &disk->workers[i];
+		freerdp_thread_free(worker->thread);
+
+		while ((irp = (IRP*)list_dequeue(worker->irp_list)) != NULL)
+			irp->Discard(irp);
+		list_free(worker->irp_list);
+	}
+	xfree(disk->workers);
 
 	while ((file = (DISK_FILE*)list_dequeue(disk->files)) != NULL)
 		disk_file_free(file);
 	list_free(disk->files);
+	freerdp_mutex_free(disk->files_mutex);
+	disk_cache_free(disk->cache);
 	xfree(disk);
 }
 
@@ -647,10 +716,12 @@ int RdpDrDisk_DeviceServiceEntry(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints)
 	DISK_DEVICE* disk;
 	char* name;
 	char* path;
+	char* workers;
 	int i, len;
 
 	name = (char*)pEntryPoints->plugin_data->data[1];
 	path = (char*)pEntryPoints->plugin_data->data[2];
+	workers = (char*)pEntryPoints->plugin_data->data[3];
 
 	if (name[0] && path[0])
 	{
@@ -668,13 +739,28 @@ int RdpDrDisk_DeviceServiceEntry(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints)
 
 		disk->path = path;
 		disk->files = list_new();
-
-		disk->irp_list = list_new();
-		disk->thread = freerdp_thread_new();
+		disk->files_mutex = freerdp_mutex_new();
+		disk->cache = disk_cache_new();
+
+		/* optional fourth argument: number of I/O workers */
+		disk->num_workers = (workers && workers[0]) ? atoi(workers) : DISK_DEFAULT_WORKERS;
+		if (disk->num_workers < 1)
+			disk->num_workers = 1;
+		else if (disk->num_workers > DISK_MAX_WORKERS)
+			disk->num_workers = DISK_MAX_WORKERS;
+
+		disk->workers = xzalloc(sizeof(DISK_WORKER) * disk->num_workers);
+		for (i = 0; i < disk->num_workers; i++)
+		{
+			disk->workers[i].disk = disk;
+			disk->workers[i].irp_list = list_new();
+			disk->workers[i].thread = freerdp_thread_new();
+		}
 
 		pEntryPoints->RegisterDevice(pEntryPoints->devman, (DEVICE*)disk);
 
-		freerdp_thread_start(disk->thread, disk_thread_func, disk);
+		for (i = 0; i < disk->num_workers; i++)
+			freerdp_thread_start(disk->workers[i].thread, disk_thread_func, &disk->workers[i]);
 	}
 
 	return 0;
@@ -209,6 +209,7 @@ static void rdpsnd_alsa_open(rdpsndDevicePlugin* device, rdpsndFormat* format, i
 	else
 	{
 		freerdp_dsp_context_reset_adpcm(alsa->dsp_context);
+		freerdp_dsp_context_reset_resampler(alsa->dsp_context);
 		rdpsnd_alsa_set_format(device, format, latency);
 		rdpsnd_alsa_open_mixer(alsa);
 	}
@@ -381,6 +382,23 @@ static void rdpsnd_alsa_play(rdpsndDevicePlugin* device, uint8* data, int size)
 	}
 }
 
+static int rdpsnd_alsa_get_latency(rdpsndDevicePlugin* device)
+{
+	rdpsndAlsaPlugin* alsa = (rdpsndAlsaPlugin*)device;
+	snd_pcm_sframes_t frames;
+
+	if (alsa->out_handle == 0 || alsa->actual_rate == 0)
+		return -1;
+
+	if (snd_pcm_delay(alsa->out_handle, &frames) < 0)
+		return -1;
+
+	if (frames < 0)
+		frames = 0;
+
+	return (int) (frames * 1000 / alsa->actual_rate);
+}
+
 static void rdpsnd_alsa_start(rdpsndDevicePlugin* device)
 {
 	rdpsndAlsaPlugin* alsa = (rdpsndAlsaPlugin*)device;
@@ -406,6 +424,7 @@ int FreeRDPRdpsndDeviceEntry(PFREERDP_RDPSND_DEVICE_ENTRY_POINTS pEntryPoints)
 	alsa->device.Start = rdpsnd_alsa_start;
 	alsa->device.Close = rdpsnd_alsa_close;
 	alsa->device.Free = rdpsnd_alsa_free;
+	alsa->device.GetLatency = rdpsnd_alsa_get_latency;
 
 	data = pEntryPoints->plugin_data;
 	if (data && strcmp((char*)data->data[0], "alsa") == 0)
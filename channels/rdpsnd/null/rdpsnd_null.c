@@ -0,0 +1,262 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol client.
+ * Audio Output Virtual Channel
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Headless sound device: audio is decoded and optionally written as raw
+ * PCM to a file, while playback is paced against a virtual device buffer
+ * so that the rdpsnd pipeline behaves as it would with real hardware.
+ *
+ * --plugin rdpsnd --data null[:file] --
+ */
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freerdp/types.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/sleep.h>
+#include <freerdp/utils/dsp.h>
+#include <freerdp/utils/svc_plugin.h>
+
+#include "rdpsnd_main.h"
+
+#define RDPSND_NULL_DEFAULT_LATENCY	100 /* ms */
+
+typedef struct rdpsnd_null_plugin rdpsndNullPlugin;
+struct rdpsnd_null_plugin
+{
+	rdpsndDevicePlugin device;
+
+	char* file_name;
+	FILE* fp;
+	boolean is_open;
+
+	int wformat;
+	int block_size;
+	uint32 rate;
+	uint32 channels;
+	int bytes_per_channel;
+	int latency;
+
+	uint32 play_end;
+	uint32 bytes_played;
+
+	FREERDP_DSP_CONTEXT* dsp_context;
+};
+
+static uint32 rdpsnd_null_get_mstime(void)
+{
+	struct timeval tp;
+
+	gettimeofday(&tp, 0);
+	return (tp.tv_sec * 1000) + (tp.tv_usec / 1000);
+}
+
+static void rdpsnd_null_set_format(rdpsndDevicePlugin* device, rdpsndFormat* format, int latency)
+{
+	rdpsndNullPlugin* null = (rdpsndNullPlugin*)device;
+
+	if (format != NULL)
+	{
+		null->wformat = format->wFormatTag;
+		null->block_size = format->nBlockAlign;
+		null->rate = format->nSamplesPerSec;
+		null->channels = format->nChannels;
+		null->bytes_per_channel = (format->wFormatTag == 1 && format->wBitsPerSample == 8) ? 1 : 2;
+	}
+
+	null->latency = (latency > 0) ? latency : RDPSND_NULL_DEFAULT_LATENCY;
+}
+
+static void rdpsnd_null_open(rdpsndDevicePlugin* device, rdpsndFormat* format, int latency)
+{
+	rdpsndNullPlugin* null = (rdpsndNullPlugin*)device;
+
+	if (null->is_open)
+		return;
+
+	if (null->file_name != NULL)
+	{
+		null->fp = fopen(null->file_name, "ab");
+		if (null->fp == NULL)
+			DEBUG_WARN("failed to open %s", null->file_name);
+	}
+
+	freerdp_dsp_context_reset_adpcm(null->dsp_context);
+	rdpsnd_null_set_format(device, format, latency);
+
+	null->play_end = 0;
+	null->is_open = true;
+}
+
+static void rdpsnd_null_close(rdpsndDevicePlugin* device)
+{
+	rdpsndNullPlugin* null = (rdpsndNullPlugin*)device;
+
+	if (!null->is_open)
+		return;
+
+	DEBUG_SVC("close, %u bytes played", null->bytes_played);
+
+	if (null->fp != NULL)
+	{
+		fclose(null->fp);
+		null->fp = NULL;
+	}
+
+	null->is_open = false;
+}
+
+static void rdpsnd_null_free(rdpsndDevicePlugin* device)
+{
+	rdpsndNullPlugin* null = (rdpsndNullPlugin*)device;
+
+	rdpsnd_null_close(device);
+	xfree(null->file_name);
+	freerdp_dsp_context_free(null->dsp_context);
+	xfree(null);
+}
+
+static boolean rdpsnd_null_format_supported(rdpsndDevicePlugin* device, rdpsndFormat* format)
+{
+	switch (format->wFormatTag)
+	{
+		case 1: /* PCM */
+			if (format->cbSize == 0 &&
+				format->nSamplesPerSec <= 48000 &&
+				(format->wBitsPerSample == 8 || format->wBitsPerSample == 16) &&
+				(format->nChannels == 1 || format->nChannels == 2))
+			{
+				return true;
+			}
+			break;
+
+		case 2: /* MS ADPCM */
+		case 0x11: /* IMA ADPCM */
+			if (format->nSamplesPerSec <= 48000 &&
+				format->wBitsPerSample == 4 &&
+				(format->nChannels == 1 || format->nChannels == 2))
+			{
+				return true;
+			}
+			break;
+	}
+	return false;
+}
+
+static void rdpsnd_null_set_volume(rdpsndDevicePlugin* device, uint32 value)
+{
+}
+
+static void rdpsnd_null_play(rdpsndDevicePlugin* device, uint8* data, int size)
+{
+	rdpsndNullPlugin* null = (rdpsndNullPlugin*)device;
+	uint8* src;
+	uint32 now;
+	uint32 duration;
+
+	if (!null->is_open || null->rate == 0)
+		return;
+
+	if (null->wformat == 2)
+	{
+		null->dsp_context->decode_ms_adpcm(null->dsp_context,
+			data, size, null->channels, null->block_size);
+		size = null->dsp_context->adpcm_size;
+		src = null->dsp_context->adpcm_buffer;
+	}
+	else if (null->wformat == 0x11)
+	{
+		null->dsp_context->decode_ima_adpcm(null->dsp_context,
+			data, size, null->channels, null->block_size);
+		size = null->dsp_context->adpcm_size;
+		src = null->dsp_context->adpcm_buffer;
+	}
+	else
+	{
+		src = data;
+	}
+
+	if (null->fp != NULL)
+		fwrite(src, 1, size, null->fp);
+
+	null->bytes_played += size;
+
+	/* block like a real device would once its buffer is full */
+	duration = size * 1000 / (null->rate * null->channels * null->bytes_per_channel);
+	now = rdpsnd_null_get_mstime();
+
+	if (null->play_end < now)
+		null->play_end = now;
+	null->play_end += duration;
+
+	if (null->play_end - now > (uint32) null->latency)
+		freerdp_usleep((null->play_end - now - null->latency) * 1000);
+}
+
+static int rdpsnd_null_get_latency(rdpsndDevicePlugin* device)
+{
+	rdpsndNullPlugin* null = (rdpsndNullPlugin*)device;
+	uint32 now;
+
+	if (!null->is_open)
+		return -1;
+
+	now = rdpsnd_null_get_mstime();
+
+	return (null->play_end > now) ? (int) (null->play_end - now) : 0;
+}
+
+static void rdpsnd_null_start(rdpsndDevicePlugin* device)
+{
+}
+
+int FreeRDPRdpsndDeviceEntry(PFREERDP_RDPSND_DEVICE_ENTRY_POINTS pEntryPoints)
+{
+	rdpsndNullPlugin* null;
+	RDP_PLUGIN_DATA* data;
+
+	null = xnew(rdpsndNullPlugin);
+
+	null->device.Open = rdpsnd_null_open;
+	null->device.FormatSupported = rdpsnd_null_format_supported;
+	null->device.SetFormat = rdpsnd_null_set_format;
+	null->device.SetVolume = rdpsnd_null_set_volume;
+	null->device.Play = rdpsnd_null_play;
+	null->device.Start = rdpsnd_null_start;
+	null->device.Close = rdpsnd_null_close;
+	null->device.Free = rdpsnd_null_free;
+	null->device.GetLatency = rdpsnd_null_get_latency;
+
+	data = pEntryPoints->plugin_data;
+	if (data && strcmp((char*)data->data[0], "null") == 0)
+	{
+		if (data->data[1] && strlen((char*)data->data[1]) > 0)
+			null->file_name = xstrdup((char*)data->data[1]);
+	}
+
+	null->latency = RDPSND_NULL_DEFAULT_LATENCY;
+	null->dsp_context = freerdp_dsp_context_new();
+
+	pEntryPoints->pRegisterRdpsndDevice(pEntryPoints->rdpsnd, (rdpsndDevicePlugin*)null);
+
+	return 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol client.
+ * Audio Output Virtual Channel Jitter Buffer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "rdpsnd_jitter.h"
+
+static void rdpsnd_jitter_update_target(rdpsndJitter* jitter, int latency)
+{
+	uint32 target;
+
+	target = RDPSND_JITTER_MIN + 3 * jitter->jitter + jitter->boost;
+	if (latency > 0 && target < (uint32) latency)
+		target = latency;
+	if (target > RDPSND_JITTER_MAX)
+		target = RDPSND_JITTER_MAX;
+
+	jitter->target = target;
+}
+
+void rdpsnd_jitter_init(rdpsndJitter* jitter)
+{
+	memset(jitter, 0, sizeof(rdpsndJitter));
+	jitter->target = RDPSND_JITTER_MIN;
+}
+
+/**
+ * Track the inter-arrival jitter of wave blocks (RFC 3550 style smoothing)
+ * and derive how much audio should be buffered before playback starts.
+ */
+void rdpsnd_jitter_arrival(rdpsndJitter* jitter, uint32 arrival, uint32 duration, int latency)
+{
+	sint32 deviation;
+
+	if (jitter->last_arrival != 0)
+	{
+		deviation = (sint32) (arrival - jitter->last_arrival) - (sint32) jitter->last_duration;
+		if (deviation < 0)
+			deviation = -deviation;
+		jitter->jitter += ((sint32) deviation - (sint32) jitter->jitter) / 16;
+	}
+
+	jitter->last_arrival = arrival;
+	jitter->last_duration = duration;
+
+	rdpsnd_jitter_update_target(jitter, latency);
+}
+
+/* the device ran dry: buffer more before playback resumes */
+void rdpsnd_jitter_underrun(rdpsndJitter* jitter, int latency)
+{
+	if (jitter->boost < RDPSND_JITTER_MAX)
+		jitter->boost += RDPSND_UNDERRUN_PENALTY;
+	jitter->played = 0;
+
+	rdpsnd_jitter_update_target(jitter, latency);
+}
+
+/**
+ * A wave block went to the device. The boost only decays with audio that
+ * was actually played, so time spent refilling the buffer does not count.
+ */
+void rdpsnd_jitter_played(rdpsndJitter* jitter, uint32 duration)
+{
+	jitter->played += duration;
+
+	while (jitter->played >= RDPSND_BOOST_DECAY_INTERVAL)
+	{
+		jitter->played -= RDPSND_BOOST_DECAY_INTERVAL;
+
+		if (jitter->boost > RDPSND_BOOST_DECAY_STEP)
+			jitter->boost -= RDPSND_BOOST_DECAY_STEP;
+		else
+			jitter->boost = 0;
+	}
+}
@@ -0,0 +1,48 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol client.
+ * Audio Output Virtual Channel Jitter Buffer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RDPSND_JITTER_H
+#define __RDPSND_JITTER_H
+
+#include <freerdp/types.h>
+
+#define RDPSND_JITTER_MIN		40 /* ms */
+#define RDPSND_JITTER_MAX		500 /* ms */
+#define RDPSND_UNDERRUN_PENALTY		20 /* ms */
+
+/* the boost shrinks by one step for every interval of audio played without an underrun */
+#define RDPSND_BOOST_DECAY_INTERVAL	2000 /* ms */
+#define RDPSND_BOOST_DECAY_STEP		5 /* ms */
+
+typedef struct rdpsnd_jitter rdpsndJitter;
+
+struct rdpsnd_jitter
+{
+	uint32 last_arrival;
+	uint32 last_duration;
+	uint32 jitter; /* smoothed inter-arrival jitter, ms */
+	uint32 boost; /* grows on every underrun */
+	uint32 played; /* ms played since the last underrun or decay step */
+	uint32 target; /* ms of audio to buffer before playback starts */
+};
+
+void rdpsnd_jitter_init(rdpsndJitter* jitter);
+void rdpsnd_jitter_arrival(rdpsndJitter* jitter, uint32 arrival, uint32 duration, int latency);
+void rdpsnd_jitter_underrun(rdpsndJitter* jitter, int latency);
+void rdpsnd_jitter_played(rdpsndJitter* jitter, uint32 duration);
+
+#endif /* __RDPSND_JITTER_H */
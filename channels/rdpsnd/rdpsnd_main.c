@@ -30,16 +30,44 @@
 #include <freerdp/utils/memory.h>
 #include <freerdp/utils/stream.h>
 #include <freerdp/utils/list.h>
+#include <freerdp/utils/mutex.h>
+#include <freerdp/utils/thread.h>
 #include <freerdp/utils/load_plugin.h>
 #include <freerdp/utils/svc_plugin.h>
 
 #include "rdpsnd_main.h"
+#include "rdpsnd_jitter.h"
+
+enum rdpsnd_queue_type
+{
+	RDPSND_QUEUE_OPEN,
+	RDPSND_QUEUE_SET_FORMAT,
+	RDPSND_QUEUE_SET_VOLUME,
+	RDPSND_QUEUE_PLAY,
+	RDPSND_QUEUE_START,
+	RDPSND_QUEUE_CLOSE
+};
+
+/* a device operation waiting for the playback thread */
+struct rdpsnd_queue_item
+{
+	int type;
+	rdpsndFormat format;
+	uint32 volume;
+
+	STREAM* data;
+	uint16 wTimeStamp; /* server timestamp */
+	uint8 cBlockNo;
+	uint32 arrival; /* client timestamp */
+	uint32 duration; /* ms */
+};
 
 struct rdpsnd_plugin
 {
 	rdpSvcPlugin plugin;
 
 	LIST* data_out_list;
+	freerdp_mutex data_out_mutex;
 
 	uint8 cBlockNo;
 	rdpsndFormat* supported_formats;
@@ -60,6 +88,21 @@ struct rdpsnd_plugin
 	uint32 fixed_rate;
 	int latency;
 
+	/* Playback queue, drained by the playback thread */
+	LIST* playback_list;
+	freerdp_thread* playback_thread;
+	uint32 queued_ms;
+	boolean prebuffering;
+	uint32 prebuffer_start;
+	uint32 play_end; /* estimated time at which the device runs dry */
+
+	/* Adaptive jitter buffer */
+	rdpsndJitter jitter;
+
+	uint32 blocks_played;
+	uint32 underruns;
+	uint32 waves_pending; /* queued wave blocks not confirmed yet */
+
 	/* Device plugin */
 	rdpsndDevicePlugin* device;
 };
@@ -79,6 +122,257 @@ static uint32 get_mstime(void)
 	return (tp.tv_sec * 1000) + (tp.tv_usec / 1000);
 }
 
+/* duration in milliseconds of a wave block in the given format */
+static uint32 rdpsnd_get_duration(rdpsndFormat* format, int size)
+{
+	uint32 frames;
+	uint32 frames_per_block;
+
+	if (format->nSamplesPerSec == 0 || format->nChannels == 0)
+		return 0;
+
+	switch (format->wFormatTag)
+	{
+		case 2: /* MS ADPCM */
+			if (format->nBlockAlign <= 7 * format->nChannels)
+				return 0;
+			frames_per_block = (format->nBlockAlign - 7 * format->nChannels) * 2 / format->nChannels + 2;
+			frames = (size / format->nBlockAlign) * frames_per_block;
+			break;
+
+		case 0x11: /* IMA ADPCM */
+			if (format->nBlockAlign <= 4 * format->nChannels)
+				return 0;
+			frames_per_block = (format->nBlockAlign - 4 * format->nChannels) * 2 / format->nChannels + 1;
+			frames = (size / format->nBlockAlign) * frames_per_block;
+			break;
+
+		default:
+			if (format->wBitsPerSample < 8)
+				return 0;
+			frames = size / (format->nChannels * (format->wBitsPerSample / 8));
+			break;
+	}
+
+	return frames * 1000 / format->nSamplesPerSec;
+}
+
+static void rdpsnd_queue_item(rdpsndPlugin* rdpsnd, struct rdpsnd_queue_item* item)
+{
+	freerdp_thread_lock(rdpsnd->playback_thread);
+	list_enqueue(rdpsnd->playback_list, item);
+	if (item->type == RDPSND_QUEUE_PLAY)
+		rdpsnd->queued_ms += item->duration;
+	freerdp_thread_unlock(rdpsnd->playback_thread);
+
+	freerdp_thread_signal(rdpsnd->playback_thread);
+}
+
+static void rdpsnd_queue_command(rdpsndPlugin* rdpsnd, int type, rdpsndFormat* format, uint32 volume)
+{
+	struct rdpsnd_queue_item* item;
+
+	item = xnew(struct rdpsnd_queue_item);
+	item->type = type;
+	item->volume = volume;
+	if (format != NULL)
+		memcpy(&item->format, format, sizeof(rdpsndFormat));
+
+	rdpsnd_queue_item(rdpsnd, item);
+}
+
+static void rdpsnd_free_queue_item(struct rdpsnd_queue_item* item)
+{
+	if (item->data)
+		stream_free(item->data);
+	xfree(item);
+}
+
+static int rdpsnd_get_device_latency(rdpsndPlugin* rdpsnd, uint32 now)
+{
+	int latency = -1;
+
+	if (rdpsnd->device && rdpsnd->device->GetLatency)
+		latency = rdpsnd->device->GetLatency(rdpsnd->device);
+
+	/* no device support: fall back to our own estimate of the buffered audio */
+	if (latency < 0)
+		latency = (rdpsnd->play_end > now) ? rdpsnd->play_end - now : 0;
+
+	return latency;
+}
+
+static void rdpsnd_playback_wave(rdpsndPlugin* rdpsnd, struct rdpsnd_queue_item* item)
+{
+	uint32 now;
+	uint32 delay_ms;
+	int latency;
+	struct data_out_item* confirm;
+
+	if (rdpsnd->device)
+		IFCALL(rdpsnd->device->Play, rdpsnd->device, stream_get_head(item->data), stream_get_size(item->data));
+
+	now = get_mstime();
+	if (rdpsnd->play_end < now)
+		rdpsnd->play_end = now;
+	rdpsnd->play_end += item->duration;
+
+	/* the block is confirmed once the device has actually played it */
+	latency = rdpsnd_get_device_latency(rdpsnd, now);
+	delay_ms = (now - item->arrival) + latency;
+
+	rdpsnd->blocks_played++;
+
+	DEBUG_SVC("data_size %d duration %u delay_ms %u latency %d jitter %u target %u",
+		stream_get_size(item->data), item->duration, delay_ms, latency,
+		rdpsnd->jitter.jitter, rdpsnd->jitter.target);
+
+	confirm = xnew(struct data_out_item);
+	confirm->data_out = stream_new(8);
+	stream_write_uint8(confirm->data_out, SNDC_WAVECONFIRM);
+	stream_write_uint8(confirm->data_out, 0);
+	stream_write_uint16(confirm->data_out, 4);
+	stream_write_uint16(confirm->data_out, (uint16) (item->wTimeStamp + delay_ms));
+	stream_write_uint8(confirm->data_out, item->cBlockNo); /* cConfirmedBlockNo */
+	stream_write_uint8(confirm->data_out, 0); /* bPad */
+	confirm->out_timestamp = item->arrival + delay_ms;
+
+	freerdp_mutex_lock(rdpsnd->data_out_mutex);
+	list_enqueue(rdpsnd->data_out_list, confirm);
+	freerdp_mutex_unlock(rdpsnd->data_out_mutex);
+}
+
+static void rdpsnd_playback_item(rdpsndPlugin* rdpsnd, struct rdpsnd_queue_item* item)
+{
+	rdpsndDevicePlugin* device = rdpsnd->device;
+
+	switch (item->type)
+	{
+		case RDPSND_QUEUE_OPEN:
+			if (device)
+				IFCALL(device->Open, device, &item->format, rdpsnd->latency);
+			rdpsnd->play_end = 0;
+			break;
+
+		case RDPSND_QUEUE_SET_FORMAT:
+			if (device)
+				IFCALL(device->SetFormat, device, &item->format, rdpsnd->latency);
+			break;
+
+		case RDPSND_QUEUE_SET_VOLUME:
+			if (device)
+				IFCALL(device->SetVolume, device, item->volume);
+			break;
+
+		case RDPSND_QUEUE_PLAY:
+			rdpsnd_playback_wave(rdpsnd, item);
+			break;
+
+		case RDPSND_QUEUE_START:
+			if (device)
+				IFCALL(device->Start, device);
+			break;
+
+		case RDPSND_QUEUE_CLOSE:
+			if (device)
+				IFCALL(device->Close, device);
+			rdpsnd->play_end = 0;
+			DEBUG_SVC("closed, %u blocks played, %u underruns", rdpsnd->blocks_played, rdpsnd->underruns);
+			break;
+	}
+
+	rdpsnd_free_queue_item(item);
+}
+
+/* returns true when waiting for the jitter buffer to fill */
+static boolean rdpsnd_process_playback_list(rdpsndPlugin* rdpsnd)
+{
+	uint32 now;
+	struct rdpsnd_queue_item* item;
+
+	while (!freerdp_thread_is_stopped(rdpsnd->playback_thread))
+	{
+		freerdp_thread_lock(rdpsnd->playback_thread);
+
+		item = (struct rdpsnd_queue_item*) list_peek(rdpsnd->playback_list);
+
+		if (item == NULL)
+		{
+			freerdp_thread_unlock(rdpsnd->playback_thread);
+			break;
+		}
+
+		if (item->type == RDPSND_QUEUE_PLAY)
+		{
+			now = get_mstime();
+
+			if (!rdpsnd->prebuffering && rdpsnd->play_end != 0 && rdpsnd->play_end < now)
+			{
+				/* the device ran dry: refill the jitter buffer and make it larger */
+				rdpsnd->prebuffering = true;
+				rdpsnd->underruns++;
+				rdpsnd_jitter_underrun(&rdpsnd->jitter, rdpsnd->latency);
+				DEBUG_SVC("underrun #%u", rdpsnd->underruns);
+			}
+
+			if (rdpsnd->prebuffering)
+			{
+				if (rdpsnd->prebuffer_start == 0)
+					rdpsnd->prebuffer_start = now;
+
+				if (rdpsnd->queued_ms < rdpsnd->jitter.target &&
+					now - rdpsnd->prebuffer_start < rdpsnd->jitter.target)
+				{
+					freerdp_thread_unlock(rdpsnd->playback_thread);
+					return true;
+				}
+
+				rdpsnd->prebuffering = false;
+				rdpsnd->prebuffer_start = 0;
+			}
+
+			rdpsnd->queued_ms -= item->duration;
+			rdpsnd_jitter_played(&rdpsnd->jitter, item->duration);
+		}
+		else if (item->type == RDPSND_QUEUE_OPEN)
+		{
+			rdpsnd->prebuffering = true;
+		}
+
+		list_dequeue(rdpsnd->playback_list);
+
+		freerdp_thread_unlock(rdpsnd->playback_thread);
+
+		rdpsnd_playback_item(rdpsnd, item);
+	}
+
+	return false;
+}
+
+static void* rdpsnd_playback_thread_func(void* arg)
+{
+	rdpsndPlugin* rdpsnd = (rdpsndPlugin*) arg;
+	boolean waiting = false;
+
+	while (1)
+	{
+		if (waiting)
+			freerdp_thread_wait_timeout(rdpsnd->playback_thread, 5);
+		else
+			freerdp_thread_wait(rdpsnd->playback_thread);
+
+		if (freerdp_thread_is_stopped(rdpsnd->playback_thread))
+			break;
+
+		freerdp_thread_reset(rdpsnd->playback_thread);
+		waiting = rdpsnd_process_playback_list(rdpsnd);
+	}
+
+	freerdp_thread_quit(rdpsnd->playback_thread);
+
+	return NULL;
+}
+
 /* process the linked list of data that has queued to be sent */
 static void rdpsnd_process_interval(rdpSvcPlugin* plugin)
 {
@@ -86,16 +380,22 @@ static void rdpsnd_process_interval(rdpSvcPlugin* plugin)
 	struct data_out_item* item;
 	uint32 cur_time;
 
-	while (list_size(rdpsnd->data_out_list) > 0)
+	while (1)
 	{
-		item = (struct data_out_item*)list_peek(rdpsnd->data_out_list) ;
+		freerdp_mutex_lock(rdpsnd->data_out_mutex);
+		item = (struct data_out_item*)list_peek(rdpsnd->data_out_list);
 		cur_time = get_mstime();
 		if (!item || cur_time <= item->out_timestamp)
+		{
+			freerdp_mutex_unlock(rdpsnd->data_out_mutex);
 			break;
-
+		}
 		item = (struct data_out_item*)list_dequeue(rdpsnd->data_out_list);
+		freerdp_mutex_unlock(rdpsnd->data_out_mutex);
+
 		svc_plugin_send(plugin, item->data_out);
 		xfree(item);
+		rdpsnd->waves_pending--;
 
 		DEBUG_SVC("processed data_out");
 	}
@@ -105,8 +405,7 @@ static void rdpsnd_process_interval(rdpSvcPlugin* plugin)
 		cur_time = get_mstime();
 		if (cur_time > rdpsnd->close_timestamp)
 		{
-			if (rdpsnd->device)
-				IFCALL(rdpsnd->device->Close, rdpsnd->device);
+			rdpsnd_queue_command(rdpsnd, RDPSND_QUEUE_CLOSE, NULL, 0);
 			rdpsnd->is_open = false;
 			rdpsnd->close_timestamp = 0;
 
@@ -114,7 +413,8 @@ static void rdpsnd_process_interval(rdpSvcPlugin* plugin)
 		}
 	}
 
-	if (list_size(rdpsnd->data_out_list) == 0 && !rdpsnd->is_open)
+	/* keep polling until every queued wave block has been confirmed */
+	if (rdpsnd->waves_pending == 0 && !rdpsnd->is_open)
 	{
 		rdpsnd->plugin.interval_ms = 0;
 	}
@@ -285,72 +585,68 @@ static void rdpsnd_process_message_wave_info(rdpsndPlugin* rdpsnd, STREAM* data_
 	stream_read(data_in, rdpsnd->waveData, 4);
 	rdpsnd->waveDataSize = BodySize - 8;
 	rdpsnd->wave_timestamp = get_mstime();
-	rdpsnd->expectingWave = true;
 
 	DEBUG_SVC("waveDataSize %d wFormatNo %d", rdpsnd->waveDataSize, wFormatNo);
 
+	if (wFormatNo >= rdpsnd->n_supported_formats)
+	{
+		DEBUG_WARN("invalid wFormatNo %d", wFormatNo);
+		return;
+	}
+
+	rdpsnd->expectingWave = true;
 	rdpsnd->close_timestamp = 0;
 	if (!rdpsnd->is_open)
 	{
 		rdpsnd->current_format = wFormatNo;
 		rdpsnd->is_open = true;
-		if (rdpsnd->device)
-			IFCALL(rdpsnd->device->Open, rdpsnd->device, &rdpsnd->supported_formats[wFormatNo],
-				rdpsnd->latency);
+		rdpsnd->jitter.last_arrival = 0;
+		rdpsnd_queue_command(rdpsnd, RDPSND_QUEUE_OPEN, &rdpsnd->supported_formats[wFormatNo], 0);
 	}
 	else if (wFormatNo != rdpsnd->current_format)
 	{
 		rdpsnd->current_format = wFormatNo;
-		if (rdpsnd->device)
-			IFCALL(rdpsnd->device->SetFormat, rdpsnd->device, &rdpsnd->supported_formats[wFormatNo],
-				rdpsnd->latency);
+		rdpsnd_queue_command(rdpsnd, RDPSND_QUEUE_SET_FORMAT, &rdpsnd->supported_formats[wFormatNo], 0);
 	}
 }
 
-/* header is not removed from data in this function */
+/* header is not removed from data in this function, data_in is consumed */
 static void rdpsnd_process_message_wave(rdpsndPlugin* rdpsnd, STREAM* data_in)
 {
-	uint16 wTimeStamp;
-	uint32 delay_ms;
-	uint32 process_ms;
-	struct data_out_item* item;
+	struct rdpsnd_queue_item* item;
 
 	rdpsnd->expectingWave = 0;
 	memcpy(stream_get_head(data_in), rdpsnd->waveData, 4);
 	if (stream_get_size(data_in) != rdpsnd->waveDataSize)
 	{
 		DEBUG_WARN("size error");
+		stream_free(data_in);
 		return;
 	}
-	if (rdpsnd->device)
-		IFCALL(rdpsnd->device->Play, rdpsnd->device, stream_get_head(data_in), stream_get_size(data_in));
-
-	process_ms = get_mstime() - rdpsnd->wave_timestamp;
-	delay_ms = 250;
-	wTimeStamp = rdpsnd->wTimeStamp + delay_ms;
-
-	DEBUG_SVC("data_size %d delay_ms %u process_ms %u",
-		stream_get_size(data_in), delay_ms, process_ms);
-
-	item = xnew(struct data_out_item);
-	item->data_out = stream_new(8);
-	stream_write_uint8(item->data_out, SNDC_WAVECONFIRM);
-	stream_write_uint8(item->data_out, 0);
-	stream_write_uint16(item->data_out, 4);
-	stream_write_uint16(item->data_out, wTimeStamp);
-	stream_write_uint8(item->data_out, rdpsnd->cBlockNo); /* cConfirmedBlockNo */
-	stream_write_uint8(item->data_out, 0); /* bPad */
-	item->out_timestamp = rdpsnd->wave_timestamp + delay_ms;
-
-	list_enqueue(rdpsnd->data_out_list, item);
+
+	item = xnew(struct rdpsnd_queue_item);
+	item->type = RDPSND_QUEUE_PLAY;
+	item->data = data_in;
+	item->wTimeStamp = rdpsnd->wTimeStamp;
+	item->cBlockNo = rdpsnd->cBlockNo;
+	item->arrival = rdpsnd->wave_timestamp;
+	if (rdpsnd->current_format < rdpsnd->n_supported_formats)
+		item->duration = rdpsnd_get_duration(&rdpsnd->supported_formats[rdpsnd->current_format],
+			stream_get_size(data_in));
+
+	freerdp_thread_lock(rdpsnd->playback_thread);
+	rdpsnd_jitter_arrival(&rdpsnd->jitter, item->arrival, item->duration, rdpsnd->latency);
+	freerdp_thread_unlock(rdpsnd->playback_thread);
+
+	rdpsnd_queue_item(rdpsnd, item);
+	rdpsnd->waves_pending++;
 	rdpsnd->plugin.interval_ms = 10;
 }
 
 static void rdpsnd_process_message_close(rdpsndPlugin* rdpsnd)
 {
 	DEBUG_SVC("server closes.");
-	if (rdpsnd->device)
-		IFCALL(rdpsnd->device->Start, rdpsnd->device);
+	rdpsnd_queue_command(rdpsnd, RDPSND_QUEUE_START, NULL, 0);
 	rdpsnd->close_timestamp = get_mstime() + 2000;
 	rdpsnd->plugin.interval_ms = 10;
 }
@@ -361,8 +657,7 @@ static void rdpsnd_process_message_setvolume(rdpsndPlugin* rdpsnd, STREAM* data_
 
 	stream_read_uint32(data_in, dwVolume);
 	DEBUG_SVC("dwVolume 0x%X", dwVolume);
-	if (rdpsnd->device)
-		IFCALL(rdpsnd->device->SetVolume, rdpsnd->device, dwVolume);
+	rdpsnd_queue_command(rdpsnd, RDPSND_QUEUE_SET_VOLUME, NULL, dwVolume);
 }
 
 static void rdpsnd_process_receive(rdpSvcPlugin* plugin, STREAM* data_in)
@@ -374,7 +669,6 @@ static void rdpsnd_process_receive(rdpSvcPlugin* plugin, STREAM* data_in)
 	if (rdpsnd->expectingWave)
 	{
 		rdpsnd_process_message_wave(rdpsnd, data_in);
-		stream_free(data_in);
 		return;
 	}
 
@@ -492,7 +786,12 @@ static void rdpsnd_process_connect(rdpSvcPlugin* plugin)
 	plugin->interval_callback = rdpsnd_process_interval;
 
 	rdpsnd->data_out_list = list_new();
+	rdpsnd->data_out_mutex = freerdp_mutex_new();
 	rdpsnd->latency = -1;
+	rdpsnd_jitter_init(&rdpsnd->jitter);
+
+	rdpsnd->playback_list = list_new();
+	rdpsnd->playback_thread = freerdp_thread_new();
 
 	data = (RDP_PLUGIN_DATA*)plugin->channel_entry_points.pExtendedData;
 
@@ -533,6 +832,8 @@ static void rdpsnd_process_connect(rdpSvcPlugin* plugin)
 	{
 		DEBUG_WARN("no sound device.");
 	}
+
+	freerdp_thread_start(rdpsnd->playback_thread, rdpsnd_playback_thread_func, rdpsnd);
 }
 
 static void rdpsnd_process_event(rdpSvcPlugin* plugin, RDP_EVENT* event)
@@ -544,6 +845,14 @@ static void rdpsnd_process_terminate(rdpSvcPlugin* plugin)
 {
 	rdpsndPlugin* rdpsnd = (rdpsndPlugin*)plugin;
 	struct data_out_item* item;
+	struct rdpsnd_queue_item* queue_item;
+
+	freerdp_thread_stop(rdpsnd->playback_thread);
+	freerdp_thread_free(rdpsnd->playback_thread);
+
+	while ((queue_item = list_dequeue(rdpsnd->playback_list)) != NULL)
+		rdpsnd_free_queue_item(queue_item);
+	list_free(rdpsnd->playback_list);
 
 	if (rdpsnd->device)
 		IFCALL(rdpsnd->device->Free, rdpsnd->device);
@@ -554,6 +863,7 @@ static void rdpsnd_process_terminate(rdpSvcPlugin* plugin)
 		xfree(item);
 	}
 	list_free(rdpsnd->data_out_list);
+	freerdp_mutex_free(rdpsnd->data_out_mutex);
 
 	rdpsnd_free_supported_formats(rdpsnd);
 
@@ -34,6 +34,7 @@ typedef void (*pcPlay) (rdpsndDevicePlugin* device, uint8* data, int size);
 typedef void (*pcStart) (rdpsndDevicePlugin* device);
 typedef void (*pcClose) (rdpsndDevicePlugin* device);
 typedef void (*pcFree) (rdpsndDevicePlugin* device);
+typedef int (*pcGetLatency) (rdpsndDevicePlugin* device);
 
 struct rdpsnd_device_plugin
 {
@@ -45,6 +46,7 @@ struct rdpsnd_device_plugin
 	pcStart Start;
 	pcClose Close;
 	pcFree Free;
+	pcGetLatency GetLatency; /* optional, milliseconds of audio still buffered in the device */
 };
 
 #define RDPSND_DEVICE_EXPORT_FUNC_NAME "FreeRDPRdpsndDeviceEntry"
@@ -143,10 +143,10 @@ boolean df_pre_connect(freerdp* instance)
 	settings->order_support[NEG_GLYPH_INDEX_INDEX] = false;
 	settings->order_support[NEG_FAST_INDEX_INDEX] = false;
 	settings->order_support[NEG_FAST_GLYPH_INDEX] = false;
-	settings->order_support[NEG_POLYGON_SC_INDEX] = false;
-	settings->order_support[NEG_POLYGON_CB_INDEX] = false;
-	settings->order_support[NEG_ELLIPSE_SC_INDEX] = false;
-	settings->order_support[NEG_ELLIPSE_CB_INDEX] = false;
+	settings->order_support[NEG_POLYGON_SC_INDEX] = true;
+	settings->order_support[NEG_POLYGON_CB_INDEX] = true;
+	settings->order_support[NEG_ELLIPSE_SC_INDEX] = true;
+	settings->order_support[NEG_ELLIPSE_CB_INDEX] = true;
 
 	dfi->clrconv = xnew(CLRCONV);
 	dfi->clrconv->alpha = 1;
@@ -167,10 +167,10 @@ boolean wf_pre_connect(freerdp* instance)
 	settings->order_support[NEG_GLYPH_INDEX_INDEX] = false;
 	settings->order_support[NEG_FAST_INDEX_INDEX] = false;
 	settings->order_support[NEG_FAST_GLYPH_INDEX] = false;
-	settings->order_support[NEG_POLYGON_SC_INDEX] = false;
-	settings->order_support[NEG_POLYGON_CB_INDEX] = false;
-	settings->order_support[NEG_ELLIPSE_SC_INDEX] = false;
-	settings->order_support[NEG_ELLIPSE_CB_INDEX] = false;
+	settings->order_support[NEG_POLYGON_SC_INDEX] = (settings->sw_gdi) ? true : false;
+	settings->order_support[NEG_POLYGON_CB_INDEX] = (settings->sw_gdi) ? true : false;
+	settings->order_support[NEG_ELLIPSE_SC_INDEX] = (settings->sw_gdi) ? true : false;
+	settings->order_support[NEG_ELLIPSE_CB_INDEX] = (settings->sw_gdi) ? true : false;
 
 	settings->glyph_cache = false;
 
@@ -17,7 +17,14 @@
  * limitations under the License.
  */
 
+#include <stdio.h>
+#include <ctype.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 #include <freerdp/utils/event.h>
@@ -27,6 +34,16 @@
 
 #include "xf_cliprdr.h"
 
+/* largest property written in one request, larger data goes through INCR */
+#define CB_INCR_CHUNK_SIZE		262144
+
+/* file contents ranges requested from the server at a time, and their size */
+#define CB_FILECONTENTS_WINDOW		4
+#define CB_FILECONTENTS_CHUNK_SIZE	65536
+
+/* largest range read for a single file contents request from the server */
+#define CB_FILECONTENTS_MAX_RANGE	(8 * 1024 * 1024)
+
 typedef struct clipboard_format_mapping clipboardFormatMapping;
 struct clipboard_format_mapping
 {
@@ -34,6 +51,26 @@ struct clipboard_format_mapping
 	uint32 format_id;
 };
 
+typedef struct clipboard_file clipboardFile;
+struct clipboard_file
+{
+	char* name; /* relative to the transfer directory */
+	uint32 lindex; /* index in the file group descriptor */
+	int fd; /* -1 for directories and files already written */
+	uint32 flags;
+	uint64 size;
+	uint64 offset; /* next byte to request */
+};
+
+typedef struct clipboard_range clipboardRange;
+struct clipboard_range
+{
+	uint32 stream_id;
+	uint32 flags;
+	uint64 position;
+	uint32 length;
+};
+
 typedef struct clipboard_context clipboardContext;
 struct clipboard_context
 {
@@ -52,21 +89,50 @@ struct clipboard_context
 	Atom targets[20];
 	int num_targets;
 	uint8* data;
+	int data_offset; /* start of the clipboard data in the data buffer */
+	int data_length;
+	uint8 data_prefix[14]; /* BMP file header provided in front of a DIB */
+	int data_prefix_length;
 	uint32 data_format;
 	uint32 data_alt_format;
-	int data_length;
 	XEvent* respond;
 
-	/* client->server data */
+	/* server->client files, pulled one range at a time into a temporary directory */
+	char* file_dir;
+	clipboardFile* files;
+	int num_files;
+	int file_index;
+	uint32 stream_id;
+	clipboardRange ranges[CB_FILECONTENTS_WINDOW];
+	int num_ranges;
+
+	/* client->server data, converted as it is read */
 	Window owner;
 	int request_index;
 	boolean sync;
+	STREAM* request_stream;
+	int request_skip; /* bytes still to drop from the start of the data */
+	uint8 request_pending[4]; /* incomplete UTF-8 sequence at the end of the last chunk */
+	int request_pending_length;
+
+	/* client->server files, read as the server requests ranges */
+	char** local_files;
+	int num_local_files;
+	int local_fd;
+	int local_fd_index;
 
 	/* INCR mechanism */
 	Atom incr_atom;
 	boolean incr_starts;
-	uint8* incr_data;
-	int incr_data_length;
+	int incr_chunk_size;
+
+	/* INCR transfer of server->client data to a requestor */
+	Window incr_requestor;
+	Atom incr_property;
+	Atom incr_target;
+	int incr_offset;
+	boolean incr_pending; /* the data is still being received from the server */
+	boolean incr_waiting; /* the requestor is ready for a chunk of the pending data */
 };
 
 void xf_cliprdr_init(xfInfo* xfi, rdpChannels* chanman)
@@ -130,62 +196,135 @@ void xf_cliprdr_init(xfInfo* xfi, rdpChannels* chanman)
 	cb->format_mappings[n].target_format = XInternAtom(xfi->display, "text/html", false);
 	cb->format_mappings[n].format_id = CB_FORMAT_HTML;
 
+	n++;
+	cb->format_mappings[n].target_format = XInternAtom(xfi->display, "text/uri-list", false);
+	cb->format_mappings[n].format_id = CB_FORMAT_FILEGROUPDESCRIPTORW;
+
 	cb->num_format_mappings = n + 1;
 	cb->targets[0] = XInternAtom(xfi->display, "TIMESTAMP", false);
 	cb->targets[1] = XInternAtom(xfi->display, "TARGETS", false);
 	cb->num_targets = 2;
 
 	cb->incr_atom = XInternAtom(xfi->display, "INCR", false);
+
+	/* the chunk has to fit in a single ChangeProperty request */
+	n = XExtendedMaxRequestSize(xfi->display);
+
+	if (n == 0)
+		n = XMaxRequestSize(xfi->display);
+
+	cb->incr_chunk_size = MIN(n * 4 - 256, CB_INCR_CHUNK_SIZE);
+
+	cb->local_fd = -1;
+	cb->local_fd_index = -1;
 }
 
-void xf_cliprdr_uninit(xfInfo* xfi)
+static void xf_cliprdr_free_local_files(clipboardContext* cb)
 {
-	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+	int i;
 
-	if (cb)
+	if (cb->local_fd >= 0)
+		close(cb->local_fd);
+
+	cb->local_fd = -1;
+	cb->local_fd_index = -1;
+
+	for (i = 0; i < cb->num_local_files; i++)
+		xfree(cb->local_files[i]);
+
+	xfree(cb->local_files);
+	cb->local_files = NULL;
+	cb->num_local_files = 0;
+}
+
+static void xf_cliprdr_free_files(clipboardContext* cb)
+{
+	int i;
+
+	for (i = 0; i < cb->num_files; i++)
 	{
-		xfree(cb->formats);
-		xfree(cb->data);
-		xfree(cb->respond);
-		xfree(cb->incr_data);
-		xfree(cb);
-		xfi->clipboard_context = NULL;
+		if (cb->files[i].fd >= 0)
+			close(cb->files[i].fd);
+
+		xfree(cb->files[i].name);
 	}
+
+	xfree(cb->files);
+	cb->files = NULL;
+	cb->num_files = 0;
+	cb->file_index = 0;
+	cb->num_ranges = 0;
 }
 
-static uint8* lf2crlf(uint8* data, int* size)
+static void xf_cliprdr_remove_tree(char* path)
 {
-	uint8 c;
-	uint8* outbuf;
-	uint8* out;
-	uint8* in_end;
-	uint8* in;
-	int out_size;
-
-	out_size = (*size) * 2 + 1;
-	outbuf = (uint8*) xzalloc(out_size);
-	out = outbuf;
-	in = data;
-	in_end = data + (*size);
+	DIR* dir;
+	char* child;
+	struct stat st;
+	struct dirent* entry;
 
-	while (in < in_end)
+	if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode))
 	{
-		c = *in++;
-		if (c == '\n')
-		{
-			*out++ = '\r';
-			*out++ = '\n';
-		}
-		else
+		dir = opendir(path);
+
+		while (dir != NULL && (entry = readdir(dir)) != NULL)
 		{
-			*out++ = c;
+			if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+				continue;
+
+			child = (char*) xmalloc(strlen(path) + strlen(entry->d_name) + 2);
+			sprintf(child, "%s/%s", path, entry->d_name);
+			xf_cliprdr_remove_tree(child);
+			xfree(child);
 		}
+
+		if (dir != NULL)
+			closedir(dir);
+
+		rmdir(path);
+	}
+	else
+	{
+		unlink(path);
 	}
+}
 
-	*out++ = 0;
-	*size = out - outbuf;
+/**
+ * The files stay in the transfer directory after the transfer is finished,
+ * since the requestor is handed their paths. They are removed when another
+ * transfer starts, the server clipboard changes or the transfer is aborted.
+ */
 
-	return outbuf;
+static void xf_cliprdr_remove_files(clipboardContext* cb)
+{
+	xf_cliprdr_free_files(cb);
+
+	if (cb->file_dir != NULL)
+	{
+		xf_cliprdr_remove_tree(cb->file_dir);
+		xfree(cb->file_dir);
+		cb->file_dir = NULL;
+	}
+}
+
+void xf_cliprdr_uninit(xfInfo* xfi)
+{
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	if (cb)
+	{
+		xf_cliprdr_remove_files(cb);
+		xf_cliprdr_free_local_files(cb);
+
+		if (cb->request_stream)
+			stream_free(cb->request_stream);
+
+		xfree(cb->formats);
+		xfree(cb->data);
+		xfree(cb->respond);
+		xfree(cb);
+		xfi->clipboard_context = NULL;
+	}
 }
 
 static void crlf2lf(uint8* data, int* size)
@@ -511,60 +650,213 @@ static void xf_cliprdr_get_requested_targets(xfInfo* xfi)
 	}
 }
 
-static uint8* xf_cliprdr_process_requested_raw(uint8* data, int* size)
+/**
+ * Data read from the clipboard owner is converted chunk by chunk into a
+ * single stream as it arrives, so INCR transfers are never accumulated in
+ * their original form before being converted.
+ */
+
+static void xf_cliprdr_begin_requested_data(clipboardContext* cb)
 {
-	uint8* outbuf;
+	if (cb->request_stream == NULL)
+		cb->request_stream = stream_new(4096);
 
-	outbuf = (uint8*) xmalloc(*size);
-	memcpy(outbuf, data, *size);
-	return outbuf;
+	stream_set_pos(cb->request_stream, 0);
+	cb->request_pending_length = 0;
+
+	/* the BMP file header is not part of a DIB */
+	if (cb->format_mappings[cb->request_index].format_id == CB_FORMAT_DIB)
+		cb->request_skip = 14;
+	else
+		cb->request_skip = 0;
 }
 
-static uint8* xf_cliprdr_process_requested_unicodetext(uint8* data, int* size)
+static void xf_cliprdr_append_text(STREAM* s, uint8* data, int size)
 {
-	uint8* inbuf;
-	uint8* outbuf;
-	size_t out_size;
-	UNICONV* uniconv;
-
-	inbuf = lf2crlf(data, size);
+	uint8* out;
+	uint8* in_end;
 
-	uniconv = freerdp_uniconv_new();
-	outbuf = (uint8*) freerdp_uniconv_out(uniconv, (char*) inbuf, &out_size);
-	freerdp_uniconv_free(uniconv);
+	stream_check_size(s, size * 2);
+	out = stream_get_tail(s);
+	in_end = data + size;
 
-	xfree(inbuf);
+	while (data < in_end)
+	{
+		if (*data == '\n')
+			*out++ = '\r';
 
-	*size = (int) out_size + 2;
+		*out++ = *data++;
+	}
 
-	return outbuf;
+	stream_set_pos(s, out - stream_get_head(s));
 }
 
-static uint8* xf_cliprdr_process_requested_text(uint8* data, int* size)
+/**
+ * Decode a single UTF-8 sequence, returning the number of bytes consumed or
+ * 0 if the sequence continues past the end of the data. Invalid sequences
+ * decode as U+FFFD.
+ */
+
+static int xf_cliprdr_utf8_decode(uint8* data, int size, uint32* wc)
 {
-	uint8* outbuf;
+	int i;
+	int n;
+	uint32 c;
 
-	outbuf = lf2crlf(data, size);
+	c = data[0];
 
-	return outbuf;
+	if (c < 0x80)
+	{
+		*wc = c;
+		return 1;
+	}
+	else if (c >= 0xC2 && c < 0xE0)
+	{
+		n = 2;
+		c &= 0x1F;
+	}
+	else if (c >= 0xE0 && c < 0xF0)
+	{
+		n = 3;
+		c &= 0x0F;
+	}
+	else if (c >= 0xF0 && c < 0xF5)
+	{
+		n = 4;
+		c &= 0x07;
+	}
+	else
+	{
+		*wc = 0xFFFD;
+		return 1;
+	}
+
+	for (i = 1; i < n; i++)
+	{
+		if (i >= size)
+			return 0;
+
+		if ((data[i] & 0xC0) != 0x80)
+		{
+			*wc = 0xFFFD;
+			return i;
+		}
+
+		c = (c << 6) | (data[i] & 0x3F);
+	}
+
+	/* overlong forms, surrogates and values past U+10FFFF */
+	if ((n == 3 && c < 0x800) || (n == 4 && (c < 0x10000 || c > 0x10FFFF)) ||
+			(c >= 0xD800 && c <= 0xDFFF))
+		c = 0xFFFD;
+
+	*wc = c;
+	return n;
 }
 
-static uint8* xf_cliprdr_process_requested_dib(uint8* data, int* size)
+static void xf_cliprdr_append_utf16(STREAM* s, uint32 wc)
 {
-	uint8* outbuf;
+	if (wc == '\n')
+		stream_write_uint16(s, '\r');
 
-	/* length should be at least BMP header (14) + sizeof(BITMAPINFOHEADER) */
-	if (*size < 54)
+	if (wc > 0xFFFF)
+	{
+		wc -= 0x10000;
+		stream_write_uint16(s, 0xD800 | (wc >> 10));
+		stream_write_uint16(s, 0xDC00 | (wc & 0x3FF));
+	}
+	else
 	{
-		DEBUG_X11_CLIPRDR("bmp length %d too short", *size);
-		return NULL;
+		stream_write_uint16(s, wc);
 	}
+}
+
+static void xf_cliprdr_append_unicodetext(clipboardContext* cb, uint8* data, int size)
+{
+	int i;
+	int n;
+	int used;
+	int extra;
+	uint32 wc;
+	uint8 seq[8];
+	STREAM* s = cb->request_stream;
 
-	*size -= 14;
-	outbuf = (uint8*) xzalloc(*size);
-	memcpy(outbuf, data + 14, *size);
+	/* every input byte produces at most 4 bytes, for a line feed */
+	stream_check_size(s, (size + 4) * 4);
 
-	return outbuf;
+	if (cb->request_pending_length > 0)
+	{
+		/* finish the sequence left over from the previous chunk */
+		used = cb->request_pending_length;
+		extra = MIN(size, 4);
+		memcpy(seq, cb->request_pending, used);
+		memcpy(seq + used, data, extra);
+
+		for (i = 0; i < used; i += n)
+		{
+			n = xf_cliprdr_utf8_decode(seq + i, used + extra - i, &wc);
+
+			if (n == 0)
+				break;
+
+			xf_cliprdr_append_utf16(s, wc);
+		}
+
+		if (i < used)
+		{
+			/* still incomplete, all of this chunk belongs to the sequence */
+			cb->request_pending_length = used + extra - i;
+			memmove(cb->request_pending, seq + i, cb->request_pending_length);
+			return;
+		}
+
+		data += i - used;
+		size -= i - used;
+		cb->request_pending_length = 0;
+	}
+
+	while (size > 0)
+	{
+		n = xf_cliprdr_utf8_decode(data, size, &wc);
+
+		if (n == 0)
+		{
+			memcpy(cb->request_pending, data, size);
+			cb->request_pending_length = size;
+			break;
+		}
+
+		xf_cliprdr_append_utf16(s, wc);
+		data += n;
+		size -= n;
+	}
+}
+
+static void xf_cliprdr_append_requested_data(clipboardContext* cb, uint8* data, int size)
+{
+	int skip;
+	STREAM* s = cb->request_stream;
+
+	skip = MIN(size, cb->request_skip);
+	cb->request_skip -= skip;
+	data += skip;
+	size -= skip;
+
+	switch (cb->format_mappings[cb->request_index].format_id)
+	{
+		case CB_FORMAT_UNICODETEXT:
+			xf_cliprdr_append_unicodetext(cb, data, size);
+			break;
+
+		case CB_FORMAT_TEXT:
+			xf_cliprdr_append_text(s, data, size);
+			break;
+
+		default:
+			stream_check_size(s, size);
+			stream_write(s, data, size);
+			break;
+	}
 }
 
 static uint8* xf_cliprdr_process_requested_html(uint8* data, int* size)
@@ -639,54 +931,199 @@ static uint8* xf_cliprdr_process_requested_html(uint8* data, int* size)
 	return outbuf;
 }
 
-static void xf_cliprdr_process_requested_data(xfInfo* xfi, boolean has_data, uint8* data, int size)
+static char* xf_cliprdr_uri_decode(char* uri, int length)
 {
-	uint8* outbuf;
-	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+	int i;
+	char* out;
+	char* path;
+	unsigned int c;
 
-	if (cb->incr_starts && has_data)
-		return;
+	path = (char*) xmalloc(length + 1);
+	out = path;
 
-	if (!has_data || data == NULL)
+	for (i = 0; i < length; i++)
 	{
-		xf_cliprdr_send_null_data_response(xfi);
-		return;
+		if (uri[i] == '%' && i + 2 < length && sscanf(uri + i + 1, "%2x", &c) == 1)
+		{
+			*out++ = (char) c;
+			i += 2;
+		}
+		else
+		{
+			*out++ = uri[i];
+		}
 	}
 
-	switch (cb->format_mappings[cb->request_index].format_id)
+	*out = 0;
+
+	return path;
+}
+
+static boolean xf_cliprdr_write_file_descriptor(STREAM* s, char* path, struct stat* st)
+{
+	int length;
+	char* basename;
+	uint64 write_time;
+	uint8 name[520];
+
+	basename = strrchr(path, '/');
+	basename = (basename != NULL) ? basename + 1 : path;
+
+	/* cFileName holds at most 259 characters and the terminating null */
+	length = freerdp_utf8_to_utf16(basename, strlen(basename), name, sizeof(name) - 2);
+
+	if (length < 0)
+		return false;
+
+	/* FILETIME counts 100ns intervals since 1601 */
+	write_time = ((uint64) st->st_mtime + 11644473600ULL) * 10000000ULL;
+
+	stream_write_uint32(s, FD_ATTRIBUTES | FD_FILESIZE | FD_WRITESTIME | FD_SHOWPROGRESSUI); /* flags */
+	stream_write_zero(s, 32); /* clsid, sizel and pointl */
+	stream_write_uint32(s, CB_FILE_ATTRIBUTE_NORMAL); /* fileAttributes */
+	stream_write_zero(s, 16); /* ftCreationTime and ftLastAccessTime */
+	stream_write_uint64(s, write_time); /* ftLastWriteTime */
+	stream_write_uint32(s, (uint32) ((uint64) st->st_size >> 32)); /* nFileSizeHigh */
+	stream_write_uint32(s, (uint32) (st->st_size & 0xFFFFFFFF)); /* nFileSizeLow */
+	stream_write(s, name, length); /* cFileName */
+	stream_write_zero(s, 520 - length);
+
+	return true;
+}
+
+/**
+ * Turn a text/uri-list into a file group descriptor. Only the descriptors
+ * are sent, the server reads the contents of each file with file contents
+ * requests. Directories are not transferred.
+ */
+
+static void xf_cliprdr_process_requested_file_list(clipboardContext* cb, STREAM* s)
+{
+	int length;
+	char* uri;
+	char* end;
+	char* path;
+	struct stat st;
+	STREAM* list;
+
+	xf_cliprdr_free_local_files(cb);
+
+	list = stream_new(4 + CB_FILEDESCRIPTOR_LENGTH);
+	stream_seek(list, 4); /* cItems, written last */
+
+	stream_write_uint8(s, 0);
+	uri = (char*) stream_get_head(s);
+
+	for (; *uri != 0; uri = end)
 	{
-		case CB_FORMAT_RAW:
-		case CB_FORMAT_PNG:
-		case CB_FORMAT_JPEG:
-		case CB_FORMAT_GIF:
-			outbuf = xf_cliprdr_process_requested_raw(data, &size);
-			break;
+		end = uri + strcspn(uri, "\r\n");
+		length = end - uri;
+		end += strspn(end, "\r\n");
+
+		if (length < 7 || strncmp(uri, "file://", 7) != 0)
+			continue;
+
+		/* skip the host name, the path starts at the next slash */
+		uri += 7;
+		length -= 7;
+
+		while (length > 0 && *uri != '/')
+		{
+			uri++;
+			length--;
+		}
+
+		path = xf_cliprdr_uri_decode(uri, length);
+
+		if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+		{
+			DEBUG_X11_CLIPRDR("skipping %s", path);
+			xfree(path);
+			continue;
+		}
+
+		stream_check_size(list, CB_FILEDESCRIPTOR_LENGTH);
+
+		if (!xf_cliprdr_write_file_descriptor(list, path, &st))
+		{
+			DEBUG_X11_CLIPRDR("skipping %s, its name does not convert to UTF-16", path);
+			xfree(path);
+			continue;
+		}
+
+		cb->local_files = (char**) xrealloc(cb->local_files, sizeof(char*) * (cb->num_local_files + 1));
+		cb->local_files[cb->num_local_files++] = path;
+	}
+
+	length = stream_get_length(list);
+	stream_set_pos(list, 0);
+	stream_write_uint32(list, cb->num_local_files); /* cItems */
+	stream_set_pos(list, length);
+
+	stream_free(s);
+	cb->request_stream = list;
+}
+
+static void xf_cliprdr_finish_requested_data(xfInfo* xfi)
+{
+	int size;
+	uint8* data;
+	STREAM* s;
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	s = cb->request_stream;
 
+	switch (cb->format_mappings[cb->request_index].format_id)
+	{
 		case CB_FORMAT_UNICODETEXT:
-			outbuf = xf_cliprdr_process_requested_unicodetext(data, &size);
+			stream_check_size(s, 4);
+
+			if (cb->request_pending_length > 0)
+				xf_cliprdr_append_utf16(s, 0xFFFD);
+
+			stream_write_uint16(s, 0);
 			break;
 
 		case CB_FORMAT_TEXT:
-			outbuf = xf_cliprdr_process_requested_text(data, &size);
+			stream_check_size(s, 1);
+			stream_write_uint8(s, 0);
 			break;
 
 		case CB_FORMAT_DIB:
-			outbuf = xf_cliprdr_process_requested_dib(data, &size);
+			/* length should be at least sizeof(BITMAPINFOHEADER) */
+			if (stream_get_length(s) < 40)
+			{
+				DEBUG_X11_CLIPRDR("dib length %d too short", (int) stream_get_length(s));
+				xf_cliprdr_send_null_data_response(xfi);
+				return;
+			}
 			break;
 
 		case CB_FORMAT_HTML:
-			outbuf = xf_cliprdr_process_requested_html(data, &size);
+			size = stream_get_length(s);
+			data = xf_cliprdr_process_requested_html(stream_get_head(s), &size);
+			xf_cliprdr_send_data_response(xfi, data, size);
+			xf_cliprdr_send_format_list(xfi);
+			return;
+
+		case CB_FORMAT_FILEGROUPDESCRIPTORW:
+			stream_check_size(s, 1);
+			xf_cliprdr_process_requested_file_list(cb, s);
+			s = cb->request_stream;
 			break;
 
 		default:
-			outbuf = NULL;
 			break;
 	}
 
-	if (outbuf)
-		xf_cliprdr_send_data_response(xfi, outbuf, size);
-	else
-		xf_cliprdr_send_null_data_response(xfi);
+	/* hand the converted data over without copying it */
+	size = stream_get_length(s);
+	data = stream_get_head(s);
+	stream_detach(s);
+	stream_free(s);
+	cb->request_stream = NULL;
+
+	xf_cliprdr_send_data_response(xfi, data, size);
 
 	/* Resend the format list, otherwise the server won't request again for the next paste */
 	xf_cliprdr_send_format_list(xfi);
@@ -697,7 +1134,6 @@ static boolean xf_cliprdr_get_requested_data(xfInfo* xfi, Atom target)
 	Atom type;
 	int format;
 	uint8* data = NULL;
-	boolean has_data = false;
 	unsigned long length, bytes_left, dummy;
 	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
 
@@ -724,61 +1160,47 @@ static boolean xf_cliprdr_get_requested_data(xfInfo* xfi, Atom target)
 	if (bytes_left <= 0 && !cb->incr_starts)
 	{
 		DEBUG_X11("no data");
+		xf_cliprdr_send_null_data_response(xfi);
 	}
 	else if (type == cb->incr_atom)
 	{
 		DEBUG_X11("INCR started");
 		cb->incr_starts = true;
-		if (cb->incr_data)
-		{
-			xfree(cb->incr_data);
-			cb->incr_data = NULL;
-		}
-		cb->incr_data_length = 0;
+		xf_cliprdr_begin_requested_data(cb);
 		/* Data will be followed in PropertyNotify event */
-		has_data = true;
 	}
-	else
+	else if (bytes_left <= 0)
 	{
-		if (bytes_left <= 0)
-		{
-			/* INCR finish */
-			data = cb->incr_data;
-			cb->incr_data = NULL;
-			bytes_left = cb->incr_data_length;
-			cb->incr_data_length = 0;
-			cb->incr_starts = 0;
-			DEBUG_X11("INCR finished");
-			has_data = true;
-		}
-		else if (XGetWindowProperty(xfi->display, xfi->drawable,
-			cb->property_atom, 0, bytes_left, 0, target,
-			&type, &format, &length, &dummy, &data) == Success)
-		{
-			if (cb->incr_starts)
-			{
-				bytes_left = length * format / 8;
-				DEBUG_X11("%d bytes", (int)bytes_left);
-				cb->incr_data = (uint8*) xrealloc(cb->incr_data, cb->incr_data_length + bytes_left);
-				memcpy(cb->incr_data + cb->incr_data_length, data, bytes_left);
-				cb->incr_data_length += bytes_left;
-				XFree(data);
-				data = NULL;
-			}
-			has_data = true;
-		}
-		else
-		{
-			DEBUG_X11_CLIPRDR("XGetWindowProperty failed");
-		}
+		/* INCR finish */
+		DEBUG_X11("INCR finished");
+		cb->incr_starts = false;
+		xf_cliprdr_finish_requested_data(xfi);
 	}
-	XDeleteProperty(xfi->display, xfi->drawable, cb->property_atom);
+	else if (XGetWindowProperty(xfi->display, xfi->drawable,
+		cb->property_atom, 0, bytes_left, 0, target,
+		&type, &format, &length, &dummy, &data) == Success)
+	{
+		bytes_left = length * format / 8;
+		DEBUG_X11("%d bytes", (int) bytes_left);
 
-	xf_cliprdr_process_requested_data(xfi, has_data, data, (int) bytes_left);
+		if (!cb->incr_starts)
+			xf_cliprdr_begin_requested_data(cb);
 
-	if (data)
+		xf_cliprdr_append_requested_data(cb, data, (int) bytes_left);
 		XFree(data);
 
+		if (!cb->incr_starts)
+			xf_cliprdr_finish_requested_data(xfi);
+	}
+	else
+	{
+		DEBUG_X11_CLIPRDR("XGetWindowProperty failed");
+
+		if (!cb->incr_starts)
+			xf_cliprdr_send_null_data_response(xfi);
+	}
+	XDeleteProperty(xfi->display, xfi->drawable, cb->property_atom);
+
 	return true;
 }
 
@@ -812,31 +1234,551 @@ static void xf_cliprdr_provide_targets(xfInfo* xfi, XEvent* respond)
 	}
 }
 
+/**
+ * The data provided to requestors is the optional prefix followed by
+ * data_length bytes at data + data_offset, written without being copied.
+ */
+
+static void xf_cliprdr_write_data(xfInfo* xfi, Window requestor, Atom property,
+	Atom target, int offset, int length)
+{
+	int n;
+	int mode = PropModeReplace;
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	if (offset < cb->data_prefix_length)
+	{
+		n = MIN(length, cb->data_prefix_length - offset);
+		XChangeProperty(xfi->display, requestor, property, target, 8, mode,
+			cb->data_prefix + offset, n);
+
+		offset += n;
+		length -= n;
+		mode = PropModeAppend;
+	}
+
+	if (length > 0 || mode == PropModeReplace)
+	{
+		XChangeProperty(xfi->display, requestor, property, target, 8, mode,
+			cb->data + cb->data_offset + offset - cb->data_prefix_length, length);
+	}
+}
+
+static void xf_cliprdr_begin_incr(xfInfo* xfi, XEvent* respond, long length)
+{
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	if (respond->xselection.property == None)
+		return;
+
+	/* the requestor deletes the property each time it has read a chunk */
+	DEBUG_X11_CLIPRDR("INCR transfer of %d bytes", (int) length);
+
+	XSelectInput(xfi->display, respond->xselection.requestor, PropertyChangeMask);
+	XChangeProperty(xfi->display,
+		respond->xselection.requestor,
+		respond->xselection.property,
+		cb->incr_atom, 32, PropModeReplace,
+		(uint8*) &length, 1);
+
+	cb->incr_requestor = respond->xselection.requestor;
+	cb->incr_property = respond->xselection.property;
+	cb->incr_target = respond->xselection.target;
+	cb->incr_offset = 0;
+}
+
 static void xf_cliprdr_provide_data(xfInfo* xfi, XEvent* respond)
 {
+	long length;
 	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
 
-	if (respond->xselection.property != None)
+	if (respond->xselection.property == None)
+		return;
+
+	length = cb->data_prefix_length + cb->data_length;
+
+	if (length > cb->incr_chunk_size)
 	{
-		XChangeProperty(xfi->display,
+		xf_cliprdr_begin_incr(xfi, respond, length);
+	}
+	else
+	{
+		xf_cliprdr_write_data(xfi,
 			respond->xselection.requestor,
 			respond->xselection.property,
-			respond->xselection.target, 8, PropModeReplace,
-			(uint8*) cb->data, cb->data_length);
+			respond->xselection.target, 0, length);
 	}
 }
 
-static void xf_cliprdr_process_cb_format_list_event(xfInfo* xfi, RDP_CB_FORMAT_LIST_EVENT* event)
+static void xf_cliprdr_provide_incr_chunk(xfInfo* xfi)
 {
-	int i, j;
+	int length;
 	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
 
-	if (cb->data)
+	length = MIN(cb->data_prefix_length + cb->data_length - cb->incr_offset, cb->incr_chunk_size);
+
+	xf_cliprdr_write_data(xfi, cb->incr_requestor, cb->incr_property,
+		cb->incr_target, cb->incr_offset, length);
+
+	cb->incr_offset += length;
+
+	/* the transfer ends with a zero length property */
+	if (length == 0)
 	{
-		xfree(cb->data);
-		cb->data = NULL;
+		DEBUG_X11_CLIPRDR("INCR transfer finished");
+		XSelectInput(xfi->display, cb->incr_requestor, NoEventMask);
+		cb->incr_requestor = None;
+	}
+
+	XFlush(xfi->display);
+}
+
+static void xf_cliprdr_clear_data(clipboardContext* cb)
+{
+	/* a transfer still reading the data is abandoned */
+	cb->incr_requestor = None;
+	cb->incr_pending = false;
+	cb->incr_waiting = false;
+
+	xfree(cb->data);
+	cb->data = NULL;
+	cb->data_offset = 0;
+	cb->data_length = 0;
+	cb->data_prefix_length = 0;
+}
+
+static void xf_cliprdr_send_respond(xfInfo* xfi)
+{
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	XSendEvent(xfi->display, cb->respond->xselection.requestor, 0, 0, cb->respond);
+	XFlush(xfi->display);
+	xfree(cb->respond);
+	cb->respond = NULL;
+}
+
+static boolean xf_cliprdr_is_safe_name(char* name)
+{
+	char* p;
+	int length;
+
+	if (name[0] == 0 || name[0] == '/')
+		return false;
+
+	for (p = name; *p != 0; p += length)
+	{
+		length = strcspn(p, "/");
+
+		if ((length == 1 && p[0] == '.') || (length == 2 && p[0] == '.' && p[1] == '.'))
+			return false;
+
+		if (p[length] == '/')
+			length++;
+	}
+
+	return true;
+}
+
+static void xf_cliprdr_make_parent_dirs(char* path, int start)
+{
+	char* p;
+
+	for (p = strchr(path + start, '/'); p != NULL; p = strchr(p + 1, '/'))
+	{
+		*p = 0;
+		mkdir(path, 0700);
+		*p = '/';
+	}
+}
+
+/**
+ * Create the files of a file group descriptor in a new temporary directory,
+ * their contents are then pulled with file contents requests.
+ */
+
+static boolean xf_cliprdr_process_file_list(clipboardContext* cb, uint8* data, int size)
+{
+	int i;
+	int length;
+	STREAM* s;
+	char* path;
+	char* name;
+	uint32 count;
+	uint32 attributes;
+	uint32 size_high;
+	uint32 size_low;
+	clipboardFile* file;
+	char name_utf8[520 / 2 * 3 + 1];
+	char dir[] = "/tmp/xfreerdp-cliprdr.XXXXXX";
+
+	xf_cliprdr_remove_files(cb);
+
+	if (size < 4)
+		return false;
+
+	s = stream_new(0);
+	stream_attach(s, data, size);
+	stream_read_uint32(s, count); /* cItems */
+
+	if (count > (uint32) (size - 4) / CB_FILEDESCRIPTOR_LENGTH || mkdtemp(dir) == NULL)
+	{
+		DEBUG_WARN("unable to receive %d files", count);
+		stream_detach(s);
+		stream_free(s);
+		return false;
+	}
+
+	cb->file_dir = xstrdup(dir);
+	cb->files = (clipboardFile*) xzalloc(sizeof(clipboardFile) * count);
+
+	for (i = 0; i < count; i++)
+	{
+		file = &cb->files[cb->num_files];
+		file->lindex = i;
+		file->fd = -1;
+
+		stream_read_uint32(s, file->flags); /* flags */
+		stream_seek(s, 32); /* clsid, sizel and pointl */
+		stream_read_uint32(s, attributes); /* fileAttributes */
+		stream_seek(s, 24); /* ftCreationTime, ftLastAccessTime and ftLastWriteTime */
+		stream_read_uint32(s, size_high); /* nFileSizeHigh */
+		stream_read_uint32(s, size_low); /* nFileSizeLow */
+
+		for (length = 0; length < 520; length += 2)
+		{
+			if (stream_get_tail(s)[length] == 0 && stream_get_tail(s)[length + 1] == 0)
+				break;
+		}
+
+		/* each UTF-16 code unit takes at most three bytes in UTF-8 */
+		length = freerdp_utf16_to_utf8(stream_get_tail(s), length, name_utf8, sizeof(name_utf8) - 1);
+		name_utf8[length] = 0;
+		name = xstrdup(name_utf8);
+		stream_seek(s, 520); /* cFileName */
+
+		for (path = name; *path != 0; path++)
+		{
+			if (*path == '\\')
+				*path = '/';
+		}
+
+		if (!xf_cliprdr_is_safe_name(name))
+		{
+			DEBUG_WARN("ignoring file %s", name);
+			xfree(name);
+			continue;
+		}
+
+		path = (char*) xmalloc(strlen(dir) + strlen(name) + 2);
+		sprintf(path, "%s/%s", dir, name);
+		xf_cliprdr_make_parent_dirs(path, strlen(dir) + 1);
+
+		if ((file->flags & FD_ATTRIBUTES) && (attributes & CB_FILE_ATTRIBUTE_DIRECTORY))
+		{
+			mkdir(path, 0700);
+		}
+		else if ((file->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+		{
+			DEBUG_WARN("unable to create %s", path);
+			xfree(path);
+			xfree(name);
+			continue;
+		}
+
+		if (file->flags & FD_FILESIZE)
+			file->size = ((uint64) size_high << 32) | size_low;
+
+		file->name = name;
+		cb->num_files++;
+		xfree(path);
 	}
 
+	stream_detach(s);
+	stream_free(s);
+
+	return true;
+}
+
+static void xf_cliprdr_send_filecontents_request(xfInfo* xfi, uint32 flags, uint64 position, uint32 length)
+{
+	clipboardRange* range;
+	RDP_CB_FILECONTENTS_REQUEST_EVENT* event;
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	range = &cb->ranges[cb->num_ranges++];
+	range->stream_id = ++cb->stream_id;
+	range->flags = flags;
+	range->position = position;
+	range->length = length;
+
+	event = (RDP_CB_FILECONTENTS_REQUEST_EVENT*) freerdp_event_new(RDP_EVENT_CLASS_CLIPRDR,
+		RDP_EVENT_TYPE_CB_FILECONTENTS_REQUEST, NULL, NULL);
+
+	event->stream_id = range->stream_id;
+	event->lindex = cb->files[cb->file_index].lindex;
+	event->flags = flags;
+	event->position = position;
+	event->requested = length;
+
+	freerdp_channels_send_event(cb->channels, (RDP_EVENT*) event);
+}
+
+static void xf_cliprdr_finish_files(xfInfo* xfi)
+{
+	int i;
+	char* p;
+	STREAM* s;
+	char* path;
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	/* the uri list names the top level files and directories */
+	s = stream_new(256);
+
+	for (i = 0; i < cb->num_files; i++)
+	{
+		if (strchr(cb->files[i].name, '/') != NULL)
+			continue;
+
+		path = (char*) xmalloc(strlen(cb->file_dir) + strlen(cb->files[i].name) + 2);
+		sprintf(path, "%s/%s", cb->file_dir, cb->files[i].name);
+
+		stream_check_size(s, strlen(path) * 3 + 10);
+		stream_write(s, "file://", 7);
+
+		for (p = path; *p != 0; p++)
+		{
+			if (isalnum((uint8) *p) || strchr("/-_.~", *p) != NULL)
+				stream_write_uint8(s, *p);
+			else
+				s->p += sprintf((char*) stream_get_tail(s), "%%%02X", (uint8) *p);
+		}
+
+		stream_write(s, "\r\n", 2);
+		xfree(path);
+	}
+
+	xfree(cb->data);
+	cb->data = stream_get_head(s);
+	cb->data_offset = 0;
+	cb->data_length = stream_get_length(s);
+	cb->data_prefix_length = 0;
+	stream_detach(s);
+	stream_free(s);
+
+	xf_cliprdr_free_files(cb);
+
+	/* the requestor was answered with an INCR transfer when the file list arrived */
+	cb->incr_pending = false;
+
+	if (cb->incr_waiting && cb->incr_requestor != None)
+		xf_cliprdr_provide_incr_chunk(xfi);
+
+	cb->incr_waiting = false;
+}
+
+static void xf_cliprdr_abort_files(xfInfo* xfi)
+{
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	xf_cliprdr_remove_files(cb);
+
+	if (cb->incr_pending)
+	{
+		/* the INCR transfer ends without data */
+		cb->incr_pending = false;
+
+		if (cb->incr_waiting && cb->incr_requestor != None)
+			xf_cliprdr_provide_incr_chunk(xfi);
+
+		cb->incr_waiting = false;
+	}
+}
+
+/**
+ * Keep up to CB_FILECONTENTS_WINDOW ranges of the current file requested,
+ * moving on to the next file once all of its ranges have been written.
+ */
+
+static void xf_cliprdr_pull_files(xfInfo* xfi)
+{
+	uint32 length;
+	clipboardFile* file;
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	while (cb->file_index < cb->num_files)
+	{
+		file = &cb->files[cb->file_index];
+
+		if (file->fd >= 0)
+		{
+			if (!(file->flags & FD_FILESIZE))
+			{
+				if (cb->num_ranges == 0)
+					xf_cliprdr_send_filecontents_request(xfi, FILECONTENTS_SIZE, 0, 8);
+
+				return;
+			}
+
+			if (file->offset < file->size)
+			{
+				if (cb->num_ranges == CB_FILECONTENTS_WINDOW)
+					return;
+
+				length = (uint32) MIN(file->size - file->offset, CB_FILECONTENTS_CHUNK_SIZE);
+				xf_cliprdr_send_filecontents_request(xfi, FILECONTENTS_RANGE, file->offset, length);
+				file->offset += length;
+				continue;
+			}
+
+			if (cb->num_ranges > 0)
+				return;
+
+			close(file->fd);
+			file->fd = -1;
+		}
+
+		cb->file_index++;
+	}
+
+	xf_cliprdr_finish_files(xfi);
+}
+
+static void xf_cliprdr_process_cb_filecontents_response_event(xfInfo* xfi, RDP_CB_FILECONTENTS_RESPONSE_EVENT* event)
+{
+	int i;
+	STREAM* s;
+	uint64 size;
+	clipboardFile* file;
+	clipboardRange range;
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	for (i = 0; i < cb->num_ranges; i++)
+	{
+		if (cb->ranges[i].stream_id == event->stream_id)
+			break;
+	}
+
+	if (i == cb->num_ranges)
+	{
+		DEBUG_X11_CLIPRDR("unexpected file contents for stream %d", event->stream_id);
+		return;
+	}
+
+	range = cb->ranges[i];
+	cb->ranges[i] = cb->ranges[--cb->num_ranges];
+	file = &cb->files[cb->file_index];
+
+	if (event->failed)
+	{
+		DEBUG_WARN("server failed to provide %s", file->name);
+		xf_cliprdr_abort_files(xfi);
+		return;
+	}
+
+	if (range.flags & FILECONTENTS_SIZE)
+	{
+		if (event->size < 8)
+		{
+			xf_cliprdr_abort_files(xfi);
+			return;
+		}
+
+		s = stream_new(0);
+		stream_attach(s, event->data, event->size);
+		stream_read_uint64(s, size);
+		stream_detach(s);
+		stream_free(s);
+
+		file->size = size;
+		file->flags |= FD_FILESIZE;
+	}
+	else
+	{
+		if (event->size > range.length ||
+			pwrite(file->fd, event->data, event->size, range.position) != event->size)
+		{
+			DEBUG_WARN("unable to write %s", file->name);
+			xf_cliprdr_abort_files(xfi);
+			return;
+		}
+
+		/* a short range ends the file */
+		if (event->size < range.length && range.position + event->size < file->size)
+			file->size = range.position + event->size;
+	}
+
+	xf_cliprdr_pull_files(xfi);
+}
+
+static void xf_cliprdr_process_cb_filecontents_request_event(xfInfo* xfi, RDP_CB_FILECONTENTS_REQUEST_EVENT* event)
+{
+	STREAM* s;
+	ssize_t length;
+	struct stat st;
+	RDP_CB_FILECONTENTS_RESPONSE_EVENT* response;
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	response = (RDP_CB_FILECONTENTS_RESPONSE_EVENT*) freerdp_event_new(RDP_EVENT_CLASS_CLIPRDR,
+		RDP_EVENT_TYPE_CB_FILECONTENTS_RESPONSE, NULL, NULL);
+
+	response->stream_id = event->stream_id;
+	response->failed = true;
+
+	if (event->lindex < cb->num_local_files && cb->local_fd_index != event->lindex)
+	{
+		if (cb->local_fd >= 0)
+			close(cb->local_fd);
+
+		cb->local_fd = open(cb->local_files[event->lindex], O_RDONLY);
+		cb->local_fd_index = (cb->local_fd >= 0) ? event->lindex : -1;
+	}
+
+	if (cb->local_fd_index != event->lindex || event->lindex >= cb->num_local_files)
+	{
+		DEBUG_X11_CLIPRDR("no file %d", event->lindex);
+	}
+	else if (event->flags & FILECONTENTS_SIZE)
+	{
+		if (fstat(cb->local_fd, &st) == 0)
+		{
+			s = stream_new(8);
+			stream_write_uint64(s, st.st_size);
+			response->data = stream_get_head(s);
+			response->size = 8;
+			response->failed = false;
+			stream_detach(s);
+			stream_free(s);
+		}
+	}
+	else
+	{
+		/* only the requested range is ever read into memory */
+		response->data = (uint8*) xmalloc(MIN(event->requested, CB_FILECONTENTS_MAX_RANGE));
+		length = pread(cb->local_fd, response->data,
+			MIN(event->requested, CB_FILECONTENTS_MAX_RANGE), event->position);
+
+		if (length >= 0)
+		{
+			response->size = length;
+			response->failed = false;
+		}
+	}
+
+	freerdp_channels_send_event(cb->channels, (RDP_EVENT*) response);
+}
+
+static void xf_cliprdr_process_cb_format_list_event(xfInfo* xfi, RDP_CB_FORMAT_LIST_EVENT* event)
+{
+	int i, j;
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	if (cb->num_files > 0)
+		xf_cliprdr_abort_files(xfi);
+	else
+		xf_cliprdr_remove_files(cb);
+
+	xf_cliprdr_clear_data(cb);
+
 	if (cb->formats)
 		xfree(cb->formats);
 
@@ -869,11 +1811,18 @@ static void xf_cliprdr_process_cb_format_list_event(xfInfo* xfi, RDP_CB_FORMAT_L
 	XFlush(xfi->display);
 }
 
-static void xf_cliprdr_process_text(clipboardContext* cb, uint8* data, int size)
+static void xf_cliprdr_take_data(clipboardContext* cb, RDP_CB_DATA_RESPONSE_EVENT* event)
+{
+	cb->data = event->data;
+	cb->data_offset = 0;
+	cb->data_length = event->size;
+	event->data = NULL;
+	event->size = 0;
+}
+
+static void xf_cliprdr_process_text(clipboardContext* cb, RDP_CB_DATA_RESPONSE_EVENT* event)
 {
-	cb->data = (uint8*) xmalloc(size);
-	memcpy(cb->data, data, size);
-	cb->data_length = size;
+	xf_cliprdr_take_data(cb, event);
 	crlf2lf(cb->data, &cb->data_length);
 }
 
@@ -888,12 +1837,13 @@ static void xf_cliprdr_process_unicodetext(clipboardContext* cb, uint8* data, in
 	crlf2lf(cb->data, &cb->data_length);
 }
 
-static void xf_cliprdr_process_dib(clipboardContext* cb, uint8* data, int size)
+static void xf_cliprdr_process_dib(clipboardContext* cb, RDP_CB_DATA_RESPONSE_EVENT* event)
 {
 	STREAM* s;
 	uint16 bpp;
 	uint32 offset;
 	uint32 ncolors;
+	int size = event->size;
 
 	/* size should be at least sizeof(BITMAPINFOHEADER) */
 	if (size < 40)
@@ -903,36 +1853,37 @@ static void xf_cliprdr_process_dib(clipboardContext* cb, uint8* data, int size)
 	}
 
 	s = stream_new(0);
-	stream_attach(s, data, size);
+	stream_attach(s, event->data, size);
 	stream_seek(s, 14);
 	stream_read_uint16(s, bpp);
 	stream_read_uint32(s, ncolors);
 	offset = 14 + 40 + (bpp <= 8 ? (ncolors == 0 ? (1 << bpp) : ncolors) * 4 : 0);
 	stream_detach(s);
-	stream_free(s);
 
 	DEBUG_X11_CLIPRDR("offset=%d bpp=%d ncolors=%d", offset, bpp, ncolors);
 
-	s = stream_new(14 + size);
+	/* the BMP file header is provided in front of the DIB */
+	stream_attach(s, cb->data_prefix, 14);
 	stream_write_uint8(s, 'B');
 	stream_write_uint8(s, 'M');
 	stream_write_uint32(s, 14 + size);
 	stream_write_uint32(s, 0);
 	stream_write_uint32(s, offset);
-	stream_write(s, data, size);
-
-	cb->data = stream_get_head(s);
-	cb->data_length = stream_get_length(s);
 	stream_detach(s);
 	stream_free(s);
+
+	cb->data_prefix_length = 14;
+	xf_cliprdr_take_data(cb, event);
 }
 
-static void xf_cliprdr_process_html(clipboardContext* cb, uint8* data, int size)
+static void xf_cliprdr_process_html(clipboardContext* cb, RDP_CB_DATA_RESPONSE_EVENT* event)
 {
 	char* start_str;
 	char* end_str;
 	int start;
 	int end;
+	int size = event->size;
+	uint8* data = event->data;
 
 	start_str = strstr((char*) data, "StartHTML:");
 	end_str = strstr((char*) data, "EndHTML:");
@@ -949,10 +1900,11 @@ static void xf_cliprdr_process_html(clipboardContext* cb, uint8* data, int size)
 		return;
 	}
 
-	cb->data = (uint8*) xmalloc(size - start + 1);
-	memcpy(cb->data, data + start, end - start);
+	/* the fragment is provided from the response buffer itself */
+	xf_cliprdr_take_data(cb, event);
+	cb->data_offset = start;
 	cb->data_length = end - start;
-	crlf2lf(cb->data, &cb->data_length);
+	crlf2lf(cb->data + start, &cb->data_length);
 }
 
 static void xf_cliprdr_process_cb_data_response_event(xfInfo* xfi, RDP_CB_DATA_RESPONSE_EVENT* event)
@@ -973,25 +1925,19 @@ static void xf_cliprdr_process_cb_data_response_event(xfInfo* xfi, RDP_CB_DATA_R
 	}
 	else
 	{
-		if (cb->data)
-		{
-			xfree(cb->data);
-			cb->data = NULL;
-		}
+		xf_cliprdr_clear_data(cb);
+
 		switch (cb->data_format)
 		{
 			case CB_FORMAT_RAW:
 			case CB_FORMAT_PNG:
 			case CB_FORMAT_JPEG:
 			case CB_FORMAT_GIF:
-				cb->data = event->data;
-				cb->data_length = event->size;
-				event->data = NULL;
-				event->size = 0;
+				xf_cliprdr_take_data(cb, event);
 				break;
 
 			case CB_FORMAT_TEXT:
-				xf_cliprdr_process_text(cb, event->data, event->size);
+				xf_cliprdr_process_text(cb, event);
 				break;
 
 			case CB_FORMAT_UNICODETEXT:
@@ -999,11 +1945,30 @@ static void xf_cliprdr_process_cb_data_response_event(xfInfo* xfi, RDP_CB_DATA_R
 				break;
 
 			case CB_FORMAT_DIB:
-				xf_cliprdr_process_dib(cb, event->data, event->size);
+				xf_cliprdr_process_dib(cb, event);
 				break;
 
 			case CB_FORMAT_HTML:
-				xf_cliprdr_process_html(cb, event->data, event->size);
+				xf_cliprdr_process_html(cb, event);
+				break;
+
+			case CB_FORMAT_FILEGROUPDESCRIPTORW:
+				if (xf_cliprdr_process_file_list(cb, event->data, event->size))
+				{
+					/**
+					 * Pulling the files may take longer than requestors wait for
+					 * an answer, so answer now with an INCR transfer and provide
+					 * the uri list once all the files are written.
+					 */
+					xf_cliprdr_begin_incr(xfi, cb->respond, 0);
+					cb->incr_pending = true;
+					cb->incr_waiting = false;
+					xf_cliprdr_send_respond(xfi);
+
+					xf_cliprdr_pull_files(xfi);
+					return;
+				}
+				cb->respond->xselection.property = None;
 				break;
 
 			default:
@@ -1013,10 +1978,7 @@ static void xf_cliprdr_process_cb_data_response_event(xfInfo* xfi, RDP_CB_DATA_R
 		xf_cliprdr_provide_data(xfi, cb->respond);
 	}
 
-	XSendEvent(xfi->display, cb->respond->xselection.requestor, 0, 0, cb->respond);
-	XFlush(xfi->display);
-	xfree(cb->respond);
-	cb->respond = NULL;
+	xf_cliprdr_send_respond(xfi);
 }
 
 void xf_process_cliprdr_event(xfInfo* xfi, RDP_EVENT* event)
@@ -1039,6 +2001,14 @@ void xf_process_cliprdr_event(xfInfo* xfi, RDP_EVENT* event)
 			xf_cliprdr_process_cb_data_response_event(xfi, (RDP_CB_DATA_RESPONSE_EVENT*) event);
 			break;
 
+		case RDP_EVENT_TYPE_CB_FILECONTENTS_REQUEST:
+			xf_cliprdr_process_cb_filecontents_request_event(xfi, (RDP_CB_FILECONTENTS_REQUEST_EVENT*) event);
+			break;
+
+		case RDP_EVENT_TYPE_CB_FILECONTENTS_RESPONSE:
+			xf_cliprdr_process_cb_filecontents_response_event(xfi, (RDP_CB_FILECONTENTS_RESPONSE_EVENT*) event);
+			break;
+
 		default:
 			DEBUG_X11_CLIPRDR("unknown event type %d", event->event_type);
 			break;
@@ -1143,7 +2113,7 @@ boolean xf_cliprdr_process_selection_request(xfInfo* xfi, XEvent* xevent)
 				respond->xselection.property = xevent->xselectionrequest.property;
 				xf_cliprdr_provide_data(xfi, respond);
 			}
-			else if (cb->respond)
+			else if (cb->respond || cb->incr_pending)
 			{
 				DEBUG_X11_CLIPRDR("duplicated request");
 			}
@@ -1153,11 +2123,7 @@ boolean xf_cliprdr_process_selection_request(xfInfo* xfi, XEvent* xevent)
 				 * Send clipboard data request to the server.
 				 * Response will be postponed after receiving the data
 				 */
-				if (cb->data)
-				{
-					xfree(cb->data);
-					cb->data = NULL;
-				}
+				xf_cliprdr_clear_data(cb);
 
 				respond->xselection.property = xevent->xselectionrequest.property;
 				cb->respond = respond;
@@ -1196,6 +2162,19 @@ boolean xf_cliprdr_process_property_notify(xfInfo* xfi, XEvent* xevent)
 {
 	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
 
+	if (xevent->xproperty.window == cb->incr_requestor &&
+		xevent->xproperty.atom == cb->incr_property &&
+		xevent->xproperty.state == PropertyDelete)
+	{
+		/* the requestor has read the last chunk */
+		if (cb->incr_pending)
+			cb->incr_waiting = true;
+		else
+			xf_cliprdr_provide_incr_chunk(xfi);
+
+		return true;
+	}
+
 	if (xevent->xproperty.atom != cb->property_atom)
 		return false; /* Not cliprdr-related */
 
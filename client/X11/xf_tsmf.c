@@ -29,24 +29,31 @@
 #include <freerdp/utils/memory.h>
 #include <freerdp/utils/event.h>
 #include <freerdp/plugins/tsmf.h>
+#include <freerdp/codec/yuv.h>
 
 #include "xf_tsmf.h"
 
 #ifdef WITH_XV
-
 #include <X11/extensions/Xv.h>
 #include <X11/extensions/Xvlib.h>
+#endif
 
 typedef struct xf_xv_context xfXvContext;
 
 struct xf_xv_context
 {
+#ifdef WITH_XV
 	long xv_port;
 	Atom xv_colorkey_atom;
 	int xv_image_size;
 	int xv_shmid;
 	char* xv_shmaddr;
 	uint32* xv_pixfmts;
+#endif
+
+	/* software rendering when Xv is unavailable, e.g. under Xvfb */
+	YUV_CONTEXT* yuv_context;
+	XImage* sw_image;
 };
 
 #ifdef WITH_DEBUG_XV
@@ -55,7 +62,37 @@ struct xf_xv_context
 #define DEBUG_XV(fmt, ...) DEBUG_NULL(fmt, ## __VA_ARGS__)
 #endif
 
-void xf_tsmf_init(xfInfo* xfi, long xv_port)
+/**
+ * Y, U and V planes of an I420 or YV12 frame with their row steps, packed
+ * unless the frame carries its own layout. Returns false if the frame data
+ * is too small for the layout.
+ */
+static boolean xf_tsmf_get_planes(RDP_VIDEO_FRAME_EVENT* vevent, uint8* planes[3], int steps[3])
+{
+	int step;
+	uint8* plane;
+
+	if (!yuv_get_yuv420p_planes(vevent->frame_data, vevent->frame_size, vevent->frame_width,
+			vevent->frame_height, vevent->frame_offsets, vevent->frame_steps, planes, steps))
+		return false;
+
+	/* YV12 stores V before U */
+	if (vevent->frame_pixfmt == RDP_PIXFMT_YV12)
+	{
+		plane = planes[1];
+		planes[1] = planes[2];
+		planes[2] = plane;
+		step = steps[1];
+		steps[1] = steps[2];
+		steps[2] = step;
+	}
+
+	return true;
+}
+
+#ifdef WITH_XV
+
+static void xf_tsmf_xv_init(xfInfo* xfi, xfXvContext* xv, long xv_port)
 {
 	int ret;
 	unsigned int i;
@@ -65,14 +102,10 @@ void xf_tsmf_init(xfInfo* xfi, long xv_port)
 	unsigned int error_base;
 	unsigned int request_base;
 	unsigned int num_adaptors;
-	xfXvContext* xv;
 	XvAdaptorInfo* ai;
 	XvAttribute* attr;
 	XvImageFormatValues* fo;
 
-	xv = xnew(xfXvContext);
-	xfi->xv_context = xv;
-
 	xv->xv_colorkey_atom = None;
 	xv->xv_image_size = 0;
 	xv->xv_port = xv_port;
@@ -152,24 +185,17 @@ void xf_tsmf_init(xfInfo* xfi, long xv_port)
 #endif
 }
 
-void xf_tsmf_uninit(xfInfo* xfi)
+static void xf_tsmf_xv_uninit(xfInfo* xfi, xfXvContext* xv)
 {
-	xfXvContext* xv = (xfXvContext*) xfi->xv_context;
-
-	if (xv)
+	if (xv->xv_image_size > 0)
 	{
-		if (xv->xv_image_size > 0)
-		{
-			shmdt(xv->xv_shmaddr);
-			shmctl(xv->xv_shmid, IPC_RMID, NULL);
-		}
-		if (xv->xv_pixfmts)
-		{
-			xfree(xv->xv_pixfmts);
-			xv->xv_pixfmts = NULL;
-		}
-		xfree(xv);
-		xfi->xv_context = NULL;
+		shmdt(xv->xv_shmaddr);
+		shmctl(xv->xv_shmid, IPC_RMID, NULL);
+	}
+	if (xv->xv_pixfmts)
+	{
+		xfree(xv->xv_pixfmts);
+		xv->xv_pixfmts = NULL;
 	}
 }
 
@@ -190,25 +216,45 @@ xf_tsmf_is_format_supported(xfXvContext* xv, uint32 pixfmt)
 	return false;
 }
 
-static void xf_process_tsmf_video_frame_event(xfInfo* xfi, RDP_VIDEO_FRAME_EVENT* vevent)
+/* returns false when Xv cannot display the frame */
+static boolean xf_tsmf_xv_video_frame(xfInfo* xfi, RDP_VIDEO_FRAME_EVENT* vevent)
 {
 	int i;
-	uint8* data1;
-	uint8* data2;
+	int p;
+	int rows;
+	int width;
+	int steps[3];
+	uint8* planes[3];
+	uint8* data[3];
 	uint32 pixfmt;
 	uint32 xvpixfmt;
-	boolean converti420yv12 = false;
 	XvImage * image;
 	int colorkey = 0;
 	XShmSegmentInfo shminfo;
 	xfXvContext* xv = (xfXvContext*) xfi->xv_context;
 
 	if (xv->xv_port == 0)
-		return;
+		return false;
 
-	/* In case the player is minimized */
-	if (vevent->x < -2048 || vevent->y < -2048 || vevent->num_visible_rects <= 0)
-		return;
+	pixfmt = vevent->frame_pixfmt;
+
+	if (xf_tsmf_is_format_supported(xv, pixfmt))
+	{
+		xvpixfmt = pixfmt;
+	}
+	else if (pixfmt == RDP_PIXFMT_I420 && xf_tsmf_is_format_supported(xv, RDP_PIXFMT_YV12))
+	{
+		xvpixfmt = RDP_PIXFMT_YV12;
+	}
+	else if (pixfmt == RDP_PIXFMT_YV12 && xf_tsmf_is_format_supported(xv, RDP_PIXFMT_I420))
+	{
+		xvpixfmt = RDP_PIXFMT_I420;
+	}
+	else
+	{
+		DEBUG_XV("pixel format 0x%X not supported by hardware.", pixfmt);
+		return false;
+	}
 
 	if (xv->xv_colorkey_atom != None)
 	{
@@ -231,28 +277,6 @@ static void xf_process_tsmf_video_frame_event(xfInfo* xfi, RDP_VIDEO_FRAME_EVENT
 			(XRectangle*) vevent->visible_rects, vevent->num_visible_rects, YXBanded);
 	}
 
-	pixfmt = vevent->frame_pixfmt;
-
-	if (xf_tsmf_is_format_supported(xv, pixfmt))
-	{
-		xvpixfmt = pixfmt;
-	}
-	else if (pixfmt == RDP_PIXFMT_I420 && xf_tsmf_is_format_supported(xv, RDP_PIXFMT_YV12))
-	{
-		xvpixfmt = RDP_PIXFMT_YV12;
-		converti420yv12 = true;
-	}
-	else if (pixfmt == RDP_PIXFMT_YV12 && xf_tsmf_is_format_supported(xv, RDP_PIXFMT_I420))
-	{
-		xvpixfmt = RDP_PIXFMT_I420;
-		converti420yv12 = true;
-	}
-	else
-	{
-		DEBUG_XV("pixel format 0x%X not supported by hardware.", pixfmt);
-		return;
-	}
-
 	image = XvShmCreateImage(xfi->display, xv->xv_port,
 		xvpixfmt, 0, vevent->frame_width, vevent->frame_height, &shminfo);
 
@@ -275,7 +299,7 @@ static void xf_process_tsmf_video_frame_event(xfInfo* xfi, RDP_VIDEO_FRAME_EVENT
 	{
 		XFree(image);
 		DEBUG_XV("XShmAttach failed.");
-		return;
+		return true;
 	}
 
 	/* The video driver may align each line to a different size
@@ -284,56 +308,30 @@ static void xf_process_tsmf_video_frame_event(xfInfo* xfi, RDP_VIDEO_FRAME_EVENT
 	{
 		case RDP_PIXFMT_I420:
 		case RDP_PIXFMT_YV12:
-			/* Y */
-			if (image->pitches[0] == vevent->frame_width)
-			{
-				memcpy(image->data + image->offsets[0],
-					vevent->frame_data,
-					vevent->frame_width * vevent->frame_height);
-			}
-			else
+			if (!xf_tsmf_get_planes(vevent, planes, steps))
+				break;
+
+			/* Conversion between I420 and YV12 is to simply swap U and V */
+			data[0] = planes[0];
+			data[1] = (xvpixfmt == RDP_PIXFMT_I420) ? planes[1] : planes[2];
+			data[2] = (xvpixfmt == RDP_PIXFMT_I420) ? planes[2] : planes[1];
+
+			for (p = 0; p < 3; p++)
 			{
-				for (i = 0; i < vevent->frame_height; i++)
+				width = (p == 0) ? vevent->frame_width : (vevent->frame_width + 1) / 2;
+				rows = (p == 0) ? vevent->frame_height : (vevent->frame_height + 1) / 2;
+
+				if (image->pitches[p] == width && steps[p] == width)
 				{
-					memcpy(image->data + image->offsets[0] + i * image->pitches[0],
-						vevent->frame_data + i * vevent->frame_width,
-						vevent->frame_width);
+					memcpy(image->data + image->offsets[p], data[p], width * rows);
 				}
-			}
-			/* UV */
-			/* Conversion between I420 and YV12 is to simply swap U and V */
-			if (converti420yv12 == false)
-			{
-				data1 = vevent->frame_data + vevent->frame_width * vevent->frame_height;
-				data2 = vevent->frame_data + vevent->frame_width * vevent->frame_height +
-					vevent->frame_width * vevent->frame_height / 4;
-			}
-			else
-			{
-				data2 = vevent->frame_data + vevent->frame_width * vevent->frame_height;
-				data1 = vevent->frame_data + vevent->frame_width * vevent->frame_height +
-					vevent->frame_width * vevent->frame_height / 4;
-				image->id = pixfmt == RDP_PIXFMT_I420 ? RDP_PIXFMT_YV12 : RDP_PIXFMT_I420;
-			}
-			if (image->pitches[1] * 2 == vevent->frame_width)
-			{
-				memcpy(image->data + image->offsets[1],
-					data1,
-					vevent->frame_width * vevent->frame_height / 4);
-				memcpy(image->data + image->offsets[2],
-					data2,
-					vevent->frame_width * vevent->frame_height / 4);
-			}
-			else
-			{
-				for (i = 0; i < vevent->frame_height / 2; i++)
+				else
 				{
-					memcpy(image->data + image->offsets[1] + i * image->pitches[1],
-						data1 + i * vevent->frame_width / 2,
-						vevent->frame_width / 2);
-					memcpy(image->data + image->offsets[2] + i * image->pitches[2],
-						data2 + i * vevent->frame_width / 2,
-						vevent->frame_width / 2);
+					for (i = 0; i < rows; i++)
+					{
+						memcpy(image->data + image->offsets[p] + i * image->pitches[p],
+							data[p] + i * steps[p], width);
+					}
 				}
 			}
 			break;
@@ -353,6 +351,78 @@ static void xf_process_tsmf_video_frame_event(xfInfo* xfi, RDP_VIDEO_FRAME_EVENT
 
 	XShmDetach(xfi->display, &shminfo);
 	XFree(image);
+
+	return true;
+}
+
+#endif /* WITH_XV */
+
+/**
+ * Convert and scale I420/YV12 frames to the window without Xv.
+ * The image is kept across frames and only reallocated when the output size changes.
+ */
+static void xf_tsmf_sw_video_frame(xfInfo* xfi, RDP_VIDEO_FRAME_EVENT* vevent)
+{
+	int steps[3];
+	uint8* data;
+	uint8* planes[3];
+	xfXvContext* xv = (xfXvContext*) xfi->xv_context;
+
+	if (vevent->frame_pixfmt != RDP_PIXFMT_I420 && vevent->frame_pixfmt != RDP_PIXFMT_YV12)
+	{
+		DEBUG_XV("pixel format 0x%X not supported.", vevent->frame_pixfmt);
+		return;
+	}
+
+	if (xfi->bpp != 32)
+	{
+		DEBUG_XV("software rendering needs a 32bpp visual.");
+		return;
+	}
+
+	if (vevent->width <= 0 || vevent->height <= 0 || !xf_tsmf_get_planes(vevent, planes, steps))
+		return;
+
+	if (xv->sw_image == NULL || xv->sw_image->width != vevent->width || xv->sw_image->height != vevent->height)
+	{
+		if (xv->sw_image)
+		{
+			xfree(xv->sw_image->data);
+			xv->sw_image->data = NULL;
+			XDestroyImage(xv->sw_image);
+		}
+
+		data = (uint8*) xmalloc(vevent->width * vevent->height * 4);
+		xv->sw_image = XCreateImage(xfi->display, xfi->visual, xfi->depth, ZPixmap, 0,
+			(char*) data, vevent->width, vevent->height, xfi->scanline_pad, vevent->width * 4);
+	}
+
+	yuv_decode_yuv420p(xv->yuv_context, (const uint8**) planes, steps, vevent->frame_width, vevent->frame_height,
+		(uint8*) xv->sw_image->data, xv->sw_image->bytes_per_line, vevent->width, vevent->height);
+
+	XSetFunction(xfi->display, xfi->gc, GXcopy);
+	XSetClipRectangles(xfi->display, xfi->gc, vevent->x, vevent->y,
+		(XRectangle*) vevent->visible_rects, vevent->num_visible_rects, YXBanded);
+
+	XPutImage(xfi->display, xfi->window->handle, xfi->gc, xv->sw_image,
+		0, 0, vevent->x, vevent->y, vevent->width, vevent->height);
+
+	XSetClipMask(xfi->display, xfi->gc, None);
+	XFlush(xfi->display);
+}
+
+static void xf_process_tsmf_video_frame_event(xfInfo* xfi, RDP_VIDEO_FRAME_EVENT* vevent)
+{
+	/* In case the player is minimized */
+	if (vevent->x < -2048 || vevent->y < -2048 || vevent->num_visible_rects <= 0)
+		return;
+
+#ifdef WITH_XV
+	if (xf_tsmf_xv_video_frame(xfi, vevent))
+		return;
+#endif
+
+	xf_tsmf_sw_video_frame(xfi, vevent);
 }
 
 static void xf_process_tsmf_redraw_event(xfInfo* xfi, RDP_REDRAW_EVENT* revent)
@@ -378,18 +448,39 @@ void xf_process_tsmf_event(xfInfo* xfi, RDP_EVENT* event)
 	}
 }
 
-#else /* WITH_XV */
-
 void xf_tsmf_init(xfInfo* xfi, long xv_port)
 {
+	xfXvContext* xv;
+
+	xv = xnew(xfXvContext);
+	xfi->xv_context = xv;
+
+	xv->yuv_context = yuv_context_new();
+	yuv_context_set_cpu_opt(xv->yuv_context, xf_detect_cpu());
+
+#ifdef WITH_XV
+	xf_tsmf_xv_init(xfi, xv, xv_port);
+#endif
 }
 
 void xf_tsmf_uninit(xfInfo* xfi)
 {
-}
+	xfXvContext* xv = (xfXvContext*) xfi->xv_context;
 
-void xf_process_tsmf_event(xfInfo* xfi, RDP_EVENT* event)
-{
-}
+	if (xv)
+	{
+#ifdef WITH_XV
+		xf_tsmf_xv_uninit(xfi, xv);
+#endif
+		if (xv->sw_image)
+		{
+			xfree(xv->sw_image->data);
+			xv->sw_image->data = NULL;
+			XDestroyImage(xv->sw_image);
+		}
 
-#endif /* WITH_XV */
+		yuv_context_free(xv->yuv_context);
+		xfree(xv);
+		xfi->xv_context = NULL;
+	}
+}
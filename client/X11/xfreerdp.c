@@ -524,11 +524,11 @@ boolean xf_pre_connect(freerdp* instance)
 	settings->order_support[NEG_FAST_INDEX_INDEX] = true;
 	settings->order_support[NEG_FAST_GLYPH_INDEX] = true;
 
-	settings->order_support[NEG_POLYGON_SC_INDEX] = (settings->sw_gdi) ? false : true;
-	settings->order_support[NEG_POLYGON_CB_INDEX] = (settings->sw_gdi) ? false : true;
+	settings->order_support[NEG_POLYGON_SC_INDEX] = true;
+	settings->order_support[NEG_POLYGON_CB_INDEX] = true;
 
-	settings->order_support[NEG_ELLIPSE_SC_INDEX] = false;
-	settings->order_support[NEG_ELLIPSE_CB_INDEX] = false;
+	settings->order_support[NEG_ELLIPSE_SC_INDEX] = (settings->sw_gdi) ? true : false;
+	settings->order_support[NEG_ELLIPSE_CB_INDEX] = (settings->sw_gdi) ? true : false;
 
 	freerdp_channels_pre_connect(xfi->_context->channels, instance);
 
@@ -705,12 +705,14 @@ boolean xf_post_connect(freerdp* instance)
 		if (instance->settings->rfx_codec)
 		{
 			rfx_context = (void*) rfx_context_new();
+			rfx_context->metrics = instance->context->metrics;
 			xfi->rfx_context = rfx_context;
 		}
 
 		if (instance->settings->ns_codec)
 		{
 			nsc_context = (void*) nsc_context_new();
+			nsc_context->metrics = instance->context->metrics;
 			xfi->nsc_context = nsc_context;
 		}
 	}
@@ -1087,6 +1089,7 @@ int xfreerdp_run(freerdp* instance)
 	fd_set rfds_set;
 	fd_set wfds_set;
 	int select_status;
+	int input_timeout;
 	rdpChannels* channels;
 	struct timeval timeout;
 
@@ -1153,11 +1156,23 @@ int xfreerdp_run(freerdp* instance)
 			break;
 
 		timeout.tv_sec = 5;
+		timeout.tv_usec = 0;
+
+		/* wake up in time to send held back mouse motion */
+		input_timeout = freerdp_input_get_flush_timeout(instance->input);
+
+		if (input_timeout >= 0 && input_timeout < 5000)
+		{
+			timeout.tv_sec = input_timeout / 1000;
+			timeout.tv_usec = (input_timeout % 1000) * 1000;
+		}
+
 		select_status = select(max_fds + 1, &rfds_set, &wfds_set, NULL, &timeout);
 
 		if (select_status == 0)
 		{
 			//freerdp_send_keep_alive(instance);
+			freerdp_input_flush(instance->input);
 			continue;
 		}
 		else if (select_status == -1)
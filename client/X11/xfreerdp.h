@@ -167,6 +167,7 @@ struct xf_info
 
 void xf_toggle_fullscreen(xfInfo* xfi);
 boolean xf_post_connect(freerdp* instance);
+uint32 xf_detect_cpu();
 
 enum XF_EXIT_CODE
 {
@@ -0,0 +1,393 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Headless Session Replay
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Replays a session recorded with --record through the update parsers and
+ * the software gdi as fast as possible, then reports the frame rate, the
+ * time spent in each stage of the pipeline, the latency histograms of the
+ * session metrics and the peak memory usage.
+ *
+ * freerdp-replay [-n loops] [-b 16|32] file
+ */
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/record.h>
+
+enum RP_STAGE
+{
+	RP_STAGE_READ,
+	RP_STAGE_PARSE,
+	RP_STAGE_PRIMARY,
+	RP_STAGE_SECONDARY,
+	RP_STAGE_ALTSEC,
+	RP_STAGE_BITMAP,
+	RP_STAGE_SURFACE,
+	RP_STAGE_PAINT,
+	RP_STAGE_COUNT
+};
+
+static const char* const RP_STAGE_NAMES[] =
+{
+	"read",
+	"parse",
+	"primary orders",
+	"secondary orders",
+	"altsec orders",
+	"bitmap updates",
+	"surface bits",
+	"paint"
+};
+
+struct rp_stage
+{
+	uint64 time;
+	uint32 calls;
+};
+typedef struct rp_stage rpStage;
+
+struct rp_context
+{
+	rdpContext _p;
+
+	uint32 frames;
+	uint64 callback_time;
+	rpStage stages[RP_STAGE_COUNT];
+
+	/* gdi callbacks */
+	rdpUpdate update;
+	rdpPrimaryUpdate primary;
+	rdpSecondaryUpdate secondary;
+	rdpAltSecUpdate altsec;
+};
+typedef struct rp_context rpContext;
+
+static uint64 rp_get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static void rp_add_time(rpContext* rpc, int stage, uint64 start)
+{
+	uint64 elapsed = rp_get_time() - start;
+
+	rpc->stages[stage].time += elapsed;
+	rpc->stages[stage].calls++;
+
+	if (stage != RP_STAGE_READ && stage != RP_STAGE_PARSE)
+		rpc->callback_time += elapsed;
+}
+
+#define RP_PROXY(_name, _type, _callbacks, _field, _stage) \
+	static void rp_##_name(rdpContext* context, _type* arg) \
+	{ \
+		uint64 start; \
+		rpContext* rpc = (rpContext*) context; \
+		start = rp_get_time(); \
+		rpc->_callbacks._field(context, arg); \
+		rp_add_time(rpc, _stage, start); \
+	}
+
+RP_PROXY(bitmap_update, BITMAP_UPDATE, update, BitmapUpdate, RP_STAGE_BITMAP)
+RP_PROXY(palette, PALETTE_UPDATE, update, Palette, RP_STAGE_BITMAP)
+RP_PROXY(surface_bits, SURFACE_BITS_COMMAND, update, SurfaceBits, RP_STAGE_SURFACE)
+
+RP_PROXY(dstblt, DSTBLT_ORDER, primary, DstBlt, RP_STAGE_PRIMARY)
+RP_PROXY(patblt, PATBLT_ORDER, primary, PatBlt, RP_STAGE_PRIMARY)
+RP_PROXY(scrblt, SCRBLT_ORDER, primary, ScrBlt, RP_STAGE_PRIMARY)
+RP_PROXY(opaque_rect, OPAQUE_RECT_ORDER, primary, OpaqueRect, RP_STAGE_PRIMARY)
+RP_PROXY(multi_opaque_rect, MULTI_OPAQUE_RECT_ORDER, primary, MultiOpaqueRect, RP_STAGE_PRIMARY)
+RP_PROXY(line_to, LINE_TO_ORDER, primary, LineTo, RP_STAGE_PRIMARY)
+RP_PROXY(polyline, POLYLINE_ORDER, primary, Polyline, RP_STAGE_PRIMARY)
+RP_PROXY(memblt, MEMBLT_ORDER, primary, MemBlt, RP_STAGE_PRIMARY)
+RP_PROXY(mem3blt, MEM3BLT_ORDER, primary, Mem3Blt, RP_STAGE_PRIMARY)
+RP_PROXY(glyph_index, GLYPH_INDEX_ORDER, primary, GlyphIndex, RP_STAGE_PRIMARY)
+RP_PROXY(fast_index, FAST_INDEX_ORDER, primary, FastIndex, RP_STAGE_PRIMARY)
+RP_PROXY(fast_glyph, FAST_GLYPH_ORDER, primary, FastGlyph, RP_STAGE_PRIMARY)
+RP_PROXY(polygon_sc, POLYGON_SC_ORDER, primary, PolygonSC, RP_STAGE_PRIMARY)
+RP_PROXY(polygon_cb, POLYGON_CB_ORDER, primary, PolygonCB, RP_STAGE_PRIMARY)
+RP_PROXY(ellipse_sc, ELLIPSE_SC_ORDER, primary, EllipseSC, RP_STAGE_PRIMARY)
+RP_PROXY(ellipse_cb, ELLIPSE_CB_ORDER, primary, EllipseCB, RP_STAGE_PRIMARY)
+
+RP_PROXY(cache_bitmap, CACHE_BITMAP_ORDER, secondary, CacheBitmap, RP_STAGE_SECONDARY)
+RP_PROXY(cache_bitmap_v2, CACHE_BITMAP_V2_ORDER, secondary, CacheBitmapV2, RP_STAGE_SECONDARY)
+RP_PROXY(cache_bitmap_v3, CACHE_BITMAP_V3_ORDER, secondary, CacheBitmapV3, RP_STAGE_SECONDARY)
+RP_PROXY(cache_color_table, CACHE_COLOR_TABLE_ORDER, secondary, CacheColorTable, RP_STAGE_SECONDARY)
+RP_PROXY(cache_glyph, CACHE_GLYPH_ORDER, secondary, CacheGlyph, RP_STAGE_SECONDARY)
+RP_PROXY(cache_glyph_v2, CACHE_GLYPH_V2_ORDER, secondary, CacheGlyphV2, RP_STAGE_SECONDARY)
+RP_PROXY(cache_brush, CACHE_BRUSH_ORDER, secondary, CacheBrush, RP_STAGE_SECONDARY)
+
+RP_PROXY(create_offscreen_bitmap, CREATE_OFFSCREEN_BITMAP_ORDER, altsec, CreateOffscreenBitmap, RP_STAGE_ALTSEC)
+RP_PROXY(switch_surface, SWITCH_SURFACE_ORDER, altsec, SwitchSurface, RP_STAGE_ALTSEC)
+
+#define RP_HOOK(_live, _name, _field) \
+	if ((_live)->_field != NULL) \
+		(_live)->_field = rp_##_name
+
+static void rp_hook_callbacks(rpContext* rpc, rdpUpdate* update)
+{
+	rdpPrimaryUpdate* primary = update->primary;
+	rdpSecondaryUpdate* secondary = update->secondary;
+	rdpAltSecUpdate* altsec = update->altsec;
+
+	memcpy(&rpc->update, update, sizeof(rdpUpdate));
+	memcpy(&rpc->primary, primary, sizeof(rdpPrimaryUpdate));
+	memcpy(&rpc->secondary, secondary, sizeof(rdpSecondaryUpdate));
+	memcpy(&rpc->altsec, altsec, sizeof(rdpAltSecUpdate));
+
+	RP_HOOK(update, bitmap_update, BitmapUpdate);
+	RP_HOOK(update, palette, Palette);
+	RP_HOOK(update, surface_bits, SurfaceBits);
+
+	RP_HOOK(primary, dstblt, DstBlt);
+	RP_HOOK(primary, patblt, PatBlt);
+	RP_HOOK(primary, scrblt, ScrBlt);
+	RP_HOOK(primary, opaque_rect, OpaqueRect);
+	RP_HOOK(primary, multi_opaque_rect, MultiOpaqueRect);
+	RP_HOOK(primary, line_to, LineTo);
+	RP_HOOK(primary, polyline, Polyline);
+	RP_HOOK(primary, memblt, MemBlt);
+	RP_HOOK(primary, mem3blt, Mem3Blt);
+	RP_HOOK(primary, glyph_index, GlyphIndex);
+	RP_HOOK(primary, fast_index, FastIndex);
+	RP_HOOK(primary, fast_glyph, FastGlyph);
+	RP_HOOK(primary, polygon_sc, PolygonSC);
+	RP_HOOK(primary, polygon_cb, PolygonCB);
+	RP_HOOK(primary, ellipse_sc, EllipseSC);
+	RP_HOOK(primary, ellipse_cb, EllipseCB);
+
+	RP_HOOK(secondary, cache_bitmap, CacheBitmap);
+	RP_HOOK(secondary, cache_bitmap_v2, CacheBitmapV2);
+	RP_HOOK(secondary, cache_bitmap_v3, CacheBitmapV3);
+	RP_HOOK(secondary, cache_color_table, CacheColorTable);
+	RP_HOOK(secondary, cache_glyph, CacheGlyph);
+	RP_HOOK(secondary, cache_glyph_v2, CacheGlyphV2);
+	RP_HOOK(secondary, cache_brush, CacheBrush);
+
+	RP_HOOK(altsec, create_offscreen_bitmap, CreateOffscreenBitmap);
+	RP_HOOK(altsec, switch_surface, SwitchSurface);
+}
+
+static void rp_begin_paint(rdpContext* context)
+{
+	uint64 start;
+	rdpGdi* gdi = context->gdi;
+	rpContext* rpc = (rpContext*) context;
+
+	start = rp_get_time();
+	gdi->primary->hdc->hwnd->invalid->null = 1;
+	rp_add_time(rpc, RP_STAGE_PAINT, start);
+}
+
+static void rp_end_paint(rdpContext* context)
+{
+	rpContext* rpc = (rpContext*) context;
+
+	rpc->frames++;
+}
+
+static void rp_desktop_resize(rdpContext* context)
+{
+	rdpSettings* settings = context->instance->settings;
+
+	gdi_resize(context->gdi, settings->width, settings->height);
+}
+
+static void rp_print_usage(const char* name)
+{
+	printf("Usage: %s [-n loops] [-b 16|32] file\n"
+		"  -n: replay the recording n times, default is 1\n"
+		"  -b: bits per pixel of the gdi buffer, default is 32\n", name);
+}
+
+static void rp_print_report(rpContext* rpc, rdpRecord* record, int loops, uint64 elapsed)
+{
+	int i;
+	double seconds;
+	double duration;
+	long peak_kb;
+	uint64 total = 0;
+	struct rusage usage;
+	METRICS_SNAPSHOT snapshot;
+	METRICS_HISTOGRAM_VALUE* histogram;
+	rdpSettings* settings = rpc->_p.instance->settings;
+
+	seconds = (elapsed > 0) ? elapsed / 1000000.0 : 1e-6;
+	duration = (record->count > 0) ? record->index[record->count - 1].timestamp / 1000000.0 : 0;
+
+	for (i = 0; i < RP_STAGE_COUNT; i++)
+		total += rpc->stages[i].time;
+
+	printf("%s: %dx%dx%d, %u records, %.1f MB, %.1f s recorded\n",
+		record->name, settings->width, settings->height, settings->color_depth,
+		record->count, record->data_end / (1024.0 * 1024.0), duration);
+
+	printf("replayed %d time(s) in %.3f s: %u frames, %.1f frames/s, %.1fx real time\n",
+		loops, seconds, rpc->frames, rpc->frames / seconds,
+		(duration * loops) / seconds);
+
+	printf("\n%-18s %12s %7s %10s\n", "stage", "time (ms)", "share", "calls");
+
+	for (i = 0; i < RP_STAGE_COUNT; i++)
+	{
+		printf("%-18s %12.3f %6.1f%% %10u\n", RP_STAGE_NAMES[i],
+			rpc->stages[i].time / 1000.0,
+			(total > 0) ? (rpc->stages[i].time * 100.0) / total : 0,
+			rpc->stages[i].calls);
+	}
+
+	freerdp_get_metrics(rpc->_p.instance, &snapshot);
+
+	printf("\n%-18s %10s %10s %10s %10s %10s\n", "metric (us)", "count", "mean", "p50", "p99", "max");
+
+	for (i = 0; i < METRICS_HISTOGRAM_COUNT; i++)
+	{
+		histogram = &snapshot.histograms[i];
+
+		if (histogram->count == 0)
+			continue;
+
+		printf("%-18s %10llu %10llu %10llu %10llu %10llu\n", metrics_histogram_name(i),
+			(unsigned long long) histogram->count,
+			(unsigned long long) (histogram->sum / histogram->count),
+			(unsigned long long) metrics_histogram_percentile(histogram, 50),
+			(unsigned long long) metrics_histogram_percentile(histogram, 99),
+			(unsigned long long) histogram->max);
+	}
+
+	getrusage(RUSAGE_SELF, &usage);
+	peak_kb = usage.ru_maxrss;
+#ifdef __APPLE__
+	peak_kb /= 1024; /* bytes on Mac OS X */
+#endif
+
+	printf("\npeak memory: %.1f MB\n", peak_kb / 1024.0);
+}
+
+int main(int argc, char* argv[])
+{
+	int i;
+	int loops = 1;
+	int bpp = 32;
+	uint64 start;
+	uint64 elapsed;
+	uint64 dispatch;
+	char* file = NULL;
+	boolean status = true;
+	freerdp* instance;
+	rpContext* rpc;
+	rdpRecord* record;
+	RECORD_ENTRY entry;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			loops = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+			bpp = atoi(argv[++i]);
+		else if (argv[i][0] != '-' && file == NULL)
+			file = argv[i];
+		else
+			break;
+	}
+
+	if (i < argc || file == NULL || loops < 1 || (bpp != 16 && bpp != 32))
+	{
+		rp_print_usage(argv[0]);
+		return 1;
+	}
+
+	record = record_open(file, false);
+
+	if (record == NULL)
+		return 1;
+
+	if (!record_read(record, &entry) || entry.type != RECORD_TYPE_DESKTOP)
+	{
+		printf("%s does not start with a desktop record\n", file);
+		record_close(record);
+		return 1;
+	}
+
+	instance = freerdp_new();
+	instance->context_size = sizeof(rpContext);
+	freerdp_context_new(instance);
+	rpc = (rpContext*) instance->context;
+
+	freerdp_replay_record(instance, &entry);
+
+	gdi_init(instance, CLRCONV_ALPHA | ((bpp == 16) ? CLRBUF_16BPP : CLRBUF_32BPP), NULL);
+
+	instance->update->BeginPaint = rp_begin_paint;
+	instance->update->EndPaint = rp_end_paint;
+	instance->update->DesktopResize = rp_desktop_resize;
+	rp_hook_callbacks(rpc, instance->update);
+
+	start = rp_get_time();
+
+	for (i = 0; i < loops && status; i++)
+	{
+		record_seek(record, 0);
+
+		while (status)
+		{
+			dispatch = rp_get_time();
+
+			if (!record_read(record, &entry))
+				break;
+
+			rp_add_time(rpc, RP_STAGE_READ, dispatch);
+
+			rpc->callback_time = 0;
+			dispatch = rp_get_time();
+
+			if (!freerdp_replay_record(instance, &entry))
+			{
+				printf("failed to replay record %u (type 0x%02X, id 0x%02X)\n",
+					record->position - 1, entry.type, entry.id);
+				status = false;
+			}
+
+			elapsed = rp_get_time() - dispatch;
+			elapsed = (elapsed > rpc->callback_time) ? elapsed - rpc->callback_time : 0;
+			rpc->stages[RP_STAGE_PARSE].time += elapsed;
+			rpc->stages[RP_STAGE_PARSE].calls++;
+		}
+	}
+
+	elapsed = rp_get_time() - start;
+
+	rp_print_report(rpc, record, loops, elapsed);
+
+	gdi_free(instance);
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+	record_close(record);
+
+	return status ? 0 : 1;
+}
@@ -319,6 +319,9 @@ int main(int argc, char* argv[])
 	instance->ContextFree = tf_context_free;
 	freerdp_context_new(instance);
 
+	/* the paint callbacks only touch the gdi, the main thread never does */
+	instance->settings->async_update_safe = true;
+
 	channels = instance->context->channels;
 	freerdp_parse_args(instance->settings, argc, argv, tf_process_plugin_args, channels, NULL, NULL);
 
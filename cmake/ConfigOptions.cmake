@@ -2,6 +2,7 @@
 option(WITH_MANPAGES "Generate manpages." ON)
 option(WITH_NEON "Enable NEON optimization for rfx decoder" OFF)
 option(WITH_PROFILER "Compile profiler." OFF)
+option(WITH_BENCHMARKS "Build codec and gdi microbenchmarks." OFF)
 option(WITH_SSE2_TARGET "Allow compiler to generate SSE2 instructions." OFF)
 option(WITH_SSE2 "Use SSE2 optimization." OFF)
 option(WITH_JPEG "Use JPEG decoding." OFF)
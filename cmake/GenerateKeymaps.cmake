@@ -0,0 +1,140 @@
+# FreeRDP: A Remote Desktop Protocol Client
+# Compiles the text keymaps into C arrays
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Usage: cmake -DKEYMAP_DIR=<keymaps> -DVK_HEADER=<virtual_key_codes.h> -DOUTPUT=<file.c> -P GenerateKeymaps.cmake
+#
+# Every keyboard of every keymap file becomes a table indexed by X11 keycode,
+# with the maps it extends already applied. The tables are listed by
+# "file(keyboard)" name in sorted order, for freerdp_keyboard_load_map().
+
+# virtual key code names known to the library, others map to 0 like at runtime
+file(STRINGS ${VK_HEADER} VK_DEFINES REGEX "^#define VK_[A-Z0-9_]+")
+set(VK_NAMES)
+foreach(VK_DEFINE ${VK_DEFINES})
+	string(REGEX REPLACE "^#define (VK_[A-Z0-9_]+).*$" "\\1" VK_NAME "${VK_DEFINE}")
+	list(APPEND VK_NAMES ${VK_NAME})
+endforeach()
+
+file(GLOB_RECURSE KEYMAP_FILES RELATIVE ${KEYMAP_DIR} ${KEYMAP_DIR}/*)
+list(REMOVE_ITEM KEYMAP_FILES CMakeLists.txt)
+list(SORT KEYMAP_FILES)
+
+# C identifier for a "file(keyboard)" name
+macro(keymap_id NAME ID)
+	string(REGEX REPLACE "[^A-Za-z0-9_]+" "_" ${ID} "${NAME}")
+	string(REGEX REPLACE "_$" "" ${ID} "${${ID}}")
+endmacro()
+
+# parse every keyboard block into a list of operations: "<keycode>=<name>" or "@<included map>"
+set(KEYMAP_NAMES)
+foreach(KEYMAP_FILE ${KEYMAP_FILES})
+	file(STRINGS ${KEYMAP_DIR}/${KEYMAP_FILE} KEYMAP_LINES REGEX "^(keyboard \"|: extends \"|[ \t]*VK_)")
+	set(KEYMAP_ID)
+
+	foreach(KEYMAP_LINE ${KEYMAP_LINES})
+		if(KEYMAP_LINE MATCHES "^keyboard \"([^\"]+)\"")
+			set(KEYMAP_NAME "${KEYMAP_FILE}(${CMAKE_MATCH_1})")
+			keymap_id("${KEYMAP_NAME}" KEYMAP_ID)
+
+			# the first keyboard of a name wins, like in the text parser
+			list(FIND KEYMAP_NAMES "${KEYMAP_NAME}" KEYMAP_INDEX)
+			if(KEYMAP_INDEX EQUAL -1)
+				list(APPEND KEYMAP_NAMES "${KEYMAP_NAME}")
+				set(KEYMAP_OPS_${KEYMAP_ID})
+			else()
+				set(KEYMAP_ID)
+			endif()
+		elseif(NOT KEYMAP_ID)
+		elseif(KEYMAP_LINE MATCHES "^: extends \"([^\"(]+)\\(([^\")]+)\\)\"")
+			list(APPEND KEYMAP_OPS_${KEYMAP_ID} "@${CMAKE_MATCH_1}(${CMAKE_MATCH_2})")
+		elseif(KEYMAP_LINE MATCHES "^: extends \"([^\"]+)\"")
+			list(APPEND KEYMAP_OPS_${KEYMAP_ID} "@${CMAKE_MATCH_1}(${CMAKE_MATCH_1})")
+		elseif(KEYMAP_LINE MATCHES "^[ \t]*(VK_[A-Z0-9_]+)[ \t]+<([0-9]+)>")
+			if(CMAKE_MATCH_2 LESS 256)
+				list(APPEND KEYMAP_OPS_${KEYMAP_ID} "${CMAKE_MATCH_2}=${CMAKE_MATCH_1}")
+			endif()
+		endif()
+	endforeach()
+endforeach()
+
+# operations of a map with those of the maps it extends expanded in place
+function(keymap_flatten NAME RESULT)
+	set(OPS)
+	keymap_id("${NAME}" ID)
+	list(FIND KEYMAP_NAMES "${NAME}" INDEX)
+
+	if(INDEX EQUAL -1)
+		message(WARNING "keymap ${NAME} not found")
+	endif()
+
+	foreach(OP ${KEYMAP_OPS_${ID}})
+		if(OP MATCHES "^@(.*)$")
+			keymap_flatten("${CMAKE_MATCH_1}" INCLUDED_OPS)
+			list(APPEND OPS ${INCLUDED_OPS})
+		else()
+			list(APPEND OPS ${OP})
+		endif()
+	endforeach()
+
+	set(${RESULT} ${OPS} PARENT_SCOPE)
+endfunction()
+
+list(SORT KEYMAP_NAMES)
+
+set(CODE "/* Generated from the keymaps directory by cmake/GenerateKeymaps.cmake, do not edit */\n\n")
+set(CODE "${CODE}#include <freerdp/locale/virtual_key_codes.h>\n\n#include \"keyboard_keymap.h\"\n")
+set(TABLE)
+
+foreach(KEYMAP_NAME ${KEYMAP_NAMES})
+	keymap_id("${KEYMAP_NAME}" KEYMAP_ID)
+	keymap_flatten("${KEYMAP_NAME}" OPS)
+
+	foreach(KEYCODE RANGE 255)
+		set(KEYCODE_${KEYCODE} 0)
+	endforeach()
+
+	foreach(OP ${OPS})
+		string(REGEX REPLACE "^([0-9]+)=(.*)$" "\\1" KEYCODE "${OP}")
+		string(REGEX REPLACE "^([0-9]+)=(.*)$" "\\2" VK_NAME "${OP}")
+
+		list(FIND VK_NAMES ${VK_NAME} VK_INDEX)
+		if(VK_INDEX EQUAL -1)
+			set(KEYCODE_${KEYCODE} 0)
+		else()
+			set(KEYCODE_${KEYCODE} ${VK_NAME})
+		endif()
+	endforeach()
+
+	set(CODE "${CODE}\n/* ${KEYMAP_NAME} */\nstatic const uint8 keymap_${KEYMAP_ID}[256] =\n{")
+
+	foreach(KEYCODE RANGE 255)
+		math(EXPR COLUMN "${KEYCODE} % 8")
+		if(COLUMN EQUAL 0)
+			set(CODE "${CODE}\n\t")
+		else()
+			set(CODE "${CODE} ")
+		endif()
+		set(CODE "${CODE}${KEYCODE_${KEYCODE}},")
+	endforeach()
+
+	set(CODE "${CODE}\n};\n")
+	set(TABLE "${TABLE}\t{ \"${KEYMAP_NAME}\", keymap_${KEYMAP_ID} },\n")
+endforeach()
+
+list(LENGTH KEYMAP_NAMES KEYMAP_COUNT)
+set(CODE "${CODE}\nconst FREERDP_KEYMAP FREERDP_COMPILED_KEYMAPS[] =\n{\n${TABLE}};\n\n")
+set(CODE "${CODE}const int FREERDP_COMPILED_KEYMAP_COUNT = ${KEYMAP_COUNT};\n")
+
+file(WRITE ${OUTPUT} "${CODE}")
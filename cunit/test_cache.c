@@ -0,0 +1,666 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Cache Unit Tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/peer.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/cache/bitmap_server.h>
+#include <freerdp/cache/glyph_server.h>
+
+#include "test_cache.h"
+
+#define MAX_TEST_ORDERS		16
+
+static rdpContext* context;
+static freerdp_peer* client;
+
+static int memblt_count;
+static MEMBLT_ORDER memblt_orders[MAX_TEST_ORDERS];
+static int cache_bitmap_v2_count;
+static CACHE_BITMAP_V2_ORDER cache_bitmap_v2_orders[MAX_TEST_ORDERS];
+static uint8 cache_bitmap_v2_data[4096];
+static int glyph_index_count;
+static GLYPH_INDEX_ORDER glyph_index_orders[MAX_TEST_ORDERS];
+static int cache_glyph_count;
+static int cache_glyph_v2_count;
+static uint32 cache_glyph_ids[MAX_TEST_ORDERS];
+static uint32 cache_glyph_counts[MAX_TEST_ORDERS];
+static GLYPH_DATA cache_glyph_data[MAX_TEST_ORDERS];
+
+static void test_memblt(rdpContext* context, MEMBLT_ORDER* memblt)
+{
+	if (memblt_count < MAX_TEST_ORDERS)
+		memblt_orders[memblt_count] = *memblt;
+
+	memblt_count++;
+}
+
+static void test_cache_bitmap_v2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cache_bitmap_v2)
+{
+	if (cache_bitmap_v2_count < MAX_TEST_ORDERS)
+		cache_bitmap_v2_orders[cache_bitmap_v2_count] = *cache_bitmap_v2;
+
+	if (cache_bitmap_v2->bitmapLength <= sizeof(cache_bitmap_v2_data))
+		memcpy(cache_bitmap_v2_data, cache_bitmap_v2->bitmapDataStream, cache_bitmap_v2->bitmapLength);
+
+	cache_bitmap_v2_count++;
+}
+
+static void test_glyph_index(rdpContext* context, GLYPH_INDEX_ORDER* glyph_index)
+{
+	if (glyph_index_count < MAX_TEST_ORDERS)
+		glyph_index_orders[glyph_index_count] = *glyph_index;
+
+	glyph_index_count++;
+}
+
+/* keeps the id and the number of glyphs of every order, the first glyph without its bits */
+static void test_cache_glyph(rdpContext* context, CACHE_GLYPH_ORDER* cache_glyph)
+{
+	int count = cache_glyph_count + cache_glyph_v2_count;
+
+	if (count < MAX_TEST_ORDERS)
+	{
+		cache_glyph_ids[count] = cache_glyph->cacheId;
+		cache_glyph_counts[count] = cache_glyph->cGlyphs;
+		cache_glyph_data[count] = *cache_glyph->glyphData[0];
+		cache_glyph_data[count].aj = NULL;
+	}
+
+	cache_glyph_count++;
+}
+
+static void test_cache_glyph_v2(rdpContext* context, CACHE_GLYPH_V2_ORDER* cache_glyph_v2)
+{
+	int count = cache_glyph_count + cache_glyph_v2_count;
+
+	if (count < MAX_TEST_ORDERS)
+	{
+		cache_glyph_ids[count] = cache_glyph_v2->cacheId;
+		cache_glyph_counts[count] = cache_glyph_v2->cGlyphs;
+		cache_glyph_data[count].cacheIndex = cache_glyph_v2->glyphData[0]->cacheIndex;
+		cache_glyph_data[count].x = cache_glyph_v2->glyphData[0]->x;
+		cache_glyph_data[count].y = cache_glyph_v2->glyphData[0]->y;
+		cache_glyph_data[count].cx = cache_glyph_v2->glyphData[0]->cx;
+		cache_glyph_data[count].cy = cache_glyph_v2->glyphData[0]->cy;
+		cache_glyph_data[count].cb = cache_glyph_v2->glyphData[0]->cb;
+		cache_glyph_data[count].aj = NULL;
+	}
+
+	cache_glyph_v2_count++;
+}
+
+static void test_orders_reset(void)
+{
+	memblt_count = 0;
+	cache_bitmap_v2_count = 0;
+	glyph_index_count = 0;
+	cache_glyph_count = 0;
+	cache_glyph_v2_count = 0;
+}
+
+/* the client advertises three cells with the given number of entries */
+static void test_settings_cells(int cell0, int cell1, int cell2)
+{
+	rdpSettings* settings = client->settings;
+
+	settings->bitmapCacheV2NumCells = 3;
+	settings->bitmapCacheV2CellInfo[0].numEntries = cell0;
+	settings->bitmapCacheV2CellInfo[1].numEntries = cell1;
+	settings->bitmapCacheV2CellInfo[2].numEntries = cell2;
+}
+
+static void test_fill(uint8* data, int length, uint8 value)
+{
+	int i;
+
+	for (i = 0; i < length; i++)
+		data[i] = value + i;
+}
+
+/* the client advertises the given glyph support level and a single glyph cache */
+static void test_settings_glyphs(uint32 level, int entries, int size)
+{
+	int i;
+	rdpSettings* settings = client->settings;
+
+	settings->glyphSupportLevel = level;
+
+	for (i = 0; i < 10; i++)
+	{
+		settings->glyphCache[i].cacheEntries = (i == 0) ? entries : 0;
+		settings->glyphCache[i].cacheMaximumCellSize = (i == 0) ? size : 0;
+	}
+
+	settings->fragCache->cacheEntries = 256;
+	settings->fragCache->cacheMaximumCellSize = 256;
+}
+
+/* glyphs of 8x8 pixels, 8 pixels apart */
+static void test_glyphs(GLYPH_SERVER_GLYPH* glyphs, uint8 bits[][8], const char* text)
+{
+	int i;
+
+	for (i = 0; text[i] != '\0'; i++)
+	{
+		glyphs[i].x = 0;
+		glyphs[i].y = -8;
+		glyphs[i].cx = 8;
+		glyphs[i].cy = 8;
+		glyphs[i].aj = bits[text[i] - 'a'];
+		glyphs[i].advance = 8;
+	}
+}
+
+int init_cache_suite(void)
+{
+	rdpSettings* settings;
+
+	settings = xnew(rdpSettings);
+	settings->server_mode = true;
+	settings->color_depth = 32;
+	settings->order_support = (uint8*) xzalloc(32);
+	settings->order_support[NEG_MEMBLT_INDEX] = true;
+	settings->bitmapCacheV2CellInfo = (BITMAP_CACHE_V2_CELL_INFO*) xzalloc(sizeof(BITMAP_CACHE_V2_CELL_INFO) * 6);
+	settings->order_support[NEG_GLYPH_INDEX_INDEX] = true;
+	settings->glyphCache = (GLYPH_CACHE_DEFINITION*) xzalloc(sizeof(GLYPH_CACHE_DEFINITION) * 10);
+	settings->fragCache = xnew(GLYPH_CACHE_DEFINITION);
+
+	client = xnew(freerdp_peer);
+	client->settings = settings;
+	client->update = xnew(rdpUpdate);
+	client->update->primary = xnew(rdpPrimaryUpdate);
+	client->update->secondary = xnew(rdpSecondaryUpdate);
+	client->update->primary->MemBlt = test_memblt;
+	client->update->secondary->CacheBitmapV2 = test_cache_bitmap_v2;
+	client->update->primary->GlyphIndex = test_glyph_index;
+	client->update->secondary->CacheGlyph = test_cache_glyph;
+	client->update->secondary->CacheGlyphV2 = test_cache_glyph_v2;
+
+	context = xnew(rdpContext);
+	context->peer = client;
+	client->context = context;
+
+	return 0;
+}
+
+int clean_cache_suite(void)
+{
+	xfree(client->update->primary);
+	xfree(client->update->secondary);
+	xfree(client->update);
+	xfree(client->settings->order_support);
+	xfree(client->settings->bitmapCacheV2CellInfo);
+	xfree(client->settings->glyphCache);
+	xfree(client->settings->fragCache);
+	xfree(client->settings);
+	xfree(client);
+	xfree(context);
+	return 0;
+}
+
+int add_cache_suite(void)
+{
+	add_test_suite(cache);
+
+	add_test_function(bitmap_cache_server_send);
+	add_test_function(bitmap_cache_server_lru);
+	add_test_function(bitmap_cache_server_padding);
+	add_test_function(bitmap_cache_server_disabled);
+	add_test_function(glyph_cache_server_send);
+	add_test_function(glyph_cache_server_lru);
+	add_test_function(glyph_cache_server_delta);
+	add_test_function(glyph_cache_server_disabled);
+	add_test_function(glyph_cache_server_large);
+
+	return 0;
+}
+
+void test_bitmap_cache_server_send(void)
+{
+	int y;
+	uint8* data;
+	rdpBitmapCacheServer* bitmap_cache;
+
+	test_settings_cells(600, 600, 2048);
+	bitmap_cache = bitmap_cache_server_new(context);
+
+	CU_ASSERT(bitmap_cache->tileSize == 64);
+
+	/* two identical 64x64 blocks side by side */
+	data = (uint8*) xmalloc(128 * 64 * 4);
+
+	for (y = 0; y < 64; y++)
+	{
+		test_fill(&data[y * 128 * 4], 64 * 4, y);
+		test_fill(&data[y * 128 * 4 + 64 * 4], 64 * 4, y);
+	}
+
+	test_orders_reset();
+	CU_ASSERT(bitmap_cache_server_send(bitmap_cache, data, 100, 200, 128, 64, 128 * 4) == true);
+
+	CU_ASSERT(cache_bitmap_v2_count == 1);
+	CU_ASSERT(cache_bitmap_v2_orders[0].cacheId == 2);
+	CU_ASSERT(cache_bitmap_v2_orders[0].bitmapWidth == 64);
+	CU_ASSERT(cache_bitmap_v2_orders[0].bitmapHeight == 64);
+	CU_ASSERT(cache_bitmap_v2_orders[0].bitmapBpp == 32);
+	CU_ASSERT(cache_bitmap_v2_orders[0].bitmapLength == 64 * 64 * 4);
+
+	CU_ASSERT(memblt_count == 2);
+	CU_ASSERT(memblt_orders[0].nLeftRect == 100);
+	CU_ASSERT(memblt_orders[0].nTopRect == 200);
+	CU_ASSERT(memblt_orders[1].nLeftRect == 164);
+	CU_ASSERT(memblt_orders[1].nTopRect == 200);
+	CU_ASSERT(memblt_orders[1].nWidth == 64);
+	CU_ASSERT(memblt_orders[1].nHeight == 64);
+	CU_ASSERT(memblt_orders[1].bRop == 0xCC);
+	CU_ASSERT(memblt_orders[0].cacheId == 2);
+	CU_ASSERT(memblt_orders[1].cacheId == 2);
+	CU_ASSERT(memblt_orders[0].cacheIndex == cache_bitmap_v2_orders[0].cacheIndex);
+	CU_ASSERT(memblt_orders[1].cacheIndex == cache_bitmap_v2_orders[0].cacheIndex);
+
+	/* the same area again only needs the MemBlts */
+	test_orders_reset();
+	bitmap_cache_server_send(bitmap_cache, data, 0, 0, 128, 64, 128 * 4);
+
+	CU_ASSERT(cache_bitmap_v2_count == 0);
+	CU_ASSERT(memblt_count == 2);
+
+	/* a changed pixel makes it a different bitmap */
+	data[64 * 4] ^= 0xFF;
+
+	test_orders_reset();
+	bitmap_cache_server_send(bitmap_cache, data, 0, 0, 128, 64, 128 * 4);
+
+	CU_ASSERT(cache_bitmap_v2_count == 1);
+	CU_ASSERT(memblt_count == 2);
+	CU_ASSERT(memblt_orders[0].cacheIndex != memblt_orders[1].cacheIndex);
+
+	xfree(data);
+	bitmap_cache_server_free(bitmap_cache);
+}
+
+void test_bitmap_cache_server_lru(void)
+{
+	int i;
+	uint32 indices[3];
+	uint8 blocks[4][16 * 16 * 4];
+	rdpBitmapCacheServer* bitmap_cache;
+
+	/* a single cell of two entries, blocks of 16x16 pixels */
+	test_settings_cells(2, 0, 0);
+	bitmap_cache = bitmap_cache_server_new(context);
+
+	CU_ASSERT(bitmap_cache->tileSize == 16);
+
+	for (i = 0; i < 4; i++)
+		test_fill(blocks[i], sizeof(blocks[i]), i * 16);
+
+	/* A and B fill the cell */
+	test_orders_reset();
+	bitmap_cache_server_send(bitmap_cache, blocks[0], 0, 0, 16, 16, 16 * 4);
+	bitmap_cache_server_send(bitmap_cache, blocks[1], 0, 0, 16, 16, 16 * 4);
+	CU_ASSERT(cache_bitmap_v2_count == 2);
+	indices[0] = cache_bitmap_v2_orders[0].cacheIndex;
+	indices[1] = cache_bitmap_v2_orders[1].cacheIndex;
+	CU_ASSERT(indices[0] != indices[1]);
+
+	/* using A again leaves B as the least recently used entry */
+	test_orders_reset();
+	bitmap_cache_server_send(bitmap_cache, blocks[0], 0, 0, 16, 16, 16 * 4);
+	CU_ASSERT(cache_bitmap_v2_count == 0);
+	CU_ASSERT(memblt_orders[0].cacheIndex == indices[0]);
+
+	/* C replaces B */
+	test_orders_reset();
+	bitmap_cache_server_send(bitmap_cache, blocks[2], 0, 0, 16, 16, 16 * 4);
+	CU_ASSERT(cache_bitmap_v2_count == 1);
+	CU_ASSERT(cache_bitmap_v2_orders[0].cacheIndex == indices[1]);
+	indices[2] = indices[1];
+
+	/* A is still cached */
+	test_orders_reset();
+	bitmap_cache_server_send(bitmap_cache, blocks[0], 0, 0, 16, 16, 16 * 4);
+	CU_ASSERT(cache_bitmap_v2_count == 0);
+
+	/* B comes back in place of C, which A was used after */
+	test_orders_reset();
+	bitmap_cache_server_send(bitmap_cache, blocks[1], 0, 0, 16, 16, 16 * 4);
+	CU_ASSERT(cache_bitmap_v2_count == 1);
+	CU_ASSERT(cache_bitmap_v2_orders[0].cacheIndex == indices[2]);
+
+	test_orders_reset();
+	bitmap_cache_server_send(bitmap_cache, blocks[0], 0, 0, 16, 16, 16 * 4);
+	bitmap_cache_server_send(bitmap_cache, blocks[1], 0, 0, 16, 16, 16 * 4);
+	CU_ASSERT(cache_bitmap_v2_count == 0);
+	CU_ASSERT(memblt_count == 2);
+
+	/* a reset forgets everything */
+	bitmap_cache_server_reset(bitmap_cache);
+
+	test_orders_reset();
+	bitmap_cache_server_send(bitmap_cache, blocks[0], 0, 0, 16, 16, 16 * 4);
+	CU_ASSERT(cache_bitmap_v2_count == 1);
+
+	bitmap_cache_server_free(bitmap_cache);
+}
+
+void test_bitmap_cache_server_padding(void)
+{
+	int y;
+	uint8 data[10 * 7 * 4];
+	rdpBitmapCacheServer* bitmap_cache;
+
+	test_settings_cells(600, 600, 2048);
+	bitmap_cache = bitmap_cache_server_new(context);
+
+	test_fill(data, sizeof(data), 1);
+
+	test_orders_reset();
+	bitmap_cache_server_send(bitmap_cache, data, 5, 6, 10, 7, 10 * 4);
+
+	/* the cached bitmap is 12 pixels wide, bottom-up */
+	CU_ASSERT(cache_bitmap_v2_count == 1);
+	CU_ASSERT(cache_bitmap_v2_orders[0].cacheId == 0);
+	CU_ASSERT(cache_bitmap_v2_orders[0].bitmapWidth == 12);
+	CU_ASSERT(cache_bitmap_v2_orders[0].bitmapHeight == 7);
+	CU_ASSERT(cache_bitmap_v2_orders[0].bitmapLength == 12 * 7 * 4);
+
+	for (y = 0; y < 7; y++)
+	{
+		CU_ASSERT(memcmp(&cache_bitmap_v2_data[(6 - y) * 12 * 4], &data[y * 10 * 4], 10 * 4) == 0);
+	}
+
+	CU_ASSERT(memblt_count == 1);
+	CU_ASSERT(memblt_orders[0].nLeftRect == 5);
+	CU_ASSERT(memblt_orders[0].nTopRect == 6);
+	CU_ASSERT(memblt_orders[0].nWidth == 10);
+	CU_ASSERT(memblt_orders[0].nHeight == 7);
+
+	bitmap_cache_server_free(bitmap_cache);
+}
+
+void test_bitmap_cache_server_disabled(void)
+{
+	uint8 data[16 * 16 * 4];
+	rdpBitmapCacheServer* bitmap_cache;
+
+	/* no cells */
+	test_settings_cells(0, 0, 0);
+	bitmap_cache = bitmap_cache_server_new(context);
+
+	test_orders_reset();
+	CU_ASSERT(bitmap_cache_server_send(bitmap_cache, data, 0, 0, 16, 16, 16 * 4) == false);
+	CU_ASSERT(memblt_count == 0);
+
+	bitmap_cache_server_free(bitmap_cache);
+
+	/* no MemBlt support */
+	test_settings_cells(600, 600, 2048);
+	client->settings->order_support[NEG_MEMBLT_INDEX] = false;
+	bitmap_cache = bitmap_cache_server_new(context);
+
+	CU_ASSERT(bitmap_cache_server_send(bitmap_cache, data, 0, 0, 16, 16, 16 * 4) == false);
+	CU_ASSERT(memblt_count == 0);
+
+	client->settings->order_support[NEG_MEMBLT_INDEX] = true;
+	bitmap_cache_server_free(bitmap_cache);
+}
+
+void test_glyph_cache_server_send(void)
+{
+	int i;
+	uint8 bits[3][8];
+	GLYPH_SERVER_GLYPH glyphs[4];
+	RECTANGLE_16 opaque = { 10, 0, 50, 20 };
+	rdpGlyphCacheServer* glyph_cache;
+	uint8 data[] = "\x00\x00\x01\x08\x02\x08\x00\x08\xff\x00\x08";
+
+	for (i = 0; i < 3; i++)
+		test_fill(bits[i], 8, i * 8);
+
+	test_settings_glyphs(GLYPH_SUPPORT_FULL, 254, 8);
+	glyph_cache = glyph_cache_server_new(context);
+
+	/* "abca": three new glyphs, the text is added as a fragment */
+	test_glyphs(glyphs, bits, "abca");
+
+	test_orders_reset();
+	CU_ASSERT(glyph_cache_server_send(glyph_cache, glyphs, 4, 12, 16, 0xFFFFFF, 0x000080, &opaque) == true);
+
+	CU_ASSERT(cache_glyph_count == 1);
+	CU_ASSERT(cache_glyph_v2_count == 0);
+	CU_ASSERT(cache_glyph_ids[0] == 0);
+	CU_ASSERT(cache_glyph_counts[0] == 3);
+	CU_ASSERT(cache_glyph_data[0].cacheIndex == 0);
+	CU_ASSERT(cache_glyph_data[0].y == -8);
+	CU_ASSERT(cache_glyph_data[0].cx == 8);
+	CU_ASSERT(cache_glyph_data[0].cy == 8);
+	CU_ASSERT(cache_glyph_data[0].cb == 8);
+
+	CU_ASSERT(glyph_index_count == 1);
+	CU_ASSERT(glyph_index_orders[0].cacheId == 0);
+	CU_ASSERT(glyph_index_orders[0].ulCharInc == 0);
+	CU_ASSERT(glyph_index_orders[0].backColor == 0xFFFFFF);
+	CU_ASSERT(glyph_index_orders[0].foreColor == 0x000080);
+	CU_ASSERT(glyph_index_orders[0].x == 12);
+	CU_ASSERT(glyph_index_orders[0].y == 16);
+	CU_ASSERT(glyph_index_orders[0].bkLeft == 12);
+	CU_ASSERT(glyph_index_orders[0].bkTop == 8);
+	CU_ASSERT(glyph_index_orders[0].bkRight == 44);
+	CU_ASSERT(glyph_index_orders[0].bkBottom == 16);
+	CU_ASSERT(glyph_index_orders[0].opLeft == 10);
+	CU_ASSERT(glyph_index_orders[0].opRight == 50);
+	CU_ASSERT(glyph_index_orders[0].cbData == sizeof(data) - 1);
+	CU_ASSERT(memcmp(glyph_index_orders[0].data, data, sizeof(data) - 1) == 0);
+
+	/* the same text elsewhere only uses the fragment */
+	test_orders_reset();
+	glyph_cache_server_send(glyph_cache, glyphs, 4, 100, 50, 0xFFFFFF, 0x000080, NULL);
+
+	CU_ASSERT(cache_glyph_count == 0);
+	CU_ASSERT(glyph_index_count == 1);
+	CU_ASSERT(glyph_index_orders[0].x == 100);
+	CU_ASSERT(glyph_index_orders[0].opRight == 0);
+	CU_ASSERT(glyph_index_orders[0].cbData == 3);
+	CU_ASSERT(memcmp(glyph_index_orders[0].data, "\xfe\x00\x00", 3) == 0);
+
+	/* "cab" reuses the glyphs as a new fragment */
+	test_glyphs(glyphs, bits, "cab");
+
+	test_orders_reset();
+	glyph_cache_server_send(glyph_cache, glyphs, 3, 0, 8, 0, 0, NULL);
+
+	CU_ASSERT(cache_glyph_count == 0);
+	CU_ASSERT(glyph_index_count == 1);
+	CU_ASSERT(glyph_index_orders[0].cbData == 9);
+	CU_ASSERT(memcmp(glyph_index_orders[0].data, "\x02\x00\x00\x08\x01\x08\xff\x01\x06", 9) == 0);
+
+	glyph_cache_server_free(glyph_cache);
+
+	/* revision 2 cache glyph orders */
+	test_settings_glyphs(GLYPH_SUPPORT_ENCODE, 254, 8);
+	glyph_cache = glyph_cache_server_new(context);
+
+	test_orders_reset();
+	glyph_cache_server_send(glyph_cache, glyphs, 3, 0, 8, 0, 0, NULL);
+
+	CU_ASSERT(cache_glyph_count == 0);
+	CU_ASSERT(cache_glyph_v2_count == 1);
+	CU_ASSERT(cache_glyph_counts[0] == 3);
+	CU_ASSERT(glyph_index_count == 1);
+
+	glyph_cache_server_free(glyph_cache);
+}
+
+void test_glyph_cache_server_lru(void)
+{
+	int i;
+	uint8 bits[3][8];
+	GLYPH_SERVER_GLYPH glyphs[3];
+	rdpGlyphCacheServer* glyph_cache;
+
+	for (i = 0; i < 3; i++)
+		test_fill(bits[i], 8, i * 8);
+
+	/* a glyph cache of two entries, without fragments */
+	test_settings_glyphs(GLYPH_SUPPORT_PARTIAL, 2, 8);
+	glyph_cache = glyph_cache_server_new(context);
+
+	/* an order cannot use more glyphs than the cache holds */
+	test_glyphs(glyphs, bits, "abc");
+
+	test_orders_reset();
+	glyph_cache_server_send(glyph_cache, glyphs, 3, 20, 30, 0, 0, NULL);
+
+	CU_ASSERT(cache_glyph_count == 2);
+	CU_ASSERT(cache_glyph_counts[0] == 2);
+	CU_ASSERT(cache_glyph_counts[1] == 1);
+	CU_ASSERT(cache_glyph_data[1].cacheIndex == 0);
+
+	CU_ASSERT(glyph_index_count == 2);
+	CU_ASSERT(glyph_index_orders[0].x == 20);
+	CU_ASSERT(glyph_index_orders[0].cbData == 4);
+	CU_ASSERT(memcmp(glyph_index_orders[0].data, "\x00\x00\x01\x08", 4) == 0);
+	CU_ASSERT(glyph_index_orders[1].x == 36);
+	CU_ASSERT(glyph_index_orders[1].y == 30);
+	CU_ASSERT(glyph_index_orders[1].cbData == 2);
+	CU_ASSERT(memcmp(glyph_index_orders[1].data, "\x00\x00", 2) == 0);
+
+	/* b is still cached, a was replaced by c */
+	test_glyphs(glyphs, bits, "ba");
+
+	test_orders_reset();
+	glyph_cache_server_send(glyph_cache, glyphs, 2, 0, 0, 0, 0, NULL);
+
+	CU_ASSERT(cache_glyph_count == 1);
+	CU_ASSERT(cache_glyph_counts[0] == 1);
+	CU_ASSERT(cache_glyph_data[0].cacheIndex == 0);
+	CU_ASSERT(memcmp(glyph_index_orders[0].data, "\x01\x00\x00\x08", 4) == 0);
+
+	glyph_cache_server_free(glyph_cache);
+}
+
+void test_glyph_cache_server_delta(void)
+{
+	uint8 bits[2][8];
+	GLYPH_SERVER_GLYPH glyphs[2];
+	rdpGlyphCacheServer* glyph_cache;
+
+	test_fill(bits[0], 8, 0);
+	test_fill(bits[1], 8, 8);
+
+	test_settings_glyphs(GLYPH_SUPPORT_PARTIAL, 254, 8);
+	glyph_cache = glyph_cache_server_new(context);
+
+	/* deltas above 127 take two more bytes */
+	test_glyphs(glyphs, bits, "ab");
+	glyphs[0].advance = 300;
+
+	test_orders_reset();
+	glyph_cache_server_send(glyph_cache, glyphs, 2, 0, 8, 0, 0, NULL);
+
+	CU_ASSERT(glyph_index_count == 1);
+	CU_ASSERT(glyph_index_orders[0].cbData == 6);
+	CU_ASSERT(memcmp(glyph_index_orders[0].data, "\x00\x00\x01\x80\x2c\x01", 6) == 0);
+	CU_ASSERT(glyph_index_orders[0].bkRight == 308);
+
+	glyph_cache_server_free(glyph_cache);
+}
+
+void test_glyph_cache_server_disabled(void)
+{
+	uint8 bits[1][8];
+	uint8 large[64 * 8];
+	GLYPH_SERVER_GLYPH glyphs[1];
+	rdpGlyphCacheServer* glyph_cache;
+
+	test_fill(bits[0], 8, 0);
+	test_glyphs(glyphs, bits, "a");
+
+	/* no glyph support */
+	test_settings_glyphs(GLYPH_SUPPORT_NONE, 254, 8);
+	glyph_cache = glyph_cache_server_new(context);
+
+	test_orders_reset();
+	CU_ASSERT(glyph_cache_server_send(glyph_cache, glyphs, 1, 0, 0, 0, 0, NULL) == false);
+	CU_ASSERT(glyph_index_count == 0);
+
+	glyph_cache_server_free(glyph_cache);
+
+	/* a glyph larger than any cache cell */
+	test_settings_glyphs(GLYPH_SUPPORT_FULL, 254, 8);
+	glyph_cache = glyph_cache_server_new(context);
+
+	test_fill(large, sizeof(large), 0);
+	glyphs[0].cx = 64;
+	glyphs[0].cy = 64;
+	glyphs[0].aj = large;
+
+	CU_ASSERT(glyph_cache_server_send(glyph_cache, glyphs, 1, 0, 0, 0, 0, NULL) == false);
+	CU_ASSERT(cache_glyph_count == 0);
+	CU_ASSERT(glyph_index_count == 0);
+
+	glyph_cache_server_free(glyph_cache);
+}
+
+void test_glyph_cache_server_large(void)
+{
+	int i;
+	uint32 total;
+	GLYPH_SERVER_GLYPH glyphs[40];
+	rdpGlyphCacheServer* glyph_cache;
+	static uint8 bits[40][16 * 128];
+
+	/* 40 different glyphs of 128x128 pixels, 2 KB each */
+	for (i = 0; i < 40; i++)
+	{
+		test_fill(bits[i], sizeof(bits[i]), i);
+		glyphs[i].x = 0;
+		glyphs[i].y = -128;
+		glyphs[i].cx = 128;
+		glyphs[i].cy = 128;
+		glyphs[i].aj = bits[i];
+		glyphs[i].advance = 128;
+	}
+
+	test_settings_glyphs(GLYPH_SUPPORT_FULL, 254, 2048);
+	glyph_cache = glyph_cache_server_new(context);
+
+	/* nothing to draw, nothing sent */
+	test_orders_reset();
+	CU_ASSERT(glyph_cache_server_send(glyph_cache, glyphs, 0, 0, 0, 0, 0, NULL) == true);
+	CU_ASSERT(cache_glyph_count == 0);
+	CU_ASSERT(glyph_index_count == 0);
+
+	/* one GlyphIndex order, the glyphs are spread over cache glyph orders of a few KB */
+	test_orders_reset();
+	CU_ASSERT(glyph_cache_server_send(glyph_cache, glyphs, 40, 0, 200, 0, 0, NULL) == true);
+	CU_ASSERT(glyph_index_count == 1);
+	CU_ASSERT(cache_glyph_count == 14);
+
+	for (i = total = 0; i < cache_glyph_count && i < MAX_TEST_ORDERS; i++)
+	{
+		CU_ASSERT(cache_glyph_counts[i] * (10 + 2048) <= 8192);
+		CU_ASSERT(cache_glyph_data[i].cacheIndex == total);
+		total += cache_glyph_counts[i];
+	}
+
+	CU_ASSERT(total == 40);
+
+	glyph_cache_server_free(glyph_cache);
+}
@@ -87,6 +87,18 @@ static const uint8 test_data_response_data[] =
 	"\x6F\x00\x20\x00\x77\x00\x6F\x00\x72\x00\x6c\x00\x64\x00\x00\x00"
 };
 
+static const uint8 test_filecontents_request_data[] =
+{
+	"\x08\x00\x00\x00\x18\x00\x00\x00\x07\x00\x00\x00\x02\x00\x00\x00"
+	"\x02\x00\x00\x00\x00\x00\x01\x00\x01\x00\x00\x00\x00\x00\x01\x00"
+};
+
+static const uint8 test_filecontents_response_data[] =
+{
+	"\x09\x00\x01\x00\x09\x00\x00\x00\x08\x00\x00\x00\x61\x62\x63\x64"
+	"\x65"
+};
+
 static int test_rdp_channel_data(freerdp* instance, int chan_id, uint8* data, int data_size)
 {
 	printf("chan_id %d data_size %d\n", chan_id, data_size);
@@ -112,6 +124,8 @@ void test_cliprdr(void)
 	RDP_CB_FORMAT_LIST_EVENT* format_list_event;
 	RDP_CB_DATA_REQUEST_EVENT* data_request_event;
 	RDP_CB_DATA_RESPONSE_EVENT* data_response_event;
+	RDP_CB_FILECONTENTS_REQUEST_EVENT* filecontents_request_event;
+	RDP_CB_FILECONTENTS_RESPONSE_EVENT* filecontents_response_event;
 
 	settings.hostname = "testhost";
 	instance.settings = &settings;
@@ -243,6 +257,80 @@ void test_cliprdr(void)
 	}
 	freerdp_event_free(event);
 
+	/* server sends file contents request PDU to cliprdr */
+	freerdp_channels_data(&instance, 0, (char*)test_filecontents_request_data, sizeof(test_filecontents_request_data) - 1,
+		CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST, sizeof(test_filecontents_request_data) - 1);
+
+	/* cliprdr sends file contents request event to UI */
+	while ((event = freerdp_channels_pop_event(channels)) == NULL)
+	{
+		freerdp_channels_check_fds(channels, &instance);
+	}
+	printf("Got event %d\n", event->event_type);
+	CU_ASSERT(event->event_type == RDP_EVENT_TYPE_CB_FILECONTENTS_REQUEST);
+	if (event->event_type == RDP_EVENT_TYPE_CB_FILECONTENTS_REQUEST)
+	{
+		filecontents_request_event = (RDP_CB_FILECONTENTS_REQUEST_EVENT*)event;
+		CU_ASSERT(filecontents_request_event->stream_id == 7);
+		CU_ASSERT(filecontents_request_event->lindex == 2);
+		CU_ASSERT(filecontents_request_event->flags == FILECONTENTS_RANGE);
+		CU_ASSERT(filecontents_request_event->position == 0x100000000LL + 0x10000);
+		CU_ASSERT(filecontents_request_event->requested == 0x10000);
+	}
+	freerdp_event_free(event);
+
+	/* UI sends file contents response event to cliprdr */
+	event = freerdp_event_new(RDP_EVENT_CLASS_CLIPRDR, RDP_EVENT_TYPE_CB_FILECONTENTS_RESPONSE, event_process_callback, NULL);
+	filecontents_response_event = (RDP_CB_FILECONTENTS_RESPONSE_EVENT*)event;
+	filecontents_response_event->stream_id = 7;
+	filecontents_response_event->data = (uint8*)xmalloc(4);
+	memcpy(filecontents_response_event->data, "data", 4);
+	filecontents_response_event->size = 4;
+	event_processed = 0;
+	freerdp_channels_send_event(channels, event);
+
+	/* cliprdr sends file contents response PDU to server */
+	while (!event_processed)
+	{
+		freerdp_channels_check_fds(channels, &instance);
+	}
+
+	/* UI sends file contents request event to cliprdr */
+	event = freerdp_event_new(RDP_EVENT_CLASS_CLIPRDR, RDP_EVENT_TYPE_CB_FILECONTENTS_REQUEST, event_process_callback, NULL);
+	filecontents_request_event = (RDP_CB_FILECONTENTS_REQUEST_EVENT*)event;
+	filecontents_request_event->stream_id = 8;
+	filecontents_request_event->flags = FILECONTENTS_RANGE;
+	filecontents_request_event->requested = 5;
+	event_processed = 0;
+	freerdp_channels_send_event(channels, event);
+
+	/* cliprdr sends file contents request PDU to server */
+	while (!event_processed)
+	{
+		freerdp_channels_check_fds(channels, &instance);
+	}
+
+	/* server sends file contents response PDU to cliprdr */
+	freerdp_channels_data(&instance, 0, (char*)test_filecontents_response_data, sizeof(test_filecontents_response_data) - 1,
+		CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST, sizeof(test_filecontents_response_data) - 1);
+
+	/* cliprdr sends file contents response event to UI */
+	while ((event = freerdp_channels_pop_event(channels)) == NULL)
+	{
+		freerdp_channels_check_fds(channels, &instance);
+	}
+	printf("Got event %d\n", event->event_type);
+	CU_ASSERT(event->event_type == RDP_EVENT_TYPE_CB_FILECONTENTS_RESPONSE);
+	if (event->event_type == RDP_EVENT_TYPE_CB_FILECONTENTS_RESPONSE)
+	{
+		filecontents_response_event = (RDP_CB_FILECONTENTS_RESPONSE_EVENT*)event;
+		CU_ASSERT(filecontents_response_event->stream_id == 8);
+		CU_ASSERT(!filecontents_response_event->failed);
+		CU_ASSERT(filecontents_response_event->size == 5);
+		CU_ASSERT(memcmp(filecontents_response_event->data, "abcde", 5) == 0);
+	}
+	freerdp_event_free(event);
+
 	freerdp_channels_close(channels, &instance);
 	freerdp_channels_free(channels);
 }
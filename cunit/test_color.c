@@ -22,6 +22,9 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/gdi/gdi.h>
 #include <freerdp/codec/color.h>
+#include <freerdp/codec/yuv.h>
+#include <freerdp/constants.h>
+#include <freerdp/utils/memory.h>
 #include "test_color.h"
 
 int init_color_suite(void)
@@ -44,6 +47,8 @@ int add_color_suite(void)
 	add_test_function(color_GetRGB16);
 	add_test_function(color_GetBGR_565);
 	add_test_function(color_GetBGR16);
+	add_test_function(color_yuv420p);
+	add_test_function(color_yuv420p_odd);
 
 	return 0;
 }
@@ -150,3 +155,125 @@ void test_color_GetBGR16(void)
 	CU_ASSERT(b == 0xEF);
 }
 
+
+static void test_color_yuv420p_fill(uint8* yuv, int width, int height)
+{
+	int i;
+	uint32 seed = 0x59555600;
+
+	for (i = 0; i < width * height * 3 / 2; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		yuv[i] = (uint8) (seed >> 16);
+	}
+}
+
+void test_color_yuv420p(void)
+{
+	int x, y;
+	int steps[3];
+	uint8* yuv;
+	uint8* bgra;
+	uint8* bgra_simd;
+	uint8* scaled;
+	const uint8* planes[3];
+	YUV_CONTEXT* context;
+	const int width = 70;
+	const int height = 6;
+
+	yuv = (uint8*) xmalloc(width * height * 3 / 2);
+	bgra = (uint8*) xmalloc(width * height * 4);
+	bgra_simd = (uint8*) xmalloc(width * height * 4);
+	scaled = (uint8*) xmalloc(width * 2 * height * 2 * 4);
+
+	planes[0] = yuv;
+	planes[1] = yuv + width * height;
+	planes[2] = yuv + width * height + width * height / 4;
+	steps[0] = width;
+	steps[1] = steps[2] = width / 2;
+
+	/* black, white and full red with video range levels */
+	memset(yuv, 16, width * height);
+	memset(yuv + width * height, 128, width * height / 2);
+	yuv[1] = 235;
+	yuv[2] = yuv[3] = 81;
+	yuv[width * height + 1] = 90;
+	yuv[width * height + width * height / 4 + 1] = 240;
+
+	context = yuv_context_new();
+	yuv_decode_yuv420p(context, planes, steps, width, height, bgra, width * 4, width, height);
+
+	CU_ASSERT(bgra[0] == 0 && bgra[1] == 0 && bgra[2] == 0 && bgra[3] == 0xFF);
+	CU_ASSERT(bgra[4] == 255 && bgra[5] == 255 && bgra[6] == 255);
+	CU_ASSERT(bgra[8] < 4 && bgra[9] < 4 && bgra[10] > 250);
+
+	/* the SIMD path produces exactly the same pixels, including the unaligned tail */
+	test_color_yuv420p_fill(yuv, width, height);
+	yuv_decode_yuv420p(context, planes, steps, width, height, bgra, width * 4, width, height);
+
+	yuv_context_set_cpu_opt(context, CPU_SSE2);
+	yuv_decode_yuv420p(context, planes, steps, width, height, bgra_simd, width * 4, width, height);
+	CU_ASSERT(memcmp(bgra, bgra_simd, width * height * 4) == 0);
+
+	/* doubling the size repeats every pixel twice in both directions */
+	yuv_decode_yuv420p(context, planes, steps, width, height, scaled, width * 8, width * 2, height * 2);
+
+	for (y = 0; y < height * 2; y++)
+	{
+		for (x = 0; x < width * 2; x++)
+		{
+			if (memcmp(&scaled[(y * width * 2 + x) * 4], &bgra[((y / 2) * width + x / 2) * 4], 4) != 0)
+				break;
+		}
+
+		if (x < width * 2)
+			break;
+	}
+
+	CU_ASSERT(y == height * 2);
+
+	yuv_context_free(context);
+	xfree(yuv);
+	xfree(bgra);
+	xfree(bgra_simd);
+	xfree(scaled);
+}
+
+void test_color_yuv420p_odd(void)
+{
+	int steps[3];
+	uint8* planes[3];
+	uint8 yuv[5 * 3 + 2 * 3 * 2];
+	uint8 bgra[5 * 3 * 4];
+	YUV_CONTEXT* context;
+	uint32 offsets[3] = { 0, 16, 24 };
+	uint32 padded_steps[3] = { 5, 4, 4 };
+
+	/* chroma of an odd sized frame rounds up: 3x2 samples for 5x3 pixels */
+	CU_ASSERT(yuv_get_yuv420p_planes(yuv, sizeof(yuv), 5, 3, NULL, NULL, planes, steps) == true);
+	CU_ASSERT(planes[0] == yuv && planes[1] == yuv + 15 && planes[2] == yuv + 21);
+	CU_ASSERT(steps[0] == 5 && steps[1] == 3 && steps[2] == 3);
+	CU_ASSERT(yuv_get_yuv420p_planes(yuv, sizeof(yuv) - 1, 5, 3, NULL, NULL, planes, steps) == false);
+
+	/* padded layouts are checked against their own steps */
+	CU_ASSERT(yuv_get_yuv420p_planes(yuv, 31, 5, 3, offsets, padded_steps, planes, steps) == true);
+	CU_ASSERT(planes[1] == yuv + 16 && steps[1] == 4);
+	CU_ASSERT(yuv_get_yuv420p_planes(yuv, 30, 5, 3, offsets, padded_steps, planes, steps) == false);
+
+	/* the last column and row take the last chroma samples */
+	memset(yuv, 16, 15);
+	memset(yuv + 15, 128, 12);
+	yuv[5 * 2 + 4] = 81;
+	yuv[15 + 3 + 2] = 90;
+	yuv[21 + 3 + 2] = 240;
+
+	yuv_get_yuv420p_planes(yuv, sizeof(yuv), 5, 3, NULL, NULL, planes, steps);
+
+	context = yuv_context_new();
+	yuv_decode_yuv420p(context, (const uint8**) planes, steps, 5, 3, bgra, 5 * 4, 5, 3);
+
+	CU_ASSERT(bgra[0] == 0 && bgra[1] == 0 && bgra[2] == 0);
+	CU_ASSERT(bgra[56] < 4 && bgra[57] < 4 && bgra[58] > 250);
+
+	yuv_context_free(context);
+}
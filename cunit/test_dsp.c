@@ -0,0 +1,358 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Digital Sound Processing Unit Tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+#include <freerdp/types.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/dsp.h>
+
+#include "test_dsp.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define TONE_FREQUENCY		997.0
+#define TONE_AMPLITUDE		16384.0
+
+int init_dsp_suite(void)
+{
+	return 0;
+}
+
+int clean_dsp_suite(void)
+{
+	return 0;
+}
+
+int add_dsp_suite(void)
+{
+	add_test_suite(dsp);
+
+	add_test_function(dsp_resample_quality);
+	add_test_function(dsp_resample_stream);
+	add_test_function(dsp_channel_mix);
+	add_test_function(dsp_resample_benchmark);
+	add_test_function(dsp_adpcm_roundtrip);
+	add_test_function(dsp_adpcm_parallel);
+
+	return 0;
+}
+
+static sint16* make_tone(uint32 rate, uint32 channels, int frames)
+{
+	int i;
+	uint32 c;
+	sint16* pcm;
+
+	pcm = (sint16*) xmalloc(frames * channels * sizeof(sint16));
+
+	for (i = 0; i < frames; i++)
+	{
+		for (c = 0; c < channels; c++)
+			pcm[i * channels + c] = (sint16) (TONE_AMPLITUDE * sin(2 * M_PI * TONE_FREQUENCY * i / rate));
+	}
+
+	return pcm;
+}
+
+/* signal to noise ratio in dB of a resampled tone, against the ideal tone at the target rate */
+static double tone_snr(const sint16* pcm, uint32 rate, uint32 channels, int frames)
+{
+	int i;
+	double ideal;
+	double noise = 0;
+	double signal = 0;
+
+	/* leave out the edges, where the resamplers run out of input */
+	for (i = 16; i < frames - 16; i++)
+	{
+		ideal = TONE_AMPLITUDE * sin(2 * M_PI * TONE_FREQUENCY * i / rate);
+		signal += ideal * ideal;
+		noise += (pcm[i * channels] - ideal) * (pcm[i * channels] - ideal);
+	}
+
+	return 10 * log10(signal / (noise + 1));
+}
+
+void test_dsp_resample_quality(void)
+{
+	sint16* tone;
+	double snr_linear;
+	double snr_nearest;
+	FREERDP_DSP_CONTEXT* context;
+
+	tone = make_tone(22050, 1, 22050);
+	context = freerdp_dsp_context_new();
+
+	context->resample(context, (uint8*) tone, 2, 1, 22050, 22050, 1, 44100);
+	CU_ASSERT(context->resampled_frames == 44098);
+	snr_linear = tone_snr((sint16*) context->resampled_buffer, 44100, 1, context->resampled_frames);
+
+	freerdp_dsp_resample_nearest(context, (uint8*) tone, 2, 1, 22050, 22050, 1, 44100);
+	CU_ASSERT(context->resampled_frames == 44100);
+	snr_nearest = tone_snr((sint16*) context->resampled_buffer, 44100, 1, context->resampled_frames);
+
+	printf("\ntest_dsp: 22050 -> 44100 Hz tone SNR: linear %.1f dB, nearest %.1f dB\n", snr_linear, snr_nearest);
+
+	CU_ASSERT(snr_linear > 40.0);
+	CU_ASSERT(snr_linear > snr_nearest + 10.0);
+
+	freerdp_dsp_context_free(context);
+	xfree(tone);
+}
+
+void test_dsp_resample_stream(void)
+{
+	int i;
+	int chunk;
+	int frames;
+	sint16* tone;
+	uint8* whole;
+	uint32 whole_size;
+	uint32 offset = 0;
+	FREERDP_DSP_CONTEXT* context;
+
+	frames = 44100;
+	tone = make_tone(44100, 2, frames);
+	context = freerdp_dsp_context_new();
+
+	context->resample(context, (uint8*) tone, 2, 2, 44100, frames, 2, 48000);
+	whole_size = context->resampled_size;
+	whole = (uint8*) xmalloc(whole_size);
+	memcpy(whole, context->resampled_buffer, whole_size);
+
+	/* the same stream in odd sized chunks must come out bit exact */
+	freerdp_dsp_context_reset_resampler(context);
+
+	for (i = 0; i < frames; i += chunk)
+	{
+		chunk = 1 + (i * 7) % 500;
+		if (i + chunk > frames)
+			chunk = frames - i;
+
+		context->resample(context, (uint8*) &tone[i * 2], 2, 2, 44100, chunk, 2, 48000);
+
+		CU_ASSERT(offset + context->resampled_size <= whole_size);
+		if (offset + context->resampled_size > whole_size)
+			break;
+
+		CU_ASSERT(memcmp(whole + offset, context->resampled_buffer, context->resampled_size) == 0);
+		offset += context->resampled_size;
+	}
+
+	CU_ASSERT(offset == whole_size);
+
+	freerdp_dsp_context_free(context);
+	xfree(whole);
+	xfree(tone);
+}
+
+void test_dsp_channel_mix(void)
+{
+	sint16* out;
+	sint16 mono[4] = { 100, -200, 300, 32767 };
+	sint16 stereo[8] = { 100, 300, -200, -400, 32767, 32767, -32768, -32768 };
+	uint8 mono8[2] = { 0x80, 0xC0 };
+	FREERDP_DSP_CONTEXT* context;
+
+	context = freerdp_dsp_context_new();
+
+	context->resample(context, (uint8*) mono, 2, 1, 22050, 4, 2, 22050);
+	out = (sint16*) context->resampled_buffer;
+	CU_ASSERT(context->resampled_frames == 4);
+	CU_ASSERT(context->resampled_size == 16);
+	CU_ASSERT(out[0] == 100 && out[1] == 100);
+	CU_ASSERT(out[6] == 32767 && out[7] == 32767);
+
+	context->resample(context, (uint8*) stereo, 2, 2, 22050, 4, 1, 22050);
+	out = (sint16*) context->resampled_buffer;
+	CU_ASSERT(context->resampled_frames == 4);
+	CU_ASSERT(out[0] == 200);
+	CU_ASSERT(out[1] == -300);
+	CU_ASSERT(out[2] == 32767);
+	CU_ASSERT(out[3] == -32768);
+
+	/* 8-bit samples stay 8-bit */
+	context->resample(context, mono8, 1, 1, 8000, 2, 2, 8000);
+	CU_ASSERT(context->resampled_size == 4);
+	CU_ASSERT(context->resampled_buffer[0] == 0x80 && context->resampled_buffer[1] == 0x80);
+	CU_ASSERT(context->resampled_buffer[2] == 0xC0 && context->resampled_buffer[3] == 0xC0);
+
+	freerdp_dsp_context_free(context);
+}
+
+static double benchmark(FREERDP_DSP_CONTEXT* context, void (*resample)(FREERDP_DSP_CONTEXT* context,
+	const uint8* src, int bytes_per_sample, uint32 schan, uint32 srate, int sframes,
+	uint32 rchan, uint32 rrate), const sint16* pcm, int frames, int packet_frames)
+{
+	int i;
+	struct timeval start_time;
+	struct timeval end_time;
+
+	gettimeofday(&start_time, NULL);
+
+	for (i = 0; i + packet_frames <= frames; i += packet_frames)
+		resample(context, (uint8*) &pcm[i * 2], 2, 2, 44100, packet_frames, 2, 48000);
+
+	gettimeofday(&end_time, NULL);
+
+	return (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_usec - start_time.tv_usec) / 1000000.0;
+}
+
+void test_dsp_resample_benchmark(void)
+{
+	int frames;
+	sint16* tone;
+	double linear;
+	double nearest;
+	FREERDP_DSP_CONTEXT* context;
+
+	/* 60 seconds of stereo audio in 20 ms packets, as rdpsnd would see it */
+	frames = 44100 * 60;
+	tone = make_tone(44100, 2, frames);
+	context = freerdp_dsp_context_new();
+
+	linear = benchmark(context, context->resample, tone, frames, 882);
+	nearest = benchmark(context, freerdp_dsp_resample_nearest, tone, frames, 882);
+
+	printf("test_dsp: resampled 60 seconds 44100 -> 48000 Hz stereo in %f seconds (linear), %f seconds (nearest)\n",
+		linear, nearest);
+
+	CU_ASSERT(context->resampled_frames > 0);
+
+	freerdp_dsp_context_free(context);
+	xfree(tone);
+}
+
+static void adpcm_encode(FREERDP_DSP_CONTEXT* context, int format, const sint16* pcm, int size, int channels, int block_size)
+{
+	if (format == 0x11)
+		context->encode_ima_adpcm(context, (const uint8*) pcm, size, channels, block_size);
+	else
+		context->encode_ms_adpcm(context, (const uint8*) pcm, size, channels, block_size);
+}
+
+static void adpcm_decode(FREERDP_DSP_CONTEXT* context, int format, const uint8* data, int size, int channels, int block_size)
+{
+	if (format == 0x11)
+		context->decode_ima_adpcm(context, data, size, channels, block_size);
+	else
+		context->decode_ms_adpcm(context, data, size, channels, block_size);
+}
+
+void test_dsp_adpcm_roundtrip(void)
+{
+	int i;
+	int size;
+	int format;
+	int frames;
+	double snr;
+	sint16* tone;
+	uint8* encoded;
+	FREERDP_DSP_CONTEXT* encoder;
+	FREERDP_DSP_CONTEXT* decoder;
+
+	/* 2 blocks of 2048 bytes hold 4088 IMA or 4068 MS stereo frames */
+	frames = 4068;
+	tone = make_tone(22050, 2, frames);
+
+	for (i = 0; i < 2; i++)
+	{
+		format = (i == 0) ? 0x11 : 0x02;
+		encoder = freerdp_dsp_context_new();
+		decoder = freerdp_dsp_context_new();
+
+		adpcm_encode(encoder, format, tone, frames * 4, 2, 2048);
+		CU_ASSERT(encoder->adpcm_size <= 2 * 2048);
+
+		size = encoder->adpcm_size;
+		encoded = (uint8*) xmalloc(2 * 2048);
+		memset(encoded, 0, 2 * 2048);
+		memcpy(encoded, encoder->adpcm_buffer, size);
+
+		adpcm_decode(decoder, format, encoded, 2 * 2048, 2, 2048);
+		CU_ASSERT(decoder->adpcm_size >= frames * 4);
+
+		snr = tone_snr((sint16*) decoder->adpcm_buffer, 22050, 2, frames);
+		printf("\ntest_dsp: %s ADPCM round trip SNR %.1f dB\n", (format == 0x11) ? "IMA" : "MS", snr);
+		CU_ASSERT(snr > 20.0);
+
+		xfree(encoded);
+		freerdp_dsp_context_free(encoder);
+		freerdp_dsp_context_free(decoder);
+	}
+
+	xfree(tone);
+}
+
+void test_dsp_adpcm_parallel(void)
+{
+	int i;
+	int format;
+	int frames;
+	uint32 size;
+	sint16* tone;
+	uint8* encoded;
+	uint8* decoded;
+	uint32 decoded_size;
+	FREERDP_DSP_CONTEXT* context;
+
+	frames = 44100 * 10;
+	tone = make_tone(44100, 2, frames);
+	context = freerdp_dsp_context_new();
+
+	for (i = 0; i < 2; i++)
+	{
+		format = (i == 0) ? 0x11 : 0x02;
+
+		/* the output must not depend on how the blocks are spread over threads */
+		freerdp_dsp_context_reset_adpcm(context);
+		adpcm_encode(context, format, tone, frames * 4, 2, 1024);
+		size = context->adpcm_size - context->adpcm_size % 1024;
+		encoded = (uint8*) xmalloc(size);
+		memcpy(encoded, context->adpcm_buffer, size);
+
+		adpcm_decode(context, format, encoded, size, 2, 1024);
+		decoded_size = context->adpcm_size;
+		decoded = (uint8*) xmalloc(decoded_size);
+		memcpy(decoded, context->adpcm_buffer, decoded_size);
+
+		freerdp_dsp_set_worker_threads(4);
+
+		freerdp_dsp_context_reset_adpcm(context);
+		adpcm_encode(context, format, tone, frames * 4, 2, 1024);
+		CU_ASSERT(context->adpcm_size - context->adpcm_size % 1024 == size);
+		CU_ASSERT(memcmp(context->adpcm_buffer, encoded, size) == 0);
+
+		adpcm_decode(context, format, encoded, size, 2, 1024);
+		CU_ASSERT(context->adpcm_size == decoded_size);
+		CU_ASSERT(memcmp(context->adpcm_buffer, decoded, decoded_size) == 0);
+
+		freerdp_dsp_set_worker_threads(0);
+
+		xfree(encoded);
+		xfree(decoded);
+	}
+
+	freerdp_dsp_context_free(context);
+	xfree(tone);
+}
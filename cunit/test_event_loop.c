@@ -0,0 +1,244 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Server Event Loop Unit Tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/event_loop.h>
+#include <freerdp/utils/sleep.h>
+#include <freerdp/utils/memory.h>
+
+#include "test_event_loop.h"
+
+/**
+ * The peers and the listener are fakes reading commands from pipes:
+ * writing to the listener accepts a peer, 'h' for one that has to go through
+ * its handshake and 'a' for one already activated. A peer counts its checks,
+ * activates on 'b' once the gate pipe is written and closes on 'q'.
+ */
+
+typedef struct
+{
+	freerdp_peer client;
+	int fds[2];
+	volatile int checks;
+	volatile int closed;
+	pthread_t thread;
+} testPeer;
+
+static rdpEventLoop* loop;
+static int listener_fds[2];
+static int gate_fds[2];
+static testPeer* peers[2];
+static int num_peers;
+
+static boolean test_peer_get_fds(freerdp_peer* client, void** rfds, int* rcount)
+{
+	testPeer* peer = (testPeer*) client;
+
+	rfds[(*rcount)++] = (void*)(long) peer->fds[0];
+
+	return true;
+}
+
+static boolean test_peer_check_fds(freerdp_peer* client)
+{
+	uint8 c;
+	testPeer* peer = (testPeer*) client;
+
+	if (read(peer->fds[0], &c, 1) != 1)
+		return false;
+
+	peer->thread = pthread_self();
+
+	if (c == 'b')
+	{
+		/* a handshake waiting for the client to answer */
+		if (read(gate_fds[0], &c, 1) != 1)
+			return false;
+
+		client->activated = true;
+	}
+
+	peer->checks++;
+
+	return (c != 'q');
+}
+
+static void test_peer_closed(freerdp_peer* client)
+{
+	testPeer* peer = (testPeer*) client;
+
+	peer->closed++;
+}
+
+static boolean test_listener_get_fds(freerdp_listener* instance, void** rfds, int* rcount)
+{
+	rfds[(*rcount)++] = (void*)(long) listener_fds[0];
+
+	return true;
+}
+
+static boolean test_listener_check_fds(freerdp_listener* instance)
+{
+	uint8 c;
+	testPeer* peer;
+	rdpEventSession* session;
+
+	if (read(listener_fds[0], &c, 1) != 1 || num_peers >= 2)
+		return false;
+
+	peer = xnew(testPeer);
+	pipe(peer->fds);
+	peer->client.GetFileDescriptor = test_peer_get_fds;
+	peer->client.CheckFileDescriptor = test_peer_check_fds;
+	peer->client.activated = (c == 'a');
+	peers[num_peers++] = peer;
+
+	session = freerdp_event_session_new(&peer->client, test_peer_closed);
+
+	return freerdp_event_loop_add_session(loop, session);
+}
+
+static void* test_event_loop_run(void* arg)
+{
+	return freerdp_event_loop_run(loop) ? arg : NULL;
+}
+
+static boolean test_event_loop_wait(volatile int* value, int expected)
+{
+	int i;
+
+	for (i = 0; i < 5000 && *value != expected; i++)
+		freerdp_usleep(1000);
+
+	return (*value == expected);
+}
+
+static void test_event_loop_send(int fd, uint8 c)
+{
+	CU_ASSERT(write(fd, &c, 1) == 1);
+}
+
+int init_event_loop_suite(void)
+{
+	return 0;
+}
+
+int clean_event_loop_suite(void)
+{
+	return 0;
+}
+
+int add_event_loop_suite(void)
+{
+	add_test_suite(event_loop);
+
+	add_test_function(event_loop);
+
+	return 0;
+}
+
+void test_event_loop(void)
+{
+	int i;
+	int count;
+	void* status;
+	pthread_t dispatcher;
+	freerdp_listener listener;
+
+	CU_ASSERT(pipe(listener_fds) == 0);
+	CU_ASSERT(pipe(gate_fds) == 0);
+	num_peers = 0;
+
+	/* one worker, so a handshake holding it up would stall every session */
+	loop = freerdp_event_loop_new(1);
+
+	if (loop == NULL)
+	{
+		/* epoll is not available on this platform */
+		close(listener_fds[0]);
+		close(listener_fds[1]);
+		close(gate_fds[0]);
+		close(gate_fds[1]);
+		return;
+	}
+
+	memset(&listener, 0, sizeof(listener));
+	listener.GetFileDescriptor = test_listener_get_fds;
+	listener.CheckFileDescriptor = test_listener_check_fds;
+	CU_ASSERT(freerdp_event_loop_add_listener(loop, &listener));
+
+	pthread_create(&dispatcher, 0, test_event_loop_run, loop);
+
+	/* the listener accepts a peer in its handshake and one already activated */
+	test_event_loop_send(listener_fds[1], 'h');
+	test_event_loop_send(listener_fds[1], 'a');
+
+	for (i = 0; i < 5000 && (count = freerdp_event_loop_get_session_count(loop)) != 2; i++)
+		freerdp_usleep(1000);
+	CU_ASSERT(count == 2);
+	if (count != 2)
+		return;
+
+	/* the handshake blocks, the activated peer is still serviced */
+	test_event_loop_send(peers[0]->fds[1], 'b');
+	test_event_loop_send(peers[1]->fds[1], 'x');
+	CU_ASSERT(test_event_loop_wait(&peers[1]->checks, 1));
+	CU_ASSERT(peers[0]->checks == 0);
+
+	/* once activated, the peer is checked on the worker */
+	test_event_loop_send(gate_fds[1], 'g');
+	CU_ASSERT(test_event_loop_wait(&peers[0]->checks, 1));
+	CU_ASSERT(!pthread_equal(peers[0]->thread, peers[1]->thread));
+
+	test_event_loop_send(peers[0]->fds[1], 'x');
+	CU_ASSERT(test_event_loop_wait(&peers[0]->checks, 2));
+	CU_ASSERT(pthread_equal(peers[0]->thread, peers[1]->thread));
+
+	/* a failed check closes the session */
+	test_event_loop_send(peers[1]->fds[1], 'q');
+	CU_ASSERT(test_event_loop_wait(&peers[1]->closed, 1));
+
+	for (i = 0; i < 5000 && (count = freerdp_event_loop_get_session_count(loop)) != 1; i++)
+		freerdp_usleep(1000);
+	CU_ASSERT(count == 1);
+
+	/* stopping returns from the dispatcher, freeing closes the sessions left */
+	freerdp_event_loop_stop(loop);
+	pthread_join(dispatcher, &status);
+	CU_ASSERT(status == loop);
+
+	freerdp_event_loop_free(loop);
+	CU_ASSERT(peers[0]->closed == 1);
+	CU_ASSERT(peers[1]->closed == 1);
+
+	for (i = 0; i < num_peers; i++)
+	{
+		close(peers[i]->fds[0]);
+		close(peers[i]->fds[1]);
+		xfree(peers[i]);
+	}
+
+	close(listener_fds[0]);
+	close(listener_fds[1]);
+	close(gate_fds[0]);
+	close(gate_fds[1]);
+}
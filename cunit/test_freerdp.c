@@ -25,6 +25,7 @@
 #include "test_mcs.h"
 #include "test_color.h"
 #include "test_bitmap.h"
+#include "test_cache.h"
 #include "test_gdi.h"
 #include "test_list.h"
 #include "test_sspi.h"
@@ -33,13 +34,20 @@
 #include "test_orders.h"
 #include "test_ntlm.h"
 #include "test_license.h"
+#include "test_input.h"
 #include "test_channels.h"
 #include "test_cliprdr.h"
 #include "test_drdynvc.h"
+#include "test_dsp.h"
+#include "test_event_loop.h"
 #include "test_rfx.h"
+#include "test_rpc.h"
 #include "test_nsc.h"
 #include "test_freerdp.h"
 #include "test_rail.h"
+#include "test_render.h"
+#include "test_rdpsnd.h"
+#include "test_sam.h"
 #include "test_pcap.h"
 #include "test_mppc.h"
 #include "test_mppc_enc.h"
@@ -124,12 +132,16 @@ const static test_suite suites[] =
 {
 	{ "ber", add_ber_suite },
 	{ "bitmap", add_bitmap_suite },
+	{ "cache", add_cache_suite },
 	{ "channels", add_channels_suite },
 	{ "cliprdr", add_cliprdr_suite },
 	{ "color", add_color_suite },
 	{ "drdynvc", add_drdynvc_suite },
+	{ "dsp", add_dsp_suite },
+	{ "event_loop", add_event_loop_suite },
 	{ "gcc", add_gcc_suite },
 	{ "gdi", add_gdi_suite },
+	{ "input", add_input_suite },
 	{ "license", add_license_suite },
 	{ "list", add_list_suite },
 	{ "mcs", add_mcs_suite },
@@ -140,7 +152,11 @@ const static test_suite suites[] =
 	{ "pcap", add_pcap_suite },
 	{ "per", add_per_suite },
 	{ "rail", add_rail_suite },
+	{ "rdpsnd", add_rdpsnd_suite },
+	{ "render", add_render_suite },
 	{ "rfx", add_rfx_suite },
+	{ "rpc", add_rpc_suite },
+	{ "sam", add_sam_suite },
 	{ "nsc", add_nsc_suite },
 	{ "sspi", add_sspi_suite },
 	{ "stream", add_stream_suite },
@@ -21,6 +21,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <freerdp/freerdp.h>
+#include <freerdp/utils/memory.h>
 
 #include <freerdp/gdi/gdi.h>
 
@@ -67,8 +68,11 @@ int add_gdi_suite(void)
 	add_test_function(gdi_MoveToEx);
 	add_test_function(gdi_LineTo);
 	add_test_function(gdi_Ellipse);
+	add_test_function(gdi_Ellipse_fill);
 	add_test_function(gdi_PtInRect);
 	add_test_function(gdi_FillRect);
+	add_test_function(gdi_Polygon);
+	add_test_function(gdi_PolyPolygon);
 	add_test_function(gdi_BitBlt_32bpp);
 	add_test_function(gdi_BitBlt_16bpp);
 	add_test_function(gdi_BitBlt_8bpp);
@@ -1866,6 +1870,90 @@ void test_gdi_Ellipse(void)
 	//assertBitmapsEqual(hBmp, hBmp_Ellipse_1, "Case 1");
 }
 
+void test_gdi_Ellipse_fill(void)
+{
+	int x, y;
+	HGDI_DC hdc;
+	HGDI_PEN pen;
+	HGDI_BRUSH brush;
+	HGDI_BITMAP hBmp;
+	uint32 color;
+	int asymmetric = 0;
+
+	hdc = gdi_GetDC();
+	gdi_SetNullClipRgn(hdc);
+	hdc->invert = 0;
+
+	hBmp = gdi_CreateCompatibleBitmap(hdc, 16, 16);
+	memset(hBmp->data, 0, 16 * 16 * 4);
+	gdi_SelectObject(hdc, (HGDIOBJECT) hBmp);
+
+	pen = gdi_CreatePen(GDI_PS_NULL, 1, 0);
+	gdi_SelectObject(hdc, (HGDIOBJECT) pen);
+
+	brush = gdi_CreateSolidBrush(0x00FF0000);
+	gdi_SelectObject(hdc, (HGDIOBJECT) brush);
+	color = gdi_get_color_32bpp(hdc, 0x00FF0000);
+
+	gdi_SetROP2(hdc, GDI_R2_COPYPEN);
+
+	/* the bounding rectangle excludes its right and bottom edges */
+	gdi_Ellipse(hdc, 0, 0, 16, 16);
+
+	for (y = 0; y < 16; y++)
+	{
+		for (x = 0; x < 16; x++)
+		{
+			if (gdi_GetPixel(hdc, x, y) != gdi_GetPixel(hdc, 15 - x, y) ||
+				gdi_GetPixel(hdc, x, y) != gdi_GetPixel(hdc, x, 15 - y))
+				asymmetric++;
+		}
+	}
+
+	CU_ASSERT(asymmetric == 0);
+	CU_ASSERT(gdi_GetPixel(hdc, 0, 0) == 0);
+	CU_ASSERT(gdi_GetPixel(hdc, 15, 15) == 0);
+	CU_ASSERT(gdi_GetPixel(hdc, 7, 0) == color);
+	CU_ASSERT(gdi_GetPixel(hdc, 5, 0) == color);
+	CU_ASSERT(gdi_GetPixel(hdc, 4, 0) == 0);
+	CU_ASSERT(gdi_GetPixel(hdc, 0, 7) == color);
+	CU_ASSERT(gdi_GetPixel(hdc, 15, 8) == color);
+	CU_ASSERT(gdi_GetPixel(hdc, 8, 8) == color);
+
+	/* drawing it again with R2_XORPEN restores the background */
+	gdi_SetROP2(hdc, GDI_R2_XORPEN);
+	gdi_Ellipse(hdc, 0, 0, 16, 16);
+
+	CU_ASSERT(gdi_GetPixel(hdc, 8, 8) == 0);
+	CU_ASSERT(gdi_GetPixel(hdc, 7, 0) == 0);
+
+	/* the outline is drawn with the pen, the interior with the brush */
+	gdi_DeleteObject((HGDIOBJECT) pen);
+	pen = gdi_CreatePen(GDI_PS_SOLID, 1, 0xFF00FF00);
+	gdi_SelectObject(hdc, (HGDIOBJECT) pen);
+
+	gdi_SetROP2(hdc, GDI_R2_COPYPEN);
+	gdi_Ellipse(hdc, 0, 0, 16, 16);
+
+	CU_ASSERT(gdi_GetPixel(hdc, 0, 7) == gdi_get_color_32bpp(hdc, 0xFF00FF00));
+	CU_ASSERT(gdi_GetPixel(hdc, 7, 0) == gdi_get_color_32bpp(hdc, 0xFF00FF00));
+	CU_ASSERT(gdi_GetPixel(hdc, 1, 7) == color);
+	CU_ASSERT(gdi_GetPixel(hdc, 8, 8) == color);
+
+	/* clipping */
+	memset(hBmp->data, 0, 16 * 16 * 4);
+	gdi_SetClipRgn(hdc, 0, 0, 8, 8);
+	gdi_Ellipse(hdc, 0, 0, 16, 16);
+
+	CU_ASSERT(gdi_GetPixel(hdc, 7, 7) == color);
+	CU_ASSERT(gdi_GetPixel(hdc, 8, 8) == 0);
+	CU_ASSERT(gdi_GetPixel(hdc, 15, 8) == 0);
+
+	gdi_DeleteObject((HGDIOBJECT) pen);
+	gdi_DeleteObject((HGDIOBJECT) brush);
+	gdi_DeleteObject((HGDIOBJECT) hBmp);
+}
+
 void test_gdi_PtInRect(void)
 {
 	HGDI_RECT hRect;
@@ -1962,6 +2050,156 @@ void test_gdi_FillRect(void)
 	gdi_DeleteObject((HGDIOBJECT) hBitmap);
 }
 
+static HGDI_DC test_gdi_polygon_dc(uint32 brushColor)
+{
+	HGDI_DC hdc;
+	HGDI_BITMAP hBmp;
+
+	hdc = gdi_GetDC();
+	gdi_SetNullClipRgn(hdc);
+	hdc->invert = 0;
+
+	hBmp = gdi_CreateCompatibleBitmap(hdc, 16, 16);
+	memset(hBmp->data, 0, 16 * 16 * 4);
+	gdi_SelectObject(hdc, (HGDIOBJECT) hBmp);
+
+	gdi_SelectObject(hdc, (HGDIOBJECT) gdi_CreatePen(GDI_PS_NULL, 1, 0));
+	gdi_SelectObject(hdc, (HGDIOBJECT) gdi_CreateSolidBrush(brushColor));
+	gdi_SetROP2(hdc, GDI_R2_COPYPEN);
+
+	return hdc;
+}
+
+static int test_gdi_count_pixels(HGDI_DC hdc, uint32 color)
+{
+	int x, y;
+	int count = 0;
+
+	for (y = 0; y < 16; y++)
+	{
+		for (x = 0; x < 16; x++)
+		{
+			if (gdi_GetPixel(hdc, x, y) == color)
+				count++;
+		}
+	}
+
+	return count;
+}
+
+void test_gdi_Polygon(void)
+{
+	HGDI_DC hdc;
+	uint32 color;
+	HGDI_BITMAP hBmp;
+	uint8 hatch[8] = { 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55 };
+	GDI_POINT rect[4] = { { 2, 2 }, { 10, 2 }, { 10, 8 }, { 2, 8 } };
+	GDI_POINT triangle[3] = { { 0, 0 }, { 16, 0 }, { 0, 16 } };
+
+	hdc = test_gdi_polygon_dc(0x000000FF);
+	hBmp = (HGDI_BITMAP) hdc->selectedObject;
+	color = gdi_get_color_32bpp(hdc, 0x000000FF);
+
+	/* the right and bottom edges are excluded, like with GDI */
+	gdi_Polygon(hdc, rect, 4);
+
+	CU_ASSERT(test_gdi_count_pixels(hdc, color) == 8 * 6);
+	CU_ASSERT(gdi_GetPixel(hdc, 2, 2) == color);
+	CU_ASSERT(gdi_GetPixel(hdc, 9, 7) == color);
+	CU_ASSERT(gdi_GetPixel(hdc, 10, 7) == 0);
+	CU_ASSERT(gdi_GetPixel(hdc, 9, 8) == 0);
+
+	/* pixels are inside when their center is */
+	memset(hBmp->data, 0, 16 * 16 * 4);
+	gdi_Polygon(hdc, triangle, 3);
+
+	CU_ASSERT(test_gdi_count_pixels(hdc, color) == 16 * 15 / 2);
+	CU_ASSERT(gdi_GetPixel(hdc, 14, 0) == color);
+	CU_ASSERT(gdi_GetPixel(hdc, 15, 0) == 0);
+	CU_ASSERT(gdi_GetPixel(hdc, 0, 14) == color);
+	CU_ASSERT(gdi_GetPixel(hdc, 0, 15) == 0);
+
+	/* R2_XORPEN twice restores the destination */
+	gdi_SetROP2(hdc, GDI_R2_XORPEN);
+	gdi_Polygon(hdc, triangle, 3);
+	CU_ASSERT(test_gdi_count_pixels(hdc, 0) == 16 * 16);
+
+	/* clipping */
+	gdi_SetROP2(hdc, GDI_R2_COPYPEN);
+	gdi_SetClipRgn(hdc, 4, 4, 4, 4);
+	gdi_Polygon(hdc, rect, 4);
+
+	CU_ASSERT(test_gdi_count_pixels(hdc, color) == 4 * 4);
+	CU_ASSERT(gdi_GetPixel(hdc, 3, 4) == 0);
+	CU_ASSERT(gdi_GetPixel(hdc, 4, 4) == color);
+	CU_ASSERT(gdi_GetPixel(hdc, 7, 7) == color);
+	CU_ASSERT(gdi_GetPixel(hdc, 8, 7) == 0);
+
+	/* hatch brushes draw their clear bits only when the background is opaque */
+	gdi_SetNullClipRgn(hdc);
+	memset(hBmp->data, 0, 16 * 16 * 4);
+	gdi_DeleteObject((HGDIOBJECT) hdc->brush);
+	hdc->brush = gdi_CreateHatchBrush(gdi_CreateBitmap(8, 8, 1, (uint8*) xmalloc(8)), 0x000000FF);
+	memcpy(hdc->brush->pattern->data, hatch, 8);
+	gdi_SetBkColor(hdc, 0x0000FF00);
+
+	gdi_SetBkMode(hdc, GDI_TRANSPARENT);
+	gdi_Polygon(hdc, rect, 4);
+
+	CU_ASSERT(test_gdi_count_pixels(hdc, color) == 8 * 6 / 2);
+	CU_ASSERT(gdi_GetPixel(hdc, 2, 2) == color);
+	CU_ASSERT(gdi_GetPixel(hdc, 3, 2) == 0);
+	CU_ASSERT(gdi_GetPixel(hdc, 3, 3) == color);
+
+	gdi_SetBkMode(hdc, GDI_OPAQUE);
+	gdi_Polygon(hdc, rect, 4);
+
+	CU_ASSERT(test_gdi_count_pixels(hdc, color) == 8 * 6 / 2);
+	CU_ASSERT(gdi_GetPixel(hdc, 3, 2) == gdi_get_color_32bpp(hdc, 0x0000FF00));
+
+	gdi_DeleteObject((HGDIOBJECT) hdc->brush);
+	gdi_DeleteObject((HGDIOBJECT) hdc->pen);
+	gdi_DeleteObject((HGDIOBJECT) hBmp);
+}
+
+void test_gdi_PolyPolygon(void)
+{
+	HGDI_DC hdc;
+	uint32 color;
+	HGDI_BITMAP hBmp;
+	int counts[2] = { 4, 4 };
+	GDI_POINT squares[8] =
+	{
+		{ 0, 0 }, { 8, 0 }, { 8, 8 }, { 0, 8 },
+		{ 4, 4 }, { 12, 4 }, { 12, 12 }, { 4, 12 }
+	};
+
+	hdc = test_gdi_polygon_dc(0x000000FF);
+	hBmp = (HGDI_BITMAP) hdc->selectedObject;
+	color = gdi_get_color_32bpp(hdc, 0x000000FF);
+
+	/* with the alternate fill mode the overlap of the squares is left out */
+	gdi_SetPolyFillMode(hdc, GDI_ALTERNATE);
+	gdi_PolyPolygon(hdc, squares, counts, 2);
+
+	CU_ASSERT(test_gdi_count_pixels(hdc, color) == 2 * 64 - 2 * 16);
+	CU_ASSERT(gdi_GetPixel(hdc, 1, 1) == color);
+	CU_ASSERT(gdi_GetPixel(hdc, 5, 5) == 0);
+	CU_ASSERT(gdi_GetPixel(hdc, 10, 10) == color);
+
+	/* the squares turn the same way, so winding fills the overlap */
+	memset(hBmp->data, 0, 16 * 16 * 4);
+	gdi_SetPolyFillMode(hdc, GDI_WINDING);
+	gdi_PolyPolygon(hdc, squares, counts, 2);
+
+	CU_ASSERT(test_gdi_count_pixels(hdc, color) == 2 * 64 - 16);
+	CU_ASSERT(gdi_GetPixel(hdc, 5, 5) == color);
+
+	gdi_DeleteObject((HGDIOBJECT) hdc->brush);
+	gdi_DeleteObject((HGDIOBJECT) hdc->pen);
+	gdi_DeleteObject((HGDIOBJECT) hBmp);
+}
+
 void test_gdi_BitBlt_32bpp(void)
 {
 	uint8* data;
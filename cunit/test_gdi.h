@@ -38,8 +38,11 @@ void test_gdi_SetROP2(void);
 void test_gdi_MoveToEx(void);
 void test_gdi_LineTo(void);
 void test_gdi_Ellipse(void);
+void test_gdi_Ellipse_fill(void);
 void test_gdi_PtInRect(void);
 void test_gdi_FillRect(void);
+void test_gdi_Polygon(void);
+void test_gdi_PolyPolygon(void);
 void test_gdi_BitBlt_32bpp(void);
 void test_gdi_BitBlt_16bpp(void);
 void test_gdi_BitBlt_8bpp(void);
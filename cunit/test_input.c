@@ -0,0 +1,198 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Input Unit Tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include "rdp.h"
+#include "input.h"
+#include "fastpath.h"
+#include "transport.h"
+
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/memory.h>
+
+#include "test_input.h"
+
+static rdpRdp* rdp;
+static rdpInput* input;
+static rdpContext* context;
+static int server_fd = -1;
+
+int init_input_suite(void)
+{
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		return -1;
+
+	/* the client writes its input PDUs into one end, the test reads them from the other */
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+	server_fd = fds[1];
+
+	rdp = rdp_new(NULL);
+	rdp->transport->layer = TRANSPORT_LAYER_TCP;
+	rdp->transport->tcp->sockfd = fds[0];
+
+	context = xnew(rdpContext);
+	context->rdp = rdp;
+	input = rdp->input;
+	input->context = context;
+
+	return 0;
+}
+
+int clean_input_suite(void)
+{
+	close(rdp->transport->tcp->sockfd);
+	rdp->transport->tcp->sockfd = -1;
+	close(server_fd);
+	rdp_free(rdp);
+	xfree(context);
+	return 0;
+}
+
+int add_input_suite(void)
+{
+	add_test_suite(input);
+
+	add_test_function(input_coalesce);
+	add_test_function(input_batch);
+	add_test_function(input_flush_timeout);
+
+	return 0;
+}
+
+static void input_setup(uint32 batch_ms, boolean coalesce)
+{
+	rdp->settings->fastpath_input = true;
+	rdp->settings->input_batch_ms = batch_ms;
+	rdp->settings->input_coalesce = coalesce;
+	input_register_client_callbacks(input);
+	memset(&input->queue->stats, 0, sizeof(INPUT_STATS));
+}
+
+/* reads the next fast-path input PDU, returns its event count or 0 if nothing was sent */
+static int input_read_pdu(uint8* events, int size)
+{
+	int length;
+	uint8 header[3];
+
+	if (read(server_fd, header, 3) != 3)
+		return 0;
+
+	CU_ASSERT((header[0] & 0x03) == FASTPATH_INPUT_ACTION_FASTPATH);
+	CU_ASSERT((header[1] & 0x80) != 0);
+
+	length = ((header[1] & 0x7F) << 8 | header[2]) - 3;
+	CU_ASSERT(length <= size);
+
+	if (length > size || read(server_fd, events, length) != length)
+		return 0;
+
+	return (header[0] >> 2) & 0x0F;
+}
+
+void test_input_coalesce(void)
+{
+	int i;
+	uint8 events[256];
+	INPUT_STATS stats;
+
+	input_setup(1000, true);
+
+	for (i = 0; i < 5; i++)
+		freerdp_input_send_mouse_event(input, PTR_FLAGS_MOVE, 10 + i, 20 + i);
+
+	/* motion is held back */
+	CU_ASSERT(input_read_pdu(events, sizeof(events)) == 0);
+
+	freerdp_input_send_mouse_event(input, PTR_FLAGS_DOWN | PTR_FLAGS_BUTTON1, 14, 24);
+
+	/* the button goes out at once, along with the last position before it */
+	CU_ASSERT(input_read_pdu(events, sizeof(events)) == 2);
+	CU_ASSERT((events[0] >> 5) == FASTPATH_INPUT_EVENT_MOUSE);
+	CU_ASSERT(events[1] == (PTR_FLAGS_MOVE & 0xFF) && events[2] == (PTR_FLAGS_MOVE >> 8));
+	CU_ASSERT(events[3] == 14 && events[5] == 24);
+	CU_ASSERT((events[7] >> 5) == FASTPATH_INPUT_EVENT_MOUSE);
+	CU_ASSERT(events[9] == ((PTR_FLAGS_DOWN | PTR_FLAGS_BUTTON1) >> 8));
+
+	freerdp_input_send_keyboard_event(input, KBD_FLAGS_DOWN, 0x1E);
+	CU_ASSERT(input_read_pdu(events, sizeof(events)) == 1);
+	CU_ASSERT((events[0] >> 5) == FASTPATH_INPUT_EVENT_SCANCODE);
+	CU_ASSERT(events[1] == 0x1E);
+
+	CU_ASSERT(freerdp_input_get_stats(input, &stats) == true);
+	CU_ASSERT(stats.events == 3);
+	CU_ASSERT(stats.coalesced == 4);
+	CU_ASSERT(stats.pdus == 2);
+	CU_ASSERT(stats.max_events_per_pdu == 2);
+	CU_ASSERT(stats.events_per_pdu[1] == 1 && stats.events_per_pdu[2] == 1);
+}
+
+void test_input_batch(void)
+{
+	int i;
+	uint8 events[256];
+	INPUT_STATS stats;
+
+	input_setup(1000, false);
+
+	for (i = 0; i < INPUT_MAX_EVENTS_PER_PDU + 5; i++)
+		freerdp_input_send_mouse_event(input, PTR_FLAGS_MOVE, i, i);
+
+	/* a full PDU goes out, the rest waits */
+	CU_ASSERT(input_read_pdu(events, sizeof(events)) == INPUT_MAX_EVENTS_PER_PDU);
+	CU_ASSERT(events[(INPUT_MAX_EVENTS_PER_PDU - 1) * 7 + 3] == INPUT_MAX_EVENTS_PER_PDU - 1);
+	CU_ASSERT(input_read_pdu(events, sizeof(events)) == 0);
+
+	freerdp_input_flush(input);
+	CU_ASSERT(input_read_pdu(events, sizeof(events)) == 5);
+	CU_ASSERT(events[3] == INPUT_MAX_EVENTS_PER_PDU);
+
+	freerdp_input_get_stats(input, &stats);
+	CU_ASSERT(stats.events == INPUT_MAX_EVENTS_PER_PDU + 5);
+	CU_ASSERT(stats.coalesced == 0);
+	CU_ASSERT(stats.pdus == 2);
+	CU_ASSERT(stats.max_events_per_pdu == INPUT_MAX_EVENTS_PER_PDU);
+}
+
+void test_input_flush_timeout(void)
+{
+	int timeout;
+	uint8 events[256];
+
+	input_setup(20, true);
+
+	CU_ASSERT(freerdp_input_get_flush_timeout(input) == -1);
+
+	freerdp_input_send_mouse_event(input, PTR_FLAGS_MOVE, 1, 1);
+	timeout = freerdp_input_get_flush_timeout(input);
+	CU_ASSERT(timeout > 0 && timeout <= 20);
+
+	/* not due yet */
+	input_check_queue(input);
+	CU_ASSERT(input_read_pdu(events, sizeof(events)) == 0);
+
+	usleep(25000);
+	CU_ASSERT(freerdp_input_get_flush_timeout(input) == 0);
+
+	input_check_queue(input);
+	CU_ASSERT(input_read_pdu(events, sizeof(events)) == 1);
+	CU_ASSERT(freerdp_input_get_flush_timeout(input) == -1);
+}
@@ -18,12 +18,15 @@
  */
 
 #include <freerdp/freerdp.h>
+#include <freerdp/utils/sleep.h>
 #include <freerdp/utils/hexdump.h>
 #include <freerdp/utils/stream.h>
+#include <freerdp/utils/memory.h>
 
 #include "test_orders.h"
 #include "libfreerdp-core/orders.h"
 #include "libfreerdp-core/update.h"
+#include "libfreerdp-core/render.h"
 
 ORDER_INFO* orderInfo;
 
@@ -52,19 +55,25 @@ int add_orders_suite(void)
 	add_test_function(read_line_to_order);
 	add_test_function(read_polyline_order);
 	add_test_function(read_glyph_index_order);
+	add_test_function(write_glyph_index_order);
 	add_test_function(read_fast_index_order);
 	add_test_function(read_fast_glyph_order);
 	add_test_function(read_polygon_cb_order);
+	add_test_function(write_memblt_order);
 
 	add_test_function(read_cache_bitmap_order);
 	add_test_function(read_cache_bitmap_v2_order);
+	add_test_function(write_cache_bitmap_v2_order);
 	add_test_function(read_cache_bitmap_v3_order);
 	add_test_function(read_cache_brush_order);
+	add_test_function(write_cache_glyph_order);
+	add_test_function(write_cache_glyph_v2_order);
 
 	add_test_function(read_create_offscreen_bitmap_order);
 	add_test_function(read_switch_surface_order);
 
 	add_test_function(update_recv_orders);
+	add_test_function(update_recv_orders_async);
 
 	return 0;
 }
@@ -415,6 +424,65 @@ void test_read_glyph_index_order(void)
 	CU_ASSERT(stream_get_length(s) == (sizeof(glyph_index_order_2) - 1));
 }
 
+uint8 glyph_index_order_text[] =
+	"\x07\x03\x00\x00\xff\xff\xff\x80\x00\x00\x0c\x02\x6e\x01\x4d\x02"
+	"\x7b\x01\x09\x02\x6e\x01\xf6\x02\x7b\x01\x0c\x02\x79\x01\x04\x00"
+	"\x00\x01\x08";
+
+void test_write_glyph_index_order(void)
+{
+	STREAM _s, *s;
+	GLYPH_INDEX_ORDER glyph_index;
+	uint8 buffer[sizeof(glyph_index_order_text)];
+
+	s = &_s;
+	s->p = s->data = buffer;
+	s->size = sizeof(buffer);
+
+	memset(&glyph_index, 0, sizeof(GLYPH_INDEX_ORDER));
+	glyph_index.cacheId = 7;
+	glyph_index.flAccel = SO_FLAG_DEFAULT_PLACEMENT | SO_HORIZONTAL;
+	glyph_index.backColor = 0x00FFFFFF;
+	glyph_index.foreColor = 0x00000080;
+	glyph_index.bkLeft = 524;
+	glyph_index.bkTop = 366;
+	glyph_index.bkRight = 589;
+	glyph_index.bkBottom = 379;
+	glyph_index.opLeft = 521;
+	glyph_index.opTop = 366;
+	glyph_index.opRight = 758;
+	glyph_index.opBottom = 379;
+	glyph_index.x = 524;
+	glyph_index.y = 377;
+	glyph_index.cbData = 4;
+	memcpy(glyph_index.data, "\x00\x00\x01\x08", 4);
+
+	update_write_glyph_index_order(s, &glyph_index);
+
+	ASSERT_STREAM(s, glyph_index_order_text, sizeof(glyph_index_order_text) - 1);
+
+	/* and it reads back the same */
+	s->p = s->data;
+	memset(orderInfo, 0, sizeof(ORDER_INFO));
+	orderInfo->fieldFlags = GLYPH_INDEX_ORDER_TEXT_FIELDS;
+	memset(&glyph_index, 0, sizeof(GLYPH_INDEX_ORDER));
+
+	update_read_glyph_index_order(s, orderInfo, &glyph_index);
+
+	CU_ASSERT(glyph_index.cacheId == 7);
+	CU_ASSERT(glyph_index.flAccel == 3);
+	CU_ASSERT(glyph_index.backColor == 0x00FFFFFF);
+	CU_ASSERT(glyph_index.foreColor == 0x00000080);
+	CU_ASSERT(glyph_index.bkRight == 589);
+	CU_ASSERT(glyph_index.opRight == 758);
+	CU_ASSERT(glyph_index.x == 524);
+	CU_ASSERT(glyph_index.y == 377);
+	CU_ASSERT(glyph_index.cbData == 4);
+	CU_ASSERT(memcmp(glyph_index.data, "\x00\x00\x01\x08", 4) == 0);
+
+	CU_ASSERT(stream_get_length(s) == (sizeof(glyph_index_order_text) - 1));
+}
+
 uint8 fast_index_order[] =
 	"\x07\x00\x03\xff\xff\x00\x74\x3b\x00\x0e\x00\x71\x00\x42\x00\x7e"
 	"\x00\x00\x80\x7c\x00\x15\x00\x00\x01\x06\x02\x04\x03\x08\x05\x09"
@@ -523,6 +591,54 @@ void test_read_polygon_cb_order(void)
 	CU_ASSERT(stream_get_length(s) == (sizeof(polygon_cb_order) - 1));
 }
 
+uint8 memblt_order[] = "\x02\x01\x40\x00\x20\x00\x0a\x00\x40\x00\xcc\x00\x00\x00\x00\x2c\x01";
+
+void test_write_memblt_order(void)
+{
+	STREAM _s, *s;
+	MEMBLT_ORDER memblt;
+	uint8 buffer[sizeof(memblt_order)];
+
+	s = &_s;
+	s->p = s->data = buffer;
+	s->size = sizeof(buffer);
+
+	memset(&memblt, 0, sizeof(MEMBLT_ORDER));
+	memblt.cacheId = 2;
+	memblt.colorIndex = 1;
+	memblt.nLeftRect = 64;
+	memblt.nTopRect = 32;
+	memblt.nWidth = 10;
+	memblt.nHeight = 64;
+	memblt.bRop = 0xCC;
+	memblt.cacheIndex = 300;
+
+	update_write_memblt_order(s, &memblt);
+
+	ASSERT_STREAM(s, memblt_order, sizeof(memblt_order) - 1);
+
+	/* and it reads back the same */
+	s->p = s->data;
+	memset(orderInfo, 0, sizeof(ORDER_INFO));
+	orderInfo->fieldFlags = MEMBLT_ORDER_ALL_FIELDS;
+	memset(&memblt, 0, sizeof(MEMBLT_ORDER));
+
+	update_read_memblt_order(s, orderInfo, &memblt);
+
+	CU_ASSERT(memblt.cacheId == 2);
+	CU_ASSERT(memblt.colorIndex == 1);
+	CU_ASSERT(memblt.nLeftRect == 64);
+	CU_ASSERT(memblt.nTopRect == 32);
+	CU_ASSERT(memblt.nWidth == 10);
+	CU_ASSERT(memblt.nHeight == 64);
+	CU_ASSERT(memblt.bRop == 0xCC);
+	CU_ASSERT(memblt.nXSrc == 0);
+	CU_ASSERT(memblt.nYSrc == 0);
+	CU_ASSERT(memblt.cacheIndex == 300);
+
+	CU_ASSERT(stream_get_length(s) == (sizeof(memblt_order) - 1));
+}
+
 uint8 cache_bitmap_order[] = "\x00\x00\x10\x01\x08\x01\x00\x00\x00\x10";
 
 void test_read_cache_bitmap_order(void)
@@ -591,6 +707,28 @@ void test_read_cache_bitmap_v2_order(void)
 	CU_ASSERT(stream_get_length(s) == (sizeof(cache_bitmap_v2_order) - 1));
 }
 
+void test_write_cache_bitmap_v2_order(void)
+{
+	STREAM _s, *s;
+	uint16 extraFlags;
+	uint8 buffer[sizeof(cache_bitmap_v2_order)];
+	CACHE_BITMAP_V2_ORDER cache_bitmap_v2;
+
+	s = &_s;
+	s->p = s->data = cache_bitmap_v2_order;
+
+	memset(&cache_bitmap_v2, 0, sizeof(CACHE_BITMAP_V2_ORDER));
+	update_read_cache_bitmap_v2_order(s, &cache_bitmap_v2, true, 0x0CA1);
+
+	s->p = s->data = buffer;
+	s->size = sizeof(buffer);
+
+	update_write_cache_bitmap_v2_order(s, &cache_bitmap_v2, true, &extraFlags);
+
+	CU_ASSERT(extraFlags == 0x0CA1);
+	ASSERT_STREAM(s, cache_bitmap_v2_order, sizeof(cache_bitmap_v2_order) - 1);
+}
+
 uint8 cache_bitmap_v3_order[] =
 	"\xff\x7f\x35\x50\xec\xbc\x74\x52\x65\xb7\x20\x00\x00\x00\x05\x00"
 	"\x02\x00\x28\x00\x00\x00\x5b\x4f\x45\xff\x5b\x4f\x45\xff\x5b\x4f"
@@ -649,6 +787,112 @@ void test_read_cache_brush_order(void)
 	CU_ASSERT(stream_get_length(s) == (sizeof(cache_brush_order) - 1));
 }
 
+uint8 cache_glyph_order[] =
+	"\x03\x01\x05\x00\xff\xff\xf6\xff\x09\x00\x02\x00\xff\x80\x7f\x00";
+
+void test_write_cache_glyph_order(void)
+{
+	STREAM _s, *s;
+	uint16 extraFlags;
+	GLYPH_DATA glyph;
+	CACHE_GLYPH_ORDER cache_glyph;
+	uint8 buffer[sizeof(cache_glyph_order)];
+
+	s = &_s;
+	s->p = s->data = buffer;
+	s->size = sizeof(buffer);
+
+	glyph.cacheIndex = 5;
+	glyph.x = -1;
+	glyph.y = -10;
+	glyph.cx = 9;
+	glyph.cy = 2;
+	glyph.cb = 4;
+	glyph.aj = (uint8*) "\xff\x80\x7f\x00";
+
+	memset(&cache_glyph, 0, sizeof(CACHE_GLYPH_ORDER));
+	cache_glyph.cacheId = 3;
+	cache_glyph.cGlyphs = 1;
+	cache_glyph.glyphData[0] = &glyph;
+
+	update_write_cache_glyph_order(s, &cache_glyph, &extraFlags);
+
+	CU_ASSERT(extraFlags == 0);
+	ASSERT_STREAM(s, cache_glyph_order, sizeof(cache_glyph_order) - 1);
+
+	/* and it reads back the same */
+	s->p = s->data;
+	memset(&cache_glyph, 0, sizeof(CACHE_GLYPH_ORDER));
+
+	update_read_cache_glyph_order(s, &cache_glyph, extraFlags);
+
+	CU_ASSERT(cache_glyph.cacheId == 3);
+	CU_ASSERT(cache_glyph.cGlyphs == 1);
+	CU_ASSERT(cache_glyph.glyphData[0]->cacheIndex == 5);
+	CU_ASSERT(cache_glyph.glyphData[0]->x == -1);
+	CU_ASSERT(cache_glyph.glyphData[0]->y == -10);
+	CU_ASSERT(cache_glyph.glyphData[0]->cb == 4);
+	CU_ASSERT(memcmp(cache_glyph.glyphData[0]->aj, glyph.aj, 4) == 0);
+
+	CU_ASSERT(stream_get_length(s) == (sizeof(cache_glyph_order) - 1));
+
+	xfree(cache_glyph.glyphData[0]->aj);
+	xfree(cache_glyph.glyphData[0]);
+}
+
+uint8 cache_glyph_v2_order[] = "\x05\x80\x64\x4a\x09\x02\xff\x80\x7f\x00";
+
+void test_write_cache_glyph_v2_order(void)
+{
+	STREAM _s, *s;
+	uint16 extraFlags;
+	GLYPH_DATA_V2 glyph;
+	CACHE_GLYPH_V2_ORDER cache_glyph_v2;
+	uint8 buffer[sizeof(cache_glyph_v2_order)];
+
+	s = &_s;
+	s->p = s->data = buffer;
+	s->size = sizeof(buffer);
+
+	glyph.cacheIndex = 5;
+	glyph.x = 100;
+	glyph.y = -10;
+	glyph.cx = 9;
+	glyph.cy = 2;
+	glyph.cb = 4;
+	glyph.aj = (uint8*) "\xff\x80\x7f\x00";
+
+	memset(&cache_glyph_v2, 0, sizeof(CACHE_GLYPH_V2_ORDER));
+	cache_glyph_v2.cacheId = 3;
+	cache_glyph_v2.cGlyphs = 1;
+	cache_glyph_v2.glyphData[0] = &glyph;
+
+	update_write_cache_glyph_v2_order(s, &cache_glyph_v2, &extraFlags);
+
+	CU_ASSERT(extraFlags == 0x0103);
+	ASSERT_STREAM(s, cache_glyph_v2_order, sizeof(cache_glyph_v2_order) - 1);
+
+	/* and it reads back the same */
+	s->p = s->data;
+	memset(&cache_glyph_v2, 0, sizeof(CACHE_GLYPH_V2_ORDER));
+
+	update_read_cache_glyph_v2_order(s, &cache_glyph_v2, extraFlags);
+
+	CU_ASSERT(cache_glyph_v2.cacheId == 3);
+	CU_ASSERT(cache_glyph_v2.cGlyphs == 1);
+	CU_ASSERT(cache_glyph_v2.glyphData[0]->cacheIndex == 5);
+	CU_ASSERT(cache_glyph_v2.glyphData[0]->x == 100);
+	CU_ASSERT(cache_glyph_v2.glyphData[0]->y == -10);
+	CU_ASSERT(cache_glyph_v2.glyphData[0]->cx == 9);
+	CU_ASSERT(cache_glyph_v2.glyphData[0]->cy == 2);
+	CU_ASSERT(memcmp(cache_glyph_v2.glyphData[0]->aj, glyph.aj, 4) == 0);
+
+	CU_ASSERT(stream_get_length(s) == (sizeof(cache_glyph_v2_order) - 1));
+
+	xfree(cache_glyph_v2.glyphData[0]->aj);
+	xfree(cache_glyph_v2.glyphData[0]);
+}
+
 uint8 create_offscreen_bitmap_order[] = "\x00\x80\x60\x01\x10\x00\x01\x00\x02\x00";
 
 void test_read_create_offscreen_bitmap_order(void)
@@ -770,3 +1014,60 @@ void test_update_recv_orders(void)
 	free(update->context);
 }
 
+void test_update_recv_orders_async(void)
+{
+	rdpRdp* rdp;
+	STREAM _s, *s;
+	rdpUpdate* update;
+	RENDER_STATS stats;
+
+	s = &_s;
+	rdp = rdp_new(NULL);
+	update = rdp->update;
+
+	update->context = malloc(sizeof(rdpContext));
+	update->context->rdp = rdp;
+
+	opaque_rect_count = 0;
+	polyline_count = 0;
+	patblt_count = 0;
+
+	update->primary->OpaqueRect = test_opaque_rect;
+	update->primary->Polyline = test_polyline;
+	update->primary->PatBlt = test_patblt;
+
+	update->render = render_new(update);
+	render_start(update->render);
+
+	s->p = s->data = orders_update_1;
+	s->size = sizeof(orders_update_1);
+
+	update_recv(update, s);
+
+	update->primary->order_info.orderType = ORDER_TYPE_PATBLT;
+	s->p = s->data = orders_update_2;
+	s->size = sizeof(orders_update_2);
+
+	update_recv(update, s);
+
+	while (1)
+	{
+		render_get_stats(update->render, &stats);
+
+		if (stats.frames_rendered == stats.frames_decoded)
+			break;
+
+		freerdp_usleep(1000);
+	}
+
+	CU_ASSERT(stats.frames_decoded == 2);
+	CU_ASSERT(opaque_rect_count == 5);
+	CU_ASSERT(polyline_count == 2);
+	CU_ASSERT(patblt_count == 3);
+
+	render_stop(update->render);
+
+	CU_ASSERT(update->primary->PatBlt == test_patblt);
+
+	free(update->context);
+}
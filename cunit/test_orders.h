@@ -32,17 +32,23 @@ void test_read_multi_opaque_rect_order(void);
 void test_read_line_to_order(void);
 void test_read_polyline_order(void);
 void test_read_glyph_index_order(void);
+void test_write_glyph_index_order(void);
 void test_read_fast_index_order(void);
 void test_read_fast_glyph_order(void);
 void test_read_polygon_cb_order(void);
+void test_write_memblt_order(void);
 
 void test_read_cache_bitmap_order(void);
 void test_read_cache_bitmap_v2_order(void);
+void test_write_cache_bitmap_v2_order(void);
 void test_read_cache_bitmap_v3_order(void);
 void test_read_cache_brush_order(void);
+void test_write_cache_glyph_order(void);
+void test_write_cache_glyph_v2_order(void);
 
 void test_read_create_offscreen_bitmap_order(void);
 void test_read_switch_surface_order(void);
 
 void test_update_recv_orders(void);
+void test_update_recv_orders_async(void);
 
@@ -0,0 +1,96 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Audio Output Virtual Channel Unit Tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <freerdp/freerdp.h>
+
+#include "test_rdpsnd.h"
+#include "channels/rdpsnd/rdpsnd_jitter.h"
+
+int init_rdpsnd_suite(void)
+{
+	return 0;
+}
+
+int clean_rdpsnd_suite(void)
+{
+	return 0;
+}
+
+int add_rdpsnd_suite(void)
+{
+	add_test_suite(rdpsnd);
+
+	add_test_function(rdpsnd_jitter);
+
+	return 0;
+}
+
+void test_rdpsnd_jitter(void)
+{
+	int i;
+	uint32 now;
+	uint32 raised;
+	rdpsndJitter jitter;
+
+	rdpsnd_jitter_init(&jitter);
+	CU_ASSERT(jitter.target == RDPSND_JITTER_MIN);
+
+	/* 20 ms blocks arriving right on time */
+	now = 1000;
+	for (i = 0; i < 10; i++)
+	{
+		rdpsnd_jitter_arrival(&jitter, now, 20, -1);
+		rdpsnd_jitter_played(&jitter, 20);
+		now += 20;
+	}
+	CU_ASSERT(jitter.target == RDPSND_JITTER_MIN);
+
+	/* the device runs dry, the buffer has to grow */
+	rdpsnd_jitter_underrun(&jitter, -1);
+	raised = jitter.target;
+	CU_ASSERT(raised == RDPSND_JITTER_MIN + RDPSND_UNDERRUN_PENALTY);
+
+	/* refilling takes a while but plays nothing, the target must hold */
+	for (i = 0; i < 5; i++)
+	{
+		rdpsnd_jitter_arrival(&jitter, now, 20, -1);
+		now += 20;
+	}
+	CU_ASSERT(jitter.target == raised);
+
+	/* just short of one decay interval of playback */
+	for (i = 0; i < RDPSND_BOOST_DECAY_INTERVAL / 20 - 1; i++)
+		rdpsnd_jitter_played(&jitter, 20);
+	rdpsnd_jitter_arrival(&jitter, now, 20, -1);
+	now += 20;
+	CU_ASSERT(jitter.target == raised);
+
+	rdpsnd_jitter_played(&jitter, 20);
+	rdpsnd_jitter_arrival(&jitter, now, 20, -1);
+	now += 20;
+	CU_ASSERT(jitter.target == raised - RDPSND_BOOST_DECAY_STEP);
+
+	/* a long stretch of clean playback brings it back down */
+	for (i = 0; i < 1000; i++)
+		rdpsnd_jitter_played(&jitter, 20);
+	rdpsnd_jitter_arrival(&jitter, now, 20, -1);
+	CU_ASSERT(jitter.boost == 0);
+	CU_ASSERT(jitter.target == RDPSND_JITTER_MIN);
+}
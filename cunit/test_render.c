@@ -0,0 +1,147 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Asynchronous Update Rendering Unit Tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/sleep.h>
+#include <freerdp/utils/memory.h>
+
+#include "test_render.h"
+#include "libfreerdp-core/rdp.h"
+#include "libfreerdp-core/update.h"
+#include "libfreerdp-core/render.h"
+
+int init_render_suite(void)
+{
+	return 0;
+}
+
+int clean_render_suite(void)
+{
+	return 0;
+}
+
+int add_render_suite(void)
+{
+	add_test_suite(render);
+
+	add_test_function(render_restart);
+
+	return 0;
+}
+
+static int paint_count;
+static int opaque_rect_count;
+static int synchronize_count;
+
+static void test_begin_paint(rdpContext* context)
+{
+	paint_count++;
+}
+
+static void test_end_paint(rdpContext* context)
+{
+
+}
+
+static void test_opaque_rect(rdpContext* context, OPAQUE_RECT_ORDER* opaque_rect)
+{
+	opaque_rect_count++;
+}
+
+static void test_synchronize(rdpContext* context)
+{
+	synchronize_count++;
+}
+
+/* wait for the render thread to catch up, without blocking on a dead one */
+static uint32 test_render_wait(rdpRender* render, uint32 frames)
+{
+	int i;
+	RENDER_STATS stats;
+
+	for (i = 0; i < 200; i++)
+	{
+		render_get_stats(render, &stats);
+
+		if (stats.frames_rendered >= frames)
+			break;
+
+		freerdp_usleep(10000);
+	}
+
+	return stats.frames_rendered;
+}
+
+void test_render_restart(void)
+{
+	int i;
+	rdpRdp* rdp;
+	rdpUpdate* update;
+	rdpRender* render;
+	rdpContext* context;
+	OPAQUE_RECT_ORDER opaque_rect;
+
+	rdp = xnew(rdpRdp);
+	context = xnew(rdpContext);
+	update = update_new(rdp);
+
+	rdp->update = update;
+	context->rdp = rdp;
+	update->context = context;
+
+	update->BeginPaint = test_begin_paint;
+	update->EndPaint = test_end_paint;
+	update->Synchronize = test_synchronize;
+	update->primary->OpaqueRect = test_opaque_rect;
+
+	render = render_new(update);
+	update->render = render;
+
+	memset(&opaque_rect, 0, sizeof(OPAQUE_RECT_ORDER));
+
+	paint_count = 0;
+	opaque_rect_count = 0;
+	synchronize_count = 0;
+
+	/* the thread must come back up after a disconnect and reconnect */
+	for (i = 0; i < 3; i++)
+	{
+		render_start(render);
+		CU_ASSERT(update->BeginPaint != test_begin_paint);
+
+		IFCALL(update->BeginPaint, context);
+		IFCALL(update->primary->OpaqueRect, context, &opaque_rect);
+		IFCALL(update->EndPaint, context);
+		IFCALL(update->Synchronize, context);
+
+		CU_ASSERT(test_render_wait(render, 2 * (i + 1)) == 2 * (i + 1));
+
+		render_stop(render);
+		CU_ASSERT(update->BeginPaint == test_begin_paint);
+	}
+
+	CU_ASSERT(paint_count == 3);
+	CU_ASSERT(opaque_rect_count == 3);
+	CU_ASSERT(synchronize_count == 3);
+
+	update_free(update);
+	xfree(context);
+	xfree(rdp);
+}
@@ -182,6 +182,8 @@ int add_rfx_suite(void)
 	add_test_function(decode);
 	add_test_function(encode);
 	add_test_function(message);
+	add_test_function(tile_cache);
+	add_test_function(rate_control);
 
 	return 0;
 }
@@ -408,3 +410,196 @@ void test_message(void)
 	rfx_context_free(context);
 	free(rgb_data);
 }
+
+void test_tile_cache(void)
+{
+	STREAM* s;
+	uint8* image;
+	RFX_CONTEXT* context;
+	RFX_CONTEXT* decoder;
+	RFX_MESSAGE* message;
+	RFX_RECT rect = { 0, 0, 150, 100 };
+	RFX_RECT damage = { 70, 10, 100, 20 };
+	RFX_RECT small[2] = { { 10, 70, 8, 8 }, { 20, 74, 30, 4 } };
+	int i;
+
+	/* 3x2 tiles, the last column and row are partial */
+	image = (uint8*) xmalloc(150 * 100 * 4);
+	for (i = 0; i < 150 * 100 * 4; i++)
+		image[i] = i * 7;
+
+	s = stream_new(65536);
+
+	context = rfx_context_new();
+	context->mode = RLGR3;
+	context->width = 150;
+	context->height = 100;
+	rfx_context_set_pixel_format(context, RDP_PIXEL_FORMAT_B8G8R8A8);
+	rfx_context_set_tile_cache(context, true);
+
+	decoder = rfx_context_new();
+	decoder->mode = RLGR3;
+	rfx_context_set_pixel_format(decoder, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+	/* every tile is sent the first time, as a single rect per row of tiles */
+	rfx_compose_message(context, s, &rect, 1, image, 150, 100, 150 * 4);
+	CU_ASSERT(stream_get_length(s) > 0);
+	message = rfx_process_message(decoder, stream_get_head(s), stream_get_length(s));
+	CU_ASSERT(message->num_tiles == 6);
+	CU_ASSERT(message->num_rects == 2);
+	CU_ASSERT(message->rects[0].width == 150 && message->rects[0].height == 64);
+	CU_ASSERT(message->rects[1].y == 64 && message->rects[1].height == 36);
+	rfx_message_free(decoder, message);
+
+	/* nothing changed, nothing is written */
+	stream_set_pos(s, 0);
+	rfx_compose_message(context, s, &rect, 1, image, 150, 100, 150 * 4);
+	CU_ASSERT(stream_get_pos(s) == 0);
+
+	/* a change in tile (0, 1), outside of the damage, is not looked at */
+	image[(80 * 150 + 10) * 4] ^= 0xFF;
+	/* the damage covers tiles (1, 0) and (2, 0), only (1, 0) has changed */
+	image[(20 * 150 + 100) * 4 + 1] ^= 0xFF;
+	stream_set_pos(s, 0);
+	rfx_compose_message(context, s, &damage, 1, image, 150, 100, 150 * 4);
+	stream_seal(s);
+	message = rfx_process_message(decoder, stream_get_head(s), stream_get_length(s));
+	CU_ASSERT(message->num_tiles == 1);
+	CU_ASSERT(message->num_rects == 1);
+	CU_ASSERT(message->rects[0].x == 70 && message->rects[0].y == 10);
+	CU_ASSERT(message->rects[0].width == 58 && message->rects[0].height == 20);
+	rfx_message_free(decoder, message);
+
+	/* damage smaller than a tile, the rest of the tile is not shown */
+	stream_set_pos(s, 0);
+	rfx_compose_message(context, s, small, 2, image, 150, 100, 150 * 4);
+	stream_seal(s);
+	message = rfx_process_message(decoder, stream_get_head(s), stream_get_length(s));
+	CU_ASSERT(message->num_tiles == 1);
+	CU_ASSERT(message->tiles[0]->x == 0 && message->tiles[0]->y == 64);
+	CU_ASSERT(message->num_rects == 2);
+	CU_ASSERT(message->rects[0].x == 10 && message->rects[0].y == 70);
+	CU_ASSERT(message->rects[0].width == 8 && message->rects[0].height == 8);
+	CU_ASSERT(message->rects[1].x == 20 && message->rects[1].y == 74);
+	CU_ASSERT(message->rects[1].width == 30 && message->rects[1].height == 4);
+	rfx_message_free(decoder, message);
+
+	/* after a reset, all the damaged tiles have to be sent again */
+	rfx_context_reset(context);
+	stream_set_pos(s, 0);
+	rfx_compose_message(context, s, &damage, 1, image, 150, 100, 150 * 4);
+	stream_seal(s);
+	message = rfx_process_message(decoder, stream_get_head(s), stream_get_length(s));
+	CU_ASSERT(message->num_tiles == 2);
+	rfx_message_free(decoder, message);
+
+	rfx_context_free(decoder);
+	rfx_context_free(context);
+	stream_free(s);
+	xfree(image);
+}
+
+void test_rate_control(void)
+{
+	STREAM* s;
+	uint8* image;
+	RFX_CONTEXT* context;
+	RFX_CONTEXT* decoder;
+	RFX_MESSAGE* message;
+	RFX_RECT rect = { 0, 0, 150, 100 };
+	RFX_RECT damage = { 0, 0, 10, 10 };
+	uint64 time;
+	uint64 sent;
+	int i;
+
+	context = rfx_context_new();
+	context->mode = RLGR3;
+	context->width = 150;
+	context->height = 100;
+	rfx_context_set_pixel_format(context, RDP_PIXEL_FORMAT_B8G8R8A8);
+	rfx_context_set_rate_control(context, true, 1000000);
+
+	/* 1MB/s sent with 200KB queued on a 1Mbit/s target, the quality goes down at once */
+	time = 1000000;
+	sent = 0;
+	rfx_context_rate_feedback(context, time, sent, 0);
+	CU_ASSERT(rfx_context_get_quality_level(context) == 0);
+	time += 100000;
+	sent += 100000;
+	rfx_context_rate_feedback(context, time, sent, 200000);
+	CU_ASSERT(rfx_context_get_quality_level(context) == 1);
+
+	/* but never below the coarsest level */
+	for (i = 0; i < 20; i++)
+	{
+		time += 100000;
+		sent += 100000;
+		rfx_context_rate_feedback(context, time, sent, 200000);
+	}
+	CU_ASSERT(rfx_context_get_quality_level(context) == RFX_QUALITY_LEVELS - 1);
+
+	/* once the link is idle it slowly comes back up */
+	time += 100000;
+	rfx_context_rate_feedback(context, time, sent, 0);
+	CU_ASSERT(rfx_context_get_quality_level(context) == RFX_QUALITY_LEVELS - 1);
+	for (i = 0; i < 100; i++)
+	{
+		time += 100000;
+		rfx_context_rate_feedback(context, time, sent, 0);
+	}
+	CU_ASSERT(rfx_context_get_quality_level(context) == 0);
+
+	image = (uint8*) xmalloc(150 * 100 * 4);
+	for (i = 0; i < 150 * 100 * 4; i++)
+		image[i] = i * 7;
+
+	s = stream_new(65536);
+	rfx_context_set_tile_cache(context, true);
+
+	decoder = rfx_context_new();
+	decoder->mode = RLGR3;
+	rfx_context_set_pixel_format(decoder, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+	rfx_compose_message(context, s, &rect, 1, image, 150, 100, 150 * 4);
+	stream_seal(s);
+	message = rfx_process_message(decoder, stream_get_head(s), stream_get_length(s));
+	CU_ASSERT(message->num_tiles == 6);
+	CU_ASSERT(decoder->num_quants == RFX_QUALITY_LEVELS);
+	rfx_message_free(decoder, message);
+
+	/* tile (0, 0) keeps changing, it ends up sent at a coarser level */
+	for (i = 0; i < 3; i++)
+	{
+		image[i * 4] ^= 0xFF;
+		stream_set_pos(s, 0);
+		rfx_compose_message(context, s, &damage, 1, image, 150, 100, 150 * 4);
+		CU_ASSERT(stream_get_pos(s) > 0);
+	}
+
+	/* once it stopped changing for 8 messages, it is sent again */
+	for (i = 0; i < 7; i++)
+	{
+		stream_set_pos(s, 0);
+		rfx_compose_message(context, s, NULL, 0, image, 150, 100, 150 * 4);
+		CU_ASSERT(stream_get_pos(s) == 0);
+	}
+
+	stream_set_pos(s, 0);
+	rfx_compose_message(context, s, NULL, 0, image, 150, 100, 150 * 4);
+	stream_seal(s);
+	message = rfx_process_message(decoder, stream_get_head(s), stream_get_length(s));
+	CU_ASSERT(message->num_tiles == 1);
+	CU_ASSERT(message->num_rects == 1);
+	CU_ASSERT(message->tiles[0]->x == 0 && message->tiles[0]->y == 0);
+	rfx_message_free(decoder, message);
+
+	/* and only once */
+	stream_set_pos(s, 0);
+	rfx_compose_message(context, s, NULL, 0, image, 150, 100, 150 * 4);
+	CU_ASSERT(stream_get_pos(s) == 0);
+
+	rfx_context_free(decoder);
+	rfx_context_free(context);
+	stream_free(s);
+	xfree(image);
+}
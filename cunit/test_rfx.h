@@ -32,3 +32,5 @@ void test_dwt(void);
 void test_decode(void);
 void test_encode(void);
 void test_message(void);
+void test_tile_cache(void);
+void test_rate_control(void);
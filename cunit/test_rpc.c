@@ -0,0 +1,493 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * RPC over HTTP Unit Tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#include "rpc.h"
+#include "rts.h"
+#include "transport.h"
+
+#include <freerdp/freerdp.h>
+#include <freerdp/settings.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/stream.h>
+
+#include "test_rpc.h"
+
+/**
+ * Mock gateway: the proxy ends of the IN and OUT channels live in this
+ * process, joined to the client ends by in-memory BIO pairs. The client
+ * sees a non-blocking connection holding exactly what the gateway wrote.
+ */
+
+#define MOCK_BIO_SIZE		0x40000
+#define MOCK_CALL_ID		2
+#define MOCK_AUTH_LENGTH	16
+
+struct _MOCK_CHANNEL
+{
+	SSL* server;
+	rdpTls* client;
+};
+typedef struct _MOCK_CHANNEL MOCK_CHANNEL;
+
+static SSL_CTX* server_ctx;
+static SSL_CTX* client_ctx;
+static MOCK_CHANNEL in_channel;
+static MOCK_CHANNEL out_channel;
+
+static freerdp* instance;
+static rdpSettings* settings;
+static rdpTransport* transport;
+static rdpRpc* rpc;
+
+static EVP_PKEY* mock_gateway_key_new(void)
+{
+	EVP_PKEY* pkey = NULL;
+	EVP_PKEY_CTX* ctx;
+
+	ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+	EVP_PKEY_keygen_init(ctx);
+	EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048);
+	EVP_PKEY_keygen(ctx, &pkey);
+	EVP_PKEY_CTX_free(ctx);
+
+	return pkey;
+}
+
+static X509* mock_gateway_certificate_new(EVP_PKEY* pkey)
+{
+	X509* x509;
+	X509_NAME* name;
+
+	x509 = X509_new();
+	X509_set_version(x509, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+	X509_gmtime_adj(X509_get_notBefore(x509), 0);
+	X509_gmtime_adj(X509_get_notAfter(x509), 3600);
+	X509_set_pubkey(x509, pkey);
+
+	name = X509_get_subject_name(x509);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (unsigned char*) "localhost", -1, -1, 0);
+	X509_set_issuer_name(x509, name);
+	X509_sign(x509, pkey, EVP_sha256());
+
+	return x509;
+}
+
+static boolean mock_channel_open(MOCK_CHANNEL* channel)
+{
+	int i;
+	BIO* client_bio;
+	BIO* server_bio;
+	int client_status = 0;
+	int server_status = 0;
+
+	BIO_new_bio_pair(&client_bio, MOCK_BIO_SIZE, &server_bio, MOCK_BIO_SIZE);
+
+	channel->client = xnew(rdpTls);
+	channel->client->ssl = SSL_new(client_ctx);
+	SSL_set_bio(channel->client->ssl, client_bio, client_bio);
+	SSL_set_connect_state(channel->client->ssl);
+
+	channel->server = SSL_new(server_ctx);
+	SSL_set_bio(channel->server, server_bio, server_bio);
+	SSL_set_accept_state(channel->server);
+
+	/* each side runs until it needs what the other one has not written yet */
+	for (i = 0; i < 16 && (client_status != 1 || server_status != 1); i++)
+	{
+		if (client_status != 1)
+			client_status = SSL_do_handshake(channel->client->ssl);
+
+		if (server_status != 1)
+			server_status = SSL_do_handshake(channel->server);
+	}
+
+	return (client_status == 1 && server_status == 1) ? true : false;
+}
+
+static void mock_channel_close(MOCK_CHANNEL* channel)
+{
+	SSL_free(channel->client->ssl);
+	xfree(channel->client);
+	SSL_free(channel->server);
+}
+
+/* write to the OUT channel, every call ends up in its own TLS record */
+static void mock_gateway_write(uint8* data, int length)
+{
+	int status;
+
+	while (length > 0)
+	{
+		status = SSL_write(out_channel.server, data, length);
+
+		if (status <= 0)
+			break;
+
+		data += status;
+		length -= status;
+	}
+}
+
+/* read what the client sent on the IN channel, 0 when there is nothing */
+static int mock_gateway_read(uint8* data, int length)
+{
+	int status;
+
+	status = SSL_read(in_channel.server, data, length);
+
+	return (status > 0) ? status : 0;
+}
+
+static void mock_stub_fill(uint8* stub, int length, uint8 seed)
+{
+	int i;
+
+	for (i = 0; i < length; i++)
+		stub[i] = (uint8) (seed + i * 7);
+}
+
+/* a response PDU as sent by the gateway, with an NTLM verifier */
+static int mock_response_write(STREAM* s, uint8* stub, int stub_length, uint32 alloc_hint)
+{
+	int frag_length;
+	int auth_pad_length;
+
+	auth_pad_length = (4 - (stub_length % 4)) % 4;
+	frag_length = 24 + stub_length + auth_pad_length + 8 + MOCK_AUTH_LENGTH;
+
+	stream_check_size(s, frag_length);
+
+	stream_write_uint8(s, 5); /* rpc_vers (1 byte) */
+	stream_write_uint8(s, 0); /* rpc_vers_minor (1 byte) */
+	stream_write_uint8(s, PTYPE_RESPONSE); /* PTYPE (1 byte) */
+	stream_write_uint8(s, PFC_FIRST_FRAG | PFC_LAST_FRAG); /* pfc_flags (1 byte) */
+	stream_write_uint32(s, 0x00000010); /* packed_drep (4 bytes) */
+	stream_write_uint16(s, frag_length); /* frag_length (2 bytes) */
+	stream_write_uint16(s, MOCK_AUTH_LENGTH); /* auth_length (2 bytes) */
+	stream_write_uint32(s, MOCK_CALL_ID); /* call_id (4 bytes) */
+	stream_write_uint32(s, alloc_hint); /* alloc_hint (4 bytes) */
+	stream_write_uint16(s, 0); /* p_cont_id (2 bytes) */
+	stream_write_uint8(s, 0); /* cancel_count (1 byte) */
+	stream_write_uint8(s, 0); /* reserved (1 byte) */
+
+	stream_write(s, stub, stub_length);
+	stream_write_zero(s, auth_pad_length);
+
+	stream_write_uint8(s, 0x0A); /* auth_type (1 byte) */
+	stream_write_uint8(s, 0x06); /* auth_level (1 byte) */
+	stream_write_uint8(s, auth_pad_length); /* auth_pad_length (1 byte) */
+	stream_write_uint8(s, 0); /* auth_reserved (1 byte) */
+	stream_write_uint32(s, 0); /* auth_context_id (4 bytes) */
+	stream_write_zero(s, MOCK_AUTH_LENGTH); /* auth_value */
+
+	return frag_length;
+}
+
+static int mock_gateway_send_response(uint8 seed, int stub_length)
+{
+	STREAM* s;
+	uint8* stub;
+	int frag_length;
+
+	s = stream_new(1024);
+	stub = (uint8*) xmalloc(stub_length);
+	mock_stub_fill(stub, stub_length, seed);
+
+	frag_length = mock_response_write(s, stub, stub_length, stub_length);
+	mock_gateway_write(s->data, stream_get_length(s));
+
+	xfree(stub);
+	stream_free(s);
+
+	return frag_length;
+}
+
+static boolean mock_stub_check(uint8* data, int length, uint8 seed, int offset)
+{
+	int i;
+
+	for (i = 0; i < length; i++)
+	{
+		if (data[i] != (uint8) (seed + (offset + i) * 7))
+			return false;
+	}
+
+	return true;
+}
+
+int init_rpc_suite(void)
+{
+	X509* x509;
+	EVP_PKEY* pkey;
+
+	SSL_load_error_strings();
+	SSL_library_init();
+
+	pkey = mock_gateway_key_new();
+	x509 = mock_gateway_certificate_new(pkey);
+
+	server_ctx = SSL_CTX_new(SSLv23_server_method());
+	SSL_CTX_use_certificate(server_ctx, x509);
+	SSL_CTX_use_PrivateKey(server_ctx, pkey);
+	client_ctx = SSL_CTX_new(SSLv23_client_method());
+
+	X509_free(x509);
+	EVP_PKEY_free(pkey);
+
+	if (!mock_channel_open(&in_channel) || !mock_channel_open(&out_channel))
+		return -1;
+
+	instance = freerdp_new();
+	settings = instance->settings = settings_new(instance);
+	settings->tsg_hostname = xstrdup("localhost");
+	transport = transport_new(settings);
+
+	/* never wait on the mock gateway, reads return 0 when it has nothing more */
+	transport->blocking = false;
+
+	rpc = rpc_new(transport);
+	rpc->tls_in = in_channel.client;
+	rpc->tls_out = out_channel.client;
+
+	return 0;
+}
+
+int clean_rpc_suite(void)
+{
+	rpc_free(rpc);
+	transport_free(transport);
+	settings_free(settings);
+	freerdp_free(instance);
+
+	mock_channel_close(&in_channel);
+	mock_channel_close(&out_channel);
+
+	SSL_CTX_free(server_ctx);
+	SSL_CTX_free(client_ctx);
+
+	return 0;
+}
+
+int add_rpc_suite(void)
+{
+	add_test_suite(rpc);
+
+	add_test_function(rpc_read);
+	add_test_function(rpc_read_partial);
+	add_test_function(rpc_read_nonblocking);
+	add_test_function(rpc_rts_ping);
+	add_test_function(rpc_flow_control);
+
+	return 0;
+}
+
+void test_rpc_read(void)
+{
+	STREAM* s;
+	uint8* stub;
+	uint8 data[0x8000];
+
+	mock_gateway_send_response(0x11, 1000);
+	mock_gateway_send_response(0x22, 3000);
+	mock_gateway_send_response(0x33, 17);
+
+	/* every call returns one response */
+	CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 1000);
+	CU_ASSERT(mock_stub_check(data, 1000, 0x11, 0));
+	CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 3000);
+	CU_ASSERT(mock_stub_check(data, 3000, 0x22, 0));
+	CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 17);
+	CU_ASSERT(mock_stub_check(data, 17, 0x33, 0));
+	CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 0);
+
+	/* a response split over two fragments, alloc_hint covers what is left */
+	s = stream_new(4096);
+	stub = (uint8*) xmalloc(1200);
+	mock_stub_fill(stub, 1200, 0x44);
+	mock_response_write(s, stub, 500, 1200);
+	mock_response_write(s, stub + 500, 700, 700);
+	mock_gateway_write(s->data, stream_get_length(s));
+	xfree(stub);
+	stream_free(s);
+
+	CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 1200);
+	CU_ASSERT(mock_stub_check(data, 1200, 0x44, 0));
+	CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 0);
+}
+
+void test_rpc_read_partial(void)
+{
+	int i;
+	uint8 data[1024];
+
+	mock_gateway_send_response(0x55, 5000);
+
+	/* what does not fit stays in the receive buffer for the next call */
+	for (i = 0; i < 4; i++)
+	{
+		CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 1024);
+		CU_ASSERT(mock_stub_check(data, 1024, 0x55, i * 1024));
+		CU_ASSERT(rpc_recv_pending(rpc) == true);
+	}
+
+	CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 904);
+	CU_ASSERT(mock_stub_check(data, 904, 0x55, 4096));
+	CU_ASSERT(rpc_recv_pending(rpc) == false);
+	CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 0);
+}
+
+void test_rpc_read_nonblocking(void)
+{
+	STREAM* s;
+	uint8* stub;
+	int frag_length;
+	uint8 data[4096];
+
+	s = stream_new(4096);
+	stub = (uint8*) xmalloc(2000);
+	mock_stub_fill(stub, 2000, 0x66);
+	frag_length = mock_response_write(s, stub, 2000, 2000);
+	mock_response_write(s, stub, 100, 100);
+	xfree(stub);
+
+	/* the header is not complete yet */
+	mock_gateway_write(s->data, 10);
+	CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 0);
+	CU_ASSERT(rpc_recv_pending(rpc) == false);
+
+	/* the header is, the fragment is not */
+	mock_gateway_write(s->data + 10, 100);
+	CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 0);
+	CU_ASSERT(rpc_recv_pending(rpc) == false);
+
+	/* the rest of the first fragment along with all of the second */
+	mock_gateway_write(s->data + 110, stream_get_length(s) - 110);
+	CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 2000);
+	CU_ASSERT(mock_stub_check(data, 2000, 0x66, 0));
+
+	/* the second fragment was read along with the first one, polling the socket would miss it */
+	CU_ASSERT(rpc_recv_pending(rpc) == true);
+	CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 100);
+	CU_ASSERT(mock_stub_check(data, 100, 0x66, 0));
+	CU_ASSERT(rpc_recv_pending(rpc) == false);
+	CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 0);
+
+	CU_ASSERT(frag_length == 24 + 2000 + 8 + MOCK_AUTH_LENGTH);
+	stream_free(s);
+}
+
+void test_rpc_rts_ping(void)
+{
+	STREAM* s;
+	uint32 BytesReceived;
+	uint8 data[4096];
+	RTS_PDU_HEADER header;
+	int frag_length;
+
+	header.rpc_vers = 5;
+	header.rpc_vers_minor = 0;
+	header.ptype = PTYPE_RTS;
+	header.pfc_flags = PFC_FIRST_FRAG | PFC_LAST_FRAG;
+	header.packed_drep[0] = 0x10;
+	header.packed_drep[1] = 0x00;
+	header.packed_drep[2] = 0x00;
+	header.packed_drep[3] = 0x00;
+	header.frag_length = 20;
+	header.auth_length = 0;
+	header.call_id = 0;
+	header.flags = RTS_FLAG_PING;
+	header.numberOfCommands = 0;
+
+	s = stream_new(20);
+	rts_pdu_header_write(s, &header);
+	mock_gateway_write(s->data, 20);
+	stream_free(s);
+
+	while (mock_gateway_read(data, sizeof(data)) > 0);
+
+	BytesReceived = rpc->VirtualConnection->DefaultOutChannel->BytesReceived;
+	frag_length = mock_gateway_send_response(0x77, 64);
+
+	/* the ping is answered on the IN channel and does not reach the caller */
+	CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 64);
+	CU_ASSERT(mock_stub_check(data, 64, 0x77, 0));
+	CU_ASSERT(mock_gateway_read(data, sizeof(data)) == 28);
+	CU_ASSERT(data[2] == PTYPE_RTS);
+
+	/* RTS PDUs are not subject to flow control */
+	CU_ASSERT(rpc->VirtualConnection->DefaultOutChannel->BytesReceived == BytesReceived + frag_length);
+}
+
+void test_rpc_flow_control(void)
+{
+	int i;
+	int length;
+	int frag_length = 0;
+	uint8 data[4096];
+	uint32 BytesReceived;
+	uint32 AvailableWindow;
+	RpcOutChannel* out = rpc->VirtualConnection->DefaultOutChannel;
+
+	out->BytesReceived = 0;
+	out->ReceiverAvailableWindow = out->ReceiveWindow;
+	out->AvailableWindowAdvertised = out->ReceiveWindow;
+
+	while (mock_gateway_read(data, sizeof(data)) > 0);
+
+	/* 7 fragments leave the proxy with more than half of the window */
+	for (i = 0; i < 7; i++)
+	{
+		frag_length = mock_gateway_send_response(i, 4096);
+		CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 4096);
+	}
+
+	CU_ASSERT(frag_length * 7 < out->ReceiveWindow / 2);
+	CU_ASSERT(mock_gateway_read(data, sizeof(data)) == 0);
+
+	/* the 8th one crosses the half */
+	mock_gateway_send_response(7, 4096);
+	CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 4096);
+	CU_ASSERT(mock_stub_check(data, 4096, 7, 0));
+
+	length = mock_gateway_read(data, sizeof(data));
+	CU_ASSERT(length == 56);
+
+	if (length == 56)
+	{
+		BytesReceived = data[32] | (data[33] << 8) | (data[34] << 16) | (data[35] << 24);
+		AvailableWindow = data[36] | (data[37] << 8) | (data[38] << 16) | (data[39] << 24);
+
+		CU_ASSERT(data[2] == PTYPE_RTS);
+		CU_ASSERT(data[28] == RTS_CMD_FLOW_CONTROL_ACK);
+		CU_ASSERT(BytesReceived == frag_length * 8);
+		CU_ASSERT(AvailableWindow == out->ReceiveWindow);
+	}
+
+	/* the ack restores the window the proxy sees */
+	for (i = 0; i < 7; i++)
+	{
+		mock_gateway_send_response(i, 4096);
+		CU_ASSERT(rpc_read(rpc, data, sizeof(data)) == 4096);
+	}
+
+	CU_ASSERT(mock_gateway_read(data, sizeof(data)) == 0);
+}
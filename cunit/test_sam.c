@@ -0,0 +1,116 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Security Accounts Manager Unit Tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <freerdp/utils/sleep.h>
+
+#include "test_sam.h"
+
+/**
+ * A private copy of the SAM code working on a scratch file, renamed so that
+ * it does not clash with the one winpr-sspi brings in.
+ */
+#define WINPR_SAM_FILE		"test_sam.tmp"
+#define SamOpen			test_SamOpen
+#define SamLookupStart		test_SamLookupStart
+#define SamLookupFinish		test_SamLookupFinish
+#define HexStrToBin		test_HexStrToBin
+#define SamReadEntry		test_SamReadEntry
+#define SamFreeEntry		test_SamFreeEntry
+#define SamLookupUserA		test_SamLookupUserA
+#define SamLookupUserW		test_SamLookupUserW
+#define SamClose		test_SamClose
+
+#include "winpr/utils/sam.c"
+
+#define TEST_SAM_LM_HASH	"00000000000000000000000000000000"
+
+int init_sam_suite(void)
+{
+	return 0;
+}
+
+int clean_sam_suite(void)
+{
+	SamCacheFree(&sam_cache);
+	remove(WINPR_SAM_FILE);
+	return 0;
+}
+
+int add_sam_suite(void)
+{
+	add_test_suite(sam);
+
+	add_test_function(sam_reload);
+
+	return 0;
+}
+
+static void test_sam_write(const char* filename, const char* nt_hash)
+{
+	FILE* fp;
+
+	fp = fopen(filename, "w");
+
+	if (fp != NULL)
+	{
+		fprintf(fp, "# test accounts\n");
+		fprintf(fp, "Alice::%s:%s:::\n", TEST_SAM_LM_HASH, nt_hash);
+		fclose(fp);
+	}
+}
+
+/* the first byte of the NT hash of Alice, or -1 */
+static int test_sam_lookup(void)
+{
+	int value = -1;
+	WINPR_SAM_ENTRY* entry;
+
+	entry = SamLookupUserA(NULL, "alice", 5, NULL, 0);
+
+	if (entry != NULL)
+	{
+		value = entry->NtHash[0];
+		SamFreeEntry(NULL, entry);
+	}
+
+	return value;
+}
+
+void test_sam_reload(void)
+{
+	test_sam_write(WINPR_SAM_FILE, "11111111111111111111111111111111");
+	CU_ASSERT(test_sam_lookup() == 0x11);
+
+	/* rewritten in place, same size and almost certainly the same second */
+	freerdp_usleep(50000);
+	test_sam_write(WINPR_SAM_FILE, "22222222222222222222222222222222");
+	CU_ASSERT(test_sam_lookup() == 0x22);
+
+	/* replaced by a new file, the usual way to update it atomically */
+	test_sam_write(WINPR_SAM_FILE ".new", "33333333333333333333333333333333");
+#ifdef _WIN32
+	remove(WINPR_SAM_FILE);
+#endif
+	CU_ASSERT(rename(WINPR_SAM_FILE ".new", WINPR_SAM_FILE) == 0);
+	CU_ASSERT(test_sam_lookup() == 0x33);
+
+	/* nothing changed, the cached copy answers */
+	CU_ASSERT(test_sam_lookup() == 0x33);
+}
@@ -37,6 +37,9 @@
 #include <freerdp/utils/passphrase.h>
 #include <freerdp/utils/signal.h>
 #include <freerdp/utils/memory.h>
+#include <freerdp/utils/metrics.h>
+#include <freerdp/utils/buffer_pool.h>
+#include <freerdp/utils/unicode.h>
 
 #include "test_utils.h"
 
@@ -61,6 +64,9 @@ int add_utils_suite(void)
 	add_test_function(args);
 	add_test_function(passphrase_read);
 	add_test_function(handle_signals);
+	add_test_function(metrics);
+	add_test_function(buffer_pool);
+	add_test_function(unicode);
 
 	return 0;
 }
@@ -671,3 +677,179 @@ void test_handle_signals(void)
 {
 	handle_signals_resets_terminal();
 }
+
+void test_metrics(void)
+{
+	int i;
+	rdpMetrics* metrics;
+	METRICS_SNAPSHOT snapshot;
+	METRICS_HISTOGRAM_VALUE* histogram;
+
+	/* a missing registry is ignored */
+	metrics_count(NULL, METRICS_BYTES_IN, 1);
+	metrics_record(NULL, METRICS_RFX_DECODE, 1);
+	metrics_snapshot(NULL, &snapshot);
+	CU_ASSERT(snapshot.counters[METRICS_BYTES_IN] == 0);
+
+	metrics = metrics_new();
+
+	metrics_count(metrics, METRICS_BYTES_IN, 100);
+	metrics_count(metrics, METRICS_BYTES_IN, 23);
+	metrics_gauge(metrics, METRICS_RENDER_QUEUE, 3);
+	metrics_gauge(metrics, METRICS_RENDER_QUEUE, 1);
+	metrics_pdu_in(metrics, METRICS_PDU_FASTPATH_UPDATE(0x04), 1000);
+	metrics_pdu_out(metrics, METRICS_PDU_DATA(0x1C), 12);
+
+	/* 90 samples at 0us, 9 at 100us and one at 5000us */
+	for (i = 0; i < 90; i++)
+		metrics_record(metrics, METRICS_RFX_DECODE, 0);
+	for (i = 0; i < 9; i++)
+		metrics_record(metrics, METRICS_RFX_DECODE, 100);
+	metrics_record(metrics, METRICS_RFX_DECODE, 5000);
+
+	metrics_snapshot(metrics, &snapshot);
+
+	CU_ASSERT(snapshot.counters[METRICS_BYTES_IN] == 123);
+	CU_ASSERT(snapshot.counters[METRICS_BYTES_OUT] == 0);
+	CU_ASSERT(snapshot.gauges[METRICS_RENDER_QUEUE].value == 1);
+	CU_ASSERT(snapshot.gauges[METRICS_RENDER_QUEUE].max == 3);
+	CU_ASSERT(snapshot.pdu_in[METRICS_PDU_FASTPATH_UPDATE(0x04)].count == 1);
+	CU_ASSERT(snapshot.pdu_in[METRICS_PDU_FASTPATH_UPDATE(0x04)].bytes == 1000);
+	CU_ASSERT(snapshot.pdu_out[METRICS_PDU_DATA(0x1C)].bytes == 12);
+
+	histogram = &snapshot.histograms[METRICS_RFX_DECODE];
+	CU_ASSERT(histogram->count == 100);
+	CU_ASSERT(histogram->sum == 9 * 100 + 5000);
+	CU_ASSERT(histogram->max == 5000);
+	CU_ASSERT(histogram->buckets[0] == 90);
+	CU_ASSERT(histogram->buckets[7] == 9); /* [64, 128) */
+	CU_ASSERT(histogram->buckets[13] == 1); /* [4096, 8192) */
+	CU_ASSERT(metrics_histogram_percentile(histogram, 50) == 1);
+	CU_ASSERT(metrics_histogram_percentile(histogram, 99) == 128);
+	CU_ASSERT(metrics_histogram_percentile(histogram, 100) == 5000);
+
+	CU_ASSERT(strcmp(metrics_counter_name(METRICS_FRAMES), "frames") == 0);
+	CU_ASSERT(strcmp(metrics_histogram_name(METRICS_GDI_SURFACE_BITS), "gdi_surface_bits") == 0);
+	CU_ASSERT(metrics_counter_name(METRICS_COUNTER_COUNT) == NULL);
+
+	metrics_reset(metrics);
+	metrics_snapshot(metrics, &snapshot);
+	CU_ASSERT(snapshot.counters[METRICS_BYTES_IN] == 0);
+	CU_ASSERT(snapshot.histograms[METRICS_RFX_DECODE].count == 0);
+
+	metrics_free(metrics);
+}
+
+void test_buffer_pool(void)
+{
+	uint8* a;
+	uint8* b;
+	uint8* c;
+	BUFFER_POOL* pool;
+
+	pool = buffer_pool_new(1);
+
+	a = buffer_pool_get(pool, 1000);
+	b = buffer_pool_get(pool, 1000);
+	CU_ASSERT(a != NULL && b != NULL && a != b);
+	CU_ASSERT(((uintptr_t) a & 15) == 0);
+	CU_ASSERT(buffer_pool_get_size(a) == 1000);
+	memset(a, 0xAA, 1000);
+
+	/* only one idle buffer is kept, the other one is released */
+	buffer_pool_put(a);
+	buffer_pool_put(b);
+	c = buffer_pool_get(pool, 1000);
+	CU_ASSERT(c == a);
+
+	/* a new size drops the idle buffers and buffers of the old size returned later */
+	buffer_pool_put(c);
+	a = buffer_pool_get(pool, 2000);
+	CU_ASSERT(buffer_pool_get_size(a) == 2000);
+	b = buffer_pool_get(pool, 2000);
+	buffer_pool_put(b);
+	c = buffer_pool_get(pool, 2000);
+	CU_ASSERT(c == b);
+
+	/* a referenced buffer is only recycled with its last put */
+	buffer_pool_ref(c);
+	buffer_pool_put(c);
+	b = buffer_pool_get(pool, 2000);
+	CU_ASSERT(b != c);
+	buffer_pool_put(b);
+	buffer_pool_put(c);
+	c = buffer_pool_get(pool, 2000);
+	CU_ASSERT(c == b);
+
+	/* outstanding buffers outlive the pool */
+	buffer_pool_free(pool);
+	memset(a, 0, 2000);
+	buffer_pool_put(a);
+	buffer_pool_put(c);
+}
+
+void test_unicode(void)
+{
+	int i;
+	int length;
+	char* str;
+	size_t out_length;
+	char utf8[128];
+	uint8 utf16[256];
+	UNICONV* uniconv;
+
+	/* "a", "é", "€", U+1F600, then an unpaired high and low surrogate */
+	const uint8 mixed16[] =
+	{
+		0x61, 0x00, 0xE9, 0x00, 0xAC, 0x20, 0x3D, 0xD8, 0x00, 0xDE,
+		0x3D, 0xD8, 0x62, 0x00, 0x00, 0xDE
+	};
+	const char mixed8[] = "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80\xEF\xBF\xBD" "b\xEF\xBF\xBD";
+
+	length = freerdp_utf16_to_utf8(mixed16, sizeof(mixed16), NULL, 0);
+	CU_ASSERT(length == sizeof(mixed8) - 1);
+	CU_ASSERT(freerdp_utf16_to_utf8(mixed16, sizeof(mixed16), utf8, length - 1) == -1);
+	CU_ASSERT(freerdp_utf16_to_utf8(mixed16, sizeof(mixed16), utf8, sizeof(utf8)) == length);
+	CU_ASSERT(memcmp(utf8, mixed8, length) == 0);
+
+	/* the pair decodes back to U+1F600, U+FFFD stays as it is */
+	length = freerdp_utf8_to_utf16(mixed8, sizeof(mixed8) - 1, NULL, 0);
+	CU_ASSERT(length == sizeof(mixed16));
+	CU_ASSERT(freerdp_utf8_to_utf16(mixed8, sizeof(mixed8) - 1, utf16, sizeof(utf16)) == length);
+	CU_ASSERT(memcmp(utf16, mixed16, 10) == 0);
+	CU_ASSERT(utf16[10] == 0xFD && utf16[11] == 0xFF && utf16[12] == 0x62);
+
+	/* truncated, overlong and out of range sequences */
+	length = freerdp_utf8_to_utf16("\xC3" "x" "\xC0\xAF" "\xF4\x90\x80\x80" "\xE2\x82", 10, utf16, sizeof(utf16));
+	CU_ASSERT(length == 12);
+	CU_ASSERT(utf16[0] == 0xFD && utf16[1] == 0xFF && utf16[2] == 'x');
+	CU_ASSERT(utf16[10] == 0xFD && utf16[11] == 0xFF);
+
+	/* ASCII runs longer than a vector, with a non-ASCII character at every offset */
+	for (i = 0; i < 40; i++)
+	{
+		memset(utf8, 'A' + (i % 26), 48);
+		utf8[i] = (char) 0xC3;
+		utf8[i + 1] = (char) 0xA9;
+
+		length = freerdp_utf8_to_utf16(utf8, 48, utf16, sizeof(utf16));
+		CU_ASSERT(length == 94);
+		CU_ASSERT(utf16[i * 2] == 0xE9 && utf16[i * 2 + 1] == 0);
+		CU_ASSERT(utf16[92] == 'A' + (i % 26));
+
+		length = freerdp_utf16_to_utf8(utf16, length, utf8 + 64, 48);
+		CU_ASSERT(length == 48);
+		CU_ASSERT(memcmp(utf8, utf8 + 64, 48) == 0);
+	}
+
+	uniconv = freerdp_uniconv_new();
+	str = freerdp_uniconv_out(uniconv, mixed8, &out_length);
+	CU_ASSERT(out_length == sizeof(mixed16));
+	CU_ASSERT(str[out_length] == 0 && str[out_length + 1] == 0);
+	xfree(str);
+
+	str = freerdp_uniconv_in(uniconv, (unsigned char*) mixed16, sizeof(mixed16));
+	CU_ASSERT(strcmp(str, mixed8) == 0);
+	xfree(str);
+	freerdp_uniconv_free(uniconv);
+}
@@ -30,3 +30,6 @@ void test_wait_obj(void);
 void test_args(void);
 void test_passphrase_read(void);
 void test_handle_signals(void);
+void test_metrics(void);
+void test_buffer_pool(void);
+void test_unicode(void);
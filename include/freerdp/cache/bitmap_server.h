@@ -0,0 +1,91 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Server Bitmap Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BITMAP_SERVER_CACHE_H
+#define __BITMAP_SERVER_CACHE_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/update.h>
+#include <freerdp/freerdp.h>
+
+/**
+ * Keeps track of what a client holds in its bitmap cache v2 cells, so a
+ * server can send a MemBlt for a block the client already has instead of
+ * its pixels. Blocks are identified by a 64-bit hash of their pixels.
+ *
+ * Cell i holds bitmaps of up to (16 << i) x (16 << i) pixels, its number
+ * of entries is the one the client advertised. Every cell replaces its
+ * least recently used entry when full.
+ */
+
+typedef struct _BITMAP_SERVER_ENTRY BITMAP_SERVER_ENTRY;
+typedef struct _BITMAP_SERVER_CELL BITMAP_SERVER_CELL;
+typedef struct rdp_bitmap_cache_server rdpBitmapCacheServer;
+
+struct _BITMAP_SERVER_ENTRY
+{
+	uint32 key1;
+	uint32 key2;
+	uint16 width;
+	uint16 height;
+	boolean used;
+	sint32 prev; /* more recently used entry */
+	sint32 next; /* less recently used entry */
+	sint32 chain; /* next entry in the same hash bucket */
+};
+
+struct _BITMAP_SERVER_CELL
+{
+	uint32 number;
+	uint32 size; /* width and height limit */
+	sint32 head; /* most recently used entry */
+	sint32 tail; /* least recently used entry, replaced next */
+	uint32 mask;
+	sint32* buckets;
+	BITMAP_SERVER_ENTRY* entries;
+};
+
+struct rdp_bitmap_cache_server
+{
+	uint32 maxCells;
+	BITMAP_SERVER_CELL* cells;
+	uint32 tileSize; /* blocks are cut to the size of the largest usable cell */
+
+	uint32 bpp;
+	uint8* buffer; /* bottom-up copy of a block, for cache orders */
+
+	rdpUpdate* update;
+	rdpContext* context;
+	rdpSettings* settings;
+};
+
+FREERDP_API boolean bitmap_cache_server_lookup(rdpBitmapCacheServer* bitmap_cache,
+		uint32 id, uint32 key1, uint32 key2, int width, int height, uint32* index);
+FREERDP_API uint32 bitmap_cache_server_put(rdpBitmapCacheServer* bitmap_cache,
+		uint32 id, uint32 key1, uint32 key2, int width, int height);
+FREERDP_API sint32 bitmap_cache_server_get_cell(rdpBitmapCacheServer* bitmap_cache, int width, int height);
+
+FREERDP_API boolean bitmap_cache_server_send(rdpBitmapCacheServer* bitmap_cache,
+		uint8* data, int x, int y, int width, int height, int scanline);
+
+FREERDP_API void bitmap_cache_server_reset(rdpBitmapCacheServer* bitmap_cache);
+
+FREERDP_API rdpBitmapCacheServer* bitmap_cache_server_new(rdpContext* context);
+FREERDP_API void bitmap_cache_server_free(rdpBitmapCacheServer* bitmap_cache);
+
+#endif /* __BITMAP_SERVER_CACHE_H */
@@ -0,0 +1,102 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Server Glyph Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __GLYPH_SERVER_CACHE_H
+#define __GLYPH_SERVER_CACHE_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/update.h>
+#include <freerdp/freerdp.h>
+
+/**
+ * Keeps track of what a client holds in its glyph caches and its glyph
+ * fragment cache, so a server can draw text with GlyphIndex orders that
+ * refer to glyphs the client already has. Glyphs and fragments are
+ * identified by a 64-bit hash of their contents.
+ *
+ * Every glyph cache the client advertised is a cell replacing its least
+ * recently used entry when full, the fragment cache works the same way.
+ */
+
+typedef struct _GLYPH_SERVER_GLYPH GLYPH_SERVER_GLYPH;
+typedef struct _GLYPH_SERVER_ENTRY GLYPH_SERVER_ENTRY;
+typedef struct _GLYPH_SERVER_CELL GLYPH_SERVER_CELL;
+typedef struct rdp_glyph_cache_server rdpGlyphCacheServer;
+
+struct _GLYPH_SERVER_GLYPH
+{
+	sint32 x; /* offset of the bitmap from the glyph origin */
+	sint32 y;
+	uint32 cx;
+	uint32 cy;
+	uint8* aj; /* 1 bpp, most significant bit first, rows padded to a byte */
+	uint32 advance; /* from the origin of this glyph to the origin of the next one */
+};
+
+struct _GLYPH_SERVER_ENTRY
+{
+	uint32 key1;
+	uint32 key2;
+	boolean used;
+	sint32 prev; /* more recently used entry */
+	sint32 next; /* less recently used entry */
+	sint32 chain; /* next entry in the same hash bucket */
+};
+
+struct _GLYPH_SERVER_CELL
+{
+	uint32 number;
+	uint32 size; /* largest glyph or fragment, in bytes */
+	sint32 head; /* most recently used entry */
+	sint32 tail; /* least recently used entry, replaced next */
+	uint32 mask;
+	sint32* buckets;
+	GLYPH_SERVER_ENTRY* entries;
+};
+
+struct rdp_glyph_cache_server
+{
+	GLYPH_SERVER_CELL glyphCache[10];
+	GLYPH_SERVER_CELL fragCache;
+	boolean glyph_v2; /* the client takes revision 2 cache glyph orders */
+	boolean enabled;
+
+	uint8* buffer; /* glyph bits padded for cache glyph orders */
+	uint32 bufferSize;
+
+	rdpUpdate* update;
+	rdpContext* context;
+	rdpSettings* settings;
+};
+
+FREERDP_API boolean glyph_cache_server_lookup(rdpGlyphCacheServer* glyph_cache,
+		uint32 id, uint32 key1, uint32 key2, uint32* index);
+FREERDP_API uint32 glyph_cache_server_put(rdpGlyphCacheServer* glyph_cache,
+		uint32 id, uint32 key1, uint32 key2);
+FREERDP_API sint32 glyph_cache_server_get_cell(rdpGlyphCacheServer* glyph_cache, int size);
+
+FREERDP_API boolean glyph_cache_server_send(rdpGlyphCacheServer* glyph_cache,
+		GLYPH_SERVER_GLYPH* glyphs, int count, int x, int y,
+		uint32 foreColor, uint32 backColor, RECTANGLE_16* opaque);
+
+FREERDP_API void glyph_cache_server_reset(rdpGlyphCacheServer* glyph_cache);
+
+FREERDP_API rdpGlyphCacheServer* glyph_cache_server_new(rdpContext* context);
+FREERDP_API void glyph_cache_server_free(rdpGlyphCacheServer* glyph_cache);
+
+#endif /* __GLYPH_SERVER_CACHE_H */
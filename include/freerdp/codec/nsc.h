@@ -25,6 +25,7 @@
 #include <freerdp/types.h>
 #include <freerdp/constants.h>
 #include <freerdp/utils/stream.h>
+#include <freerdp/utils/metrics.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -61,6 +62,9 @@ struct _NSC_CONTEXT
 	void (*decode)(NSC_CONTEXT* context);
 	void (*encode)(NSC_CONTEXT* context, uint8* bmpdata, int rowstride);
 
+	/* session metrics, set by the owner of the context */
+	rdpMetrics* metrics;
+
 	NSC_CONTEXT_PRIV* priv;
 };
 
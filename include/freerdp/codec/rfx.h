@@ -24,6 +24,7 @@
 #include <freerdp/types.h>
 #include <freerdp/constants.h>
 #include <freerdp/utils/stream.h>
+#include <freerdp/utils/metrics.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -75,6 +76,9 @@ typedef struct _RFX_MESSAGE RFX_MESSAGE;
 
 typedef struct _RFX_CONTEXT_PRIV RFX_CONTEXT_PRIV;
 
+/* quantization tables the rate controller picks from, level 0 is the finest */
+#define RFX_QUALITY_LEVELS	6
+
 struct _RFX_CONTEXT
 {
 	uint16 flags;
@@ -107,6 +111,10 @@ struct _RFX_CONTEXT
 	void (*quantization_encode)(sint16* buffer, const uint32* quantization_values);
 	void (*dwt_2d_decode)(sint16* buffer, sint16* dwt_buffer);
 	void (*dwt_2d_encode)(sint16* buffer, sint16* dwt_buffer);
+	boolean (*tile_equal)(const uint8* src, int rowstride, const uint8* cached, int line_length, int height);
+
+	/* session metrics, set by the owner of the context */
+	rdpMetrics* metrics;
 
 	/* private definitions */
 	RFX_CONTEXT_PRIV* priv;
@@ -118,6 +126,10 @@ FREERDP_API void rfx_context_free(RFX_CONTEXT* context);
 FREERDP_API void rfx_context_set_cpu_opt(RFX_CONTEXT* context, uint32 cpu_opt);
 FREERDP_API void rfx_context_set_pixel_format(RFX_CONTEXT* context, RDP_PIXEL_FORMAT pixel_format);
 FREERDP_API void rfx_context_reset(RFX_CONTEXT* context);
+FREERDP_API void rfx_context_set_tile_cache(RFX_CONTEXT* context, boolean enabled);
+FREERDP_API void rfx_context_set_rate_control(RFX_CONTEXT* context, boolean enabled, uint32 target_bitrate);
+FREERDP_API void rfx_context_rate_feedback(RFX_CONTEXT* context, uint64 time, uint64 bytes_sent, uint32 bytes_queued);
+FREERDP_API int rfx_context_get_quality_level(RFX_CONTEXT* context);
 
 FREERDP_API RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, uint8* data, uint32 length);
 FREERDP_API uint16 rfx_message_get_tile_count(RFX_MESSAGE* message);
@@ -127,6 +139,19 @@ FREERDP_API RFX_RECT* rfx_message_get_rect(RFX_MESSAGE* message, int index);
 FREERDP_API void rfx_message_free(RFX_CONTEXT* context, RFX_MESSAGE* message);
 
 FREERDP_API void rfx_compose_message_header(RFX_CONTEXT* context, STREAM* s);
+
+/**
+ * Without the tile cache, every tile of the width x height image is encoded.
+ *
+ * With the tile cache, image_data must always be the whole surface, from its
+ * origin. Only the tiles covered by rects are considered, and of those only
+ * the ones that changed since they were last encoded are sent, with region
+ * rects reduced to them. Nothing is written if no tile changed.
+ *
+ * With rate control as well, tiles that keep changing are sent one quality
+ * level coarser than the rest, and tiles that stopped changing are sent again
+ * at the current level, a few per message, even when not covered by rects.
+ */
 FREERDP_API void rfx_compose_message(RFX_CONTEXT* context, STREAM* s,
 	const RFX_RECT* rects, int num_rects, uint8* image_data, int width, int height, int rowstride);
 
@@ -0,0 +1,65 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * YUV to RGB Conversion
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __YUV_H
+#define __YUV_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _YUV_CONTEXT YUV_CONTEXT;
+struct _YUV_CONTEXT
+{
+	/* convert one row of 4:2:0 samples to 32bpp BGRX, width pixels starting at an even column */
+	void (*decode_row)(const uint8* y, const uint8* u, const uint8* v, uint8* dst, int width);
+
+	/* one converted source row, kept while scaling reuses it */
+	uint8* row_buffer;
+	int row_buffer_width;
+	int row_source;
+};
+
+FREERDP_API YUV_CONTEXT* yuv_context_new(void);
+FREERDP_API void yuv_context_set_cpu_opt(YUV_CONTEXT* context, uint32 cpu_opt);
+FREERDP_API void yuv_context_free(YUV_CONTEXT* context);
+
+/**
+ * Convert planar 4:2:0 (I420, or YV12 with the chroma planes swapped by the
+ * caller) to 32bpp BGRX, scaling with nearest neighbour sampling from
+ * src_width x src_height to dst_width x dst_height.
+ */
+/**
+ * Locate the planes of a 4:2:0 frame. The chroma planes of a width x height
+ * frame are ((width + 1) / 2) x ((height + 1) / 2). Without offsets and
+ * steps (or with steps[0] == 0) the planes are packed one after the other.
+ * Returns false if size is too small for the layout.
+ */
+FREERDP_API boolean yuv_get_yuv420p_planes(uint8* data, uint32 size, int width, int height,
+	const uint32* offsets, const uint32* steps, uint8* planes[3], int plane_steps[3]);
+
+FREERDP_API void yuv_decode_yuv420p(YUV_CONTEXT* context, const uint8* planes[3], const int steps[3],
+	int src_width, int src_height, uint8* dst, int dst_step, int dst_width, int dst_height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __YUV_H */
@@ -40,6 +40,8 @@ struct rdp_tls
 	rdpBlob public_key;
 	rdpSettings* settings;
 	rdpCertificateStore* certificate_store;
+	char* session_key;
+	boolean resumed;
 };
 
 FREERDP_API boolean tls_connect(rdpTls* tls);
@@ -58,6 +60,8 @@ FREERDP_API void tls_print_certificate_name_mismatch_error(char* hostname, char*
 
 FREERDP_API boolean tls_print_error(char* func, SSL* connection, int value);
 
+FREERDP_API void tls_session_cache_flush(void);
+
 FREERDP_API rdpTls* tls_new(rdpSettings* settings);
 FREERDP_API void tls_free(rdpTls* tls);
 
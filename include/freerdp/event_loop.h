@@ -0,0 +1,77 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Server Event Loop
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __FREERDP_EVENT_LOOP_H
+#define __FREERDP_EVENT_LOOP_H
+
+typedef struct rdp_event_loop rdpEventLoop;
+typedef struct rdp_event_session rdpEventSession;
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/peer.h>
+#include <freerdp/listener.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Services the listeners and the sessions of a server from one epoll
+ * dispatcher and a fixed pool of worker threads, instead of a thread and
+ * a select() loop per session.
+ *
+ * A session is a peer plus any other file descriptors it needs watched,
+ * such as its virtual channel manager. Sessions are spread over the
+ * workers and a session is only ever serviced by one worker at a time, so
+ * its callbacks need no locking. They should not block either, as they
+ * hold up the other sessions of the worker.
+ *
+ * The handshake of a peer does block, so until the peer is activated its
+ * session is checked on a thread of its own, then it moves to a worker.
+ *
+ * Listeners are serviced on the dispatcher: PeerAccepted initializes the
+ * peer, then hands it over with freerdp_event_loop_add_session().
+ */
+
+/* return false to close the session */
+typedef boolean (*psEventSessionCheck)(void* arg);
+/* called on a worker once the session is closed, the peer is no longer watched */
+typedef void (*psEventSessionClosed)(freerdp_peer* client);
+
+#define EVENT_SESSION_MAX_SOURCES	4
+#define EVENT_SESSION_MAX_FDS		16
+
+FREERDP_API rdpEventLoop* freerdp_event_loop_new(int num_workers);
+FREERDP_API void freerdp_event_loop_free(rdpEventLoop* loop);
+
+FREERDP_API boolean freerdp_event_loop_add_listener(rdpEventLoop* loop, freerdp_listener* listener);
+
+FREERDP_API rdpEventSession* freerdp_event_session_new(freerdp_peer* client, psEventSessionClosed closed);
+FREERDP_API boolean freerdp_event_session_add_fds(rdpEventSession* session, void** rfds, int rcount,
+		psEventSessionCheck check, void* arg);
+FREERDP_API boolean freerdp_event_loop_add_session(rdpEventLoop* loop, rdpEventSession* session);
+FREERDP_API int freerdp_event_loop_get_session_count(rdpEventLoop* loop);
+
+FREERDP_API boolean freerdp_event_loop_run(rdpEventLoop* loop);
+FREERDP_API void freerdp_event_loop_stop(rdpEventLoop* loop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FREERDP_EVENT_LOOP_H */
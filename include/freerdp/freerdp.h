@@ -36,6 +36,8 @@ typedef struct rdp_freerdp_peer freerdp_peer;
 #include <freerdp/settings.h>
 #include <freerdp/extension.h>
 #include <freerdp/utils/stream.h>
+#include <freerdp/utils/record.h>
+#include <freerdp/utils/metrics.h>
 
 #include <freerdp/input.h>
 #include <freerdp/update.h>
@@ -96,7 +98,10 @@ struct rdp_context
 	rdpCache* cache; /* 35 */
 	rdpChannels* channels; /* 36 */
 	rdpGraphics* graphics; /* 37 */
-	uint32 paddingC[64 - 38]; /* 38 */
+	rdpMetrics* metrics; /**< (offset 38)
+				Per-session counters and histograms, owned by the rdp_rdp structure.
+				@see freerdp_get_metrics() */
+	uint32 paddingC[64 - 39]; /* 39 */
 };
 
 /** Defines the options for a given instance of RDP connection.
@@ -193,6 +198,11 @@ FREERDP_API boolean freerdp_check_fds(freerdp* instance);
 
 FREERDP_API uint32 freerdp_error_info(freerdp* instance);
 
+FREERDP_API boolean freerdp_get_render_stats(freerdp* instance, RENDER_STATS* stats);
+FREERDP_API void freerdp_get_metrics(freerdp* instance, METRICS_SNAPSHOT* snapshot);
+
+FREERDP_API boolean freerdp_replay_record(freerdp* instance, RECORD_ENTRY* entry);
+
 FREERDP_API void freerdp_get_version(int* major, int* minor, int* revision);
 
 FREERDP_API freerdp* freerdp_new();
@@ -29,6 +29,8 @@ FREERDP_API GDI_COLOR gdi_GetBkColor(HGDI_DC hdc);
 FREERDP_API GDI_COLOR gdi_SetBkColor(HGDI_DC hdc, GDI_COLOR crColor);
 FREERDP_API int gdi_GetBkMode(HGDI_DC hdc);
 FREERDP_API int gdi_SetBkMode(HGDI_DC hdc, int iBkMode);
+FREERDP_API int gdi_GetPolyFillMode(HGDI_DC hdc);
+FREERDP_API int gdi_SetPolyFillMode(HGDI_DC hdc, int iPolyFillMode);
 FREERDP_API GDI_COLOR gdi_SetTextColor(HGDI_DC hdc, GDI_COLOR crColor);
 
 #endif /* __GDI_DRAWING_H */
@@ -21,6 +21,7 @@
 #define __INPUT_API_H
 
 typedef struct rdp_input rdpInput;
+typedef struct rdp_input_queue rdpInputQueue;
 
 #include <freerdp/api.h>
 #include <freerdp/freerdp.h>
@@ -54,6 +55,20 @@ typedef struct rdp_input rdpInput;
 
 #define RDP_CLIENT_INPUT_PDU_HEADER_LENGTH	4
 
+/* Input Statistics */
+
+#define INPUT_MAX_EVENTS_PER_PDU	15
+
+struct _INPUT_STATS
+{
+	uint32 events; /* events sent */
+	uint32 coalesced; /* mouse motion events replaced by a later one before being sent */
+	uint32 pdus;
+	uint32 max_events_per_pdu;
+	uint32 events_per_pdu[INPUT_MAX_EVENTS_PER_PDU + 1]; /* number of pdus sent with n events */
+};
+typedef struct _INPUT_STATS INPUT_STATS;
+
 typedef void (*pSynchronizeEvent)(rdpInput* input, uint32 flags);
 typedef void (*pKeyboardEvent)(rdpInput* input, uint16 flags, uint16 code);
 typedef void (*pUnicodeKeyboardEvent)(rdpInput* input, uint16 flags, uint16 code);
@@ -71,7 +86,8 @@ struct rdp_input
 	pUnicodeKeyboardEvent UnicodeKeyboardEvent; /* 18 */
 	pMouseEvent MouseEvent; /* 19 */
 	pExtendedMouseEvent ExtendedMouseEvent; /* 20 */
-	uint32 paddingB[32 - 21]; /* 21 */
+	rdpInputQueue* queue; /* 21 */
+	uint32 paddingB[32 - 22]; /* 22 */
 };
 
 FREERDP_API void freerdp_input_send_synchronize_event(rdpInput* input, uint32 flags);
@@ -80,6 +96,10 @@ FREERDP_API void freerdp_input_send_unicode_keyboard_event(rdpInput* input, uint
 FREERDP_API void freerdp_input_send_mouse_event(rdpInput* input, uint16 flags, uint16 x, uint16 y);
 FREERDP_API void freerdp_input_send_extended_mouse_event(rdpInput* input, uint16 flags, uint16 x, uint16 y);
 
+FREERDP_API void freerdp_input_flush(rdpInput* input);
+FREERDP_API int freerdp_input_get_flush_timeout(rdpInput* input);
+FREERDP_API boolean freerdp_input_get_stats(rdpInput* input, INPUT_STATS* stats);
+
 #define freerdp_input_send_keyboard_event_2(input, down, rdp_scancode) \
 		freerdp_input_send_keyboard_event(input, \
 			(rdp_scancode_extended(rdp_scancode) ? KBD_FLAGS_EXTENDED : 0) | \
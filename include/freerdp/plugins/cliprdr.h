@@ -27,6 +27,8 @@
 #define RDP_EVENT_TYPE_CB_FORMAT_LIST		2
 #define RDP_EVENT_TYPE_CB_DATA_REQUEST		3
 #define RDP_EVENT_TYPE_CB_DATA_RESPONSE		4
+#define RDP_EVENT_TYPE_CB_FILECONTENTS_REQUEST	5
+#define RDP_EVENT_TYPE_CB_FILECONTENTS_RESPONSE	6
 
 /**
  * Clipboard Formats
@@ -40,6 +42,30 @@
 #define CB_FORMAT_PNG			0xD011
 #define CB_FORMAT_JPEG			0xD012
 #define CB_FORMAT_GIF			0xD013
+#define CB_FORMAT_FILEGROUPDESCRIPTORW	0xD014
+
+/**
+ * File Lists
+ *
+ * CB_FORMAT_FILEGROUPDESCRIPTORW data is a uint32 count followed by
+ * FILEDESCRIPTORW structures, the file contents are then transferred
+ * with file contents requests, one range at a time.
+ */
+#define CB_FILEDESCRIPTOR_LENGTH	592
+
+/* FILEDESCRIPTORW.flags */
+#define FD_ATTRIBUTES			0x00000004
+#define FD_WRITESTIME			0x00000020
+#define FD_FILESIZE			0x00000040
+#define FD_SHOWPROGRESSUI		0x00004000
+
+/* FILEDESCRIPTORW.fileAttributes */
+#define CB_FILE_ATTRIBUTE_DIRECTORY	0x00000010
+#define CB_FILE_ATTRIBUTE_NORMAL	0x00000080
+
+/* RDP_CB_FILECONTENTS_REQUEST_EVENT.flags */
+#define FILECONTENTS_SIZE		0x00000001
+#define FILECONTENTS_RANGE		0x00000002
 
 /**
  * Clipboard Events
@@ -71,4 +97,25 @@ struct _RDP_CB_DATA_RESPONSE_EVENT
 };
 typedef struct _RDP_CB_DATA_RESPONSE_EVENT RDP_CB_DATA_RESPONSE_EVENT;
 
+struct _RDP_CB_FILECONTENTS_REQUEST_EVENT
+{
+	RDP_EVENT event;
+	uint32 stream_id; /* echoed in the response */
+	uint32 lindex; /* index of the file in the file list */
+	uint32 flags;
+	uint64 position;
+	uint32 requested; /* 8 for FILECONTENTS_SIZE */
+};
+typedef struct _RDP_CB_FILECONTENTS_REQUEST_EVENT RDP_CB_FILECONTENTS_REQUEST_EVENT;
+
+struct _RDP_CB_FILECONTENTS_RESPONSE_EVENT
+{
+	RDP_EVENT event;
+	uint32 stream_id;
+	boolean failed;
+	uint8* data; /* the size as a uint64 for FILECONTENTS_SIZE, less than requested at the end of the file */
+	uint32 size;
+};
+typedef struct _RDP_CB_FILECONTENTS_RESPONSE_EVENT RDP_CB_FILECONTENTS_RESPONSE_EVENT;
+
 #endif /* __CLIPRDR_PLUGIN */
@@ -43,6 +43,9 @@ struct _RDP_VIDEO_FRAME_EVENT
 	sint16 height;
 	uint16 num_visible_rects;
 	RDP_RECT* visible_rects;
+	/* plane offsets in frame_data and bytes per row, all zero when the planes are packed */
+	uint32 frame_offsets[3];
+	uint32 frame_steps[3];
 };
 typedef struct _RDP_VIDEO_FRAME_EVENT RDP_VIDEO_FRAME_EVENT;
 
@@ -311,7 +311,11 @@ struct rdp_settings
 	ALIGN64 boolean mouse_motion; /* 86 */
 	ALIGN64 char* window_title; /* 87 */
 	ALIGN64 uint64 parent_window_xid; /* 88 */
-	ALIGN64 uint64 paddingD[112 - 89]; /* 89 */
+	ALIGN64 boolean async_update; /* 89 */
+	ALIGN64 uint32 input_batch_ms; /* 90 */
+	ALIGN64 boolean input_coalesce; /* 91 */
+	ALIGN64 boolean async_update_safe; /* 92 */
+	ALIGN64 uint64 paddingD[112 - 93]; /* 93 */
 
 	/* Internal Parameters */
 	ALIGN64 char* home_path; /* 112 */
@@ -410,7 +414,8 @@ struct rdp_settings
 	ALIGN64 boolean play_rfx; /* 297 */
 	ALIGN64 char* dump_rfx_file; /* 298 */
 	ALIGN64 char* play_rfx_file; /* 299 */
-	ALIGN64 uint64 paddingN[312 - 300]; /* 300 */
+	ALIGN64 char* record_file; /* 300 */
+	ALIGN64 uint64 paddingN[312 - 301]; /* 301 */
 
 	/* RemoteApp */
 	ALIGN64 boolean remote_app; /* 312 */
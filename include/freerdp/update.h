@@ -21,6 +21,8 @@
 #define __UPDATE_API_H
 
 typedef struct rdp_update rdpUpdate;
+typedef struct rdp_render rdpRender;
+typedef struct _RENDER_STATS RENDER_STATS;
 
 #include <freerdp/rail.h>
 #include <freerdp/types.h>
@@ -129,6 +131,21 @@ enum SURFCMD_FRAMEACTION
 	SURFACECMD_FRAMEACTION_END = 0x0001
 };
 
+/* Render Statistics */
+
+struct _RENDER_STATS
+{
+	uint32 queue_depth; /* frames waiting for the render thread */
+	uint32 max_queue_depth;
+	uint32 frames_decoded;
+	uint32 frames_rendered;
+	uint32 barriers; /* updates that had to wait for the queue to drain */
+	uint32 decode_time; /* last frame, in microseconds */
+	uint32 render_time; /* last frame, in microseconds */
+	uint64 total_decode_time;
+	uint64 total_render_time;
+};
+
 /* Update Interface */
 
 typedef void (*pBeginPaint)(rdpContext* context);
@@ -191,6 +208,8 @@ struct rdp_update
 
 	SURFACE_BITS_COMMAND surface_bits_command;
 	SURFACE_FRAME_MARKER surface_frame_marker;
+
+	rdpRender* render;
 };
 
 #endif /* __UPDATE_API_H */
@@ -0,0 +1,45 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Buffer Pool
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BUFFER_POOL_UTILS_H
+#define __BUFFER_POOL_UTILS_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+/**
+ * Recycles equally sized buffers, such as decoded video frames, between
+ * a producer and a consumer running on different threads.
+ *
+ * Buffers are 16 byte aligned and remember their pool, so whoever ends up
+ * owning one returns it with buffer_pool_put(). A buffer shared by several
+ * owners takes a buffer_pool_ref() for each additional one and is recycled
+ * with the last put. buffer_pool_free() may be called while buffers are
+ * still out: the pool goes away with the last one.
+ */
+
+typedef struct _BUFFER_POOL BUFFER_POOL;
+
+FREERDP_API BUFFER_POOL* buffer_pool_new(int max_idle);
+FREERDP_API void buffer_pool_free(BUFFER_POOL* pool);
+
+FREERDP_API uint8* buffer_pool_get(BUFFER_POOL* pool, uint32 size);
+FREERDP_API void buffer_pool_ref(uint8* buffer);
+FREERDP_API void buffer_pool_put(uint8* buffer);
+FREERDP_API uint32 buffer_pool_get_size(uint8* buffer);
+
+#endif /* __BUFFER_POOL_UTILS_H */
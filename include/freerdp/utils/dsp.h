@@ -39,6 +39,26 @@ union _ADPCM
 };
 typedef union _ADPCM ADPCM;
 
+#define FREERDP_DSP_MAX_CHANNELS	8
+
+/**
+ * Streaming state of the resampler. The fractional read position and the
+ * last input frame are carried over from one call to the next, so that
+ * a stream resampled in arbitrary chunks comes out the same as if it had
+ * been resampled in one go.
+ */
+struct _RESAMPLER
+{
+	uint32 srate;
+	uint32 rrate;
+	uint32 channels;
+	uint32 pos;
+	uint32 frac;
+	boolean primed;
+	sint16 history[FREERDP_DSP_MAX_CHANNELS];
+};
+typedef struct _RESAMPLER RESAMPLER;
+
 typedef struct _FREERDP_DSP_CONTEXT FREERDP_DSP_CONTEXT;
 struct _FREERDP_DSP_CONTEXT
 {
@@ -53,6 +73,11 @@ struct _FREERDP_DSP_CONTEXT
 
 	ADPCM adpcm;
 
+	sint16* mix_buffer;
+	uint32 mix_maxlength;
+
+	RESAMPLER resampler;
+
 	void (*resample)(FREERDP_DSP_CONTEXT* context,
 		const uint8* src, int bytes_per_sample,
 		uint32 schan, uint32 srate, int sframes,
@@ -71,7 +96,14 @@ struct _FREERDP_DSP_CONTEXT
 
 FREERDP_API FREERDP_DSP_CONTEXT* freerdp_dsp_context_new(void);
 FREERDP_API void freerdp_dsp_context_free(FREERDP_DSP_CONTEXT* context);
+FREERDP_API void freerdp_dsp_set_worker_threads(int count);
 #define freerdp_dsp_context_reset_adpcm(_c) memset(&_c->adpcm, 0, sizeof(ADPCM))
+#define freerdp_dsp_context_reset_resampler(_c) memset(&_c->resampler, 0, sizeof(RESAMPLER))
+
+FREERDP_API void freerdp_dsp_resample_nearest(FREERDP_DSP_CONTEXT* context,
+	const uint8* src, int bytes_per_sample,
+	uint32 schan, uint32 srate, int sframes,
+	uint32 rchan, uint32 rrate);
 
 #endif /* __DSP_UTILS_H */
 
@@ -0,0 +1,172 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Runtime Metrics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTILS_METRICS_H
+#define __UTILS_METRICS_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+/**
+ * Per-session counters, gauges and latency histograms.
+ *
+ * Every value is a 64-bit word updated with atomic operations, so the
+ * transport, codec, gdi and render threads can record without taking a
+ * lock. All recording functions accept a NULL registry and do nothing,
+ * which is how codecs and gdi surfaces not attached to a session behave.
+ */
+
+enum METRICS_COUNTER
+{
+	METRICS_BYTES_IN = 0, /* bytes read from the transport */
+	METRICS_BYTES_OUT, /* bytes written to the transport */
+	METRICS_PDUS_IN, /* complete TPKT or fast-path PDUs received */
+	METRICS_PDUS_OUT,
+	METRICS_MPPC_BYTES_IN, /* bulk compressor input */
+	METRICS_MPPC_BYTES_OUT, /* bulk compressor output, uncompressed packets count in full */
+	METRICS_MPPC_UNCOMPRESSED, /* packets the compressor could not shrink */
+	METRICS_RFX_TILES_DECODED,
+	METRICS_RFX_TILES_ENCODED,
+	METRICS_RFX_TILES_SKIPPED, /* tiles the encoder tile cache found unchanged */
+	METRICS_NSC_PIXELS_DECODED,
+	METRICS_NSC_PIXELS_ENCODED,
+	METRICS_BITMAP_CACHE_HITS, /* blocks a server sent as a MemBlt of a bitmap the client had cached */
+	METRICS_BITMAP_CACHE_MISSES, /* blocks a server had to send a cache bitmap order for */
+	METRICS_GLYPH_CACHE_HITS, /* glyphs a server sent as an index into the client glyph cache */
+	METRICS_GLYPH_CACHE_MISSES, /* glyphs a server had to send a cache glyph order for */
+	METRICS_FRAMES, /* BeginPaint/EndPaint pairs */
+	METRICS_TLS_HANDSHAKES, /* full TLS handshakes */
+	METRICS_TLS_RESUMED, /* TLS handshakes that resumed a cached session */
+	METRICS_COUNTER_COUNT
+};
+
+enum METRICS_GAUGE
+{
+	METRICS_RECV_BUFFER = 0, /* bytes buffered in the transport waiting for a complete PDU */
+	METRICS_RENDER_QUEUE, /* frames waiting for the render thread */
+	METRICS_SEND_QUEUE, /* bytes written to the socket the peer has not acknowledged yet */
+	METRICS_GAUGE_COUNT
+};
+
+enum METRICS_HISTOGRAM
+{
+	METRICS_FRAME_TIME = 0, /* receiving a fast-path PDU until EndPaint returns */
+	METRICS_RFX_DECODE,
+	METRICS_RFX_ENCODE,
+	METRICS_NSC_DECODE,
+	METRICS_NSC_ENCODE,
+	METRICS_GDI_BITMAP_UPDATE,
+	METRICS_GDI_SURFACE_BITS,
+	METRICS_CONNECT_NEGO, /* TCP connect and X.224 negotiation */
+	METRICS_CONNECT_TLS,
+	METRICS_CONNECT_NLA,
+	METRICS_CONNECT_MCS, /* MCS connect, channel joins, security exchange and client info */
+	METRICS_CONNECT_LICENSE,
+	METRICS_CONNECT_CAPABILITIES, /* demand active until finalization, also on reactivation */
+	METRICS_HISTOGRAM_COUNT
+};
+
+/**
+ * Histograms hold microseconds in power of two buckets:
+ * bucket 0 counts values below 1us, bucket i values in [2^(i-1), 2^i)
+ * and the last bucket everything from 2^(METRICS_HISTOGRAM_BUCKETS - 2)us up.
+ */
+#define METRICS_HISTOGRAM_BUCKETS		26
+
+/**
+ * PDU types share a single table:
+ * fast-path update codes, fast-path input event codes,
+ * slow-path share data PDU types, then virtual channel and other PDUs.
+ */
+#define METRICS_PDU_FASTPATH_UPDATE(_code)	((_code) & 0x0F)
+#define METRICS_PDU_FASTPATH_INPUT(_code)	(16 + ((_code) & 0x07))
+#define METRICS_PDU_DATA(_type)			(24 + ((_type) & 0x3F))
+#define METRICS_PDU_CHANNEL			88
+#define METRICS_PDU_OTHER			89
+#define METRICS_PDU_TYPE_COUNT			90
+
+struct _METRICS_PDU
+{
+	uint64 count;
+	uint64 bytes;
+};
+typedef struct _METRICS_PDU METRICS_PDU;
+
+struct _METRICS_GAUGE_VALUE
+{
+	uint64 value;
+	uint64 max;
+};
+typedef struct _METRICS_GAUGE_VALUE METRICS_GAUGE_VALUE;
+
+struct _METRICS_HISTOGRAM_VALUE
+{
+	uint64 count;
+	uint64 sum; /* microseconds */
+	uint64 max; /* microseconds */
+	uint64 buckets[METRICS_HISTOGRAM_BUCKETS];
+};
+typedef struct _METRICS_HISTOGRAM_VALUE METRICS_HISTOGRAM_VALUE;
+
+/* only 64-bit words, so a snapshot can be copied one atomic word at a time */
+struct _METRICS_SNAPSHOT
+{
+	uint64 uptime; /* microseconds since the registry was created */
+	uint64 counters[METRICS_COUNTER_COUNT];
+	METRICS_GAUGE_VALUE gauges[METRICS_GAUGE_COUNT];
+	METRICS_HISTOGRAM_VALUE histograms[METRICS_HISTOGRAM_COUNT];
+	METRICS_PDU pdu_in[METRICS_PDU_TYPE_COUNT];
+	METRICS_PDU pdu_out[METRICS_PDU_TYPE_COUNT];
+};
+typedef struct _METRICS_SNAPSHOT METRICS_SNAPSHOT;
+
+struct rdp_metrics
+{
+	uint64 start;
+	uint64 phase; /* start of the current connection phase */
+	METRICS_SNAPSHOT values;
+};
+typedef struct rdp_metrics rdpMetrics;
+
+FREERDP_API rdpMetrics* metrics_new(void);
+FREERDP_API void metrics_free(rdpMetrics* metrics);
+FREERDP_API void metrics_reset(rdpMetrics* metrics);
+
+FREERDP_API uint64 metrics_time(void);
+
+FREERDP_API void metrics_count(rdpMetrics* metrics, int counter, uint64 value);
+FREERDP_API void metrics_gauge(rdpMetrics* metrics, int gauge, uint64 value);
+FREERDP_API void metrics_record(rdpMetrics* metrics, int histogram, uint64 usec);
+FREERDP_API void metrics_record_since(rdpMetrics* metrics, int histogram, uint64 start);
+FREERDP_API void metrics_phase_begin(rdpMetrics* metrics);
+FREERDP_API void metrics_phase_end(rdpMetrics* metrics, int histogram);
+FREERDP_API void metrics_pdu_in(rdpMetrics* metrics, int type, uint32 length);
+FREERDP_API void metrics_pdu_out(rdpMetrics* metrics, int type, uint32 length);
+
+FREERDP_API uint64 metrics_get_counter(rdpMetrics* metrics, int counter);
+FREERDP_API uint64 metrics_get_gauge(rdpMetrics* metrics, int gauge);
+FREERDP_API void metrics_snapshot(rdpMetrics* metrics, METRICS_SNAPSHOT* snapshot);
+FREERDP_API uint64 metrics_histogram_percentile(METRICS_HISTOGRAM_VALUE* histogram, int percentile);
+
+FREERDP_API const char* metrics_counter_name(int counter);
+FREERDP_API const char* metrics_gauge_name(int gauge);
+FREERDP_API const char* metrics_histogram_name(int histogram);
+
+/* a timestamp for metrics_record_since(), 0 when there is no registry to record into */
+#define METRICS_START(_metrics)		((_metrics) ? metrics_time() : 0)
+
+#endif /* __UTILS_METRICS_H */
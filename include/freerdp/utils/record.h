@@ -0,0 +1,98 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Session Recording File Format Utils
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTILS_RECORD_H
+#define __UTILS_RECORD_H
+
+#include <stdio.h>
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/utils/stream.h>
+
+/**
+ * A recording is a 16 byte file header followed by records, each made of a
+ * 12 byte header and its payload. Record headers carry the time elapsed
+ * since the previous record. Closing a recording appends an index of record
+ * offsets and timestamps, and a 16 byte trailer pointing to it. A recording
+ * that was never closed is still readable, its index is rebuilt on open.
+ * All fields are little-endian.
+ */
+
+#define RECORD_MAGIC			0x43455246 /* "FREC" */
+#define RECORD_INDEX_MAGIC		0x58444946 /* "FIDX" */
+#define RECORD_VERSION			1
+
+#define RECORD_HEADER_LENGTH		16
+#define RECORD_ENTRY_HEADER_LENGTH	12
+#define RECORD_TRAILER_LENGTH		16
+
+/* Record Types */
+#define RECORD_TYPE_DESKTOP		0x01 /* id: 0, data: width (2), height (2), color depth (4) */
+#define RECORD_TYPE_BEGIN_PAINT		0x02 /* id: 0, no data, start of a fast-path PDU */
+#define RECORD_TYPE_END_PAINT		0x03 /* id: 0, no data, end of a fast-path PDU */
+#define RECORD_TYPE_FASTPATH		0x04 /* id: updateCode, data: reassembled, decompressed update */
+#define RECORD_TYPE_DATA_PDU		0x05 /* id: pduType2, data: decompressed data PDU body */
+#define RECORD_TYPE_CHANNEL		0x06 /* id: channelId, data: channel PDU header and chunk */
+
+struct _RECORD_ENTRY
+{
+	uint8 type;
+	uint16 id;
+	uint64 timestamp; /* microseconds since the start of the recording */
+	uint32 length;
+	uint8* data; /* owned by the recording, valid until the next read */
+};
+typedef struct _RECORD_ENTRY RECORD_ENTRY;
+
+struct _RECORD_INDEX
+{
+	uint64 offset;
+	uint64 timestamp;
+};
+typedef struct _RECORD_INDEX RECORD_INDEX;
+
+struct rdp_record
+{
+	FILE* fp;
+	char* name;
+	boolean write;
+	STREAM* s;
+
+	uint64 start_time;
+	uint64 timestamp;
+
+	uint32 count;
+	uint32 position;
+	uint32 index_size;
+	RECORD_INDEX* index;
+	long data_end;
+
+	uint8* buffer;
+	uint32 buffer_size;
+};
+typedef struct rdp_record rdpRecord;
+
+FREERDP_API rdpRecord* record_open(const char* name, boolean write);
+FREERDP_API void record_close(rdpRecord* record);
+
+FREERDP_API void record_write(rdpRecord* record, uint8 type, uint16 id, uint8* data, uint32 length);
+FREERDP_API boolean record_read(rdpRecord* record, RECORD_ENTRY* entry);
+FREERDP_API boolean record_seek(rdpRecord* record, uint32 index);
+FREERDP_API uint32 record_get_count(rdpRecord* record);
+
+#endif /* __UTILS_RECORD_H */
@@ -51,4 +51,14 @@ FREERDP_API char* freerdp_uniconv_in(UNICONV *uniconv, unsigned char* pin, size_
 FREERDP_API char* freerdp_uniconv_out(UNICONV *uniconv, const char *str, size_t *pout_len);
 FREERDP_API void freerdp_uniconv_uppercase(UNICONV *uniconv, char *wstr, int length);
 
+/**
+ * Convert between UTF-16LE and UTF-8 into a caller provided buffer.
+ * Lengths are in bytes and the output is not null terminated.
+ * With a NULL destination the exact output length is returned without
+ * converting, otherwise the length written, or -1 if dst is too small.
+ * Unpaired surrogates and invalid UTF-8 sequences become U+FFFD.
+ */
+FREERDP_API int freerdp_utf16_to_utf8(const unsigned char* src, int src_length, char* dst, int dst_length);
+FREERDP_API int freerdp_utf8_to_utf16(const char* src, int src_length, unsigned char* dst, int dst_length);
+
 #endif /* __UNICODE_UTILS_H */
@@ -154,11 +154,14 @@ void update_gdi_cache_bitmap_v3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cach
 void update_gdi_bitmap_update(rdpContext* context, BITMAP_UPDATE* bitmap_update)
 {
 	int i;
+	uint64 start;
 	rdpBitmap* bitmap;
 	BITMAP_DATA* bitmap_data;
 	boolean reused = true;
 	rdpCache* cache = context->cache;
 
+	start = METRICS_START(context->metrics);
+
 	if (cache->bitmap->bitmap == NULL)
 	{
 		cache->bitmap->bitmap = Bitmap_Alloc(context);
@@ -196,6 +199,8 @@ void update_gdi_bitmap_update(rdpContext* context, BITMAP_UPDATE* bitmap_update)
 
 		bitmap->Paint(context, bitmap);
 	}
+
+	metrics_record_since(context->metrics, METRICS_GDI_BITMAP_UPDATE, start);
 }
 
 rdpBitmap* bitmap_cache_get(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index)
@@ -0,0 +1,437 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Server Bitmap Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <freerdp/peer.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/constants.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/metrics.h>
+
+#include <freerdp/cache/bitmap_server.h>
+
+/**
+ * Blocks are at most 64x64 pixels, the size cell 2 holds. Larger blocks
+ * are less likely to repeat, so cells 3 and 4 are not used.
+ */
+#define BITMAP_SERVER_MAX_CELLS		3
+
+static INLINE uint64 bitmap_cache_server_mix(uint64 h, uint64 v)
+{
+	h ^= v;
+	h *= 0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> 29);
+}
+
+/**
+ * Hash the pixels of a block, eight bytes at a time.
+ * The dimensions are part of the hash, so blocks with the same bytes but
+ * a different shape do not collide.
+ */
+
+static void bitmap_cache_server_hash(uint8* data, int length, int height, int scanline,
+		uint32 extra, uint32* key1, uint32* key2)
+{
+	int x, y;
+	uint8* row;
+	uint64 value;
+	uint64 h = 0xCBF29CE484222325ULL ^ extra;
+
+	for (y = 0; y < height; y++)
+	{
+		row = &data[y * scanline];
+
+		for (x = 0; x + 8 <= length; x += 8)
+		{
+			memcpy(&value, &row[x], 8);
+			h = bitmap_cache_server_mix(h, value);
+		}
+
+		if (x < length)
+		{
+			value = 0;
+			memcpy(&value, &row[x], length - x);
+			h = bitmap_cache_server_mix(h, value);
+		}
+	}
+
+	/* final avalanche, so both halves depend on every input bit */
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+
+	*key1 = (uint32) h;
+	*key2 = (uint32) (h >> 32);
+}
+
+static void bitmap_cache_server_unlink(BITMAP_SERVER_CELL* cell, sint32 index)
+{
+	BITMAP_SERVER_ENTRY* entry = &cell->entries[index];
+
+	if (entry->prev >= 0)
+		cell->entries[entry->prev].next = entry->next;
+	else
+		cell->head = entry->next;
+
+	if (entry->next >= 0)
+		cell->entries[entry->next].prev = entry->prev;
+	else
+		cell->tail = entry->prev;
+}
+
+static void bitmap_cache_server_touch(BITMAP_SERVER_CELL* cell, sint32 index)
+{
+	BITMAP_SERVER_ENTRY* entry = &cell->entries[index];
+
+	if (cell->head == index)
+		return;
+
+	bitmap_cache_server_unlink(cell, index);
+
+	entry->prev = -1;
+	entry->next = cell->head;
+	cell->entries[cell->head].prev = index;
+	cell->head = index;
+}
+
+static void bitmap_cache_server_clear_cell(BITMAP_SERVER_CELL* cell)
+{
+	uint32 i;
+
+	for (i = 0; i <= cell->mask; i++)
+		cell->buckets[i] = -1;
+
+	/* every entry starts out free, in index order */
+	for (i = 0; i < cell->number; i++)
+	{
+		cell->entries[i].used = false;
+		cell->entries[i].prev = (sint32) i - 1;
+		cell->entries[i].next = (i + 1 < cell->number) ? (sint32) i + 1 : -1;
+		cell->entries[i].chain = -1;
+	}
+
+	cell->head = 0;
+	cell->tail = cell->number - 1;
+}
+
+boolean bitmap_cache_server_lookup(rdpBitmapCacheServer* bitmap_cache,
+		uint32 id, uint32 key1, uint32 key2, int width, int height, uint32* index)
+{
+	sint32 i;
+	BITMAP_SERVER_CELL* cell;
+	BITMAP_SERVER_ENTRY* entry;
+
+	if (id >= bitmap_cache->maxCells || bitmap_cache->cells[id].number == 0)
+		return false;
+
+	cell = &bitmap_cache->cells[id];
+
+	for (i = cell->buckets[key1 & cell->mask]; i >= 0; i = entry->chain)
+	{
+		entry = &cell->entries[i];
+
+		if (entry->key1 == key1 && entry->key2 == key2 &&
+				entry->width == width && entry->height == height)
+		{
+			bitmap_cache_server_touch(cell, i);
+			*index = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Take the least recently used entry of a cell for a new bitmap.
+ * @return the cache index the bitmap has to be sent with
+ */
+
+uint32 bitmap_cache_server_put(rdpBitmapCacheServer* bitmap_cache,
+		uint32 id, uint32 key1, uint32 key2, int width, int height)
+{
+	sint32 i;
+	sint32 index;
+	sint32* link;
+	BITMAP_SERVER_CELL* cell;
+	BITMAP_SERVER_ENTRY* entry;
+
+	cell = &bitmap_cache->cells[id];
+	index = cell->tail;
+	entry = &cell->entries[index];
+
+	if (entry->used)
+	{
+		for (link = &cell->buckets[entry->key1 & cell->mask]; *link >= 0; link = &cell->entries[i].chain)
+		{
+			i = *link;
+
+			if (i == index)
+			{
+				*link = entry->chain;
+				break;
+			}
+		}
+	}
+
+	entry->key1 = key1;
+	entry->key2 = key2;
+	entry->width = width;
+	entry->height = height;
+	entry->used = true;
+	entry->chain = cell->buckets[key1 & cell->mask];
+	cell->buckets[key1 & cell->mask] = index;
+
+	bitmap_cache_server_touch(cell, index);
+
+	return index;
+}
+
+/**
+ * Find the smallest cell a bitmap fits in.
+ * @return the cell id, or -1 when no cell is large enough
+ */
+
+sint32 bitmap_cache_server_get_cell(rdpBitmapCacheServer* bitmap_cache, int width, int height)
+{
+	uint32 id;
+	BITMAP_SERVER_CELL* cell;
+
+	for (id = 0; id < bitmap_cache->maxCells; id++)
+	{
+		cell = &bitmap_cache->cells[id];
+
+		if (cell->number > 0 && width <= (int) cell->size && height <= (int) cell->size)
+			return id;
+	}
+
+	return -1;
+}
+
+static void bitmap_cache_server_send_block(rdpBitmapCacheServer* bitmap_cache,
+		uint8* data, int x, int y, int width, int height, int scanline)
+{
+	int i;
+	sint32 id;
+	uint32 key1;
+	uint32 key2;
+	uint32 index;
+	int cacheWidth;
+	int bytesPerPixel;
+	MEMBLT_ORDER memblt;
+	CACHE_BITMAP_V2_ORDER cache_bitmap_v2;
+	rdpUpdate* update = bitmap_cache->update;
+	rdpContext* context = bitmap_cache->context;
+
+	bytesPerPixel = (bitmap_cache->bpp + 7) / 8;
+
+	/* cached bitmaps are a multiple of 4 pixels wide, the padding is never drawn */
+	cacheWidth = (width + 3) & ~3;
+
+	id = bitmap_cache_server_get_cell(bitmap_cache, cacheWidth, height);
+
+	bitmap_cache_server_hash(data, width * bytesPerPixel, height, scanline,
+			(width << 16) | height, &key1, &key2);
+
+	if (bitmap_cache_server_lookup(bitmap_cache, id, key1, key2, width, height, &index))
+	{
+		metrics_count(context->metrics, METRICS_BITMAP_CACHE_HITS, 1);
+	}
+	else
+	{
+		metrics_count(context->metrics, METRICS_BITMAP_CACHE_MISSES, 1);
+
+		index = bitmap_cache_server_put(bitmap_cache, id, key1, key2, width, height);
+
+		/* uncompressed cache bitmaps are bottom-up */
+		memset(bitmap_cache->buffer, 0, cacheWidth * height * bytesPerPixel);
+
+		for (i = 0; i < height; i++)
+		{
+			memcpy(&bitmap_cache->buffer[(height - i - 1) * cacheWidth * bytesPerPixel],
+					&data[i * scanline], width * bytesPerPixel);
+		}
+
+		memset(&cache_bitmap_v2, 0, sizeof(CACHE_BITMAP_V2_ORDER));
+		cache_bitmap_v2.cacheId = id;
+		cache_bitmap_v2.flags = (cacheWidth == height) ? CBR2_HEIGHT_SAME_AS_WIDTH : 0;
+		cache_bitmap_v2.bitmapBpp = bitmap_cache->bpp;
+		cache_bitmap_v2.bitmapWidth = cacheWidth;
+		cache_bitmap_v2.bitmapHeight = height;
+		cache_bitmap_v2.bitmapLength = cacheWidth * height * bytesPerPixel;
+		cache_bitmap_v2.cacheIndex = index;
+		cache_bitmap_v2.compressed = false;
+		cache_bitmap_v2.bitmapDataStream = bitmap_cache->buffer;
+
+		IFCALL(update->secondary->CacheBitmapV2, context, &cache_bitmap_v2);
+	}
+
+	memset(&memblt, 0, sizeof(MEMBLT_ORDER));
+	memblt.cacheId = id;
+	memblt.nLeftRect = x;
+	memblt.nTopRect = y;
+	memblt.nWidth = width;
+	memblt.nHeight = height;
+	memblt.bRop = 0xCC; /* SRCCOPY */
+	memblt.cacheIndex = index;
+
+	IFCALL(update->primary->MemBlt, context, &memblt);
+}
+
+/**
+ * Send a screen area as cached bitmaps: the area is cut into blocks, the
+ * blocks the client does not have yet are sent with cache bitmap orders and
+ * every block is drawn with a MemBlt.
+ * @param data top-down pixels in the session color depth
+ * @return false when the client cannot cache bitmaps, the caller has to
+ * send the area another way
+ */
+
+boolean bitmap_cache_server_send(rdpBitmapCacheServer* bitmap_cache,
+		uint8* data, int x, int y, int width, int height, int scanline)
+{
+	int bx, by;
+	int bw, bh;
+	int bytesPerPixel;
+	int tileSize = bitmap_cache->tileSize;
+
+	if (tileSize == 0)
+		return false;
+
+	bytesPerPixel = (bitmap_cache->bpp + 7) / 8;
+
+	for (by = 0; by < height; by += tileSize)
+	{
+		bh = MIN(tileSize, height - by);
+
+		for (bx = 0; bx < width; bx += tileSize)
+		{
+			bw = MIN(tileSize, width - bx);
+
+			bitmap_cache_server_send_block(bitmap_cache, &data[by * scanline + bx * bytesPerPixel],
+					x + bx, y + by, bw, bh, scanline);
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Forget the contents of every cell. The client starts with empty caches
+ * after a reactivation, which also changes the color depth and may change
+ * the cells the client advertised.
+ */
+
+void bitmap_cache_server_reset(rdpBitmapCacheServer* bitmap_cache)
+{
+	uint32 i;
+	uint32 size;
+	uint32 number;
+	BITMAP_SERVER_CELL* cell;
+	rdpSettings* settings = bitmap_cache->settings;
+
+	for (i = 0; i < bitmap_cache->maxCells; i++)
+	{
+		xfree(bitmap_cache->cells[i].buckets);
+		xfree(bitmap_cache->cells[i].entries);
+	}
+
+	xfree(bitmap_cache->cells);
+	xfree(bitmap_cache->buffer);
+
+	bitmap_cache->maxCells = 0;
+	bitmap_cache->cells = NULL;
+	bitmap_cache->buffer = NULL;
+	bitmap_cache->tileSize = 0;
+	bitmap_cache->bpp = settings->color_depth;
+
+	if (settings->order_support[NEG_MEMBLT_INDEX] == false && settings->order_support[NEG_MEMBLT_V2_INDEX] == false)
+		return;
+
+	bitmap_cache->maxCells = MIN(settings->bitmapCacheV2NumCells, BITMAP_SERVER_MAX_CELLS);
+
+	if (bitmap_cache->maxCells == 0)
+		return;
+
+	bitmap_cache->cells = (BITMAP_SERVER_CELL*) xzalloc(sizeof(BITMAP_SERVER_CELL) * bitmap_cache->maxCells);
+
+	for (i = 0; i < bitmap_cache->maxCells; i++)
+	{
+		cell = &bitmap_cache->cells[i];
+
+		/* cache indices are 15 bits, the last one is the waiting list */
+		number = MIN(settings->bitmapCacheV2CellInfo[i].numEntries, BITMAP_CACHE_WAITING_LIST_INDEX);
+
+		cell->size = 16 << i;
+		cell->number = number;
+
+		if (number == 0)
+			continue;
+
+		for (size = 1; size < number; size <<= 1);
+
+		cell->mask = size - 1;
+		cell->buckets = (sint32*) xmalloc(sizeof(sint32) * size);
+		cell->entries = (BITMAP_SERVER_ENTRY*) xzalloc(sizeof(BITMAP_SERVER_ENTRY) * number);
+
+		bitmap_cache_server_clear_cell(cell);
+
+		bitmap_cache->tileSize = cell->size;
+	}
+
+	if (bitmap_cache->tileSize > 0)
+		bitmap_cache->buffer = (uint8*) xmalloc(bitmap_cache->tileSize * bitmap_cache->tileSize * 4);
+}
+
+rdpBitmapCacheServer* bitmap_cache_server_new(rdpContext* context)
+{
+	rdpBitmapCacheServer* bitmap_cache;
+
+	bitmap_cache = (rdpBitmapCacheServer*) xzalloc(sizeof(rdpBitmapCacheServer));
+
+	if (bitmap_cache != NULL)
+	{
+		bitmap_cache->context = context;
+		bitmap_cache->update = context->peer->update;
+		bitmap_cache->settings = context->peer->settings;
+
+		bitmap_cache_server_reset(bitmap_cache);
+	}
+
+	return bitmap_cache;
+}
+
+void bitmap_cache_server_free(rdpBitmapCacheServer* bitmap_cache)
+{
+	uint32 i;
+
+	if (bitmap_cache != NULL)
+	{
+		for (i = 0; i < bitmap_cache->maxCells; i++)
+		{
+			xfree(bitmap_cache->cells[i].buckets);
+			xfree(bitmap_cache->cells[i].entries);
+		}
+
+		xfree(bitmap_cache->cells);
+		xfree(bitmap_cache->buffer);
+		xfree(bitmap_cache);
+	}
+}
@@ -66,6 +66,24 @@ void update_gdi_polygon_cb(rdpContext* context, POLYGON_CB_ORDER* polygon_cb)
 	brush->style = style;
 }
 
+void update_gdi_ellipse_cb(rdpContext* context, ELLIPSE_CB_ORDER* ellipse_cb)
+{
+	uint8 style;
+	rdpBrush* brush = &ellipse_cb->brush;
+	rdpCache* cache = context->cache;
+
+	style = brush->style;
+
+	if (brush->style & CACHED_BRUSH)
+	{
+		brush->data = brush_cache_get(cache->brush, brush->index, &brush->bpp);
+		brush->style = 0x03;
+	}
+
+	IFCALL(cache->brush->EllipseCB, context, ellipse_cb);
+	brush->style = style;
+}
+
 void update_gdi_cache_brush(rdpContext* context, CACHE_BRUSH_ORDER* cache_brush)
 {
 	rdpCache* cache = context->cache;
@@ -153,10 +171,12 @@ void brush_cache_register_callbacks(rdpUpdate* update)
 	cache->brush->PatBlt = update->primary->PatBlt;
 	cache->brush->PolygonSC = update->primary->PolygonSC;
 	cache->brush->PolygonCB = update->primary->PolygonCB;
+	cache->brush->EllipseCB = update->primary->EllipseCB;
 
 	update->primary->PatBlt = update_gdi_patblt;
 	update->primary->PolygonSC = update_gdi_polygon_sc;
 	update->primary->PolygonCB = update_gdi_polygon_cb;
+	update->primary->EllipseCB = update_gdi_ellipse_cb;
 	update->secondary->CacheBrush = update_gdi_cache_brush;
 }
 
@@ -0,0 +1,614 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Server Glyph Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <freerdp/peer.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/constants.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/metrics.h>
+
+#include <freerdp/cache/glyph_server.h>
+
+/* glyph index data of an order, leaving room to add it as a fragment */
+#define GLYPH_SERVER_MAX_DATA		252
+
+/* every glyph takes at least an index and a delta byte */
+#define GLYPH_SERVER_MAX_GLYPHS		(GLYPH_SERVER_MAX_DATA / 2)
+
+/* glyph indices 0xFE and 0xFF in glyph index data are fragment operations */
+#define GLYPH_SERVER_MAX_ENTRIES	254
+
+/* size of a glyph in cache glyph orders, rows padded to a byte and the whole to 4 bytes */
+#define GLYPH_SERVER_SIZE(_glyph)	(((((_glyph)->cx + 7) / 8) * (_glyph)->cy + 3) & ~3)
+
+/**
+ * Glyph bytes of a cache glyph order, counting the 10 bytes of fields each
+ * glyph takes at most. Orders stay far below the 16-bit order length and
+ * fit in a single fast-path PDU.
+ */
+#define GLYPH_SERVER_MAX_ORDER_SIZE	8192
+
+static INLINE uint64 glyph_cache_server_mix(uint64 h, uint64 v)
+{
+	h ^= v;
+	h *= 0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> 29);
+}
+
+static void glyph_cache_server_hash(uint8* data, int length, uint64 seed, uint32* key1, uint32* key2)
+{
+	int i;
+	uint64 value;
+	uint64 h = 0xCBF29CE484222325ULL;
+
+	h = glyph_cache_server_mix(h, seed);
+
+	for (i = 0; i + 8 <= length; i += 8)
+	{
+		memcpy(&value, &data[i], 8);
+		h = glyph_cache_server_mix(h, value);
+	}
+
+	if (i < length)
+	{
+		value = 0;
+		memcpy(&value, &data[i], length - i);
+		h = glyph_cache_server_mix(h, value);
+	}
+
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+
+	*key1 = (uint32) h;
+	*key2 = (uint32) (h >> 32);
+}
+
+static void glyph_cache_server_unlink(GLYPH_SERVER_CELL* cell, sint32 index)
+{
+	GLYPH_SERVER_ENTRY* entry = &cell->entries[index];
+
+	if (entry->prev >= 0)
+		cell->entries[entry->prev].next = entry->next;
+	else
+		cell->head = entry->next;
+
+	if (entry->next >= 0)
+		cell->entries[entry->next].prev = entry->prev;
+	else
+		cell->tail = entry->prev;
+}
+
+static void glyph_cache_server_touch(GLYPH_SERVER_CELL* cell, sint32 index)
+{
+	GLYPH_SERVER_ENTRY* entry = &cell->entries[index];
+
+	if (cell->head == index)
+		return;
+
+	glyph_cache_server_unlink(cell, index);
+
+	entry->prev = -1;
+	entry->next = cell->head;
+	cell->entries[cell->head].prev = index;
+	cell->head = index;
+}
+
+static void glyph_cache_server_cell_init(GLYPH_SERVER_CELL* cell, uint32 number, uint32 size)
+{
+	uint32 i;
+	uint32 buckets;
+
+	cell->number = number;
+	cell->size = size;
+
+	if (number == 0)
+		return;
+
+	for (buckets = 1; buckets < number; buckets <<= 1);
+
+	cell->mask = buckets - 1;
+	cell->buckets = (sint32*) xmalloc(sizeof(sint32) * buckets);
+	cell->entries = (GLYPH_SERVER_ENTRY*) xzalloc(sizeof(GLYPH_SERVER_ENTRY) * number);
+
+	for (i = 0; i < buckets; i++)
+		cell->buckets[i] = -1;
+
+	/* every entry starts out free, the lowest indices are used first */
+	for (i = 0; i < number; i++)
+	{
+		cell->entries[i].prev = (i + 1 < number) ? (sint32) i + 1 : -1;
+		cell->entries[i].next = (sint32) i - 1;
+		cell->entries[i].chain = -1;
+	}
+
+	cell->head = number - 1;
+	cell->tail = 0;
+}
+
+static void glyph_cache_server_cell_free(GLYPH_SERVER_CELL* cell)
+{
+	xfree(cell->buckets);
+	xfree(cell->entries);
+	memset(cell, 0, sizeof(GLYPH_SERVER_CELL));
+}
+
+static boolean glyph_cache_server_cell_lookup(GLYPH_SERVER_CELL* cell, uint32 key1, uint32 key2, uint32* index)
+{
+	sint32 i;
+	GLYPH_SERVER_ENTRY* entry;
+
+	if (cell->number == 0)
+		return false;
+
+	for (i = cell->buckets[key1 & cell->mask]; i >= 0; i = entry->chain)
+	{
+		entry = &cell->entries[i];
+
+		if (entry->key1 == key1 && entry->key2 == key2)
+		{
+			glyph_cache_server_touch(cell, i);
+			*index = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static uint32 glyph_cache_server_cell_put(GLYPH_SERVER_CELL* cell, uint32 key1, uint32 key2)
+{
+	sint32 i;
+	sint32 index;
+	sint32* link;
+	GLYPH_SERVER_ENTRY* entry;
+
+	index = cell->tail;
+	entry = &cell->entries[index];
+
+	if (entry->used)
+	{
+		for (link = &cell->buckets[entry->key1 & cell->mask]; *link >= 0; link = &cell->entries[i].chain)
+		{
+			i = *link;
+
+			if (i == index)
+			{
+				*link = entry->chain;
+				break;
+			}
+		}
+	}
+
+	entry->key1 = key1;
+	entry->key2 = key2;
+	entry->used = true;
+	entry->chain = cell->buckets[key1 & cell->mask];
+	cell->buckets[key1 & cell->mask] = index;
+
+	glyph_cache_server_touch(cell, index);
+
+	return index;
+}
+
+boolean glyph_cache_server_lookup(rdpGlyphCacheServer* glyph_cache,
+		uint32 id, uint32 key1, uint32 key2, uint32* index)
+{
+	if (id > 9)
+		return false;
+
+	return glyph_cache_server_cell_lookup(&glyph_cache->glyphCache[id], key1, key2, index);
+}
+
+/**
+ * Take the least recently used entry of a glyph cache for a new glyph.
+ * @return the cache index the glyph has to be sent with
+ */
+
+uint32 glyph_cache_server_put(rdpGlyphCacheServer* glyph_cache,
+		uint32 id, uint32 key1, uint32 key2)
+{
+	return glyph_cache_server_cell_put(&glyph_cache->glyphCache[id], key1, key2);
+}
+
+/**
+ * Find the glyph cache with the smallest cells a glyph fits in.
+ * @param size glyph size in bytes, as in cache glyph orders
+ * @return the cache id, or -1 when no cache is large enough
+ */
+
+sint32 glyph_cache_server_get_cell(rdpGlyphCacheServer* glyph_cache, int size)
+{
+	uint32 id;
+	sint32 best = -1;
+	GLYPH_SERVER_CELL* cell;
+
+	for (id = 0; id < 10; id++)
+	{
+		cell = &glyph_cache->glyphCache[id];
+
+		if (cell->number == 0 || size > (int) cell->size)
+			continue;
+
+		if (best < 0 || cell->size < glyph_cache->glyphCache[best].size)
+			best = id;
+	}
+
+	return best;
+}
+
+static void glyph_cache_server_send_glyphs(rdpGlyphCacheServer* glyph_cache, uint32 id,
+		GLYPH_SERVER_GLYPH** glyphs, uint32* indices, int count)
+{
+	int i;
+	int first;
+	uint8* aj;
+	uint32 orderSize;
+	uint32 size;
+	uint32 length;
+	GLYPH_SERVER_GLYPH* glyph;
+	CACHE_GLYPH_ORDER cache_glyph;
+	CACHE_GLYPH_V2_ORDER cache_glyph_v2;
+	GLYPH_DATA glyphData[GLYPH_SERVER_MAX_GLYPHS];
+	GLYPH_DATA_V2 glyphDataV2[GLYPH_SERVER_MAX_GLYPHS];
+	rdpUpdate* update = glyph_cache->update;
+	rdpContext* context = glyph_cache->context;
+
+	for (i = size = 0; i < count; i++)
+		size += GLYPH_SERVER_SIZE(glyphs[i]);
+
+	if (size > glyph_cache->bufferSize)
+	{
+		glyph_cache->buffer = (uint8*) xrealloc(glyph_cache->buffer, size);
+		glyph_cache->bufferSize = size;
+	}
+
+	memset(glyph_cache->buffer, 0, size);
+	memset(&cache_glyph, 0, sizeof(CACHE_GLYPH_ORDER));
+	memset(&cache_glyph_v2, 0, sizeof(CACHE_GLYPH_V2_ORDER));
+
+	aj = glyph_cache->buffer;
+
+	for (i = 0; i < count; i++)
+	{
+		glyph = glyphs[i];
+		length = ((glyph->cx + 7) / 8) * glyph->cy;
+		memcpy(aj, glyph->aj, length);
+
+		glyphData[i].cacheIndex = indices[i];
+		glyphData[i].x = glyph->x;
+		glyphData[i].y = glyph->y;
+		glyphData[i].cx = glyph->cx;
+		glyphData[i].cy = glyph->cy;
+		glyphData[i].cb = GLYPH_SERVER_SIZE(glyph);
+		glyphData[i].aj = aj;
+
+		glyphDataV2[i].cacheIndex = indices[i];
+		glyphDataV2[i].x = glyph->x;
+		glyphDataV2[i].y = glyph->y;
+		glyphDataV2[i].cx = glyph->cx;
+		glyphDataV2[i].cy = glyph->cy;
+		glyphDataV2[i].cb = glyphData[i].cb;
+		glyphDataV2[i].aj = aj;
+
+		aj += glyphData[i].cb;
+	}
+
+	/* large glyphs go out in several orders */
+	for (first = 0; first < count; first += cache_glyph.cGlyphs)
+	{
+		orderSize = 0;
+		cache_glyph.cGlyphs = 0;
+
+		for (i = first; i < count; i++)
+		{
+			if (i > first && orderSize + 10 + glyphData[i].cb > GLYPH_SERVER_MAX_ORDER_SIZE)
+				break;
+
+			orderSize += 10 + glyphData[i].cb;
+			cache_glyph.glyphData[i - first] = &glyphData[i];
+			cache_glyph_v2.glyphData[i - first] = &glyphDataV2[i];
+			cache_glyph.cGlyphs++;
+		}
+
+		if (glyph_cache->glyph_v2)
+		{
+			cache_glyph_v2.cacheId = id;
+			cache_glyph_v2.cGlyphs = cache_glyph.cGlyphs;
+			IFCALL(update->secondary->CacheGlyphV2, context, &cache_glyph_v2);
+		}
+		else
+		{
+			cache_glyph.cacheId = id;
+			IFCALL(update->secondary->CacheGlyph, context, &cache_glyph);
+		}
+	}
+}
+
+/**
+ * Send as many glyphs as fit in a single GlyphIndex order, along with a
+ * cache glyph order for those the client does not have yet.
+ * @return the number of glyphs sent
+ */
+
+static int glyph_cache_server_send_run(rdpGlyphCacheServer* glyph_cache, uint32 id,
+		GLYPH_SERVER_GLYPH* glyphs, int count, int* x, int y,
+		uint32 foreColor, uint32 backColor, RECTANGLE_16* opaque)
+{
+	int n;
+	int penX;
+	int misses;
+	uint32 key1;
+	uint32 key2;
+	uint32 index;
+	uint32 delta;
+	uint64 seed;
+	GLYPH_SERVER_GLYPH* glyph;
+	GLYPH_INDEX_ORDER glyph_index;
+	GLYPH_SERVER_CELL* cell = &glyph_cache->glyphCache[id];
+	GLYPH_SERVER_CELL* fragCache = &glyph_cache->fragCache;
+	GLYPH_SERVER_GLYPH* missGlyphs[GLYPH_SERVER_MAX_GLYPHS];
+	uint32 missIndices[GLYPH_SERVER_MAX_GLYPHS];
+	rdpUpdate* update = glyph_cache->update;
+	rdpContext* context = glyph_cache->context;
+	int left = 0, top = 0, right = 0, bottom = 0;
+
+	memset(&glyph_index, 0, sizeof(GLYPH_INDEX_ORDER));
+
+	penX = *x;
+	misses = 0;
+
+	for (n = 0; n < count; n++)
+	{
+		/* every glyph is placed relative to the previous one, the first one at the origin */
+		delta = (n > 0) ? glyphs[n - 1].advance & 0xFFFF : 0;
+
+		if (glyph_index.cbData + ((delta > 0x7F) ? 4 : 2) > GLYPH_SERVER_MAX_DATA)
+			break;
+
+		/* all the glyphs of an order have to stay in the cache until it is drawn */
+		if (n == (int) cell->number)
+			break;
+
+		glyph = &glyphs[n];
+		penX += delta;
+
+		seed = ((uint64) (glyph->x & 0xFFFF) << 48) | ((uint64) (glyph->y & 0xFFFF) << 32) |
+				((glyph->cx & 0xFFFF) << 16) | (glyph->cy & 0xFFFF);
+
+		glyph_cache_server_hash(glyph->aj, ((glyph->cx + 7) / 8) * glyph->cy, seed, &key1, &key2);
+
+		if (glyph_cache_server_cell_lookup(cell, key1, key2, &index))
+		{
+			metrics_count(context->metrics, METRICS_GLYPH_CACHE_HITS, 1);
+		}
+		else
+		{
+			metrics_count(context->metrics, METRICS_GLYPH_CACHE_MISSES, 1);
+
+			index = glyph_cache_server_cell_put(cell, key1, key2);
+			missGlyphs[misses] = glyph;
+			missIndices[misses] = index;
+			misses++;
+		}
+
+		glyph_index.data[glyph_index.cbData++] = index;
+
+		if (delta > 0x7F)
+		{
+			glyph_index.data[glyph_index.cbData++] = 0x80;
+			glyph_index.data[glyph_index.cbData++] = delta & 0xFF;
+			glyph_index.data[glyph_index.cbData++] = (delta >> 8) & 0xFF;
+		}
+		else
+		{
+			glyph_index.data[glyph_index.cbData++] = delta;
+		}
+
+		if (n == 0 || penX + glyph->x < left)
+			left = penX + glyph->x;
+
+		if (n == 0 || y + glyph->y < top)
+			top = y + glyph->y;
+
+		if (n == 0 || penX + glyph->x + (int) glyph->cx > right)
+			right = penX + glyph->x + glyph->cx;
+
+		if (n == 0 || y + glyph->y + (int) glyph->cy > bottom)
+			bottom = y + glyph->y + glyph->cy;
+	}
+
+	if (n > 1 && fragCache->number > 0 && glyph_index.cbData <= fragCache->size)
+	{
+		glyph_cache_server_hash(glyph_index.data, glyph_index.cbData,
+				(id << 8) | glyph_index.cbData, &key1, &key2);
+
+		if (glyph_cache_server_cell_lookup(fragCache, key1, key2, &index))
+		{
+			/* the delta of a fragment is always sent, some clients expect it */
+			glyph_index.data[0] = GLYPH_FRAGMENT_USE;
+			glyph_index.data[1] = index;
+			glyph_index.data[2] = 0;
+			glyph_index.cbData = 3;
+		}
+		else
+		{
+			index = glyph_cache_server_cell_put(fragCache, key1, key2);
+			glyph_index.data[glyph_index.cbData] = GLYPH_FRAGMENT_ADD;
+			glyph_index.data[glyph_index.cbData + 1] = index;
+			glyph_index.data[glyph_index.cbData + 2] = glyph_index.cbData;
+			glyph_index.cbData += 3;
+		}
+	}
+
+	if (misses > 0)
+		glyph_cache_server_send_glyphs(glyph_cache, id, missGlyphs, missIndices, misses);
+
+	/* the text color is the back color of a GlyphIndex order, the opaque rectangle color the fore color */
+	glyph_index.cacheId = id;
+	glyph_index.flAccel = SO_FLAG_DEFAULT_PLACEMENT | SO_HORIZONTAL;
+	glyph_index.backColor = foreColor;
+	glyph_index.foreColor = backColor;
+	glyph_index.bkLeft = MAX(left, 0);
+	glyph_index.bkTop = MAX(top, 0);
+	glyph_index.bkRight = MAX(right, 0);
+	glyph_index.bkBottom = MAX(bottom, 0);
+	glyph_index.x = *x;
+	glyph_index.y = y;
+
+	if (opaque != NULL)
+	{
+		glyph_index.opLeft = opaque->left;
+		glyph_index.opTop = opaque->top;
+		glyph_index.opRight = opaque->right;
+		glyph_index.opBottom = opaque->bottom;
+	}
+
+	IFCALL(update->primary->GlyphIndex, context, &glyph_index);
+
+	*x = (n > 0) ? penX + glyphs[n - 1].advance : penX;
+
+	return n;
+}
+
+/**
+ * Draw a line of text with glyph orders: the glyphs the client does not
+ * have yet are sent with cache glyph orders, and the text is drawn with
+ * GlyphIndex orders, as a glyph fragment when it repeats.
+ * @param glyphs glyphs of the text, left to right
+ * @param x origin of the first glyph, other glyphs follow by their advance
+ * @param y baseline of the text
+ * @param opaque rectangle filled with the background color first, right and
+ * bottom exclusive, or NULL for transparent text
+ * @return false when the client cannot cache glyphs this large, the caller
+ * has to draw the text another way
+ */
+
+boolean glyph_cache_server_send(rdpGlyphCacheServer* glyph_cache,
+		GLYPH_SERVER_GLYPH* glyphs, int count, int x, int y,
+		uint32 foreColor, uint32 backColor, RECTANGLE_16* opaque)
+{
+	int i;
+	sint32 id;
+	int sent = 0;
+	int maxSize = 0;
+
+	if (glyph_cache->enabled == false)
+		return false;
+
+	/* nothing to draw, don't send an empty GlyphIndex order */
+	if (count < 1)
+		return true;
+
+	/* an order draws from a single glyph cache, the one the largest glyph fits in */
+	for (i = 0; i < count; i++)
+		maxSize = MAX(maxSize, (int) GLYPH_SERVER_SIZE(&glyphs[i]));
+
+	id = glyph_cache_server_get_cell(glyph_cache, maxSize);
+
+	if (id < 0)
+		return false;
+
+	do
+	{
+		sent += glyph_cache_server_send_run(glyph_cache, id, &glyphs[sent], count - sent,
+				&x, y, foreColor, backColor, (sent == 0) ? opaque : NULL);
+	}
+	while (sent < count);
+
+	return true;
+}
+
+/**
+ * Forget the contents of every cache. The client starts with empty caches
+ * after a reactivation, which may also change the caches it advertised.
+ */
+
+void glyph_cache_server_reset(rdpGlyphCacheServer* glyph_cache)
+{
+	uint32 i;
+	GLYPH_CACHE_DEFINITION* definition;
+	rdpSettings* settings = glyph_cache->settings;
+
+	for (i = 0; i < 10; i++)
+		glyph_cache_server_cell_free(&glyph_cache->glyphCache[i]);
+
+	glyph_cache_server_cell_free(&glyph_cache->fragCache);
+
+	glyph_cache->enabled = false;
+	glyph_cache->glyph_v2 = (settings->glyphSupportLevel == GLYPH_SUPPORT_ENCODE) ? true : false;
+
+	if (settings->glyphSupportLevel == GLYPH_SUPPORT_NONE || settings->order_support[NEG_GLYPH_INDEX_INDEX] == false)
+		return;
+
+	for (i = 0; i < 10; i++)
+	{
+		definition = &settings->glyphCache[i];
+
+		glyph_cache_server_cell_init(&glyph_cache->glyphCache[i],
+				MIN(definition->cacheEntries, GLYPH_SERVER_MAX_ENTRIES), definition->cacheMaximumCellSize);
+
+		if (glyph_cache->glyphCache[i].number > 0)
+			glyph_cache->enabled = true;
+	}
+
+	/* fragment indices are a single byte */
+	if (settings->glyphSupportLevel >= GLYPH_SUPPORT_FULL)
+	{
+		glyph_cache_server_cell_init(&glyph_cache->fragCache,
+				MIN(settings->fragCache->cacheEntries, 256),
+				MIN(settings->fragCache->cacheMaximumCellSize, GLYPH_SERVER_MAX_DATA));
+	}
+}
+
+rdpGlyphCacheServer* glyph_cache_server_new(rdpContext* context)
+{
+	rdpGlyphCacheServer* glyph_cache;
+
+	glyph_cache = (rdpGlyphCacheServer*) xzalloc(sizeof(rdpGlyphCacheServer));
+
+	if (glyph_cache != NULL)
+	{
+		glyph_cache->context = context;
+		glyph_cache->update = context->peer->update;
+		glyph_cache->settings = context->peer->settings;
+
+		glyph_cache_server_reset(glyph_cache);
+	}
+
+	return glyph_cache;
+}
+
+void glyph_cache_server_free(rdpGlyphCacheServer* glyph_cache)
+{
+	uint32 i;
+
+	if (glyph_cache != NULL)
+	{
+		for (i = 0; i < 10; i++)
+			glyph_cache_server_cell_free(&glyph_cache->glyphCache[i]);
+
+		glyph_cache_server_cell_free(&glyph_cache->fragCache);
+
+		xfree(glyph_cache->buffer);
+		xfree(glyph_cache);
+	}
+}
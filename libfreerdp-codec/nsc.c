@@ -234,7 +234,7 @@ void nsc_context_free(NSC_CONTEXT* context)
 {
 	int i;
 
-	for (i = 0; i < 4; i++)
+	for (i = 0; i < 5; i++)
 	{
 		if (context->priv->plane_buf[i])
 			xfree(context->priv->plane_buf[i]);
@@ -313,6 +313,9 @@ void nsc_process_message(NSC_CONTEXT* context, uint16 bpp,
 	uint16 width, uint16 height, uint8* data, uint32 length)
 {
 	STREAM* s;
+	uint64 start;
+
+	start = METRICS_START(context->metrics);
 
 	s = stream_new(0);
 	stream_attach(s, data, length);
@@ -332,4 +335,7 @@ void nsc_process_message(NSC_CONTEXT* context, uint16 bpp,
 	PROFILER_ENTER(context->priv->prof_nsc_decode);
 	context->decode(context);
 	PROFILER_EXIT(context->priv->prof_nsc_decode);
+
+	metrics_record_since(context->metrics, METRICS_NSC_DECODE, start);
+	metrics_count(context->metrics, METRICS_NSC_PIXELS_DECODED, width * height);
 }
@@ -327,6 +327,9 @@ void nsc_compose_message(NSC_CONTEXT* context, STREAM* s,
 	uint8* bmpdata, int width, int height, int rowstride)
 {
 	int i;
+	uint64 start;
+
+	start = METRICS_START(context->metrics);
 
 	context->width = width;
 	context->height = height;
@@ -360,4 +363,7 @@ void nsc_compose_message(NSC_CONTEXT* context, STREAM* s,
 			stream_write(s, context->priv->plane_buf[i], context->nsc_stream.PlaneByteCount[i]);
 		}
 	}
+
+	metrics_record_since(context->metrics, METRICS_NSC_ENCODE, start);
+	metrics_count(context->metrics, METRICS_NSC_PIXELS_ENCODED, width * height);
 }
@@ -62,6 +62,44 @@ static const uint32 rfx_default_quantization_values[] =
 	6, 6, 6, 6, 7, 7, 8, 8, 8, 9
 };
 
+/**
+ * The quality levels of the rate controller. The first is the default table,
+ * each one after it quantizes every band one step more, which roughly halves
+ * the size of the encoded tiles.
+ */
+static const uint32 rfx_quality_levels[RFX_QUALITY_LEVELS * 10] =
+{
+	6, 6, 6, 6, 7, 7, 8, 8, 8, 9,
+	7, 7, 7, 7, 8, 8, 9, 9, 9, 10,
+	8, 8, 8, 8, 9, 9, 10, 10, 10, 11,
+	9, 9, 9, 9, 10, 10, 11, 11, 11, 12,
+	10, 10, 10, 10, 11, 11, 12, 12, 12, 13,
+	11, 11, 11, 11, 12, 12, 13, 13, 13, 14
+};
+
+#define RFX_RATE_MIN_INTERVAL		20000	/* microseconds between two feedback samples */
+#define RFX_RATE_MAX_DELAY		100000	/* microseconds it may take to send what is queued */
+#define RFX_RATE_MIN_QUEUE		16384	/* bytes queued that never count as congestion */
+#define RFX_RATE_HOLD			8	/* good samples in a row before the quality goes up */
+#define RFX_CHANGING_TILE		3	/* changes in the last 8 messages that make a tile changing */
+#define RFX_REFINE_TILES		16	/* tiles sent again at a finer level per message */
+
+static boolean rfx_tile_equal(const uint8* src, int rowstride, const uint8* cached, int line_length, int height)
+{
+	int y;
+
+	for (y = 0; y < height; y++)
+	{
+		if (memcmp(src, cached, line_length) != 0)
+			return false;
+
+		src += rowstride;
+		cached += line_length;
+	}
+
+	return true;
+}
+
 static void rfx_profiler_create(RFX_CONTEXT* context)
 {
 	PROFILER_CREATE(context->priv->prof_rfx_decode_rgb, "rfx_decode_rgb");
@@ -157,6 +195,7 @@ RFX_CONTEXT* rfx_context_new(void)
 	context->quantization_encode = rfx_quantization_encode;	
 	context->dwt_2d_decode = rfx_dwt_2d_decode;
 	context->dwt_2d_encode = rfx_dwt_2d_encode;
+	context->tile_equal = rfx_tile_equal;
 
 	return context;
 }
@@ -168,10 +207,167 @@ void rfx_context_set_cpu_opt(RFX_CONTEXT* context, uint32 cpu_opt)
 		RFX_INIT_SIMD(context);
 }
 
+static void rfx_tile_cache_free(RFX_CONTEXT* context)
+{
+	RFX_CONTEXT_PRIV* priv = context->priv;
+
+	xfree(priv->cache_data);
+	xfree(priv->cache_valid);
+	xfree(priv->cache_marks);
+	xfree(priv->cache_tiles);
+	xfree(priv->cache_rects);
+	xfree(priv->cache_history);
+	xfree(priv->cache_levels);
+
+	priv->cache_data = NULL;
+	priv->cache_valid = NULL;
+	priv->cache_marks = NULL;
+	priv->cache_tiles = NULL;
+	priv->cache_rects = NULL;
+	priv->cache_history = NULL;
+	priv->cache_levels = NULL;
+	priv->cache_rects_size = 0;
+	priv->cache_tiles_x = 0;
+	priv->cache_tiles_y = 0;
+}
+
+/* (re)allocates the cache when the surface size or pixel format changed */
+static void rfx_tile_cache_resize(RFX_CONTEXT* context, int width, int height)
+{
+	int numTiles;
+	int numTilesX;
+	int numTilesY;
+	int bytesPerPixel;
+	RFX_CONTEXT_PRIV* priv = context->priv;
+
+	numTilesX = (width + 63) / 64;
+	numTilesY = (height + 63) / 64;
+	bytesPerPixel = context->bits_per_pixel / 8;
+
+	if (priv->cache_tiles_x == numTilesX && priv->cache_tiles_y == numTilesY &&
+		priv->cache_bytes_per_pixel == bytesPerPixel)
+		return;
+
+	rfx_tile_cache_free(context);
+
+	numTiles = numTilesX * numTilesY;
+	priv->cache_tiles_x = numTilesX;
+	priv->cache_tiles_y = numTilesY;
+	priv->cache_bytes_per_pixel = bytesPerPixel;
+	priv->cache_data = (uint8*) xmalloc(numTiles * 64 * 64 * bytesPerPixel);
+	priv->cache_valid = (boolean*) xzalloc(numTiles * sizeof(boolean));
+	priv->cache_marks = (boolean*) xzalloc(numTiles * sizeof(boolean));
+	priv->cache_tiles = (uint16*) xmalloc(numTiles * sizeof(uint16));
+	priv->cache_rects_size = numTiles;
+	priv->cache_rects = (RFX_RECT*) xmalloc(numTiles * sizeof(RFX_RECT));
+	priv->cache_history = (uint8*) xzalloc(numTiles);
+	priv->cache_levels = (uint8*) xzalloc(numTiles);
+}
+
+/**
+ * The tile cache lets the encoder skip tiles that are the same as when they
+ * were last encoded, like a blinking cursor leaves most of its damage untouched.
+ */
+
+void rfx_context_set_tile_cache(RFX_CONTEXT* context, boolean enabled)
+{
+	context->priv->tile_cache = enabled;
+
+	if (!enabled)
+		rfx_tile_cache_free(context);
+}
+
+/**
+ * The rate controller picks the quality level of each message from how fast
+ * the peer takes the data in and, if not zero, the target bitrate.
+ * Per tile quality needs the tile cache.
+ */
+
+void rfx_context_set_rate_control(RFX_CONTEXT* context, boolean enabled, uint32 target_bitrate)
+{
+	RFX_CONTEXT_PRIV* priv = context->priv;
+
+	priv->rate_control = enabled;
+	priv->target_bitrate = target_bitrate;
+	priv->quality_level = 0;
+	priv->quality_hold = 0;
+	priv->rate_time = 0;
+	priv->rate_bytes = 0;
+	priv->throughput = 0;
+}
+
+/**
+ * Feedback from the transport: the time in microseconds, the total number of
+ * bytes sent so far and the number of bytes still queued for the peer.
+ *
+ * The quality goes down a level as soon as what is queued would take more
+ * than RFX_RATE_MAX_DELAY to send, or the throughput is above the target,
+ * and only goes back up after RFX_RATE_HOLD good samples in a row.
+ *
+ * When the context has a metrics registry the encoder samples the transport
+ * counters itself before each message, so this is only needed without one.
+ */
+
+void rfx_context_rate_feedback(RFX_CONTEXT* context, uint64 time, uint64 bytes_sent, uint32 bytes_queued)
+{
+	uint64 rate;
+	uint64 budget;
+	uint64 interval;
+	uint64 max_queue;
+	RFX_CONTEXT_PRIV* priv = context->priv;
+
+	if (priv->rate_time == 0 || time < priv->rate_time || bytes_sent < priv->rate_bytes)
+	{
+		priv->rate_time = time;
+		priv->rate_bytes = bytes_sent;
+		return;
+	}
+
+	interval = time - priv->rate_time;
+
+	if (interval < RFX_RATE_MIN_INTERVAL)
+		return;
+
+	rate = (bytes_sent - priv->rate_bytes) * 1000000 / interval;
+	priv->throughput = (priv->throughput * 3 + rate) / 4;
+	priv->rate_time = time;
+	priv->rate_bytes = bytes_sent;
+
+	budget = priv->target_bitrate / 8;
+	max_queue = MAX(priv->throughput * RFX_RATE_MAX_DELAY / 1000000, RFX_RATE_MIN_QUEUE);
+
+	if (bytes_queued > max_queue || (budget != 0 && priv->throughput > budget))
+	{
+		if (priv->quality_level < RFX_QUALITY_LEVELS - 1)
+			priv->quality_level++;
+
+		priv->quality_hold = 0;
+	}
+	else if (budget == 0 || priv->throughput < budget * 3 / 4)
+	{
+		if (++priv->quality_hold >= RFX_RATE_HOLD && priv->quality_level > 0)
+		{
+			priv->quality_level--;
+			priv->quality_hold = 0;
+		}
+	}
+	else
+	{
+		priv->quality_hold = 0;
+	}
+}
+
+int rfx_context_get_quality_level(RFX_CONTEXT* context)
+{
+	return context->priv->quality_level;
+}
+
 void rfx_context_free(RFX_CONTEXT* context)
 {
 	xfree(context->quants);
 
+	rfx_tile_cache_free(context);
+
 	rfx_pool_free(context->priv->pool);
 
 	rfx_profiler_print(context);
@@ -213,6 +409,10 @@ void rfx_context_set_pixel_format(RFX_CONTEXT* context, RDP_PIXEL_FORMAT pixel_f
 void rfx_context_reset(RFX_CONTEXT* context)
 {
 	context->header_processed = false;
+
+	/* whoever receives the next frame has none of the cached tiles */
+	if (context->priv->cache_valid != NULL)
+		memset(context->priv->cache_valid, 0, context->priv->cache_tiles_x * context->priv->cache_tiles_y * sizeof(boolean));
 	context->frame_idx = 0;
 }
 
@@ -508,8 +708,11 @@ RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, uint8* data, uint32 lengt
 	STREAM* s;
 	uint32 blockLen;
 	uint32 blockType;
+	uint64 start;
 	RFX_MESSAGE* message;
 
+	start = METRICS_START(context->metrics);
+
 	s = stream_new(0);
 	message = xnew(RFX_MESSAGE);
 	stream_attach(s, data, length);
@@ -583,6 +786,9 @@ RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, uint8* data, uint32 lengt
 	stream_detach(s);
 	stream_free(s);
 
+	metrics_record_since(context->metrics, METRICS_RFX_DECODE, start);
+	metrics_count(context->metrics, METRICS_RFX_TILES_DECODED, message->num_tiles);
+
 	return message;
 }
 
@@ -775,7 +981,7 @@ static void rfx_compose_message_tile(RFX_CONTEXT* context, STREAM* s,
 }
 
 static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
-	uint8* image_data, int width, int height, int rowstride)
+	uint8* image_data, int width, int height, int rowstride, const uint16* tiles, int num_tiles)
 {
 	int size;
 	int start_pos, end_pos;
@@ -791,9 +997,19 @@ static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
 	int numTilesY;
 	int xIdx;
 	int yIdx;
+	int tileIdx;
 	int tilesDataSize;
+	RFX_CONTEXT_PRIV* priv = context->priv;
 
-	if (context->num_quants == 0)
+	if (priv->rate_control)
+	{
+		numQuants = RFX_QUALITY_LEVELS;
+		quantVals = rfx_quality_levels;
+		quantIdxY = priv->quality_level;
+		quantIdxCb = priv->quality_level;
+		quantIdxCr = priv->quality_level;
+	}
+	else if (context->num_quants == 0)
 	{
 		numQuants = 1;
 		quantVals = rfx_default_quantization_values;
@@ -812,7 +1028,7 @@ static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
 
 	numTilesX = (width + 63) / 64;
 	numTilesY = (height + 63) / 64;
-	numTiles = numTilesX * numTilesY;
+	numTiles = (tiles != NULL) ? num_tiles : numTilesX * numTilesY;
 
 	size = 22 + numQuants * 5;
 	stream_check_size(s, size);
@@ -840,16 +1056,24 @@ static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
 	DEBUG_RFX("width:%d height:%d rowstride:%d", width, height, rowstride);
 
 	end_pos = stream_get_pos(s);
-	for (yIdx = 0; yIdx < numTilesY; yIdx++)
+	for (i = 0; i < numTiles; i++)
 	{
-		for (xIdx = 0; xIdx < numTilesX; xIdx++)
+		tileIdx = (tiles != NULL) ? tiles[i] : i;
+		xIdx = tileIdx % numTilesX;
+		yIdx = tileIdx / numTilesX;
+
+		if (priv->rate_control && tiles != NULL)
 		{
-			rfx_compose_message_tile(context, s,
-				image_data + yIdx * 64 * rowstride + xIdx * 8 * context->bits_per_pixel,
-				(xIdx < numTilesX - 1) ? 64 : width - xIdx * 64,
-				(yIdx < numTilesY - 1) ? 64 : height - yIdx * 64,
-				rowstride, quantVals, quantIdxY, quantIdxCb, quantIdxCr, xIdx, yIdx);
+			quantIdxY = priv->cache_levels[tileIdx];
+			quantIdxCb = quantIdxY;
+			quantIdxCr = quantIdxY;
 		}
+
+		rfx_compose_message_tile(context, s,
+			image_data + yIdx * 64 * rowstride + xIdx * 8 * context->bits_per_pixel,
+			(xIdx < numTilesX - 1) ? 64 : width - xIdx * 64,
+			(yIdx < numTilesY - 1) ? 64 : height - yIdx * 64,
+			rowstride, quantVals, quantIdxY, quantIdxCb, quantIdxCr, xIdx, yIdx);
 	}
 	tilesDataSize = stream_get_pos(s) - end_pos;
 	size += tilesDataSize;
@@ -874,21 +1098,238 @@ static void rfx_compose_message_frame_end(RFX_CONTEXT* context, STREAM* s)
 }
 
 static void rfx_compose_message_data(RFX_CONTEXT* context, STREAM* s,
-	const RFX_RECT* rects, int num_rects, uint8* image_data, int width, int height, int rowstride)
+	const RFX_RECT* rects, int num_rects, uint8* image_data, int width, int height, int rowstride,
+	const uint16* tiles, int num_tiles)
 {
 	rfx_compose_message_frame_begin(context, s);
 	rfx_compose_message_region(context, s, rects, num_rects);
-	rfx_compose_message_tileset(context, s, image_data, width, height, rowstride);
+	rfx_compose_message_tileset(context, s, image_data, width, height, rowstride, tiles, num_tiles);
 	rfx_compose_message_frame_end(context, s);
 }
 
+static int rfx_bit_count(uint8 bits)
+{
+	int count;
+
+	for (count = 0; bits != 0; bits &= bits - 1)
+		count++;
+
+	return count;
+}
+
+static void rfx_tile_cache_add_rect(RFX_CONTEXT_PRIV* priv, int* num_rects, int x1, int y1, int x2, int y2)
+{
+	RFX_RECT* rect;
+
+	if (*num_rects >= priv->cache_rects_size)
+	{
+		priv->cache_rects_size *= 2;
+		priv->cache_rects = (RFX_RECT*) xrealloc(priv->cache_rects, priv->cache_rects_size * sizeof(RFX_RECT));
+	}
+
+	rect = &priv->cache_rects[(*num_rects)++];
+	rect->x = x1;
+	rect->y = y1;
+	rect->width = x2 - x1;
+	rect->height = y2 - y1;
+}
+
+/**
+ * Finds the tiles covered by rects that changed since they were last encoded,
+ * and updates their cached pixels. The region is the part of the rects on the
+ * changed tiles, so the pixels of a tile outside of the rects are never shown.
+ * Changed tiles that are next to each other in a row of tiles share a rect.
+ *
+ * With rate control, also picks the quality level of each tile and adds the
+ * tiles to send again at a finer level. Those are sent whole, so image_data
+ * has to hold the whole surface, not only the damaged areas.
+ */
+
+static int rfx_tile_cache_update(RFX_CONTEXT* context, const RFX_RECT* rects, int num_rects,
+	uint8* image_data, int width, int height, int rowstride, int* num_changed_rects, int* num_skipped)
+{
+	int i, y;
+	int x1, y1, x2, y2;
+	int xIdx, yIdx;
+	int xEnd;
+	int tileIdx;
+	int tileWidth;
+	int tileHeight;
+	int lineLength;
+	int level;
+	boolean changed;
+	int numTiles = 0;
+	int numRects = 0;
+	int numSkipped = 0;
+	int numRefined = 0;
+	uint8* src;
+	uint8* cached;
+	RFX_CONTEXT_PRIV* priv = context->priv;
+
+	rfx_tile_cache_resize(context, width, height);
+
+	for (i = 0; i < num_rects; i++)
+	{
+		x1 = MAX(rects[i].x, 0);
+		y1 = MAX(rects[i].y, 0);
+		x2 = MIN(rects[i].x + rects[i].width, width);
+		y2 = MIN(rects[i].y + rects[i].height, height);
+
+		if (x1 >= x2 || y1 >= y2)
+			continue;
+
+		for (yIdx = y1 / 64; yIdx <= (y2 - 1) / 64; yIdx++)
+		{
+			for (xIdx = x1 / 64; xIdx <= (x2 - 1) / 64; xIdx++)
+				priv->cache_marks[yIdx * priv->cache_tiles_x + xIdx] = true;
+		}
+	}
+
+	for (tileIdx = 0; tileIdx < priv->cache_tiles_x * priv->cache_tiles_y; tileIdx++)
+	{
+		xIdx = tileIdx % priv->cache_tiles_x;
+		yIdx = tileIdx / priv->cache_tiles_x;
+		tileWidth = MIN(64, width - xIdx * 64);
+		tileHeight = MIN(64, height - yIdx * 64);
+		level = priv->quality_level;
+		changed = false;
+
+		if (priv->cache_marks[tileIdx])
+		{
+			priv->cache_marks[tileIdx] = false;
+
+			lineLength = tileWidth * priv->cache_bytes_per_pixel;
+			src = image_data + yIdx * 64 * rowstride + xIdx * 64 * priv->cache_bytes_per_pixel;
+			cached = priv->cache_data + tileIdx * 64 * 64 * priv->cache_bytes_per_pixel;
+
+			if (priv->cache_valid[tileIdx] && context->tile_equal(src, rowstride, cached, lineLength, tileHeight))
+			{
+				numSkipped++;
+			}
+			else
+			{
+				for (y = 0; y < tileHeight; y++)
+					memcpy(cached + y * lineLength, src + y * rowstride, lineLength);
+
+				priv->cache_valid[tileIdx] = true;
+				changed = true;
+			}
+		}
+
+		priv->cache_history[tileIdx] = (priv->cache_history[tileIdx] << 1) | (changed ? 1 : 0);
+
+		if (changed)
+		{
+			/* tiles that keep changing, like video, do not need as much detail */
+			if (priv->rate_control && rfx_bit_count(priv->cache_history[tileIdx]) >= RFX_CHANGING_TILE)
+				level = MIN(level + 1, RFX_QUALITY_LEVELS - 1);
+
+			/* marks the tiles whose rects are clipped below */
+			priv->cache_marks[tileIdx] = true;
+		}
+		else
+		{
+			/* tiles that stopped changing get sent again once the link allows a finer level */
+			if (!priv->rate_control || !priv->cache_valid[tileIdx] || priv->cache_history[tileIdx] != 0 ||
+				priv->cache_levels[tileIdx] <= level || numRefined >= RFX_REFINE_TILES)
+				continue;
+
+			numRefined++;
+
+			rfx_tile_cache_add_rect(priv, &numRects, xIdx * 64, yIdx * 64,
+				xIdx * 64 + tileWidth, yIdx * 64 + tileHeight);
+		}
+
+		priv->cache_levels[tileIdx] = level;
+		priv->cache_tiles[numTiles++] = tileIdx;
+	}
+
+	for (i = 0; i < num_rects; i++)
+	{
+		x1 = MAX(rects[i].x, 0);
+		y1 = MAX(rects[i].y, 0);
+		x2 = MIN(rects[i].x + rects[i].width, width);
+		y2 = MIN(rects[i].y + rects[i].height, height);
+
+		if (x1 >= x2 || y1 >= y2)
+			continue;
+
+		for (yIdx = y1 / 64; yIdx <= (y2 - 1) / 64; yIdx++)
+		{
+			for (xIdx = x1 / 64; xIdx <= (x2 - 1) / 64; xIdx = xEnd)
+			{
+				for (xEnd = xIdx; xEnd <= (x2 - 1) / 64; xEnd++)
+				{
+					if (!priv->cache_marks[yIdx * priv->cache_tiles_x + xEnd])
+						break;
+				}
+
+				if (xEnd == xIdx)
+				{
+					xEnd++;
+					continue;
+				}
+
+				rfx_tile_cache_add_rect(priv, &numRects,
+					MAX(x1, xIdx * 64), MAX(y1, yIdx * 64),
+					MIN(x2, xEnd * 64), MIN(y2, (yIdx + 1) * 64));
+			}
+		}
+	}
+
+	for (i = 0; i < numTiles; i++)
+		priv->cache_marks[priv->cache_tiles[i]] = false;
+
+	*num_changed_rects = numRects;
+	*num_skipped = numSkipped;
+
+	return numTiles;
+}
+
 FREERDP_API void rfx_compose_message(RFX_CONTEXT* context, STREAM* s,
 	const RFX_RECT* rects, int num_rects, uint8* image_data, int width, int height, int rowstride)
 {
-	/* Only the first frame should send the RemoteFX header */
-	if (context->frame_idx == 0 && !context->header_processed)
-		rfx_compose_message_header(context, s);
+	uint64 start;
+	int numTiles;
+	int numRects;
+	int numSkipped;
 
-	rfx_compose_message_data(context, s, rects, num_rects, image_data, width, height, rowstride);
-}
+	start = METRICS_START(context->metrics);
+
+	if (context->priv->rate_control && context->metrics != NULL)
+	{
+		rfx_context_rate_feedback(context, metrics_time(),
+			metrics_get_counter(context->metrics, METRICS_BYTES_OUT),
+			metrics_get_gauge(context->metrics, METRICS_SEND_QUEUE));
+	}
+
+	if (context->priv->tile_cache)
+	{
+		numTiles = rfx_tile_cache_update(context, rects, num_rects,
+			image_data, width, height, rowstride, &numRects, &numSkipped);
+
+		metrics_count(context->metrics, METRICS_RFX_TILES_SKIPPED, numSkipped);
+
+		if (numTiles == 0)
+			return;
 
+		if (context->frame_idx == 0 && !context->header_processed)
+			rfx_compose_message_header(context, s);
+
+		rfx_compose_message_data(context, s, context->priv->cache_rects, numRects,
+			image_data, width, height, rowstride, context->priv->cache_tiles, numTiles);
+	}
+	else
+	{
+		numTiles = ((width + 63) / 64) * ((height + 63) / 64);
+
+		/* Only the first frame should send the RemoteFX header */
+		if (context->frame_idx == 0 && !context->header_processed)
+			rfx_compose_message_header(context, s);
+
+		rfx_compose_message_data(context, s, rects, num_rects, image_data, width, height, rowstride, NULL, 0);
+	}
+
+	metrics_record_since(context->metrics, METRICS_RFX_ENCODE, start);
+	metrics_count(context->metrics, METRICS_RFX_TILES_ENCODED, numTiles);
+}
@@ -649,6 +649,36 @@ static void rfx_dwt_2d_encode_sse2(sint16* buffer, sint16* dwt_buffer)
 	rfx_dwt_2d_encode_block_sse2(buffer + 3840, dwt_buffer, 8);
 }
 
+static boolean rfx_tile_equal_sse2(const uint8* src, int rowstride, const uint8* cached, int line_length, int height)
+{
+	int x, y;
+	__m128i a, b;
+	__m128i diff;
+
+	for (y = 0; y < height; y++)
+	{
+		diff = _mm_setzero_si128();
+
+		for (x = 0; x + 16 <= line_length; x += 16)
+		{
+			a = _mm_loadu_si128((const __m128i*) (src + x));
+			b = _mm_loadu_si128((const __m128i*) (cached + x));
+			diff = _mm_or_si128(diff, _mm_xor_si128(a, b));
+		}
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xFFFF)
+			return false;
+
+		if (x < line_length && memcmp(src + x, cached + x, line_length - x) != 0)
+			return false;
+
+		src += rowstride;
+		cached += line_length;
+	}
+
+	return true;
+}
+
 void rfx_init_sse2(RFX_CONTEXT* context)
 {
 	DEBUG_RFX("Using SSE2 optimizations");
@@ -666,4 +696,5 @@ void rfx_init_sse2(RFX_CONTEXT* context)
 	context->quantization_encode = rfx_quantization_encode_sse2;
 	context->dwt_2d_decode = rfx_dwt_2d_decode_sse2;
 	context->dwt_2d_encode = rfx_dwt_2d_encode_sse2;
+	context->tile_equal = rfx_tile_equal_sse2;
 }
@@ -50,6 +50,29 @@ struct _RFX_CONTEXT_PRIV
 
 	sint16* dwt_buffer;
 
+	/* encoder tile cache, the pixels of each tile as it was last encoded */
+	boolean tile_cache;
+	int cache_tiles_x;
+	int cache_tiles_y;
+	int cache_bytes_per_pixel;
+	uint8* cache_data; /* 64x64 tiles, one after the other */
+	boolean* cache_valid;
+	boolean* cache_marks; /* tiles covered by the rects of the message being composed */
+	uint16* cache_tiles; /* tiles of the message being composed */
+	RFX_RECT* cache_rects; /* region of the message being composed */
+	int cache_rects_size;
+	uint8* cache_history; /* one bit per message, most recent lowest, set when the tile changed */
+	uint8* cache_levels; /* quality level each tile was last sent at */
+
+	/* encoder rate control */
+	boolean rate_control;
+	uint32 target_bitrate; /* bits per second, 0 for none */
+	int quality_level;
+	int quality_hold; /* good feedback samples in a row */
+	uint64 rate_time; /* microseconds, time of the last feedback sample */
+	uint64 rate_bytes; /* bytes sent at the last feedback sample */
+	uint64 throughput; /* bytes per second, smoothed */
+
 	/* profilers */
 	PROFILER_DEFINE(prof_rfx_decode_rgb);
 	PROFILER_DEFINE(prof_rfx_decode_component);
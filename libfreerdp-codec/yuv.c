@@ -0,0 +1,185 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * YUV to RGB Conversion
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freerdp/codec/yuv.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/constants.h>
+
+#include "yuv_types.h"
+
+#ifdef WITH_SSE2
+#include "yuv_sse2.h"
+#endif
+
+#ifndef YUV_INIT_SIMD
+#define YUV_INIT_SIMD(_context) do { } while (0)
+#endif
+
+#define YUV_CLIP(_v) ((_v) < 0 ? 0 : ((_v) > 255 ? 255 : (_v)))
+
+void yuv_decode_row(const uint8* y, const uint8* u, const uint8* v, uint8* dst, int width)
+{
+	int x;
+	sint32 c, d, e;
+	sint32 r, g, b;
+
+	for (x = 0; x < width; x++)
+	{
+		c = YUV_MUL(y[x] - 16, YUV_Y);
+		d = u[x >> 1] - 128;
+		e = v[x >> 1] - 128;
+
+		r = c + YUV_MUL(e, YUV_RV);
+		g = c - YUV_MUL(d, YUV_GU) - YUV_MUL(e, YUV_GV);
+		b = c + YUV_MUL(d, YUV_BU);
+
+		*dst++ = YUV_CLIP(b);
+		*dst++ = YUV_CLIP(g);
+		*dst++ = YUV_CLIP(r);
+		*dst++ = 0xFF;
+	}
+}
+
+YUV_CONTEXT* yuv_context_new(void)
+{
+	YUV_CONTEXT* context;
+
+	context = xnew(YUV_CONTEXT);
+	context->decode_row = yuv_decode_row;
+	context->row_source = -1;
+
+	return context;
+}
+
+void yuv_context_set_cpu_opt(YUV_CONTEXT* context, uint32 cpu_opt)
+{
+	/* enable SIMD CPU acceleration if detected */
+	if (cpu_opt & CPU_SSE2)
+		YUV_INIT_SIMD(context);
+}
+
+void yuv_context_free(YUV_CONTEXT* context)
+{
+	xfree(context->row_buffer);
+	xfree(context);
+}
+
+boolean yuv_get_yuv420p_planes(uint8* data, uint32 size, int width, int height,
+	const uint32* offsets, const uint32* steps, uint8* planes[3], int plane_steps[3])
+{
+	int i;
+	int rows;
+	int columns;
+	uint64 offset;
+	uint64 luma_size;
+	uint64 chroma_size;
+
+	if (width <= 0 || height <= 0)
+		return false;
+
+	luma_size = (uint64) width * height;
+	chroma_size = (uint64) ((width + 1) / 2) * ((height + 1) / 2);
+
+	for (i = 0; i < 3; i++)
+	{
+		columns = (i == 0) ? width : (width + 1) / 2;
+		rows = (i == 0) ? height : (height + 1) / 2;
+
+		if (steps == NULL || steps[0] == 0)
+		{
+			offset = (i == 0) ? 0 : luma_size + (i - 1) * chroma_size;
+			plane_steps[i] = columns;
+		}
+		else
+		{
+			offset = offsets[i];
+			plane_steps[i] = (int) steps[i];
+
+			if (steps[i] > 0x7FFFFFFF)
+				return false;
+		}
+
+		if (plane_steps[i] < columns || offset + (uint64) plane_steps[i] * (rows - 1) + columns > size)
+			return false;
+
+		planes[i] = data + offset;
+	}
+
+	return true;
+}
+
+static uint8* yuv_decode_source_row(YUV_CONTEXT* context, const uint8* planes[3], const int steps[3],
+	int src_width, int sy)
+{
+	if (context->row_buffer_width < src_width)
+	{
+		context->row_buffer = (uint8*) xrealloc(context->row_buffer, src_width * 4);
+		context->row_buffer_width = src_width;
+		context->row_source = -1;
+	}
+
+	if (context->row_source != sy)
+	{
+		context->decode_row(planes[0] + sy * steps[0], planes[1] + (sy >> 1) * steps[1],
+			planes[2] + (sy >> 1) * steps[2], context->row_buffer, src_width);
+		context->row_source = sy;
+	}
+
+	return context->row_buffer;
+}
+
+void yuv_decode_yuv420p(YUV_CONTEXT* context, const uint8* planes[3], const int steps[3],
+	int src_width, int src_height, uint8* dst, int dst_step, int dst_width, int dst_height)
+{
+	int x, y;
+	int sy;
+	uint32 sx;
+	uint32 x_step;
+	uint32* src_row;
+	uint32* dst_row;
+
+	if (src_width <= 0 || src_height <= 0 || dst_width <= 0 || dst_height <= 0)
+		return;
+
+	/* 16.16 fixed point source column increment */
+	x_step = (uint32) (((uint64) src_width << 16) / dst_width);
+
+	for (y = 0; y < dst_height; y++)
+	{
+		sy = (int) (((uint64) y * src_height) / dst_height);
+		dst_row = (uint32*) (dst + y * dst_step);
+
+		if (dst_width == src_width)
+		{
+			context->decode_row(planes[0] + sy * steps[0], planes[1] + (sy >> 1) * steps[1],
+				planes[2] + (sy >> 1) * steps[2], (uint8*) dst_row, dst_width);
+			continue;
+		}
+
+		/* scaling converts each source row once, upscaled rows repeat it */
+		src_row = (uint32*) yuv_decode_source_row(context, planes, steps, src_width, sy);
+
+		for (x = 0, sx = x_step >> 1; x < dst_width; x++, sx += x_step)
+			dst_row[x] = src_row[sx >> 16];
+	}
+
+	/* the planes change with the next frame */
+	context->row_source = -1;
+}
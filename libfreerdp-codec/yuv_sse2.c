@@ -0,0 +1,102 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * YUV to RGB Conversion - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include "yuv_types.h"
+#include "yuv_sse2.h"
+
+/* eight pixels of (Y - 16) * 128 and chroma (C - 128) * 128, each chroma sample covering two pixels */
+static __inline void yuv_decode_8_sse2(__m128i y, __m128i d, __m128i e,
+	__m128i* r, __m128i* g, __m128i* b)
+{
+	__m128i c;
+
+	c = _mm_mulhi_epi16(y, _mm_set1_epi16(YUV_Y));
+
+	*r = _mm_add_epi16(c, _mm_mulhi_epi16(e, _mm_set1_epi16(YUV_RV)));
+	*g = _mm_sub_epi16(_mm_sub_epi16(c, _mm_mulhi_epi16(d, _mm_set1_epi16(YUV_GU))),
+		_mm_mulhi_epi16(e, _mm_set1_epi16(YUV_GV)));
+	*b = _mm_add_epi16(c, _mm_mulhi_epi16(d, _mm_set1_epi16(YUV_BU)));
+}
+
+static void yuv_decode_row_sse2(const uint8* y, const uint8* u, const uint8* v, uint8* dst, int width)
+{
+	int x;
+	__m128i yy, uu, vv;
+	__m128i y_lo, y_hi;
+	__m128i d_lo, d_hi;
+	__m128i e_lo, e_hi;
+	__m128i r_lo, g_lo, b_lo;
+	__m128i r_hi, g_hi, b_hi;
+	__m128i r, g, b;
+	__m128i bg, ra;
+	__m128i zero = _mm_setzero_si128();
+	__m128i alpha = _mm_set1_epi8((char) 0xFF);
+	__m128i y_bias = _mm_set1_epi16(16);
+	__m128i c_bias = _mm_set1_epi16(128);
+
+	/* sixteen pixels per iteration, eight chroma samples */
+	for (x = 0; x + 16 <= width; x += 16)
+	{
+		yy = _mm_loadu_si128((const __m128i*) &y[x]);
+		uu = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) &u[x >> 1]), zero);
+		vv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) &v[x >> 1]), zero);
+
+		y_lo = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(yy, zero), y_bias), 7);
+		y_hi = _mm_slli_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(yy, zero), y_bias), 7);
+
+		uu = _mm_slli_epi16(_mm_sub_epi16(uu, c_bias), 7);
+		vv = _mm_slli_epi16(_mm_sub_epi16(vv, c_bias), 7);
+
+		/* duplicate each chroma sample for its two pixels */
+		d_lo = _mm_unpacklo_epi16(uu, uu);
+		d_hi = _mm_unpackhi_epi16(uu, uu);
+		e_lo = _mm_unpacklo_epi16(vv, vv);
+		e_hi = _mm_unpackhi_epi16(vv, vv);
+
+		yuv_decode_8_sse2(y_lo, d_lo, e_lo, &r_lo, &g_lo, &b_lo);
+		yuv_decode_8_sse2(y_hi, d_hi, e_hi, &r_hi, &g_hi, &b_hi);
+
+		/* saturate to bytes, then interleave to B G R A */
+		r = _mm_packus_epi16(r_lo, r_hi);
+		g = _mm_packus_epi16(g_lo, g_hi);
+		b = _mm_packus_epi16(b_lo, b_hi);
+
+		bg = _mm_unpacklo_epi8(b, g);
+		ra = _mm_unpacklo_epi8(r, alpha);
+		_mm_storeu_si128((__m128i*) &dst[x * 4], _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128((__m128i*) &dst[x * 4 + 16], _mm_unpackhi_epi16(bg, ra));
+
+		bg = _mm_unpackhi_epi8(b, g);
+		ra = _mm_unpackhi_epi8(r, alpha);
+		_mm_storeu_si128((__m128i*) &dst[x * 4 + 32], _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128((__m128i*) &dst[x * 4 + 48], _mm_unpackhi_epi16(bg, ra));
+	}
+
+	if (x < width)
+		yuv_decode_row(&y[x], &u[x >> 1], &v[x >> 1], &dst[x * 4], width - x);
+}
+
+void yuv_init_sse2(YUV_CONTEXT* context)
+{
+	context->decode_row = yuv_decode_row_sse2;
+}
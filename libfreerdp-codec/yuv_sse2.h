@@ -0,0 +1,29 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * YUV to RGB Conversion - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __YUV_SSE2_H
+#define __YUV_SSE2_H
+
+#include <freerdp/codec/yuv.h>
+
+void yuv_init_sse2(YUV_CONTEXT* context);
+
+#ifndef YUV_INIT_SIMD
+#define YUV_INIT_SIMD(_context) yuv_init_sse2(_context)
+#endif
+
+#endif /* __YUV_SSE2_H */
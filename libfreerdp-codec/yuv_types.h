@@ -0,0 +1,38 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * YUV to RGB Conversion
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __YUV_TYPES_H
+#define __YUV_TYPES_H
+
+#include <freerdp/codec/yuv.h>
+
+/**
+ * BT.601 video range coefficients scaled by 512. The product is taken as
+ * (value * 128 * coefficient) >> 16, which is exactly what a 16-bit SIMD
+ * multiply-high computes, so every implementation produces the same pixels.
+ */
+#define YUV_Y		597	/* 1.164, rounded up so that white (235) reaches 255 */
+#define YUV_RV		817	/* 1.596 */
+#define YUV_GU		200	/* 0.391 */
+#define YUV_GV		416	/* 0.813 */
+#define YUV_BU		1033	/* 2.018 */
+
+#define YUV_MUL(_v, _c)	(((_v) * 128 * (_c)) >> 16)
+
+void yuv_decode_row(const uint8* y, const uint8* u, const uint8* v, uint8* dst, int width);
+
+#endif /* __YUV_TYPES_H */
@@ -288,6 +288,7 @@ boolean rdp_recv_deactivate_all(rdpRdp* rdp, STREAM* s)
 		stream_seek(s, lengthSourceDescriptor); /* sourceDescriptor (should be 0x00) */
 	}
 
+	metrics_phase_begin(rdp->metrics);
 	rdp->state = CONNECTION_STATE_CAPABILITY;
 
 	while (rdp->state != CONNECTION_STATE_ACTIVE)
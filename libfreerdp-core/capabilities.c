@@ -836,10 +836,23 @@ void rdp_write_cache_definition(STREAM* s, GLYPH_CACHE_DEFINITION* cache_definit
 
 void rdp_read_glyph_cache_capability_set(STREAM* s, uint16 length, rdpSettings* settings)
 {
+	int i;
 	uint16 glyphSupportLevel;
 
-	stream_seek(s, 40); /* glyphCache (40 bytes) */
-	stream_seek_uint32(s); /* fragCache (4 bytes) */
+	if (settings->server_mode)
+	{
+		/* glyphCache (40 bytes) */
+		for (i = 0; i < 10; i++)
+			rdp_read_cache_definition(s, &(settings->glyphCache[i])); /* glyphCache0-9 (4 bytes) */
+
+		rdp_read_cache_definition(s, settings->fragCache); /* fragCache (4 bytes) */
+	}
+	else
+	{
+		stream_seek(s, 40); /* glyphCache (40 bytes) */
+		stream_seek_uint32(s); /* fragCache (4 bytes) */
+	}
+
 	stream_read_uint16(s, glyphSupportLevel); /* glyphSupportLevel (2 bytes) */
 	stream_seek_uint16(s); /* pad2Octets (2 bytes) */
 
@@ -962,6 +975,16 @@ void rdp_write_bitmap_cache_host_support_capability_set(STREAM* s, rdpSettings*
 	rdp_capability_set_finish(s, header, CAPSET_TYPE_BITMAP_CACHE_HOST_SUPPORT);
 }
 
+void rdp_read_bitmap_cache_cell_info(STREAM* s, BITMAP_CACHE_V2_CELL_INFO* cellInfo)
+{
+	uint32 info;
+
+	stream_read_uint32(s, info);
+
+	cellInfo->numEntries = (info & 0x7FFFFFFF);
+	cellInfo->persistent = (info & 0x80000000) ? true : false;
+}
+
 void rdp_write_bitmap_cache_cell_info(STREAM* s, BITMAP_CACHE_V2_CELL_INFO* cellInfo)
 {
 	uint32 info;
@@ -984,14 +1007,26 @@ void rdp_write_bitmap_cache_cell_info(STREAM* s, BITMAP_CACHE_V2_CELL_INFO* cell
 
 void rdp_read_bitmap_cache_v2_capability_set(STREAM* s, uint16 length, rdpSettings* settings)
 {
+	int i;
+	uint8 numCellCaches;
+
 	stream_seek_uint16(s); /* cacheFlags (2 bytes) */
 	stream_seek_uint8(s); /* pad2 (1 byte) */
-	stream_seek_uint8(s); /* numCellCaches (1 byte) */
-	stream_seek(s, 4); /* bitmapCache0CellInfo (4 bytes) */
-	stream_seek(s, 4); /* bitmapCache1CellInfo (4 bytes) */
-	stream_seek(s, 4); /* bitmapCache2CellInfo (4 bytes) */
-	stream_seek(s, 4); /* bitmapCache3CellInfo (4 bytes) */
-	stream_seek(s, 4); /* bitmapCache4CellInfo (4 bytes) */
+	stream_read_uint8(s, numCellCaches); /* numCellCaches (1 byte) */
+
+	if (settings->server_mode)
+	{
+		/* the server needs the cache layout of the client to send bitmap cache orders */
+		settings->bitmapCacheV2NumCells = MIN(numCellCaches, 5);
+
+		for (i = 0; i < 5; i++)
+			rdp_read_bitmap_cache_cell_info(s, &settings->bitmapCacheV2CellInfo[i]); /* bitmapCacheNCellInfo (4 bytes) */
+	}
+	else
+	{
+		stream_seek(s, 20); /* bitmapCache0CellInfo to bitmapCache4CellInfo (20 bytes) */
+	}
+
 	stream_seek(s, 12); /* pad3 (12 bytes) */
 }
 
@@ -22,6 +22,7 @@
 
 #include "connection.h"
 #include "transport.h"
+#include "replay.h"
 
 #include <freerdp/errorcodes.h>
 
@@ -66,6 +67,8 @@ boolean rdp_client_connect(rdpRdp* rdp)
 {
 	rdpSettings* settings = rdp->settings;
 
+	metrics_phase_begin(rdp->metrics);
+
 	nego_init(rdp->nego);
 	nego_set_target(rdp->nego, settings->hostname, settings->port);
 	nego_set_cookie(rdp->nego, settings->username);
@@ -88,6 +91,10 @@ boolean rdp_client_connect(rdpRdp* rdp)
 		return false;
 	}
 
+	/* with TLS or NLA the transport closes the negotiation phase before its handshake */
+	if (rdp->nego->selected_protocol == PROTOCOL_RDP)
+		metrics_phase_end(rdp->metrics, METRICS_CONNECT_NEGO);
+
 	if ((rdp->nego->selected_protocol & PROTOCOL_TLS) || (rdp->nego->selected_protocol == PROTOCOL_RDP))
 	{
 		if ((settings->username != NULL) && ((settings->password != NULL) || (settings->password_cookie != NULL && settings->password_cookie->length > 0)))
@@ -148,6 +155,7 @@ boolean rdp_client_redirect(rdpRdp* rdp)
 	xfree(settings->ip_address);
 
 	rdp->transport = transport_new(settings);
+	rdp->transport->metrics = rdp->metrics;
 	rdp->license = license_new(rdp);
 	rdp->nego = nego_new(rdp->transport);
 	rdp->mcs = mcs_new(rdp->transport);
@@ -418,6 +426,7 @@ boolean rdp_client_connect_mcs_channel_join_confirm(rdpRdp* rdp, STREAM* s)
 			return false;
 		if (!rdp_send_client_info(rdp))
 			return false;
+		metrics_phase_end(rdp->metrics, METRICS_CONNECT_MCS);
 		rdp->state = CONNECTION_STATE_LICENSE;
 	}
 
@@ -437,6 +446,7 @@ boolean rdp_client_connect_license(rdpRdp* rdp, STREAM* s)
 
 	if (rdp->license->state == LICENSE_STATE_COMPLETED)
 	{
+		metrics_phase_end(rdp->metrics, METRICS_CONNECT_LICENSE);
 		rdp->state = CONNECTION_STATE_CAPABILITY;
 	}
 
@@ -479,6 +489,7 @@ boolean rdp_client_connect_demand_active(rdpRdp* rdp, STREAM* s)
 	 */
 	if (width != rdp->settings->width || height != rdp->settings->height)
 	{
+		replay_record_desktop(rdp);
 		IFCALL(rdp->update->DesktopResize, rdp->update->context);
 	}
 
@@ -0,0 +1,703 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Server Event Loop
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/select.h>
+#endif
+
+#include <freerdp/utils/list.h>
+#include <freerdp/utils/mutex.h>
+#include <freerdp/utils/sleep.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/thread.h>
+#include <freerdp/utils/wait_obj.h>
+#include <freerdp/event_loop.h>
+
+#define EVENT_LOOP_MAX_EVENTS	64
+
+enum EVENT_SOURCE_TYPE
+{
+	EVENT_SOURCE_STOP = 0,
+	EVENT_SOURCE_LISTENER,
+	EVENT_SOURCE_SESSION
+};
+
+typedef struct _EVENT_WORKER EVENT_WORKER;
+typedef struct _EVENT_LISTENER EVENT_LISTENER;
+typedef struct _EVENT_SESSION_SOURCE EVENT_SESSION_SOURCE;
+
+/* the epoll data of every watched descriptor points to one of these, they all start with the type */
+struct _EVENT_LISTENER
+{
+	int type;
+	freerdp_listener* instance;
+};
+
+struct _EVENT_SESSION_SOURCE
+{
+	psEventSessionCheck check;
+	void* arg;
+};
+
+struct rdp_event_session
+{
+	int type;
+	freerdp_peer* client;
+	psEventSessionClosed closed;
+
+	int num_sources;
+	EVENT_SESSION_SOURCE sources[EVENT_SESSION_MAX_SOURCES];
+	int num_fds;
+	int fds[EVENT_SESSION_MAX_FDS];
+
+	rdpEventLoop* loop;
+	/* NULL until the handshake is over */
+	EVENT_WORKER* worker;
+
+	/* protected by the worker's lock */
+	boolean queued;
+	boolean closing;
+};
+
+struct _EVENT_WORKER
+{
+	rdpEventLoop* loop;
+	freerdp_thread* thread;
+	LIST* queue;
+	int num_sessions;
+};
+
+struct rdp_event_loop
+{
+	int epfd;
+	int stop_type;
+	struct wait_obj* stop_event;
+
+	int num_workers;
+	EVENT_WORKER* workers;
+
+	/* sessions still in their handshake, each serviced by a thread of its own */
+	struct wait_obj* handshake_stop;
+	int num_handshakes;
+
+	freerdp_mutex mutex;
+	LIST* listeners;
+	LIST* sessions;
+	/* closed sessions, freed by the dispatcher once no epoll event can refer to them */
+	LIST* closed;
+};
+
+static boolean event_session_check_peer(void* arg)
+{
+	freerdp_peer* client = (freerdp_peer*) arg;
+
+	return client->CheckFileDescriptor(client);
+}
+
+static void event_session_close_peer(freerdp_peer* client)
+{
+	client->Disconnect(client);
+	freerdp_peer_context_free(client);
+	freerdp_peer_free(client);
+}
+
+rdpEventSession* freerdp_event_session_new(freerdp_peer* client, psEventSessionClosed closed)
+{
+	int rcount;
+	void* rfds[EVENT_SESSION_MAX_FDS];
+	rdpEventSession* session;
+
+	session = xnew(rdpEventSession);
+	session->type = EVENT_SOURCE_SESSION;
+	session->client = client;
+	session->closed = (closed != NULL) ? closed : event_session_close_peer;
+
+	rcount = 0;
+
+	if (!client->GetFileDescriptor(client, rfds, &rcount) ||
+		!freerdp_event_session_add_fds(session, rfds, rcount, event_session_check_peer, client))
+	{
+		xfree(session);
+		return NULL;
+	}
+
+	return session;
+}
+
+/**
+ * Watch more descriptors for a session. Each source is checked whenever any
+ * descriptor of the session is readable, like the select() loops did.
+ */
+
+boolean freerdp_event_session_add_fds(rdpEventSession* session, void** rfds, int rcount,
+		psEventSessionCheck check, void* arg)
+{
+	int i;
+
+	if (session->num_sources >= EVENT_SESSION_MAX_SOURCES || session->num_fds + rcount > EVENT_SESSION_MAX_FDS)
+		return false;
+
+	session->sources[session->num_sources].check = check;
+	session->sources[session->num_sources].arg = arg;
+	session->num_sources++;
+
+	for (i = 0; i < rcount; i++)
+		session->fds[session->num_fds++] = (int)(long) rfds[i];
+
+	return true;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+static boolean event_loop_watch(rdpEventLoop* loop, int op, int fd, void* source, uint32 events)
+{
+	struct epoll_event event;
+
+	memset(&event, 0, sizeof(event));
+	event.events = events;
+	event.data.ptr = source;
+
+	if (epoll_ctl(loop->epfd, op, fd, &event) != 0)
+	{
+		perror("epoll_ctl");
+		return false;
+	}
+
+	return true;
+}
+
+/* session descriptors are one-shot, so events stop while a worker services the session */
+static void event_session_rearm(rdpEventLoop* loop, rdpEventSession* session)
+{
+	int i;
+
+	for (i = 0; i < session->num_fds; i++)
+		event_loop_watch(loop, EPOLL_CTL_MOD, session->fds[i], session, EPOLLIN | EPOLLONESHOT);
+}
+
+static boolean event_session_check(rdpEventSession* session)
+{
+	int i;
+
+	for (i = 0; i < session->num_sources; i++)
+	{
+		if (!session->sources[i].check(session->sources[i].arg))
+			return false;
+	}
+
+	return true;
+}
+
+static void event_session_close(rdpEventLoop* loop, rdpEventSession* session)
+{
+	int i;
+	EVENT_WORKER* worker = session->worker;
+
+	if (worker != NULL)
+	{
+		/* it may have been queued again while it was being checked */
+		freerdp_thread_lock(worker->thread);
+		session->closing = true;
+		if (session->queued)
+			list_remove(worker->queue, session);
+		freerdp_thread_unlock(worker->thread);
+
+		for (i = 0; i < session->num_fds; i++)
+			epoll_ctl(loop->epfd, EPOLL_CTL_DEL, session->fds[i], NULL);
+	}
+
+	session->closed(session->client);
+
+	freerdp_mutex_lock(loop->mutex);
+	list_remove(loop->sessions, session);
+	if (worker != NULL)
+		worker->num_sessions--;
+	list_enqueue(loop->closed, session);
+	freerdp_mutex_unlock(loop->mutex);
+}
+
+static void event_worker_process_queue(EVENT_WORKER* worker)
+{
+	rdpEventSession* session;
+	rdpEventLoop* loop = worker->loop;
+
+	while (!freerdp_thread_is_stopped(worker->thread))
+	{
+		freerdp_thread_lock(worker->thread);
+		session = (rdpEventSession*) list_dequeue(worker->queue);
+		if (session)
+			session->queued = false;
+		freerdp_thread_unlock(worker->thread);
+
+		if (session == NULL)
+			break;
+
+		if (event_session_check(session))
+			event_session_rearm(loop, session);
+		else
+			event_session_close(loop, session);
+	}
+}
+
+static void* event_worker_thread_func(void* arg)
+{
+	EVENT_WORKER* worker = (EVENT_WORKER*) arg;
+
+	while (1)
+	{
+		freerdp_thread_wait(worker->thread);
+
+		if (freerdp_thread_is_stopped(worker->thread))
+			break;
+
+		freerdp_thread_reset(worker->thread);
+		event_worker_process_queue(worker);
+	}
+
+	freerdp_thread_quit(worker->thread);
+
+	return NULL;
+}
+
+static void event_loop_schedule(rdpEventSession* session)
+{
+	boolean signal = false;
+	EVENT_WORKER* worker = session->worker;
+
+	freerdp_thread_lock(worker->thread);
+
+	if (!session->queued && !session->closing)
+	{
+		session->queued = true;
+		list_enqueue(worker->queue, session);
+		signal = true;
+	}
+
+	freerdp_thread_unlock(worker->thread);
+
+	if (signal)
+		freerdp_thread_signal(worker->thread);
+}
+
+/**
+ * Gives the session to the worker with the fewest sessions and starts
+ * watching its descriptors. The session is closed if they cannot be watched.
+ */
+
+static boolean event_loop_watch_session(rdpEventLoop* loop, rdpEventSession* session)
+{
+	int i;
+	EVENT_WORKER* worker;
+
+	freerdp_mutex_lock(loop->mutex);
+
+	worker = &loop->workers[0];
+
+	for (i = 1; i < loop->num_workers; i++)
+	{
+		if (loop->workers[i].num_sessions < worker->num_sessions)
+			worker = &loop->workers[i];
+	}
+
+	worker->num_sessions++;
+	session->worker = worker;
+
+	freerdp_mutex_unlock(loop->mutex);
+
+	for (i = 0; i < session->num_fds; i++)
+	{
+		if (!event_loop_watch(loop, EPOLL_CTL_ADD, session->fds[i], session, EPOLLIN | EPOLLONESHOT))
+		{
+			event_session_close(loop, session);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * The security handshake of a peer (TLS accept, NLA) blocks until the client
+ * has answered, so sessions are checked on a thread of their own until the
+ * peer is activated, the same way the select() loops did it.
+ */
+
+static void* event_session_handshake_func(void* arg)
+{
+	int i;
+	int fd;
+	int max_fd;
+	int count;
+	void* fds[1];
+	fd_set rfds_set;
+	boolean status = true;
+	rdpEventSession* session = (rdpEventSession*) arg;
+	rdpEventLoop* loop = session->loop;
+
+	count = 0;
+	wait_obj_get_fds(loop->handshake_stop, fds, &count);
+
+	while (1)
+	{
+		max_fd = (int)(long) fds[0];
+		FD_ZERO(&rfds_set);
+		FD_SET(max_fd, &rfds_set);
+
+		for (i = 0; i < session->num_fds; i++)
+		{
+			fd = session->fds[i];
+			FD_SET(fd, &rfds_set);
+			if (fd > max_fd)
+				max_fd = fd;
+		}
+
+		if (select(max_fd + 1, &rfds_set, NULL, NULL, NULL) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+
+			perror("select");
+			status = false;
+			break;
+		}
+
+		if (wait_obj_is_set(loop->handshake_stop))
+			break;
+
+		if (!event_session_check(session))
+		{
+			status = false;
+			break;
+		}
+
+		if (session->client->activated)
+			break;
+	}
+
+	/* once the loop is being freed, the sessions left are closed by freerdp_event_loop_free() */
+	if (!wait_obj_is_set(loop->handshake_stop))
+	{
+		if (status)
+			event_loop_watch_session(loop, session);
+		else
+			event_session_close(loop, session);
+	}
+
+	freerdp_mutex_lock(loop->mutex);
+	loop->num_handshakes--;
+	freerdp_mutex_unlock(loop->mutex);
+
+	return NULL;
+}
+
+static void event_loop_free_closed(rdpEventLoop* loop)
+{
+	rdpEventSession* session;
+
+	freerdp_mutex_lock(loop->mutex);
+
+	while ((session = (rdpEventSession*) list_dequeue(loop->closed)) != NULL)
+		xfree(session);
+
+	freerdp_mutex_unlock(loop->mutex);
+}
+
+rdpEventLoop* freerdp_event_loop_new(int num_workers)
+{
+	int i;
+	int count;
+	void* fds[1];
+	rdpEventLoop* loop;
+
+	loop = xnew(rdpEventLoop);
+
+	loop->epfd = epoll_create(EVENT_LOOP_MAX_EVENTS);
+
+	if (loop->epfd == -1)
+	{
+		perror("epoll_create");
+		xfree(loop);
+		return NULL;
+	}
+
+	loop->mutex = freerdp_mutex_new();
+	loop->listeners = list_new();
+	loop->sessions = list_new();
+	loop->closed = list_new();
+
+	loop->stop_type = EVENT_SOURCE_STOP;
+	loop->stop_event = wait_obj_new();
+	count = 0;
+	wait_obj_get_fds(loop->stop_event, fds, &count);
+	event_loop_watch(loop, EPOLL_CTL_ADD, (int)(long) fds[0], &loop->stop_type, EPOLLIN);
+
+	loop->handshake_stop = wait_obj_new();
+
+	loop->num_workers = (num_workers > 0) ? num_workers : 1;
+	loop->workers = (EVENT_WORKER*) xzalloc(sizeof(EVENT_WORKER) * loop->num_workers);
+
+	for (i = 0; i < loop->num_workers; i++)
+	{
+		loop->workers[i].loop = loop;
+		loop->workers[i].queue = list_new();
+		loop->workers[i].thread = freerdp_thread_new();
+		freerdp_thread_start(loop->workers[i].thread, event_worker_thread_func, &loop->workers[i]);
+	}
+
+	return loop;
+}
+
+/**
+ * Stops the handshake threads and the workers, then closes the sessions still
+ * open on the calling thread. Listeners are not closed, they belong to the caller.
+ */
+
+void freerdp_event_loop_free(rdpEventLoop* loop)
+{
+	int i;
+	int count;
+	rdpEventSession* session;
+
+	if (loop == NULL)
+		return;
+
+	/* a thread in the middle of a check finishes it first */
+	wait_obj_set(loop->handshake_stop);
+
+	while (1)
+	{
+		freerdp_mutex_lock(loop->mutex);
+		count = loop->num_handshakes;
+		freerdp_mutex_unlock(loop->mutex);
+
+		if (count == 0)
+			break;
+
+		freerdp_usleep(10000);
+	}
+
+	for (i = 0; i < loop->num_workers; i++)
+		freerdp_thread_stop(loop->workers[i].thread);
+
+	while ((session = (rdpEventSession*) list_peek(loop->sessions)) != NULL)
+		event_session_close(loop, session);
+
+	event_loop_free_closed(loop);
+
+	for (i = 0; i < loop->num_workers; i++)
+	{
+		freerdp_thread_free(loop->workers[i].thread);
+		list_free(loop->workers[i].queue);
+	}
+
+	while (list_size(loop->listeners) > 0)
+		xfree(list_dequeue(loop->listeners));
+
+	close(loop->epfd);
+	wait_obj_free(loop->stop_event);
+	wait_obj_free(loop->handshake_stop);
+	list_free(loop->listeners);
+	list_free(loop->sessions);
+	list_free(loop->closed);
+	freerdp_mutex_free(loop->mutex);
+	xfree(loop->workers);
+	xfree(loop);
+}
+
+boolean freerdp_event_loop_add_listener(rdpEventLoop* loop, freerdp_listener* instance)
+{
+	int i;
+	int rcount;
+	void* rfds[EVENT_SESSION_MAX_FDS];
+	EVENT_LISTENER* listener;
+
+	rcount = 0;
+
+	if (!instance->GetFileDescriptor(instance, rfds, &rcount))
+		return false;
+
+	listener = xnew(EVENT_LISTENER);
+	listener->type = EVENT_SOURCE_LISTENER;
+	listener->instance = instance;
+
+	freerdp_mutex_lock(loop->mutex);
+	list_enqueue(loop->listeners, listener);
+	freerdp_mutex_unlock(loop->mutex);
+
+	for (i = 0; i < rcount; i++)
+	{
+		if (!event_loop_watch(loop, EPOLL_CTL_ADD, (int)(long) rfds[i], listener, EPOLLIN))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * The loop takes the session over, it is freed when the session closes,
+ * also when it cannot be watched. A peer not activated yet goes through its
+ * handshake on a thread of its own before it is given to a worker.
+ */
+
+boolean freerdp_event_loop_add_session(rdpEventLoop* loop, rdpEventSession* session)
+{
+	pthread_t th;
+	boolean handshake;
+
+	handshake = !session->client->activated;
+	session->loop = loop;
+
+	freerdp_mutex_lock(loop->mutex);
+	list_enqueue(loop->sessions, session);
+	if (handshake)
+		loop->num_handshakes++;
+	freerdp_mutex_unlock(loop->mutex);
+
+	if (!handshake)
+		return event_loop_watch_session(loop, session);
+
+	if (pthread_create(&th, 0, event_session_handshake_func, session) != 0)
+	{
+		freerdp_mutex_lock(loop->mutex);
+		loop->num_handshakes--;
+		freerdp_mutex_unlock(loop->mutex);
+
+		event_session_close(loop, session);
+		return false;
+	}
+
+	pthread_detach(th);
+
+	return true;
+}
+
+int freerdp_event_loop_get_session_count(rdpEventLoop* loop)
+{
+	int count;
+
+	freerdp_mutex_lock(loop->mutex);
+	count = list_size(loop->sessions);
+	freerdp_mutex_unlock(loop->mutex);
+
+	return count;
+}
+
+/**
+ * Runs the dispatcher on the calling thread until freerdp_event_loop_stop().
+ */
+
+boolean freerdp_event_loop_run(rdpEventLoop* loop)
+{
+	int i;
+	int count;
+	boolean status = true;
+	EVENT_LISTENER* listener;
+	struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+
+	while (!wait_obj_is_set(loop->stop_event))
+	{
+		count = epoll_wait(loop->epfd, events, EVENT_LOOP_MAX_EVENTS, -1);
+
+		if (count == -1)
+		{
+			if (errno == EINTR)
+				continue;
+
+			perror("epoll_wait");
+			status = false;
+			break;
+		}
+
+		for (i = 0; i < count; i++)
+		{
+			switch (*((int*) events[i].data.ptr))
+			{
+				case EVENT_SOURCE_LISTENER:
+					listener = (EVENT_LISTENER*) events[i].data.ptr;
+
+					if (!listener->instance->CheckFileDescriptor(listener->instance))
+						printf("Failed to check FreeRDP listener file descriptor\n");
+					break;
+
+				case EVENT_SOURCE_SESSION:
+					event_loop_schedule((rdpEventSession*) events[i].data.ptr);
+					break;
+
+				default:
+					break;
+			}
+		}
+
+		event_loop_free_closed(loop);
+	}
+
+	return status;
+}
+
+void freerdp_event_loop_stop(rdpEventLoop* loop)
+{
+	wait_obj_set(loop->stop_event);
+}
+
+#else
+
+rdpEventLoop* freerdp_event_loop_new(int num_workers)
+{
+	printf("freerdp_event_loop_new: epoll is not available on this platform\n");
+	return NULL;
+}
+
+void freerdp_event_loop_free(rdpEventLoop* loop)
+{
+}
+
+boolean freerdp_event_loop_add_listener(rdpEventLoop* loop, freerdp_listener* instance)
+{
+	return false;
+}
+
+boolean freerdp_event_loop_add_session(rdpEventLoop* loop, rdpEventSession* session)
+{
+	xfree(session);
+	return false;
+}
+
+int freerdp_event_loop_get_session_count(rdpEventLoop* loop)
+{
+	return 0;
+}
+
+boolean freerdp_event_loop_run(rdpEventLoop* loop)
+{
+	return false;
+}
+
+void freerdp_event_loop_stop(rdpEventLoop* loop)
+{
+}
+
+#endif /* HAVE_SYS_EPOLL_H */
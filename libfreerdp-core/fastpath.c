@@ -182,7 +182,7 @@ static void fastpath_recv_update_synchronize(rdpFastPath* fastpath, STREAM* s)
 	stream_seek_uint16(s); /* size (2 bytes), must be set to zero */
 }
 
-static boolean fastpath_recv_update(rdpFastPath* fastpath, uint8 updateCode, uint32 size, STREAM* s)
+boolean fastpath_recv_update(rdpFastPath* fastpath, uint8 updateCode, uint32 size, STREAM* s)
 {
 	rdpUpdate* update = fastpath->rdp->update;
 	rdpContext* context = fastpath->rdp->update->context;
@@ -280,6 +280,8 @@ static boolean fastpath_recv_update_data(rdpFastPath* fastpath, STREAM* s)
 	next_pos = stream_get_pos(s) + size;
 	comp_stream = s;
 
+	metrics_pdu_in(rdp->metrics, METRICS_PDU_FASTPATH_UPDATE(updateCode), size);
+
 	if (compressionFlags & PACKET_COMPRESSED)
 	{
 		if (decompress_rdp(rdp->mppc_dec, s->p, size, compressionFlags, &roff, &rlen))
@@ -321,6 +323,9 @@ static boolean fastpath_recv_update_data(rdpFastPath* fastpath, STREAM* s)
 
 	if (update_stream)
 	{
+		if (rdp->record != NULL)
+			record_write(rdp->record, RECORD_TYPE_FASTPATH, updateCode, stream_get_tail(update_stream), totalSize);
+
 		if (!fastpath_recv_update(fastpath, updateCode, totalSize, update_stream))
 			return false;
 	}
@@ -335,7 +340,14 @@ static boolean fastpath_recv_update_data(rdpFastPath* fastpath, STREAM* s)
 
 boolean fastpath_recv_updates(rdpFastPath* fastpath, STREAM* s)
 {
-	rdpUpdate* update = fastpath->rdp->update;
+	uint64 start;
+	rdpRdp* rdp = fastpath->rdp;
+	rdpUpdate* update = rdp->update;
+
+	start = METRICS_START(rdp->metrics);
+
+	if (rdp->record != NULL)
+		record_write(rdp->record, RECORD_TYPE_BEGIN_PAINT, 0, NULL, 0);
 
 	IFCALL(update->BeginPaint, update->context);
 
@@ -348,8 +360,14 @@ boolean fastpath_recv_updates(rdpFastPath* fastpath, STREAM* s)
 		}
 	}
 
+	if (rdp->record != NULL)
+		record_write(rdp->record, RECORD_TYPE_END_PAINT, 0, NULL, 0);
+
 	IFCALL(update->EndPaint, update->context);
 
+	metrics_record_since(rdp->metrics, METRICS_FRAME_TIME, start);
+	metrics_count(rdp->metrics, METRICS_FRAMES, 1);
+
 	return true;
 }
 
@@ -458,9 +476,12 @@ static boolean fastpath_recv_input_event_unicode(rdpFastPath* fastpath, STREAM*
 
 static boolean fastpath_recv_input_event(rdpFastPath* fastpath, STREAM* s)
 {
+	uint8* mark;
 	uint8 eventFlags;
 	uint8 eventCode;
 
+	stream_get_mark(s, mark);
+
 	if (!fastpath_read_input_event_header(s, &eventFlags, &eventCode))
 		return false;
 
@@ -496,6 +517,8 @@ static boolean fastpath_recv_input_event(rdpFastPath* fastpath, STREAM* s)
 			break;
 	}
 
+	metrics_pdu_in(fastpath->rdp->metrics, METRICS_PDU_FASTPATH_INPUT(eventCode), s->p - mark);
+
 	return true;
 }
 
@@ -540,7 +563,12 @@ static uint32 fastpath_get_sec_bytes(rdpRdp* rdp)
 	return sec_bytes;
 }
 
-STREAM* fastpath_input_pdu_init(rdpFastPath* fastpath, uint8 eventFlags, uint8 eventCode)
+/**
+ * Starts a PDU for several input events, each one written
+ * with fastpath_write_input_event_header() and its data.
+ */
+
+STREAM* fastpath_input_pdu_init_multiple(rdpFastPath* fastpath)
 {
 	rdpRdp *rdp;
 	STREAM* s;
@@ -555,15 +583,39 @@ STREAM* fastpath_input_pdu_init(rdpFastPath* fastpath, uint8 eventFlags, uint8 e
 			rdp->sec_flags |= SEC_SECURE_CHECKSUM;
 	}
 	stream_seek(s, fastpath_get_sec_bytes(rdp));
+	return s;
+}
+
+void fastpath_write_input_event_header(STREAM* s, uint8 eventFlags, uint8 eventCode)
+{
 	stream_write_uint8(s, eventFlags | (eventCode << 5)); /* eventHeader (1 byte) */
+}
+
+STREAM* fastpath_input_pdu_init(rdpFastPath* fastpath, uint8 eventFlags, uint8 eventCode)
+{
+	STREAM* s;
+
+	s = fastpath_input_pdu_init_multiple(fastpath);
+	fastpath_write_input_event_header(s, eventFlags, eventCode);
 	return s;
 }
 
 boolean fastpath_send_input_pdu(rdpFastPath* fastpath, STREAM* s)
+{
+	return fastpath_send_multiple_input_pdu(fastpath, s, 1);
+}
+
+/**
+ * The event count is carried in the header, which limits
+ * a PDU to INPUT_MAX_EVENTS_PER_PDU events.
+ */
+
+boolean fastpath_send_multiple_input_pdu(rdpFastPath* fastpath, STREAM* s, int numberEvents)
 {
 	rdpRdp *rdp;
 	uint16 length;
 	uint8 eventHeader;
+	uint8 eventCode;
 	int sec_bytes;
 
 	rdp = fastpath->rdp;
@@ -575,16 +627,21 @@ boolean fastpath_send_input_pdu(rdpFastPath* fastpath, STREAM* s)
 		return false;
 	}
 
+	if (numberEvents < 1 || numberEvents > INPUT_MAX_EVENTS_PER_PDU)
+		return false;
+
 	eventHeader = FASTPATH_INPUT_ACTION_FASTPATH;
-	eventHeader |= (1 << 2); /* numberEvents */
+	eventHeader |= (numberEvents << 2); /* numberEvents */
 	if (rdp->sec_flags & SEC_ENCRYPT)
 		eventHeader |= (FASTPATH_INPUT_ENCRYPTED << 6);
 	if (rdp->sec_flags & SEC_SECURE_CHECKSUM)
 		eventHeader |= (FASTPATH_INPUT_SECURE_CHECKSUM << 6);
 
+	sec_bytes = fastpath_get_sec_bytes(fastpath->rdp);
+	eventCode = s->data[3 + sec_bytes] >> 5; /* the first event, before it gets encrypted */
+
 	stream_set_pos(s, 0);
 	stream_write_uint8(s, eventHeader);
-	sec_bytes = fastpath_get_sec_bytes(fastpath->rdp);
 	/*
 	 * We always encode length in two bytes, eventhough we could use
 	 * only one byte if length <= 0x7F. It is just easier that way,
@@ -609,6 +666,8 @@ boolean fastpath_send_input_pdu(rdpFastPath* fastpath, STREAM* s)
 
 	rdp->sec_flags = 0;
 
+	metrics_pdu_out(rdp->metrics, METRICS_PDU_FASTPATH_INPUT(eventCode), length);
+
 	stream_set_pos(s, length);
 	if (transport_write(fastpath->rdp->transport, s) < 0)
 		return false;
@@ -675,6 +734,8 @@ boolean fastpath_send_update_pdu(rdpFastPath* fastpath, uint8 updateCode, STREAM
 		{
 			if (compress_rdp(rdp->mppc_enc, ls->p + header_bytes, dlen))
 			{
+				metrics_count(rdp->metrics, METRICS_MPPC_BYTES_IN, dlen);
+
 				if (rdp->mppc_enc->flags & PACKET_COMPRESSED)
 				{
 					cflags = rdp->mppc_enc->flags;
@@ -685,6 +746,12 @@ boolean fastpath_send_update_pdu(rdpFastPath* fastpath, uint8 updateCode, STREAM
 					stream_attach(comp_update, bm, pdu_data_bytes + header_bytes);
 					ls = comp_update;
 				}
+				else
+				{
+					metrics_count(rdp->metrics, METRICS_MPPC_UNCOMPRESSED, 1);
+				}
+
+				metrics_count(rdp->metrics, METRICS_MPPC_BYTES_OUT, pdu_data_bytes);
 			}
 			else
 				printf("fastpath_send_update_pdu: mppc_encode failed\n");
@@ -725,6 +792,8 @@ boolean fastpath_send_update_pdu(rdpFastPath* fastpath, uint8 updateCode, STREAM
 		stream_attach(update, bm, pduLength);
 		stream_seek(update, pduLength);
 
+		metrics_pdu_out(rdp->metrics, METRICS_PDU_FASTPATH_UPDATE(updateCode), pduLength);
+
 		if (sec_bytes > 0)
 		{
 			/* does this work ? */
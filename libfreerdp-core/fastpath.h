@@ -105,11 +105,15 @@ struct rdp_fastpath
 uint16 fastpath_header_length(STREAM* s);
 uint16 fastpath_read_header(rdpFastPath* fastpath, STREAM* s);
 uint16 fastpath_read_header_rdp(rdpFastPath* fastpath, STREAM* s);
+boolean fastpath_recv_update(rdpFastPath* fastpath, uint8 updateCode, uint32 size, STREAM* s);
 boolean fastpath_recv_updates(rdpFastPath* fastpath, STREAM* s);
 boolean fastpath_recv_inputs(rdpFastPath* fastpath, STREAM* s);
 
 STREAM* fastpath_input_pdu_init(rdpFastPath* fastpath, uint8 eventFlags, uint8 eventCode);
 boolean fastpath_send_input_pdu(rdpFastPath* fastpath, STREAM* s);
+STREAM* fastpath_input_pdu_init_multiple(rdpFastPath* fastpath);
+void fastpath_write_input_event_header(STREAM* s, uint8 eventFlags, uint8 eventCode);
+boolean fastpath_send_multiple_input_pdu(rdpFastPath* fastpath, STREAM* s, int numberEvents);
 
 STREAM* fastpath_update_pdu_init(rdpFastPath* fastpath);
 boolean fastpath_send_update_pdu(rdpFastPath* fastpath, uint8 updateCode, STREAM* s);
@@ -21,6 +21,8 @@
 #include "input.h"
 #include "update.h"
 #include "surface.h"
+#include "render.h"
+#include "replay.h"
 #include "transport.h"
 #include "connection.h"
 #include "extension.h"
@@ -82,6 +84,8 @@ boolean freerdp_connect(freerdp* instance)
 				instance->update->dump_rfx = true;
 		}
 
+		replay_record_start(rdp);
+
 		extension_post_connect(rdp->extension);
 
 		IFCALLRET(instance->PostConnect, status, instance);
@@ -98,6 +102,14 @@ boolean freerdp_connect(freerdp* instance)
 			return false;
 		}
 
+		if (instance->settings->async_update && instance->settings->async_update_safe)
+		{
+			if (instance->update->render == NULL)
+				instance->update->render = render_new(instance->update);
+
+			render_start(instance->update->render);
+		}
+
 		if (instance->settings->play_rfx)
 		{
 			STREAM* s;
@@ -163,6 +175,8 @@ boolean freerdp_check_fds(freerdp* instance)
 	if (status < 0)
 		return false;
 
+	input_check_queue(rdp->input);
+
 	return true;
 }
 
@@ -176,8 +190,14 @@ boolean freerdp_disconnect(freerdp* instance)
 	rdpRdp* rdp;
 
 	rdp = instance->context->rdp;
+
+	if (rdp->update->render != NULL)
+		render_stop(rdp->update->render);
+
 	transport_disconnect(rdp->transport);
 
+	replay_record_stop(rdp);
+
 	return true;
 }
 
@@ -187,6 +207,34 @@ boolean freerdp_shall_disconnect(freerdp* instance)
 	return instance->context->rdp->disconnect;
 }
 
+/** Retrieves the counters of the asynchronous render pipeline.
+ *  @see rdp_settings.async_update
+ *
+ *  @return false if updates are rendered on the transport thread.
+ */
+boolean freerdp_get_render_stats(freerdp* instance, RENDER_STATS* stats)
+{
+	rdpRender* render;
+
+	render = instance->update->render;
+
+	if (render == NULL || !render->started)
+		return false;
+
+	render_get_stats(render, stats);
+
+	return true;
+}
+
+/** Copies the session metrics into a snapshot.
+ *  Cheap enough to be polled from a timer while connected.
+ *  Servers can call metrics_snapshot() on the peer context directly.
+ */
+void freerdp_get_metrics(freerdp* instance, METRICS_SNAPSHOT* snapshot)
+{
+	metrics_snapshot(instance->context->metrics, snapshot);
+}
+
 void freerdp_get_version(int* major, int* minor, int* revision)
 {
 	if (major != NULL)
@@ -222,6 +270,7 @@ void freerdp_context_new(freerdp* instance)
 	instance->context->graphics = graphics_new(instance->context);
 	instance->context->instance = instance;
 	instance->context->rdp = rdp;
+	instance->context->metrics = rdp->metrics;
 
 	instance->update->context = instance->context;
 	instance->update->pointer->context = instance->context;
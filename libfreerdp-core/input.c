@@ -18,12 +18,13 @@
  */
 
 #include <freerdp/input.h>
+#include <freerdp/utils/metrics.h>
 
 #include "input.h"
 
 void rdp_write_client_input_pdu_header(STREAM* s, uint16 number)
 {
-	stream_write_uint16(s, 1); /* numberEvents (2 bytes) */
+	stream_write_uint16(s, number); /* numberEvents (2 bytes) */
 	stream_write_uint16(s, 0); /* pad2Octets (2 bytes) */
 }
 
@@ -198,6 +199,200 @@ void input_send_fastpath_extended_mouse_event(rdpInput* input, uint16 flags, uin
 	fastpath_send_input_pdu(rdp->fastpath, s);
 }
 
+static void input_write_queued_event(STREAM* s, INPUT_QUEUE_EVENT* event)
+{
+	rdp_write_input_event_header(s, 0, event->type);
+
+	switch (event->type)
+	{
+		case INPUT_EVENT_SYNC:
+			input_write_synchronize_event(s, event->flags);
+			break;
+
+		case INPUT_EVENT_SCANCODE:
+			input_write_keyboard_event(s, event->flags, event->x);
+			break;
+
+		case INPUT_EVENT_UNICODE:
+			input_write_unicode_keyboard_event(s, event->flags, event->x);
+			break;
+
+		case INPUT_EVENT_MOUSE:
+			input_write_mouse_event(s, event->flags, event->x, event->y);
+			break;
+
+		case INPUT_EVENT_MOUSEX:
+			input_write_extended_mouse_event(s, event->flags, event->x, event->y);
+			break;
+	}
+}
+
+static void input_write_fastpath_queued_event(STREAM* s, INPUT_QUEUE_EVENT* event)
+{
+	uint8 eventFlags = 0;
+
+	switch (event->type)
+	{
+		case INPUT_EVENT_SYNC:
+			fastpath_write_input_event_header(s, (uint8) event->flags, FASTPATH_INPUT_EVENT_SYNC);
+			break;
+
+		case INPUT_EVENT_SCANCODE:
+			eventFlags |= (event->flags & KBD_FLAGS_RELEASE) ? FASTPATH_INPUT_KBDFLAGS_RELEASE : 0;
+			eventFlags |= (event->flags & KBD_FLAGS_EXTENDED) ? FASTPATH_INPUT_KBDFLAGS_EXTENDED : 0;
+			fastpath_write_input_event_header(s, eventFlags, FASTPATH_INPUT_EVENT_SCANCODE);
+			stream_write_uint8(s, event->x); /* keyCode (1 byte) */
+			break;
+
+		case INPUT_EVENT_UNICODE:
+			eventFlags |= (event->flags & KBD_FLAGS_RELEASE) ? FASTPATH_INPUT_KBDFLAGS_RELEASE : 0;
+			fastpath_write_input_event_header(s, eventFlags, FASTPATH_INPUT_EVENT_UNICODE);
+			stream_write_uint16(s, event->x); /* unicodeCode (2 bytes) */
+			break;
+
+		case INPUT_EVENT_MOUSE:
+			fastpath_write_input_event_header(s, 0, FASTPATH_INPUT_EVENT_MOUSE);
+			input_write_mouse_event(s, event->flags, event->x, event->y);
+			break;
+
+		case INPUT_EVENT_MOUSEX:
+			fastpath_write_input_event_header(s, 0, FASTPATH_INPUT_EVENT_MOUSEX);
+			input_write_extended_mouse_event(s, event->flags, event->x, event->y);
+			break;
+	}
+}
+
+/* sends the queued events in a single PDU, called with the queue locked */
+static void input_send_queue(rdpInput* input)
+{
+	int i;
+	STREAM* s;
+	rdpInputQueue* queue = input->queue;
+	rdpRdp* rdp = input->context->rdp;
+
+	if (queue->count == 0)
+		return;
+
+	if (rdp->settings->fastpath_input)
+	{
+		s = fastpath_input_pdu_init_multiple(rdp->fastpath);
+
+		for (i = 0; i < queue->count; i++)
+			input_write_fastpath_queued_event(s, &queue->events[i]);
+
+		fastpath_send_multiple_input_pdu(rdp->fastpath, s, queue->count);
+	}
+	else
+	{
+		s = rdp_data_pdu_init(rdp);
+		rdp_write_client_input_pdu_header(s, queue->count);
+
+		for (i = 0; i < queue->count; i++)
+			input_write_queued_event(s, &queue->events[i]);
+
+		rdp_send_client_input_pdu(rdp, s);
+	}
+
+	queue->stats.events += queue->count;
+	queue->stats.pdus++;
+	queue->stats.events_per_pdu[queue->count]++;
+
+	if (queue->count > queue->stats.max_events_per_pdu)
+		queue->stats.max_events_per_pdu = queue->count;
+
+	queue->count = 0;
+}
+
+static boolean input_queue_is_due(rdpInputQueue* queue, uint64 now)
+{
+	return (queue->count > 0) && (now - queue->first >= queue->batch_time);
+}
+
+static void input_queue_event(rdpInput* input, uint16 type, uint32 flags, uint16 x, uint16 y)
+{
+	boolean motion;
+	INPUT_QUEUE_EVENT* last;
+	INPUT_QUEUE_EVENT* event;
+	rdpInputQueue* queue = input->queue;
+
+	motion = (type == INPUT_EVENT_MOUSE) && (flags == PTR_FLAGS_MOVE);
+
+	freerdp_mutex_lock(queue->mutex);
+
+	last = (queue->count > 0) ? &queue->events[queue->count - 1] : NULL;
+
+	if (motion && queue->coalesce && last != NULL &&
+		last->type == INPUT_EVENT_MOUSE && last->flags == PTR_FLAGS_MOVE)
+	{
+		/* only the latest position of consecutive motion events matters */
+		last->x = x;
+		last->y = y;
+		queue->stats.coalesced++;
+	}
+	else
+	{
+		if (queue->count == 0)
+			queue->first = metrics_time();
+
+		event = &queue->events[queue->count++];
+		event->type = type;
+		event->flags = flags;
+		event->x = x;
+		event->y = y;
+	}
+
+	/* buttons, wheel and keys go out right away, they are what the user waits on */
+	if (!motion || queue->count == INPUT_MAX_EVENTS_PER_PDU || input_queue_is_due(queue, metrics_time()))
+		input_send_queue(input);
+
+	freerdp_mutex_unlock(queue->mutex);
+}
+
+static void input_queue_synchronize_event(rdpInput* input, uint32 flags)
+{
+	input_queue_event(input, INPUT_EVENT_SYNC, flags, 0, 0);
+}
+
+static void input_queue_keyboard_event(rdpInput* input, uint16 flags, uint16 code)
+{
+	input_queue_event(input, INPUT_EVENT_SCANCODE, flags, code, 0);
+}
+
+static void input_queue_unicode_keyboard_event(rdpInput* input, uint16 flags, uint16 code)
+{
+	input_queue_event(input, INPUT_EVENT_UNICODE, flags, code, 0);
+}
+
+static void input_queue_mouse_event(rdpInput* input, uint16 flags, uint16 x, uint16 y)
+{
+	input_queue_event(input, INPUT_EVENT_MOUSE, flags, x, y);
+}
+
+static void input_queue_extended_mouse_event(rdpInput* input, uint16 flags, uint16 x, uint16 y)
+{
+	input_queue_event(input, INPUT_EVENT_MOUSEX, flags, x, y);
+}
+
+/**
+ * Sends the queued events if the oldest one has waited long enough.
+ * Called from freerdp_check_fds().
+ */
+
+void input_check_queue(rdpInput* input)
+{
+	rdpInputQueue* queue = input->queue;
+
+	if (queue == NULL)
+		return;
+
+	freerdp_mutex_lock(queue->mutex);
+
+	if (input_queue_is_due(queue, metrics_time()))
+		input_send_queue(input);
+
+	freerdp_mutex_unlock(queue->mutex);
+}
+
 static boolean input_recv_sync_event(rdpInput* input, STREAM* s)
 {
 	uint32 toggleFlags;
@@ -364,7 +559,26 @@ void input_register_client_callbacks(rdpInput* input)
 {
 	rdpRdp* rdp = input->context->rdp;
 
-	if (rdp->settings->fastpath_input)
+	if (rdp->settings->input_batch_ms > 0)
+	{
+		if (input->queue == NULL)
+		{
+			input->queue = xnew(rdpInputQueue);
+			input->queue->mutex = freerdp_mutex_new();
+		}
+
+		/* events queued before a reactivation belong to the previous share */
+		input->queue->count = 0;
+		input->queue->batch_time = rdp->settings->input_batch_ms * 1000;
+		input->queue->coalesce = rdp->settings->input_coalesce;
+
+		input->SynchronizeEvent = input_queue_synchronize_event;
+		input->KeyboardEvent = input_queue_keyboard_event;
+		input->UnicodeKeyboardEvent = input_queue_unicode_keyboard_event;
+		input->MouseEvent = input_queue_mouse_event;
+		input->ExtendedMouseEvent = input_queue_extended_mouse_event;
+	}
+	else if (rdp->settings->fastpath_input)
 	{
 		input->SynchronizeEvent = input_send_fastpath_synchronize_event;
 		input->KeyboardEvent = input_send_fastpath_keyboard_event;
@@ -407,6 +621,64 @@ void freerdp_input_send_extended_mouse_event(rdpInput* input, uint16 flags, uint
 	IFCALL(input->ExtendedMouseEvent, input, flags, x, y);
 }
 
+/**
+ * Sends any held back mouse motion now.
+ */
+
+void freerdp_input_flush(rdpInput* input)
+{
+	rdpInputQueue* queue = input->queue;
+
+	if (queue == NULL)
+		return;
+
+	freerdp_mutex_lock(queue->mutex);
+	input_send_queue(input);
+	freerdp_mutex_unlock(queue->mutex);
+}
+
+/**
+ * Milliseconds until held back mouse motion is due, or -1 if there is none.
+ * Clients waiting in select() should not wait longer than this, or call
+ * freerdp_input_flush() before waiting.
+ */
+
+int freerdp_input_get_flush_timeout(rdpInput* input)
+{
+	int timeout = -1;
+	uint64 elapsed;
+	rdpInputQueue* queue = input->queue;
+
+	if (queue == NULL)
+		return -1;
+
+	freerdp_mutex_lock(queue->mutex);
+
+	if (queue->count > 0)
+	{
+		elapsed = metrics_time() - queue->first;
+		timeout = (elapsed >= queue->batch_time) ? 0 : (int) ((queue->batch_time - elapsed + 999) / 1000);
+	}
+
+	freerdp_mutex_unlock(queue->mutex);
+
+	return timeout;
+}
+
+boolean freerdp_input_get_stats(rdpInput* input, INPUT_STATS* stats)
+{
+	rdpInputQueue* queue = input->queue;
+
+	if (queue == NULL)
+		return false;
+
+	freerdp_mutex_lock(queue->mutex);
+	memcpy(stats, &queue->stats, sizeof(INPUT_STATS));
+	freerdp_mutex_unlock(queue->mutex);
+
+	return true;
+}
+
 rdpInput* input_new(rdpRdp* rdp)
 {
 	rdpInput* input;
@@ -425,6 +697,12 @@ void input_free(rdpInput* input)
 {
 	if (input != NULL)
 	{
+		if (input->queue != NULL)
+		{
+			freerdp_mutex_free(input->queue->mutex);
+			xfree(input->queue);
+		}
+
 		xfree(input);
 	}
 }
@@ -25,6 +25,7 @@
 
 #include <freerdp/input.h>
 #include <freerdp/freerdp.h>
+#include <freerdp/utils/mutex.h>
 #include <freerdp/utils/stream.h>
 #include <freerdp/utils/memory.h>
 
@@ -37,6 +38,30 @@
 
 #define RDP_CLIENT_INPUT_PDU_HEADER_LENGTH	4
 
+struct _INPUT_QUEUE_EVENT
+{
+	uint16 type; /* INPUT_EVENT_* */
+	uint32 flags;
+	uint16 x; /* keyboard events: key or unicode code */
+	uint16 y;
+};
+typedef struct _INPUT_QUEUE_EVENT INPUT_QUEUE_EVENT;
+
+/**
+ * Events waiting to be sent together. Mouse motion is held back for up to
+ * batch_time, any other event is sent right away along with what is queued.
+ */
+struct rdp_input_queue
+{
+	freerdp_mutex mutex;
+	uint64 batch_time; /* microseconds */
+	boolean coalesce;
+	uint64 first; /* when the oldest queued event was queued */
+	int count;
+	INPUT_QUEUE_EVENT events[INPUT_MAX_EVENTS_PER_PDU];
+	INPUT_STATS stats;
+};
+
 void input_send_synchronize_event(rdpInput* input, uint32 flags);
 void input_send_keyboard_event(rdpInput* input, uint16 flags, uint16 code);
 void input_send_unicode_keyboard_event(rdpInput* input, uint16 flags, uint16 code);
@@ -52,6 +77,7 @@ void input_send_fastpath_extended_mouse_event(rdpInput* input, uint16 flags, uin
 boolean input_recv(rdpInput* input, STREAM* s);
 
 void input_register_client_callbacks(rdpInput* input);
+void input_check_queue(rdpInput* input);
 
 rdpInput* input_new(rdpRdp* rdp);
 void input_free(rdpInput* input);
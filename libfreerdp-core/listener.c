@@ -232,41 +232,49 @@ static boolean freerdp_listener_check_fds(freerdp_listener* instance)
 
 	for (i = 0; i < listener->num_sockfds; i++)
 	{
-		peer_addr_size = sizeof(peer_addr);
-		peer_sockfd = accept(listener->sockfds[i], (struct sockaddr*) &peer_addr, &peer_addr_size);
-
-		if (peer_sockfd == -1)
+		/* accept every pending connection, not just one per call */
+		while (1)
 		{
+			peer_addr_size = sizeof(peer_addr);
+			peer_sockfd = accept(listener->sockfds[i], (struct sockaddr*) &peer_addr, &peer_addr_size);
+
+			if (peer_sockfd == -1)
+			{
 #ifdef _WIN32
-			int wsa_error = WSAGetLastError();
+				int wsa_error = WSAGetLastError();
 
-			/* No data available */
-			if (wsa_error == WSAEWOULDBLOCK)
-				continue;
+				/* No data available */
+				if (wsa_error == WSAEWOULDBLOCK)
+					break;
 #else
-			if (errno == EAGAIN || errno == EWOULDBLOCK)
-				continue;
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					break;
+
+				/* the connection went away before it was accepted */
+				if (errno == ECONNABORTED || errno == EINTR)
+					continue;
 #endif
-			perror("accept");
-			return false;
-		}
+				perror("accept");
+				return false;
+			}
 
-		client = freerdp_peer_new(peer_sockfd);
+			client = freerdp_peer_new(peer_sockfd);
 
-		sin_addr = NULL;
-		if (peer_addr.ss_family == AF_INET)
-			sin_addr = &(((struct sockaddr_in*) &peer_addr)->sin_addr);
-		else if (peer_addr.ss_family == AF_INET6)
-			sin_addr = &(((struct sockaddr_in6*) &peer_addr)->sin6_addr);
+			sin_addr = NULL;
+			if (peer_addr.ss_family == AF_INET)
+				sin_addr = &(((struct sockaddr_in*) &peer_addr)->sin_addr);
+			else if (peer_addr.ss_family == AF_INET6)
+				sin_addr = &(((struct sockaddr_in6*) &peer_addr)->sin6_addr);
 #ifndef _WIN32
-		else if (peer_addr.ss_family == AF_UNIX)
-			client->local = true;
+			else if (peer_addr.ss_family == AF_UNIX)
+				client->local = true;
 #endif
 
-		if (sin_addr)
-			inet_ntop(peer_addr.ss_family, sin_addr, client->hostname, sizeof(client->hostname));
+			if (sin_addr)
+				inet_ntop(peer_addr.ss_family, sin_addr, client->hostname, sizeof(client->hostname));
 
-		IFCALL(instance->PeerAccepted, instance, client);
+			IFCALL(instance->PeerAccepted, instance, client);
+		}
 	}
 
 	return true;
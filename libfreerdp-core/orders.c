@@ -138,6 +138,15 @@ static const uint8 BMF_BPP[] =
 		0, 1, 0, 8, 16, 24, 32
 };
 
+static const uint8 BPP_CBR2[] =
+{
+		0, 0, 0, 0, 0, 0, 0, 0,
+		3, 0, 0, 0, 0, 0, 0, 4,
+		4, 0, 0, 0, 0, 0, 0, 0,
+		5, 0, 0, 0, 0, 0, 0, 0,
+		6
+};
+
 static INLINE void update_read_coord(STREAM* s, sint32* coord, boolean delta)
 {
 	sint8 lsi8;
@@ -167,6 +176,13 @@ static INLINE void update_read_color(STREAM* s, uint32* color)
 	*color |= (byte << 16);
 }
 
+static INLINE void update_write_color(STREAM* s, uint32 color)
+{
+	stream_write_uint8(s, color & 0xFF);
+	stream_write_uint8(s, (color >> 8) & 0xFF);
+	stream_write_uint8(s, (color >> 16) & 0xFF);
+}
+
 static INLINE void update_read_colorref(STREAM* s, uint32* color)
 {
 	uint8 byte;
@@ -211,6 +227,19 @@ static INLINE void update_read_2byte_unsigned(STREAM* s, uint32* value)
 	}
 }
 
+static INLINE void update_write_2byte_unsigned(STREAM* s, uint32 value)
+{
+	if (value > 0x7F)
+	{
+		stream_write_uint8(s, ((value >> 8) & 0x7F) | 0x80);
+		stream_write_uint8(s, value & 0xFF);
+	}
+	else
+	{
+		stream_write_uint8(s, value);
+	}
+}
+
 static INLINE void update_read_2byte_signed(STREAM* s, sint32* value)
 {
 	uint8 byte;
@@ -232,6 +261,25 @@ static INLINE void update_read_2byte_signed(STREAM* s, sint32* value)
 		*value *= -1;
 }
 
+static INLINE void update_write_2byte_signed(STREAM* s, sint32 value)
+{
+	uint8 byte;
+	uint32 magnitude;
+
+	byte = (value < 0) ? 0x40 : 0;
+	magnitude = (value < 0) ? -value : value;
+
+	if (magnitude > 0x3F)
+	{
+		stream_write_uint8(s, byte | ((magnitude >> 8) & 0x3F) | 0x80);
+		stream_write_uint8(s, magnitude & 0xFF);
+	}
+	else
+	{
+		stream_write_uint8(s, byte | magnitude);
+	}
+}
+
 static INLINE void update_read_4byte_unsigned(STREAM* s, uint32* value)
 {
 	uint8 byte;
@@ -276,6 +324,32 @@ static INLINE void update_read_4byte_unsigned(STREAM* s, uint32* value)
 	}
 }
 
+static INLINE void update_write_4byte_unsigned(STREAM* s, uint32 value)
+{
+	if (value <= 0x3F)
+	{
+		stream_write_uint8(s, value);
+	}
+	else if (value <= 0x3FFF)
+	{
+		stream_write_uint8(s, (value >> 8) | 0x40);
+		stream_write_uint8(s, value & 0xFF);
+	}
+	else if (value <= 0x3FFFFF)
+	{
+		stream_write_uint8(s, (value >> 16) | 0x80);
+		stream_write_uint8(s, (value >> 8) & 0xFF);
+		stream_write_uint8(s, value & 0xFF);
+	}
+	else
+	{
+		stream_write_uint8(s, ((value >> 24) & 0x3F) | 0xC0);
+		stream_write_uint8(s, (value >> 16) & 0xFF);
+		stream_write_uint8(s, (value >> 8) & 0xFF);
+		stream_write_uint8(s, value & 0xFF);
+	}
+}
+
 static INLINE void update_read_delta(STREAM* s, sint32* value)
 {
 	uint8 byte;
@@ -816,6 +890,24 @@ void update_read_memblt_order(STREAM* s, ORDER_INFO* orderInfo, MEMBLT_ORDER* me
 	memblt->cacheId = (memblt->cacheId & 0xFF);
 }
 
+/**
+ * Write all the fields of a MemBlt order, with absolute coordinates.
+ * The field flags to send along are MEMBLT_ORDER_ALL_FIELDS.
+ */
+
+void update_write_memblt_order(STREAM* s, MEMBLT_ORDER* memblt)
+{
+	stream_write_uint16(s, (memblt->cacheId & 0xFF) | ((memblt->colorIndex & 0xFF) << 8));
+	stream_write_uint16(s, memblt->nLeftRect);
+	stream_write_uint16(s, memblt->nTopRect);
+	stream_write_uint16(s, memblt->nWidth);
+	stream_write_uint16(s, memblt->nHeight);
+	stream_write_uint8(s, memblt->bRop);
+	stream_write_uint16(s, memblt->nXSrc);
+	stream_write_uint16(s, memblt->nYSrc);
+	stream_write_uint16(s, memblt->cacheIndex);
+}
+
 void update_read_mem3blt_order(STREAM* s, ORDER_INFO* orderInfo, MEM3BLT_ORDER* mem3blt)
 {
 	if (orderInfo->fieldFlags & ORDER_FIELD_01)
@@ -938,6 +1030,34 @@ void update_read_glyph_index_order(STREAM* s, ORDER_INFO* orderInfo, GLYPH_INDEX
 	}
 }
 
+/**
+ * Write the fields of a GlyphIndex order but the brush, which text
+ * drawing does not use. The field flags to send along are
+ * GLYPH_INDEX_ORDER_TEXT_FIELDS.
+ */
+
+void update_write_glyph_index_order(STREAM* s, GLYPH_INDEX_ORDER* glyph_index)
+{
+	stream_write_uint8(s, glyph_index->cacheId);
+	stream_write_uint8(s, glyph_index->flAccel);
+	stream_write_uint8(s, glyph_index->ulCharInc);
+	stream_write_uint8(s, glyph_index->fOpRedundant);
+	update_write_color(s, glyph_index->backColor);
+	update_write_color(s, glyph_index->foreColor);
+	stream_write_uint16(s, glyph_index->bkLeft);
+	stream_write_uint16(s, glyph_index->bkTop);
+	stream_write_uint16(s, glyph_index->bkRight);
+	stream_write_uint16(s, glyph_index->bkBottom);
+	stream_write_uint16(s, glyph_index->opLeft);
+	stream_write_uint16(s, glyph_index->opTop);
+	stream_write_uint16(s, glyph_index->opRight);
+	stream_write_uint16(s, glyph_index->opBottom);
+	stream_write_uint16(s, glyph_index->x);
+	stream_write_uint16(s, glyph_index->y);
+	stream_write_uint8(s, glyph_index->cbData);
+	stream_write(s, glyph_index->data, glyph_index->cbData);
+}
+
 void update_read_fast_index_order(STREAM* s, ORDER_INFO* orderInfo, FAST_INDEX_ORDER* fast_index)
 {
 	if (orderInfo->fieldFlags & ORDER_FIELD_01)
@@ -1281,6 +1401,51 @@ void update_read_cache_bitmap_v2_order(STREAM* s, CACHE_BITMAP_V2_ORDER* cache_b
 	cache_bitmap_v2_order->compressed = compressed;
 }
 
+void update_write_cache_bitmap_v2_order(STREAM* s, CACHE_BITMAP_V2_ORDER* cache_bitmap_v2_order, boolean compressed, uint16* flags)
+{
+	uint8 bitsPerPixelId;
+	uint32 bitmapLength;
+
+	bitsPerPixelId = (cache_bitmap_v2_order->bitmapBpp < sizeof(BPP_CBR2)) ? BPP_CBR2[cache_bitmap_v2_order->bitmapBpp] : 0;
+
+	*flags = (cache_bitmap_v2_order->cacheId & 0x0003) | (bitsPerPixelId << 3) |
+			((cache_bitmap_v2_order->flags << 7) & 0xFF80);
+
+	if (cache_bitmap_v2_order->flags & CBR2_PERSISTENT_KEY_PRESENT)
+	{
+		stream_write_uint32(s, cache_bitmap_v2_order->key1); /* key1 (4 bytes) */
+		stream_write_uint32(s, cache_bitmap_v2_order->key2); /* key2 (4 bytes) */
+	}
+
+	if (cache_bitmap_v2_order->flags & CBR2_HEIGHT_SAME_AS_WIDTH)
+	{
+		update_write_2byte_unsigned(s, cache_bitmap_v2_order->bitmapWidth); /* bitmapWidth */
+	}
+	else
+	{
+		update_write_2byte_unsigned(s, cache_bitmap_v2_order->bitmapWidth); /* bitmapWidth */
+		update_write_2byte_unsigned(s, cache_bitmap_v2_order->bitmapHeight); /* bitmapHeight */
+	}
+
+	bitmapLength = cache_bitmap_v2_order->bitmapLength;
+
+	if (compressed && !(cache_bitmap_v2_order->flags & CBR2_NO_BITMAP_COMPRESSION_HDR))
+		bitmapLength += 8;
+
+	update_write_4byte_unsigned(s, bitmapLength); /* bitmapLength */
+	update_write_2byte_unsigned(s, cache_bitmap_v2_order->cacheIndex); /* cacheIndex */
+
+	if (compressed && !(cache_bitmap_v2_order->flags & CBR2_NO_BITMAP_COMPRESSION_HDR))
+	{
+		stream_write_uint16(s, cache_bitmap_v2_order->cbCompFirstRowSize); /* cbCompFirstRowSize (2 bytes) */
+		stream_write_uint16(s, cache_bitmap_v2_order->cbCompMainBodySize); /* cbCompMainBodySize (2 bytes) */
+		stream_write_uint16(s, cache_bitmap_v2_order->cbScanWidth); /* cbScanWidth (2 bytes) */
+		stream_write_uint16(s, cache_bitmap_v2_order->cbUncompressedSize); /* cbUncompressedSize (2 bytes) */
+	}
+
+	stream_write(s, cache_bitmap_v2_order->bitmapDataStream, cache_bitmap_v2_order->bitmapLength); /* bitmapDataStream */
+}
+
 void update_read_cache_bitmap_v3_order(STREAM* s, CACHE_BITMAP_V3_ORDER* cache_bitmap_v3_order, boolean compressed, uint16 flags)
 {
 	uint8 bitsPerPixelId;
@@ -1374,6 +1539,29 @@ void update_read_cache_glyph_order(STREAM* s, CACHE_GLYPH_ORDER* cache_glyph_ord
 		stream_seek(s, cache_glyph_order->cGlyphs * 2);
 }
 
+void update_write_cache_glyph_order(STREAM* s, CACHE_GLYPH_ORDER* cache_glyph_order, uint16* flags)
+{
+	int i;
+	GLYPH_DATA* glyph;
+
+	*flags = 0;
+
+	stream_write_uint8(s, cache_glyph_order->cacheId); /* cacheId (1 byte) */
+	stream_write_uint8(s, cache_glyph_order->cGlyphs); /* cGlyphs (1 byte) */
+
+	for (i = 0; i < (int) cache_glyph_order->cGlyphs; i++)
+	{
+		glyph = cache_glyph_order->glyphData[i];
+
+		stream_write_uint16(s, glyph->cacheIndex);
+		stream_write_uint16(s, glyph->x);
+		stream_write_uint16(s, glyph->y);
+		stream_write_uint16(s, glyph->cx);
+		stream_write_uint16(s, glyph->cy);
+		stream_write(s, glyph->aj, glyph->cb);
+	}
+}
+
 void update_read_cache_glyph_v2_order(STREAM* s, CACHE_GLYPH_V2_ORDER* cache_glyph_v2_order, uint16 flags)
 {
 	int i;
@@ -1409,6 +1597,28 @@ void update_read_cache_glyph_v2_order(STREAM* s, CACHE_GLYPH_V2_ORDER* cache_gly
 		stream_seek(s, cache_glyph_v2_order->cGlyphs * 2);
 }
 
+void update_write_cache_glyph_v2_order(STREAM* s, CACHE_GLYPH_V2_ORDER* cache_glyph_v2_order, uint16* flags)
+{
+	int i;
+	GLYPH_DATA_V2* glyph;
+
+	*flags = (cache_glyph_v2_order->cacheId & 0x000F) |
+			((cache_glyph_v2_order->flags & 0x000F) << 4) |
+			((cache_glyph_v2_order->cGlyphs & 0x00FF) << 8);
+
+	for (i = 0; i < (int) cache_glyph_v2_order->cGlyphs; i++)
+	{
+		glyph = cache_glyph_v2_order->glyphData[i];
+
+		stream_write_uint8(s, glyph->cacheIndex);
+		update_write_2byte_signed(s, glyph->x);
+		update_write_2byte_signed(s, glyph->y);
+		update_write_2byte_unsigned(s, glyph->cx);
+		update_write_2byte_unsigned(s, glyph->cy);
+		stream_write(s, glyph->aj, glyph->cb);
+	}
+}
+
 void update_decompress_brush(STREAM* s, uint8* output, uint8 bpp)
 {
 	int index;
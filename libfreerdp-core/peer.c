@@ -72,6 +72,8 @@ static boolean peer_recv_data_pdu(freerdp_peer* client, STREAM* s)
 	if (!rdp_read_share_data_header(s, &length, &type, &share_id, &compressed_type, &compressed_len))
 		return false;
 
+	metrics_pdu_in(client->context->metrics, METRICS_PDU_DATA(type), length);
+
 	switch (type)
 	{
 		case DATA_PDU_TYPE_SYNCHRONIZE:
@@ -180,6 +182,7 @@ static boolean peer_recv_tpkt_pdu(freerdp_peer* client, STREAM* s)
 
 	if (channelId != MCS_GLOBAL_CHANNEL_ID)
 	{
+		metrics_pdu_in(rdp->metrics, METRICS_PDU_CHANNEL, stream_get_left(s));
 		freerdp_channel_peer_process(client, s, channelId);
 	}
 	else
@@ -346,6 +349,7 @@ void freerdp_peer_context_new(freerdp_peer* client)
 	client->context = (rdpContext*) xzalloc(client->context_size);
 	client->context->rdp = rdp;
 	client->context->peer = client;
+	client->context->metrics = rdp->metrics;
 
 	client->update->context = client->context;
 	client->input->context = client->context;
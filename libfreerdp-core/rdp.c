@@ -397,6 +397,9 @@ boolean rdp_send(rdpRdp* rdp, STREAM* s, uint16 channel_id)
 	s->p = sec_hold;
 	length += rdp_security_stream_out(rdp, s, length);
 
+	metrics_pdu_out(rdp->metrics, (channel_id != MCS_GLOBAL_CHANNEL_ID) ?
+		METRICS_PDU_CHANNEL : METRICS_PDU_OTHER, length);
+
 	stream_set_pos(s, length);
 	if (transport_write(rdp->transport, s) < 0)
 		return false;
@@ -424,6 +427,8 @@ boolean rdp_send_pdu(rdpRdp* rdp, STREAM* s, uint16 type, uint16 channel_id)
 	s->p = sec_hold;
 	length += rdp_security_stream_out(rdp, s, length);
 
+	metrics_pdu_out(rdp->metrics, METRICS_PDU_OTHER, length);
+
 	stream_set_pos(s, length);
 	if (transport_write(rdp->transport, s) < 0)
 		return false;
@@ -452,6 +457,8 @@ boolean rdp_send_data_pdu(rdpRdp* rdp, STREAM* s, uint8 type, uint16 channel_id)
 	s->p = sec_hold;
 	length += rdp_security_stream_out(rdp, s, length);
 
+	metrics_pdu_out(rdp->metrics, METRICS_PDU_DATA(type), length);
+
 	stream_set_pos(s, length);
 	if (transport_write(rdp->transport, s) < 0)
 		return false;
@@ -482,6 +489,8 @@ boolean rdp_recv_data_pdu(rdpRdp* rdp, STREAM* s)
 
 	rdp_read_share_data_header(s, &length, &type, &share_id, &compressed_type, &compressed_len);
 
+	metrics_pdu_in(rdp->metrics, METRICS_PDU_DATA(type), length);
+
 	comp_stream = s;
 
 	if (compressed_type & PACKET_COMPRESSED)
@@ -501,6 +510,9 @@ boolean rdp_recv_data_pdu(rdpRdp* rdp, STREAM* s)
 		stream_seek(s, compressed_len - 18);
 	}
 
+	if (rdp->record != NULL)
+		record_write(rdp->record, RECORD_TYPE_DATA_PDU, type, stream_get_tail(comp_stream), stream_get_left(comp_stream));
+
 #ifdef WITH_DEBUG_RDP
 	/* if (type != DATA_PDU_TYPE_UPDATE) */
 		DEBUG_RDP("recv %s Data PDU (0x%02X), length:%d",
@@ -738,6 +750,11 @@ static boolean rdp_recv_tpkt_pdu(rdpRdp* rdp, STREAM* s)
 
 	if (channelId != MCS_GLOBAL_CHANNEL_ID)
 	{
+		if (rdp->record != NULL)
+			record_write(rdp->record, RECORD_TYPE_CHANNEL, channelId, stream_get_tail(s), stream_get_left(s));
+
+		metrics_pdu_in(rdp->metrics, METRICS_PDU_CHANNEL, stream_get_left(s));
+
 		freerdp_channel_process(rdp->instance, s, channelId);
 	}
 	else
@@ -761,11 +778,13 @@ static boolean rdp_recv_tpkt_pdu(rdpRdp* rdp, STREAM* s)
 					break;
 
 				case PDU_TYPE_DEACTIVATE_ALL:
+					metrics_pdu_in(rdp->metrics, METRICS_PDU_OTHER, pduLength);
 					if (!rdp_recv_deactivate_all(rdp, s))
 						return false;
 					break;
 
 				case PDU_TYPE_SERVER_REDIRECTION:
+					metrics_pdu_in(rdp->metrics, METRICS_PDU_OTHER, pduLength);
 					rdp_recv_enhanced_security_redirection_packet(rdp, s);
 					break;
 
@@ -863,7 +882,10 @@ static boolean rdp_recv_callback(rdpTransport* transport, STREAM* s, void* extra
 			if (!rdp_recv_pdu(rdp, s))
 				return false;
 			if (rdp->finalize_sc_pdus == FINALIZE_SC_COMPLETE)
+			{
+				metrics_phase_end(rdp->metrics, METRICS_CONNECT_CAPABILITIES);
 				rdp->state = CONNECTION_STATE_ACTIVE;
+			}
 			break;
 
 		case CONNECTION_STATE_ACTIVE:
@@ -920,7 +942,9 @@ rdpRdp* rdp_new(freerdp* instance)
 		if (instance != NULL)
 			instance->settings = rdp->settings;
 		rdp->extension = extension_new(instance);
+		rdp->metrics = metrics_new();
 		rdp->transport = transport_new(rdp->settings);
+		rdp->transport->metrics = rdp->metrics;
 		rdp->license = license_new(rdp);
 		rdp->input = input_new(rdp);
 		rdp->update = update_new(rdp);
@@ -961,6 +985,8 @@ void rdp_free(rdpRdp* rdp)
 		redirection_free(rdp->redirection);
 		mppc_dec_free(rdp->mppc_dec);
 		mppc_enc_free(rdp->mppc_enc);
+		record_close(rdp->record);
+		metrics_free(rdp->metrics);
 		xfree(rdp);
 	}
 }
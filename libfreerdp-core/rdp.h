@@ -43,6 +43,8 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/settings.h>
 #include <freerdp/utils/debug.h>
+#include <freerdp/utils/record.h>
+#include <freerdp/utils/metrics.h>
 #include <freerdp/utils/stream.h>
 #include <freerdp/codec/mppc_dec.h>
 #include <freerdp/codec/mppc_enc.h>
@@ -154,6 +156,8 @@ struct rdp_rdp
 	uint32 errorInfo;
 	uint32 finalize_sc_pdus;
 	boolean disconnect;
+	rdpRecord* record;
+	rdpMetrics* metrics;
 };
 
 void rdp_read_security_header(STREAM* s, uint16* flags);
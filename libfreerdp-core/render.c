@@ -0,0 +1,1128 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Asynchronous Update Rendering
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * When enabled, the update callbacks registered by the client are replaced
+ * by proxies that record each update into a command buffer. EndPaint hands
+ * the buffer to a render thread which replays it through the original
+ * callbacks, so that slow drawing no longer holds up the transport. Updates
+ * that are not worth recording (desktop resize, RAIL windows) act as
+ * barriers: they wait for the render thread to go idle and are then called
+ * directly.
+ */
+
+#ifdef _WIN32
+#include <winpr/windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <freerdp/utils/memory.h>
+
+#include "render.h"
+
+static uint64 render_get_time(void)
+{
+#ifdef _WIN32
+	return (uint64) GetTickCount() * 1000;
+#else
+	struct timeval tp;
+
+	gettimeofday(&tp, 0);
+	return ((uint64) tp.tv_sec * 1000000) + tp.tv_usec;
+#endif
+}
+
+/* Command Buffer */
+
+static RENDER_CHUNK* render_chunk_new(size_t size)
+{
+	RENDER_CHUNK* chunk;
+
+	chunk = (RENDER_CHUNK*) xmalloc(sizeof(RENDER_CHUNK) + size);
+	chunk->next = NULL;
+	chunk->data = (uint8*) &chunk[1];
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+static void* render_alloc(RENDER_FRAME* frame, size_t size)
+{
+	void* ptr;
+	RENDER_CHUNK* chunk;
+
+	size = (size + 7) & ~((size_t) 7);
+	chunk = frame->chunks;
+
+	if (chunk == NULL || chunk->size - chunk->used < size)
+	{
+		chunk = render_chunk_new((size > RENDER_CHUNK_SIZE) ? size : RENDER_CHUNK_SIZE);
+		chunk->next = frame->chunks;
+		frame->chunks = chunk;
+	}
+
+	ptr = &chunk->data[chunk->used];
+	chunk->used += size;
+
+	return ptr;
+}
+
+static void* render_copy(RENDER_FRAME* frame, void* data, size_t size)
+{
+	void* copy;
+
+	if (data == NULL || size == 0)
+		return NULL;
+
+	copy = render_alloc(frame, size);
+	memcpy(copy, data, size);
+
+	return copy;
+}
+
+/* release whatever the callbacks did not take over */
+static void render_command_release(RENDER_COMMAND* cmd, boolean replayed)
+{
+	int i;
+
+	switch (cmd->type)
+	{
+		case RENDER_CMD_FAST_GLYPH:
+			{
+				FAST_GLYPH_ORDER* fast_glyph = (FAST_GLYPH_ORDER*) cmd->data;
+				GLYPH_DATA_V2* glyph = (GLYPH_DATA_V2*) fast_glyph->glyph_data;
+
+				if (glyph != NULL)
+				{
+					xfree(glyph->aj);
+					xfree(glyph);
+					fast_glyph->glyph_data = NULL;
+				}
+			}
+			break;
+
+		case RENDER_CMD_CACHE_GLYPH:
+			{
+				CACHE_GLYPH_ORDER* cache_glyph = (CACHE_GLYPH_ORDER*) cmd->data;
+
+				for (i = 0; i < (int) cache_glyph->cGlyphs; i++)
+				{
+					if (cache_glyph->glyphData[i] != NULL)
+					{
+						xfree(cache_glyph->glyphData[i]->aj);
+						xfree(cache_glyph->glyphData[i]);
+						cache_glyph->glyphData[i] = NULL;
+					}
+				}
+			}
+			break;
+
+		case RENDER_CMD_CACHE_GLYPH_V2:
+			{
+				CACHE_GLYPH_V2_ORDER* cache_glyph_v2 = (CACHE_GLYPH_V2_ORDER*) cmd->data;
+
+				for (i = 0; i < (int) cache_glyph_v2->cGlyphs; i++)
+				{
+					if (cache_glyph_v2->glyphData[i] != NULL)
+					{
+						xfree(cache_glyph_v2->glyphData[i]->aj);
+						xfree(cache_glyph_v2->glyphData[i]);
+						cache_glyph_v2->glyphData[i] = NULL;
+					}
+				}
+			}
+			break;
+
+		case RENDER_CMD_CACHE_COLOR_TABLE:
+			if (!replayed)
+				xfree(((CACHE_COLOR_TABLE_ORDER*) cmd->data)->colorTable);
+			break;
+
+		case RENDER_CMD_CACHE_BRUSH:
+			if (!replayed)
+				xfree(((CACHE_BRUSH_ORDER*) cmd->data)->data);
+			break;
+
+		case RENDER_CMD_POINTER_COLOR:
+			if (!replayed)
+			{
+				xfree(((POINTER_COLOR_UPDATE*) cmd->data)->xorMaskData);
+				xfree(((POINTER_COLOR_UPDATE*) cmd->data)->andMaskData);
+			}
+			break;
+
+		case RENDER_CMD_POINTER_NEW:
+			if (!replayed)
+			{
+				xfree(((POINTER_NEW_UPDATE*) cmd->data)->colorPtrAttr.xorMaskData);
+				xfree(((POINTER_NEW_UPDATE*) cmd->data)->colorPtrAttr.andMaskData);
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void render_frame_reset(RENDER_FRAME* frame)
+{
+	RENDER_CHUNK* next;
+	RENDER_CHUNK* chunk;
+	RENDER_CHUNK* keep = NULL;
+
+	/* keep one regular chunk around, oversized payloads get their own */
+	for (chunk = frame->chunks; chunk != NULL; chunk = next)
+	{
+		next = chunk->next;
+
+		if (keep == NULL && chunk->size == RENDER_CHUNK_SIZE)
+		{
+			keep = chunk;
+			keep->next = NULL;
+			keep->used = 0;
+		}
+		else
+		{
+			xfree(chunk);
+		}
+	}
+
+	frame->paint = false;
+	frame->count = 0;
+	frame->decode_time = 0;
+	frame->chunks = keep;
+	frame->head = NULL;
+	frame->tail = NULL;
+}
+
+static void render_frame_free(RENDER_FRAME* frame)
+{
+	RENDER_COMMAND* cmd;
+
+	if (frame == NULL)
+		return;
+
+	for (cmd = frame->head; cmd != NULL; cmd = cmd->next)
+		render_command_release(cmd, false);
+
+	render_frame_reset(frame);
+	xfree(frame->chunks);
+	xfree(frame);
+}
+
+/* Decoding Side */
+
+static RENDER_FRAME* render_get_frame(rdpRender* render)
+{
+	if (render->frame == NULL)
+	{
+		freerdp_thread_lock(render->thread);
+		render->frame = (RENDER_FRAME*) list_dequeue(render->free_frames);
+		freerdp_thread_unlock(render->thread);
+
+		if (render->frame == NULL)
+			render->frame = xnew(RENDER_FRAME);
+
+		render->frame->paint = render->in_paint;
+		render->decode_start = render_get_time();
+	}
+
+	return render->frame;
+}
+
+static void* render_record(rdpRender* render, uint32 type, pRenderReplay replay, void* data, size_t size)
+{
+	RENDER_FRAME* frame;
+	RENDER_COMMAND* cmd;
+
+	frame = render_get_frame(render);
+
+	cmd = (RENDER_COMMAND*) render_alloc(frame, sizeof(RENDER_COMMAND));
+	cmd->next = NULL;
+	cmd->type = type;
+	cmd->replay = replay;
+	cmd->data = render_copy(frame, data, size);
+
+	if (frame->tail != NULL)
+		frame->tail->next = cmd;
+	else
+		frame->head = cmd;
+
+	frame->tail = cmd;
+	frame->count++;
+
+	return cmd->data;
+}
+
+/* blocks while the render thread is RENDER_MAX_QUEUED_FRAMES behind */
+static void render_submit(rdpRender* render)
+{
+	RENDER_FRAME* frame;
+	RENDER_STATS* stats = &render->stats;
+
+	frame = render->frame;
+
+	if (frame == NULL)
+		return;
+
+	render->frame = NULL;
+	frame->decode_time = (uint32) (render_get_time() - render->decode_start);
+
+	freerdp_thread_lock(render->thread);
+
+	if (frame->count == 0)
+	{
+		render_frame_reset(frame);
+		list_enqueue(render->free_frames, frame);
+		freerdp_thread_unlock(render->thread);
+		return;
+	}
+
+	while (list_size(render->frames) >= RENDER_MAX_QUEUED_FRAMES)
+	{
+		wait_obj_clear(render->drained);
+		freerdp_thread_unlock(render->thread);
+		wait_obj_select(&render->drained, 1, -1);
+		freerdp_thread_lock(render->thread);
+	}
+
+	list_enqueue(render->frames, frame);
+
+	stats->frames_decoded++;
+	stats->decode_time = frame->decode_time;
+	stats->total_decode_time += frame->decode_time;
+	stats->queue_depth = list_size(render->frames);
+
+	if (stats->queue_depth > stats->max_queue_depth)
+		stats->max_queue_depth = stats->queue_depth;
+
+	metrics_gauge(render->context->metrics, METRICS_RENDER_QUEUE, stats->queue_depth);
+
+	freerdp_thread_unlock(render->thread);
+
+	freerdp_thread_signal(render->thread);
+}
+
+/* updates recorded outside of BeginPaint/EndPaint are sent on their own */
+static void render_command_done(rdpRender* render)
+{
+	if (!render->in_paint)
+		render_submit(render);
+}
+
+static void render_barrier(rdpRender* render)
+{
+	render_submit(render);
+
+	freerdp_thread_lock(render->thread);
+
+	while (list_size(render->frames) > 0 || render->busy)
+	{
+		wait_obj_clear(render->drained);
+		freerdp_thread_unlock(render->thread);
+		wait_obj_select(&render->drained, 1, -1);
+		freerdp_thread_lock(render->thread);
+	}
+
+	render->stats.barriers++;
+
+	freerdp_thread_unlock(render->thread);
+}
+
+/* Rendering Side */
+
+static void render_replay(rdpRender* render, RENDER_FRAME* frame)
+{
+	RENDER_COMMAND* cmd;
+	rdpContext* context = render->context;
+
+	if (frame->paint)
+		IFCALL(render->callbacks.BeginPaint, context);
+
+	for (cmd = frame->head; cmd != NULL; cmd = cmd->next)
+	{
+		cmd->replay(render, cmd->data);
+		render_command_release(cmd, true);
+	}
+
+	if (frame->paint)
+		IFCALL(render->callbacks.EndPaint, context);
+}
+
+static void render_process_frames(rdpRender* render)
+{
+	uint64 start;
+	uint32 elapsed;
+	RENDER_FRAME* frame;
+	RENDER_STATS* stats = &render->stats;
+
+	while (1)
+	{
+		freerdp_thread_lock(render->thread);
+		frame = (RENDER_FRAME*) list_dequeue(render->frames);
+		render->busy = (frame != NULL) ? true : false;
+		freerdp_thread_unlock(render->thread);
+
+		if (frame == NULL)
+			break;
+
+		start = render_get_time();
+		render_replay(render, frame);
+		elapsed = (uint32) (render_get_time() - start);
+
+		render_frame_reset(frame);
+
+		freerdp_thread_lock(render->thread);
+
+		list_enqueue(render->free_frames, frame);
+		render->busy = false;
+
+		stats->frames_rendered++;
+		stats->render_time = elapsed;
+		stats->total_render_time += elapsed;
+		stats->queue_depth = list_size(render->frames);
+
+		metrics_gauge(render->context->metrics, METRICS_RENDER_QUEUE, stats->queue_depth);
+
+		wait_obj_set(render->drained);
+
+		freerdp_thread_unlock(render->thread);
+
+		if (freerdp_thread_is_stopped(render->thread))
+			break;
+	}
+}
+
+static void* render_thread_func(void* arg)
+{
+	rdpRender* render = (rdpRender*) arg;
+
+	while (1)
+	{
+		freerdp_thread_wait(render->thread);
+
+		if (freerdp_thread_is_stopped(render->thread))
+			break;
+
+		freerdp_thread_reset(render->thread);
+
+		render_process_frames(render);
+	}
+
+	freerdp_thread_quit(render->thread);
+
+	return NULL;
+}
+
+/* Update Proxies */
+
+/**
+ * Recorded updates are replayed through a trampoline that hands the payload
+ * to the client callback with the callback's own argument type.
+ */
+#define RENDER_REPLAY(_name, _type, _callbacks, _field) \
+	static void render_call_##_name(rdpRender* render, void* data) \
+	{ \
+		IFCALL(render->_callbacks._field, render->context, (_type*) data); \
+	}
+
+#define RENDER_PROXY(_name, _type, _callbacks, _field) \
+	RENDER_REPLAY(_name, _type, _callbacks, _field) \
+	static void render_##_name(rdpContext* context, _type* order) \
+	{ \
+		rdpRender* render = context->rdp->update->render; \
+		render_record(render, RENDER_CMD_GENERIC, render_call_##_name, order, sizeof(_type)); \
+		render_command_done(render); \
+	}
+
+#define RENDER_PROXY_BRUSH(_name, _type, _callbacks, _field) \
+	RENDER_REPLAY(_name, _type, _callbacks, _field) \
+	static void render_##_name(rdpContext* context, _type* order) \
+	{ \
+		_type* copy; \
+		rdpRender* render = context->rdp->update->render; \
+		copy = (_type*) render_record(render, RENDER_CMD_GENERIC, render_call_##_name, order, sizeof(_type)); \
+		render_fix_brush(&copy->brush, &order->brush); \
+		render_command_done(render); \
+	}
+
+/* the brush may point into its own pattern, which has moved with the copy */
+static void render_fix_brush(rdpBrush* copy, rdpBrush* brush)
+{
+	if (brush->data == (uint8*) brush->p8x8)
+		copy->data = (uint8*) copy->p8x8;
+}
+
+static void render_begin_paint(rdpContext* context)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render->in_paint = true;
+	render_get_frame(render)->paint = true;
+}
+
+static void render_end_paint(rdpContext* context)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_submit(render);
+	render->in_paint = false;
+}
+
+RENDER_REPLAY(set_bounds, rdpBounds, callbacks, SetBounds)
+
+static void render_set_bounds(rdpContext* context, rdpBounds* bounds)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_record(render, RENDER_CMD_GENERIC, render_call_set_bounds, bounds, sizeof(rdpBounds));
+	render_command_done(render);
+}
+
+/* Synchronize takes no payload */
+static void render_call_synchronize(rdpRender* render, void* data)
+{
+	IFCALL(render->callbacks.Synchronize, render->context);
+}
+
+static void render_synchronize(rdpContext* context)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_record(render, RENDER_CMD_GENERIC, render_call_synchronize, NULL, 0);
+	render_command_done(render);
+}
+
+static void render_desktop_resize(rdpContext* context)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_barrier(render);
+	IFCALL(render->callbacks.DesktopResize, context);
+}
+
+RENDER_REPLAY(bitmap_update, BITMAP_UPDATE, callbacks, BitmapUpdate)
+
+static void render_bitmap_update(rdpContext* context, BITMAP_UPDATE* bitmap)
+{
+	int i;
+	BITMAP_UPDATE* copy;
+	RENDER_FRAME* frame;
+	rdpRender* render = context->rdp->update->render;
+
+	copy = (BITMAP_UPDATE*) render_record(render, RENDER_CMD_GENERIC,
+			render_call_bitmap_update, bitmap, sizeof(BITMAP_UPDATE));
+
+	frame = render->frame;
+	copy->count = bitmap->number;
+	copy->rectangles = (BITMAP_DATA*) render_copy(frame, bitmap->rectangles, sizeof(BITMAP_DATA) * bitmap->number);
+
+	for (i = 0; i < (int) bitmap->number; i++)
+	{
+		copy->rectangles[i].bitmapDataStream = (uint8*) render_copy(frame,
+				bitmap->rectangles[i].bitmapDataStream, bitmap->rectangles[i].bitmapLength);
+	}
+
+	render_command_done(render);
+}
+
+RENDER_PROXY(palette, PALETTE_UPDATE, callbacks, Palette)
+RENDER_PROXY(play_sound, PLAY_SOUND_UPDATE, callbacks, PlaySound)
+RENDER_PROXY(surface_frame_marker, SURFACE_FRAME_MARKER, callbacks, SurfaceFrameMarker)
+
+RENDER_REPLAY(surface_bits, SURFACE_BITS_COMMAND, callbacks, SurfaceBits)
+
+static void render_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_command)
+{
+	SURFACE_BITS_COMMAND* copy;
+	rdpRender* render = context->rdp->update->render;
+
+	copy = (SURFACE_BITS_COMMAND*) render_record(render, RENDER_CMD_GENERIC,
+			render_call_surface_bits, surface_bits_command, sizeof(SURFACE_BITS_COMMAND));
+
+	copy->bitmapData = (uint8*) render_copy(render->frame,
+			surface_bits_command->bitmapData, surface_bits_command->bitmapDataLength);
+
+	render_command_done(render);
+}
+
+/* Pointer Updates */
+
+RENDER_PROXY(pointer_position, POINTER_POSITION_UPDATE, pointer, PointerPosition)
+RENDER_PROXY(pointer_system, POINTER_SYSTEM_UPDATE, pointer, PointerSystem)
+RENDER_PROXY(pointer_cached, POINTER_CACHED_UPDATE, pointer, PointerCached)
+
+RENDER_REPLAY(pointer_color, POINTER_COLOR_UPDATE, pointer, PointerColor)
+
+static void render_pointer_color(rdpContext* context, POINTER_COLOR_UPDATE* pointer_color)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_record(render, RENDER_CMD_POINTER_COLOR, render_call_pointer_color,
+			pointer_color, sizeof(POINTER_COLOR_UPDATE));
+
+	/* the masks now belong to the recorded update */
+	pointer_color->xorMaskData = NULL;
+	pointer_color->andMaskData = NULL;
+
+	render_command_done(render);
+}
+
+RENDER_REPLAY(pointer_new, POINTER_NEW_UPDATE, pointer, PointerNew)
+
+static void render_pointer_new(rdpContext* context, POINTER_NEW_UPDATE* pointer_new)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_record(render, RENDER_CMD_POINTER_NEW, render_call_pointer_new,
+			pointer_new, sizeof(POINTER_NEW_UPDATE));
+
+	pointer_new->colorPtrAttr.xorMaskData = NULL;
+	pointer_new->colorPtrAttr.andMaskData = NULL;
+
+	render_command_done(render);
+}
+
+/* Primary Drawing Orders */
+
+RENDER_PROXY(dstblt, DSTBLT_ORDER, primary, DstBlt)
+RENDER_PROXY_BRUSH(patblt, PATBLT_ORDER, primary, PatBlt)
+RENDER_PROXY(scrblt, SCRBLT_ORDER, primary, ScrBlt)
+RENDER_PROXY(opaque_rect, OPAQUE_RECT_ORDER, primary, OpaqueRect)
+RENDER_PROXY(draw_nine_grid, DRAW_NINE_GRID_ORDER, primary, DrawNineGrid)
+RENDER_PROXY(multi_dstblt, MULTI_DSTBLT_ORDER, primary, MultiDstBlt)
+RENDER_PROXY_BRUSH(multi_patblt, MULTI_PATBLT_ORDER, primary, MultiPatBlt)
+RENDER_PROXY(multi_scrblt, MULTI_SCRBLT_ORDER, primary, MultiScrBlt)
+RENDER_PROXY(multi_opaque_rect, MULTI_OPAQUE_RECT_ORDER, primary, MultiOpaqueRect)
+RENDER_PROXY(multi_draw_nine_grid, MULTI_DRAW_NINE_GRID_ORDER, primary, MultiDrawNineGrid)
+RENDER_PROXY(line_to, LINE_TO_ORDER, primary, LineTo)
+RENDER_PROXY(memblt, MEMBLT_ORDER, primary, MemBlt)
+RENDER_PROXY_BRUSH(mem3blt, MEM3BLT_ORDER, primary, Mem3Blt)
+RENDER_PROXY(save_bitmap, SAVE_BITMAP_ORDER, primary, SaveBitmap)
+RENDER_PROXY_BRUSH(glyph_index, GLYPH_INDEX_ORDER, primary, GlyphIndex)
+RENDER_PROXY(fast_index, FAST_INDEX_ORDER, primary, FastIndex)
+RENDER_PROXY(ellipse_sc, ELLIPSE_SC_ORDER, primary, EllipseSC)
+RENDER_PROXY_BRUSH(ellipse_cb, ELLIPSE_CB_ORDER, primary, EllipseCB)
+
+RENDER_REPLAY(polyline, POLYLINE_ORDER, primary, Polyline)
+
+static void render_polyline(rdpContext* context, POLYLINE_ORDER* polyline)
+{
+	POLYLINE_ORDER* copy;
+	rdpRender* render = context->rdp->update->render;
+
+	copy = (POLYLINE_ORDER*) render_record(render, RENDER_CMD_GENERIC,
+			render_call_polyline, polyline, sizeof(POLYLINE_ORDER));
+
+	copy->points = (DELTA_POINT*) render_copy(render->frame,
+			polyline->points, sizeof(DELTA_POINT) * polyline->numPoints);
+
+	render_command_done(render);
+}
+
+RENDER_REPLAY(polygon_sc, POLYGON_SC_ORDER, primary, PolygonSC)
+
+static void render_polygon_sc(rdpContext* context, POLYGON_SC_ORDER* polygon_sc)
+{
+	POLYGON_SC_ORDER* copy;
+	rdpRender* render = context->rdp->update->render;
+
+	copy = (POLYGON_SC_ORDER*) render_record(render, RENDER_CMD_GENERIC,
+			render_call_polygon_sc, polygon_sc, sizeof(POLYGON_SC_ORDER));
+
+	copy->points = (DELTA_POINT*) render_copy(render->frame,
+			polygon_sc->points, sizeof(DELTA_POINT) * polygon_sc->numPoints);
+
+	render_command_done(render);
+}
+
+RENDER_REPLAY(polygon_cb, POLYGON_CB_ORDER, primary, PolygonCB)
+
+static void render_polygon_cb(rdpContext* context, POLYGON_CB_ORDER* polygon_cb)
+{
+	POLYGON_CB_ORDER* copy;
+	rdpRender* render = context->rdp->update->render;
+
+	copy = (POLYGON_CB_ORDER*) render_record(render, RENDER_CMD_GENERIC,
+			render_call_polygon_cb, polygon_cb, sizeof(POLYGON_CB_ORDER));
+
+	copy->points = (DELTA_POINT*) render_copy(render->frame,
+			polygon_cb->points, sizeof(DELTA_POINT) * polygon_cb->numPoints);
+	render_fix_brush(&copy->brush, &polygon_cb->brush);
+
+	render_command_done(render);
+}
+
+RENDER_REPLAY(fast_glyph, FAST_GLYPH_ORDER, primary, FastGlyph)
+
+static void render_fast_glyph(rdpContext* context, FAST_GLYPH_ORDER* fast_glyph)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_record(render, RENDER_CMD_FAST_GLYPH, render_call_fast_glyph,
+			fast_glyph, sizeof(FAST_GLYPH_ORDER));
+
+	/* the optional glyph goes along with the recorded order */
+	fast_glyph->glyph_data = NULL;
+
+	render_command_done(render);
+}
+
+/* Secondary Drawing Orders */
+
+RENDER_REPLAY(cache_bitmap, CACHE_BITMAP_ORDER, secondary, CacheBitmap)
+
+static void render_cache_bitmap(rdpContext* context, CACHE_BITMAP_ORDER* cache_bitmap)
+{
+	CACHE_BITMAP_ORDER* copy;
+	rdpRender* render = context->rdp->update->render;
+
+	copy = (CACHE_BITMAP_ORDER*) render_record(render, RENDER_CMD_GENERIC,
+			render_call_cache_bitmap, cache_bitmap, sizeof(CACHE_BITMAP_ORDER));
+
+	copy->bitmapDataStream = (uint8*) render_copy(render->frame,
+			cache_bitmap->bitmapDataStream, cache_bitmap->bitmapLength);
+
+	render_command_done(render);
+}
+
+RENDER_REPLAY(cache_bitmap_v2, CACHE_BITMAP_V2_ORDER, secondary, CacheBitmapV2)
+
+static void render_cache_bitmap_v2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cache_bitmap_v2)
+{
+	CACHE_BITMAP_V2_ORDER* copy;
+	rdpRender* render = context->rdp->update->render;
+
+	copy = (CACHE_BITMAP_V2_ORDER*) render_record(render, RENDER_CMD_GENERIC,
+			render_call_cache_bitmap_v2, cache_bitmap_v2, sizeof(CACHE_BITMAP_V2_ORDER));
+
+	copy->bitmapDataStream = (uint8*) render_copy(render->frame,
+			cache_bitmap_v2->bitmapDataStream, cache_bitmap_v2->bitmapLength);
+
+	render_command_done(render);
+}
+
+RENDER_REPLAY(cache_bitmap_v3, CACHE_BITMAP_V3_ORDER, secondary, CacheBitmapV3)
+
+static void render_cache_bitmap_v3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cache_bitmap_v3)
+{
+	CACHE_BITMAP_V3_ORDER* copy;
+	rdpRender* render = context->rdp->update->render;
+
+	copy = (CACHE_BITMAP_V3_ORDER*) render_record(render, RENDER_CMD_GENERIC,
+			render_call_cache_bitmap_v3, cache_bitmap_v3, sizeof(CACHE_BITMAP_V3_ORDER));
+
+	copy->bitmapData.data = (uint8*) render_copy(render->frame,
+			cache_bitmap_v3->bitmapData.data, cache_bitmap_v3->bitmapData.length);
+
+	render_command_done(render);
+}
+
+RENDER_REPLAY(cache_color_table, CACHE_COLOR_TABLE_ORDER, secondary, CacheColorTable)
+
+static void render_cache_color_table(rdpContext* context, CACHE_COLOR_TABLE_ORDER* cache_color_table)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_record(render, RENDER_CMD_CACHE_COLOR_TABLE, render_call_cache_color_table,
+			cache_color_table, sizeof(CACHE_COLOR_TABLE_ORDER));
+
+	cache_color_table->colorTable = NULL;
+
+	render_command_done(render);
+}
+
+RENDER_REPLAY(cache_glyph, CACHE_GLYPH_ORDER, secondary, CacheGlyph)
+
+static void render_cache_glyph(rdpContext* context, CACHE_GLYPH_ORDER* cache_glyph)
+{
+	int i;
+	rdpRender* render = context->rdp->update->render;
+
+	render_record(render, RENDER_CMD_CACHE_GLYPH, render_call_cache_glyph,
+			cache_glyph, sizeof(CACHE_GLYPH_ORDER));
+
+	for (i = 0; i < (int) cache_glyph->cGlyphs; i++)
+		cache_glyph->glyphData[i] = NULL;
+
+	render_command_done(render);
+}
+
+RENDER_REPLAY(cache_glyph_v2, CACHE_GLYPH_V2_ORDER, secondary, CacheGlyphV2)
+
+static void render_cache_glyph_v2(rdpContext* context, CACHE_GLYPH_V2_ORDER* cache_glyph_v2)
+{
+	int i;
+	rdpRender* render = context->rdp->update->render;
+
+	render_record(render, RENDER_CMD_CACHE_GLYPH_V2, render_call_cache_glyph_v2,
+			cache_glyph_v2, sizeof(CACHE_GLYPH_V2_ORDER));
+
+	for (i = 0; i < (int) cache_glyph_v2->cGlyphs; i++)
+		cache_glyph_v2->glyphData[i] = NULL;
+
+	render_command_done(render);
+}
+
+RENDER_REPLAY(cache_brush, CACHE_BRUSH_ORDER, secondary, CacheBrush)
+
+static void render_cache_brush(rdpContext* context, CACHE_BRUSH_ORDER* cache_brush)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_record(render, RENDER_CMD_CACHE_BRUSH, render_call_cache_brush,
+			cache_brush, sizeof(CACHE_BRUSH_ORDER));
+
+	cache_brush->data = NULL;
+
+	render_command_done(render);
+}
+
+/* Alternate Secondary Drawing Orders */
+
+RENDER_REPLAY(create_offscreen_bitmap, CREATE_OFFSCREEN_BITMAP_ORDER, altsec, CreateOffscreenBitmap)
+
+static void render_create_offscreen_bitmap(rdpContext* context, CREATE_OFFSCREEN_BITMAP_ORDER* create_offscreen_bitmap)
+{
+	CREATE_OFFSCREEN_BITMAP_ORDER* copy;
+	OFFSCREEN_DELETE_LIST* deleteList;
+	rdpRender* render = context->rdp->update->render;
+
+	copy = (CREATE_OFFSCREEN_BITMAP_ORDER*) render_record(render, RENDER_CMD_GENERIC,
+			render_call_create_offscreen_bitmap, create_offscreen_bitmap, sizeof(CREATE_OFFSCREEN_BITMAP_ORDER));
+
+	deleteList = &create_offscreen_bitmap->deleteList;
+	copy->deleteList.sIndices = deleteList->cIndices;
+	copy->deleteList.indices = (uint16*) render_copy(render->frame,
+			deleteList->indices, deleteList->cIndices * 2);
+
+	render_command_done(render);
+}
+
+RENDER_REPLAY(stream_bitmap_next, STREAM_BITMAP_FIRST_ORDER, altsec, StreamBitmapNext)
+
+static void render_stream_bitmap_next(rdpContext* context, STREAM_BITMAP_FIRST_ORDER* stream_bitmap_next)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	/* update_recv_altsec_order passes a STREAM_BITMAP_NEXT_ORDER here */
+	render_record(render, RENDER_CMD_GENERIC, render_call_stream_bitmap_next,
+			stream_bitmap_next, sizeof(STREAM_BITMAP_NEXT_ORDER));
+	render_command_done(render);
+}
+
+RENDER_PROXY(switch_surface, SWITCH_SURFACE_ORDER, altsec, SwitchSurface)
+RENDER_PROXY(create_nine_grid_bitmap, CREATE_NINE_GRID_BITMAP_ORDER, altsec, CreateNineGridBitmap)
+RENDER_PROXY(frame_marker, FRAME_MARKER_ORDER, altsec, FrameMarker)
+RENDER_PROXY(stream_bitmap_first, STREAM_BITMAP_FIRST_ORDER, altsec, StreamBitmapFirst)
+RENDER_PROXY(draw_gdiplus_first, DRAW_GDIPLUS_FIRST_ORDER, altsec, DrawGdiPlusFirst)
+RENDER_PROXY(draw_gdiplus_next, DRAW_GDIPLUS_NEXT_ORDER, altsec, DrawGdiPlusNext)
+RENDER_PROXY(draw_gdiplus_end, DRAW_GDIPLUS_END_ORDER, altsec, DrawGdiPlusEnd)
+RENDER_PROXY(draw_gdiplus_cache_first, DRAW_GDIPLUS_CACHE_FIRST_ORDER, altsec, DrawGdiPlusCacheFirst)
+RENDER_PROXY(draw_gdiplus_cache_next, DRAW_GDIPLUS_CACHE_NEXT_ORDER, altsec, DrawGdiPlusCacheNext)
+RENDER_PROXY(draw_gdiplus_cache_end, DRAW_GDIPLUS_CACHE_END_ORDER, altsec, DrawGdiPlusCacheEnd)
+
+/* Window Alternate Secondary Drawing Orders */
+
+static void render_window_create(rdpContext* context, WINDOW_ORDER_INFO* orderInfo, WINDOW_STATE_ORDER* window_state)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_barrier(render);
+	IFCALL(render->window.WindowCreate, context, orderInfo, window_state);
+}
+
+static void render_window_update(rdpContext* context, WINDOW_ORDER_INFO* orderInfo, WINDOW_STATE_ORDER* window_state)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_barrier(render);
+	IFCALL(render->window.WindowUpdate, context, orderInfo, window_state);
+}
+
+static void render_window_icon(rdpContext* context, WINDOW_ORDER_INFO* orderInfo, WINDOW_ICON_ORDER* window_icon)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_barrier(render);
+	IFCALL(render->window.WindowIcon, context, orderInfo, window_icon);
+}
+
+static void render_window_cached_icon(rdpContext* context, WINDOW_ORDER_INFO* orderInfo, WINDOW_CACHED_ICON_ORDER* window_cached_icon)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_barrier(render);
+	IFCALL(render->window.WindowCachedIcon, context, orderInfo, window_cached_icon);
+}
+
+static void render_window_delete(rdpContext* context, WINDOW_ORDER_INFO* orderInfo)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_barrier(render);
+	IFCALL(render->window.WindowDelete, context, orderInfo);
+}
+
+static void render_notify_icon_create(rdpContext* context, WINDOW_ORDER_INFO* orderInfo, NOTIFY_ICON_STATE_ORDER* notify_icon_state)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_barrier(render);
+	IFCALL(render->window.NotifyIconCreate, context, orderInfo, notify_icon_state);
+}
+
+static void render_notify_icon_update(rdpContext* context, WINDOW_ORDER_INFO* orderInfo, NOTIFY_ICON_STATE_ORDER* notify_icon_state)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_barrier(render);
+	IFCALL(render->window.NotifyIconUpdate, context, orderInfo, notify_icon_state);
+}
+
+static void render_notify_icon_delete(rdpContext* context, WINDOW_ORDER_INFO* orderInfo)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_barrier(render);
+	IFCALL(render->window.NotifyIconDelete, context, orderInfo);
+}
+
+static void render_monitored_desktop(rdpContext* context, WINDOW_ORDER_INFO* orderInfo, MONITORED_DESKTOP_ORDER* monitored_desktop)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_barrier(render);
+	IFCALL(render->window.MonitoredDesktop, context, orderInfo, monitored_desktop);
+}
+
+static void render_non_monitored_desktop(rdpContext* context, WINDOW_ORDER_INFO* orderInfo)
+{
+	rdpRender* render = context->rdp->update->render;
+
+	render_barrier(render);
+	IFCALL(render->window.NonMonitoredDesktop, context, orderInfo);
+}
+
+/* Callback Registration */
+
+/**
+ * Swap a client callback with its proxy, or put it back. Callbacks the
+ * client left unset stay unset, the parser already skips those.
+ */
+#define RENDER_HOOK(_live, _saved, _field, _proxy) \
+	do { \
+		if (install) \
+		{ \
+			_saved._field = _live->_field; \
+			if (_live->_field != NULL) \
+				_live->_field = _proxy; \
+		} \
+		else \
+		{ \
+			_live->_field = _saved._field; \
+		} \
+	} while (0)
+
+static void render_hook_callbacks(rdpRender* render, boolean install)
+{
+	rdpUpdate* update = render->update;
+	rdpPointerUpdate* pointer = update->pointer;
+	rdpPrimaryUpdate* primary = update->primary;
+	rdpSecondaryUpdate* secondary = update->secondary;
+	rdpAltSecUpdate* altsec = update->altsec;
+	rdpWindowUpdate* window = update->window;
+
+	/* BeginPaint and EndPaint always bracket a frame */
+	if (install)
+	{
+		render->callbacks.BeginPaint = update->BeginPaint;
+		render->callbacks.EndPaint = update->EndPaint;
+		update->BeginPaint = render_begin_paint;
+		update->EndPaint = render_end_paint;
+	}
+	else
+	{
+		update->BeginPaint = render->callbacks.BeginPaint;
+		update->EndPaint = render->callbacks.EndPaint;
+	}
+
+	RENDER_HOOK(update, render->callbacks, SetBounds, render_set_bounds);
+	RENDER_HOOK(update, render->callbacks, Synchronize, render_synchronize);
+	RENDER_HOOK(update, render->callbacks, DesktopResize, render_desktop_resize);
+	RENDER_HOOK(update, render->callbacks, BitmapUpdate, render_bitmap_update);
+	RENDER_HOOK(update, render->callbacks, Palette, render_palette);
+	RENDER_HOOK(update, render->callbacks, PlaySound, render_play_sound);
+	RENDER_HOOK(update, render->callbacks, SurfaceBits, render_surface_bits);
+	RENDER_HOOK(update, render->callbacks, SurfaceFrameMarker, render_surface_frame_marker);
+
+	RENDER_HOOK(pointer, render->pointer, PointerPosition, render_pointer_position);
+	RENDER_HOOK(pointer, render->pointer, PointerSystem, render_pointer_system);
+	RENDER_HOOK(pointer, render->pointer, PointerColor, render_pointer_color);
+	RENDER_HOOK(pointer, render->pointer, PointerNew, render_pointer_new);
+	RENDER_HOOK(pointer, render->pointer, PointerCached, render_pointer_cached);
+
+	RENDER_HOOK(primary, render->primary, DstBlt, render_dstblt);
+	RENDER_HOOK(primary, render->primary, PatBlt, render_patblt);
+	RENDER_HOOK(primary, render->primary, ScrBlt, render_scrblt);
+	RENDER_HOOK(primary, render->primary, OpaqueRect, render_opaque_rect);
+	RENDER_HOOK(primary, render->primary, DrawNineGrid, render_draw_nine_grid);
+	RENDER_HOOK(primary, render->primary, MultiDstBlt, render_multi_dstblt);
+	RENDER_HOOK(primary, render->primary, MultiPatBlt, render_multi_patblt);
+	RENDER_HOOK(primary, render->primary, MultiScrBlt, render_multi_scrblt);
+	RENDER_HOOK(primary, render->primary, MultiOpaqueRect, render_multi_opaque_rect);
+	RENDER_HOOK(primary, render->primary, MultiDrawNineGrid, render_multi_draw_nine_grid);
+	RENDER_HOOK(primary, render->primary, LineTo, render_line_to);
+	RENDER_HOOK(primary, render->primary, Polyline, render_polyline);
+	RENDER_HOOK(primary, render->primary, MemBlt, render_memblt);
+	RENDER_HOOK(primary, render->primary, Mem3Blt, render_mem3blt);
+	RENDER_HOOK(primary, render->primary, SaveBitmap, render_save_bitmap);
+	RENDER_HOOK(primary, render->primary, GlyphIndex, render_glyph_index);
+	RENDER_HOOK(primary, render->primary, FastIndex, render_fast_index);
+	RENDER_HOOK(primary, render->primary, FastGlyph, render_fast_glyph);
+	RENDER_HOOK(primary, render->primary, PolygonSC, render_polygon_sc);
+	RENDER_HOOK(primary, render->primary, PolygonCB, render_polygon_cb);
+	RENDER_HOOK(primary, render->primary, EllipseSC, render_ellipse_sc);
+	RENDER_HOOK(primary, render->primary, EllipseCB, render_ellipse_cb);
+
+	RENDER_HOOK(secondary, render->secondary, CacheBitmap, render_cache_bitmap);
+	RENDER_HOOK(secondary, render->secondary, CacheBitmapV2, render_cache_bitmap_v2);
+	RENDER_HOOK(secondary, render->secondary, CacheBitmapV3, render_cache_bitmap_v3);
+	RENDER_HOOK(secondary, render->secondary, CacheColorTable, render_cache_color_table);
+	RENDER_HOOK(secondary, render->secondary, CacheGlyph, render_cache_glyph);
+	RENDER_HOOK(secondary, render->secondary, CacheGlyphV2, render_cache_glyph_v2);
+	RENDER_HOOK(secondary, render->secondary, CacheBrush, render_cache_brush);
+
+	RENDER_HOOK(altsec, render->altsec, CreateOffscreenBitmap, render_create_offscreen_bitmap);
+	RENDER_HOOK(altsec, render->altsec, SwitchSurface, render_switch_surface);
+	RENDER_HOOK(altsec, render->altsec, CreateNineGridBitmap, render_create_nine_grid_bitmap);
+	RENDER_HOOK(altsec, render->altsec, FrameMarker, render_frame_marker);
+	RENDER_HOOK(altsec, render->altsec, StreamBitmapFirst, render_stream_bitmap_first);
+	RENDER_HOOK(altsec, render->altsec, StreamBitmapNext, render_stream_bitmap_next);
+	RENDER_HOOK(altsec, render->altsec, DrawGdiPlusFirst, render_draw_gdiplus_first);
+	RENDER_HOOK(altsec, render->altsec, DrawGdiPlusNext, render_draw_gdiplus_next);
+	RENDER_HOOK(altsec, render->altsec, DrawGdiPlusEnd, render_draw_gdiplus_end);
+	RENDER_HOOK(altsec, render->altsec, DrawGdiPlusCacheFirst, render_draw_gdiplus_cache_first);
+	RENDER_HOOK(altsec, render->altsec, DrawGdiPlusCacheNext, render_draw_gdiplus_cache_next);
+	RENDER_HOOK(altsec, render->altsec, DrawGdiPlusCacheEnd, render_draw_gdiplus_cache_end);
+
+	RENDER_HOOK(window, render->window, WindowCreate, render_window_create);
+	RENDER_HOOK(window, render->window, WindowUpdate, render_window_update);
+	RENDER_HOOK(window, render->window, WindowIcon, render_window_icon);
+	RENDER_HOOK(window, render->window, WindowCachedIcon, render_window_cached_icon);
+	RENDER_HOOK(window, render->window, WindowDelete, render_window_delete);
+	RENDER_HOOK(window, render->window, NotifyIconCreate, render_notify_icon_create);
+	RENDER_HOOK(window, render->window, NotifyIconUpdate, render_notify_icon_update);
+	RENDER_HOOK(window, render->window, NotifyIconDelete, render_notify_icon_delete);
+	RENDER_HOOK(window, render->window, MonitoredDesktop, render_monitored_desktop);
+	RENDER_HOOK(window, render->window, NonMonitoredDesktop, render_non_monitored_desktop);
+}
+
+/**
+ * Start rendering on a separate thread. Must be called from the thread
+ * that processes the connection, once the client has registered its
+ * update callbacks (i.e. after PostConnect).
+ */
+void render_start(rdpRender* render)
+{
+	if (render->started)
+		return;
+
+	render_hook_callbacks(render, true);
+
+	/* the previous thread cleared the stop signal in freerdp_thread_quit, drop stale data */
+	freerdp_thread_reset(render->thread);
+
+	render->started = true;
+	freerdp_thread_start(render->thread, render_thread_func, render);
+}
+
+/**
+ * Stop the render thread and give the client its callbacks back. Frames
+ * that were not rendered yet are dropped.
+ */
+void render_stop(rdpRender* render)
+{
+	RENDER_FRAME* frame;
+
+	if (!render->started)
+		return;
+
+	freerdp_thread_stop(render->thread);
+	render_hook_callbacks(render, false);
+	render->started = false;
+	render->in_paint = false;
+
+	render_frame_free(render->frame);
+	render->frame = NULL;
+
+	while ((frame = (RENDER_FRAME*) list_dequeue(render->frames)) != NULL)
+		render_frame_free(frame);
+
+	render->stats.queue_depth = 0;
+}
+
+void render_get_stats(rdpRender* render, RENDER_STATS* stats)
+{
+	freerdp_thread_lock(render->thread);
+	memcpy(stats, &render->stats, sizeof(RENDER_STATS));
+	freerdp_thread_unlock(render->thread);
+}
+
+rdpRender* render_new(rdpUpdate* update)
+{
+	rdpRender* render;
+
+	render = (rdpRender*) xzalloc(sizeof(rdpRender));
+
+	if (render != NULL)
+	{
+		render->update = update;
+		render->context = update->context;
+		render->frames = list_new();
+		render->free_frames = list_new();
+		render->thread = freerdp_thread_new();
+		render->drained = wait_obj_new();
+	}
+
+	return render;
+}
+
+void render_free(rdpRender* render)
+{
+	RENDER_FRAME* frame;
+
+	if (render != NULL)
+	{
+		render_stop(render);
+
+		while ((frame = (RENDER_FRAME*) list_dequeue(render->free_frames)) != NULL)
+			render_frame_free(frame);
+
+		list_free(render->frames);
+		list_free(render->free_frames);
+		freerdp_thread_free(render->thread);
+		wait_obj_free(render->drained);
+		xfree(render);
+	}
+}
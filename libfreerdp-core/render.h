@@ -0,0 +1,118 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Asynchronous Update Rendering
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RENDER_H
+#define __RENDER_H
+
+#include "rdp.h"
+
+#include <freerdp/types.h>
+#include <freerdp/update.h>
+#include <freerdp/utils/list.h>
+#include <freerdp/utils/thread.h>
+#include <freerdp/utils/wait_obj.h>
+
+#define RENDER_CHUNK_SIZE		65536
+#define RENDER_MAX_QUEUED_FRAMES	4
+
+typedef void (*pRenderReplay)(rdpRender* render, void* data);
+
+enum RENDER_COMMAND_TYPE
+{
+	RENDER_CMD_GENERIC,
+	RENDER_CMD_FAST_GLYPH,
+	RENDER_CMD_CACHE_COLOR_TABLE,
+	RENDER_CMD_CACHE_GLYPH,
+	RENDER_CMD_CACHE_GLYPH_V2,
+	RENDER_CMD_CACHE_BRUSH,
+	RENDER_CMD_POINTER_COLOR,
+	RENDER_CMD_POINTER_NEW
+};
+
+typedef struct _RENDER_CHUNK RENDER_CHUNK;
+typedef struct _RENDER_COMMAND RENDER_COMMAND;
+typedef struct _RENDER_FRAME RENDER_FRAME;
+
+struct _RENDER_CHUNK
+{
+	RENDER_CHUNK* next;
+	uint8* data;
+	size_t size;
+	size_t used;
+};
+
+struct _RENDER_COMMAND
+{
+	RENDER_COMMAND* next;
+	uint32 type;
+	pRenderReplay replay;
+	void* data;
+};
+
+/**
+ * Everything decoded between two EndPaint calls. Commands and the payloads
+ * they reference live in the frame's chunks; cache order payloads that the
+ * client callbacks adopt (glyphs, brushes, color tables, pointer masks) are
+ * taken over from the parser and released with the frame if never replayed.
+ */
+struct _RENDER_FRAME
+{
+	boolean paint;
+	int count;
+	uint32 decode_time;
+	RENDER_CHUNK* chunks;
+	RENDER_COMMAND* head;
+	RENDER_COMMAND* tail;
+};
+
+struct rdp_render
+{
+	rdpUpdate* update;
+	rdpContext* context;
+
+	boolean started;
+	boolean busy;
+	boolean in_paint;
+	uint64 decode_start;
+
+	RENDER_FRAME* frame;
+	LIST* frames;
+	LIST* free_frames;
+
+	freerdp_thread* thread;
+	struct wait_obj* drained;
+
+	RENDER_STATS stats;
+
+	/* client callbacks, called on the render thread */
+	rdpUpdate callbacks;
+	rdpPointerUpdate pointer;
+	rdpPrimaryUpdate primary;
+	rdpSecondaryUpdate secondary;
+	rdpAltSecUpdate altsec;
+	rdpWindowUpdate window;
+};
+
+rdpRender* render_new(rdpUpdate* update);
+void render_free(rdpRender* render);
+
+void render_start(rdpRender* render);
+void render_stop(rdpRender* render);
+
+void render_get_stats(rdpRender* render, RENDER_STATS* stats);
+
+#endif /* __RENDER_H */
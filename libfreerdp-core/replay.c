@@ -0,0 +1,165 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Session Recording and Replay
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * The recorder captures what the client receives once it has been decrypted,
+ * decompressed and reassembled: fast-path updates, slow-path data PDUs and
+ * virtual channel PDUs. Replaying a recording feeds the updates back into
+ * the same parsers, so that everything from order decoding to the client
+ * callbacks runs exactly as it did during the session, without a server.
+ */
+
+#include "update.h"
+#include "fastpath.h"
+
+#include <freerdp/freerdp.h>
+
+#include "replay.h"
+
+void replay_record_start(rdpRdp* rdp)
+{
+	if (rdp->settings->record_file == NULL || rdp->record != NULL)
+		return;
+
+	rdp->record = record_open(rdp->settings->record_file, true);
+
+	if (rdp->record != NULL)
+		replay_record_desktop(rdp);
+}
+
+void replay_record_desktop(rdpRdp* rdp)
+{
+	STREAM stream;
+	uint8 data[8];
+	STREAM* s = &stream;
+
+	if (rdp->record == NULL)
+		return;
+
+	stream_attach(s, data, sizeof(data));
+	stream_write_uint16(s, rdp->settings->width); /* width (2 bytes) */
+	stream_write_uint16(s, rdp->settings->height); /* height (2 bytes) */
+	stream_write_uint32(s, rdp->settings->color_depth); /* colorDepth (4 bytes) */
+
+	record_write(rdp->record, RECORD_TYPE_DESKTOP, 0, data, sizeof(data));
+}
+
+void replay_record_stop(rdpRdp* rdp)
+{
+	record_close(rdp->record);
+	rdp->record = NULL;
+}
+
+static boolean replay_desktop(rdpRdp* rdp, STREAM* s)
+{
+	uint16 width;
+	uint16 height;
+	uint32 color_depth;
+	boolean resize;
+	rdpUpdate* update = rdp->update;
+	rdpSettings* settings = rdp->settings;
+
+	if (stream_get_left(s) < 8)
+		return false;
+
+	stream_read_uint16(s, width); /* width (2 bytes) */
+	stream_read_uint16(s, height); /* height (2 bytes) */
+	stream_read_uint32(s, color_depth); /* colorDepth (4 bytes) */
+
+	resize = (width != settings->width || height != settings->height) ? true : false;
+
+	settings->width = width;
+	settings->height = height;
+	settings->color_depth = color_depth;
+
+	if (resize)
+		IFCALL(update->DesktopResize, update->context);
+
+	update_reset_state(update);
+
+	return true;
+}
+
+static boolean replay_data_pdu(rdpRdp* rdp, uint8 type, STREAM* s)
+{
+	switch (type)
+	{
+		case DATA_PDU_TYPE_UPDATE:
+			return update_recv(rdp->update, s);
+
+		case DATA_PDU_TYPE_POINTER:
+			update_recv_pointer(rdp->update, s);
+			break;
+
+		case DATA_PDU_TYPE_PLAY_SOUND:
+			update_recv_play_sound(rdp->update, s);
+			break;
+
+		default:
+			/* connection management, nothing to replay */
+			break;
+	}
+
+	return true;
+}
+
+/**
+ * Replay one record of a session recording.\n
+ * Virtual channel records are skipped, channels need a live connection.
+ * @param instance instance, does not need to be connected
+ * @param entry record read with record_read()
+ * @return false if the record could not be parsed
+ */
+
+boolean freerdp_replay_record(freerdp* instance, RECORD_ENTRY* entry)
+{
+	STREAM stream;
+	STREAM* s = &stream;
+	rdpRdp* rdp = instance->context->rdp;
+	rdpUpdate* update = rdp->update;
+
+	stream_attach(s, entry->data, entry->length);
+
+	switch (entry->type)
+	{
+		case RECORD_TYPE_DESKTOP:
+			return replay_desktop(rdp, s);
+
+		case RECORD_TYPE_BEGIN_PAINT:
+			IFCALL(update->BeginPaint, update->context);
+			break;
+
+		case RECORD_TYPE_END_PAINT:
+			IFCALL(update->EndPaint, update->context);
+			break;
+
+		case RECORD_TYPE_FASTPATH:
+			return fastpath_recv_update(rdp->fastpath, (uint8) entry->id, entry->length, s);
+
+		case RECORD_TYPE_DATA_PDU:
+			return replay_data_pdu(rdp, (uint8) entry->id, s);
+
+		case RECORD_TYPE_CHANNEL:
+			break;
+
+		default:
+			DEBUG_WARN("unknown record type 0x%02X", entry->type);
+			break;
+	}
+
+	return true;
+}
@@ -0,0 +1,30 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Session Recording and Replay
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __REPLAY_H
+#define __REPLAY_H
+
+#include "rdp.h"
+
+#include <freerdp/types.h>
+#include <freerdp/utils/record.h>
+
+void replay_record_start(rdpRdp* rdp);
+void replay_record_desktop(rdpRdp* rdp);
+void replay_record_stop(rdpRdp* rdp);
+
+#endif /* __REPLAY_H */
@@ -29,6 +29,10 @@
 
 #include "rpc.h"
 
+/* fragments are at most 0xFFFF bytes, the proxy never has more than the receive window in flight */
+#define RPC_RECV_BUFFER_SIZE		0x00020000
+#define RPC_TLS_RECORD_SIZE		0x00004000
+
 boolean ntlm_client_init(rdpNtlm* ntlm, boolean confidentiality, char* user, char* domain, char* password)
 {
 	size_t size;
@@ -371,6 +375,185 @@ int rpc_in_write(rdpRpc* rpc, uint8* data, int length)
 	return status;
 }
 
+/**
+ * Make at least length bytes past recv_offset available in the receive buffer.
+ * Each read asks for all the space left, so a single call usually brings in
+ * several fragments. Returns 1 when the bytes are available, 0 when the
+ * transport is non-blocking and the OUT channel has nothing more to read.
+ */
+
+static int rpc_recv_fill(rdpRpc* rpc, int length)
+{
+	int status;
+	int available;
+	STREAM* s = rpc->recv_stream;
+
+	available = stream_get_pos(s) - rpc->recv_offset;
+
+	if (available == 0)
+	{
+		stream_set_pos(s, 0);
+		rpc->recv_offset = 0;
+	}
+
+	while (available < length)
+	{
+		/**
+		 * Move the partial fragment to the front when the rest of it would not fit,
+		 * or when there is not enough room left to take in a whole TLS record.
+		 */
+		if (rpc->recv_offset > 0 && (rpc->recv_offset + length > stream_get_size(s) ||
+			stream_get_left(s) < RPC_TLS_RECORD_SIZE))
+		{
+			memmove(s->data, s->data + rpc->recv_offset, available);
+			stream_set_pos(s, available);
+			rpc->recv_offset = 0;
+		}
+
+		status = tls_read(rpc->tls_out, stream_get_tail(s), stream_get_left(s));
+
+		if (status < 0)
+			return -1;
+
+		if (status == 0)
+		{
+			if (!rpc->transport->blocking)
+				return 0;
+
+			freerdp_usleep(rpc->transport->usleep_interval);
+			continue;
+		}
+
+		stream_seek(s, status);
+		available += status;
+	}
+
+	return 1;
+}
+
+/**
+ * Receive one complete fragment from the OUT channel, RTS PDUs included.
+ * The fragment is left in the receive buffer and stays valid until the next call.
+ * Returns the fragment length, 0 when a non-blocking read would block, or -1.
+ */
+
+int rpc_recv_fragment(rdpRpc* rpc, uint8** fragment)
+{
+	uint8* p;
+	int status;
+	uint16 frag_length;
+
+	status = rpc_recv_fill(rpc, 16);
+
+	if (status <= 0)
+		return status;
+
+	p = rpc->recv_stream->data + rpc->recv_offset;
+	frag_length = p[8] | (p[9] << 8); /* frag_length (2 bytes) */
+
+	if (frag_length < 16)
+	{
+		printf("rpc_recv_fragment error: invalid frag_length: %d\n", frag_length);
+		return -1;
+	}
+
+	status = rpc_recv_fill(rpc, frag_length);
+
+	if (status <= 0)
+		return status;
+
+	/* compaction may have moved the fragment */
+	*fragment = rpc->recv_stream->data + rpc->recv_offset;
+	rpc->recv_offset += frag_length;
+
+#ifdef WITH_DEBUG_RPC
+	printf("rpc_recv_fragment(): length: %d\n", frag_length);
+	freerdp_hexdump(*fragment, frag_length);
+	printf("\n");
+#endif
+
+	return frag_length;
+}
+
+/**
+ * Receive the next non-RTS PDU. RTS PDUs (flow control, pings) received in
+ * between are processed in place. Only the PDUs returned here count against
+ * the receive window, rpc_consume_pdu() gives the space back.
+ */
+
+static int rpc_recv_pdu(rdpRpc* rpc, uint8** pdu)
+{
+	int status;
+	RTS_PDU rts_pdu;
+	RpcOutChannel* out_channel = rpc->VirtualConnection->DefaultOutChannel;
+
+	while (true)
+	{
+		status = rpc_recv_fragment(rpc, pdu);
+
+		if (status <= 0)
+			return status;
+
+		if ((*pdu)[2] != PTYPE_RTS) /* PTYPE (1 byte) */
+			break;
+
+		if (rts_recv_pdu_fragment(rpc, *pdu, status, &rts_pdu) < 0)
+			return -1;
+	}
+
+	out_channel->BytesReceived += status;
+	out_channel->ReceiverAvailableWindow -= status;
+
+	if (out_channel->AvailableWindowAdvertised > (uint32) status)
+		out_channel->AvailableWindowAdvertised -= status;
+	else
+		out_channel->AvailableWindowAdvertised = 0;
+
+	return status;
+}
+
+/**
+ * The PDU has been handed over to the caller. Once the window the proxy
+ * believes is left drops below half of the receive window, acknowledge
+ * everything received so far so that it can keep sending.
+ */
+
+static void rpc_consume_pdu(rdpRpc* rpc, uint32 length)
+{
+	RpcOutChannel* out_channel = rpc->VirtualConnection->DefaultOutChannel;
+
+	out_channel->ReceiverAvailableWindow += length;
+
+	if (out_channel->AvailableWindowAdvertised < out_channel->ReceiveWindow / 2)
+	{
+		rts_send_flow_control_ack_pdu(rpc);
+		out_channel->AvailableWindowAdvertised = out_channel->ReceiverAvailableWindow;
+	}
+}
+
+/**
+ * Whether rpc_read() can return more data without reading from the OUT channel,
+ * in which case polling the socket would not tell.
+ */
+
+boolean rpc_recv_pending(rdpRpc* rpc)
+{
+	uint8* p;
+	int available;
+
+	if (rpc->stub_frag_length > 0)
+		return true;
+
+	available = stream_get_pos(rpc->recv_stream) - rpc->recv_offset;
+
+	if (available < 16)
+		return false;
+
+	p = rpc->recv_stream->data + rpc->recv_offset;
+
+	return (available >= (p[8] | (p[9] << 8))) ? true : false;
+}
+
 boolean rpc_send_bind_pdu(rdpRpc* rpc)
 {
 	STREAM* pdu;
@@ -500,43 +683,44 @@ boolean rpc_send_bind_pdu(rdpRpc* rpc)
 
 int rpc_recv_bind_ack_pdu(rdpRpc* rpc)
 {
-	uint8* p;
 	STREAM* s;
 	int status;
 	uint8* pdu;
 	uint8* auth_data;
 	RPC_PDU_HEADER header;
-	int pdu_length = 0x8FFF;
 
-	pdu = xmalloc(pdu_length);
-	if (pdu == NULL)
-		return -1 ;
-	status = rpc_out_read(rpc, pdu, pdu_length);
+	status = rpc_recv_pdu(rpc, &pdu);
 
 	if (status > 0)
 	{
 		s = stream_new(0);
-		stream_attach(s, pdu, pdu_length);
+		stream_attach(s, pdu, status);
 		rpc_pdu_header_read(s, &header);
 		stream_detach(s);
 		stream_free(s);
 
-		auth_data = xmalloc(header.auth_length);
-		if (auth_data == NULL)
+		if (header.auth_length > header.frag_length)
 		{
-			xfree(pdu) ;
-			return -1 ;
+			printf("rpc_recv_bind_ack_pdu error: invalid auth_length\n");
+			return -1;
 		}
-		p = (pdu + (header.frag_length - header.auth_length));
-		memcpy(auth_data, p, header.auth_length);
+
+		/* the receive buffer is reused, NTLM keeps its own copy of the token */
+		auth_data = xmalloc(header.auth_length);
+
+		if (auth_data == NULL)
+			return -1;
+
+		memcpy(auth_data, pdu + (header.frag_length - header.auth_length), header.auth_length);
 
 		rpc->ntlm->inputBuffer.pvBuffer = auth_data;
 		rpc->ntlm->inputBuffer.cbBuffer = header.auth_length;
 
 		ntlm_authenticate(rpc->ntlm);
+
+		rpc_consume_pdu(rpc, status);
 	}
 
-	xfree(pdu);
 	return status;
 }
 
@@ -595,81 +779,6 @@ boolean rpc_send_rpc_auth_3_pdu(rdpRpc* rpc)
 	return true;
 }
 
-int rpc_out_read(rdpRpc* rpc, uint8* data, int length)
-{
-	STREAM* s;
-	int status;
-	uint8* pdu;
-	int content_length;
-	RPC_PDU_HEADER header;
-
-	if (rpc->VirtualConnection->DefaultOutChannel->ReceiverAvailableWindow < 0x00008FFF) /* Just a simple workaround */
-		rts_send_flow_control_ack_pdu(rpc);  /* Send FlowControlAck every time AvailableWindow reaches the half */
-
-	pdu = xmalloc(0xFFFF);
-	if (pdu == NULL)
-	{
-		printf("rpc_out_read error: memory allocation failed") ;
-		return -1 ;
-	}
-
-	status = tls_read(rpc->tls_out, pdu, 16); /* read first 16 bytes to get RPC PDU Header */
-
-	if (status <= 0)
-	{
-		xfree(pdu);
-		return status;
-	}
-
-	s = stream_new(0);
-	stream_attach(s, pdu, 16);
-
-	rpc_pdu_header_read(s, &header);
-
-	stream_detach(s);
-	stream_free(s);
-
-	content_length = header.frag_length - 16;
-	status = tls_read(rpc->tls_out, pdu + 16, content_length);
-
-	if (status < 0)
-	{
-		xfree(pdu);
-		return status;
-	}
-
-	if (header.ptype == PTYPE_RTS) /* RTS PDU */
-	{
-		printf("rpc_out_read error: Unexpected RTS PDU\n");
-		xfree(pdu);
-		return -1;
-	}
-	else
-	{
-		/* RTS PDUs are not subject to flow control */
-		rpc->VirtualConnection->DefaultOutChannel->BytesReceived += header.frag_length;
-		rpc->VirtualConnection->DefaultOutChannel->ReceiverAvailableWindow -= header.frag_length;
-	}
-
-	if (length < header.frag_length)
-	{
-		printf("rpc_out_read error! receive buffer is not large enough\n");
-		xfree(pdu);
-		return -1;
-	}
-
-	memcpy(data, pdu, header.frag_length);
-
-#ifdef WITH_DEBUG_RPC
-	printf("rpc_out_read(): length: %d\n", header.frag_length);
-	freerdp_hexdump(data, header.frag_length);
-	printf("\n");
-#endif
-
-	xfree(pdu);
-	return header.frag_length;
-}
-
 int rpc_tsg_write(rdpRpc* rpc, uint8* data, int length, uint16 opnum)
 {
 	int i;
@@ -782,91 +891,94 @@ int rpc_tsg_write(rdpRpc* rpc, uint8* data, int length, uint16 opnum)
 	return length;
 }
 
+/**
+ * Copy RPC stub data into the caller buffer, straight out of the receive buffer.
+ * Stub data that does not fit stays in place for the next call. Reading stops
+ * at the end of a response, when the buffer is full, or in non-blocking mode
+ * when no complete fragment is available.
+ */
+
 int rpc_read(rdpRpc* rpc, uint8* data, int length)
 {
 	int status;
 	int read = 0;
+	uint8* pdu;
 	int data_length;
+	uint32 alloc_hint;
 	uint16 frag_length;
 	uint16 auth_length;
 	uint8 auth_pad_length;
-	uint32 call_id = -1;
-	int rpc_length = length + 0xFF;
-	uint8* rpc_data = xmalloc(rpc_length);
-
-	if (rpc_data == NULL)
-	{
-		printf("rpc_read error: memory allocation failed\n") ;
-		return -1 ;
-	}
 
-	if (rpc->read_buffer_len > 0)
+	while (read < length)
 	{
-		if (rpc->read_buffer_len > (uint32) length)
+		if (rpc->stub_frag_length > 0)
 		{
-			printf("rpc_read error: receiving buffer is not large enough\n");
-			xfree(rpc_data) ;
-			return -1;
-		}
+			data_length = MIN(rpc->stub_length, (uint32) (length - read));
 
-		memcpy(data, rpc->read_buffer, rpc->read_buffer_len);
-		read += rpc->read_buffer_len;
-		xfree(rpc->read_buffer);
-		rpc->read_buffer_len = 0;
-	}
+			memcpy(data + read, rpc->stub_data, data_length);
+			rpc->stub_data += data_length;
+			rpc->stub_length -= data_length;
+			read += data_length;
 
-	while (true)
-	{
-		status = rpc_out_read(rpc, rpc_data, rpc_length);
+			if (rpc->stub_length > 0)
+				break;
 
-		if (status == 0)
-		{
-			xfree(rpc_data);
-			return read;
+			rpc_consume_pdu(rpc, rpc->stub_frag_length);
+			rpc->stub_frag_length = 0;
+
+			if (rpc->stub_last)
+				break;
+
+			continue;
 		}
-		else if (status < 0)
+
+		status = rpc_recv_pdu(rpc, &pdu);
+
+		if (status == 0)
+			break;
+
+		if (status < 0 || status < 24)
 		{
-			printf("Error! rpc_out_read() returned negative value. BytesSent: %d, BytesReceived: %d\n",
+			printf("Error! rpc_recv_pdu() failed. BytesSent: %d, BytesReceived: %d\n",
 					rpc->VirtualConnection->DefaultInChannel->BytesSent,
 					rpc->VirtualConnection->DefaultOutChannel->BytesReceived);
 
-			xfree(rpc_data);
-			return status;
+			return -1;
+		}
+
+		frag_length = status;
+		auth_length = pdu[10] | (pdu[11] << 8); /* auth_length (2 bytes) */
+		alloc_hint = pdu[16] | (pdu[17] << 8) | (pdu[18] << 16) | (pdu[19] << 24); /* alloc_hint (4 bytes) */
+
+		if (auth_length + 32 > frag_length)
+		{
+			printf("rpc_read error: invalid auth_length: %d\n", auth_length);
+			return -1;
 		}
 
-		frag_length = *(uint16*)(rpc_data + 8);
-		auth_length = *(uint16*)(rpc_data + 10);
-		call_id = *(uint32*)(rpc_data + 12);
-		status = *(uint32*)(rpc_data + 16); /* alloc_hint */
-		auth_pad_length = *(rpc_data + frag_length - auth_length - 6); /* -6 = -8 + 2 (sec_trailer + 2) */
+		auth_pad_length = pdu[frag_length - auth_length - 6]; /* -6 = -8 + 2 (sec_trailer + 2) */
 
 		/* data_length must be calculated because alloc_hint carries size of more than one pdu */
 		data_length = frag_length - auth_length - 24 - 8 - auth_pad_length; /* 24 is header; 8 is sec_trailer */
 
-		if (status == 4)
-			continue;
-
-		if (read + data_length > length) /* if read data is greater then given buffer */
+		if (data_length < 0)
 		{
-			rpc->read_buffer_len = read + data_length - length;
-			rpc->read_buffer = xmalloc(rpc->read_buffer_len);
-
-			data_length -= rpc->read_buffer_len;
-
-			memcpy(rpc->read_buffer, rpc_data + 24 + data_length, rpc->read_buffer_len);
+			printf("rpc_read error: invalid auth_pad_length: %d\n", auth_pad_length);
+			return -1;
 		}
 
-		memcpy(data + read, rpc_data + 24, data_length);
-
-		read += data_length;
-
-		if (status > data_length && read < length)
+		if (alloc_hint == 4)
+		{
+			rpc_consume_pdu(rpc, frag_length);
 			continue;
+		}
 
-		break;
+		rpc->stub_data = pdu + 24;
+		rpc->stub_length = data_length;
+		rpc->stub_frag_length = frag_length;
+		rpc->stub_last = (alloc_hint > (uint32) data_length) ? false : true;
 	}
 
-	xfree(rpc_data);
 	return read;
 }
 
@@ -909,6 +1021,7 @@ void rpc_client_virtual_connection_init(rdpRpc* rpc, RpcVirtualConnection* virtu
 	virtual_connection->DefaultOutChannel->ReceiverAvailableWindow = rpc->ReceiveWindow;
 	virtual_connection->DefaultOutChannel->ReceiveWindow = rpc->ReceiveWindow;
 	virtual_connection->DefaultOutChannel->ReceiveWindowSize = rpc->ReceiveWindow;
+	virtual_connection->DefaultOutChannel->AvailableWindowAdvertised = rpc->ReceiveWindow;
 	virtual_connection->DefaultInChannel->SenderAvailableWindow = rpc->ReceiveWindow;
 	virtual_connection->DefaultInChannel->PingOriginator.ConnectionTimeout = 30;
 	virtual_connection->DefaultInChannel->PingOriginator.KeepAliveInterval = 0;
@@ -1006,11 +1119,13 @@ rdpRpc* rpc_new(rdpTransport* transport)
 		rpc_ntlm_http_init_channel(rpc, rpc->ntlm_http_in, TSG_CHANNEL_IN);
 		rpc_ntlm_http_init_channel(rpc, rpc->ntlm_http_out, TSG_CHANNEL_OUT);
 
-		rpc->read_buffer = NULL;
 		rpc->write_buffer = NULL;
-		rpc->read_buffer_len = 0;
 		rpc->write_buffer_len = 0;
 
+		rpc->recv_stream = stream_new(RPC_RECV_BUFFER_SIZE);
+		rpc->recv_offset = 0;
+		rpc->stub_frag_length = 0;
+
 		rpc->ReceiveWindow = 0x00010000;
 		rpc->VirtualConnection = rpc_client_virtual_connection_new(rpc);
 
@@ -1027,6 +1142,7 @@ void rpc_free(rdpRpc* rpc)
 		ntlm_http_free(rpc->ntlm_http_in);
 		ntlm_http_free(rpc->ntlm_http_out);
 		rpc_client_virtual_connection_free(rpc->VirtualConnection);
+		stream_free(rpc->recv_stream);
 		xfree(rpc);
 	}
 }
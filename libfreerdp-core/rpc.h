@@ -653,8 +653,16 @@ struct rdp_rpc
 
 	uint8* write_buffer;
 	uint32 write_buffer_len;
-	uint8* read_buffer;
-	uint32 read_buffer_len;
+
+	/* OUT channel bytes, parsed in place one fragment at a time */
+	STREAM* recv_stream;
+	uint32 recv_offset;
+
+	/* stub data of the current fragment not yet returned by rpc_read() */
+	uint8* stub_data;
+	uint32 stub_length;
+	uint32 stub_frag_length;
+	boolean stub_last;
 
 	uint32 call_id;
 	uint32 pipe_call_id;
@@ -682,7 +690,8 @@ void rpc_pdu_header_read(STREAM* s, RPC_PDU_HEADER* header);
 int rpc_out_write(rdpRpc* rpc, uint8* data, int length);
 int rpc_in_write(rdpRpc* rpc, uint8* data, int length);
 
-int rpc_out_read(rdpRpc* rpc, uint8* data, int length);
+int rpc_recv_fragment(rdpRpc* rpc, uint8** fragment);
+boolean rpc_recv_pending(rdpRpc* rpc);
 
 int rpc_tsg_write(rdpRpc* rpc, uint8* data, int length, uint16 opnum);
 int rpc_read(rdpRpc* rpc, uint8* data, int length);
@@ -575,7 +575,7 @@ int rts_recv_pdu_commands(rdpRpc* rpc, RTS_PDU* rts_pdu)
 	}
 
 	s = stream_new(0);
-	stream_attach(s, rts_pdu->content, rts_pdu->header.frag_length);
+	stream_attach(s, rts_pdu->content, rts_pdu->header.frag_length - 20);
 
 	for (i = 0; i < rts_pdu->header.numberOfCommands; i++)
 	{
@@ -660,41 +660,30 @@ int rts_recv_pdu_commands(rdpRpc* rpc, RTS_PDU* rts_pdu)
 	return 0;
 }
 
-int rts_recv_pdu(rdpRpc* rpc, RTS_PDU* rts_pdu)
+/**
+ * Process an RTS PDU left in the receive buffer by rpc_recv_fragment(),
+ * the content points into the fragment and is not copied.
+ */
+
+int rts_recv_pdu_fragment(rdpRpc* rpc, uint8* fragment, int length, RTS_PDU* rts_pdu)
 {
 	STREAM* s;
-	int status;
-	int length;
-	uint8 header_buffer[20];
-	rdpTls* tls_out = rpc->tls_out;
-
-	/* read first 20 bytes to get RTS PDU Header */
-	status = tls_read(tls_out, (uint8*) &header_buffer, 20);
 
-	if (status <= 0)
+	if (length < 20)
 	{
-		printf("rts_recv error\n");
-		return status;
+		printf("rts_recv error: fragment too short: %d\n", length);
+		return -1;
 	}
 
 	s = stream_new(0);
-	stream_attach(s, header_buffer, 20);
+	stream_attach(s, fragment, 20);
 
 	rts_pdu_header_read(s, &(rts_pdu->header));
 
 	stream_detach(s);
 	stream_free(s);
 
-	length = rts_pdu->header.frag_length - 20;
-	rts_pdu->content = (uint8*) xmalloc(length);
-
-	status = tls_read(tls_out, rts_pdu->content, length);
-
-	if (status < 0)
-	{
-		printf("rts_recv error\n");
-		return status;
-	}
+	rts_pdu->content = fragment + 20;
 
 	if (rts_pdu->header.ptype != PTYPE_RTS)
 	{
@@ -703,8 +692,8 @@ int rts_recv_pdu(rdpRpc* rpc, RTS_PDU* rts_pdu)
 	}
 
 #ifdef WITH_DEBUG_RTS
-	printf("rts_recv(): length: %d\n", length);
-	freerdp_hexdump(rts_pdu->content, length);
+	printf("rts_recv(): length: %d\n", length - 20);
+	freerdp_hexdump(rts_pdu->content, length - 20);
 	printf("\n");
 #endif
 
@@ -712,3 +701,19 @@ int rts_recv_pdu(rdpRpc* rpc, RTS_PDU* rts_pdu)
 
 	return rts_pdu->header.frag_length;
 }
+
+int rts_recv_pdu(rdpRpc* rpc, RTS_PDU* rts_pdu)
+{
+	int status;
+	uint8* fragment;
+
+	status = rpc_recv_fragment(rpc, &fragment);
+
+	if (status <= 0)
+	{
+		printf("rts_recv error\n");
+		return status;
+	}
+
+	return rts_recv_pdu_fragment(rpc, fragment, status, rts_pdu);
+}
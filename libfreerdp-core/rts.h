@@ -154,6 +154,7 @@ boolean rts_send_flow_control_ack_pdu(rdpRpc* rpc);
 boolean rts_send_ping_pdu(rdpRpc* rpc);
 
 int rts_recv_pdu(rdpRpc* rpc, RTS_PDU* rts_pdu);
+int rts_recv_pdu_fragment(rdpRpc* rpc, uint8* fragment, int length, RTS_PDU* rts_pdu);
 
 #ifdef WITH_DEBUG_TSG
 #define WITH_DEBUG_RTS
@@ -264,6 +264,7 @@ rdpSettings* settings_new(void* instance)
 		gethostname(settings->client_hostname, 31);
 		settings->client_hostname[31] = 0;
 		settings->mouse_motion = true;
+		settings->input_coalesce = true;
 
 		settings->client_auto_reconnect_cookie = xnew(ARC_CS_PRIVATE_PACKET);
 		settings->server_auto_reconnect_cookie = xnew(ARC_SC_PRIVATE_PACKET);
@@ -315,6 +316,7 @@ void settings_free(rdpSettings* settings)
 		xfree(settings->config_path);
 		xfree(settings->current_path);
 		xfree(settings->development_path);
+		xfree(settings->record_file);
 		xfree(settings);
 	}
 }
@@ -40,6 +40,10 @@
 #endif
 #endif
 
+#ifdef __linux__
+#include <linux/sockios.h>
+#endif
+
 #else
 #define SHUT_RDWR SD_BOTH
 #define close(_fd) closesocket(_fd)
@@ -234,6 +238,26 @@ boolean tcp_set_keep_alive_mode(rdpTcp* tcp)
 	return true;
 }
 
+/**
+ * Bytes written to the socket that the peer has not acknowledged yet,
+ * 0 where the system cannot tell.
+ */
+
+int tcp_get_send_queue(rdpTcp* tcp)
+{
+	int queued = 0;
+
+#if defined(SIOCOUTQ)
+	if (ioctl(tcp->sockfd, SIOCOUTQ, &queued) < 0)
+		return 0;
+#elif defined(FIONWRITE)
+	if (ioctl(tcp->sockfd, FIONWRITE, &queued) < 0)
+		return 0;
+#endif
+
+	return queued;
+}
+
 rdpTcp* tcp_new(freerdp* instance)
 {
     rdpSettings* settings = instance->settings;
@@ -80,6 +80,11 @@ boolean transport_connect_rdp(rdpTransport* transport)
 	return true;
 }
 
+static void transport_count_tls(rdpTransport* transport, rdpTls* tls)
+{
+	metrics_count(transport->metrics, tls->resumed ? METRICS_TLS_RESUMED : METRICS_TLS_HANDSHAKES, 1);
+}
+
 boolean transport_connect_tls(rdpTransport* transport)
 {
 	if (transport->tls == NULL)
@@ -88,6 +93,8 @@ boolean transport_connect_tls(rdpTransport* transport)
 	transport->layer = TRANSPORT_LAYER_TLS;
 	transport->tls->sockfd = transport->tcp->sockfd;
 
+	metrics_phase_end(transport->metrics, METRICS_CONNECT_NEGO);
+
 	if (tls_connect(transport->tls) != true)
 	{
 		if (!connectErrorCode)                    
@@ -98,6 +105,9 @@ boolean transport_connect_tls(rdpTransport* transport)
 		return false;
 	}
 
+	transport_count_tls(transport, transport->tls);
+	metrics_phase_end(transport->metrics, METRICS_CONNECT_TLS);
+
 	return true;
 }
 
@@ -112,6 +122,8 @@ boolean transport_connect_nla(rdpTransport* transport)
 	transport->layer = TRANSPORT_LAYER_TLS;
 	transport->tls->sockfd = transport->tcp->sockfd;
 
+	metrics_phase_end(transport->metrics, METRICS_CONNECT_NEGO);
+
 	if (tls_connect(transport->tls) != true)
 	{
 		if (!connectErrorCode)                    
@@ -122,6 +134,9 @@ boolean transport_connect_nla(rdpTransport* transport)
 		return false;
 	}
 
+	transport_count_tls(transport, transport->tls);
+	metrics_phase_end(transport->metrics, METRICS_CONNECT_TLS);
+
 	/* Network Level Authentication */
 
 	if (transport->settings->authentication != true)
@@ -147,6 +162,8 @@ boolean transport_connect_nla(rdpTransport* transport)
 
 	credssp_free(transport->credssp);
 
+	metrics_phase_end(transport->metrics, METRICS_CONNECT_NLA);
+
 	return true;
 }
 
@@ -170,9 +187,13 @@ boolean transport_tsg_connect(rdpTransport* transport, const char* hostname, uin
 	if (tls_connect(transport->tls_in) != true)
 		return false;
 
+	transport_count_tls(transport, transport->tls_in);
+
 	if (tls_connect(transport->tls_out) != true)
 		return false;
 
+	transport_count_tls(transport, transport->tls_out);
+
 	if (!tsg_connect(tsg, hostname, port))
 		return false;
 
@@ -220,9 +241,14 @@ boolean transport_accept_tls(rdpTransport* transport)
 	transport->layer = TRANSPORT_LAYER_TLS;
 	transport->tls->sockfd = transport->tcp->sockfd;
 
+	metrics_phase_begin(transport->metrics);
+
 	if (tls_accept(transport->tls, transport->settings->cert_file, transport->settings->privatekey_file) != true)
 		return false;
 
+	transport_count_tls(transport, transport->tls);
+	metrics_phase_end(transport->metrics, METRICS_CONNECT_TLS);
+
 	return true;
 }
 
@@ -237,9 +263,14 @@ boolean transport_accept_nla(rdpTransport* transport)
 	transport->layer = TRANSPORT_LAYER_TLS;
 	transport->tls->sockfd = transport->tcp->sockfd;
 
+	metrics_phase_begin(transport->metrics);
+
 	if (tls_accept(transport->tls, transport->settings->cert_file, transport->settings->privatekey_file) != true)
 		return false;
 
+	transport_count_tls(transport, transport->tls);
+	metrics_phase_end(transport->metrics, METRICS_CONNECT_TLS);
+
 	/* Network Level Authentication */
 
 	if (transport->settings->authentication != true)
@@ -285,6 +316,9 @@ int transport_read(rdpTransport* transport, STREAM* s)
 		break;
 	}
 
+	if (status > 0)
+		metrics_count(transport->metrics, METRICS_BYTES_IN, status);
+
 #ifdef WITH_DEBUG_TRANSPORT
 	if (status > 0)
 	{
@@ -355,6 +389,7 @@ int transport_write(rdpTransport* transport, STREAM* s)
 
 		length -= status;
 		stream_seek(s, status);
+		metrics_count(transport->metrics, METRICS_BYTES_OUT, status);
 	}
 
 	if (status < 0)
@@ -362,13 +397,25 @@ int transport_write(rdpTransport* transport, STREAM* s)
 		/* A write error indicates that the peer has dropped the connection */
 		transport->layer = TRANSPORT_LAYER_CLOSED;
 	}
+	else
+	{
+		metrics_count(transport->metrics, METRICS_PDUS_OUT, 1);
+
+		/* lets encoders adapt to how fast the peer takes the data in */
+		if (transport->metrics != NULL && transport->layer != TRANSPORT_LAYER_TSG)
+			metrics_gauge(transport->metrics, METRICS_SEND_QUEUE, tcp_get_send_queue(transport->tcp));
+	}
 
 	return status;
 }
 
 void transport_get_fds(rdpTransport* transport, void** rfds, int* rcount)
 {
-	rfds[*rcount] = (void*)(long)(transport->tcp->sockfd);
+	if (transport->layer == TRANSPORT_LAYER_TSG)
+		rfds[*rcount] = (void*)(long)(transport->tcp_out->sockfd);
+	else
+		rfds[*rcount] = (void*)(long)(transport->tcp->sockfd);
+
 	(*rcount)++;
 	wait_obj_get_fds(transport->recv_event, rfds, rcount);
 }
@@ -388,6 +435,9 @@ int transport_check_fds(rdpTransport** ptransport)
 	if (status < 0)
 		return status;
 
+	/* bytes waiting to be processed, including what was left over from the last call */
+	metrics_gauge(transport->metrics, METRICS_RECV_BUFFER, stream_get_pos(transport->recv_buffer));
+
 	while ((pos = stream_get_pos(transport->recv_buffer)) > 0)
 	{
 		stream_set_pos(transport->recv_buffer, 0);
@@ -450,6 +500,8 @@ int transport_check_fds(rdpTransport** ptransport)
 		stream_seal(received);
 		stream_set_pos(received, 0);
 
+		metrics_count(transport->metrics, METRICS_PDUS_IN, 1);
+
 		if (transport->recv_callback(transport, received, transport->recv_extra) == false)
 			status = -1;
 
@@ -478,6 +530,11 @@ int transport_check_fds(rdpTransport** ptransport)
 boolean transport_set_blocking_mode(rdpTransport* transport, boolean blocking)
 {
 	transport->blocking = blocking;
+
+	/* gateway traffic arrives on the OUT channel, writes on the IN channel stay blocking */
+	if (transport->layer == TRANSPORT_LAYER_TSG)
+		return tcp_set_blocking_mode(transport->tcp_out, blocking);
+
 	return tcp_set_blocking_mode(transport->tcp, blocking);
 }
 
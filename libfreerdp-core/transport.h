@@ -40,6 +40,7 @@ typedef struct rdp_transport rdpTransport;
 #include <freerdp/types.h>
 #include <freerdp/settings.h>
 #include <freerdp/utils/stream.h>
+#include <freerdp/utils/metrics.h>
 #include <freerdp/utils/wait_obj.h>
 
 typedef boolean (*TransportRecv) (rdpTransport* transport, STREAM* stream, void* extra);
@@ -65,6 +66,7 @@ struct rdp_transport
 	struct wait_obj* recv_event;
 	boolean blocking;
 	boolean process_single_pdu; /* process single pdu in transport_check_fds */
+	rdpMetrics* metrics;
 };
 
 STREAM* transport_recv_stream_init(rdpTransport* transport, int size);
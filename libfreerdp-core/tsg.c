@@ -2016,6 +2016,10 @@ int tsg_read(rdpTsg* tsg, uint8* data, uint32 length)
 
 	status = rpc_read(tsg->rpc, data, length);
 
+	/* fragments already buffered will not make the socket readable again */
+	if (rpc_recv_pending(tsg->rpc))
+		wait_obj_set(tsg->transport->recv_event);
+
 	return status;
 }
 
@@ -18,6 +18,7 @@
  */
 
 #include "update.h"
+#include "render.h"
 #include "surface.h"
 #include <freerdp/utils/rect.h>
 #include <freerdp/codec/bitmap.h>
@@ -462,6 +463,131 @@ static void update_send_scrblt(rdpContext* context, SCRBLT_ORDER* scrblt)
 	fastpath_send_update_pdu(rdp->fastpath, FASTPATH_UPDATETYPE_ORDERS, s);
 }
 
+static void update_send_memblt(rdpContext* context, MEMBLT_ORDER* memblt)
+{
+	STREAM* s;
+	rdpRdp* rdp = context->rdp;
+
+	s = fastpath_update_pdu_init(rdp->fastpath);
+
+	stream_write_uint16(s, 1); /* numberOrders (2 bytes) */
+	stream_write_uint8(s, ORDER_STANDARD | ORDER_TYPE_CHANGE); /* controlFlags (1 byte) */
+	stream_write_uint8(s, ORDER_TYPE_MEMBLT); /* orderType (1 byte) */
+	stream_write_uint16(s, MEMBLT_ORDER_ALL_FIELDS); /* fieldFlags (variable) */
+
+	update_write_memblt_order(s, memblt);
+
+	fastpath_send_update_pdu(rdp->fastpath, FASTPATH_UPDATETYPE_ORDERS, s);
+}
+
+static void update_send_glyph_index(rdpContext* context, GLYPH_INDEX_ORDER* glyph_index)
+{
+	STREAM* s;
+	rdpRdp* rdp = context->rdp;
+
+	s = fastpath_update_pdu_init(rdp->fastpath);
+
+	stream_write_uint16(s, 1); /* numberOrders (2 bytes) */
+	stream_write_uint8(s, ORDER_STANDARD | ORDER_TYPE_CHANGE); /* controlFlags (1 byte) */
+	stream_write_uint8(s, ORDER_TYPE_GLYPH_INDEX); /* orderType (1 byte) */
+	stream_write_uint8(s, GLYPH_INDEX_ORDER_TEXT_FIELDS & 0xFF); /* fieldFlags (variable) */
+	stream_write_uint8(s, (GLYPH_INDEX_ORDER_TEXT_FIELDS >> 8) & 0xFF);
+	stream_write_uint8(s, (GLYPH_INDEX_ORDER_TEXT_FIELDS >> 16) & 0xFF);
+
+	update_write_glyph_index_order(s, glyph_index);
+
+	fastpath_send_update_pdu(rdp->fastpath, FASTPATH_UPDATETYPE_ORDERS, s);
+}
+
+/**
+ * Start a fast-path orders update holding a single secondary order.
+ * The order header is written by update_send_secondary_order() once the
+ * length of the order is known.
+ * @return position of the order header
+ */
+
+static int update_init_secondary_order(STREAM* s, int size)
+{
+	stream_check_size(s, 16 + size);
+
+	stream_write_uint16(s, 1); /* numberOrders (2 bytes) */
+	stream_write_uint8(s, ORDER_STANDARD | ORDER_SECONDARY); /* controlFlags (1 byte) */
+	stream_seek(s, 5); /* orderLength, extraFlags and orderType */
+
+	return stream_get_pos(s) - 5;
+}
+
+static void update_send_secondary_order(rdpRdp* rdp, STREAM* s, int bm, uint16 extraFlags, uint8 orderType)
+{
+	int em;
+
+	/* orderLength counts the bytes after the order header, minus 7 */
+	em = stream_get_pos(s);
+	stream_set_pos(s, bm);
+	stream_write_uint16(s, em - bm - 12); /* orderLength (2 bytes) */
+	stream_write_uint16(s, extraFlags); /* extraFlags (2 bytes) */
+	stream_write_uint8(s, orderType); /* orderType (1 byte) */
+	stream_set_pos(s, em);
+
+	fastpath_send_update_pdu(rdp->fastpath, FASTPATH_UPDATETYPE_ORDERS, s);
+}
+
+static void update_send_cache_bitmap_v2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cache_bitmap_v2)
+{
+	int bm;
+	STREAM* s;
+	uint16 extraFlags;
+	rdpRdp* rdp = context->rdp;
+
+	s = fastpath_update_pdu_init(rdp->fastpath);
+	bm = update_init_secondary_order(s, 16 + cache_bitmap_v2->bitmapLength);
+
+	update_write_cache_bitmap_v2_order(s, cache_bitmap_v2, cache_bitmap_v2->compressed, &extraFlags);
+
+	update_send_secondary_order(rdp, s, bm, extraFlags, cache_bitmap_v2->compressed ?
+			ORDER_TYPE_BITMAP_COMPRESSED_V2 : ORDER_TYPE_BITMAP_UNCOMPRESSED_V2);
+}
+
+static void update_send_cache_glyph(rdpContext* context, CACHE_GLYPH_ORDER* cache_glyph)
+{
+	int i;
+	int bm;
+	int size;
+	STREAM* s;
+	uint16 extraFlags;
+	rdpRdp* rdp = context->rdp;
+
+	for (i = size = 0; i < (int) cache_glyph->cGlyphs; i++)
+		size += 10 + cache_glyph->glyphData[i]->cb;
+
+	s = fastpath_update_pdu_init(rdp->fastpath);
+	bm = update_init_secondary_order(s, 2 + size);
+
+	update_write_cache_glyph_order(s, cache_glyph, &extraFlags);
+
+	update_send_secondary_order(rdp, s, bm, extraFlags, ORDER_TYPE_CACHE_GLYPH);
+}
+
+static void update_send_cache_glyph_v2(rdpContext* context, CACHE_GLYPH_V2_ORDER* cache_glyph_v2)
+{
+	int i;
+	int bm;
+	int size;
+	STREAM* s;
+	uint16 extraFlags;
+	rdpRdp* rdp = context->rdp;
+
+	for (i = size = 0; i < (int) cache_glyph_v2->cGlyphs; i++)
+		size += 9 + cache_glyph_v2->glyphData[i]->cb;
+
+	s = fastpath_update_pdu_init(rdp->fastpath);
+	bm = update_init_secondary_order(s, size);
+
+	update_write_cache_glyph_v2_order(s, cache_glyph_v2, &extraFlags);
+
+	update_send_secondary_order(rdp, s, bm, extraFlags, ORDER_TYPE_CACHE_GLYPH);
+}
+
 static void update_send_pointer_system(rdpContext* context, POINTER_SYSTEM_UPDATE* pointer_system)
 {
 	STREAM* s;
@@ -569,6 +695,11 @@ void update_register_server_callbacks(rdpUpdate* update)
 	update->SurfaceFrameMarker = update_send_surface_frame_marker;
 	update->SurfaceCommand = update_send_surface_command;
 	update->primary->ScrBlt = update_send_scrblt;
+	update->primary->MemBlt = update_send_memblt;
+	update->primary->GlyphIndex = update_send_glyph_index;
+	update->secondary->CacheBitmapV2 = update_send_cache_bitmap_v2;
+	update->secondary->CacheGlyph = update_send_cache_glyph;
+	update->secondary->CacheGlyphV2 = update_send_cache_glyph_v2;
 	update->pointer->PointerSystem = update_send_pointer_system;
 	update->pointer->PointerColor = update_send_pointer_color;
 	update->pointer->PointerNew = update_send_pointer_new;
@@ -616,6 +747,9 @@ void update_free(rdpUpdate* update)
 	if (update != NULL)
 	{
 		OFFSCREEN_DELETE_LIST* deleteList;
+
+		render_free(update->render);
+
 		deleteList = &(update->altsec->create_offscreen_bitmap.deleteList);
 		xfree(deleteList->indices);
 
@@ -17,11 +17,20 @@
  * limitations under the License.
  */
 
+#include <freerdp/utils/mutex.h>
 #include <freerdp/utils/stream.h>
 #include <freerdp/utils/memory.h>
 
 #include <freerdp/crypto/tls.h>
 
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#endif
+
 static CryptoCert tls_get_certificate(rdpTls* tls, boolean peer)
 {
 	CryptoCert cert;
@@ -53,20 +62,268 @@ static void tls_free_certificate(CryptoCert cert)
 	xfree(cert);
 }
 
-boolean tls_connect(rdpTls* tls)
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+#define TLS_CTX_ADDREF(_ctx)		SSL_CTX_up_ref(_ctx)
+#else
+#define TLS_CTX_ADDREF(_ctx)		CRYPTO_add(&(_ctx)->references, 1, CRYPTO_LOCK_SSL_CTX)
+#endif
+
+/**
+ * Creating an SSL_CTX loads the cipher lists and, for a server, the key and
+ * certificate files, so contexts are created once per process and shared by
+ * all connections, each rdpTls holding a reference.
+ *
+ * Client sessions are cached by peer address so that reconnecting to the same
+ * server (redirection, auto-reconnect) resumes instead of doing a full handshake.
+ * Server sessions live in the OpenSSL cache of the shared server context.
+ */
+
+#define TLS_SESSION_CACHE_SIZE		16
+
+struct _TLS_SESSION_ENTRY
 {
-	CryptoCert cert;
+	char* key;
+	uint32 used;
+	SSL_SESSION* session;
+};
+typedef struct _TLS_SESSION_ENTRY TLS_SESSION_ENTRY;
+
+struct _TLS_SERVER_CONTEXT
+{
+	char* cert_file;
+	char* privatekey_file;
+	SSL_CTX* ctx;
+	struct _TLS_SERVER_CONTEXT* next;
+};
+typedef struct _TLS_SERVER_CONTEXT TLS_SERVER_CONTEXT;
+
+static freerdp_mutex tls_mutex = NULL;
+static SSL_CTX* tls_client_ctx = NULL;
+static TLS_SERVER_CONTEXT* tls_server_contexts = NULL;
+
+static uint32 tls_session_clock = 0;
+static TLS_SESSION_ENTRY tls_sessions[TLS_SESSION_CACHE_SIZE];
+
+/* numeric "address:port" of the peer, NULL if the socket is not connected */
+static char* tls_get_peer_key(int sockfd)
+{
+	char* key;
+	char host[NI_MAXHOST];
+	char service[NI_MAXSERV];
+	struct sockaddr_storage addr;
+	socklen_t length = sizeof(addr);
+
+	if (getpeername(sockfd, (struct sockaddr*) &addr, &length) != 0)
+		return NULL;
+
+	if (getnameinfo((struct sockaddr*) &addr, length, host, sizeof(host),
+			service, sizeof(service), NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+		return NULL;
+
+	key = (char*) xmalloc(strlen(host) + strlen(service) + 2);
+	sprintf(key, "%s:%s", host, service);
+
+	return key;
+}
+
+static TLS_SESSION_ENTRY* tls_session_find(const char* key)
+{
+	int index;
+
+	for (index = 0; index < TLS_SESSION_CACHE_SIZE; index++)
+	{
+		if (tls_sessions[index].key && strcmp(tls_sessions[index].key, key) == 0)
+			return &tls_sessions[index];
+	}
+
+	return NULL;
+}
+
+static void tls_session_entry_clear(TLS_SESSION_ENTRY* entry)
+{
+	SSL_SESSION_free(entry->session);
+	xfree(entry->key);
+	memset(entry, 0, sizeof(TLS_SESSION_ENTRY));
+}
+
+/* offer the session cached for this peer, if any */
+static void tls_session_resume(rdpTls* tls)
+{
+	TLS_SESSION_ENTRY* entry;
+
+	freerdp_mutex_lock(tls_mutex);
+
+	entry = tls_session_find(tls->session_key);
+
+	if (entry != NULL)
+	{
+		SSL_set_session(tls->ssl, entry->session);
+		entry->used = ++tls_session_clock;
+	}
+
+	freerdp_mutex_unlock(tls_mutex);
+}
+
+/**
+ * Called by OpenSSL when the server has given us a session we can resume,
+ * which with TLS 1.3 happens after the handshake. Keeps the reference.
+ */
+static int tls_session_new(SSL* ssl, SSL_SESSION* session)
+{
+	int index;
+	rdpTls* tls;
+	TLS_SESSION_ENTRY* entry;
+
+	tls = (rdpTls*) SSL_get_app_data(ssl);
+
+	if (tls == NULL || tls->session_key == NULL)
+		return 0;
+
+	freerdp_mutex_lock(tls_mutex);
+
+	entry = tls_session_find(tls->session_key);
+
+	if (entry == NULL)
+	{
+		/* least recently used, empty entries first */
+		entry = &tls_sessions[0];
+
+		for (index = 1; index < TLS_SESSION_CACHE_SIZE; index++)
+		{
+			if (tls_sessions[index].used < entry->used)
+				entry = &tls_sessions[index];
+		}
+	}
+
+	if (entry->key != NULL)
+		tls_session_entry_clear(entry);
+
+	entry->key = xstrdup(tls->session_key);
+	entry->session = session;
+	entry->used = ++tls_session_clock;
+
+	freerdp_mutex_unlock(tls_mutex);
+
+	return 1;
+}
+
+static void tls_session_remove(const char* key)
+{
+	TLS_SESSION_ENTRY* entry;
+
+	freerdp_mutex_lock(tls_mutex);
+
+	entry = tls_session_find(key);
+
+	if (entry != NULL)
+		tls_session_entry_clear(entry);
+
+	freerdp_mutex_unlock(tls_mutex);
+}
+
+/**
+ * Forget all cached client sessions, the next connection to every server
+ * does a full handshake.
+ */
+
+void tls_session_cache_flush(void)
+{
+	int index;
+
+	freerdp_mutex_lock(tls_mutex);
+
+	for (index = 0; index < TLS_SESSION_CACHE_SIZE; index++)
+	{
+		if (tls_sessions[index].key != NULL)
+			tls_session_entry_clear(&tls_sessions[index]);
+	}
+
+	freerdp_mutex_unlock(tls_mutex);
+}
+
+static SSL_CTX* tls_client_context(void)
+{
+	SSL_CTX* ctx;
 	long options = 0;
-	int connection_status;
 
-	tls->ctx = SSL_CTX_new(TLSv1_client_method());
+	freerdp_mutex_lock(tls_mutex);
 
-	if (tls->ctx == NULL)
+	if (tls_client_ctx == NULL)
+	{
+		tls_client_ctx = SSL_CTX_new(TLSv1_client_method());
+
+		if (tls_client_ctx == NULL)
+		{
+			printf("SSL_CTX_new failed\n");
+			freerdp_mutex_unlock(tls_mutex);
+			return NULL;
+		}
+
+		/**
+		 * SSL_OP_NO_COMPRESSION:
+		 *
+		 * The Microsoft RDP server does not advertise support
+		 * for TLS compression, but alternative servers may support it.
+		 * This was observed between early versions of the FreeRDP server
+		 * and the FreeRDP client, and caused major performance issues,
+		 * which is why we're disabling it.
+		 */
+#ifdef SSL_OP_NO_COMPRESSION
+		options |= SSL_OP_NO_COMPRESSION;
+#endif
+
+		/**
+		 * SSL_OP_TLS_BLOCK_PADDING_BUG:
+		 *
+		 * The Microsoft RDP server does *not* support TLS padding.
+		 * It absolutely needs to be disabled otherwise it won't work.
+		 */
+		options |= SSL_OP_TLS_BLOCK_PADDING_BUG;
+
+		/**
+		 * SSL_OP_DONT_INSERT_EMPTY_FRAGMENTS:
+		 *
+		 * Just like TLS padding, the Microsoft RDP server does not
+		 * support empty fragments. This needs to be disabled.
+		 */
+		options |= SSL_OP_DONT_INSERT_EMPTY_FRAGMENTS;
+
+		SSL_CTX_set_options(tls_client_ctx, options);
+
+		/* sessions are kept in tls_sessions, by peer address */
+		SSL_CTX_set_session_cache_mode(tls_client_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(tls_client_ctx, tls_session_new);
+	}
+
+	ctx = tls_client_ctx;
+	TLS_CTX_ADDREF(ctx);
+
+	freerdp_mutex_unlock(tls_mutex);
+
+	return ctx;
+}
+
+static SSL_CTX* tls_server_context_new(const char* cert_file, const char* privatekey_file)
+{
+	SSL_CTX* ctx;
+	long options = 0;
+
+	ctx = SSL_CTX_new(SSLv23_server_method());
+
+	if (ctx == NULL)
 	{
 		printf("SSL_CTX_new failed\n");
-		return false;
+		return NULL;
 	}
 
+	/*
+	 * SSL_OP_NO_SSLv2:
+	 *
+	 * We only want SSLv3 and TLSv1, so disable SSLv2.
+	 * SSLv3 is used by, eg. Microsoft RDC for Mac OS X.
+	 */
+	options |= SSL_OP_NO_SSLv2;
+
 	/**
 	 * SSL_OP_NO_COMPRESSION:
 	 *
@@ -96,7 +353,78 @@ boolean tls_connect(rdpTls* tls)
 	 */
 	options |= SSL_OP_DONT_INSERT_EMPTY_FRAGMENTS;
 
-	SSL_CTX_set_options(tls->ctx, options);
+	SSL_CTX_set_options(ctx, options);
+
+	if (SSL_CTX_use_RSAPrivateKey_file(ctx, privatekey_file, SSL_FILETYPE_PEM) <= 0)
+	{
+		printf("SSL_CTX_use_RSAPrivateKey_file failed\n");
+		SSL_CTX_free(ctx);
+		return NULL;
+	}
+
+	if (SSL_CTX_use_certificate_file(ctx, cert_file, SSL_FILETYPE_PEM) <= 0)
+	{
+		printf("SSL_CTX_use_certificate_file failed\n");
+		SSL_CTX_free(ctx);
+		return NULL;
+	}
+
+	/* session ids and tickets issued by this context are valid for every connection using it */
+	SSL_CTX_set_session_id_context(ctx, (unsigned char*) "FreeRDP", 7);
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+
+	return ctx;
+}
+
+static SSL_CTX* tls_server_context(const char* cert_file, const char* privatekey_file)
+{
+	SSL_CTX* ctx = NULL;
+	TLS_SERVER_CONTEXT* context;
+
+	freerdp_mutex_lock(tls_mutex);
+
+	for (context = tls_server_contexts; context != NULL; context = context->next)
+	{
+		if (strcmp(context->cert_file, cert_file) == 0 &&
+			strcmp(context->privatekey_file, privatekey_file) == 0)
+			break;
+	}
+
+	if (context == NULL)
+	{
+		ctx = tls_server_context_new(cert_file, privatekey_file);
+
+		if (ctx != NULL)
+		{
+			context = xnew(TLS_SERVER_CONTEXT);
+			context->cert_file = xstrdup(cert_file);
+			context->privatekey_file = xstrdup(privatekey_file);
+			context->ctx = ctx;
+			context->next = tls_server_contexts;
+			tls_server_contexts = context;
+		}
+	}
+
+	if (context != NULL)
+	{
+		ctx = context->ctx;
+		TLS_CTX_ADDREF(ctx);
+	}
+
+	freerdp_mutex_unlock(tls_mutex);
+
+	return ctx;
+}
+
+boolean tls_connect(rdpTls* tls)
+{
+	CryptoCert cert;
+	int connection_status;
+
+	tls->ctx = tls_client_context();
+
+	if (tls->ctx == NULL)
+		return false;
 
 	tls->ssl = SSL_new(tls->ctx);
 
@@ -112,6 +440,15 @@ boolean tls_connect(rdpTls* tls)
 		return false;
 	}
 
+	/* tls_session_new() finds the peer through the connection */
+	SSL_set_app_data(tls->ssl, tls);
+
+	xfree(tls->session_key);
+	tls->session_key = tls_get_peer_key(tls->sockfd);
+
+	if (tls->session_key != NULL)
+		tls_session_resume(tls);
+
 	connection_status = SSL_connect(tls->ssl);
 
 	if (connection_status <= 0)
@@ -122,6 +459,8 @@ boolean tls_connect(rdpTls* tls)
 		}
 	}
 
+	tls->resumed = SSL_session_reused(tls->ssl) ? true : false;
+
 	cert = tls_get_certificate(tls, true);
 
 	if (cert == NULL)
@@ -140,6 +479,11 @@ boolean tls_connect(rdpTls* tls)
 	if (!tls_verify_certificate(tls, cert, tls->settings->hostname))
 	{
 		printf("tls_connect: certificate not trusted, aborting.\n");
+
+		/* do not resume a session with a server that was not trusted */
+		if (tls->session_key != NULL)
+			tls_session_remove(tls->session_key);
+
 		tls_disconnect(tls);
 		tls_free_certificate(cert);
 		return false;
@@ -153,61 +497,12 @@ boolean tls_connect(rdpTls* tls)
 boolean tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_file)
 {
 	CryptoCert cert;
-	long options = 0;
 	int connection_status;
 
-	tls->ctx = SSL_CTX_new(SSLv23_server_method());
+	tls->ctx = tls_server_context(cert_file, privatekey_file);
 
 	if (tls->ctx == NULL)
-	{
-		printf("SSL_CTX_new failed\n");
-		return false;
-	}
-
-	/*
-	 * SSL_OP_NO_SSLv2:
-	 *
-	 * We only want SSLv3 and TLSv1, so disable SSLv2.
-	 * SSLv3 is used by, eg. Microsoft RDC for Mac OS X.
-	 */
-	options |= SSL_OP_NO_SSLv2;
-
-	/**
-	 * SSL_OP_NO_COMPRESSION:
-	 *
-	 * The Microsoft RDP server does not advertise support
-	 * for TLS compression, but alternative servers may support it.
-	 * This was observed between early versions of the FreeRDP server
-	 * and the FreeRDP client, and caused major performance issues,
-	 * which is why we're disabling it.
-	 */
-#ifdef SSL_OP_NO_COMPRESSION
-	options |= SSL_OP_NO_COMPRESSION;
-#endif
-	 
-	/**
-	 * SSL_OP_TLS_BLOCK_PADDING_BUG:
-	 *
-	 * The Microsoft RDP server does *not* support TLS padding.
-	 * It absolutely needs to be disabled otherwise it won't work.
-	 */
-	options |= SSL_OP_TLS_BLOCK_PADDING_BUG;
-
-	/**
-	 * SSL_OP_DONT_INSERT_EMPTY_FRAGMENTS:
-	 *
-	 * Just like TLS padding, the Microsoft RDP server does not
-	 * support empty fragments. This needs to be disabled.
-	 */
-	options |= SSL_OP_DONT_INSERT_EMPTY_FRAGMENTS;
-
-	SSL_CTX_set_options(tls->ctx, options);
-
-	if (SSL_CTX_use_RSAPrivateKey_file(tls->ctx, privatekey_file, SSL_FILETYPE_PEM) <= 0)
-	{
-		printf("SSL_CTX_use_RSAPrivateKey_file failed\n");
 		return false;
-	}
 
 	tls->ssl = SSL_new(tls->ctx);
 
@@ -217,12 +512,6 @@ boolean tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_fi
 		return false;
 	}
 
-	if (SSL_use_certificate_file(tls->ssl, cert_file, SSL_FILETYPE_PEM) <= 0)
-	{
-		printf("SSL_use_certificate_file failed\n");
-		return false;
-	}
-
 	cert = tls_get_certificate(tls, false);
 
 	if (cert == NULL)
@@ -234,7 +523,7 @@ boolean tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_fi
 	if (!crypto_cert_get_public_key(cert, &tls->public_key))
 	{
 		printf("tls_connect: crypto_cert_get_public_key failed to return the server public key.\n");
-		tls_free_certificate(cert);
+		xfree(cert); /* the certificate belongs to the shared context */
 		return false;
 	}
 
@@ -271,7 +560,9 @@ boolean tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_fi
 		}
 	}
 
-	printf("TLS connection accepted\n");
+	tls->resumed = SSL_session_reused(tls->ssl) ? true : false;
+
+	printf("TLS connection accepted%s\n", tls->resumed ? " (session resumed)" : "");
 
 	return true;
 }
@@ -608,16 +899,41 @@ void tls_print_certificate_name_mismatch_error(char* hostname, char* common_name
 	printf("A valid certificate for the wrong name should NOT be trusted!\n");
 }
 
+static void tls_global_init(void)
+{
+	SSL_load_error_strings();
+	SSL_library_init();
+
+	tls_mutex = freerdp_mutex_new();
+}
+
+#ifdef _WIN32
+static BOOL CALLBACK tls_global_init_once(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	tls_global_init();
+	return TRUE;
+}
+#endif
+
 rdpTls* tls_new(rdpSettings* settings)
 {
 	rdpTls* tls;
+#ifdef _WIN32
+	static INIT_ONCE tls_once = INIT_ONCE_STATIC_INIT;
+#else
+	static pthread_once_t tls_once = PTHREAD_ONCE_INIT;
+#endif
 
 	tls = (rdpTls*) xzalloc(sizeof(rdpTls));
 
 	if (tls != NULL)
 	{
-		SSL_load_error_strings();
-		SSL_library_init();
+		/* server peer threads may get here at the same time */
+#ifdef _WIN32
+		InitOnceExecuteOnce(&tls_once, tls_global_init_once, NULL, NULL);
+#else
+		pthread_once(&tls_once, tls_global_init);
+#endif
 
 		tls->settings = settings;
 		tls->certificate_store = certificate_store_new(settings);
@@ -637,6 +953,7 @@ void tls_free(rdpTls* tls)
 			SSL_CTX_free(tls->ctx);
 
 		freerdp_blob_free(&tls->public_key);
+		xfree(tls->session_key);
 
 		certificate_store_free(tls->certificate_store);
 
@@ -74,6 +74,26 @@ HGDI_BRUSH gdi_CreatePatternBrush(HGDI_BITMAP hbmp)
 	return hBrush;
 }
 
+/**
+ * Create a new hatch brush.\n
+ * The hatch is an 8x8 monochrome bitmap, one byte per row, most significant
+ * bit first. Set bits are drawn in the brush color, clear bits in the
+ * background color unless the background mode is transparent.
+ * @param hbmp hatch bitmap
+ * @param crColor hatch color
+ * @return new brush
+ */
+
+HGDI_BRUSH gdi_CreateHatchBrush(HGDI_BITMAP hbmp, GDI_COLOR crColor)
+{
+	HGDI_BRUSH hBrush = (HGDI_BRUSH) xmalloc(sizeof(GDI_BRUSH));
+	hBrush->objectType = GDIOBJECT_BRUSH;
+	hBrush->style = GDI_BS_HATCHED;
+	hBrush->pattern = hbmp;
+	hBrush->color = crColor;
+	return hBrush;
+}
+
 /**
  * Perform a pattern blit operation on the given pixel buffer.\n
  * @msdn{dd162778}
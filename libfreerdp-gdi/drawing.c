@@ -115,6 +115,34 @@ int gdi_SetBkMode(HGDI_DC hdc, int iBkMode)
 	return 0;
 }
 
+/**
+ * Get the current polygon fill mode.\n
+ * @param hdc device context
+ * @return polygon fill mode
+ */
+
+int gdi_GetPolyFillMode(HGDI_DC hdc)
+{
+	return hdc->polyFillMode;
+}
+
+/**
+ * Set the current polygon fill mode.\n
+ * @param hdc device context
+ * @param iPolyFillMode polygon fill mode
+ * @return previous polygon fill mode
+ */
+
+int gdi_SetPolyFillMode(HGDI_DC hdc, int iPolyFillMode)
+{
+	int prevPolyFillMode = hdc->polyFillMode;
+
+	if (iPolyFillMode == GDI_ALTERNATE || iPolyFillMode == GDI_WINDING)
+		hdc->polyFillMode = iPolyFillMode;
+
+	return prevPolyFillMode;
+}
+
 /**
  * Set the current text color.\n
  * @msdn{dd145093}
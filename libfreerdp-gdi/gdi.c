@@ -659,24 +659,177 @@ void gdi_mem3blt(rdpContext* context, MEM3BLT_ORDER* mem3blt)
 	}
 }
 
+static GDI_POINT* gdi_polygon_points(sint32 x, sint32 y, DELTA_POINT* deltas, int numPoints)
+{
+	int i;
+	GDI_POINT* points;
+
+	points = (GDI_POINT*) xmalloc(sizeof(GDI_POINT) * (numPoints + 1));
+
+	points[0].x = x;
+	points[0].y = y;
+
+	for (i = 0; i < numPoints; i++)
+	{
+		x += deltas[i].x;
+		y += deltas[i].y;
+		points[i + 1].x = x;
+		points[i + 1].y = y;
+	}
+
+	return points;
+}
+
+static HGDI_BRUSH gdi_order_brush_new(rdpGdi* gdi, rdpBrush* brush, uint32 backColor, uint32 foreColor)
+{
+	uint8* data;
+	HGDI_BITMAP hBmp;
+
+	if (brush->style == GDI_BS_SOLID)
+	{
+		foreColor = freerdp_color_convert_rgb(foreColor, gdi->srcBpp, 32, gdi->clrconv);
+		return gdi_CreateSolidBrush(foreColor);
+	}
+	else if (brush->style == GDI_BS_PATTERN)
+	{
+		if (brush->bpp > 1)
+		{
+			data = freerdp_image_convert(brush->data, NULL, 8, 8, gdi->srcBpp, gdi->dstBpp, gdi->clrconv);
+			hBmp = gdi_CreateBitmap(8, 8, gdi->drawing->hdc->bitsPerPixel, data);
+			return gdi_CreatePatternBrush(hBmp);
+		}
+
+		/* set bits are drawn in the back color, as freerdp_mono_image_convert() does */
+		data = (uint8*) xmalloc(8);
+		memcpy(data, brush->data, 8);
+		hBmp = gdi_CreateBitmap(8, 8, 1, data);
+
+		backColor = freerdp_color_convert_rgb(backColor, gdi->srcBpp, 32, gdi->clrconv);
+		foreColor = freerdp_color_convert_rgb(foreColor, gdi->srcBpp, 32, gdi->clrconv);
+		gdi_SetBkColor(gdi->drawing->hdc, foreColor);
+
+		return gdi_CreateHatchBrush(hBmp, backColor);
+	}
+
+	printf("unimplemented brush style:%d\n", brush->style);
+
+	return NULL;
+}
+
+static void gdi_draw_polygon(rdpGdi* gdi, HGDI_BRUSH hBrush, uint32 bRop2, uint32 fillMode,
+		sint32 xStart, sint32 yStart, DELTA_POINT* deltas, int numPoints)
+{
+	HGDI_PEN hPen;
+	GDI_POINT* points;
+	HGDI_BRUSH originalBrush;
+	HGDI_DC hdc = gdi->drawing->hdc;
+
+	points = gdi_polygon_points(xStart, yStart, deltas, numPoints);
+
+	hPen = gdi_CreatePen(GDI_PS_NULL, 1, 0);
+	gdi_SelectObject(hdc, (HGDIOBJECT) hPen);
+	originalBrush = hdc->brush;
+	hdc->brush = hBrush;
+
+	gdi_SetROP2(hdc, bRop2);
+	gdi_SetPolyFillMode(hdc, fillMode);
+	gdi_Polygon(hdc, points, numPoints + 1);
+
+	hdc->brush = originalBrush;
+	gdi_DeleteObject((HGDIOBJECT) hBrush);
+	gdi_DeleteObject((HGDIOBJECT) hPen);
+	xfree(points);
+}
+
 void gdi_polygon_sc(rdpContext* context, POLYGON_SC_ORDER* polygon_sc)
 {
-	printf("PolygonSC\n");
+	uint32 color;
+	HGDI_BRUSH hBrush;
+	rdpGdi* gdi = context->gdi;
+
+	color = freerdp_color_convert_rgb(polygon_sc->brushColor, gdi->srcBpp, 32, gdi->clrconv);
+	hBrush = gdi_CreateSolidBrush(color);
+
+	gdi_draw_polygon(gdi, hBrush, polygon_sc->bRop2, polygon_sc->fillMode,
+			polygon_sc->xStart, polygon_sc->yStart, polygon_sc->points, polygon_sc->numPoints);
 }
 
 void gdi_polygon_cb(rdpContext* context, POLYGON_CB_ORDER* polygon_cb)
 {
-	printf("PolygonCB\n");
+	HGDI_BRUSH hBrush;
+	rdpGdi* gdi = context->gdi;
+
+	hBrush = gdi_order_brush_new(gdi, &polygon_cb->brush, polygon_cb->backColor, polygon_cb->foreColor);
+	gdi_SetBkMode(gdi->drawing->hdc, (polygon_cb->backMode == BACKMODE_TRANSPARENT) ? GDI_TRANSPARENT : GDI_OPAQUE);
+
+	gdi_draw_polygon(gdi, hBrush, polygon_cb->bRop2, polygon_cb->fillMode,
+			polygon_cb->xStart, polygon_cb->yStart, polygon_cb->points, polygon_cb->numPoints);
+}
+
+/**
+ * Ellipses with a fill mode are filled with the brush, the others are only
+ * outlined with the color.
+ */
+
+static void gdi_draw_ellipse(rdpGdi* gdi, HGDI_BRUSH hBrush, uint32 color, uint32 bRop2,
+		sint32 left, sint32 top, sint32 right, sint32 bottom)
+{
+	HGDI_PEN hPen;
+	HGDI_BRUSH originalBrush;
+	HGDI_DC hdc = gdi->drawing->hdc;
+
+	if (hBrush != NULL)
+		hPen = gdi_CreatePen(GDI_PS_NULL, 1, 0);
+	else
+		hPen = gdi_CreatePen(GDI_PS_SOLID, 1, (GDI_COLOR) color);
+
+	gdi_SelectObject(hdc, (HGDIOBJECT) hPen);
+	originalBrush = hdc->brush;
+	hdc->brush = hBrush;
+
+	gdi_SetROP2(hdc, bRop2);
+	gdi_Ellipse(hdc, left, top, right, bottom);
+
+	hdc->brush = originalBrush;
+	gdi_DeleteObject((HGDIOBJECT) hBrush);
+	gdi_DeleteObject((HGDIOBJECT) hPen);
 }
 
 void gdi_ellipse_sc(rdpContext* context, ELLIPSE_SC_ORDER* ellipse_sc)
 {
-	printf("EllipseSC\n");
+	uint32 color;
+	HGDI_BRUSH hBrush = NULL;
+	rdpGdi* gdi = context->gdi;
+
+	color = freerdp_color_convert_rgb(ellipse_sc->color, gdi->srcBpp, 32, gdi->clrconv);
+
+	if (ellipse_sc->fillMode != 0)
+		hBrush = gdi_CreateSolidBrush(color);
+
+	gdi_draw_ellipse(gdi, hBrush, color, ellipse_sc->bRop2,
+			ellipse_sc->leftRect, ellipse_sc->topRect, ellipse_sc->rightRect, ellipse_sc->bottomRect);
 }
 
 void gdi_ellipse_cb(rdpContext* context, ELLIPSE_CB_ORDER* ellipse_cb)
 {
-	printf("EllipseCB\n");
+	uint32 color;
+	HGDI_BRUSH hBrush = NULL;
+	rdpGdi* gdi = context->gdi;
+
+	color = freerdp_color_convert_rgb(ellipse_cb->foreColor, gdi->srcBpp, 32, gdi->clrconv);
+
+	if (ellipse_cb->fillMode != 0)
+	{
+		hBrush = gdi_order_brush_new(gdi, &ellipse_cb->brush, ellipse_cb->backColor, ellipse_cb->foreColor);
+
+		if (hBrush == NULL)
+			return;
+
+		gdi_SetBkMode(gdi->drawing->hdc, GDI_OPAQUE);
+	}
+
+	gdi_draw_ellipse(gdi, hBrush, color, ellipse_cb->bRop2,
+			ellipse_cb->leftRect, ellipse_cb->topRect, ellipse_cb->rightRect, ellipse_cb->bottomRect);
 }
 
 int tilenum = 0;
@@ -685,6 +838,7 @@ void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_co
 {
 	int i, j;
 	int tx, ty;
+	uint64 start;
 	char* tile_bitmap;
 	RFX_MESSAGE* message;
 	rdpGdi* gdi = context->gdi;
@@ -699,6 +853,8 @@ void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_co
 		surface_bits_command->width, surface_bits_command->height,
 		surface_bits_command->bitmapDataLength);
 
+	start = METRICS_START(context->metrics);
+
 	tile_bitmap = (char*) xzalloc(32);
 
 	if (surface_bits_command->codecID == CODEC_ID_REMOTEFX)
@@ -789,6 +945,8 @@ void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_co
 
 	if (tile_bitmap != NULL)
 		xfree(tile_bitmap);
+
+	metrics_record_since(context->metrics, METRICS_GDI_SURFACE_BITS, start);
 }
 
 /**
@@ -859,6 +1017,7 @@ void gdi_resize(rdpGdi* gdi, int width, int height)
 			gdi->width = width;
 			gdi->height = height;
 			gdi_bitmap_free_ex(gdi->primary);
+			gdi->primary_buffer = NULL;
 			gdi_init_primary(gdi);
 		}
 	}
@@ -959,6 +1118,9 @@ int gdi_init(freerdp* instance, uint32 flags, uint8* buffer)
 	gdi->rfx_context = rfx_context_new();
 	gdi->nsc_context = nsc_context_new();
 
+	((RFX_CONTEXT*) gdi->rfx_context)->metrics = instance->context->metrics;
+	((NSC_CONTEXT*) gdi->nsc_context)->metrics = instance->context->metrics;
+
 	return 0;
 }
 
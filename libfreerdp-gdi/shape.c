@@ -26,7 +26,11 @@
 #include <freerdp/gdi/8bpp.h>
 #include <freerdp/gdi/16bpp.h>
 #include <freerdp/gdi/32bpp.h>
+#include <freerdp/gdi/line.h>
 #include <freerdp/gdi/bitmap.h>
+#include <freerdp/gdi/region.h>
+#include <freerdp/gdi/drawing.h>
+#include <freerdp/utils/memory.h>
 
 #include <freerdp/gdi/shape.h>
 
@@ -39,128 +43,561 @@ p_FillRect FillRect_[5] =
 	FillRect_32bpp
 };
 
-static void Ellipse_Bresenham(HGDI_DC hdc, int x1, int y1, int x2, int y2)
+/**
+ * Shapes are drawn as horizontal spans of pixels, each span goes through the
+ * binary raster operation of the device context and is clipped to its clipping
+ * region. The source of a span is either the selected brush or, for outlines,
+ * the color of the selected pen.
+ */
+
+struct _GDI_SPAN_FILL
+{
+	HGDI_DC hdc;
+	GDI_RECT clip;
+	HGDI_BRUSH brush;
+	uint32 color;
+	uint32 bkColor;
+	boolean transparent;
+};
+typedef struct _GDI_SPAN_FILL GDI_SPAN_FILL;
+
+struct _GDI_EDGE
+{
+	int x1;
+	int y1;
+	int x2;
+	int y2;
+	int dir;
+};
+typedef struct _GDI_EDGE GDI_EDGE;
+
+struct _GDI_CROSSING
+{
+	int x;
+	int dir;
+};
+typedef struct _GDI_CROSSING GDI_CROSSING;
+
+static INLINE uint32 gdi_rop2(int rop2, uint32 dst, uint32 pen)
+{
+	uint32 result = 0;
+
+	/* the low four bits of (rop2 - 1) are the truth table for (P, D) */
+	rop2--;
+
+	if (rop2 & 0x01)
+		result |= ~pen & ~dst;
+	if (rop2 & 0x02)
+		result |= ~pen & dst;
+	if (rop2 & 0x04)
+		result |= pen & ~dst;
+	if (rop2 & 0x08)
+		result |= pen & dst;
+
+	return result;
+}
+
+static INLINE uint32 gdi_read_pixel(uint8* p, int bpp)
+{
+	if (bpp == 4)
+		return *((uint32*) p);
+	else if (bpp == 2)
+		return *((uint16*) p);
+
+	return *p;
+}
+
+static INLINE void gdi_write_pixel(uint8* p, int bpp, uint32 pixel)
+{
+	if (bpp == 4)
+		*((uint32*) p) = pixel;
+	else if (bpp == 2)
+		*((uint16*) p) = (uint16) pixel;
+	else
+		*p = (uint8) pixel;
+}
+
+static uint32 gdi_get_color(HGDI_DC hdc, GDI_COLOR color)
+{
+	if (hdc->bitsPerPixel == 32)
+		return gdi_get_color_32bpp(hdc, color);
+	else if (hdc->bitsPerPixel == 16 || hdc->bitsPerPixel == 15)
+		return gdi_get_color_16bpp(hdc, color);
+
+	return gdi_get_color_8bpp(hdc, color);
+}
+
+static boolean gdi_get_clip_rect(HGDI_DC hdc, GDI_RECT* clip)
+{
+	GDI_RECT rgn;
+	HGDI_BITMAP hBmp = (HGDI_BITMAP) hdc->selectedObject;
+
+	gdi_CRgnToRect(0, 0, hBmp->width, hBmp->height, clip);
+
+	if (!hdc->clip->null)
+	{
+		gdi_RgnToRect(hdc->clip, &rgn);
+
+		if (rgn.left > clip->left)
+			clip->left = rgn.left;
+		if (rgn.top > clip->top)
+			clip->top = rgn.top;
+		if (rgn.right < clip->right)
+			clip->right = rgn.right;
+		if (rgn.bottom < clip->bottom)
+			clip->bottom = rgn.bottom;
+	}
+
+	return (clip->left <= clip->right && clip->top <= clip->bottom) ? true : false;
+}
+
+static INLINE boolean gdi_has_brush(HGDI_DC hdc)
+{
+	return (hdc->brush != NULL && hdc->brush->style != GDI_BS_NULL) ? true : false;
+}
+
+static INLINE boolean gdi_has_pen(HGDI_DC hdc)
+{
+	return (hdc->pen != NULL && hdc->pen->style != GDI_PS_NULL) ? true : false;
+}
+
+static void gdi_span_fill_brush(GDI_SPAN_FILL* fill)
+{
+	HGDI_DC hdc = fill->hdc;
+
+	fill->brush = hdc->brush;
+	fill->color = 0;
+
+	/* pattern brushes carry their own pixels, only these have a color */
+	if (hdc->brush->style == GDI_BS_SOLID || hdc->brush->style == GDI_BS_HATCHED)
+		fill->color = gdi_get_color(hdc, hdc->brush->color);
+
+	fill->bkColor = gdi_get_color(hdc, hdc->bkColor);
+	fill->transparent = (hdc->bkMode == GDI_TRANSPARENT) ? true : false;
+}
+
+static void gdi_span_fill_pen(GDI_SPAN_FILL* fill)
 {
-	int i;
-	long e, e2;
-	long dx, dy;
-	int a, b, c;
+	/* pen colors are converted like brush colors, so outlines match fills */
+	fill->brush = NULL;
+	fill->color = gdi_get_color(fill->hdc, fill->hdc->pen->color);
+}
 
-	HGDI_BITMAP bmp;
-	uint8 pixel8;
-	uint16 pixel16;
-	uint32 pixel32;
-	int bpp = hdc->bitsPerPixel;
+static void gdi_FillSpan(GDI_SPAN_FILL* fill, int x1, int x2, int y)
+{
+	int x;
+	uint8* dstp;
+	uint8* patp;
+	uint32 src;
+	uint8 hatch = 0;
+	HGDI_DC hdc = fill->hdc;
+	HGDI_BRUSH brush = fill->brush;
+	int bpp = hdc->bytesPerPixel;
+	int rop2 = gdi_GetROP2(hdc);
 
-	a = (x1 < x2) ? x2 - x1 : x1 - x2;
-	b = (y1 < y2) ? y2 - y1 : y1 - y2;
-	c = b & 1;
+	if (y < fill->clip.top || y > fill->clip.bottom)
+		return;
 
-	dx = 4 * (1 - a) * b * b;
-	dy = 4 * (c + 1) * a * a;
-	e = dx + dy + c * a * a;
+	if (x1 < fill->clip.left)
+		x1 = fill->clip.left;
+
+	if (x2 > fill->clip.right)
+		x2 = fill->clip.right;
 
 	if (x1 > x2)
+		return;
+
+	dstp = gdi_get_bitmap_pointer(hdc, x1, y);
+
+	if (dstp == NULL)
+		return;
+
+	if (brush != NULL && brush->style == GDI_BS_HATCHED)
+		hatch = brush->pattern->data[y & 7];
+
+	src = fill->color;
+
+	for (x = x1; x <= x2; x++, dstp += bpp)
 	{
-		x1 = x2;
-		x2 += a;
+		if (brush != NULL && brush->style == GDI_BS_PATTERN)
+		{
+			patp = gdi_get_brush_pointer(hdc, x, y);
+			src = gdi_read_pixel(patp, bpp);
+		}
+		else if (brush != NULL && brush->style == GDI_BS_HATCHED)
+		{
+			if (hatch & (0x80 >> (x & 7)))
+				src = fill->color;
+			else if (fill->transparent)
+				continue;
+			else
+				src = fill->bkColor;
+		}
+
+		gdi_write_pixel(dstp, bpp, gdi_rop2(rop2, gdi_read_pixel(dstp, bpp), src));
 	}
+}
 
-	if (y1 > y2)
-		y1 = y2;
+static void gdi_invalidate_bounds(GDI_SPAN_FILL* fill, int left, int top, int right, int bottom)
+{
+	if (left < fill->clip.left)
+		left = fill->clip.left;
+	if (top < fill->clip.top)
+		top = fill->clip.top;
+	if (right > fill->clip.right)
+		right = fill->clip.right;
+	if (bottom > fill->clip.bottom)
+		bottom = fill->clip.bottom;
 
-	y1 += (b + 1) / 2;
-	y2 = y1 - c;
+	if (left <= right && top <= bottom)
+		gdi_InvalidateRegion(fill->hdc, left, top, right - left + 1, bottom - top + 1);
+}
 
-	a *= 8 * a;
-	c = 8 * b * b;
+static uint32 gdi_isqrt(uint64 n)
+{
+	uint64 root = 0;
+	uint64 bit = ((uint64) 1) << 62;
 
-	pixel8 = 0;
-	pixel16 = 0;
-	pixel32 = 0;
-	bmp = (HGDI_BITMAP) hdc->selectedObject;
+	while (bit > n)
+		bit >>= 2;
 
-	do
+	while (bit != 0)
 	{
-		if (bpp == 32)
+		if (n >= root + bit)
 		{
-			gdi_SetPixel_32bpp(bmp, x2, y1, pixel32);
-			gdi_SetPixel_32bpp(bmp, x1, y1, pixel32);
-			gdi_SetPixel_32bpp(bmp, x1, y2, pixel32);
-			gdi_SetPixel_32bpp(bmp, x2, y2, pixel32);
+			n -= root + bit;
+			root = (root >> 1) + bit;
 		}
-		else if (bpp == 16)
+		else
 		{
-			gdi_SetPixel_16bpp(bmp, x2, y1, pixel16);
-			gdi_SetPixel_16bpp(bmp, x1, y1, pixel16);
-			gdi_SetPixel_16bpp(bmp, x1, y2, pixel16);
-			gdi_SetPixel_16bpp(bmp, x2, y2, pixel16);
+			root >>= 1;
 		}
-		else if (bpp == 8)
+
+		bit >>= 2;
+	}
+
+	return (uint32) root;
+}
+
+/**
+ * Compute the horizontal extent of every row of the ellipse inscribed in the
+ * given inclusive rectangle. A pixel is inside when its center is inside the
+ * ellipse touching the outer edges of the rectangle, rows are kept symmetric
+ * around the center of the rectangle.
+ */
+
+static void gdi_ellipse_spans(int left, int top, int right, int bottom, int* xl, int* xr)
+{
+	int y;
+	sint64 k;
+	sint64 dy;
+	uint64 s;
+	uint64 a = right - left + 1;
+	uint64 b = bottom - top + 1;
+
+	for (y = top; y <= bottom; y++)
+	{
+		/* in doubled coordinates: x^2 * b^2 + dy^2 * a^2 <= a^2 * b^2 */
+		dy = 2 * y - (top + bottom);
+		s = (a * a * (b * b - (uint64) (dy * dy))) / (b * b);
+		k = gdi_isqrt(s);
+
+		/* x in doubled coordinates has the parity of the width minus one */
+		if ((k ^ (a - 1)) & 1)
+			k--;
+
+		if (k < 0)
+			k = 1;
+
+		xl[y - top] = (int) ((left + right - k) / 2);
+		xr[y - top] = (int) ((left + right + k) / 2);
+	}
+}
+
+static int gdi_compare_edges(const void* a, const void* b)
+{
+	return ((GDI_EDGE*) a)->y1 - ((GDI_EDGE*) b)->y1;
+}
+
+/**
+ * First pixel at or right of the crossing of an edge with the center of row y,
+ * so that a span covers the pixels whose centers are inside the polygon.
+ */
+
+static INLINE int gdi_edge_crossing(GDI_EDGE* edge, int y)
+{
+	sint64 num;
+	sint64 den;
+
+	den = 2 * (sint64) (edge->y2 - edge->y1);
+	num = 2 * (sint64) edge->x1 * (edge->y2 - edge->y1)
+		+ (sint64) (edge->x2 - edge->x1) * (2 * (y - edge->y1) + 1)
+		- (edge->y2 - edge->y1);
+
+	if (num >= 0)
+		return (int) ((num + den - 1) / den);
+
+	return (int) -((-num) / den);
+}
+
+static void gdi_fill_polygons(GDI_SPAN_FILL* fill, GDI_POINT* lpPoints, int* lpPolyCounts, int nCount)
+{
+	int i, j;
+	int x, y;
+	int next;
+	int nEdges;
+	int nActive;
+	int winding;
+	int left, top;
+	int right, bottom;
+	GDI_EDGE* edge;
+	GDI_EDGE* edges;
+	GDI_EDGE** active;
+	GDI_POINT* points;
+	GDI_POINT* p1;
+	GDI_POINT* p2;
+	GDI_CROSSING* crossings;
+
+	nEdges = 0;
+
+	for (i = 0; i < nCount; i++)
+	{
+		if (lpPolyCounts[i] > 0)
+			nEdges += lpPolyCounts[i];
+	}
+
+	if (nEdges < 1)
+		return;
+
+	edges = (GDI_EDGE*) xmalloc(sizeof(GDI_EDGE) * nEdges);
+	points = lpPoints;
+	nEdges = 0;
+
+	left = right = lpPoints[0].x;
+
+	/* build the edge table, horizontal edges never cross a row center */
+	for (i = 0; i < nCount; i++)
+	{
+		if (lpPolyCounts[i] < 1)
+			continue;
+
+		for (j = 0; j < lpPolyCounts[i]; j++)
 		{
-			for (i = x1; i < x2; i++)
+			p1 = &points[j];
+			p2 = &points[(j + 1) % lpPolyCounts[i]];
+
+			left = MIN(left, p1->x);
+			right = MAX(right, p1->x);
+
+			if (p1->y == p2->y)
+				continue;
+
+			edge = &edges[nEdges++];
+
+			if (p1->y < p2->y)
 			{
-				gdi_SetPixel_8bpp(bmp, i, y1, pixel8);
-				gdi_SetPixel_8bpp(bmp, i, y2, pixel8);
+				edge->x1 = p1->x;
+				edge->y1 = p1->y;
+				edge->x2 = p2->x;
+				edge->y2 = p2->y;
+				edge->dir = 1;
 			}
-
-			for (i = y1; i < y2; i++)
+			else
 			{
-				gdi_SetPixel_8bpp(bmp, x1, i, pixel8);
-				gdi_SetPixel_8bpp(bmp, x2, i, pixel8);
+				edge->x1 = p2->x;
+				edge->y1 = p2->y;
+				edge->x2 = p1->x;
+				edge->y2 = p1->y;
+				edge->dir = -1;
 			}
 		}
 
-		e2 = 2 * e;
+		points += lpPolyCounts[i];
+	}
+
+	if (nEdges < 1)
+	{
+		xfree(edges);
+		return;
+	}
+
+	qsort(edges, nEdges, sizeof(GDI_EDGE), gdi_compare_edges);
+
+	top = edges[0].y1;
+	bottom = edges[0].y2;
+
+	for (i = 1; i < nEdges; i++)
+		bottom = MAX(bottom, edges[i].y2);
+
+	/* rows are sampled at their center, the last one is above the lowest vertex */
+	bottom--;
+
+	active = (GDI_EDGE**) xmalloc(sizeof(GDI_EDGE*) * nEdges);
+	crossings = (GDI_CROSSING*) xmalloc(sizeof(GDI_CROSSING) * nEdges);
+
+	next = 0;
+	nActive = 0;
 
-		if (e2 >= dx)
+	for (y = MAX(top, fill->clip.top); y <= MIN(bottom, fill->clip.bottom); y++)
+	{
+		/* drop the edges ending above this row, then add the ones reaching it */
+		for (i = 0, j = 0; i < nActive; i++)
 		{
-			x1++;
-			x2--;
-			e += dx += c;
+			if (active[i]->y2 > y)
+				active[j++] = active[i];
 		}
 
-		if (e2 <= dy)
+		nActive = j;
+
+		while (next < nEdges && edges[next].y1 <= y)
 		{
-			y1++;
-			y2--;
-			e += dy += a;
+			if (edges[next].y2 > y)
+				active[nActive++] = &edges[next];
+
+			next++;
 		}
-	}
-	while (x1 <= x2);
 
-	while (y1 - y2 < b)
-	{
-		if (bpp == 32)
+		/* crossings with the row center, sorted from left to right */
+		for (i = 0; i < nActive; i++)
 		{
-			gdi_SetPixel_32bpp(bmp, x1 - 1, ++y1, pixel32);
-			gdi_SetPixel_32bpp(bmp, x1 - 1, --y2, pixel32);
+			x = gdi_edge_crossing(active[i], y);
+
+			for (j = i; j > 0 && crossings[j - 1].x > x; j--)
+				crossings[j] = crossings[j - 1];
+
+			crossings[j].x = x;
+			crossings[j].dir = active[i]->dir;
 		}
-		else if (bpp == 16)
+
+		if (gdi_GetPolyFillMode(fill->hdc) == GDI_WINDING)
 		{
-			gdi_SetPixel_16bpp(bmp, x1 - 1, ++y1, pixel16);
-			gdi_SetPixel_16bpp(bmp, x1 - 1, --y2, pixel16);
+			winding = 0;
+
+			for (i = 0; i < nActive; i++)
+			{
+				if (winding == 0)
+					x = crossings[i].x;
+
+				winding += crossings[i].dir;
+
+				if (winding == 0)
+					gdi_FillSpan(fill, x, crossings[i].x - 1, y);
+			}
 		}
-		else if (bpp == 8)
+		else
 		{
-			gdi_SetPixel_8bpp(bmp, x1 - 1, ++y1, pixel8);
-			gdi_SetPixel_8bpp(bmp, x1 - 1, --y2, pixel8);
+			for (i = 0; i + 1 < nActive; i += 2)
+				gdi_FillSpan(fill, crossings[i].x, crossings[i + 1].x - 1, y);
 		}
 	}
+
+	gdi_invalidate_bounds(fill, left, top, right - 1, bottom);
+
+	xfree(crossings);
+	xfree(active);
+	xfree(edges);
 }
 
 /**
- * Draw an ellipse
+ * Draw an ellipse, outlined with the current pen and filled with the current brush.
+ * The bounding rectangle excludes its right and bottom edges.
  * @param hdc device context
  * @param nLeftRect x1
  * @param nTopRect y1
  * @param nRightRect x2
  * @param nBottomRect y2
- * @return
+ * @return 1 if successful, 0 otherwise
  */
 int gdi_Ellipse(HGDI_DC hdc, int nLeftRect, int nTopRect, int nRightRect, int nBottomRect)
 {
-	Ellipse_Bresenham(hdc, nLeftRect, nTopRect, nRightRect, nBottomRect);
+	int i, y;
+	int rows;
+	int nl, nr;
+	int il, ir;
+	int* xl;
+	int* xr;
+	int left, top;
+	int right, bottom;
+	boolean brush, pen;
+	GDI_SPAN_FILL penFill;
+	GDI_SPAN_FILL brushFill;
+
+	left = MIN(nLeftRect, nRightRect);
+	top = MIN(nTopRect, nBottomRect);
+	right = MAX(nLeftRect, nRightRect) - 1;
+	bottom = MAX(nTopRect, nBottomRect) - 1;
+
+	if (right < left || bottom < top)
+		return 1;
+
+	if (right - left >= 0xFFFF || bottom - top >= 0xFFFF)
+		return 0;
+
+	brush = gdi_has_brush(hdc);
+	pen = gdi_has_pen(hdc);
+
+	penFill.hdc = hdc;
+
+	if (!gdi_get_clip_rect(hdc, &penFill.clip) || (!brush && !pen))
+		return 1;
+
+	brushFill = penFill;
+
+	if (pen)
+		gdi_span_fill_pen(&penFill);
+
+	if (brush)
+		gdi_span_fill_brush(&brushFill);
+
+	rows = bottom - top + 1;
+	xl = (int*) xmalloc(sizeof(int) * rows);
+	xr = (int*) xmalloc(sizeof(int) * rows);
+
+	gdi_ellipse_spans(left, top, right, bottom, xl, xr);
+
+	for (i = 0; i < rows; i++)
+	{
+		y = top + i;
+
+		if (!pen)
+		{
+			gdi_FillSpan(&brushFill, xl[i], xr[i], y);
+			continue;
+		}
+
+		/* the outline is what is left of a row once its interior is removed */
+		if (i == 0 || i == rows - 1)
+		{
+			il = xr[i] + 1;
+			ir = xl[i] - 1;
+		}
+		else
+		{
+			nl = MAX(xl[i - 1], xl[i + 1]);
+			nr = MIN(xr[i - 1], xr[i + 1]);
+			il = MAX(xl[i] + 1, nl);
+			ir = MIN(xr[i] - 1, nr);
+		}
+
+		if (il > ir)
+		{
+			gdi_FillSpan(&penFill, xl[i], xr[i], y);
+		}
+		else
+		{
+			gdi_FillSpan(&penFill, xl[i], il - 1, y);
+			gdi_FillSpan(&penFill, ir + 1, xr[i], y);
+
+			if (brush)
+				gdi_FillSpan(&brushFill, il, ir, y);
+		}
+	}
+
+	gdi_invalidate_bounds(&penFill, left, top, right, bottom);
+
+	xfree(xl);
+	xfree(xr);
+
 	return 1;
 }
 
@@ -184,15 +621,16 @@ int gdi_FillRect(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr)
 }
 
 /**
- *
+ * Draw a closed polygon, outlined with the current pen and filled with the current
+ * brush according to the current polygon fill mode.
  * @param hdc device context
  * @param lpPoints array of points
  * @param nCount number of points
- * @return
+ * @return 1 if successful, 0 otherwise
  */
 int gdi_Polygon(HGDI_DC hdc, GDI_POINT *lpPoints, int nCount)
 {
-	return 1;
+	return gdi_PolyPolygon(hdc, lpPoints, &nCount, 1);
 }
 
 /**
@@ -201,10 +639,54 @@ int gdi_Polygon(HGDI_DC hdc, GDI_POINT *lpPoints, int nCount)
  * @param lpPoints array of series of points
  * @param lpPolyCounts array of number of points in each series
  * @param nCount count of number of points in lpPolyCounts
- * @return
+ * @return 1 if successful, 0 otherwise
  */
 int gdi_PolyPolygon(HGDI_DC hdc, GDI_POINT *lpPoints, int *lpPolyCounts, int nCount)
 {
+	int i, j;
+	int posX, posY;
+	GDI_POINT* points;
+	GDI_SPAN_FILL fill;
+
+	fill.hdc = hdc;
+
+	if (nCount < 1 || !gdi_get_clip_rect(hdc, &fill.clip))
+		return 1;
+
+	if (gdi_has_brush(hdc))
+	{
+		gdi_span_fill_brush(&fill);
+		gdi_fill_polygons(&fill, lpPoints, lpPolyCounts, nCount);
+	}
+
+	if (gdi_has_pen(hdc))
+	{
+		/* drawing the outline does not move the current position */
+		posX = hdc->pen->posX;
+		posY = hdc->pen->posY;
+		points = lpPoints;
+
+		for (i = 0; i < nCount; i++)
+		{
+			if (lpPolyCounts[i] < 1)
+				continue;
+
+			gdi_MoveToEx(hdc, points[0].x, points[0].y, NULL);
+
+			for (j = 1; j < lpPolyCounts[i]; j++)
+			{
+				gdi_LineTo(hdc, points[j].x, points[j].y);
+				gdi_MoveToEx(hdc, points[j].x, points[j].y, NULL);
+			}
+
+			gdi_LineTo(hdc, points[0].x, points[0].y);
+			points += lpPolyCounts[i];
+		}
+
+		hdc->pen->posX = posX;
+		hdc->pen->posY = posY;
+	}
+
 	return 1;
 }
 
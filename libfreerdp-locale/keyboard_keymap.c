@@ -29,61 +29,26 @@
 #include "config.h"
 #include "liblocale.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 extern const RDP_SCANCODE VIRTUAL_KEY_CODE_TO_DEFAULT_RDP_SCANCODE_TABLE[256];
 
-int freerdp_keyboard_load_map(uint32 keycode_to_vkcode[256], char* name)
+static int freerdp_keyboard_load_map_from_file(uint32 keycode_to_vkcode[256], FILE* fp, char* keymap_name)
 {
-	FILE* fp;
 	char* pch;
 	char* beg;
 	char* end;
 	uint32 vkcode;
 	int kbd_found = 0;
-	char* keymap_path;
 	uint32 keycode = 0;
 	char buffer[1024] = "";
-	char keymap_name[256] = "";
 	char keymap_include[256] = "";
-	char keymap_filename[256] = "";
 	char keycode_string[32] = "";
 	char vkcode_name[128] = "";
 
-	beg = name;
-
-	/* Extract file name and keymap name */
-	if ((end = strrchr(name, '(')) != NULL)
-	{
-		strncpy(keymap_filename, &name[beg - name], end - beg);
-
-		beg = end + 1;
-		if ((end = strrchr(name, ')')) != NULL)
-		{
-			strncpy(keymap_name, &name[beg - name], end - beg);
-			keymap_name[end - beg] = '\0';
-		}
-	}
-	else
-	{
-		/* The keyboard name is the same as the file name */
-		strcpy(keymap_filename, name);
-		strcpy(keymap_name, name);
-	}
-
-	keymap_path = freerdp_construct_path(FREERDP_KEYMAP_PATH, keymap_filename);
-
-	DEBUG_KBD("Loading keymap %s, first trying %s", name, keymap_path);
-
-	if ((fp = fopen(keymap_path, "r")) == NULL)
-	{
-		DEBUG_KBD("%s not found", keymap_path);
-		xfree(keymap_path);
-		return 0;
-	}
-	xfree(keymap_path);
-
 	while (fgets(buffer, sizeof(buffer), fp) != NULL)
 	{
 		if (buffer[0] == '#')
@@ -163,19 +128,102 @@ int freerdp_keyboard_load_map(uint32 keycode_to_vkcode[256], char* name)
 				break;
 
 			pch = beg;
-			buffer[end - beg] = '\0';
+			*end = '\0';
 
 			/* Does it match our keymap name? */
-			if (strncmp(keymap_name, pch, strlen(keymap_name)) == 0)
+			if (strcmp(keymap_name, pch) == 0)
 				kbd_found = 1;
 		}
 	}
 
-	fclose(fp); /* Don't forget to close file */
+	return 1;
+}
+
+static int freerdp_keyboard_compare_keymap(const void* name, const void* keymap)
+{
+	return strcmp((const char*) name, ((const FREERDP_KEYMAP*) keymap)->name);
+}
+
+static int freerdp_keyboard_load_compiled_map(uint32 keycode_to_vkcode[256], char* keymap_filename, char* keymap_name)
+{
+	int keycode;
+	char name[520];
+	const FREERDP_KEYMAP* keymap;
+
+	snprintf(name, sizeof(name), "%s(%s)", keymap_filename, keymap_name);
+
+	keymap = (const FREERDP_KEYMAP*) bsearch(name, FREERDP_COMPILED_KEYMAPS, FREERDP_COMPILED_KEYMAP_COUNT,
+			sizeof(FREERDP_KEYMAP), freerdp_keyboard_compare_keymap);
+
+	if (keymap == NULL)
+	{
+		DEBUG_KBD("%s not found", name);
+		return 0;
+	}
+
+	/* the maps it extends are already applied */
+	for (keycode = 0; keycode < 256; keycode++)
+	{
+		if (keymap->keycode_to_vkcode[keycode] != 0)
+			keycode_to_vkcode[keycode] = keymap->keycode_to_vkcode[keycode];
+	}
 
 	return 1;
 }
 
+int freerdp_keyboard_load_map(uint32 keycode_to_vkcode[256], char* name)
+{
+	FILE* fp;
+	int status;
+	char* beg;
+	char* end;
+	char* keymap_path;
+	char keymap_name[256] = "";
+	char keymap_filename[256] = "";
+
+	beg = name;
+
+	/* Extract file name and keymap name */
+	if ((end = strrchr(name, '(')) != NULL)
+	{
+		strncpy(keymap_filename, &name[beg - name], end - beg);
+
+		beg = end + 1;
+		if ((end = strrchr(name, ')')) != NULL)
+		{
+			strncpy(keymap_name, &name[beg - name], end - beg);
+			keymap_name[end - beg] = '\0';
+		}
+	}
+	else
+	{
+		/* The keyboard name is the same as the file name */
+		strcpy(keymap_filename, name);
+		strcpy(keymap_name, name);
+	}
+
+	/* keymap files installed in the keymap path override the compiled keymaps */
+	keymap_path = freerdp_construct_path(FREERDP_KEYMAP_PATH, keymap_filename);
+	fp = fopen(keymap_path, "r");
+
+	if (fp != NULL)
+	{
+		DEBUG_KBD("Loading keymap %s from %s", name, keymap_path);
+		xfree(keymap_path);
+
+		status = freerdp_keyboard_load_map_from_file(keycode_to_vkcode, fp, keymap_name);
+		fclose(fp);
+
+		return status;
+	}
+
+	xfree(keymap_path);
+
+	DEBUG_KBD("Loading compiled keymap %s", name);
+
+	return freerdp_keyboard_load_compiled_map(keycode_to_vkcode, keymap_filename, keymap_name);
+}
+
 void freerdp_keyboard_load_maps(uint32 keycode_to_vkcode[256], char* names)
 {
 	char* kbd;
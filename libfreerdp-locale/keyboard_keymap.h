@@ -22,6 +22,21 @@
 
 #include <freerdp/types.h>
 
+/**
+ * Keymaps compiled into the library by cmake/GenerateKeymaps.cmake, sorted
+ * by "file(keyboard)" name. Keycodes a keymap does not define map to 0.
+ */
+
+struct _FREERDP_KEYMAP
+{
+	const char* name;
+	const uint8* keycode_to_vkcode;
+};
+typedef struct _FREERDP_KEYMAP FREERDP_KEYMAP;
+
+extern const FREERDP_KEYMAP FREERDP_COMPILED_KEYMAPS[];
+extern const int FREERDP_COMPILED_KEYMAP_COUNT;
+
 int freerdp_keyboard_load_map(uint32 keycode_to_vkcode[256], char* name);
 void freerdp_keyboard_load_maps(uint32 keycode_to_vkcode[256], char* names);
 
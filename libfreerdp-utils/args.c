@@ -110,7 +110,11 @@ int freerdp_parse_args(rdpSettings* settings, int argc, char** argv,
 				"  --from-stdin: unspecified username, password, domain and hostname params are prompted\n"
 				"  --no-fastpath: disable fast-path\n"
 				"  --no-motion: don't send mouse motion events\n"
+				"  --input-batch: hold back mouse motion up to this many milliseconds to batch input events\n"
+				"  --no-input-coalesce: send every batched mouse motion event instead of the last one\n"
 				"  --gdi: graphics rendering (hw, sw)\n"
+				"  --async-update: render updates on a separate thread (not supported by all clients)\n"
+				"  --record: record the session to a file, see freerdp-replay\n"
 				"  --no-osb: disable offscreen bitmaps\n"
 				"  --no-bmp-cache: disable bitmap cache\n"
 				"  --bcv3: codec for bitmap cache v3 (rfx, nsc, jpeg)\n"
@@ -369,6 +373,17 @@ int freerdp_parse_args(rdpSettings* settings, int argc, char** argv,
 			settings->fastpath_input = false;
 			settings->fastpath_output = false;
 		}
+		else if (strcmp("--async-update", argv[index]) == 0)
+		{
+			/* the client has to be ready for its callbacks to run on another thread */
+			if (!settings->async_update_safe)
+			{
+				printf("--async-update is not supported by this client\n");
+				return FREERDP_ARGS_PARSE_FAILURE;
+			}
+
+			settings->async_update = true;
+		}
 		else if (strcmp("--gdi", argv[index]) == 0)
 		{
 			index++;
@@ -501,6 +516,16 @@ int freerdp_parse_args(rdpSettings* settings, int argc, char** argv,
 			settings->dump_rfx_file = xstrdup(argv[index]);
 			settings->dump_rfx = true;
 		}
+		else if (strcmp("--record", argv[index]) == 0)
+		{
+			index++;
+			if (index == argc)
+			{
+				printf("missing file name\n");
+				return FREERDP_ARGS_PARSE_FAILURE;
+			}
+			settings->record_file = xstrdup(argv[index]);
+		}
 		else if (strcmp("--play-rfx", argv[index]) == 0)
 		{
 			index++;
@@ -540,6 +565,20 @@ int freerdp_parse_args(rdpSettings* settings, int argc, char** argv,
 		{
 			settings->mouse_motion = false;
 		}
+		else if (strcmp("--input-batch", argv[index]) == 0)
+		{
+			index++;
+			if (index == argc)
+			{
+				printf("missing input batch time\n");
+				return FREERDP_ARGS_PARSE_FAILURE;
+			}
+			settings->input_batch_ms = atoi(argv[index]);
+		}
+		else if (strcmp("--no-input-coalesce", argv[index]) == 0)
+		{
+			settings->input_coalesce = false;
+		}
 		else if (strcmp("--app", argv[index]) == 0)
 		{
 			settings->remote_app = true;
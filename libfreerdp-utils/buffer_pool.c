@@ -0,0 +1,226 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Buffer Pool
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/mutex.h>
+#include <freerdp/utils/buffer_pool.h>
+
+/* kept in front of every buffer, padded so the data stays 16 byte aligned */
+struct _BUFFER_HEADER
+{
+	BUFFER_POOL* pool;
+	uint32 size;
+	int refs;
+	uint8* mem;
+};
+typedef struct _BUFFER_HEADER BUFFER_HEADER;
+
+#define BUFFER_HEADER_SIZE	((sizeof(BUFFER_HEADER) + 15) & ~15)
+
+#define BUFFER_GET_HEADER(_buffer)	((BUFFER_HEADER*) ((_buffer) - BUFFER_HEADER_SIZE))
+
+struct _BUFFER_POOL
+{
+	freerdp_mutex mutex;
+
+	uint32 size; /* size of the buffers being recycled */
+	int outstanding; /* buffers handed out and not returned yet */
+	boolean closed;
+
+	int count;
+	int max_idle;
+	uint8** idle;
+};
+
+static uint8* buffer_pool_alloc(BUFFER_POOL* pool, uint32 size)
+{
+	uint8* mem;
+	uint8* buffer;
+	BUFFER_HEADER* header;
+
+	mem = (uint8*) xmalloc(size + BUFFER_HEADER_SIZE + 15);
+
+	if (mem == NULL)
+		return NULL;
+
+	buffer = (uint8*) (((uintptr_t) mem + BUFFER_HEADER_SIZE + 15) & ~((uintptr_t) 15));
+
+	header = BUFFER_GET_HEADER(buffer);
+	header->pool = pool;
+	header->size = size;
+	header->mem = mem;
+
+	return buffer;
+}
+
+static void buffer_pool_release(uint8* buffer)
+{
+	xfree(BUFFER_GET_HEADER(buffer)->mem);
+}
+
+static void buffer_pool_destroy(BUFFER_POOL* pool)
+{
+	int i;
+
+	for (i = 0; i < pool->count; i++)
+		buffer_pool_release(pool->idle[i]);
+
+	freerdp_mutex_free(pool->mutex);
+	xfree(pool->idle);
+	xfree(pool);
+}
+
+BUFFER_POOL* buffer_pool_new(int max_idle)
+{
+	BUFFER_POOL* pool;
+
+	pool = xnew(BUFFER_POOL);
+	pool->mutex = freerdp_mutex_new();
+	pool->max_idle = max_idle;
+	pool->idle = (uint8**) xzalloc(sizeof(uint8*) * max_idle);
+
+	return pool;
+}
+
+/**
+ * Closes the pool. Buffers still handed out are released when they are put
+ * back, the last one also releases the pool.
+ */
+
+void buffer_pool_free(BUFFER_POOL* pool)
+{
+	boolean destroy;
+
+	if (pool == NULL)
+		return;
+
+	freerdp_mutex_lock(pool->mutex);
+	pool->closed = true;
+	destroy = (pool->outstanding == 0);
+	freerdp_mutex_unlock(pool->mutex);
+
+	if (destroy)
+		buffer_pool_destroy(pool);
+}
+
+/**
+ * Hands out a buffer of at least the given size. A different size than the
+ * previous request (a video resolution change) drops the idle buffers.
+ */
+
+uint8* buffer_pool_get(BUFFER_POOL* pool, uint32 size)
+{
+	int i;
+	uint8* buffer = NULL;
+
+	freerdp_mutex_lock(pool->mutex);
+
+	if (size != pool->size)
+	{
+		for (i = 0; i < pool->count; i++)
+			buffer_pool_release(pool->idle[i]);
+
+		pool->count = 0;
+		pool->size = size;
+	}
+
+	if (pool->count > 0)
+		buffer = pool->idle[--pool->count];
+
+	pool->outstanding++;
+
+	freerdp_mutex_unlock(pool->mutex);
+
+	if (buffer == NULL)
+	{
+		buffer = buffer_pool_alloc(pool, size);
+
+		if (buffer == NULL)
+		{
+			freerdp_mutex_lock(pool->mutex);
+			pool->outstanding--;
+			freerdp_mutex_unlock(pool->mutex);
+			return NULL;
+		}
+	}
+
+	BUFFER_GET_HEADER(buffer)->refs = 1;
+
+	return buffer;
+}
+
+/**
+ * Adds an owner to a buffer, such as a video decoder keeping a frame as a
+ * reference picture after handing it out. Every owner calls buffer_pool_put().
+ */
+
+void buffer_pool_ref(uint8* buffer)
+{
+	BUFFER_POOL* pool;
+
+	pool = BUFFER_GET_HEADER(buffer)->pool;
+
+	freerdp_mutex_lock(pool->mutex);
+	BUFFER_GET_HEADER(buffer)->refs++;
+	freerdp_mutex_unlock(pool->mutex);
+}
+
+void buffer_pool_put(uint8* buffer)
+{
+	BUFFER_POOL* pool;
+	boolean destroy;
+
+	if (buffer == NULL)
+		return;
+
+	pool = BUFFER_GET_HEADER(buffer)->pool;
+
+	freerdp_mutex_lock(pool->mutex);
+
+	if (--BUFFER_GET_HEADER(buffer)->refs > 0)
+	{
+		freerdp_mutex_unlock(pool->mutex);
+		return;
+	}
+
+	pool->outstanding--;
+
+	if (!pool->closed && pool->count < pool->max_idle && BUFFER_GET_HEADER(buffer)->size == pool->size)
+	{
+		pool->idle[pool->count++] = buffer;
+		buffer = NULL;
+	}
+
+	destroy = (pool->closed && pool->outstanding == 0);
+
+	freerdp_mutex_unlock(pool->mutex);
+
+	if (buffer != NULL)
+		buffer_pool_release(buffer);
+
+	if (destroy)
+		buffer_pool_destroy(pool);
+}
+
+uint32 buffer_pool_get_size(uint8* buffer)
+{
+	return BUFFER_GET_HEADER(buffer)->size;
+}
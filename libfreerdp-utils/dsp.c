@@ -21,10 +21,29 @@
 #include <stdlib.h>
 #include <string.h>
 #include <freerdp/types.h>
+#include <freerdp/utils/list.h>
+#include <freerdp/utils/mutex.h>
 #include <freerdp/utils/memory.h>
+#include <freerdp/utils/thread.h>
+#include <freerdp/utils/wait_obj.h>
 #include <freerdp/utils/dsp.h>
 
-static void freerdp_dsp_resample(FREERDP_DSP_CONTEXT* context,
+#ifdef _WIN32
+#include <winpr/windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifdef WITH_SSE2
+#include <emmintrin.h>
+#endif
+
+/**
+ * Cheap nearest neighbour resampler working on raw bytes. It does not keep
+ * any state between calls and does no channel mixing, but it is still
+ * around for callers which prefer speed over quality.
+ */
+void freerdp_dsp_resample_nearest(FREERDP_DSP_CONTEXT* context,
 	const uint8* src, int bytes_per_sample,
 	uint32 schan, uint32 srate, int sframes,
 	uint32 rchan, uint32 rrate)
@@ -69,286 +88,1105 @@ static void freerdp_dsp_resample(FREERDP_DSP_CONTEXT* context,
 	context->resampled_size = rsize;
 }
 
-/**
- * Microsoft IMA ADPCM specification:
- *
- * http://wiki.multimedia.cx/index.php?title=Microsoft_IMA_ADPCM
- * http://wiki.multimedia.cx/index.php?title=IMA_ADPCM
- */
+/* interpolation weights are Q14, so that both weights of a pair fit in a sint16 */
+#define DSP_WEIGHT_BITS		14
+#define DSP_WEIGHT_ONE		(1 << DSP_WEIGHT_BITS)
+#define DSP_WEIGHT_ROUND	(1 << (DSP_WEIGHT_BITS - 1))
 
-static const sint16 ima_step_index_table[] =
+static INLINE sint16 freerdp_dsp_get_sample(const uint8* src, int bytes_per_sample, int index)
 {
-	-1, -1, -1, -1, 2, 4, 6, 8,
-	-1, -1, -1, -1, 2, 4, 6, 8
-};
+	if (bytes_per_sample == 1)
+		return (sint16) ((src[index] - 128) * 256);
 
-static const sint16 ima_step_size_table[] =
+	src += index * 2;
+	return (sint16) (((uint16) src[0]) | (((uint16) src[1]) << 8));
+}
+
+/**
+ * Convert sframes frames to 16-bit samples with rchan channels. The frames
+ * are written after one frame of room at the start of the mix buffer, which
+ * the resampler fills with the last frame of the previous call.
+ */
+static sint16* freerdp_dsp_mix(FREERDP_DSP_CONTEXT* context,
+	const uint8* src, int bytes_per_sample,
+	uint32 schan, int sframes, uint32 rchan)
 {
-	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 
-	19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 
-	50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 
-	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
-	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
-	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 
-	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
-	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 
-	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767 
-};
+	int i;
+	uint32 c;
+	sint32 sum;
+	sint16* dst;
+	uint32 length;
+
+	length = (sframes + 1) * rchan;
+
+	if (length > context->mix_maxlength)
+	{
+		context->mix_maxlength = length + 1024;
+		context->mix_buffer = (sint16*) xrealloc(context->mix_buffer, context->mix_maxlength * sizeof(sint16));
+	}
+	dst = context->mix_buffer + rchan;
+
+	if (schan == rchan && bytes_per_sample == 2)
+	{
+		memcpy(dst, src, sframes * rchan * 2);
+		return context->mix_buffer;
+	}
+
+	for (i = 0; i < sframes; i++)
+	{
+		if (schan == rchan)
+		{
+			for (c = 0; c < rchan; c++)
+				*dst++ = freerdp_dsp_get_sample(src, bytes_per_sample, i * schan + c);
+		}
+		else if (rchan == 1)
+		{
+			/* down-mix to mono */
+			for (c = 0, sum = 0; c < schan; c++)
+				sum += freerdp_dsp_get_sample(src, bytes_per_sample, i * schan + c);
+			*dst++ = (sint16) (sum / (sint32) schan);
+		}
+		else
+		{
+			/* up-mix repeats the source channels, down-mix keeps the front channels */
+			for (c = 0; c < rchan; c++)
+				*dst++ = freerdp_dsp_get_sample(src, bytes_per_sample, i * schan + (c % schan));
+		}
+	}
+
+	return context->mix_buffer;
+}
+
+#ifdef WITH_SSE2
 
-static uint16 dsp_decode_ima_adpcm_sample(ADPCM* adpcm,
-	int channel, uint8 sample)
+/* four output frames at a time, the caller guarantees that idx[k] + 1 is a valid frame */
+static INLINE void freerdp_dsp_interpolate_sse2(const sint16* e, uint32 channels,
+	const uint32* idx, const uint32* w, sint16* dst)
 {
-	sint32 ss;
-	sint32 d;
+	__m128i v0, v1;
+	__m128i w0, w1;
+	__m128i round = _mm_set1_epi32(DSP_WEIGHT_ROUND);
 
-	ss = ima_step_size_table[adpcm->ima.last_step[channel]];
-	d = (ss >> 3);
-	if (sample & 1)
-		d += (ss >> 2);
-	if (sample & 2)
-		d += (ss >> 1);
-	if (sample & 4)
-		d += ss;
-	if (sample & 8)
-		d = -d;
-	d += adpcm->ima.last_sample[channel];
-
-	if (d < -32768)
-		d = -32768;
-	else if (d > 32767)
-		d = 32767;
+	/* weight pairs (1 - w, w), packed to match the (a, b) sample pairs */
+	w0 = _mm_set_epi32(
+		(w[1] << 16) | (DSP_WEIGHT_ONE - w[1]), (w[1] << 16) | (DSP_WEIGHT_ONE - w[1]),
+		(w[0] << 16) | (DSP_WEIGHT_ONE - w[0]), (w[0] << 16) | (DSP_WEIGHT_ONE - w[0]));
+	w1 = _mm_set_epi32(
+		(w[3] << 16) | (DSP_WEIGHT_ONE - w[3]), (w[3] << 16) | (DSP_WEIGHT_ONE - w[3]),
+		(w[2] << 16) | (DSP_WEIGHT_ONE - w[2]), (w[2] << 16) | (DSP_WEIGHT_ONE - w[2]));
 
-	adpcm->ima.last_sample[channel] = (sint16) d;
+	if (channels == 2)
+	{
+		/* aL aR bL bR -> aL bL aR bR */
+		v0 = _mm_unpacklo_epi64(
+			_mm_shufflelo_epi16(_mm_loadl_epi64((const __m128i*) &e[idx[0] * 2]), _MM_SHUFFLE(3, 1, 2, 0)),
+			_mm_shufflelo_epi16(_mm_loadl_epi64((const __m128i*) &e[idx[1] * 2]), _MM_SHUFFLE(3, 1, 2, 0)));
+		v1 = _mm_unpacklo_epi64(
+			_mm_shufflelo_epi16(_mm_loadl_epi64((const __m128i*) &e[idx[2] * 2]), _MM_SHUFFLE(3, 1, 2, 0)),
+			_mm_shufflelo_epi16(_mm_loadl_epi64((const __m128i*) &e[idx[3] * 2]), _MM_SHUFFLE(3, 1, 2, 0)));
+
+		v0 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(v0, w0), round), DSP_WEIGHT_BITS);
+		v1 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(v1, w1), round), DSP_WEIGHT_BITS);
+
+		_mm_storeu_si128((__m128i*) dst, _mm_packs_epi32(v0, v1));
+	}
+	else
+	{
+		v0 = _mm_set_epi16(e[idx[3] + 1], e[idx[3]], e[idx[2] + 1], e[idx[2]],
+			e[idx[1] + 1], e[idx[1]], e[idx[0] + 1], e[idx[0]]);
+
+		/* only one weight pair per frame for mono */
+		w0 = _mm_unpacklo_epi64(_mm_shuffle_epi32(w0, _MM_SHUFFLE(2, 0, 2, 0)),
+			_mm_shuffle_epi32(w1, _MM_SHUFFLE(2, 0, 2, 0)));
 
-	adpcm->ima.last_step[channel] += ima_step_index_table[sample];
-	if (adpcm->ima.last_step[channel] < 0)
-		adpcm->ima.last_step[channel] = 0;
-	else if (adpcm->ima.last_step[channel] > 88)
-		adpcm->ima.last_step[channel] = 88;
+		v0 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(v0, w0), round), DSP_WEIGHT_BITS);
 
-	return (uint16) d;
+		_mm_storel_epi64((__m128i*) dst, _mm_packs_epi32(v0, v0));
+	}
 }
 
-static void freerdp_dsp_decode_ima_adpcm(FREERDP_DSP_CONTEXT* context,
-	const uint8* src, int size, int channels, int block_size)
+#endif
+
+/**
+ * Linear interpolating resampler on 16-bit frames. The read position is
+ * tracked as an exact fraction of the source and target rates, so that the
+ * phase never drifts, and the interpolation weights come from a reciprocal
+ * multiply instead of a division per sample.
+ */
+static void freerdp_dsp_resample(FREERDP_DSP_CONTEXT* context,
+	const uint8* src, int bytes_per_sample,
+	uint32 schan, uint32 srate, int sframes,
+	uint32 rchan, uint32 rrate)
 {
-	uint8* dst;
-	uint8 sample;
-	uint16 decoded;
-	uint32 out_size;
-	int channel;
-	int i;
+	uint32 c;
+	int rsize;
+	sint16* e;
+	sint16* dst;
+	uint32 n, pos, frac;
+	uint32 step, step_frac;
+	uint32 rframes;
+	uint32 max_frames;
+	uint64 recip;
+	sint32 w;
+	RESAMPLER* state = &context->resampler;
 
-	out_size = size * 4;
-	if (out_size > context->adpcm_maxlength)
+	if (rchan > FREERDP_DSP_MAX_CHANNELS || schan == 0 || srate == 0 || rrate == 0)
 	{
-		context->adpcm_maxlength = out_size + 1024;
-		context->adpcm_buffer = xrealloc(context->adpcm_buffer, context->adpcm_maxlength);
+		freerdp_dsp_resample_nearest(context, src, bytes_per_sample, schan, srate, sframes, rchan, rrate);
+		return;
 	}
-	dst = context->adpcm_buffer;
-	while (size > 0)
+
+	context->resampled_frames = 0;
+	context->resampled_size = 0;
+
+	if (sframes <= 0)
+		return;
+
+	max_frames = (uint32) (((uint64) (sframes + 1) * rrate) / srate) + 2;
+	rsize = max_frames * rchan * 2;
+
+	if (rsize > (int) context->resampled_maxlength)
+	{
+		context->resampled_maxlength = rsize + 1024;
+		context->resampled_buffer = (uint8*) xrealloc(context->resampled_buffer, context->resampled_maxlength);
+	}
+	dst = (sint16*) context->resampled_buffer;
+
+	e = freerdp_dsp_mix(context, src, bytes_per_sample, schan, sframes, rchan);
+	n = sframes;
+
+	if (!state->primed || state->srate != srate || state->rrate != rrate || state->channels != rchan)
+	{
+		/* start on the first frame of this block, without any delay */
+		state->srate = srate;
+		state->rrate = rrate;
+		state->channels = rchan;
+		state->pos = 1;
+		state->frac = 0;
+		state->primed = true;
+
+		for (c = 0; c < rchan; c++)
+			state->history[c] = e[rchan + c];
+	}
+
+	if (srate == rrate)
+	{
+		memcpy(dst, e + rchan, n * rchan * 2);
+		rframes = n;
+	}
+	else
 	{
-		if (size % block_size == 0)
+		memcpy(e, state->history, rchan * 2);
+
+		/* e[0] is the history frame, e[1..n] are the new frames */
+		pos = state->pos;
+		frac = state->frac;
+		step = srate / rrate;
+		step_frac = srate % rrate;
+		recip = ((uint64) DSP_WEIGHT_ONE << 32) / rrate;
+		rframes = 0;
+
+#ifdef WITH_SSE2
+		if (rchan <= 2)
 		{
-			context->adpcm.ima.last_sample[0] = (sint16) (((uint16)(*src)) | (((uint16)(*(src + 1))) << 8));
-			context->adpcm.ima.last_step[0] = (sint16) (*(src + 2));
-			src += 4;
-			size -= 4;
-			out_size -= 16;
-			if (channels > 1)
+			int k;
+			uint32 p, f;
+			uint32 idx[4];
+			uint32 wt[4];
+
+			for (;;)
 			{
-				context->adpcm.ima.last_sample[1] = (sint16) (((uint16)(*src)) | (((uint16)(*(src + 1))) << 8));
-				context->adpcm.ima.last_step[1] = (sint16) (*(src + 2));
-				src += 4;
-				size -= 4;
-				out_size -= 16;
+				p = pos;
+				f = frac;
+
+				for (k = 0; k < 4 && p < n; k++)
+				{
+					idx[k] = p;
+					wt[k] = (uint32) (((uint64) f * recip) >> 32);
+
+					p += step;
+					f += step_frac;
+					if (f >= rrate)
+					{
+						f -= rrate;
+						p++;
+					}
+				}
+
+				if (k < 4)
+					break;
+
+				freerdp_dsp_interpolate_sse2(e, rchan, idx, wt, dst);
+				dst += 4 * rchan;
+				rframes += 4;
+				pos = p;
+				frac = f;
 			}
 		}
+#endif
 
-		if (channels > 1)
+		while (pos < n)
 		{
-			for (i = 0; i < 8; i++)
+			w = (sint32) (((uint64) frac * recip) >> 32);
+
+			for (c = 0; c < rchan; c++)
 			{
-				channel = (i < 4 ? 0 : 1);
-				sample = ((*src) & 0x0f);
-				decoded = dsp_decode_ima_adpcm_sample(&context->adpcm, channel, sample);
-				dst[((i & 3) << 3) + (channel << 1)] = (decoded & 0xff);
-				dst[((i & 3) << 3) + (channel << 1) + 1] = (decoded >> 8);
-				sample = ((*src) >> 4);
-				decoded = dsp_decode_ima_adpcm_sample(&context->adpcm, channel, sample);
-				dst[((i & 3) << 3) + (channel << 1) + 4] = (decoded & 0xff);
-				dst[((i & 3) << 3) + (channel << 1) + 5] = (decoded >> 8);
-				src++;
+				*dst++ = (sint16) ((e[pos * rchan + c] * (DSP_WEIGHT_ONE - w) +
+					e[(pos + 1) * rchan + c] * w + DSP_WEIGHT_ROUND) >> DSP_WEIGHT_BITS);
+			}
+			rframes++;
+
+			pos += step;
+			frac += step_frac;
+			if (frac >= rrate)
+			{
+				frac -= rrate;
+				pos++;
 			}
-			dst += 32;
-			size -= 8;
-		}
-		else
-		{
-			sample = ((*src) & 0x0f);
-			decoded = dsp_decode_ima_adpcm_sample(&context->adpcm, 0, sample);
-			*dst++ = (decoded & 0xff);
-			*dst++ = (decoded >> 8);
-			sample = ((*src) >> 4);
-			decoded = dsp_decode_ima_adpcm_sample(&context->adpcm, 0, sample);
-			*dst++ = (decoded & 0xff);
-			*dst++ = (decoded >> 8);
-			src++;
-			size--;
 		}
+
+		state->pos = pos - n;
+		state->frac = frac;
+
+		for (c = 0; c < rchan; c++)
+			state->history[c] = e[n * rchan + c];
+	}
+
+	if (bytes_per_sample == 1)
+	{
+		/* in place, each byte is written behind the sample it comes from */
+		dst = (sint16*) context->resampled_buffer;
+
+		for (c = 0; c < rframes * rchan; c++)
+			context->resampled_buffer[c] = (uint8) ((dst[c] >> 8) + 128);
 	}
 
-	context->adpcm_size = dst - context->adpcm_buffer;
+	context->resampled_frames = rframes;
+	context->resampled_size = rframes * rchan * bytes_per_sample;
 }
 
 /**
- * 0     1     2     3
- * 2 0   6 4   10 8  14 12   <left>
+ * ADPCM data is made of blocks which each start with a header holding the
+ * full predictor state, so blocks can be decoded independently of each
+ * other. The encoders make their blocks independent too: the first block
+ * continues from the context state, the others start from the last input
+ * sample before the block and an estimated step. The output therefore does
+ * not depend on how the blocks are spread over threads.
  *
- * 4     5     6     7
- * 3 1   7 5   11 9  15 13   <right>
+ * Large buffers are split into tasks of DSP_BLOCKS_PER_TASK blocks and
+ * shared with a process wide worker pool, if freerdp_dsp_set_worker_threads()
+ * has enabled one. The calling thread always works on its own buffer too.
+ * Every caller holds a reference on the pool while it uses it, so the pool
+ * can be replaced at any time: the old one goes away with its last user.
  */
-static const struct
-{
-	uint8 byte_num;
-	uint8 byte_shift;
-} ima_stereo_encode_map[] =
-{
-	{ 0, 0 },
-	{ 4, 0 },
-	{ 0, 4 },
-	{ 4, 4 },
-	{ 1, 0 },
-	{ 5, 0 },
-	{ 1, 4 },
-	{ 5, 4 },
-	{ 2, 0 },
-	{ 6, 0 },
-	{ 2, 4 },
-	{ 6, 4 },
-	{ 3, 0 },
-	{ 7, 0 },
-	{ 3, 4 },
-	{ 7, 4 }
+
+#define DSP_BLOCKS_PER_TASK		8
+#define DSP_MIN_PARALLEL_BLOCKS		(2 * DSP_BLOCKS_PER_TASK)
+#define DSP_MAX_WORKER_THREADS		32
+
+typedef struct _DSP_BLOCK_JOB DSP_BLOCK_JOB;
+typedef int (*pcDspBlockFunc)(DSP_BLOCK_JOB* job, ADPCM* adpcm, const uint8* src, int size, uint8* dst);
+
+struct _DSP_BLOCK_JOB
+{
+	pcDspBlockFunc func;
+	const uint8* src;
+	uint8* dst;
+	int size;
+	int channels;
+	int in_block;
+	int out_block;
+	int blocks;
+
+	ADPCM first;
+	ADPCM last;
+	int last_size;
+
+	int next;
+	int pending;
+	struct wait_obj* done;
+};
+
+typedef struct _DSP_WORKER DSP_WORKER;
+typedef struct _DSP_WORKER_POOL DSP_WORKER_POOL;
+
+struct _DSP_WORKER
+{
+	DSP_WORKER_POOL* pool;
+	freerdp_thread* thread;
 };
 
-static uint8 dsp_encode_ima_adpcm_sample(ADPCM* adpcm,
-	int channel, sint16 sample)
+struct _DSP_WORKER_POOL
 {
-	sint32 e;
-	sint32 d;
-	sint32 ss;
-	uint8 enc;
-	sint32 diff;
+	freerdp_mutex mutex;
+	LIST* jobs;
+	int count;
+	DSP_WORKER* workers;
+	int users;
+};
+
+/* dsp_pool_mutex guards dsp_pool and the users count of every pool */
+static DSP_WORKER_POOL* dsp_pool = NULL;
+static freerdp_mutex dsp_pool_mutex = NULL;
+
+static void freerdp_dsp_process_block(DSP_BLOCK_JOB* job, int block)
+{
+	int size;
+	int out_size;
+	ADPCM adpcm;
+
+	size = job->size - block * job->in_block;
+	if (size > job->in_block)
+		size = job->in_block;
+
+	if (block == 0)
+		memcpy(&adpcm, &job->first, sizeof(ADPCM));
+	else
+		memset(&adpcm, 0, sizeof(ADPCM));
+
+	out_size = job->func(job, &adpcm, job->src + block * job->in_block, size,
+		job->dst + block * job->out_block);
 
-	ss = ima_step_size_table[adpcm->ima.last_step[channel]];
-	d = e = sample - adpcm->ima.last_sample[channel];
-	diff = ss >> 3;
-	enc = 0;
-	if (e < 0)
+	if (block == job->blocks - 1)
 	{
-		enc = 8;
-		e = -e;
+		memcpy(&job->last, &adpcm, sizeof(ADPCM));
+		job->last_size = out_size;
 	}
-	if (e >= ss)
+}
+
+static void freerdp_dsp_run_job(DSP_WORKER_POOL* pool, DSP_BLOCK_JOB* job)
+{
+	int block;
+	int begin;
+	int end;
+
+	while (1)
+	{
+		freerdp_mutex_lock(pool->mutex);
+		begin = job->next;
+		job->next += DSP_BLOCKS_PER_TASK;
+		freerdp_mutex_unlock(pool->mutex);
+
+		if (begin >= job->blocks)
+			break;
+
+		end = begin + DSP_BLOCKS_PER_TASK;
+		if (end > job->blocks)
+			end = job->blocks;
+
+		for (block = begin; block < end; block++)
+			freerdp_dsp_process_block(job, block);
+	}
+}
+
+static void* freerdp_dsp_worker_func(void* arg)
+{
+	DSP_WORKER* worker = (DSP_WORKER*) arg;
+	freerdp_thread* thread = worker->thread;
+	DSP_WORKER_POOL* pool = worker->pool;
+	DSP_BLOCK_JOB* job;
+
+	while (1)
 	{
-		enc |= 4;
-		e -= ss;
+		freerdp_thread_wait(thread);
+
+		if (freerdp_thread_is_stopped(thread))
+			break;
+
+		freerdp_thread_reset(thread);
+
+		while (1)
+		{
+			freerdp_mutex_lock(pool->mutex);
+			job = (DSP_BLOCK_JOB*) list_dequeue(pool->jobs);
+			freerdp_mutex_unlock(pool->mutex);
+
+			if (job == NULL)
+				break;
+
+			freerdp_dsp_run_job(pool, job);
+
+			freerdp_mutex_lock(pool->mutex);
+			if (--job->pending == 0)
+				wait_obj_set(job->done);
+			freerdp_mutex_unlock(pool->mutex);
+		}
 	}
-	ss >>= 1;
-	if (e >= ss)
+
+	freerdp_thread_quit(thread);
+
+	return NULL;
+}
+
+static void freerdp_dsp_pool_mutex_init(void)
+{
+	dsp_pool_mutex = freerdp_mutex_new();
+}
+
+#ifdef _WIN32
+static BOOL CALLBACK freerdp_dsp_pool_mutex_init_once(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	freerdp_dsp_pool_mutex_init();
+	return TRUE;
+}
+#endif
+
+static void freerdp_dsp_pool_lock(void)
+{
+#ifdef _WIN32
+	static INIT_ONCE dsp_pool_once = INIT_ONCE_STATIC_INIT;
+	InitOnceExecuteOnce(&dsp_pool_once, freerdp_dsp_pool_mutex_init_once, NULL, NULL);
+#else
+	static pthread_once_t dsp_pool_once = PTHREAD_ONCE_INIT;
+	pthread_once(&dsp_pool_once, freerdp_dsp_pool_mutex_init);
+#endif
+
+	freerdp_mutex_lock(dsp_pool_mutex);
+}
+
+static void freerdp_dsp_pool_unlock(void)
+{
+	freerdp_mutex_unlock(dsp_pool_mutex);
+}
+
+static DSP_WORKER_POOL* freerdp_dsp_pool_new(int count)
+{
+	int i;
+	DSP_WORKER_POOL* pool;
+
+	pool = xnew(DSP_WORKER_POOL);
+	pool->mutex = freerdp_mutex_new();
+	pool->jobs = list_new();
+	pool->count = count;
+	pool->workers = (DSP_WORKER*) xzalloc(sizeof(DSP_WORKER) * count);
+
+	for (i = 0; i < count; i++)
 	{
-		enc |= 2;
-		e -= ss;
+		pool->workers[i].pool = pool;
+		pool->workers[i].thread = freerdp_thread_new();
+		freerdp_thread_start(pool->workers[i].thread, freerdp_dsp_worker_func, &pool->workers[i]);
 	}
-	ss >>= 1;
-	if (e >= ss)
+
+	return pool;
+}
+
+static void freerdp_dsp_pool_free(DSP_WORKER_POOL* pool)
+{
+	int i;
+
+	for (i = 0; i < pool->count; i++)
 	{
-		enc |= 1;
-		e -= ss;
+		freerdp_thread_stop(pool->workers[i].thread);
+		freerdp_thread_free(pool->workers[i].thread);
 	}
 
-	if (d < 0)
-		diff = d + e - diff;
-	else
-		diff = d - e + diff;
+	list_free(pool->jobs);
+	freerdp_mutex_free(pool->mutex);
+	xfree(pool->workers);
+	xfree(pool);
+}
 
-	diff += adpcm->ima.last_sample[channel];
-	if (diff < -32768)
-		diff = -32768;
-	else if (diff > 32767)
-		diff = 32767;
-	adpcm->ima.last_sample[channel] = (sint16) diff;
+static DSP_WORKER_POOL* freerdp_dsp_pool_acquire(void)
+{
+	DSP_WORKER_POOL* pool;
 
-	adpcm->ima.last_step[channel] += ima_step_index_table[enc];
-	if (adpcm->ima.last_step[channel] < 0)
-		adpcm->ima.last_step[channel] = 0;
-	else if (adpcm->ima.last_step[channel] > 88)
-		adpcm->ima.last_step[channel] = 88;
+	freerdp_dsp_pool_lock();
+	pool = dsp_pool;
+	if (pool != NULL)
+		pool->users++;
+	freerdp_dsp_pool_unlock();
 
-	return enc;
+	return pool;
 }
 
-static void freerdp_dsp_encode_ima_adpcm(FREERDP_DSP_CONTEXT* context,
-	const uint8* src, int size, int channels, int block_size)
+static void freerdp_dsp_pool_release(DSP_WORKER_POOL* pool)
+{
+	boolean retired;
+
+	freerdp_dsp_pool_lock();
+	pool->users--;
+	retired = (pool != dsp_pool && pool->users == 0) ? true : false;
+	freerdp_dsp_pool_unlock();
+
+	if (retired)
+		freerdp_dsp_pool_free(pool);
+}
+
+/* returns the number of bytes written for the last block */
+static int freerdp_dsp_process_blocks(DSP_BLOCK_JOB* job)
 {
-	uint8* dst;
-	sint16 sample;
-	uint8 encoded;
-	uint32 out_size;
 	int i;
+	int helpers;
+	DSP_WORKER_POOL* pool;
+
+	job->last_size = 0;
+	memcpy(&job->last, &job->first, sizeof(ADPCM));
+
+	pool = (job->blocks < DSP_MIN_PARALLEL_BLOCKS) ? NULL : freerdp_dsp_pool_acquire();
+
+	if (pool == NULL)
+	{
+		for (i = 0; i < job->blocks; i++)
+			freerdp_dsp_process_block(job, i);
+
+		return job->last_size;
+	}
+
+	helpers = (job->blocks + DSP_BLOCKS_PER_TASK - 1) / DSP_BLOCKS_PER_TASK - 1;
+	if (helpers > pool->count)
+		helpers = pool->count;
+
+	job->next = 0;
+	job->pending = helpers;
+	job->done = wait_obj_new();
+
+	freerdp_mutex_lock(pool->mutex);
+	for (i = 0; i < helpers; i++)
+		list_enqueue(pool->jobs, job);
+	freerdp_mutex_unlock(pool->mutex);
+
+	for (i = 0; i < pool->count; i++)
+		freerdp_thread_signal(pool->workers[i].thread);
+
+	freerdp_dsp_run_job(pool, job);
+
+	/* no need to wait for workers which have not picked the job up yet */
+	freerdp_mutex_lock(pool->mutex);
+	while (list_remove(pool->jobs, job) != NULL)
+		job->pending--;
+	helpers = job->pending;
+	freerdp_mutex_unlock(pool->mutex);
+
+	if (helpers > 0)
+		wait_obj_select(&job->done, 1, -1);
+
+	wait_obj_free(job->done);
+
+	freerdp_dsp_pool_release(pool);
+
+	return job->last_size;
+}
+
+/**
+ * Enable a worker pool of count threads for block coding, or disable it
+ * with a count of 0. Safe to call while other threads are coding: they
+ * finish their current buffer with the pool they started with.
+ */
+void freerdp_dsp_set_worker_threads(int count)
+{
+	DSP_WORKER_POOL* pool = NULL;
+	DSP_WORKER_POOL* retired;
+
+	if (count > DSP_MAX_WORKER_THREADS)
+		count = DSP_MAX_WORKER_THREADS;
+
+	if (count > 0)
+		pool = freerdp_dsp_pool_new(count);
+
+	freerdp_dsp_pool_lock();
+	retired = dsp_pool;
+	dsp_pool = pool;
+	if (retired != NULL && retired->users > 0)
+		retired = NULL; /* freed by its last user */
+	freerdp_dsp_pool_unlock();
 
-	out_size = size / 2;
+	if (retired != NULL)
+		freerdp_dsp_pool_free(retired);
+}
+
+static void freerdp_dsp_reserve_adpcm(FREERDP_DSP_CONTEXT* context, uint32 out_size)
+{
 	if (out_size > context->adpcm_maxlength)
 	{
 		context->adpcm_maxlength = out_size + 1024;
 		context->adpcm_buffer = xrealloc(context->adpcm_buffer, context->adpcm_maxlength);
 	}
-	dst = context->adpcm_buffer;
+}
+
+static INLINE sint16 dsp_read_sint16(const uint8* src)
+{
+	return (sint16) (((uint16) src[0]) | (((uint16) src[1]) << 8));
+}
+
+static INLINE void dsp_write_sint16(uint8* dst, sint16 value)
+{
+	dst[0] = (uint8) (value & 0xff);
+	dst[1] = (uint8) ((value >> 8) & 0xff);
+}
+
+static INLINE sint32 dsp_clamp_sint16(sint32 value)
+{
+	value = (value < -32768) ? -32768 : value;
+	return (value > 32767) ? 32767 : value;
+}
+
+/**
+ * Microsoft IMA ADPCM specification:
+ *
+ * http://wiki.multimedia.cx/index.php?title=Microsoft_IMA_ADPCM
+ * http://wiki.multimedia.cx/index.php?title=IMA_ADPCM
+ */
+
+static const sint16 ima_step_size_table[] =
+{
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767 
+};
+
+/**
+ * ima_diff_table[step * 16 + nibble] is the signed difference a nibble
+ * decodes to, ima_next_step_table[step * 16 + nibble] the step index that
+ * follows it, clamped to 0..88. Both are derived from the step size table
+ * above and the step index adjustments -1, -1, -1, -1, 2, 4, 6, 8.
+ */
+
+static const sint32 ima_diff_table[89 * 16] =
+{
+	0, 1, 3, 4, 7, 8, 10, 11, 0, -1, -3, -4, -7, -8, -10, -11,
+	1, 3, 5, 7, 9, 11, 13, 15, -1, -3, -5, -7, -9, -11, -13, -15,
+	1, 3, 5, 7, 10, 12, 14, 16, -1, -3, -5, -7, -10, -12, -14, -16,
+	1, 3, 6, 8, 11, 13, 16, 18, -1, -3, -6, -8, -11, -13, -16, -18,
+	1, 3, 6, 8, 12, 14, 17, 19, -1, -3, -6, -8, -12, -14, -17, -19,
+	1, 4, 7, 10, 13, 16, 19, 22, -1, -4, -7, -10, -13, -16, -19, -22,
+	1, 4, 7, 10, 14, 17, 20, 23, -1, -4, -7, -10, -14, -17, -20, -23,
+	1, 4, 8, 11, 15, 18, 22, 25, -1, -4, -8, -11, -15, -18, -22, -25,
+	2, 6, 10, 14, 18, 22, 26, 30, -2, -6, -10, -14, -18, -22, -26, -30,
+	2, 6, 10, 14, 19, 23, 27, 31, -2, -6, -10, -14, -19, -23, -27, -31,
+	2, 6, 11, 15, 21, 25, 30, 34, -2, -6, -11, -15, -21, -25, -30, -34,
+	2, 7, 12, 17, 23, 28, 33, 38, -2, -7, -12, -17, -23, -28, -33, -38,
+	2, 7, 13, 18, 25, 30, 36, 41, -2, -7, -13, -18, -25, -30, -36, -41,
+	3, 9, 15, 21, 28, 34, 40, 46, -3, -9, -15, -21, -28, -34, -40, -46,
+	3, 10, 17, 24, 31, 38, 45, 52, -3, -10, -17, -24, -31, -38, -45, -52,
+	3, 10, 18, 25, 34, 41, 49, 56, -3, -10, -18, -25, -34, -41, -49, -56,
+	4, 12, 21, 29, 38, 46, 55, 63, -4, -12, -21, -29, -38, -46, -55, -63,
+	4, 13, 22, 31, 41, 50, 59, 68, -4, -13, -22, -31, -41, -50, -59, -68,
+	5, 15, 25, 35, 46, 56, 66, 76, -5, -15, -25, -35, -46, -56, -66, -76,
+	5, 16, 27, 38, 50, 61, 72, 83, -5, -16, -27, -38, -50, -61, -72, -83,
+	6, 18, 31, 43, 56, 68, 81, 93, -6, -18, -31, -43, -56, -68, -81, -93,
+	6, 19, 33, 46, 61, 74, 88, 101, -6, -19, -33, -46, -61, -74, -88, -101,
+	7, 22, 37, 52, 67, 82, 97, 112, -7, -22, -37, -52, -67, -82, -97, -112,
+	8, 24, 41, 57, 74, 90, 107, 123, -8, -24, -41, -57, -74, -90, -107, -123,
+	9, 27, 45, 63, 82, 100, 118, 136, -9, -27, -45, -63, -82, -100, -118, -136,
+	10, 30, 50, 70, 90, 110, 130, 150, -10, -30, -50, -70, -90, -110, -130, -150,
+	11, 33, 55, 77, 99, 121, 143, 165, -11, -33, -55, -77, -99, -121, -143, -165,
+	12, 36, 60, 84, 109, 133, 157, 181, -12, -36, -60, -84, -109, -133, -157, -181,
+	13, 39, 66, 92, 120, 146, 173, 199, -13, -39, -66, -92, -120, -146, -173, -199,
+	14, 43, 73, 102, 132, 161, 191, 220, -14, -43, -73, -102, -132, -161, -191, -220,
+	16, 48, 81, 113, 146, 178, 211, 243, -16, -48, -81, -113, -146, -178, -211, -243,
+	17, 52, 88, 123, 160, 195, 231, 266, -17, -52, -88, -123, -160, -195, -231, -266,
+	19, 58, 97, 136, 176, 215, 254, 293, -19, -58, -97, -136, -176, -215, -254, -293,
+	21, 64, 107, 150, 194, 237, 280, 323, -21, -64, -107, -150, -194, -237, -280, -323,
+	23, 70, 118, 165, 213, 260, 308, 355, -23, -70, -118, -165, -213, -260, -308, -355,
+	26, 78, 130, 182, 235, 287, 339, 391, -26, -78, -130, -182, -235, -287, -339, -391,
+	28, 85, 143, 200, 258, 315, 373, 430, -28, -85, -143, -200, -258, -315, -373, -430,
+	31, 94, 157, 220, 284, 347, 410, 473, -31, -94, -157, -220, -284, -347, -410, -473,
+	34, 103, 173, 242, 313, 382, 452, 521, -34, -103, -173, -242, -313, -382, -452, -521,
+	38, 114, 191, 267, 345, 421, 498, 574, -38, -114, -191, -267, -345, -421, -498, -574,
+	42, 126, 210, 294, 379, 463, 547, 631, -42, -126, -210, -294, -379, -463, -547, -631,
+	46, 138, 231, 323, 417, 509, 602, 694, -46, -138, -231, -323, -417, -509, -602, -694,
+	51, 153, 255, 357, 459, 561, 663, 765, -51, -153, -255, -357, -459, -561, -663, -765,
+	56, 168, 280, 392, 505, 617, 729, 841, -56, -168, -280, -392, -505, -617, -729, -841,
+	61, 184, 308, 431, 555, 678, 802, 925, -61, -184, -308, -431, -555, -678, -802, -925,
+	68, 204, 340, 476, 612, 748, 884, 1020, -68, -204, -340, -476, -612, -748, -884, -1020,
+	74, 223, 373, 522, 672, 821, 971, 1120, -74, -223, -373, -522, -672, -821, -971, -1120,
+	82, 246, 411, 575, 740, 904, 1069, 1233, -82, -246, -411, -575, -740, -904, -1069, -1233,
+	90, 271, 452, 633, 814, 995, 1176, 1357, -90, -271, -452, -633, -814, -995, -1176, -1357,
+	99, 298, 497, 696, 895, 1094, 1293, 1492, -99, -298, -497, -696, -895, -1094, -1293, -1492,
+	109, 328, 547, 766, 985, 1204, 1423, 1642, -109, -328, -547, -766, -985, -1204, -1423, -1642,
+	120, 360, 601, 841, 1083, 1323, 1564, 1804, -120, -360, -601, -841, -1083, -1323, -1564, -1804,
+	132, 397, 662, 927, 1192, 1457, 1722, 1987, -132, -397, -662, -927, -1192, -1457, -1722, -1987,
+	145, 436, 728, 1019, 1311, 1602, 1894, 2185, -145, -436, -728, -1019, -1311, -1602, -1894, -2185,
+	160, 480, 801, 1121, 1442, 1762, 2083, 2403, -160, -480, -801, -1121, -1442, -1762, -2083, -2403,
+	176, 528, 881, 1233, 1587, 1939, 2292, 2644, -176, -528, -881, -1233, -1587, -1939, -2292, -2644,
+	194, 582, 970, 1358, 1746, 2134, 2522, 2910, -194, -582, -970, -1358, -1746, -2134, -2522, -2910,
+	213, 639, 1066, 1492, 1920, 2346, 2773, 3199, -213, -639, -1066, -1492, -1920, -2346, -2773, -3199,
+	234, 703, 1173, 1642, 2112, 2581, 3051, 3520, -234, -703, -1173, -1642, -2112, -2581, -3051, -3520,
+	258, 774, 1291, 1807, 2324, 2840, 3357, 3873, -258, -774, -1291, -1807, -2324, -2840, -3357, -3873,
+	284, 852, 1420, 1988, 2556, 3124, 3692, 4260, -284, -852, -1420, -1988, -2556, -3124, -3692, -4260,
+	312, 936, 1561, 2185, 2811, 3435, 4060, 4684, -312, -936, -1561, -2185, -2811, -3435, -4060, -4684,
+	343, 1030, 1717, 2404, 3092, 3779, 4466, 5153, -343, -1030, -1717, -2404, -3092, -3779, -4466, -5153,
+	378, 1134, 1890, 2646, 3402, 4158, 4914, 5670, -378, -1134, -1890, -2646, -3402, -4158, -4914, -5670,
+	415, 1246, 2078, 2909, 3742, 4573, 5405, 6236, -415, -1246, -2078, -2909, -3742, -4573, -5405, -6236,
+	457, 1372, 2287, 3202, 4117, 5032, 5947, 6862, -457, -1372, -2287, -3202, -4117, -5032, -5947, -6862,
+	503, 1509, 2516, 3522, 4529, 5535, 6542, 7548, -503, -1509, -2516, -3522, -4529, -5535, -6542, -7548,
+	553, 1660, 2767, 3874, 4981, 6088, 7195, 8302, -553, -1660, -2767, -3874, -4981, -6088, -7195, -8302,
+	608, 1825, 3043, 4260, 5479, 6696, 7914, 9131, -608, -1825, -3043, -4260, -5479, -6696, -7914, -9131,
+	669, 2008, 3348, 4687, 6027, 7366, 8706, 10045, -669, -2008, -3348, -4687, -6027, -7366, -8706, -10045,
+	736, 2209, 3683, 5156, 6630, 8103, 9577, 11050, -736, -2209, -3683, -5156, -6630, -8103, -9577, -11050,
+	810, 2431, 4052, 5673, 7294, 8915, 10536, 12157, -810, -2431, -4052, -5673, -7294, -8915, -10536, -12157,
+	891, 2674, 4457, 6240, 8023, 9806, 11589, 13372, -891, -2674, -4457, -6240, -8023, -9806, -11589, -13372,
+	980, 2941, 4902, 6863, 8825, 10786, 12747, 14708, -980, -2941, -4902, -6863, -8825, -10786, -12747, -14708,
+	1078, 3235, 5393, 7550, 9708, 11865, 14023, 16180, -1078, -3235, -5393, -7550, -9708, -11865, -14023, -16180,
+	1186, 3559, 5932, 8305, 10679, 13052, 15425, 17798, -1186, -3559, -5932, -8305, -10679, -13052, -15425, -17798,
+	1305, 3915, 6526, 9136, 11747, 14357, 16968, 19578, -1305, -3915, -6526, -9136, -11747, -14357, -16968, -19578,
+	1435, 4306, 7178, 10049, 12922, 15793, 18665, 21536, -1435, -4306, -7178, -10049, -12922, -15793, -18665, -21536,
+	1579, 4737, 7896, 11054, 14214, 17372, 20531, 23689, -1579, -4737, -7896, -11054, -14214, -17372, -20531, -23689,
+	1737, 5211, 8686, 12160, 15636, 19110, 22585, 26059, -1737, -5211, -8686, -12160, -15636, -19110, -22585, -26059,
+	1911, 5733, 9555, 13377, 17200, 21022, 24844, 28666, -1911, -5733, -9555, -13377, -17200, -21022, -24844, -28666,
+	2102, 6306, 10511, 14715, 18920, 23124, 27329, 31533, -2102, -6306, -10511, -14715, -18920, -23124, -27329, -31533,
+	2312, 6937, 11562, 16187, 20812, 25437, 30062, 34687, -2312, -6937, -11562, -16187, -20812, -25437, -30062, -34687,
+	2543, 7630, 12718, 17805, 22893, 27980, 33068, 38155, -2543, -7630, -12718, -17805, -22893, -27980, -33068, -38155,
+	2798, 8394, 13990, 19586, 25183, 30779, 36375, 41971, -2798, -8394, -13990, -19586, -25183, -30779, -36375, -41971,
+	3077, 9232, 15388, 21543, 27700, 33855, 40011, 46166, -3077, -9232, -15388, -21543, -27700, -33855, -40011, -46166,
+	3385, 10156, 16928, 23699, 30471, 37242, 44014, 50785, -3385, -10156, -16928, -23699, -30471, -37242, -44014, -50785,
+	3724, 11172, 18621, 26069, 33518, 40966, 48415, 55863, -3724, -11172, -18621, -26069, -33518, -40966, -48415, -55863,
+	4095, 12286, 20478, 28669, 36862, 45053, 53245, 61436, -4095, -12286, -20478, -28669, -36862, -45053, -53245, -61436
+};
+
+static const uint8 ima_next_step_table[89 * 16] =
+{
+	0, 0, 0, 0, 2, 4, 6, 8, 0, 0, 0, 0, 2, 4, 6, 8,
+	0, 0, 0, 0, 3, 5, 7, 9, 0, 0, 0, 0, 3, 5, 7, 9,
+	1, 1, 1, 1, 4, 6, 8, 10, 1, 1, 1, 1, 4, 6, 8, 10,
+	2, 2, 2, 2, 5, 7, 9, 11, 2, 2, 2, 2, 5, 7, 9, 11,
+	3, 3, 3, 3, 6, 8, 10, 12, 3, 3, 3, 3, 6, 8, 10, 12,
+	4, 4, 4, 4, 7, 9, 11, 13, 4, 4, 4, 4, 7, 9, 11, 13,
+	5, 5, 5, 5, 8, 10, 12, 14, 5, 5, 5, 5, 8, 10, 12, 14,
+	6, 6, 6, 6, 9, 11, 13, 15, 6, 6, 6, 6, 9, 11, 13, 15,
+	7, 7, 7, 7, 10, 12, 14, 16, 7, 7, 7, 7, 10, 12, 14, 16,
+	8, 8, 8, 8, 11, 13, 15, 17, 8, 8, 8, 8, 11, 13, 15, 17,
+	9, 9, 9, 9, 12, 14, 16, 18, 9, 9, 9, 9, 12, 14, 16, 18,
+	10, 10, 10, 10, 13, 15, 17, 19, 10, 10, 10, 10, 13, 15, 17, 19,
+	11, 11, 11, 11, 14, 16, 18, 20, 11, 11, 11, 11, 14, 16, 18, 20,
+	12, 12, 12, 12, 15, 17, 19, 21, 12, 12, 12, 12, 15, 17, 19, 21,
+	13, 13, 13, 13, 16, 18, 20, 22, 13, 13, 13, 13, 16, 18, 20, 22,
+	14, 14, 14, 14, 17, 19, 21, 23, 14, 14, 14, 14, 17, 19, 21, 23,
+	15, 15, 15, 15, 18, 20, 22, 24, 15, 15, 15, 15, 18, 20, 22, 24,
+	16, 16, 16, 16, 19, 21, 23, 25, 16, 16, 16, 16, 19, 21, 23, 25,
+	17, 17, 17, 17, 20, 22, 24, 26, 17, 17, 17, 17, 20, 22, 24, 26,
+	18, 18, 18, 18, 21, 23, 25, 27, 18, 18, 18, 18, 21, 23, 25, 27,
+	19, 19, 19, 19, 22, 24, 26, 28, 19, 19, 19, 19, 22, 24, 26, 28,
+	20, 20, 20, 20, 23, 25, 27, 29, 20, 20, 20, 20, 23, 25, 27, 29,
+	21, 21, 21, 21, 24, 26, 28, 30, 21, 21, 21, 21, 24, 26, 28, 30,
+	22, 22, 22, 22, 25, 27, 29, 31, 22, 22, 22, 22, 25, 27, 29, 31,
+	23, 23, 23, 23, 26, 28, 30, 32, 23, 23, 23, 23, 26, 28, 30, 32,
+	24, 24, 24, 24, 27, 29, 31, 33, 24, 24, 24, 24, 27, 29, 31, 33,
+	25, 25, 25, 25, 28, 30, 32, 34, 25, 25, 25, 25, 28, 30, 32, 34,
+	26, 26, 26, 26, 29, 31, 33, 35, 26, 26, 26, 26, 29, 31, 33, 35,
+	27, 27, 27, 27, 30, 32, 34, 36, 27, 27, 27, 27, 30, 32, 34, 36,
+	28, 28, 28, 28, 31, 33, 35, 37, 28, 28, 28, 28, 31, 33, 35, 37,
+	29, 29, 29, 29, 32, 34, 36, 38, 29, 29, 29, 29, 32, 34, 36, 38,
+	30, 30, 30, 30, 33, 35, 37, 39, 30, 30, 30, 30, 33, 35, 37, 39,
+	31, 31, 31, 31, 34, 36, 38, 40, 31, 31, 31, 31, 34, 36, 38, 40,
+	32, 32, 32, 32, 35, 37, 39, 41, 32, 32, 32, 32, 35, 37, 39, 41,
+	33, 33, 33, 33, 36, 38, 40, 42, 33, 33, 33, 33, 36, 38, 40, 42,
+	34, 34, 34, 34, 37, 39, 41, 43, 34, 34, 34, 34, 37, 39, 41, 43,
+	35, 35, 35, 35, 38, 40, 42, 44, 35, 35, 35, 35, 38, 40, 42, 44,
+	36, 36, 36, 36, 39, 41, 43, 45, 36, 36, 36, 36, 39, 41, 43, 45,
+	37, 37, 37, 37, 40, 42, 44, 46, 37, 37, 37, 37, 40, 42, 44, 46,
+	38, 38, 38, 38, 41, 43, 45, 47, 38, 38, 38, 38, 41, 43, 45, 47,
+	39, 39, 39, 39, 42, 44, 46, 48, 39, 39, 39, 39, 42, 44, 46, 48,
+	40, 40, 40, 40, 43, 45, 47, 49, 40, 40, 40, 40, 43, 45, 47, 49,
+	41, 41, 41, 41, 44, 46, 48, 50, 41, 41, 41, 41, 44, 46, 48, 50,
+	42, 42, 42, 42, 45, 47, 49, 51, 42, 42, 42, 42, 45, 47, 49, 51,
+	43, 43, 43, 43, 46, 48, 50, 52, 43, 43, 43, 43, 46, 48, 50, 52,
+	44, 44, 44, 44, 47, 49, 51, 53, 44, 44, 44, 44, 47, 49, 51, 53,
+	45, 45, 45, 45, 48, 50, 52, 54, 45, 45, 45, 45, 48, 50, 52, 54,
+	46, 46, 46, 46, 49, 51, 53, 55, 46, 46, 46, 46, 49, 51, 53, 55,
+	47, 47, 47, 47, 50, 52, 54, 56, 47, 47, 47, 47, 50, 52, 54, 56,
+	48, 48, 48, 48, 51, 53, 55, 57, 48, 48, 48, 48, 51, 53, 55, 57,
+	49, 49, 49, 49, 52, 54, 56, 58, 49, 49, 49, 49, 52, 54, 56, 58,
+	50, 50, 50, 50, 53, 55, 57, 59, 50, 50, 50, 50, 53, 55, 57, 59,
+	51, 51, 51, 51, 54, 56, 58, 60, 51, 51, 51, 51, 54, 56, 58, 60,
+	52, 52, 52, 52, 55, 57, 59, 61, 52, 52, 52, 52, 55, 57, 59, 61,
+	53, 53, 53, 53, 56, 58, 60, 62, 53, 53, 53, 53, 56, 58, 60, 62,
+	54, 54, 54, 54, 57, 59, 61, 63, 54, 54, 54, 54, 57, 59, 61, 63,
+	55, 55, 55, 55, 58, 60, 62, 64, 55, 55, 55, 55, 58, 60, 62, 64,
+	56, 56, 56, 56, 59, 61, 63, 65, 56, 56, 56, 56, 59, 61, 63, 65,
+	57, 57, 57, 57, 60, 62, 64, 66, 57, 57, 57, 57, 60, 62, 64, 66,
+	58, 58, 58, 58, 61, 63, 65, 67, 58, 58, 58, 58, 61, 63, 65, 67,
+	59, 59, 59, 59, 62, 64, 66, 68, 59, 59, 59, 59, 62, 64, 66, 68,
+	60, 60, 60, 60, 63, 65, 67, 69, 60, 60, 60, 60, 63, 65, 67, 69,
+	61, 61, 61, 61, 64, 66, 68, 70, 61, 61, 61, 61, 64, 66, 68, 70,
+	62, 62, 62, 62, 65, 67, 69, 71, 62, 62, 62, 62, 65, 67, 69, 71,
+	63, 63, 63, 63, 66, 68, 70, 72, 63, 63, 63, 63, 66, 68, 70, 72,
+	64, 64, 64, 64, 67, 69, 71, 73, 64, 64, 64, 64, 67, 69, 71, 73,
+	65, 65, 65, 65, 68, 70, 72, 74, 65, 65, 65, 65, 68, 70, 72, 74,
+	66, 66, 66, 66, 69, 71, 73, 75, 66, 66, 66, 66, 69, 71, 73, 75,
+	67, 67, 67, 67, 70, 72, 74, 76, 67, 67, 67, 67, 70, 72, 74, 76,
+	68, 68, 68, 68, 71, 73, 75, 77, 68, 68, 68, 68, 71, 73, 75, 77,
+	69, 69, 69, 69, 72, 74, 76, 78, 69, 69, 69, 69, 72, 74, 76, 78,
+	70, 70, 70, 70, 73, 75, 77, 79, 70, 70, 70, 70, 73, 75, 77, 79,
+	71, 71, 71, 71, 74, 76, 78, 80, 71, 71, 71, 71, 74, 76, 78, 80,
+	72, 72, 72, 72, 75, 77, 79, 81, 72, 72, 72, 72, 75, 77, 79, 81,
+	73, 73, 73, 73, 76, 78, 80, 82, 73, 73, 73, 73, 76, 78, 80, 82,
+	74, 74, 74, 74, 77, 79, 81, 83, 74, 74, 74, 74, 77, 79, 81, 83,
+	75, 75, 75, 75, 78, 80, 82, 84, 75, 75, 75, 75, 78, 80, 82, 84,
+	76, 76, 76, 76, 79, 81, 83, 85, 76, 76, 76, 76, 79, 81, 83, 85,
+	77, 77, 77, 77, 80, 82, 84, 86, 77, 77, 77, 77, 80, 82, 84, 86,
+	78, 78, 78, 78, 81, 83, 85, 87, 78, 78, 78, 78, 81, 83, 85, 87,
+	79, 79, 79, 79, 82, 84, 86, 88, 79, 79, 79, 79, 82, 84, 86, 88,
+	80, 80, 80, 80, 83, 85, 87, 88, 80, 80, 80, 80, 83, 85, 87, 88,
+	81, 81, 81, 81, 84, 86, 88, 88, 81, 81, 81, 81, 84, 86, 88, 88,
+	82, 82, 82, 82, 85, 87, 88, 88, 82, 82, 82, 82, 85, 87, 88, 88,
+	83, 83, 83, 83, 86, 88, 88, 88, 83, 83, 83, 83, 86, 88, 88, 88,
+	84, 84, 84, 84, 87, 88, 88, 88, 84, 84, 84, 84, 87, 88, 88, 88,
+	85, 85, 85, 85, 88, 88, 88, 88, 85, 85, 85, 85, 88, 88, 88, 88,
+	86, 86, 86, 86, 88, 88, 88, 88, 86, 86, 86, 86, 88, 88, 88, 88,
+	87, 87, 87, 87, 88, 88, 88, 88, 87, 87, 87, 87, 88, 88, 88, 88
+};
+
+static INLINE sint16 dsp_decode_ima_adpcm_sample(ADPCM* adpcm, int channel, int sample)
+{
+	int index;
+	sint32 d;
+
+	index = adpcm->ima.last_step[channel] * 16 + sample;
+	d = dsp_clamp_sint16(adpcm->ima.last_sample[channel] + ima_diff_table[index]);
+
+	adpcm->ima.last_sample[channel] = (sint16) d;
+	adpcm->ima.last_step[channel] = ima_next_step_table[index];
+
+	return (sint16) d;
+}
+
+/**
+ * The samples come in groups of four bytes per channel, eight samples each:
+ *
+ * 0     1     2     3
+ * 2 0   6 4   10 8  14 12   <left>
+ *
+ * 4     5     6     7
+ * 3 1   7 5   11 9  15 13   <right>
+ *
+ * Byte i of a group holds frames 2 * (i & 3) and 2 * (i & 3) + 1 of channel
+ * i >> 2. Mono data is handled as groups of one byte.
+ */
+#define IMA_GROUP_BYTES(_channels)	((_channels) == 1 ? 1 : 4 * (_channels))
+
+static INLINE int dsp_decode_ima_adpcm_groups(ADPCM* adpcm, const uint8* src, int size, sint16* dst, int channels)
+{
+	int i, c, k;
+	int group;
+	int groups;
+
+	group = IMA_GROUP_BYTES(channels);
+	groups = size / group;
+
+	for (; groups > 0; groups--)
+	{
+		for (i = 0; i < group; i++)
+		{
+			c = i >> 2;
+			k = (i & 3) * 2;
+			dst[k * channels + c] = dsp_decode_ima_adpcm_sample(adpcm, c, src[i] & 0x0F);
+			dst[(k + 1) * channels + c] = dsp_decode_ima_adpcm_sample(adpcm, c, src[i] >> 4);
+		}
+
+		src += group;
+		dst += group * 2;
+	}
+
+	return (size / group) * group * 4;
+}
+
+static void dsp_read_ima_adpcm_header(ADPCM* adpcm, const uint8* src, int channels)
+{
+	int c;
+
+	for (c = 0; c < channels; c++)
+	{
+		adpcm->ima.last_sample[c] = dsp_read_sint16(src + c * 4);
+		adpcm->ima.last_step[c] = (src[c * 4 + 2] > 88) ? 88 : src[c * 4 + 2];
+	}
+}
+
+static int dsp_decode_ima_adpcm_block(DSP_BLOCK_JOB* job, ADPCM* adpcm, const uint8* src, int size, uint8* dst)
+{
+	dsp_read_ima_adpcm_header(adpcm, src, job->channels);
+
+	/* constant channel counts let the compiler unroll the group loop */
+	if (job->channels == 1)
+		return dsp_decode_ima_adpcm_groups(adpcm, src + 4, size - 4, (sint16*) dst, 1);
+	else
+		return dsp_decode_ima_adpcm_groups(adpcm, src + 8, size - 8, (sint16*) dst, 2);
+}
+
+static void freerdp_dsp_decode_ima_adpcm(FREERDP_DSP_CONTEXT* context,
+	const uint8* src, int size, int channels, int block_size)
+{
+	int head;
+	int head_size;
+	DSP_BLOCK_JOB job;
+
+	context->adpcm_size = 0;
+
+	if (channels < 1 || channels > 2 || block_size <= 4 * channels || size <= 0)
+		return;
+
+	freerdp_dsp_reserve_adpcm(context, size * 4);
+
+	/* a block header is expected wherever the remaining size is a multiple of the block size */
+	head = size % block_size;
+	head_size = dsp_decode_ima_adpcm_groups(&context->adpcm, src, head, (sint16*) context->adpcm_buffer, channels);
+
+	memset(&job, 0, sizeof(DSP_BLOCK_JOB));
+	job.func = dsp_decode_ima_adpcm_block;
+	job.src = src + head;
+	job.dst = context->adpcm_buffer + head_size;
+	job.size = size - head;
+	job.channels = channels;
+	job.in_block = block_size;
+	job.out_block = (block_size - 4 * channels) / IMA_GROUP_BYTES(channels) * IMA_GROUP_BYTES(channels) * 4;
+	job.blocks = job.size / block_size;
+	memcpy(&job.first, &context->adpcm, sizeof(ADPCM));
+
+	freerdp_dsp_process_blocks(&job);
+	memcpy(&context->adpcm, &job.last, sizeof(ADPCM));
+
+	context->adpcm_size = head_size + job.blocks * job.out_block;
+}
+
+static INLINE uint8 dsp_encode_ima_adpcm_sample(ADPCM* adpcm, int channel, sint16 sample)
+{
+	sint32 e;
+	sint32 s0, s1, s2;
+	uint8 enc;
+	int index;
+
+	s2 = ima_step_size_table[adpcm->ima.last_step[channel]];
+	s1 = s2 >> 1;
+	s0 = s2 >> 2;
+	e = sample - adpcm->ima.last_sample[channel];
+
+	enc = (uint8) ((e >> 31) & 8);
+	e = (e < 0) ? -e : e;
+
+	/*
+	 * The reference encoder subtracts ss, ss / 2 and ss / 4 from |e| one
+	 * after the other. Since ss >= ss / 2 + ss / 4, that is the same as
+	 * counting the partial sums that do not exceed |e|, which needs no
+	 * branches and no dependency between the comparisons.
+	 */
+	enc |= (e >= s0) + (e >= s1) + (e >= s1 + s0) + (e >= s2) +
+		(e >= s2 + s0) + (e >= s2 + s1) + (e >= s2 + s1 + s0);
+
+	/* track the decoder, so that both sides stay in sync */
+	index = adpcm->ima.last_step[channel] * 16 + enc;
+	adpcm->ima.last_sample[channel] = (sint16) dsp_clamp_sint16(adpcm->ima.last_sample[channel] + ima_diff_table[index]);
+	adpcm->ima.last_step[channel] = ima_next_step_table[index];
+
+	return enc;
+}
+
+static sint16 dsp_estimate_ima_adpcm_step(sint32 delta)
+{
+	sint16 step = 0;
+
+	delta = (delta < 0) ? -delta : delta;
+
+	while (step < 88 && ima_step_size_table[step] < delta)
+		step++;
+
+	return step;
+}
+
+static INLINE int dsp_encode_ima_adpcm_groups(ADPCM* adpcm, const uint8* src, int size, uint8* dst, int channels)
+{
+	int i, c, k;
+	int group;
+	uint8* start = dst;
+	uint8 padded[32];
+
+	group = IMA_GROUP_BYTES(channels);
+
 	while (size > 0)
 	{
-		if ((dst - context->adpcm_buffer) % block_size == 0)
+		if (size < group * 4)
 		{
-			*dst++ = context->adpcm.ima.last_sample[0] & 0xff;
-			*dst++ = (context->adpcm.ima.last_sample[0] >> 8) & 0xff;
-			*dst++ = (uint8) context->adpcm.ima.last_step[0];
-			*dst++ = 0;
-			if (channels > 1)
-			{
-				*dst++ = context->adpcm.ima.last_sample[1] & 0xff;
-				*dst++ = (context->adpcm.ima.last_sample[1] >> 8) & 0xff;
-				*dst++ = (uint8) context->adpcm.ima.last_step[1];
-				*dst++ = 0;
-			}
+			/* pad the last group with silence */
+			memset(padded, 0, sizeof(padded));
+			memcpy(padded, src, size);
+			src = padded;
+			size = group * 4;
 		}
 
-		if (channels > 1)
+		for (i = 0; i < group; i++)
 		{
-			memset(dst, 0, 8);
-			for (i = 0; i < 16; i++)
-			{
-				sample = (sint16) (((uint16)(*src)) | (((uint16)(*(src + 1))) << 8));
-				src += 2;
-				encoded = dsp_encode_ima_adpcm_sample(&context->adpcm, i % 2, sample);
-				dst[ima_stereo_encode_map[i].byte_num] |= encoded << ima_stereo_encode_map[i].byte_shift;
-			}
-			dst += 8;
-			size -= 32;
+			c = i >> 2;
+			k = (i & 3) * 2;
+			dst[i] = dsp_encode_ima_adpcm_sample(adpcm, c, dsp_read_sint16(src + (k * channels + c) * 2));
+			dst[i] |= dsp_encode_ima_adpcm_sample(adpcm, c, dsp_read_sint16(src + ((k + 1) * channels + c) * 2)) << 4;
 		}
-		else
+
+		src += group * 4;
+		size -= group * 4;
+		dst += group;
+	}
+
+	return dst - start;
+}
+
+static int dsp_encode_ima_adpcm_block(DSP_BLOCK_JOB* job, ADPCM* adpcm, const uint8* src, int size, uint8* dst)
+{
+	int c;
+	int channels = job->channels;
+	boolean first_block = (src == job->src);
+	uint8* start = dst;
+
+	if (!first_block)
+	{
+		/* start from the sample just before this block */
+		for (c = 0; c < channels; c++)
 		{
-			sample = (sint16) (((uint16)(*src)) | (((uint16)(*(src + 1))) << 8));
-			src += 2;
-			encoded = dsp_encode_ima_adpcm_sample(&context->adpcm, 0, sample);
-			sample = (sint16) (((uint16)(*src)) | (((uint16)(*(src + 1))) << 8));
-			src += 2;
-			encoded |= dsp_encode_ima_adpcm_sample(&context->adpcm, 0, sample) << 4;
-			*dst++ = encoded;
-			size -= 4;
+			adpcm->ima.last_sample[c] = dsp_read_sint16(src + (c - channels) * 2);
+			adpcm->ima.last_step[c] = dsp_estimate_ima_adpcm_step(
+				dsp_read_sint16(src + c * 2) - adpcm->ima.last_sample[c]);
 		}
 	}
-	
-	context->adpcm_size = dst - context->adpcm_buffer;
+
+	for (c = 0; c < channels; c++)
+	{
+		dsp_write_sint16(dst, adpcm->ima.last_sample[c]);
+		dst[2] = (uint8) adpcm->ima.last_step[c];
+		dst[3] = 0;
+		dst += 4;
+	}
+
+	/* constant channel counts let the compiler unroll the group loop */
+	if (channels == 1)
+		dst += dsp_encode_ima_adpcm_groups(adpcm, src, size, dst, 1);
+	else
+		dst += dsp_encode_ima_adpcm_groups(adpcm, src, size, dst, 2);
+
+	return dst - start;
+}
+
+static void freerdp_dsp_encode_ima_adpcm(FREERDP_DSP_CONTEXT* context,
+	const uint8* src, int size, int channels, int block_size)
+{
+	int last_size;
+	DSP_BLOCK_JOB job;
+
+	context->adpcm_size = 0;
+
+	if (channels < 1 || channels > 2 || block_size <= 4 * channels || size <= 0)
+		return;
+
+	memset(&job, 0, sizeof(DSP_BLOCK_JOB));
+	job.func = dsp_encode_ima_adpcm_block;
+	job.src = src;
+	job.size = size;
+	job.channels = channels;
+	job.out_block = 4 * channels + (block_size - 4 * channels) / IMA_GROUP_BYTES(channels) * IMA_GROUP_BYTES(channels);
+	job.in_block = (job.out_block - 4 * channels) * 4;
+	job.blocks = (size + job.in_block - 1) / job.in_block;
+	memcpy(&job.first, &context->adpcm, sizeof(ADPCM));
+
+	freerdp_dsp_reserve_adpcm(context, job.blocks * job.out_block);
+	job.dst = context->adpcm_buffer;
+
+	last_size = freerdp_dsp_process_blocks(&job);
+	memcpy(&context->adpcm, &job.last, sizeof(ADPCM));
+
+	context->adpcm_size = (job.blocks - 1) * job.out_block + last_size;
 }
 
 /**
@@ -373,217 +1211,219 @@ static const sint16 ms_adpcm_coeff2_table[] =
 	0, -256, 0, 64, 0, -208, -232
 };
 
-static sint16 freerdp_dsp_decode_ms_adpcm_sample(ADPCM* adpcm, uint8 sample, int channel)
+static const sint8 ms_adpcm_nibble_table[] =
+{
+	0, 1, 2, 3, 4, 5, 6, 7,
+	-8, -7, -6, -5, -4, -3, -2, -1
+};
+
+#define MS_ADPCM_PREDICT(_adpcm, _channel) \
+	(((_adpcm)->ms.sample1[_channel] * ms_adpcm_coeff1_table[(_adpcm)->ms.predictor[_channel]] + \
+	(_adpcm)->ms.sample2[_channel] * ms_adpcm_coeff2_table[(_adpcm)->ms.predictor[_channel]]) / 256)
+
+static INLINE sint16 freerdp_dsp_decode_ms_adpcm_sample(ADPCM* adpcm, uint8 sample, int channel)
 {
-	sint8 nibble;
 	sint32 presample;
 
-	nibble = (sample & 0x08 ? (sint8)sample - 16 : sample);
-	presample = ((adpcm->ms.sample1[channel] * ms_adpcm_coeff1_table[adpcm->ms.predictor[channel]]) +
-		(adpcm->ms.sample2[channel] * ms_adpcm_coeff2_table[adpcm->ms.predictor[channel]])) / 256;
-	presample += nibble * adpcm->ms.delta[channel];
-	if (presample > 32767)
-		presample = 32767;
-	else if (presample < -32768)
-		presample = -32768;
+	presample = MS_ADPCM_PREDICT(adpcm, channel) + ms_adpcm_nibble_table[sample] * adpcm->ms.delta[channel];
+	presample = dsp_clamp_sint16(presample);
+
 	adpcm->ms.sample2[channel] = adpcm->ms.sample1[channel];
 	adpcm->ms.sample1[channel] = presample;
 	adpcm->ms.delta[channel] = adpcm->ms.delta[channel] * ms_adpcm_adaptation_table[sample] / 256;
-	if (adpcm->ms.delta[channel] < 16)
-		adpcm->ms.delta[channel] = 16;
+	adpcm->ms.delta[channel] = (adpcm->ms.delta[channel] < 16) ? 16 : adpcm->ms.delta[channel];
+
 	return (sint16) presample;
 }
 
-static void freerdp_dsp_decode_ms_adpcm(FREERDP_DSP_CONTEXT* context,
-	const uint8* src, int size, int channels, int block_size)
+/* the high nibble is for the first channel, the low nibble for the last one */
+static int dsp_decode_ms_adpcm_bytes(ADPCM* adpcm, const uint8* src, int size, sint16* dst, int channels)
 {
-	uint8* dst;
-	uint8 sample;
-	uint32 out_size;
+	int i;
 
-	out_size = size * 4;
-	if (out_size > context->adpcm_maxlength)
+	for (i = 0; i < size; i++)
 	{
-		context->adpcm_maxlength = out_size + 1024;
-		context->adpcm_buffer = xrealloc(context->adpcm_buffer, context->adpcm_maxlength);
+		*dst++ = freerdp_dsp_decode_ms_adpcm_sample(adpcm, src[i] >> 4, 0);
+		*dst++ = freerdp_dsp_decode_ms_adpcm_sample(adpcm, src[i] & 0x0F, channels - 1);
 	}
-	dst = context->adpcm_buffer;
-	while (size > 0)
+
+	return size * 4;
+}
+
+static int dsp_decode_ms_adpcm_block(DSP_BLOCK_JOB* job, ADPCM* adpcm, const uint8* src, int size, uint8* dst)
+{
+	int c;
+	int channels = job->channels;
+	sint16* out = (sint16*) dst;
+
+	/* predictors, deltas, then the first two samples of each channel, newest first */
+	for (c = 0; c < channels; c++)
 	{
-		if (size % block_size == 0)
-		{
-			if (channels > 1)
-			{
-				context->adpcm.ms.predictor[0] = *src++;
-				context->adpcm.ms.predictor[1] = *src++;
-				context->adpcm.ms.delta[0] = *((sint16*)src);
-				src += 2;
-				context->adpcm.ms.delta[1] = *((sint16*)src);
-				src += 2;
-				context->adpcm.ms.sample1[0] = *((sint16*)src);
-				src += 2;
-				context->adpcm.ms.sample1[1] = *((sint16*)src);
-				src += 2;
-				context->adpcm.ms.sample2[0] = *((sint16*)src);
-				src += 2;
-				context->adpcm.ms.sample2[1] = *((sint16*)src);
-				src += 2;
-				size -= 14;
-
-				*((sint16*)dst) = context->adpcm.ms.sample2[0];
-				dst += 2;
-				*((sint16*)dst) = context->adpcm.ms.sample2[1];
-				dst += 2;
-				*((sint16*)dst) = context->adpcm.ms.sample1[0];
-				dst += 2;
-				*((sint16*)dst) = context->adpcm.ms.sample1[1];
-				dst += 2;
-			}
-			else
-			{
-				context->adpcm.ms.predictor[0] = *src++;
-				context->adpcm.ms.delta[0] = *((sint16*)src);
-				src += 2;
-				context->adpcm.ms.sample1[0] = *((sint16*)src);
-				src += 2;
-				context->adpcm.ms.sample2[0] = *((sint16*)src);
-				src += 2;
-				size -= 7;
-
-				*((sint16*)dst) = context->adpcm.ms.sample2[0];
-				dst += 2;
-				*((sint16*)dst) = context->adpcm.ms.sample1[0];
-				dst += 2;
-			}
-		}
+		adpcm->ms.predictor[c] = (src[c] > 6) ? 0 : src[c];
+		adpcm->ms.delta[c] = dsp_read_sint16(src + channels + c * 2);
+		adpcm->ms.sample1[c] = dsp_read_sint16(src + channels * 3 + c * 2);
+		adpcm->ms.sample2[c] = dsp_read_sint16(src + channels * 5 + c * 2);
 
-		if (channels > 1)
-		{
-			sample = *src++;
-			size--;
-			*((sint16*)dst) = freerdp_dsp_decode_ms_adpcm_sample(&context->adpcm, sample >> 4, 0);
-			dst += 2;
-			*((sint16*)dst) = freerdp_dsp_decode_ms_adpcm_sample(&context->adpcm, sample & 0x0F, 1);
-			dst += 2;
-
-			sample = *src++;
-			size--;
-			*((sint16*)dst) = freerdp_dsp_decode_ms_adpcm_sample(&context->adpcm, sample >> 4, 0);
-			dst += 2;
-			*((sint16*)dst) = freerdp_dsp_decode_ms_adpcm_sample(&context->adpcm, sample & 0x0F, 1);
-			dst += 2;
-		}
-		else
-		{
-			sample = *src++;
-			size--;
-			*((sint16*)dst) = freerdp_dsp_decode_ms_adpcm_sample(&context->adpcm, sample >> 4, 0);
-			dst += 2;
-			*((sint16*)dst) = freerdp_dsp_decode_ms_adpcm_sample(&context->adpcm, sample & 0x0F, 0);
-			dst += 2;
-		}
+		out[c] = (sint16) adpcm->ms.sample2[c];
+		out[channels + c] = (sint16) adpcm->ms.sample1[c];
 	}
 
-	context->adpcm_size = dst - context->adpcm_buffer;
+	return channels * 4 + dsp_decode_ms_adpcm_bytes(adpcm, src + 7 * channels, size - 7 * channels,
+		out + 2 * channels, channels);
+}
+
+static void freerdp_dsp_decode_ms_adpcm(FREERDP_DSP_CONTEXT* context,
+	const uint8* src, int size, int channels, int block_size)
+{
+	int head;
+	int head_size;
+	DSP_BLOCK_JOB job;
+
+	context->adpcm_size = 0;
+
+	if (channels < 1 || channels > 2 || block_size <= 7 * channels || size <= 0)
+		return;
+
+	freerdp_dsp_reserve_adpcm(context, size * 4);
+
+	/* a block header is expected wherever the remaining size is a multiple of the block size */
+	head = size % block_size;
+	head_size = dsp_decode_ms_adpcm_bytes(&context->adpcm, src, head, (sint16*) context->adpcm_buffer, channels);
+
+	memset(&job, 0, sizeof(DSP_BLOCK_JOB));
+	job.func = dsp_decode_ms_adpcm_block;
+	job.src = src + head;
+	job.dst = context->adpcm_buffer + head_size;
+	job.size = size - head;
+	job.channels = channels;
+	job.in_block = block_size;
+	job.out_block = channels * 4 + (block_size - 7 * channels) * 4;
+	job.blocks = job.size / block_size;
+	memcpy(&job.first, &context->adpcm, sizeof(ADPCM));
+
+	freerdp_dsp_process_blocks(&job);
+	memcpy(&context->adpcm, &job.last, sizeof(ADPCM));
+
+	context->adpcm_size = head_size + job.blocks * job.out_block;
 }
 
-static uint8 freerdp_dsp_encode_ms_adpcm_sample(ADPCM* adpcm, sint32 sample, int channel)
+static INLINE uint8 freerdp_dsp_encode_ms_adpcm_sample(ADPCM* adpcm, sint32 sample, int channel)
 {
 	sint32 presample;
 	sint32 errordelta;
 
-	presample = ((adpcm->ms.sample1[channel] * ms_adpcm_coeff1_table[adpcm->ms.predictor[channel]]) +
-		(adpcm->ms.sample2[channel] * ms_adpcm_coeff2_table[adpcm->ms.predictor[channel]])) / 256;
+	presample = MS_ADPCM_PREDICT(adpcm, channel);
 	errordelta = (sample - presample) / adpcm->ms.delta[channel];
 	if ((sample - presample) % adpcm->ms.delta[channel] > adpcm->ms.delta[channel] / 2)
 		errordelta++;
-	if (errordelta > 7)
-		errordelta = 7;
-	else if (errordelta < -8)
-		errordelta = -8;
-	presample += adpcm->ms.delta[channel] * errordelta;
-	if (presample > 32767)
-		presample = 32767;
-	else if (presample < -32768)
-		presample = -32768;
+	errordelta = (errordelta > 7) ? 7 : errordelta;
+	errordelta = (errordelta < -8) ? -8 : errordelta;
+
+	presample = dsp_clamp_sint16(presample + adpcm->ms.delta[channel] * errordelta);
+
 	adpcm->ms.sample2[channel] = adpcm->ms.sample1[channel];
 	adpcm->ms.sample1[channel] = presample;
 	adpcm->ms.delta[channel] = adpcm->ms.delta[channel] * ms_adpcm_adaptation_table[(((uint8)errordelta) & 0x0F)] / 256;
-	if (adpcm->ms.delta[channel] < 16)
-		adpcm->ms.delta[channel] = 16;
+	adpcm->ms.delta[channel] = (adpcm->ms.delta[channel] < 16) ? 16 : adpcm->ms.delta[channel];
+
 	return ((uint8)errordelta) & 0x0F;
 }
 
-static void freerdp_dsp_encode_ms_adpcm(FREERDP_DSP_CONTEXT* context,
-	const uint8* src, int size, int channels, int block_size)
+static int dsp_encode_ms_adpcm_block(DSP_BLOCK_JOB* job, ADPCM* adpcm, const uint8* src, int size, uint8* dst)
 {
-	uint8* dst;
-	sint32 sample;
-	uint32 out_size;
+	int c;
+	sint32 delta;
+	int channels = job->channels;
+	boolean first_block = (src == job->src);
+	uint8* start = dst;
+	uint8 padded[8];
 
-	out_size = size / 2;
-	if (out_size > context->adpcm_maxlength)
+	if (size < channels * 4)
 	{
-		context->adpcm_maxlength = out_size + 1024;
-		context->adpcm_buffer = xrealloc(context->adpcm_buffer, context->adpcm_maxlength);
+		memset(padded, 0, sizeof(padded));
+		memcpy(padded, src, size);
+		src = padded;
+		size = channels * 4;
 	}
-	dst = context->adpcm_buffer;
 
-	if (context->adpcm.ms.delta[0] < 16)
-		context->adpcm.ms.delta[0] = 16;
-	if (context->adpcm.ms.delta[1] < 16)
-		context->adpcm.ms.delta[1] = 16;
+	for (c = 0; c < channels; c++)
+	{
+		adpcm->ms.sample2[c] = dsp_read_sint16(src + c * 2);
+		adpcm->ms.sample1[c] = dsp_read_sint16(src + (channels + c) * 2);
+
+		if (!first_block)
+		{
+			/* no previous state to continue from, guess the delta from the first samples */
+			delta = (adpcm->ms.sample1[c] - adpcm->ms.sample2[c]) / 4;
+			delta = (delta < 0) ? -delta : delta;
+			adpcm->ms.predictor[c] = job->first.ms.predictor[c];
+			adpcm->ms.delta[c] = delta;
+		}
+
+		adpcm->ms.delta[c] = (adpcm->ms.delta[c] < 16) ? 16 : adpcm->ms.delta[c];
+	}
+
+	for (c = 0; c < channels; c++)
+		dst[c] = adpcm->ms.predictor[c];
+
+	for (c = 0; c < channels; c++)
+	{
+		dsp_write_sint16(dst + channels + c * 2, (sint16) adpcm->ms.delta[c]);
+		dsp_write_sint16(dst + channels * 3 + c * 2, (sint16) adpcm->ms.sample1[c]);
+		dsp_write_sint16(dst + channels * 5 + c * 2, (sint16) adpcm->ms.sample2[c]);
+	}
+
+	dst += 7 * channels;
+	src += 4 * channels;
+	size -= 4 * channels;
 
 	while (size > 0)
 	{
-		if ((dst - context->adpcm_buffer) % block_size == 0)
+		if (size < 4)
 		{
-			if (channels > 1)
-			{
-				*dst++ = context->adpcm.ms.predictor[0];
-				*dst++ = context->adpcm.ms.predictor[1];
-				*dst++ = (uint8) (context->adpcm.ms.delta[0] & 0xff);
-				*dst++ = (uint8) ((context->adpcm.ms.delta[0] >> 8) & 0xff);
-				*dst++ = (uint8) (context->adpcm.ms.delta[1] & 0xff);
-				*dst++ = (uint8) ((context->adpcm.ms.delta[1] >> 8) & 0xff);
-				context->adpcm.ms.sample1[0] = *((sint16*) (src + 4));
-				context->adpcm.ms.sample1[1] = *((sint16*) (src + 6));
-				context->adpcm.ms.sample2[0] = *((sint16*) (src + 0));
-				context->adpcm.ms.sample2[1] = *((sint16*) (src + 2));
-				*((sint16*) (dst + 0)) = (sint16) context->adpcm.ms.sample1[0];
-				*((sint16*) (dst + 2)) = (sint16) context->adpcm.ms.sample1[1];
-				*((sint16*) (dst + 4)) = (sint16) context->adpcm.ms.sample2[0];
-				*((sint16*) (dst + 6)) = (sint16) context->adpcm.ms.sample2[1];
-				dst += 8;
-				src += 8;
-				size -= 8;
-			}
-			else
-			{
-				*dst++ = context->adpcm.ms.predictor[0];
-				*dst++ = (uint8) (context->adpcm.ms.delta[0] & 0xff);
-				*dst++ = (uint8) ((context->adpcm.ms.delta[0] >> 8) & 0xff);
-				context->adpcm.ms.sample1[0] = *((sint16*) (src + 2));
-				context->adpcm.ms.sample2[0] = *((sint16*) (src + 0));
-				*((sint16*) (dst + 0)) = (sint16) context->adpcm.ms.sample1[0];
-				*((sint16*) (dst + 2)) = (sint16) context->adpcm.ms.sample2[0];
-				dst += 4;
-				src += 4;
-				size -= 4;
-			}
+			memset(padded, 0, sizeof(padded));
+			memcpy(padded, src, size);
+			src = padded;
+			size = 4;
 		}
 
-		sample = *((sint16*) src);
-		src += 2;
-		*dst = freerdp_dsp_encode_ms_adpcm_sample(&context->adpcm, sample, 0) << 4;
-		sample = *((sint16*) src);
-		src += 2;
-		*dst += freerdp_dsp_encode_ms_adpcm_sample(&context->adpcm, sample, channels > 1 ? 1 : 0);
-		dst++;
+		*dst = freerdp_dsp_encode_ms_adpcm_sample(adpcm, dsp_read_sint16(src), 0) << 4;
+		*dst++ |= freerdp_dsp_encode_ms_adpcm_sample(adpcm, dsp_read_sint16(src + 2), channels - 1);
+		src += 4;
 		size -= 4;
 	}
-	
-	context->adpcm_size = dst - context->adpcm_buffer;
+
+	return dst - start;
+}
+
+static void freerdp_dsp_encode_ms_adpcm(FREERDP_DSP_CONTEXT* context,
+	const uint8* src, int size, int channels, int block_size)
+{
+	int last_size;
+	DSP_BLOCK_JOB job;
+
+	context->adpcm_size = 0;
+
+	if (channels < 1 || channels > 2 || block_size <= 7 * channels || size <= 0)
+		return;
+
+	memset(&job, 0, sizeof(DSP_BLOCK_JOB));
+	job.func = dsp_encode_ms_adpcm_block;
+	job.src = src;
+	job.size = size;
+	job.channels = channels;
+	job.in_block = channels * 4 + (block_size - 7 * channels) * 4;
+	job.out_block = block_size;
+	job.blocks = (size + job.in_block - 1) / job.in_block;
+	memcpy(&job.first, &context->adpcm, sizeof(ADPCM));
+
+	freerdp_dsp_reserve_adpcm(context, job.blocks * job.out_block);
+	job.dst = context->adpcm_buffer;
+
+	last_size = freerdp_dsp_process_blocks(&job);
+	memcpy(&context->adpcm, &job.last, sizeof(ADPCM));
+
+	context->adpcm_size = (job.blocks - 1) * job.out_block + last_size;
 }
 
 FREERDP_DSP_CONTEXT* freerdp_dsp_context_new(void)
@@ -607,6 +1447,8 @@ void freerdp_dsp_context_free(FREERDP_DSP_CONTEXT* context)
 	{
 		if (context->resampled_buffer)
 			xfree(context->resampled_buffer);
+		if (context->mix_buffer)
+			xfree(context->mix_buffer);
 		if (context->adpcm_buffer)
 			xfree(context->adpcm_buffer);
 		xfree(context);
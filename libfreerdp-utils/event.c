@@ -44,6 +44,12 @@ static RDP_EVENT* freerdp_cliprdr_event_new(uint16 event_type)
 		case RDP_EVENT_TYPE_CB_DATA_RESPONSE:
 			event = (RDP_EVENT*) xnew(RDP_CB_DATA_RESPONSE_EVENT);
 			break;
+		case RDP_EVENT_TYPE_CB_FILECONTENTS_REQUEST:
+			event = (RDP_EVENT*) xnew(RDP_CB_FILECONTENTS_REQUEST_EVENT);
+			break;
+		case RDP_EVENT_TYPE_CB_FILECONTENTS_RESPONSE:
+			event = (RDP_EVENT*) xnew(RDP_CB_FILECONTENTS_RESPONSE_EVENT);
+			break;
 	}
 
 	return event;
@@ -122,6 +128,12 @@ static void freerdp_cliprdr_event_free(RDP_EVENT* event)
 				xfree(cb_event->data);
 			}
 			break;
+		case RDP_EVENT_TYPE_CB_FILECONTENTS_RESPONSE:
+			{
+				RDP_CB_FILECONTENTS_RESPONSE_EVENT* cb_event = (RDP_CB_FILECONTENTS_RESPONSE_EVENT*)event;
+				xfree(cb_event->data);
+			}
+			break;
 	}
 }
 
@@ -0,0 +1,377 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Runtime Metrics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/metrics.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef _WIN32
+#define METRICS_ADD(_p, _v)		InterlockedExchangeAdd64((volatile LONGLONG*) (_p), (LONGLONG) (_v))
+#define METRICS_CAS(_p, _o, _n)		((uint64) InterlockedCompareExchange64((volatile LONGLONG*) (_p), (LONGLONG) (_n), (LONGLONG) (_o)))
+#define METRICS_XCHG(_p, _v)		InterlockedExchange64((volatile LONGLONG*) (_p), (LONGLONG) (_v))
+#else
+#define METRICS_ADD(_p, _v)		__sync_fetch_and_add((_p), (uint64) (_v))
+#define METRICS_CAS(_p, _o, _n)		__sync_val_compare_and_swap((_p), (uint64) (_o), (uint64) (_n))
+#define METRICS_XCHG(_p, _v)		__sync_lock_test_and_set((_p), (uint64) (_v))
+#endif
+
+/* aligned 64-bit loads are atomic on 64-bit targets, 32-bit ones need a locked operation */
+#if defined(__LP64__) || defined(_WIN64)
+#define METRICS_LOAD(_p)		(*(volatile uint64*) (_p))
+#else
+#define METRICS_LOAD(_p)		((uint64) METRICS_ADD((_p), 0))
+#endif
+
+static const char* const METRICS_COUNTER_NAMES[] =
+{
+	"bytes_in",
+	"bytes_out",
+	"pdus_in",
+	"pdus_out",
+	"mppc_bytes_in",
+	"mppc_bytes_out",
+	"mppc_uncompressed",
+	"rfx_tiles_decoded",
+	"rfx_tiles_encoded",
+	"rfx_tiles_skipped",
+	"nsc_pixels_decoded",
+	"nsc_pixels_encoded",
+	"bitmap_cache_hits",
+	"bitmap_cache_misses",
+	"glyph_cache_hits",
+	"glyph_cache_misses",
+	"frames",
+	"tls_handshakes",
+	"tls_resumed"
+};
+
+static const char* const METRICS_GAUGE_NAMES[] =
+{
+	"recv_buffer",
+	"render_queue",
+	"send_queue"
+};
+
+static const char* const METRICS_HISTOGRAM_NAMES[] =
+{
+	"frame_time",
+	"rfx_decode",
+	"rfx_encode",
+	"nsc_decode",
+	"nsc_encode",
+	"gdi_bitmap_update",
+	"gdi_surface_bits",
+	"connect_nego",
+	"connect_tls",
+	"connect_nla",
+	"connect_mcs",
+	"connect_license",
+	"connect_capabilities"
+};
+
+/**
+ * Monotonic time in microseconds, unaffected by changes to the wall clock.
+ */
+
+uint64 metrics_time(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER count;
+	static LARGE_INTEGER frequency;
+
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+
+	QueryPerformanceCounter(&count);
+
+	return (uint64) ((count.QuadPart / frequency.QuadPart) * 1000000 +
+		((count.QuadPart % frequency.QuadPart) * 1000000) / frequency.QuadPart);
+#elif defined(__APPLE__)
+	static mach_timebase_info_data_t timebase;
+
+	if (timebase.denom == 0)
+		mach_timebase_info(&timebase);
+
+	return (mach_absolute_time() * timebase.numer / timebase.denom) / 1000;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static void metrics_update_max(uint64* max, uint64 value)
+{
+	uint64 current;
+
+	current = METRICS_LOAD(max);
+
+	while (value > current)
+	{
+		uint64 previous = METRICS_CAS(max, current, value);
+
+		if (previous == current)
+			break;
+
+		current = previous;
+	}
+}
+
+void metrics_count(rdpMetrics* metrics, int counter, uint64 value)
+{
+	if (metrics == NULL)
+		return;
+
+	METRICS_ADD(&metrics->values.counters[counter], value);
+}
+
+void metrics_gauge(rdpMetrics* metrics, int gauge, uint64 value)
+{
+	METRICS_GAUGE_VALUE* gauge_value;
+
+	if (metrics == NULL)
+		return;
+
+	gauge_value = &metrics->values.gauges[gauge];
+
+	METRICS_XCHG(&gauge_value->value, value);
+	metrics_update_max(&gauge_value->max, value);
+}
+
+void metrics_record(rdpMetrics* metrics, int histogram, uint64 usec)
+{
+	int bucket;
+	uint64 value;
+	METRICS_HISTOGRAM_VALUE* histogram_value;
+
+	if (metrics == NULL)
+		return;
+
+	histogram_value = &metrics->values.histograms[histogram];
+
+	/* index of the highest bit set, plus one */
+	bucket = 0;
+
+	for (value = usec; value != 0 && bucket < METRICS_HISTOGRAM_BUCKETS - 1; value >>= 1)
+		bucket++;
+
+	METRICS_ADD(&histogram_value->buckets[bucket], 1);
+	METRICS_ADD(&histogram_value->count, 1);
+	METRICS_ADD(&histogram_value->sum, usec);
+	metrics_update_max(&histogram_value->max, usec);
+}
+
+/**
+ * Record the time elapsed since a METRICS_START() timestamp.
+ */
+
+void metrics_record_since(rdpMetrics* metrics, int histogram, uint64 start)
+{
+	if (metrics == NULL)
+		return;
+
+	metrics_record(metrics, histogram, metrics_time() - start);
+}
+
+/**
+ * Connection phases run one after the other on the thread driving the
+ * connection: each metrics_phase_end() records the time since the previous
+ * one, or since metrics_phase_begin(), and starts the next phase.
+ */
+
+void metrics_phase_begin(rdpMetrics* metrics)
+{
+	if (metrics == NULL)
+		return;
+
+	metrics->phase = metrics_time();
+}
+
+void metrics_phase_end(rdpMetrics* metrics, int histogram)
+{
+	uint64 now;
+
+	if (metrics == NULL)
+		return;
+
+	now = metrics_time();
+	metrics_record(metrics, histogram, now - metrics->phase);
+	metrics->phase = now;
+}
+
+void metrics_pdu_in(rdpMetrics* metrics, int type, uint32 length)
+{
+	if (metrics == NULL)
+		return;
+
+	METRICS_ADD(&metrics->values.pdu_in[type].count, 1);
+	METRICS_ADD(&metrics->values.pdu_in[type].bytes, length);
+}
+
+void metrics_pdu_out(rdpMetrics* metrics, int type, uint32 length)
+{
+	if (metrics == NULL)
+		return;
+
+	METRICS_ADD(&metrics->values.pdu_out[type].count, 1);
+	METRICS_ADD(&metrics->values.pdu_out[type].bytes, length);
+}
+
+/**
+ * Current value of a single counter or gauge, without taking a whole snapshot.
+ */
+
+uint64 metrics_get_counter(rdpMetrics* metrics, int counter)
+{
+	if (metrics == NULL)
+		return 0;
+
+	return METRICS_LOAD(&metrics->values.counters[counter]);
+}
+
+uint64 metrics_get_gauge(rdpMetrics* metrics, int gauge)
+{
+	if (metrics == NULL)
+		return 0;
+
+	return METRICS_LOAD(&metrics->values.gauges[gauge].value);
+}
+
+/**
+ * Copy the current values, one word at a time. Values recorded while the
+ * copy is in progress may or may not be included, but no word is torn.
+ */
+
+void metrics_snapshot(rdpMetrics* metrics, METRICS_SNAPSHOT* snapshot)
+{
+	int i;
+	uint64* src;
+	uint64* dst;
+
+	if (metrics == NULL)
+	{
+		memset(snapshot, 0, sizeof(METRICS_SNAPSHOT));
+		return;
+	}
+
+	src = (uint64*) &metrics->values;
+	dst = (uint64*) snapshot;
+
+	for (i = 0; i < sizeof(METRICS_SNAPSHOT) / sizeof(uint64); i++)
+		dst[i] = METRICS_LOAD(&src[i]);
+
+	snapshot->uptime = metrics_time() - metrics->start;
+}
+
+/**
+ * Upper bound of the bucket holding the given percentile, clamped to the
+ * largest value recorded. Bucket resolution makes this accurate to a factor of two.
+ */
+
+uint64 metrics_histogram_percentile(METRICS_HISTOGRAM_VALUE* histogram, int percentile)
+{
+	int i;
+	uint64 rank;
+	uint64 seen;
+	uint64 bound;
+
+	if (histogram->count == 0)
+		return 0;
+
+	rank = (histogram->count * percentile + 99) / 100;
+	seen = 0;
+
+	for (i = 0; i < METRICS_HISTOGRAM_BUCKETS - 1; i++)
+	{
+		seen += histogram->buckets[i];
+
+		if (seen >= rank)
+		{
+			bound = ((uint64) 1) << i;
+			return (bound < histogram->max) ? bound : histogram->max;
+		}
+	}
+
+	return histogram->max;
+}
+
+const char* metrics_counter_name(int counter)
+{
+	if (counter < 0 || counter >= METRICS_COUNTER_COUNT)
+		return NULL;
+
+	return METRICS_COUNTER_NAMES[counter];
+}
+
+const char* metrics_gauge_name(int gauge)
+{
+	if (gauge < 0 || gauge >= METRICS_GAUGE_COUNT)
+		return NULL;
+
+	return METRICS_GAUGE_NAMES[gauge];
+}
+
+const char* metrics_histogram_name(int histogram)
+{
+	if (histogram < 0 || histogram >= METRICS_HISTOGRAM_COUNT)
+		return NULL;
+
+	return METRICS_HISTOGRAM_NAMES[histogram];
+}
+
+void metrics_reset(rdpMetrics* metrics)
+{
+	int i;
+	uint64* values;
+
+	values = (uint64*) &metrics->values;
+
+	for (i = 0; i < sizeof(METRICS_SNAPSHOT) / sizeof(uint64); i++)
+		METRICS_XCHG(&values[i], 0);
+
+	metrics->start = metrics_time();
+}
+
+rdpMetrics* metrics_new(void)
+{
+	rdpMetrics* metrics;
+
+	metrics = xnew(rdpMetrics);
+
+	if (metrics != NULL)
+		metrics->start = metrics_time();
+
+	return metrics;
+}
+
+void metrics_free(rdpMetrics* metrics)
+{
+	xfree(metrics);
+}
@@ -0,0 +1,344 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Session Recording File Format Utils
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef _WIN32
+#include <winpr/windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <freerdp/types.h>
+#include <freerdp/utils/memory.h>
+
+#include <freerdp/utils/record.h>
+
+static uint64 record_get_time(void)
+{
+#ifdef _WIN32
+	return (uint64) GetTickCount() * 1000;
+#else
+	struct timeval tp;
+
+	gettimeofday(&tp, 0);
+	return ((uint64) tp.tv_sec * 1000000) + tp.tv_usec;
+#endif
+}
+
+static void record_add_index(rdpRecord* record, uint64 offset, uint64 timestamp)
+{
+	if (record->count == record->index_size)
+	{
+		record->index_size = (record->index_size > 0) ? record->index_size * 2 : 1024;
+		record->index = (RECORD_INDEX*) xrealloc(record->index, sizeof(RECORD_INDEX) * record->index_size);
+	}
+
+	record->index[record->count].offset = offset;
+	record->index[record->count].timestamp = timestamp;
+	record->count++;
+}
+
+static boolean record_read_header(rdpRecord* record)
+{
+	uint32 magic;
+	uint16 version;
+	STREAM* s = record->s;
+
+	stream_set_pos(s, 0);
+
+	if (fread(s->data, RECORD_HEADER_LENGTH, 1, record->fp) != 1)
+		return false;
+
+	stream_read_uint32(s, magic); /* magic (4 bytes) */
+	stream_read_uint16(s, version); /* version (2 bytes) */
+	stream_seek_uint16(s); /* reserved (2 bytes) */
+	stream_read_uint64(s, record->start_time); /* startTime (8 bytes), UNIX time in microseconds */
+
+	return (magic == RECORD_MAGIC && version == RECORD_VERSION) ? true : false;
+}
+
+static void record_write_header(rdpRecord* record)
+{
+	STREAM* s = record->s;
+
+	stream_set_pos(s, 0);
+	stream_write_uint32(s, RECORD_MAGIC); /* magic (4 bytes) */
+	stream_write_uint16(s, RECORD_VERSION); /* version (2 bytes) */
+	stream_write_uint16(s, 0); /* reserved (2 bytes) */
+	stream_write_uint64(s, record->start_time); /* startTime (8 bytes) */
+
+	fwrite(s->data, RECORD_HEADER_LENGTH, 1, record->fp);
+}
+
+static boolean record_read_entry_header(rdpRecord* record, RECORD_ENTRY* entry, uint32* delta)
+{
+	STREAM* s = record->s;
+
+	stream_set_pos(s, 0);
+
+	if (fread(s->data, RECORD_ENTRY_HEADER_LENGTH, 1, record->fp) != 1)
+		return false;
+
+	stream_read_uint8(s, entry->type); /* type (1 byte) */
+	stream_seek_uint8(s); /* reserved (1 byte) */
+	stream_read_uint16(s, entry->id); /* id (2 bytes) */
+	stream_read_uint32(s, *delta); /* delta (4 bytes), microseconds since the previous record */
+	stream_read_uint32(s, entry->length); /* length (4 bytes) */
+
+	return true;
+}
+
+/* load the index written by record_close(), or rebuild it from the records */
+static boolean record_read_index(rdpRecord* record)
+{
+	int i;
+	long size;
+	long offset;
+	uint32 magic;
+	uint32 count;
+	uint32 delta;
+	uint64 index_offset;
+	uint64 timestamp;
+	RECORD_ENTRY entry;
+	STREAM* s = record->s;
+
+	fseek(record->fp, 0, SEEK_END);
+	size = ftell(record->fp);
+
+	if (size >= RECORD_HEADER_LENGTH + RECORD_TRAILER_LENGTH)
+	{
+		fseek(record->fp, size - RECORD_TRAILER_LENGTH, SEEK_SET);
+		stream_set_pos(s, 0);
+
+		if (fread(s->data, RECORD_TRAILER_LENGTH, 1, record->fp) == 1)
+		{
+			stream_read_uint32(s, magic); /* magic (4 bytes) */
+			stream_read_uint32(s, count); /* count (4 bytes) */
+			stream_read_uint64(s, index_offset); /* indexOffset (8 bytes) */
+
+			if (magic == RECORD_INDEX_MAGIC && index_offset >= RECORD_HEADER_LENGTH &&
+				index_offset + (uint64) count * 16 + RECORD_TRAILER_LENGTH == (uint64) size)
+			{
+				record->index_size = (count > 0) ? count : 1;
+				record->index = (RECORD_INDEX*) xmalloc(sizeof(RECORD_INDEX) * record->index_size);
+				fseek(record->fp, (long) index_offset, SEEK_SET);
+
+				for (i = 0; i < (int) count; i++)
+				{
+					stream_set_pos(s, 0);
+
+					if (fread(s->data, 16, 1, record->fp) != 1)
+						break;
+
+					stream_read_uint64(s, record->index[i].offset);
+					stream_read_uint64(s, record->index[i].timestamp);
+				}
+
+				if (i == (int) count)
+				{
+					record->count = count;
+					record->data_end = (long) index_offset;
+					return true;
+				}
+
+				record->count = 0;
+			}
+		}
+	}
+
+	/* no usable index, the recording was not closed properly */
+	offset = RECORD_HEADER_LENGTH;
+	timestamp = 0;
+	fseek(record->fp, offset, SEEK_SET);
+
+	while (offset + RECORD_ENTRY_HEADER_LENGTH <= size)
+	{
+		if (!record_read_entry_header(record, &entry, &delta))
+			break;
+
+		if (offset + RECORD_ENTRY_HEADER_LENGTH + (long) entry.length > size)
+			break;
+
+		timestamp += delta;
+		record_add_index(record, offset, timestamp);
+
+		offset += RECORD_ENTRY_HEADER_LENGTH + entry.length;
+		fseek(record->fp, offset, SEEK_SET);
+	}
+
+	record->data_end = offset;
+
+	return true;
+}
+
+static void record_write_index(rdpRecord* record)
+{
+	uint32 i;
+	long index_offset;
+	STREAM* s = record->s;
+
+	index_offset = ftell(record->fp);
+
+	for (i = 0; i < record->count; i++)
+	{
+		stream_set_pos(s, 0);
+		stream_write_uint64(s, record->index[i].offset); /* offset (8 bytes) */
+		stream_write_uint64(s, record->index[i].timestamp); /* timestamp (8 bytes) */
+		fwrite(s->data, 16, 1, record->fp);
+	}
+
+	stream_set_pos(s, 0);
+	stream_write_uint32(s, RECORD_INDEX_MAGIC); /* magic (4 bytes) */
+	stream_write_uint32(s, record->count); /* count (4 bytes) */
+	stream_write_uint64(s, (uint64) index_offset); /* indexOffset (8 bytes) */
+	fwrite(s->data, RECORD_TRAILER_LENGTH, 1, record->fp);
+}
+
+void record_write(rdpRecord* record, uint8 type, uint16 id, uint8* data, uint32 length)
+{
+	uint64 now;
+	uint64 delta;
+	STREAM* s = record->s;
+
+	if (!record->write)
+		return;
+
+	now = record_get_time() - record->start_time;
+	delta = (now > record->timestamp) ? now - record->timestamp : 0;
+
+	if (delta > 0xFFFFFFFF)
+		delta = 0xFFFFFFFF;
+
+	record->timestamp += delta;
+	record_add_index(record, ftell(record->fp), record->timestamp);
+
+	stream_set_pos(s, 0);
+	stream_write_uint8(s, type); /* type (1 byte) */
+	stream_write_uint8(s, 0); /* reserved (1 byte) */
+	stream_write_uint16(s, id); /* id (2 bytes) */
+	stream_write_uint32(s, (uint32) delta); /* delta (4 bytes) */
+	stream_write_uint32(s, length); /* length (4 bytes) */
+
+	fwrite(s->data, RECORD_ENTRY_HEADER_LENGTH, 1, record->fp);
+
+	if (length > 0)
+		fwrite(data, length, 1, record->fp);
+}
+
+boolean record_read(rdpRecord* record, RECORD_ENTRY* entry)
+{
+	uint32 delta;
+
+	if (record->write || record->position >= record->count)
+		return false;
+
+	if (!record_read_entry_header(record, entry, &delta))
+		return false;
+
+	if (entry->length > record->buffer_size)
+	{
+		record->buffer_size = entry->length;
+		record->buffer = (uint8*) xrealloc(record->buffer, record->buffer_size);
+	}
+
+	if (entry->length > 0 && fread(record->buffer, entry->length, 1, record->fp) != 1)
+		return false;
+
+	entry->data = record->buffer;
+	entry->timestamp = record->index[record->position].timestamp;
+	record->timestamp = entry->timestamp;
+	record->position++;
+
+	return true;
+}
+
+boolean record_seek(rdpRecord* record, uint32 index)
+{
+	if (record->write || index > record->count)
+		return false;
+
+	if (index == record->count)
+		fseek(record->fp, record->data_end, SEEK_SET);
+	else
+		fseek(record->fp, (long) record->index[index].offset, SEEK_SET);
+
+	record->position = index;
+
+	return true;
+}
+
+uint32 record_get_count(rdpRecord* record)
+{
+	return record->count;
+}
+
+rdpRecord* record_open(const char* name, boolean write)
+{
+	FILE* fp;
+	rdpRecord* record;
+
+	fp = fopen(name, write ? "w+b" : "rb");
+
+	if (fp == NULL)
+	{
+		perror("opening recording failed");
+		return NULL;
+	}
+
+	record = xnew(rdpRecord);
+	record->name = xstrdup(name);
+	record->write = write;
+	record->fp = fp;
+	record->s = stream_new(RECORD_HEADER_LENGTH);
+
+	if (write)
+	{
+		record->start_time = record_get_time();
+		record_write_header(record);
+	}
+	else
+	{
+		if (!record_read_header(record) || !record_read_index(record))
+		{
+			printf("%s is not a recording\n", name);
+			record_close(record);
+			return NULL;
+		}
+
+		record_seek(record, 0);
+	}
+
+	return record;
+}
+
+void record_close(rdpRecord* record)
+{
+	if (record == NULL)
+		return;
+
+	if (record->write)
+		record_write_index(record);
+
+	fclose(record->fp);
+	stream_free(record->s);
+	xfree(record->index);
+	xfree(record->buffer);
+	xfree(record->name);
+	xfree(record);
+}
@@ -17,81 +17,266 @@
  * limitations under the License.
  */
 
-#include <errno.h>
 #include <wctype.h>
+#include <freerdp/types.h>
 #include <freerdp/utils/memory.h>
 
 #include <freerdp/utils/unicode.h>
 
-/* Convert pin/in_len from WINDOWS_CODEPAGE - return like xstrdup, 0-terminated */
+#ifdef WITH_SSE2
+#include <emmintrin.h>
+#endif
 
-char* freerdp_uniconv_in(UNICONV* uniconv, unsigned char* pin, size_t in_len)
+#define UNICODE_REPLACEMENT_CHARACTER	0xFFFD
+
+/**
+ * Decode one UTF-8 sequence, returning the number of bytes consumed.
+ * Truncated and invalid sequences, overlong forms, surrogates and values
+ * past U+10FFFF decode as U+FFFD, consuming the bytes examined so far.
+ */
+
+static int freerdp_utf8_decode(const uint8* src, int length, uint32* wc)
 {
-	unsigned char *conv_pin = pin;
-	size_t conv_in_len = in_len;
-	char *pout = xmalloc(in_len * 2 + 1), *conv_pout = pout;
-	size_t conv_out_len = in_len * 2;
+	int i;
+	int n;
+	uint32 c;
+
+	c = src[0];
 
-#ifdef HAVE_ICONV
-	if (iconv(uniconv->in_iconv_h, (ICONV_CONST char **) &conv_pin, &conv_in_len, &conv_pout, &conv_out_len) == (size_t) - 1)
+	if (c < 0x80)
 	{
-		/* TODO: xrealloc if conv_out_len == 0 - it shouldn't be needed, but would allow a smaller initial alloc ... */
-		printf("freerdp_uniconv_in: iconv failure\n");
-		return 0;
+		*wc = c;
+		return 1;
 	}
-#else
-	while (conv_in_len >= 2)
+	else if (c >= 0xC2 && c < 0xE0)
 	{
-		unsigned int wc;
-
-		wc = (unsigned int)(unsigned char)(*conv_pin++);
-		wc += ((unsigned int)(unsigned char)(*conv_pin++)) << 8;
-		conv_in_len -= 2;
+		n = 2;
+		c &= 0x1F;
+	}
+	else if (c >= 0xE0 && c < 0xF0)
+	{
+		n = 3;
+		c &= 0x0F;
+	}
+	else if (c >= 0xF0 && c < 0xF5)
+	{
+		n = 4;
+		c &= 0x07;
+	}
+	else
+	{
+		*wc = UNICODE_REPLACEMENT_CHARACTER;
+		return 1;
+	}
 
-		if (wc >= 0xD800 && wc <= 0xDFFF && conv_in_len >= 2)
+	for (i = 1; i < n; i++)
+	{
+		if (i >= length || (src[i] & 0xC0) != 0x80)
 		{
-			/* Code points U+10000 to U+10FFFF using surrogate pair */
-			wc = ((wc - 0xD800) << 10) + 0x10000;
-			wc += (unsigned int)(unsigned char)(*conv_pin++);
-			wc += ((unsigned int)(unsigned char)(*conv_pin++) - 0xDC) << 8;
-			conv_in_len -= 2;
+			*wc = UNICODE_REPLACEMENT_CHARACTER;
+			return i;
 		}
 
-		if (wc <= 0x7F)
-		{
-			*conv_pout++ = (char)wc;
-			conv_out_len--;
-		}
-		else if (wc <= 0x07FF)
+		c = (c << 6) | (src[i] & 0x3F);
+	}
+
+	if ((n == 3 && c < 0x800) || (n == 4 && (c < 0x10000 || c > 0x10FFFF)) ||
+			(c >= 0xD800 && c <= 0xDFFF))
+		c = UNICODE_REPLACEMENT_CHARACTER;
+
+	*wc = c;
+	return n;
+}
+
+int freerdp_utf16_to_utf8(const uint8* src, int src_length, char* dst, int dst_length)
+{
+	int i;
+	int n;
+	int count;
+	int length;
+	uint32 wc;
+	uint32 wc2;
+	uint8* out;
+#ifdef WITH_SSE2
+	__m128i a, b;
+	__m128i zero = _mm_setzero_si128();
+	__m128i mask = _mm_set1_epi16((short) 0xFF80);
+#endif
+
+	i = 0;
+	length = 0;
+	count = src_length / 2;
+	out = (uint8*) dst;
+
+	while (i < count)
+	{
+#ifdef WITH_SSE2
+		/* ASCII runs, 16 code units at a time */
+		while (i + 16 <= count)
 		{
-			*conv_pout++ = (char)(0xC0 + (wc >> 6));
-			*conv_pout++ = (char)(0x80 + (wc & 0x3F));
-			conv_out_len -= 2;
+			a = _mm_loadu_si128((__m128i*) &src[i * 2]);
+			b = _mm_loadu_si128((__m128i*) &src[i * 2 + 16]);
+
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(_mm_or_si128(a, b), mask), zero)) != 0xFFFF)
+				break;
+
+			if (dst != NULL)
+			{
+				if (length + 16 > dst_length)
+					return -1;
+
+				_mm_storeu_si128((__m128i*) &out[length], _mm_packus_epi16(a, b));
+			}
+
+			length += 16;
+			i += 16;
 		}
-		else if (wc <= 0xFFFF)
+
+		if (i >= count)
+			break;
+#endif
+		wc = src[i * 2] | (src[i * 2 + 1] << 8);
+		i++;
+
+		if (wc >= 0xD800 && wc <= 0xDFFF)
 		{
-			*conv_pout++ = (char)(0xE0 + (wc >> 12));
-			*conv_pout++ = (char)(0x80 + ((wc >> 6) & 0x3F));
-			*conv_pout++ = (char)(0x80 + (wc & 0x3F));
-			conv_out_len -= 3;
+			wc2 = (i < count) ? (src[i * 2] | (src[i * 2 + 1] << 8)) : 0;
+
+			if (wc < 0xDC00 && wc2 >= 0xDC00 && wc2 <= 0xDFFF)
+			{
+				/* Code points U+10000 to U+10FFFF using surrogate pair */
+				wc = 0x10000 + ((wc - 0xD800) << 10) + (wc2 - 0xDC00);
+				i++;
+			}
+			else
+			{
+				wc = UNICODE_REPLACEMENT_CHARACTER;
+			}
 		}
-		else
+
+		n = (wc < 0x80) ? 1 : ((wc < 0x800) ? 2 : ((wc < 0x10000) ? 3 : 4));
+
+		if (dst != NULL)
 		{
-			*conv_pout++ = (char)(0xF0 + (wc >> 18));
-			*conv_pout++ = (char)(0x80 + ((wc >> 12) & 0x3F));
-			*conv_pout++ = (char)(0x80 + ((wc >> 6) & 0x3F));
-			*conv_pout++ = (char)(0x80 + (wc & 0x3F));
-			conv_out_len -= 4;
+			if (length + n > dst_length)
+				return -1;
+
+			switch (n)
+			{
+				case 1:
+					out[length] = (uint8) wc;
+					break;
+
+				case 2:
+					out[length] = (uint8) (0xC0 | (wc >> 6));
+					out[length + 1] = (uint8) (0x80 | (wc & 0x3F));
+					break;
+
+				case 3:
+					out[length] = (uint8) (0xE0 | (wc >> 12));
+					out[length + 1] = (uint8) (0x80 | ((wc >> 6) & 0x3F));
+					out[length + 2] = (uint8) (0x80 | (wc & 0x3F));
+					break;
+
+				default:
+					out[length] = (uint8) (0xF0 | (wc >> 18));
+					out[length + 1] = (uint8) (0x80 | ((wc >> 12) & 0x3F));
+					out[length + 2] = (uint8) (0x80 | ((wc >> 6) & 0x3F));
+					out[length + 3] = (uint8) (0x80 | (wc & 0x3F));
+					break;
+			}
 		}
+
+		length += n;
 	}
+
+	return length;
+}
+
+int freerdp_utf8_to_utf16(const char* src, int src_length, uint8* dst, int dst_length)
+{
+	int i;
+	int n;
+	int length;
+	uint32 wc;
+	const uint8* in;
+#ifdef WITH_SSE2
+	__m128i v;
+	__m128i zero = _mm_setzero_si128();
 #endif
 
-	if (conv_in_len > 0)
+	i = 0;
+	length = 0;
+	in = (const uint8*) src;
+
+	while (i < src_length)
 	{
-		printf("freerdp_uniconv_in: conversion failure - %d chars left\n", (int) conv_in_len);
+#ifdef WITH_SSE2
+		/* ASCII runs, 16 bytes at a time */
+		while (i + 16 <= src_length)
+		{
+			v = _mm_loadu_si128((__m128i*) &in[i]);
+
+			if (_mm_movemask_epi8(v) != 0)
+				break;
+
+			if (dst != NULL)
+			{
+				if (length + 32 > dst_length)
+					return -1;
+
+				_mm_storeu_si128((__m128i*) &dst[length], _mm_unpacklo_epi8(v, zero));
+				_mm_storeu_si128((__m128i*) &dst[length + 16], _mm_unpackhi_epi8(v, zero));
+			}
+
+			length += 32;
+			i += 16;
+		}
+
+		if (i >= src_length)
+			break;
+#endif
+		i += freerdp_utf8_decode(&in[i], src_length - i, &wc);
+		n = (wc > 0xFFFF) ? 4 : 2;
+
+		if (dst != NULL)
+		{
+			if (length + n > dst_length)
+				return -1;
+
+			if (n == 4)
+			{
+				wc -= 0x10000;
+				dst[length] = (uint8) ((wc >> 10) & 0xFF);
+				dst[length + 1] = (uint8) (0xD8 | (wc >> 18));
+				dst[length + 2] = (uint8) (wc & 0xFF);
+				dst[length + 3] = (uint8) (0xDC | ((wc >> 8) & 0x03));
+			}
+			else
+			{
+				dst[length] = (uint8) (wc & 0xFF);
+				dst[length + 1] = (uint8) (wc >> 8);
+			}
+		}
+
+		length += n;
 	}
 
-	*conv_pout = 0;
+	return length;
+}
+
+/* Convert pin/in_len from WINDOWS_CODEPAGE - return like xstrdup, 0-terminated */
+
+char* freerdp_uniconv_in(UNICONV* uniconv, unsigned char* pin, size_t in_len)
+{
+	int length;
+	char* pout;
+
+	length = freerdp_utf16_to_utf8(pin, (int) in_len, NULL, 0);
+	pout = (char*) xmalloc(length + 1);
+	freerdp_utf16_to_utf8(pin, (int) in_len, pout, length);
+	pout[length] = 0;
+
 	return pout;
 }
 
@@ -100,11 +285,9 @@ char* freerdp_uniconv_in(UNICONV* uniconv, unsigned char* pin, size_t in_len)
 
 char* freerdp_uniconv_out(UNICONV* uniconv, const char *str, size_t* pout_len)
 {
-	size_t ibl;
-	size_t obl;
-	char* pin;
+	int length;
+	int str_length;
 	char* pout;
-	char* pout0;
 
 	if (str == NULL)
 	{
@@ -112,75 +295,17 @@ char* freerdp_uniconv_out(UNICONV* uniconv, const char *str, size_t* pout_len)
 		return NULL;
 	}
 
-	ibl = strlen(str);
-	obl = 2 * ibl;
-	pin = (char*) str;
-	pout0 = xmalloc(obl + 2);
-	pout = pout0;
+	str_length = strlen(str);
+	length = freerdp_utf8_to_utf16(str, str_length, NULL, 0);
+	pout = (char*) xmalloc(length + 2);
+	freerdp_utf8_to_utf16(str, str_length, (uint8*) pout, length);
 
-#ifdef HAVE_ICONV
-	if (iconv(uniconv->out_iconv_h, (ICONV_CONST char **) &pin, &ibl, &pout, &obl) == (size_t) - 1)
-	{
-		printf("freerdp_uniconv_out: iconv() error\n");
-		return NULL;
-	}
-#else
-	while ((ibl > 0) && (obl > 0))
-	{
-		unsigned int wc;
+	/* Add extra double zero termination */
+	pout[length] = 0;
+	pout[length + 1] = 0;
+	*pout_len = length;
 
-		wc = (unsigned int)(unsigned char)(*pin++);
-		ibl--;
-		if (wc >= 0xF0)
-		{
-			wc = (wc - 0xF0) << 18;
-			wc += ((unsigned int)(unsigned char)(*pin++) - 0x80) << 12;
-			wc += ((unsigned int)(unsigned char)(*pin++) - 0x80) << 6;
-			wc += ((unsigned int)(unsigned char)(*pin++) - 0x80);
-			ibl -= 3;
-		}
-		else if (wc >= 0xE0)
-		{
-			wc = (wc - 0xE0) << 12;
-			wc += ((unsigned int)(unsigned char)(*pin++) - 0x80) << 6;
-			wc += ((unsigned int)(unsigned char)(*pin++) - 0x80);
-			ibl -= 2;
-		}
-		else if (wc >= 0xC0)
-		{
-			wc = (wc - 0xC0) << 6;
-			wc += ((unsigned int)(unsigned char)(*pin++) - 0x80);
-			ibl -= 1;
-		}
-
-		if (wc <= 0xFFFF)
-		{
-			*pout++ = (char)(wc & 0xFF);
-			*pout++ = (char)(wc >> 8);
-			obl -= 2;
-		}
-		else
-		{
-			wc -= 0x10000;
-			*pout++ = (char)((wc >> 10) & 0xFF);
-			*pout++ = (char)((wc >> 18) + 0xD8);
-			*pout++ = (char)(wc & 0xFF);
-			*pout++ = (char)(((wc >> 8) & 0x03) + 0xDC);
-			obl -= 4;
-		}
-	}
-#endif
-
-	if (ibl > 0)
-	{
-		printf("freerdp_uniconv_out: string not fully converted - %d chars left\n", (int) ibl);
-	}
-
-	*pout_len = pout - pout0;
-	*pout++ = 0; /* Add extra double zero termination */
-	*pout = 0;
-
-	return pout0;
+	return pout;
 }
 
 /* Uppercase a unicode string */
@@ -210,35 +335,17 @@ void freerdp_uniconv_uppercase(UNICONV *uniconv, char *wstr, int length)
 	}
 }
 
+/**
+ * Conversions no longer go through iconv, a converter holds no state
+ * and is only kept for the existing interface.
+ */
+
 UNICONV* freerdp_uniconv_new()
 {
-	UNICONV *uniconv = xnew(UNICONV);
-
-#ifdef HAVE_ICONV
-	uniconv->iconv = 1;
-	uniconv->in_iconv_h = iconv_open(DEFAULT_CODEPAGE, WINDOWS_CODEPAGE);
-	if (errno == EINVAL)
-	{
-		printf("Error opening iconv converter to %s from %s\n", DEFAULT_CODEPAGE, WINDOWS_CODEPAGE);
-	}
-	uniconv->out_iconv_h = iconv_open(WINDOWS_CODEPAGE, DEFAULT_CODEPAGE);
-	if (errno == EINVAL)
-	{
-		printf("Error opening iconv converter to %s from %s\n", WINDOWS_CODEPAGE, DEFAULT_CODEPAGE);
-	}
-#endif
-
-	return uniconv;
+	return xnew(UNICONV);
 }
 
 void freerdp_uniconv_free(UNICONV *uniconv)
 {
-	if (uniconv != NULL)
-	{
-#ifdef HAVE_ICONV
-		iconv_close(uniconv->in_iconv_h);
-		iconv_close(uniconv->out_iconv_h);
-#endif
-		xfree(uniconv);
-	}
+	xfree(uniconv);
 }
@@ -36,6 +36,7 @@
 
 extern char* xf_pcap_file;
 extern boolean xf_pcap_dump_realtime;
+extern uint32 xf_target_bitrate;
 
 #include "xf_event.h"
 #include "xf_input.h"
@@ -261,8 +262,15 @@ void xf_peer_context_new(freerdp_peer* client, xfPeerContext* context)
 	context->rfx_context->mode = RLGR3;
 	context->rfx_context->width = context->info->width;
 	context->rfx_context->height = context->info->height;
+	context->rfx_context->metrics = context->_p.metrics;
 
 	rfx_context_set_pixel_format(context->rfx_context, RDP_PIXEL_FORMAT_B8G8R8A8);
+	rfx_context_set_tile_cache(context->rfx_context, true);
+	rfx_context_set_rate_control(context->rfx_context, true, xf_target_bitrate);
+
+	/* without XShm, damaged areas are copied into a full screen image for the tile cache, filled on activation */
+	if (!context->info->use_xshm)
+		context->frame = (uint8*) xzalloc(context->info->width * context->info->height * context->info->bytesPerPixel);
 
 	context->s = stream_new(65536);
 }
@@ -273,6 +281,7 @@ void xf_peer_context_free(freerdp_peer* client, xfPeerContext* context)
 	{
 		stream_free(context->s);
 		rfx_context_free(context->rfx_context);
+		xfree(context->frame);
 	}
 }
 
@@ -391,9 +400,11 @@ void xf_peer_dump_rfx(freerdp_peer* client)
 
 void xf_peer_rfx_update(freerdp_peer* client, int x, int y, int width, int height)
 {
+	int i;
 	STREAM* s;
 	uint8* data;
 	xfInfo* xfi;
+	int rowstride;
 	RFX_RECT rect;
 	XImage* image;
 	rdpUpdate* update;
@@ -410,54 +421,52 @@ void xf_peer_rfx_update(freerdp_peer* client, int x, int y, int width, int heigh
 
 	s = xf_peer_stream_init(xfp);
 
-	if (xfi->use_xshm)
-	{
-		/**
-		 * Passing an offset source rectangle to rfx_compose_message()
-		 * leads to protocol errors, so offset the data pointer instead.
-		 */
-		rect.x = 0;
-		rect.y = 0;
-		rect.width = width;
-		rect.height = height;
+	rect.x = x;
+	rect.y = y;
+	rect.width = width;
+	rect.height = height;
 
-		image = xf_snapshot(xfp, x, y, width, height);
+	image = xf_snapshot(xfp, x, y, width, height);
 
+	if (xfi->use_xshm)
+	{
+		/* the shared image holds the whole screen */
 		data = (uint8*) image->data;
-		data = &data[(y * image->bytes_per_line) + (x * image->bits_per_pixel / 8)];
-
-		rfx_compose_message(xfp->rfx_context, s, &rect, 1, data,
-				width, height, image->bytes_per_line);
-
-		cmd->destLeft = x;
-		cmd->destTop = y;
-		cmd->destRight = x + width;
-		cmd->destBottom = y + height;
+		rowstride = image->bytes_per_line;
 	}
 	else
 	{
-		rect.x = 0;
-		rect.y = 0;
-		rect.width = width;
-		rect.height = height;
-
-		image = xf_snapshot(xfp, x, y, width, height);
+		rowstride = xfi->width * xfi->bytesPerPixel;
 
-		rfx_compose_message(xfp->rfx_context, s, &rect, 1,
-				(uint8*) image->data, width, height, width * xfi->bytesPerPixel);
-
-		cmd->destLeft = x;
-		cmd->destTop = y;
-		cmd->destRight = x + width;
-		cmd->destBottom = y + height;
+		for (i = 0; i < height; i++)
+		{
+			memcpy(&xfp->frame[((y + i) * rowstride) + (x * xfi->bytesPerPixel)],
+					&image->data[i * image->bytes_per_line], width * xfi->bytesPerPixel);
+		}
 
 		XDestroyImage(image);
+		data = xfp->frame;
 	}
 
+	/**
+	 * The message covers the whole screen, tiles sit at fixed positions
+	 * so the tile cache can leave out those the damage did not change.
+	 */
+	rfx_compose_message(xfp->rfx_context, s, &rect, 1, data,
+			xfi->width, xfi->height, rowstride);
+
+	if (stream_get_length(s) == 0)
+		return;
+
+	cmd->destLeft = 0;
+	cmd->destTop = 0;
+	cmd->destRight = xfi->width;
+	cmd->destBottom = xfi->height;
+
 	cmd->bpp = 32;
 	cmd->codecID = client->settings->rfx_codec_id;
-	cmd->width = width;
-	cmd->height = height;
+	cmd->width = xfi->width;
+	cmd->height = xfi->height;
 	cmd->bitmapDataLength = stream_get_length(s);
 	cmd->bitmapData = stream_get_head(s);
 
@@ -579,6 +588,12 @@ boolean xf_peer_activate(freerdp_peer* client)
 	rfx_context_reset(xfp->rfx_context);
 	xfp->activated = true;
 
+	/**
+	 * The client starts from a blank screen, and the tile cache needs the
+	 * whole screen in the shadow frame, so the first update grabs all of it.
+	 */
+	gdi_InvalidateRegion(xfp->hdc, 0, 0, xfp->info->width, xfp->info->height);
+
 	if (xf_pcap_file != NULL)
 	{
 		client->update->dump_rfx = true;
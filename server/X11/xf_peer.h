@@ -41,6 +41,7 @@ struct xf_peer_context
 	HGDI_DC hdc;
 	xfInfo* info;
 	int activations;
+	uint8* frame;
 	pthread_t thread;
 	boolean activated;
 	pthread_mutex_t mutex;
@@ -33,6 +33,7 @@
 
 char* xf_pcap_file = NULL;
 boolean xf_pcap_dump_realtime = true;
+uint32 xf_target_bitrate = 0;
 
 void xf_server_main_loop(freerdp_listener* instance)
 {
@@ -96,6 +97,7 @@ void xf_server_main_loop(freerdp_listener* instance)
 
 int main(int argc, char* argv[])
 {
+	int index;
 	freerdp_listener* instance;
 
 	/* ignore SIGPIPE, otherwise an SSL_write failure could crash the server */
@@ -104,11 +106,30 @@ int main(int argc, char* argv[])
 	instance = freerdp_listener_new();
 	instance->PeerAccepted = xf_peer_accepted;
 
-	if (argc > 1)
-		xf_pcap_file = argv[1];
+	for (index = 1; index < argc; index++)
+	{
+		if (strcmp(argv[index], "--fast") == 0)
+		{
+			xf_pcap_dump_realtime = false;
+		}
+		else if (strcmp(argv[index], "--bitrate") == 0)
+		{
+			index++;
 
-	if (argc > 2 && !strcmp(argv[2], "--fast"))
-		xf_pcap_dump_realtime = false;
+			if (index == argc)
+			{
+				printf("missing target bitrate\n");
+				return 1;
+			}
+
+			/* kilobits per second */
+			xf_target_bitrate = atoi(argv[index]) * 1000;
+		}
+		else
+		{
+			xf_pcap_file = argv[index];
+		}
+	}
 
 	/* Open the server socket and start listening. */
 	if (instance->Open(instance, NULL, 3389))
@@ -278,6 +278,7 @@ static void rdpsnd_server_select_format(rdpsnd_server_context* context, int clie
 	}
 
 	freerdp_dsp_context_reset_adpcm(rdpsnd->dsp_context);
+	freerdp_dsp_context_reset_resampler(rdpsnd->dsp_context);
 }
 
 static boolean rdpsnd_server_send_audio_pdu(rdpsnd_server* rdpsnd)
@@ -24,6 +24,7 @@
 #include <errno.h>
 #include <pthread.h>
 #include <signal.h>
+#include <unistd.h>
 #include <sys/time.h>
 #include <freerdp/constants.h>
 #include <freerdp/utils/sleep.h>
@@ -32,11 +33,13 @@
 #include <freerdp/codec/rfx.h>
 #include <freerdp/codec/nsc.h>
 #include <freerdp/listener.h>
+#include <freerdp/event_loop.h>
 #include <freerdp/channels/wtsvc.h>
 #include <freerdp/server/audin.h>
 
 static char* test_pcap_file = NULL;
 static boolean test_dump_rfx_realtime = true;
+static rdpEventLoop* test_event_loop = NULL;
 
 /* HL1, LH1, HH1, HL2, LH2, HH2, HL3, LH3, HH3, LL3 */
 static const unsigned int test_quantization_values[] =
@@ -87,9 +90,11 @@ void test_peer_context_new(freerdp_peer* client, testPeerContext* context)
 	context->rfx_context->mode = RLGR3;
 	context->rfx_context->width = client->settings->width;
 	context->rfx_context->height = client->settings->height;
+	context->rfx_context->metrics = context->_p.metrics;
 	rfx_context_set_pixel_format(context->rfx_context, RDP_PIXEL_FORMAT_R8G8B8);
 
 	context->nsc_context = nsc_context_new();
+	context->nsc_context->metrics = context->_p.metrics;
 	nsc_context_set_pixel_format(context->nsc_context, RDP_PIXEL_FORMAT_R8G8B8);
 
 	context->s = stream_new(65536);
@@ -668,19 +673,8 @@ static void tf_peer_suppress_output(rdpContext* context, uint8 allow, RECTANGLE_
 	}
 }
 
-static void* test_peer_mainloop(void* arg)
+static void test_peer_setup(freerdp_peer* client)
 {
-	int i;
-	int fds;
-	int max_fds;
-	int rcount;
-	void* rfds[32];
-	fd_set rfds_set;
-	testPeerContext* context;
-	freerdp_peer* client = (freerdp_peer*) arg;
-
-	memset(rfds, 0, sizeof(rfds));
-
 	test_peer_init(client);
 
 	/* Initialize the real server settings here */
@@ -704,9 +698,25 @@ static void* test_peer_mainloop(void* arg)
 	client->update->SuppressOutput = tf_peer_suppress_output;
 
 	client->Initialize(client);
-	context = (testPeerContext*) client->context;
 
 	printf("We've got a client %s\n", client->local ? "(local)" : client->hostname);
+}
+
+static void* test_peer_mainloop(void* arg)
+{
+	int i;
+	int fds;
+	int max_fds;
+	int rcount;
+	void* rfds[32];
+	fd_set rfds_set;
+	testPeerContext* context;
+	freerdp_peer* client = (freerdp_peer*) arg;
+
+	memset(rfds, 0, sizeof(rfds));
+
+	test_peer_setup(client);
+	context = (testPeerContext*) client->context;
 
 	while (1)
 	{
@@ -763,12 +773,52 @@ static void* test_peer_mainloop(void* arg)
 	return NULL;
 }
 
+static boolean test_peer_check_vcm(void* arg)
+{
+	return WTSVirtualChannelManagerCheckFileDescriptor((WTSVirtualChannelManager*) arg);
+}
+
+static void test_peer_closed(freerdp_peer* client)
+{
+	printf("Client %s disconnected.\n", client->local ? "(local)" : client->hostname);
+
+	client->Disconnect(client);
+	freerdp_peer_context_free(client);
+	freerdp_peer_free(client);
+}
+
 static void test_peer_accepted(freerdp_listener* instance, freerdp_peer* client)
 {
 	pthread_t th;
+	int rcount;
+	void* rfds[32];
+	rdpEventSession* session;
+	testPeerContext* context;
 
-	pthread_create(&th, 0, test_peer_mainloop, client);
-	pthread_detach(th);
+	if (test_event_loop == NULL)
+	{
+		pthread_create(&th, 0, test_peer_mainloop, client);
+		pthread_detach(th);
+		return;
+	}
+
+	/* the peer is serviced by the event loop workers, no thread of its own */
+	test_peer_setup(client);
+	context = (testPeerContext*) client->context;
+
+	session = freerdp_event_session_new(client, test_peer_closed);
+
+	if (session == NULL)
+	{
+		test_peer_closed(client);
+		return;
+	}
+
+	rcount = 0;
+	WTSVirtualChannelManagerGetFileDescriptor(context->vcm, rfds, &rcount);
+	freerdp_event_session_add_fds(session, rfds, rcount, test_peer_check_vcm, context->vcm);
+
+	freerdp_event_loop_add_session(test_event_loop, session);
 }
 
 static void test_server_mainloop(freerdp_listener* instance)
@@ -831,8 +881,21 @@ static void test_server_mainloop(freerdp_listener* instance)
 	instance->Close(instance);
 }
 
+static void test_server_event_loop(freerdp_listener* instance)
+{
+	if (freerdp_event_loop_add_listener(test_event_loop, instance))
+		freerdp_event_loop_run(test_event_loop);
+
+	freerdp_event_loop_free(test_event_loop);
+	test_event_loop = NULL;
+
+	instance->Close(instance);
+}
+
 int main(int argc, char* argv[])
 {
+	int index;
+	boolean event_loop = false;
 	freerdp_listener* instance;
 
 	/* Ignore SIGPIPE, otherwise an SSL_write failure could crash your server */
@@ -842,18 +905,29 @@ int main(int argc, char* argv[])
 
 	instance->PeerAccepted = test_peer_accepted;
 
-	if (argc > 1)
-		test_pcap_file = argv[1];
-	
-	if (argc > 2 && !strcmp(argv[2], "--fast"))
-		test_dump_rfx_realtime = false;
+	for (index = 1; index < argc; index++)
+	{
+		if (!strcmp(argv[index], "--fast"))
+			test_dump_rfx_realtime = false;
+		else if (!strcmp(argv[index], "--event-loop"))
+			event_loop = true;
+		else
+			test_pcap_file = argv[index];
+	}
+
+	/* Serve all peers from a few worker threads instead of one thread per peer. */
+	if (event_loop)
+		test_event_loop = freerdp_event_loop_new((int) sysconf(_SC_NPROCESSORS_ONLN));
 
 	/* Open the server socket and start listening. */
 	if (instance->Open(instance, NULL, 3389) &&
 		instance->OpenLocal(instance, "/tmp/tfreerdp-server.0"))
 	{
 		/* Entering the server main loop. In a real server the listener can be run in its own thread. */
-		test_server_mainloop(instance);
+		if (test_event_loop != NULL)
+			test_server_event_loop(instance);
+		else
+			test_server_mainloop(instance);
 	}
 
 	freerdp_listener_free(instance);
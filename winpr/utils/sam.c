@@ -20,16 +20,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
 
 #include <winpr/crt.h>
 #include <winpr/sam.h>
 #include <winpr/print.h>
 
+#ifndef WINPR_SAM_FILE
 #ifdef _WIN32
 #define WINPR_SAM_FILE		"C:\\SAM"
 #else
 #define WINPR_SAM_FILE		"/etc/winpr/SAM"
 #endif
+#endif
 
 WINPR_SAM* SamOpen(BOOL read_only)
 {
@@ -191,139 +200,349 @@ void SamFreeEntry(WINPR_SAM* sam, WINPR_SAM_ENTRY* entry)
 	}
 }
 
-WINPR_SAM_ENTRY* SamLookupUserA(WINPR_SAM* sam, LPSTR User, UINT32 UserLength, LPSTR Domain, UINT32 DomainLength)
+/**
+ * Lookups go through a copy of the SAM file parsed once into a hash table,
+ * which is reloaded when the file changes: a different inode, size, change
+ * time or modification time, the latter to the nanosecond where available. Entries are chained in file order under a hash of the upper case
+ * UTF-16 user name, so that a lookup without a domain finds the first entry
+ * of the user. The table is shared by all threads under a read/write lock,
+ * and callers get their own copy of the entry they looked up.
+ */
+
+struct winpr_sam_cache_entry
 {
-	int length;
-	BOOL found = 0;
-	WINPR_SAM_ENTRY* entry;
+	WINPR_SAM_ENTRY entry;
+	UINT32 Hash;
+	LPWSTR User;
+	UINT32 UserLength;
+	LPWSTR Domain;
+	UINT32 DomainLength;
+	struct winpr_sam_cache_entry* next;
+};
+typedef struct winpr_sam_cache_entry WINPR_SAM_CACHE_ENTRY;
+
+struct winpr_sam_cache
+{
+	BOOL loaded;
+	time_t mtime;
+	long mtime_nsec;
+	time_t ctime;
+	UINT64 ino;
+	UINT64 size;
+	UINT32 mask;
+	WINPR_SAM_CACHE_ENTRY** buckets;
+};
+typedef struct winpr_sam_cache WINPR_SAM_CACHE;
+
+static WINPR_SAM_CACHE sam_cache;
+
+#if defined(__APPLE__)
+#define SAM_STAT_MTIME_NSEC(_st)	((long) (_st)->st_mtimespec.tv_nsec)
+#elif defined(_WIN32)
+#define SAM_STAT_MTIME_NSEC(_st)	0L
+#else
+#define SAM_STAT_MTIME_NSEC(_st)	((long) (_st)->st_mtim.tv_nsec)
+#endif
 
-	entry = (WINPR_SAM_ENTRY*) malloc(sizeof(WINPR_SAM_ENTRY));
+#ifdef _WIN32
+static SRWLOCK sam_cache_lock = SRWLOCK_INIT;
+#define SamCacheLockShared()		AcquireSRWLockShared(&sam_cache_lock)
+#define SamCacheUnlockShared()		ReleaseSRWLockShared(&sam_cache_lock)
+#define SamCacheLockExclusive()		AcquireSRWLockExclusive(&sam_cache_lock)
+#define SamCacheUnlockExclusive()	ReleaseSRWLockExclusive(&sam_cache_lock)
+#else
+static pthread_rwlock_t sam_cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+#define SamCacheLockShared()		pthread_rwlock_rdlock(&sam_cache_lock)
+#define SamCacheUnlockShared()		pthread_rwlock_unlock(&sam_cache_lock)
+#define SamCacheLockExclusive()		pthread_rwlock_wrlock(&sam_cache_lock)
+#define SamCacheUnlockExclusive()	pthread_rwlock_unlock(&sam_cache_lock)
+#endif
+
+/* FNV-1a */
 
-	SamLookupStart(sam);
+static UINT32 SamHashW(LPWSTR str, UINT32 length)
+{
+	UINT32 i;
+	UINT32 hash = 2166136261U;
 
-	while (sam->line != NULL)
+	for (i = 0; i < length; i++)
 	{
-		length = strlen(sam->line);
+		hash ^= ((BYTE*) str)[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/* Upper case UTF-16 copy of a UTF-16 string, lengths are in bytes */
+
+static LPWSTR SamUpperW(LPWSTR str, UINT32 length)
+{
+	LPWSTR upper;
+
+	upper = (LPWSTR) malloc(length + 2);
+	CopyMemory(upper, str, length);
+	CharUpperBuffW(upper, length / 2);
+
+	return upper;
+}
+
+/* Upper case UTF-16 copy of a UTF-8 string, length is in bytes */
 
-		if (length > 1)
+static LPWSTR SamUpperA(LPSTR str, UINT32 length, UINT32* pLength)
+{
+	int count;
+	LPWSTR upper;
+
+	upper = (LPWSTR) malloc((length + 1) * 2);
+	count = (length > 0) ? MultiByteToWideChar(CP_UTF8, 0, str, length, upper, length) : 0;
+	CharUpperBuffW(upper, count);
+	*pLength = count * 2;
+
+	return upper;
+}
+
+static void SamCacheFree(WINPR_SAM_CACHE* cache)
+{
+	UINT32 i;
+	WINPR_SAM_CACHE_ENTRY* next;
+	WINPR_SAM_CACHE_ENTRY* cache_entry;
+
+	if (cache->buckets != NULL)
+	{
+		for (i = 0; i <= cache->mask; i++)
 		{
-			if (sam->line[0] != '#')
+			for (cache_entry = cache->buckets[i]; cache_entry != NULL; cache_entry = next)
 			{
-				SamReadEntry(sam, entry);
+				next = cache_entry->next;
 
-				if (strcmp(User, entry->User) == 0)
-				{
-					found = 1;
-					break;
-				}
+				free(cache_entry->entry.User);
+				free(cache_entry->entry.Domain);
+				free(cache_entry->User);
+				free(cache_entry->Domain);
+				free(cache_entry);
 			}
 		}
 
-		sam->line = strtok(NULL, "\n");
+		free(cache->buckets);
 	}
 
-	SamLookupFinish(sam);
+	ZeroMemory(cache, sizeof(WINPR_SAM_CACHE));
+}
 
-	if (!found)
-	{
-		free(entry);
-		return NULL;
-	}
+static void SamCacheSetStat(WINPR_SAM_CACHE* cache, struct stat* st)
+{
+	cache->mtime = st->st_mtime;
+	cache->mtime_nsec = SAM_STAT_MTIME_NSEC(st);
+	cache->ctime = st->st_ctime;
+	cache->ino = (UINT64) st->st_ino;
+	cache->size = (UINT64) st->st_size;
+}
 
-	return entry;
+/* whole second timestamps alone miss a rewrite of the same size within the second */
+static BOOL SamCacheIsCurrent(WINPR_SAM_CACHE* cache, struct stat* st)
+{
+	return cache->loaded &&
+		(cache->mtime == st->st_mtime) &&
+		(cache->mtime_nsec == SAM_STAT_MTIME_NSEC(st)) &&
+		(cache->ctime == st->st_ctime) &&
+		(cache->ino == (UINT64) st->st_ino) &&
+		(cache->size == (UINT64) st->st_size);
 }
 
-WINPR_SAM_ENTRY* SamLookupUserW(WINPR_SAM* sam, LPWSTR User, UINT32 UserLength, LPWSTR Domain, UINT32 DomainLength)
+static void SamCacheLoad(WINPR_SAM_CACHE* cache, struct stat* st)
 {
-	int length;
-	BOOL Found = 0;
-	BOOL UserMatch;
-	BOOL DomainMatch;
-	LPWSTR EntryUser;
-	UINT32 EntryUserLength;
-	LPWSTR EntryDomain;
-	UINT32 EntryDomainLength;
-	WINPR_SAM_ENTRY* entry;
+	int i;
+	int count;
+	char* end;
+	char* line;
+	char* buffer;
+	size_t length;
+	FILE* fp;
+	WINPR_SAM sam;
+	WINPR_SAM_CACHE_ENTRY* cache_entry;
+	WINPR_SAM_CACHE_ENTRY** entries;
+
+	SamCacheFree(cache);
 
-	entry = (WINPR_SAM_ENTRY*) malloc(sizeof(WINPR_SAM_ENTRY));
+	/* an unreadable file is cached as an empty one until it changes */
+	cache->loaded = TRUE;
+	SamCacheSetStat(cache, st);
 
-	SamLookupStart(sam);
+	count = 0;
+	entries = NULL;
+	buffer = NULL;
 
-	while (sam->line != NULL)
+	fp = fopen(WINPR_SAM_FILE, "r");
+
+	if (fp != NULL)
 	{
-		length = strlen(sam->line);
+		/* the file may have been replaced since it was checked, key the cache on what is read */
+		if (fstat(fileno(fp), st) == 0)
+			SamCacheSetStat(cache, st);
+
+		buffer = (char*) malloc((size_t) st->st_size + 1);
+		length = fread(buffer, 1, (size_t) st->st_size, fp);
+		buffer[length] = '\0';
+		fclose(fp);
 
-		if (length > 1)
+		entries = (WINPR_SAM_CACHE_ENTRY**) malloc(sizeof(WINPR_SAM_CACHE_ENTRY*) * (length / 6 + 1));
+		ZeroMemory(&sam, sizeof(WINPR_SAM));
+
+		for (line = buffer; *line != '\0'; line = end)
 		{
-			if (sam->line[0] != '#')
+			end = line + strcspn(line, "\r\n");
+
+			if (*end != '\0')
+				*end++ = '\0';
+
+			/* comments, lines without a user name and lines without all the fields */
+			if (line[0] == '\0' || line[0] == '#' || line[0] == ':')
+				continue;
+
+			sam.line = strchr(line, ':');
+
+			for (i = 1; (i < 5) && (sam.line != NULL); i++)
+				sam.line = strchr(sam.line + 1, ':');
+
+			if (sam.line == NULL)
+				continue;
+
+			sam.line = line;
+			cache_entry = (WINPR_SAM_CACHE_ENTRY*) malloc(sizeof(WINPR_SAM_CACHE_ENTRY));
+			ZeroMemory(cache_entry, sizeof(WINPR_SAM_CACHE_ENTRY));
+			SamReadEntry(&sam, &cache_entry->entry);
+
+			cache_entry->User = SamUpperA(cache_entry->entry.User,
+					cache_entry->entry.UserLength, &cache_entry->UserLength);
+
+			if (cache_entry->entry.DomainLength > 0)
 			{
-				DomainMatch = 0;
-				UserMatch = 0;
-
-				entry = SamReadEntry(sam, entry);
-
-				if (DomainLength > 0)
-				{
-					if (entry->DomainLength > 0)
-					{
-						EntryDomainLength = strlen(entry->Domain) * 2;
-						EntryDomain = (LPWSTR) malloc(EntryDomainLength + 2);
-						MultiByteToWideChar(CP_ACP, 0, entry->Domain, EntryDomainLength / 2,
-								(LPWSTR) EntryDomain, EntryDomainLength / 2);
-
-						if (DomainLength == EntryDomainLength)
-						{
-							if (memcmp(Domain, EntryDomain, DomainLength) == 0)
-							{
-								DomainMatch = 1;
-							}
-						}
-					}
-					else
-					{
-						DomainMatch = 0;
-					}
-				}
-				else
-				{
-					DomainMatch = 1;
-				}
-
-				if (DomainMatch)
-				{
-					EntryUserLength = strlen(entry->User) * 2;
-					EntryUser = (LPWSTR) malloc(EntryUserLength + 2);
-					MultiByteToWideChar(CP_ACP, 0, entry->User, EntryUserLength / 2,
-							(LPWSTR) EntryUser, EntryUserLength / 2);
-
-					if (UserLength == EntryUserLength)
-					{
-						if (memcmp(User, EntryUser, UserLength) == 0)
-						{
-							UserMatch = 1;
-						}
-					}
-
-					if (UserMatch && DomainMatch)
-					{
-						Found = 1;
-						break;
-					}
-				}
+				cache_entry->Domain = SamUpperA(cache_entry->entry.Domain,
+						cache_entry->entry.DomainLength, &cache_entry->DomainLength);
 			}
+
+			cache_entry->Hash = SamHashW(cache_entry->User, cache_entry->UserLength);
+			entries[count++] = cache_entry;
 		}
 
-		sam->line = strtok(NULL, "\n");
+		free(buffer);
 	}
 
-	SamLookupFinish(sam);
+	for (cache->mask = 15; cache->mask < count * 2; cache->mask = (cache->mask << 1) | 1);
+
+	cache->buckets = (WINPR_SAM_CACHE_ENTRY**) malloc(sizeof(WINPR_SAM_CACHE_ENTRY*) * (cache->mask + 1));
+	ZeroMemory(cache->buckets, sizeof(WINPR_SAM_CACHE_ENTRY*) * (cache->mask + 1));
 
-	if (!Found)
+	/* insert from the end so that every chain is in file order */
+	for (i = count - 1; i >= 0; i--)
 	{
-		free(entry);
+		cache_entry = entries[i];
+		cache_entry->next = cache->buckets[cache_entry->Hash & cache->mask];
+		cache->buckets[cache_entry->Hash & cache->mask] = cache_entry;
+	}
+
+	free(entries);
+}
+
+static WINPR_SAM_ENTRY* SamCacheFind(WINPR_SAM_CACHE* cache, LPWSTR User, UINT32 UserLength, LPWSTR Domain, UINT32 DomainLength)
+{
+	UINT32 hash;
+	WINPR_SAM_ENTRY* entry;
+	WINPR_SAM_CACHE_ENTRY* cache_entry;
+
+	hash = SamHashW(User, UserLength);
+
+	for (cache_entry = cache->buckets[hash & cache->mask]; cache_entry != NULL; cache_entry = cache_entry->next)
+	{
+		if ((cache_entry->Hash != hash) || (cache_entry->UserLength != UserLength) ||
+				(memcmp(cache_entry->User, User, UserLength) != 0))
+			continue;
+
+		if (DomainLength > 0)
+		{
+			if ((cache_entry->DomainLength != DomainLength) ||
+					(memcmp(cache_entry->Domain, Domain, DomainLength) != 0))
+				continue;
+		}
+
+		entry = (WINPR_SAM_ENTRY*) malloc(sizeof(WINPR_SAM_ENTRY));
+		CopyMemory(entry, &cache_entry->entry, sizeof(WINPR_SAM_ENTRY));
+		entry->User = _strdup(cache_entry->entry.User);
+		entry->Domain = (entry->DomainLength > 0) ? _strdup(cache_entry->entry.Domain) : NULL;
+
+		return entry;
+	}
+
+	return NULL;
+}
+
+/* User and Domain are upper case UTF-16, lengths are in bytes */
+
+static WINPR_SAM_ENTRY* SamLookupUser(LPWSTR User, UINT32 UserLength, LPWSTR Domain, UINT32 DomainLength)
+{
+	struct stat st;
+	WINPR_SAM_ENTRY* entry;
+
+	if (stat(WINPR_SAM_FILE, &st) != 0)
 		return NULL;
+
+	SamCacheLockShared();
+
+	if (SamCacheIsCurrent(&sam_cache, &st))
+	{
+		entry = SamCacheFind(&sam_cache, User, UserLength, Domain, DomainLength);
+		SamCacheUnlockShared();
+
+		return entry;
 	}
 
+	SamCacheUnlockShared();
+	SamCacheLockExclusive();
+
+	/* another thread may have reloaded it in the meantime */
+	if (!SamCacheIsCurrent(&sam_cache, &st))
+		SamCacheLoad(&sam_cache, &st);
+
+	entry = SamCacheFind(&sam_cache, User, UserLength, Domain, DomainLength);
+	SamCacheUnlockExclusive();
+
+	return entry;
+}
+
+WINPR_SAM_ENTRY* SamLookupUserA(WINPR_SAM* sam, LPSTR User, UINT32 UserLength, LPSTR Domain, UINT32 DomainLength)
+{
+	LPWSTR UserW;
+	LPWSTR DomainW;
+	UINT32 UserLengthW;
+	UINT32 DomainLengthW;
+	WINPR_SAM_ENTRY* entry;
+
+	UserW = SamUpperA(User, UserLength, &UserLengthW);
+	DomainW = SamUpperA(Domain, DomainLength, &DomainLengthW);
+
+	entry = SamLookupUser(UserW, UserLengthW, DomainW, DomainLengthW);
+
+	free(UserW);
+	free(DomainW);
+
+	return entry;
+}
+
+WINPR_SAM_ENTRY* SamLookupUserW(WINPR_SAM* sam, LPWSTR User, UINT32 UserLength, LPWSTR Domain, UINT32 DomainLength)
+{
+	LPWSTR UserW;
+	LPWSTR DomainW;
+	WINPR_SAM_ENTRY* entry;
+
+	UserW = SamUpperW(User, UserLength);
+	DomainW = (DomainLength > 0) ? SamUpperW(Domain, DomainLength) : NULL;
+
+	entry = SamLookupUser(UserW, UserLength, DomainW, DomainLength);
+
+	free(UserW);
+	free(DomainW);
+
 	return entry;
 }
 